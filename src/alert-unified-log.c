@@ -244,7 +244,7 @@ TmEcode AlertUnifiedLog (ThreadVars *tv, Packet *p, void *data, PacketQueue *pq,
             buflen += sizeof(ethh);
         }
 
-        memcpy(buf+buflen,&p->pkt,p->pktlen);
+        memcpy(buf+buflen,GET_PKT_DATA(p),GET_PKT_LEN(p));
         buflen += p->pktlen;
 
         /** Wait for the mutex. We dont want all the threads rotating the file
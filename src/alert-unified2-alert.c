@@ -263,7 +263,7 @@ int Unified2PacketTypeAlert (ThreadVars *t, Packet *p, void *data)
     phdr.packet_length = htonl(p->pktlen);
 
     memcpy(write_buffer+sizeof(Unified2AlertFileHeader),&phdr,sizeof(Unified2Packet) - 4);
-    memcpy(write_buffer + sizeof(Unified2AlertFileHeader) + sizeof(Unified2Packet) - 4 , p->pkt, p->pktlen);
+    memcpy(write_buffer + sizeof(Unified2AlertFileHeader) + sizeof(Unified2Packet) - 4 , GET_PKT_DATA(p), GET_PKT_LEN(p));
 
     ret = fwrite(write_buffer,len, 1, aun->file_ctx->fp);
     if (ret != 1) {
@@ -763,6 +763,7 @@ static int Unified2Test01 (void)   {
     memset(&tv, 0, sizeof(ThreadVars));
     memset(&pq, 0, sizeof(PacketQueue));
     memset(&p, 0, sizeof(Packet));
+    PACKET_ALERTS_RESET(&p);
 
     p.alerts.cnt++;
     p.alerts.alerts[p.alerts.cnt-1].sid = 1;
@@ -832,6 +833,7 @@ static int Unified2Test02 (void)   {
     memset(&tv, 0, sizeof(ThreadVars));
     memset(&pq, 0, sizeof(PacketQueue));
     memset(&p, 0, sizeof(Packet));
+    PACKET_ALERTS_RESET(&p);
 
     p.alerts.cnt++;
     p.alerts.alerts[p.alerts.cnt-1].sid = 1;
@@ -907,6 +909,7 @@ static int Unified2Test03 (void) {
     memset(&tv, 0, sizeof(ThreadVars));
     memset(&pq, 0, sizeof(PacketQueue));
     memset(&p, 0, sizeof(Packet));
+    PACKET_ALERTS_RESET(&p);
 
     p.alerts.cnt++;
     p.alerts.alerts[p.alerts.cnt-1].sid = 1;
@@ -976,6 +979,7 @@ static int Unified2Test04 (void)   {
     memset(&tv, 0, sizeof(ThreadVars));
     memset(&pq, 0, sizeof(PacketQueue));
     memset(&p, 0, sizeof(Packet));
+    PACKET_ALERTS_RESET(&p);
 
     p.alerts.cnt++;
     p.alerts.alerts[p.alerts.cnt-1].sid = 1;
@@ -1043,6 +1047,7 @@ static int Unified2Test05 (void)   {
     memset(&tv, 0, sizeof(ThreadVars));
     memset(&pq, 0, sizeof(PacketQueue));
     memset(&p, 0, sizeof(Packet));
+    PACKET_ALERTS_RESET(&p);
 
     p.alerts.cnt++;
     p.alerts.alerts[p.alerts.cnt-1].sid = 1;
@@ -25,13 +25,6 @@
 #define __DECODE_EVENTS_H__
 
 enum {
-    /* LORAWAN EVENTS */
-    LORAWAN_PKT_TOO_SMALL,
-    LORAWAN_FRAME_HEADER_TOO_BIG,
-    LORAWAN_FRAME_PKT_INVALID,
-    LORAWAN_FRAME_CONTROL_INVALID,
-    LORAWAN_HEADER_INVALID_LEN,
-
     /* IPV4 EVENTS */
     IPV4_PKT_TOO_SMALL = 1,         /**< ipv4 pkt smaller than minimum header size */
     IPV4_HLEN_TOO_SMALL,            /**< ipv4 header smaller than minimum size */
@@ -75,6 +68,18 @@ enum {
      /* RAW EVENTS */
     IPRAW_INVALID_IPV,              /**< invalid ip version in ip raw */
 
+    /* LORAWAN EVENTS */
+    LORAWAN_PKT_TOO_SMALL,          /**< PHYPayload smaller than MHDR + MIC */
+    LORAWAN_FRAME_HEADER_TOO_BIG,   /**< FOptsLen runs past the end of the frame */
+    LORAWAN_FRAME_PKT_INVALID,      /**< data frame smaller than the minimum FHDR */
+    LORAWAN_FRAME_CONTROL_INVALID,  /**< FOpts set while FPort is 0 */
+    LORAWAN_HEADER_INVALID_LEN,     /**< join request/accept of invalid length */
+    LORAWAN_MAJOR_UNKNOWN,          /**< MHDR major version isn't LoRaWAN R1 */
+    LORAWAN_MTYPE_RFU,              /**< reserved MType */
+    LORAWAN_FCNT_REPLAY,            /**< FCnt seen before for this device */
+    LORAWAN_FCNT_ROLLBACK,          /**< FCnt went back past the window */
+    LORAWAN_FCNT_JUMP,              /**< FCnt skipped more than the max gap */
+
 
     /* should always be last! */
     DECODE_EVENT_MAX,
@@ -7,56 +7,243 @@
 #include "decode-events.h"
 #include "defrag.h"
 #include "util-debug.h"
+#include "util-unittest.h"
 #include "decode-lorawan-Mac.h"
+#include "decode-lorawan-frame.h"
+#include "lorawan-session.h"
 
-static int DecodeLorawanMACPacket(ThreadVars *tv, Packet *p, uint8_t *pkt, uint16_t len)
+/**
+ * \brief Decode a Join-Request: JoinEUI(8) | DevEUI(8) | DevNonce(2)
+ */
+static int DecodeLorawanJoinRequest(Packet *p, LorawanHdr *lh, uint8_t *pkt, uint16_t len)
 {
+    if (len != LORAWAN_JOIN_REQUEST_LEN) {
+        DECODER_SET_EVENT(p, LORAWAN_HEADER_INVALID_LEN);
+        return -1;
+    }
 
-	if (len != LORAWAN_MAC_HEADER_LEN){
-		DECODER_SET_EVENT(p,LORAWAN_HEADER_INVALID_LEN);
-		return -1;
-	}
-
-	p->lorawanmh = (LorawanMacHdr *)pkt;
+    lh->join_eui = LORAWAN_GET_LE64(pkt);
+    lh->dev_eui = LORAWAN_GET_LE64(pkt + 8);
+    lh->dev_nonce = LORAWAN_GET_LE16(pkt + 16);
+    lh->flags |= LORAWAN_HDR_HAS_JOIN;
+    return 0;
+}
 
-	p->lorawanmvars->macpayload = pkt + LORAWAN_MAC_HEADER_LEN;
+/**
+ * \brief Decode a Join-Accept. It is encrypted as a whole so all we can
+ *        do is check the length and hand out the payload.
+ */
+static int DecodeLorawanJoinAccept(Packet *p, LorawanHdr *lh, uint8_t *pkt, uint16_t len)
+{
+    if (len != LORAWAN_JOIN_ACCEPT_LEN && len != LORAWAN_JOIN_ACCEPT_CFLIST_LEN) {
+        DECODER_SET_EVENT(p, LORAWAN_HEADER_INVALID_LEN);
+        return -1;
+    }
 
-	return 0;
+    lh->frmpayload = pkt;
+    lh->frmpayload_len = len;
+    return 0;
 }
 
+/**
+ * \brief Decode a LoRaWAN PHYPayload into p->lorawan.
+ *
+ * Single pass over MHDR, MACPayload and MIC for every MType. On success
+ * p->lorawanh points to the parsed view and p->payload to the FRMPayload.
+ * On error p->lorawanh stays NULL and a decoder event is set.
+ *
+ * \param pkt the PHYPayload
+ * \param len length of the PHYPayload
+ */
 void DecodeLorawanMAC(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p, uint8_t *pkt, uint16_t len, PacketQueue *pq)
 {
-	int ret;
+    LorawanHdr *lh = &p->lorawan;
+    uint16_t plen;
+    int ret = 0;
+
+    SCPerfCounterIncr(dtv->counter_lorawan_mac, tv->sc_perf_pca);
+
+    if (len < LORAWAN_MAC_HEADER_LEN + LORAWAN_MIC_LEN) {
+        DECODER_SET_EVENT(p, LORAWAN_PKT_TOO_SMALL);
+        return;
+    }
+
+    memset(lh, 0x00, sizeof(LorawanHdr));
+    lh->mhdr = pkt[0];
+    lh->mtype = LORAWAN_MHDR_GET_MTYPE(lh->mhdr);
+    lh->major = LORAWAN_MHDR_GET_MAJOR(lh->mhdr);
+
+    SCPerfCounterIncr(dtv->counter_lorawan_mtype[lh->mtype], tv->sc_perf_pca);
+
+    if (lh->major != LORAWAN_MAJOR_R1) {
+        DECODER_SET_EVENT(p, LORAWAN_MAJOR_UNKNOWN);
+        return;
+    }
+
+    /* MACPayload sits between MHDR and MIC */
+    plen = len - LORAWAN_MAC_HEADER_LEN - LORAWAN_MIC_LEN;
+    lh->mic = LORAWAN_GET_LE32(pkt + len - LORAWAN_MIC_LEN);
+    pkt += LORAWAN_MAC_HEADER_LEN;
 
-	SCPerfCounterIncr(dtv->counter_lorawan_dataframe, tv->sc_perf_pca);
+    switch (lh->mtype) {
+        case JOIN_REQUEST:
+            ret = DecodeLorawanJoinRequest(p, lh, pkt, plen);
+            break;
+        case JOIN_ACCEPT:
+            ret = DecodeLorawanJoinAccept(p, lh, pkt, plen);
+            break;
+        case UNCONFIRMED_DATA_UP:
+        case UNCONFIRMED_DATA_DOWN:
+        case CONFIRMED_DATA_UP:
+        case CONFIRMED_DATA_DOWN:
+            ret = DecodeLorawanFrame(tv, dtv, p, pkt, plen, pq);
+            break;
+        case MTYPE_RFU:
+            DECODER_SET_EVENT(p, LORAWAN_MTYPE_RFU);
+            ret = -1;
+            break;
+        case PROPRIETARY:
+            /* format is up to the vendor, only MHDR and MIC are known */
+            lh->frmpayload = pkt;
+            lh->frmpayload_len = plen;
+            break;
+    }
 
-    ret = DecodeLorawanMACPacket(tv, p, pkt, len);
     if (ret < 0) {
         SCLogDebug("decoding Lorawan MAC packet failed");
-        p->lorawanfh = NULL;
         return;
     }
 
-	if(len < LORAWAN_MAC_HEADER_LEN + LORAWAN_MAC_PAYLOAD_LEN_MIN) {
-		DECODER_SET_EVENT(p,LORAWAN_PKT_TOO_SMALL);
-		return;
-	}
-
-	LORAWAN_MAC_TRIM_MIC(p,p->lorawanmvars);
-
-    switch (p->lorawanmh->mtype) {
-
-    	//TODO check for uplink and downlink about detailed MAC command
-    	case 0x02:	//unconfirmed data up
-    		break;
-    	case 0x04:	//unconfirmed data down
-    		break;
-    	case 0x05:	//confirmed data up
-    		DecodeLorawanFrame(tv, dtv, p, pkt, len, pq);
-    	case 0x06:	//confirmed data down
-    		break;
-    	default:	//join-request, join-accept, RFU, proprietary
-    		//TODO whether goto veridict directly?
-    		break;
-    }
-}
\ No newline at end of file
+    p->lorawanh = lh;
+    p->payload = lh->frmpayload;
+    p->payload_len = lh->frmpayload_len;
+
+    LorawanSessionHandlePacket(tv, p);
+}
+
+#ifdef UNITTESTS
+
+static int DecodeLorawanMACTestSetup(Packet *p, ThreadVars *tv, DecodeThreadVars *dtv,
+                                     uint8_t *raw, uint16_t len)
+{
+    memset(tv, 0, sizeof(ThreadVars));
+    memset(dtv, 0, sizeof(DecodeThreadVars));
+    memset(p, 0, sizeof(Packet));
+
+    DecodeLorawanMAC(tv, dtv, p, raw, len, NULL);
+    return PKT_IS_LORAWAN(p);
+}
+
+/** \test unconfirmed data up with FOpts and FRMPayload */
+static int DecodeLorawanMACTest01(void)
+{
+    Packet p;
+    ThreadVars tv;
+    DecodeThreadVars dtv;
+    uint8_t raw[] = {
+        0x40,                               /* MHDR: unconfirmed up */
+        0x04, 0x03, 0x02, 0x01,             /* DevAddr 0x01020304 */
+        0x82,                               /* FCtrl: ADR, FOptsLen 2 */
+        0x2a, 0x01,                         /* FCnt 298 */
+        0x02, 0x00,                         /* FOpts: LinkCheckReq + 1 byte */
+        0x0a,                               /* FPort 10 */
+        0xde, 0xad, 0xbe,                   /* FRMPayload */
+        0x11, 0x22, 0x33, 0x44 };           /* MIC */
+
+    if (DecodeLorawanMACTestSetup(&p, &tv, &dtv, raw, sizeof(raw)) == 0)
+        return 0;
+
+    if (LORAWAN_GET_MTYPE(&p) != UNCONFIRMED_DATA_UP ||
+        LORAWAN_GET_DEVADDR(&p) != 0x01020304 ||
+        LORAWAN_GET_FCNT(&p) != 298 ||
+        !(LORAWAN_GET_FCTRL(&p) & LORAWAN_FCTRL_ADR) ||
+        p.lorawan.fopts_len != 2 || p.lorawan.fopts != raw + 8 ||
+        !LORAWAN_HAS_FPORT(&p) || LORAWAN_GET_FPORT(&p) != 10 ||
+        p.payload != raw + 11 || p.payload_len != 3 ||
+        LORAWAN_GET_MIC(&p) != 0x44332211)
+        return 0;
+
+    return 1;
+}
+
+/** \test join request */
+static int DecodeLorawanMACTest02(void)
+{
+    Packet p;
+    ThreadVars tv;
+    DecodeThreadVars dtv;
+    uint8_t raw[] = {
+        0x00,
+        0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01,
+        0x18, 0x17, 0x16, 0x15, 0x14, 0x13, 0x12, 0x11,
+        0x34, 0x12,
+        0x11, 0x22, 0x33, 0x44 };
+
+    if (DecodeLorawanMACTestSetup(&p, &tv, &dtv, raw, sizeof(raw)) == 0)
+        return 0;
+
+    if (p.lorawan.join_eui != 0x0102030405060708ULL ||
+        p.lorawan.dev_eui != 0x1112131415161718ULL ||
+        p.lorawan.dev_nonce != 0x1234 || LORAWAN_HAS_FHDR(&p))
+        return 0;
+
+    return 1;
+}
+
+/** \test FOptsLen runs past the end of the frame */
+static int DecodeLorawanMACTest03(void)
+{
+    Packet p;
+    ThreadVars tv;
+    DecodeThreadVars dtv;
+    uint8_t raw[] = {
+        0x80, 0x04, 0x03, 0x02, 0x01, 0x0f, 0x01, 0x00,
+        0x11, 0x22, 0x33, 0x44 };
+
+    if (DecodeLorawanMACTestSetup(&p, &tv, &dtv, raw, sizeof(raw)) == 1)
+        return 0;
+
+    return DECODER_ISSET_EVENT(&p, LORAWAN_FRAME_HEADER_TOO_BIG) ? 1 : 0;
+}
+
+/** \test data down without FPort, unknown major and short frames */
+static int DecodeLorawanMACTest04(void)
+{
+    Packet p;
+    ThreadVars tv;
+    DecodeThreadVars dtv;
+    uint8_t nofport[] = {
+        0x60, 0x04, 0x03, 0x02, 0x01, 0x20, 0x05, 0x00,
+        0x11, 0x22, 0x33, 0x44 };
+    uint8_t major[] = {
+        0x41, 0x04, 0x03, 0x02, 0x01, 0x00, 0x05, 0x00,
+        0x11, 0x22, 0x33, 0x44 };
+    uint8_t tiny[] = { 0x40, 0x11, 0x22 };
+
+    if (DecodeLorawanMACTestSetup(&p, &tv, &dtv, nofport, sizeof(nofport)) == 0)
+        return 0;
+    if (LORAWAN_HAS_FPORT(&p) || p.payload_len != 0 ||
+        !(LORAWAN_GET_FCTRL(&p) & LORAWAN_FCTRL_ACK))
+        return 0;
+
+    if (DecodeLorawanMACTestSetup(&p, &tv, &dtv, major, sizeof(major)) == 1 ||
+        !DECODER_ISSET_EVENT(&p, LORAWAN_MAJOR_UNKNOWN))
+        return 0;
+
+    if (DecodeLorawanMACTestSetup(&p, &tv, &dtv, tiny, sizeof(tiny)) == 1 ||
+        !DECODER_ISSET_EVENT(&p, LORAWAN_PKT_TOO_SMALL))
+        return 0;
+
+    return 1;
+}
+#endif /* UNITTESTS */
+
+void DecodeLorawanMACRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("DecodeLorawanMACTest01", DecodeLorawanMACTest01, 1);
+    UtRegisterTest("DecodeLorawanMACTest02", DecodeLorawanMACTest02, 1);
+    UtRegisterTest("DecodeLorawanMACTest03", DecodeLorawanMACTest03, 1);
+    UtRegisterTest("DecodeLorawanMACTest04", DecodeLorawanMACTest04, 1);
+#endif /* UNITTESTS */
+}
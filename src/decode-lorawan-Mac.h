@@ -5,41 +5,105 @@
 #ifndef SRC_DECODE_LORAWAN_MAC_H
 #define SRC_DECODE_LORAWAN_MAC_H
 
+// PHYPayload:
 // MHDR(1) [MType(3) | RFU(3) | Major(2) ]
 // MACPayload(7~N) [ FHDR(7~22) | FPort(0-1) | FRMPayload(0-N)]
+//   or Join-Request(18) [ JoinEUI(8) | DevEUI(8) | DevNonce(2) ]
+//   or Join-Accept(12|28), encrypted
 // MIC(4)
+//
+// All multi byte fields are little endian.
+
+#define LORAWAN_MAC_HEADER_LEN                  1           /**< MAC Header Length */
+#define LORAWAN_MAC_PAYLOAD_LEN_MIN             7           /**< MAC Payload Minimum Length */
+#define LORAWAN_MIC_LEN                         4           /**< Message Integrity Code */
 
-#define LORAWAN_MAC_
-#define LORAWAN_MAC_HEADER_LEN					1			/**< MAC Header Length */
-#define LORAWAN_MAC_PAYLOAD_LEN_MIN				7			/**< MAC Payload Minimum Length */
+#define LORAWAN_JOIN_REQUEST_LEN                18          /**< JoinEUI + DevEUI + DevNonce */
+#define LORAWAN_JOIN_ACCEPT_LEN                 12          /**< without CFList, MIC excluded */
+#define LORAWAN_JOIN_ACCEPT_CFLIST_LEN          28          /**< with CFList, MIC excluded */
 
 /** MType message types  */
 
-#define JOIN_REQUEST							0x00	 	/**< Join Request Message from End-Device */
-#define JOIN_ACCEPT								0x01		/**< Join Accept Message  */
-#define UNCONFIRMED_DATA_UP						0x02		/**< Unconfirmed Data Up Message from End-Device */
-#define UNCONFIRMED_DATA_DOWN					0x03		/**< Unconfirmed Data Down Message from GateWay */
-#define CONFIRMED_DATA_UP						0x04		/**< Confirmed Data Up Message from End-Device */
-#define CONFIRMED_DATA_DOWN						0x05		/**< Confirmed Data Down Message from GateWay */
-#define MTYPE_RFU								0x06		/**< Mtype Reserved for future use  */
-#define PROPRIETARY								0x07		/**< Proprietary message from End-Device?  */
+#define JOIN_REQUEST                            0x00        /**< Join Request Message from End-Device */
+#define JOIN_ACCEPT                             0x01        /**< Join Accept Message  */
+#define UNCONFIRMED_DATA_UP                     0x02        /**< Unconfirmed Data Up Message from End-Device */
+#define UNCONFIRMED_DATA_DOWN                   0x03        /**< Unconfirmed Data Down Message from GateWay */
+#define CONFIRMED_DATA_UP                       0x04        /**< Confirmed Data Up Message from End-Device */
+#define CONFIRMED_DATA_DOWN                     0x05        /**< Confirmed Data Down Message from GateWay */
+#define MTYPE_RFU                               0x06        /**< Mtype Reserved for future use  */
+#define PROPRIETARY                             0x07        /**< Proprietary message from End-Device?  */
+#define LORAWAN_MTYPE_MAX                       8
+
+/** Major version, only LoRaWAN R1 is defined */
+#define LORAWAN_MAJOR_R1                        0x00
+
+#define LORAWAN_MHDR_GET_MTYPE(mhdr)            (((mhdr) >> 5) & 0x07)
+#define LORAWAN_MHDR_GET_MAJOR(mhdr)            ((mhdr) & 0x03)
+
+#define LORAWAN_MTYPE_IS_DATA(t)                ((t) >= UNCONFIRMED_DATA_UP && (t) <= CONFIRMED_DATA_DOWN)
+#define LORAWAN_MTYPE_IS_UPLINK(t)              ((t) == JOIN_REQUEST || (t) == UNCONFIRMED_DATA_UP || \
+                                                 (t) == CONFIRMED_DATA_UP)
+
+#define LORAWAN_GET_LE16(p)                     ((uint16_t)(p)[0] | ((uint16_t)(p)[1] << 8))
+#define LORAWAN_GET_LE32(p)                     ((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8) | \
+                                                 ((uint32_t)(p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+#define LORAWAN_GET_LE64(p)                     ((uint64_t)LORAWAN_GET_LE32((p)) | \
+                                                 ((uint64_t)LORAWAN_GET_LE32((p) + 4) << 32))
+
+/* LorawanHdr flags */
+#define LORAWAN_HDR_HAS_FHDR                    0x01        /**< data frame, FHDR fields are set */
+#define LORAWAN_HDR_HAS_FPORT                   0x02        /**< fport and frmpayload are set */
+#define LORAWAN_HDR_HAS_JOIN                    0x04        /**< join request fields are set */
+
+/**
+ * \brief Parsed view of a LoRaWAN PHYPayload.
+ *
+ * Filled in a single pass by DecodeLorawanMAC. The slices point into the
+ * packet data, nothing is copied or allocated. The view is exactly one
+ * cache line so detection touches a single line for any header field.
+ */
+typedef struct LorawanHdr_ {
+    uint8_t mhdr;               /**< raw MHDR */
+    uint8_t mtype;
+    uint8_t major;
+    uint8_t flags;              /**< LORAWAN_HDR_HAS_* */
+
+    /* FHDR, data frames only */
+    uint8_t fctrl;
+    uint8_t fopts_len;
+    uint8_t fport;
+    uint8_t pad0;
+    uint16_t fcnt;              /**< 16 lsb of the frame counter */
+    uint16_t frmpayload_len;
+    uint32_t devaddr;
+
+    uint32_t mic;
 
+    uint8_t *fopts;             /**< FOpts, NULL if fopts_len is 0 */
+    uint8_t *frmpayload;        /**< FRMPayload (join accept: encrypted payload) */
 
-#define LORAWAN_MAC_TRIM_MIC(packet,payload)		(((packet)->lorawanmvars.macpayload) = (payload>>32))
+    /** FCnt values skipped since the previous frame of the device, set
+     *  by the session table */
+    uint32_t fcnt_gap;
 
-typedef struct LorawanMacHdr_ {
-	unsigned int mtype : 3;
-	unsigned int rfu : 3;
-	unsigned int major : 2;
-} LorawanMacHdr;
+    /* Join-Request only */
+    uint16_t dev_nonce;
+    uint16_t pad1;
+    uint64_t join_eui;
+    uint64_t dev_eui;
+} __attribute__((aligned(64))) LorawanHdr;
 
-typedef struct LorawanMacVars_ {
-	unsigned int macpayload;		//maximum payload size?? 
-	//uint32_t MIC;
-} LorawanMacVars;
+#define LORAWAN_GET_MTYPE(p)                    ((p)->lorawanh->mtype)
+#define LORAWAN_GET_DEVADDR(p)                  ((p)->lorawanh->devaddr)
+#define LORAWAN_GET_FCNT(p)                     ((p)->lorawanh->fcnt)
+#define LORAWAN_GET_FCTRL(p)                    ((p)->lorawanh->fctrl)
+#define LORAWAN_GET_FPORT(p)                    ((p)->lorawanh->fport)
+#define LORAWAN_GET_MIC(p)                      ((p)->lorawanh->mic)
+#define LORAWAN_GET_FCNT_GAP(p)                 ((p)->lorawanh->fcnt_gap)
+#define LORAWAN_HAS_FHDR(p)                     ((p)->lorawanh->flags & LORAWAN_HDR_HAS_FHDR)
+#define LORAWAN_HAS_FPORT(p)                    ((p)->lorawanh->flags & LORAWAN_HDR_HAS_FPORT)
 
-static int DecodeLorawanMACPacket(ThreadVars *tv, Packet *p, uint8_t *pkt, uint16_t len);
-void DecodeLorawanMAC(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p, uint8_t *pkt, uint16_t len, PacketQueue *pq);
+void DecodeLorawanMACRegisterTests(void);
 
 
-#endif //SRC_DECODE_LORAWAN_MAC_H
\ No newline at end of file
+#endif //SRC_DECODE_LORAWAN_MAC_H
@@ -7,89 +7,62 @@
 #include "decode-events.h"
 #include "defrag.h"
 #include "util-debug.h"
+#include "decode-lorawan-Mac.h"
 #include "decode-lorawan-frame.h"
 
 
-static int DecodeLorawanFrameControls(ThreadVars *tv, Packet *p, uint8_t *pkt, uint16_t len)
+/**
+ * \brief Decode the MACPayload of a data frame into p->lorawan.
+ *
+ * FHDR: DevAddr(4) | FCtrl(1) | FCnt(2) | FOpts(0~15), followed by an
+ * optional FPort(1) and FRMPayload. Only offsets into pkt are stored.
+ *
+ * \param pkt the MACPayload, MHDR and MIC stripped
+ * \param len length of the MACPayload
+ *
+ * \retval 0 ok
+ * \retval -1 invalid frame, decoder event set
+ */
+int DecodeLorawanFrame(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p, uint8_t *pkt, uint16_t len, PacketQueue *pq)
 {
-    if (len != LORAWAN_FRAME_CTRL_LEN) {
-        DECODER_SET_EVENT(p, LORAWAN_FRAME_CONTROL_INVALID);
-        return -1;
-    }
-
-    p->lorawanfh->fctl = (LorawanFrameCtrl *)pkt;
-    //TODO
-    LORAWAN_FRAME_SET_FOPTS_LEN(p, p->lorawanfh->fctl->fopts_len);
-    LORAWAN_FRAME_SET_HEADER_LEN(p, LORAWAN_FRAME_HEADER_LEN_MIN + LORAWAN_FRAME_GET_OPTS(p));
-
-    return 0;
-}
-
+    LorawanHdr *lh = &p->lorawan;
+    uint16_t hlen;
 
-static int DecodeLorawanFramePacket(ThreadVars *tv, Packet *p, uint8_t *pkt, uint16_t len)
-{
-    int ret;
+    SCPerfCounterIncr(dtv->counter_lorawan_dataframe, tv->sc_perf_pca);
 
     if (len < LORAWAN_FRAME_HEADER_LEN_MIN) {
-        DECODER_SET_EVENT(p,LORAWAN_PKT_TOO_SMALL);
+        DECODER_SET_EVENT(p, LORAWAN_FRAME_PKT_INVALID);
         return -1;
     }
 
-    p->lorawanfh = (LorawanFrameHdr *)pkt;
+    lh->devaddr = LORAWAN_GET_LE32(pkt);
+    lh->fctrl = pkt[LORAWAN_FRAME_DEV_ADDR_LEN];
+    lh->fcnt = LORAWAN_GET_LE16(pkt + LORAWAN_FRAME_DEV_ADDR_LEN + LORAWAN_FRAME_CTRL_LEN);
+    lh->fopts_len = lh->fctrl & LORAWAN_FCTRL_FOPTS_LEN_MASK;
 
-    ret = DecodeLorawanFrameControls(tv, p, pkt+LORAWAN_FRAME_DEV_ADDR_LEN, LORAWAN_FRAME_CTRL_LEN);
-
-    if (ret < 0) {
-        SCLogDebug("decoding Lorawan frame control failed");
-        p->lorawanfh = NULL;
+    hlen = LORAWAN_FRAME_HEADER_LEN_MIN + lh->fopts_len;
+    if (len < hlen) {
+        DECODER_SET_EVENT(p, LORAWAN_FRAME_HEADER_TOO_BIG);
         return -1;
     }
 
-    if (len < LORAWAN_FRAME_GET_HEADER_LEN(p)) {
-        DECODER_SET_EVENT(p, LORAWAN_PKT_TOO_SMALL);
-        return -1;
-    }
-
-    if (len < LORAWAN_FRAME_GET_HEADER_LEN(p) + LORAWAN_FRAME_PORT_LEN) {
-        DECODER_SET_EVENT(p, LORAWAN_PKT_TOO_SMALL);
-        return -1;
+    if (lh->fopts_len > 0)
+        lh->fopts = pkt + LORAWAN_FRAME_HEADER_LEN_MIN;
+    lh->flags |= LORAWAN_HDR_HAS_FHDR;
+
+    /* FPort is only present if there is a FRMPayload */
+    if (len > hlen) {
+        lh->fport = pkt[hlen];
+        lh->frmpayload = pkt + hlen + LORAWAN_FRAME_PORT_LEN;
+        lh->frmpayload_len = len - hlen - LORAWAN_FRAME_PORT_LEN;
+        lh->flags |= LORAWAN_HDR_HAS_FPORT;
+
+        /* MAC commands go either in FOpts or in a FPort 0 payload,
+         * never in both */
+        if (lh->fport == LORAWAN_FPORT_MAC_COMMAND && lh->fopts_len > 0) {
+            DECODER_SET_EVENT(p, LORAWAN_FRAME_CONTROL_INVALID);
+        }
     }
 
-    p->lorawanfvars = (LorawanFrameVars *)(pkt + LORAWAN_FRAME_GET_HEADER_LEN(p));
-
-    p->payload = pkt + LORAWAN_FRAME_GET_HEADER_LEN(p) + LORAWAN_FRAME_PORT_LEN;
-    p->payload_len = len - LORAWAN_FRAME_GET_HEADER_LEN(p) - LORAWAN_FRAME_PORT_LEN;
-
     return 0;
 }
-
-
-void DecodeLorawanFrame(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p, uint8_t *pkt, uint16_t len, PacketQueue *pq)
-{
-    int ret;
-
-    SCPerfCounterIncr(dtv->counter_lorawan_dataframe, tv->sc_perf_pca);
-
-
-    ret = DecodeLorawanFramePacket(tv, p, pkt, len);
-    if (ret < 0) {
-        SCLogDebug("decoding Lorawan frame packet failed");
-        p->lorawanfh = NULL;
-        return;
-    }
-
-    switch (LORAWAN_FRAME_GET_FPORT(p)) {
-        case 0x00:
-            SCLogDebug("Lorawan Mac message dose not filtered");
-            break;
-        case 0x01:
-            //TODO IF Some AppLayer IOT Protocols Based on LoRaWan Decoding From Here
-            break;
-        default:
-            //TODO Decode Raw Payloads
-            break;
-    }
-
-    //TODO HOW TO PROCESS THE RE-ASSEMBLY or VerdictNFQ ???
-    return;
-}
\ No newline at end of file
@@ -16,35 +16,30 @@
 #define LORAWAN_FRAME_HEADER_LEN_MIN            7            /**< Header Minimum length */
 #define LORAWAN_FRAME_PORT_LEN                  1            /**< Frame Ports length */
 #define LORAWAN_FRAME_CTRL_LEN                  1            /**< Frame Control length */
+#define LORAWAN_FRAME_FOPTS_LEN_MAX             15
 #define LORAWAN_FPORT_MAC_COMMAND               0x00
 
-
-typedef struct LorawanFrameHdr_ {
-    uint32_t dev_addr;                                      /* DevAddr */
-    struct LorawanFrameCtrl *fctl;                         /* Fctl */
-    uint16_t fcnt;                                          /* Fcnt */
-    unsigned char* fopts;                                 /* Fopts */
-} LorawanFrameHdr;
-
-typedef struct LorawanFrameVars_ {
-    uint8_t fports;
-}LorawanFrameVars;
-
-typedef struct LorawanFrameCtrl_ {
-    unsigned int address : 1;
-    unsigned int address_ack_request : 1;
-    unsigned int ack : 1;
-    unsigned int fpending : 1;
-    unsigned int fopts_len : 4;
-} LorawanFrameCtrl;
-
-#define LORAWAN_FRAME_SET_FOPTS_LEN(p, len) ((p)->lorawanfh->fctl.fopts_len = len)
-#define LORAWAN_FRAME_GET_FPORT(p) ((p)->lorawanfvars->fports)
-#define LORAWAN_FRAME_GET_HEADER_LEN(p) ((p)->lorawanfh->fctl.fopts_len + LORAWAN_FRAME_HEADER_LEN_MIN)
-
-
-void DecodeLorawanFrame(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p, uint8_t *pkt, uint16_t len, PacketQueue *pq);
-static int DecodeLorawanFramePacket(ThreadVars *tv, Packet *p, uint8_t *pkt, uint16_t len);
-static int DecodeLorawanFrameControls(ThreadVars *tv, Packet *p, uint8_t *pkt, uint16_t len);
+/** FCtrl bits */
+#define LORAWAN_FCTRL_ADR                       0x80
+#define LORAWAN_FCTRL_ADR_ACK_REQ               0x40         /**< uplink only */
+#define LORAWAN_FCTRL_ACK                       0x20
+#define LORAWAN_FCTRL_FPENDING                  0x10         /**< downlink; ClassB on uplink */
+#define LORAWAN_FCTRL_FOPTS_LEN_MASK            0x0f
+
+/** MAC command identifiers (CID), shared by the request and the answer */
+#define LORAWAN_CID_LINK_CHECK                  0x02
+#define LORAWAN_CID_LINK_ADR                    0x03
+#define LORAWAN_CID_DUTY_CYCLE                  0x04
+#define LORAWAN_CID_RX_PARAM_SETUP              0x05
+#define LORAWAN_CID_DEV_STATUS                  0x06
+#define LORAWAN_CID_NEW_CHANNEL                 0x07
+#define LORAWAN_CID_RX_TIMING_SETUP             0x08
+#define LORAWAN_CID_TX_PARAM_SETUP              0x09
+#define LORAWAN_CID_DL_CHANNEL                  0x0a
+#define LORAWAN_CID_DEVICE_TIME                 0x0d
+#define LORAWAN_CID_MAX                         LORAWAN_CID_DEVICE_TIME
+#define LORAWAN_CID_PROPRIETARY_MIN             0x80         /**< 0x80-0xff */
+
+#define LORAWAN_FRAME_GET_HEADER_LEN(p)         ((p)->lorawanh->fopts_len + LORAWAN_FRAME_HEADER_LEN_MIN)
 
 #endif //SRC_DECODE_LORAWAN_FRAME_H
@@ -77,6 +77,61 @@ Packet *PacketGetFromQueueOrAlloc(void) {
     return p;
 }
 
+/**
+ *  \brief Copy data into the packet at 'offset', switching the packet over
+ *         to an external buffer if it no longer fits the inline one.
+ *
+ *  The inline buffer holds PKT_INLINE_SIZE bytes which is enough for any
+ *  LoRaWAN frame, so the external buffer is only allocated for the rare
+ *  bigger packet (IP traffic, reassembled fragments). It is freed again
+ *  when the packet is recycled.
+ *
+ *  \param p packet to copy into
+ *  \param offset offset in the packet data to copy to
+ *  \param data data to copy
+ *  \param datalen length of data
+ *
+ *  \retval 0 ok
+ *  \retval -1 data too big or out of memory
+ */
+int PacketCopyDataOffset(Packet *p, uint32_t offset, uint8_t *data, uint32_t datalen)
+{
+    if (offset + datalen > MAX_PAYLOAD_SIZE || offset + datalen < offset) {
+        SCLogDebug("packet data too big: %" PRIu32 " + %" PRIu32, offset, datalen);
+        return -1;
+    }
+
+    if (p->ext_pkt == NULL && offset + datalen > PKT_INLINE_SIZE) {
+        p->ext_pkt = SCMalloc(MAX_PAYLOAD_SIZE);
+        if (p->ext_pkt == NULL) {
+            SCLogError(SC_ERR_MEM_ALLOC, "SCMalloc failed: %s", strerror(errno));
+            return -1;
+        }
+        /* keep what we already have */
+        if (offset > 0)
+            memcpy(p->ext_pkt, p->pkt, offset < PKT_INLINE_SIZE ? offset : PKT_INLINE_SIZE);
+    }
+
+    memcpy(GET_PKT_DATA(p) + offset, data, datalen);
+    return 0;
+}
+
+/**
+ *  \brief Copy data into the packet and set the packet length.
+ *
+ *  \retval 0 ok
+ *  \retval -1 data too big or out of memory
+ */
+int PacketCopyData(Packet *p, uint8_t *pktdata, uint32_t pktlen)
+{
+    SET_PKT_LEN(p, 0);
+    if (PacketCopyDataOffset(p, 0, pktdata, pktlen) == -1)
+        return -1;
+
+    SET_PKT_LEN(p, pktlen);
+    return 0;
+}
+
 /**
  *  \brief Setup a pseudo packet (tunnel or reassembled frags)
  *
@@ -103,8 +158,16 @@ Packet *PacketPseudoPktSetup(Packet *parent, uint8_t *pkt, uint16_t len, uint8_t
 
     /* copy packet and set lenght, proto */
     p->tunnel_proto = proto;
-    p->pktlen = len;
-    memcpy(&p->pkt, pkt, len);
+    if (PacketCopyData(p, pkt, len) == -1) {
+        if (p->flags & PKT_ALLOC) {
+            PACKET_CLEANUP(p);
+            SCFree(p);
+        } else {
+            PACKET_RECYCLE(p);
+            PacketPoolStorePacket(p);
+        }
+        return NULL;
+    }
     p->recursion_level = parent->recursion_level + 1;
     p->ts.tv_sec = parent->ts.tv_sec;
     p->ts.tv_usec = parent->ts.tv_usec;
@@ -162,6 +225,30 @@ void DecodeRegisterPerfCounters(DecodeThreadVars *dtv, ThreadVars *tv)
                                                               SC_PERF_TYPE_UINT64, "NULL");
     dtv->counter_lorawan_mac = SCPerfTVRegisterCounter("decoder.lorawanmac", tv,
                                                         SC_PERF_TYPE_UINT64, "NULL");
+    dtv->counter_lorawan_mtype[JOIN_REQUEST] =
+        SCPerfTVRegisterCounter("decoder.lorawan.join_request", tv,
+            SC_PERF_TYPE_UINT64, "NULL");
+    dtv->counter_lorawan_mtype[JOIN_ACCEPT] =
+        SCPerfTVRegisterCounter("decoder.lorawan.join_accept", tv,
+            SC_PERF_TYPE_UINT64, "NULL");
+    dtv->counter_lorawan_mtype[UNCONFIRMED_DATA_UP] =
+        SCPerfTVRegisterCounter("decoder.lorawan.unconfirmed_up", tv,
+            SC_PERF_TYPE_UINT64, "NULL");
+    dtv->counter_lorawan_mtype[UNCONFIRMED_DATA_DOWN] =
+        SCPerfTVRegisterCounter("decoder.lorawan.unconfirmed_down", tv,
+            SC_PERF_TYPE_UINT64, "NULL");
+    dtv->counter_lorawan_mtype[CONFIRMED_DATA_UP] =
+        SCPerfTVRegisterCounter("decoder.lorawan.confirmed_up", tv,
+            SC_PERF_TYPE_UINT64, "NULL");
+    dtv->counter_lorawan_mtype[CONFIRMED_DATA_DOWN] =
+        SCPerfTVRegisterCounter("decoder.lorawan.confirmed_down", tv,
+            SC_PERF_TYPE_UINT64, "NULL");
+    dtv->counter_lorawan_mtype[MTYPE_RFU] =
+        SCPerfTVRegisterCounter("decoder.lorawan.rfu", tv,
+            SC_PERF_TYPE_UINT64, "NULL");
+    dtv->counter_lorawan_mtype[PROPRIETARY] =
+        SCPerfTVRegisterCounter("decoder.lorawan.proprietary", tv,
+            SC_PERF_TYPE_UINT64, "NULL");
     dtv->counter_avg_pkt_size = SCPerfTVRegisterAvgCounter("decoder.avg_pkt_size", tv,
                                                            SC_PERF_TYPE_DOUBLE, "NULL");
     dtv->counter_max_pkt_size = SCPerfTVRegisterMaxCounter("decoder.max_pkt_size", tv,
@@ -30,6 +30,7 @@
 #include "threadvars.h"
 
 #include "source-nfq.h"
+#include "source-packetqueue.h"
 
 #include "action-globals.h"
 
@@ -41,6 +42,9 @@
 
 /* forward declaration */
 struct DetectionEngineThreadCtx_;
+struct DetectEngineCtx_;
+
+void DetectEngineCtxRelease(struct DetectEngineCtx_ *);
 
 
 /* EUI */
@@ -76,15 +80,9 @@ typedef struct EUI_ {
     (((e1)->deveui == (e2)->deveui &&                             \
       (e1)->appeui == (e2)->appeui ))
 
-#define CLEAR_MAC_PACKET(p) do { \
-    (p)->lorawanmvars.macpayload = 0; \
-    (p)->lorawanmh = NULL; \
-} while (0)
-
-#define CLEAR_FRAME_PACKET(p) do { \
-    (p)->lorawanfvars.fports = 0; \
-    (p)->lorawanfh = NULL; \
-    (p)->lorawanfctl = NULL; \
+/* the parsed view is rewritten by the decoder, dropping the ptr is enough */
+#define CLEAR_LORAWAN_PACKET(p) do { \
+    (p)->lorawanh = NULL; \
 } while (0)
 
 
@@ -92,7 +90,16 @@ typedef struct EUI_ {
 #define PKT_IS_IPV6(p)      (((p)->ip6h != NULL))
 #define PKT_IS_TCP(p)       (((p)->tcph != NULL))
 #define PKT_IS_UDP(p)       (((p)->udph != NULL))
-#define PKT_IS_LORAWAN(p)   (((p)->lorawanmh != NULL))
+/** size of the buffer inside the Packet, enough for any LoRaWAN PHYPayload */
+#define PKT_INLINE_SIZE     256
+/** maximum ip packet size + link header (ipv6 hdr + 64k + 28) */
+#define MAX_PAYLOAD_SIZE    (40 + 65536 + 28)
+
+#define GET_PKT_DATA(p)     (((p)->ext_pkt == NULL) ? (p)->pkt : (p)->ext_pkt)
+#define GET_PKT_LEN(p)      ((p)->pktlen)
+#define SET_PKT_LEN(p, len) do { (p)->pktlen = (len); } while (0)
+
+#define PKT_IS_LORAWAN(p)   (((p)->lorawanh != NULL))
 #define PKT_IS_TOSERVER(p)  (((p)->UNCONFIRMED_DATA_UP | CONFIRMED_DATA_UP))
 #define PKT_IS_TOMOTE(p)    (((p)->UNCONFIRMED_DATA_DOWN | CONFIRMED_DATA_DOWN))
 
@@ -115,12 +122,36 @@ typedef struct PacketAlert_ {
 } PacketAlert;
 
 #define PACKET_ALERT_MAX 256
+/** alerts that fit in the packet itself, PacketAlertAppend grows the
+ *  array on demand up to PACKET_ALERT_MAX */
+#define PACKET_ALERT_INLINE 8
 
 typedef struct PacketAlerts_ {
     uint16_t cnt;
-    PacketAlert alerts[PACKET_ALERT_MAX];
+    uint16_t size;              /**< number of alerts 'alerts' can hold */
+    PacketAlert *alerts;        /**< inline_alerts or a SCMalloc'd array */
+    PacketAlert inline_alerts[PACKET_ALERT_INLINE];
+    /** ctx the msg, class_msg and references point into. We hold a
+     *  reference so a rule reload can't free it under the outputs. */
+    struct DetectEngineCtx_ *de_ctx;
 } PacketAlerts;
 
+/** \brief point the alert array back at the inline storage, freeing
+ *         the grown array if we had one */
+#define PACKET_ALERTS_RESET(p) do {                                 \
+        if ((p)->alerts.alerts != NULL &&                           \
+            (p)->alerts.alerts != (p)->alerts.inline_alerts) {      \
+            SCFree((p)->alerts.alerts);                             \
+        }                                                           \
+        (p)->alerts.alerts = (p)->alerts.inline_alerts;             \
+        (p)->alerts.size = PACKET_ALERT_INLINE;                     \
+        (p)->alerts.cnt = 0;                                        \
+        if ((p)->alerts.de_ctx != NULL) {                           \
+            DetectEngineCtxRelease((p)->alerts.de_ctx);             \
+            (p)->alerts.de_ctx = NULL;                              \
+        }                                                           \
+    } while (0)
+
 #define PACKET_DECODER_EVENT_MAX 16
 
 typedef struct PacketDecoderEvents_ {
@@ -181,6 +212,7 @@ typedef struct Packet_
     struct timeval ts;
 
     NFQPacketVars nfq_v;
+    PacketQueuePacketVars pq_v;
 
     /* IPS action to take */
     uint8_t action;
@@ -188,18 +220,20 @@ typedef struct Packet_
     /* pkt vars */
     PktVar *pktvar;
 
-    LorawanMacHdr *lorawanmh;
-    LorawanMacVars *lorawanmvars;
-
-    LorawanFrameHdr *lorawanfh;
-    LorawanFrameVars *lorawanfvars;
+    /* LoRaWAN: points to 'lorawan' once the frame is decoded */
+    LorawanHdr *lorawanh;
 
     uint8_t *payload;
     uint16_t payload_len;
 
-    /* storage: maximum ip packet size + link header */
-    uint8_t pkt[IPV6_HEADER_LEN + 65536 + 28];
+    /* storage: a LoRaWAN PHYPayload always fits in the inline buffer,
+     * bigger packets are copied into ext_pkt (see PacketCopyData) */
+    uint8_t *ext_pkt;
     uint32_t pktlen;
+    uint8_t pkt[PKT_INLINE_SIZE];
+
+    /* parsed LoRaWAN headers, see DecodeLorawanMAC */
+    LorawanHdr lorawan;
 
     PacketAlerts alerts;
 
@@ -254,6 +288,7 @@ typedef struct DecodeThreadVars_
     /** stats/counters */
     uint16_t counter_lorawan_dataframe;
     uint16_t counter_lorawan_mac;
+    uint16_t counter_lorawan_mtype[LORAWAN_MTYPE_MAX];
     uint16_t counter_pkts;
     uint16_t counter_pkts_per_sec;
     uint16_t counter_bytes;
@@ -293,6 +328,7 @@ typedef struct DecodeThreadVars_
     memset((p), 0x00, sizeof(Packet)); \
     SCMutexInit(&(p)->mutex_rtv_cnt, NULL); \
     PACKET_RESET_CHECKSUMS((p)); \
+    PACKET_ALERTS_RESET((p)); \
 }
 
 
@@ -332,14 +368,17 @@ typedef struct DecodeThreadVars_
         if ((p)->udph != NULL) {                \
             CLEAR_UDP_PACKET((p));              \
         }                                       \
-        if ((p)->lorawanmh != NULL) {           \
-            CLEAR_MAC_PACKET((p));              \
-            CLEAR_FRAME_PACKET((p));            \
+        if ((p)->lorawanh != NULL) {            \
+            CLEAR_LORAWAN_PACKET((p));          \
         }                                       \
         (p)->payload = NULL;                    \
         (p)->payload_len = 0;                   \
         (p)->pktlen = 0;                        \
-        (p)->alerts.cnt = 0;                    \
+        if ((p)->ext_pkt != NULL) {             \
+            SCFree((p)->ext_pkt);               \
+            (p)->ext_pkt = NULL;                \
+        }                                       \
+        PACKET_ALERTS_RESET((p));               \
         (p)->next = NULL;                       \
         (p)->prev = NULL;                       \
         (p)->rtv_cnt = 0;                       \
@@ -363,6 +402,16 @@ typedef struct DecodeThreadVars_
         if ((p)->pktvar != NULL) {              \
             PktVarFree((p)->pktvar);            \
         }                                       \
+        if ((p)->ext_pkt != NULL) {             \
+            SCFree((p)->ext_pkt);               \
+        }                                       \
+        if ((p)->alerts.alerts != NULL &&       \
+            (p)->alerts.alerts != (p)->alerts.inline_alerts) { \
+            SCFree((p)->alerts.alerts);         \
+        }                                       \
+        if ((p)->alerts.de_ctx != NULL) {       \
+            DetectEngineCtxRelease((p)->alerts.de_ctx); \
+        }                                       \
         SCMutexDestroy(&(p)->mutex_rtv_cnt);    \
     } while (0)
 
@@ -409,6 +458,8 @@ typedef struct DecodeThreadVars_
 void DecodeRegisterPerfCounters(DecodeThreadVars *, ThreadVars *);
 Packet *PacketPseudoPktSetup(Packet *parent, uint8_t *pkt, uint16_t len, uint8_t proto);
 Packet *PacketGetFromQueueOrAlloc(void);
+int PacketCopyData(Packet *, uint8_t *, uint32_t);
+int PacketCopyDataOffset(Packet *, uint32_t, uint8_t *, uint32_t);
 
 DecodeThreadVars *DecodeThreadVarsAlloc();
 
@@ -420,6 +471,8 @@ void DecodeIPV4(ThreadVars *, DecodeThreadVars *, Packet *, uint8_t *, uint16_t,
 void DecodeIPV6(ThreadVars *, DecodeThreadVars *, Packet *, uint8_t *, uint16_t, PacketQueue *);
 void DecodeTCP(ThreadVars *, DecodeThreadVars *, Packet *, uint8_t *, uint16_t, PacketQueue *);
 void DecodeUDP(ThreadVars *, DecodeThreadVars *, Packet *, uint8_t *, uint16_t, PacketQueue *);
+void DecodeLorawanMAC(ThreadVars *, DecodeThreadVars *, Packet *, uint8_t *, uint16_t, PacketQueue *);
+int DecodeLorawanFrame(ThreadVars *, DecodeThreadVars *, Packet *, uint8_t *, uint16_t, PacketQueue *);
 
 /** \brief Set the No payload inspection Flag for the packet.
  *
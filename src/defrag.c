@@ -557,8 +557,9 @@ Defrag4Reassemble(ThreadVars *tv, DefragContext *dc, DefragTracker *tracker,
         if (frag->offset == 0) {
             /* This is the first packet, we use this packets link and
              * IPv4 header. We also copy in its data. */
-            memcpy(rp->pkt, frag->pkt, frag->len);
-            rp->ip4h = (IPV4Hdr *)(rp->pkt + frag->ip_hdr_offset);
+            if (PacketCopyDataOffset(rp, 0, frag->pkt, frag->len) == -1)
+                goto remove_tracker;
+            rp->ip4h = (IPV4Hdr *)(GET_PKT_DATA(rp) + frag->ip_hdr_offset);
             hlen = frag->hlen;
             ip_hdr_offset = frag->ip_hdr_offset;
 
@@ -570,18 +571,22 @@ Defrag4Reassemble(ThreadVars *tv, DefragContext *dc, DefragTracker *tracker,
         }
         else {
             int pkt_end = fragmentable_offset + frag->offset + frag->data_len;
-            if (pkt_end > (int)sizeof(rp->pkt)) {
+            if (pkt_end > (int)MAX_PAYLOAD_SIZE) {
                 SCLogWarning(SC_ERR_REASSEMBLY, "Failed re-assemble fragmented packet, exceeds size of packet buffer.");
                 goto remove_tracker;
             }
-            memcpy(rp->pkt + fragmentable_offset + frag->offset + frag->ltrim,
-                frag->pkt + frag->data_offset + frag->ltrim,
-                frag->data_len - frag->ltrim);
+            if (PacketCopyDataOffset(rp,
+                    fragmentable_offset + frag->offset + frag->ltrim,
+                    frag->pkt + frag->data_offset + frag->ltrim,
+                    frag->data_len - frag->ltrim) == -1)
+                goto remove_tracker;
             if (frag->offset + frag->data_len > fragmentable_len)
                 fragmentable_len = frag->offset + frag->data_len;
         }
     }
     BUG_ON(rp->ip4h == NULL);
+    /* the data may have moved to the external buffer */
+    rp->ip4h = (IPV4Hdr *)(GET_PKT_DATA(rp) + ip_hdr_offset);
 
     int old = rp->ip4h->ip_len + rp->ip4h->ip_off;
     rp->ip4h->ip_len = htons(fragmentable_len + hlen);
@@ -673,11 +678,13 @@ Defrag6Reassemble(ThreadVars *tv, DefragContext *dc, DefragTracker *tracker,
             /* This is the first packet, we use this packets link and
              * IPv6 headers. We also copy in its data, but remove the
              * fragmentation header. */
-            memcpy(rp->pkt, frag->pkt, frag->frag_hdr_offset);
-            memcpy(rp->pkt + frag->frag_hdr_offset,
-                frag->pkt + frag->frag_hdr_offset + sizeof(IPV6FragHdr),
-                frag->data_len);
-            rp->ip6h = (IPV6Hdr *)(rp->pkt + frag->ip_hdr_offset);
+            if (PacketCopyDataOffset(rp, 0, frag->pkt, frag->frag_hdr_offset) == -1)
+                goto remove_tracker;
+            if (PacketCopyDataOffset(rp, frag->frag_hdr_offset,
+                    frag->pkt + frag->frag_hdr_offset + sizeof(IPV6FragHdr),
+                    frag->data_len) == -1)
+                goto remove_tracker;
+            rp->ip6h = (IPV6Hdr *)(GET_PKT_DATA(rp) + frag->ip_hdr_offset);
             ip_hdr_offset = frag->ip_hdr_offset;
 
             /* This is the start of the fragmentable portion of the
@@ -687,14 +694,17 @@ Defrag6Reassemble(ThreadVars *tv, DefragContext *dc, DefragTracker *tracker,
             fragmentable_len = frag->data_len;
         }
         else {
-            memcpy(rp->pkt + fragmentable_offset + frag->offset + frag->ltrim,
-                frag->pkt + frag->data_offset + frag->ltrim,
-                frag->data_len - frag->ltrim);
+            if (PacketCopyDataOffset(rp,
+                    fragmentable_offset + frag->offset + frag->ltrim,
+                    frag->pkt + frag->data_offset + frag->ltrim,
+                    frag->data_len - frag->ltrim) == -1)
+                goto remove_tracker;
             if (frag->offset + frag->data_len > fragmentable_len)
                 fragmentable_len = frag->offset + frag->data_len;
         }
     }
     BUG_ON(rp->ip6h == NULL);
+    rp->ip6h = (IPV6Hdr *)(GET_PKT_DATA(rp) + ip_hdr_offset);
     rp->ip6h->s_ip6_plen = htons(fragmentable_len);
     rp->ip6h->s_ip6_nxt = next_hdr;
     rp->pktlen = ip_hdr_offset + sizeof(IPV6Hdr) + fragmentable_len;
@@ -753,10 +763,10 @@ DefragInsertFrag(ThreadVars *tv, DecodeThreadVars *dtv, DefragContext *dc,
         more_frags = IPV4_GET_MF(p);
         frag_offset = IPV4_GET_IPOFFSET(p) << 3;
         hlen = IPV4_GET_HLEN(p);
-        data_offset = (uint8_t *)p->ip4h + hlen - p->pkt;
+        data_offset = (uint8_t *)p->ip4h + hlen - GET_PKT_DATA(p);
         data_len = IPV4_GET_IPLEN(p) - hlen;
         frag_end = frag_offset + data_len;
-        ip_hdr_offset = (uint8_t *)p->ip4h - p->pkt;
+        ip_hdr_offset = (uint8_t *)p->ip4h - GET_PKT_DATA(p);
 
         /* Ignore fragment if the end of packet extends past the
          * maximum size of a packet. */
@@ -768,13 +778,13 @@ DefragInsertFrag(ThreadVars *tv, DecodeThreadVars *dtv, DefragContext *dc,
     else if (tracker->af == AF_INET6) {
         more_frags = IPV6_EXTHDR_GET_FH_FLAG(p);
         frag_offset = IPV6_EXTHDR_GET_FH_OFFSET(p);
-        data_offset = (uint8_t *)p->ip6eh.ip6fh + sizeof(IPV6FragHdr) - p->pkt;
+        data_offset = (uint8_t *)p->ip6eh.ip6fh + sizeof(IPV6FragHdr) - GET_PKT_DATA(p);
         data_len = IPV6_GET_PLEN(p) - (
             ((uint8_t *)p->ip6eh.ip6fh + sizeof(IPV6FragHdr)) -
                 ((uint8_t *)p->ip6h + sizeof(IPV6Hdr)));
         frag_end = frag_offset + data_len;
-        ip_hdr_offset = (uint8_t *)p->ip6h - p->pkt;
-        frag_hdr_offset = (uint8_t *)p->ip6eh.ip6fh - p->pkt;
+        ip_hdr_offset = (uint8_t *)p->ip6h - GET_PKT_DATA(p);
+        frag_hdr_offset = (uint8_t *)p->ip6eh.ip6fh - GET_PKT_DATA(p);
 
         /* Ignore fragment if the end of packet extends past the
          * maximum size of a packet. */
@@ -900,7 +910,7 @@ insert:
         SCMutexUnlock(&dc->frag_pool_lock);
         goto done;
     }
-    memcpy(new->pkt, p->pkt + ltrim, p->pktlen - ltrim);
+    memcpy(new->pkt, GET_PKT_DATA(p) + ltrim, GET_PKT_LEN(p) - ltrim);
     new->len = p->pktlen - ltrim;
     new->hlen = hlen;
     new->offset = frag_offset + ltrim;
@@ -1368,19 +1378,19 @@ DefragInOrderSimpleTest(void)
 
     /* 20 bytes in we should find 8 bytes of A. */
     for (i = 20; i < 20 + 8; i++) {
-        if (reassembled->pkt[i] != 'A')
+        if (GET_PKT_DATA(reassembled)[i] != 'A')
             goto end;
     }
 
     /* 28 bytes in we should find 8 bytes of B. */
     for (i = 28; i < 28 + 8; i++) {
-        if (reassembled->pkt[i] != 'B')
+        if (GET_PKT_DATA(reassembled)[i] != 'B')
             goto end;
     }
 
     /* And 36 bytes in we should find 3 bytes of C. */
     for (i = 36; i < 36 + 3; i++) {
-        if (reassembled->pkt[i] != 'C')
+        if (GET_PKT_DATA(reassembled)[i] != 'C')
             goto end;
     }
 
@@ -1447,19 +1457,19 @@ DefragReverseSimpleTest(void)
 
     /* 20 bytes in we should find 8 bytes of A. */
     for (i = 20; i < 20 + 8; i++) {
-        if (reassembled->pkt[i] != 'A')
+        if (GET_PKT_DATA(reassembled)[i] != 'A')
             goto end;
     }
 
     /* 28 bytes in we should find 8 bytes of B. */
     for (i = 28; i < 28 + 8; i++) {
-        if (reassembled->pkt[i] != 'B')
+        if (GET_PKT_DATA(reassembled)[i] != 'B')
             goto end;
     }
 
     /* And 36 bytes in we should find 3 bytes of C. */
     for (i = 36; i < 36 + 3; i++) {
-        if (reassembled->pkt[i] != 'C')
+        if (GET_PKT_DATA(reassembled)[i] != 'C')
             goto end;
     }
 
@@ -1524,19 +1534,19 @@ IPV6DefragInOrderSimpleTest(void)
 
     /* 40 bytes in we should find 8 bytes of A. */
     for (i = 40; i < 40 + 8; i++) {
-        if (reassembled->pkt[i] != 'A')
+        if (GET_PKT_DATA(reassembled)[i] != 'A')
             goto end;
     }
 
     /* 28 bytes in we should find 8 bytes of B. */
     for (i = 48; i < 48 + 8; i++) {
-        if (reassembled->pkt[i] != 'B')
+        if (GET_PKT_DATA(reassembled)[i] != 'B')
             goto end;
     }
 
     /* And 36 bytes in we should find 3 bytes of C. */
     for (i = 56; i < 56 + 3; i++) {
-        if (reassembled->pkt[i] != 'C')
+        if (GET_PKT_DATA(reassembled)[i] != 'C')
             goto end;
     }
 
@@ -1593,19 +1603,19 @@ IPV6DefragReverseSimpleTest(void)
 
     /* 40 bytes in we should find 8 bytes of A. */
     for (i = 40; i < 40 + 8; i++) {
-        if (reassembled->pkt[i] != 'A')
+        if (GET_PKT_DATA(reassembled)[i] != 'A')
             goto end;
     }
 
     /* 28 bytes in we should find 8 bytes of B. */
     for (i = 48; i < 48 + 8; i++) {
-        if (reassembled->pkt[i] != 'B')
+        if (GET_PKT_DATA(reassembled)[i] != 'B')
             goto end;
     }
 
     /* And 36 bytes in we should find 3 bytes of C. */
     for (i = 56; i < 56 + 3; i++) {
-        if (reassembled->pkt[i] != 'C')
+        if (GET_PKT_DATA(reassembled)[i] != 'C')
             goto end;
     }
 
@@ -1726,7 +1736,7 @@ DefragDoSturgesNovakTest(int policy, u_char *expected, size_t expected_len)
     if (IPV4_GET_IPLEN(reassembled) != 20 + 192)
         goto end;
 
-    if (memcmp(reassembled->pkt + 20, expected, expected_len) != 0)
+    if (memcmp(GET_PKT_DATA(reassembled) + 20, expected, expected_len) != 0)
         goto end;
     SCFree(reassembled);
 
@@ -1917,7 +1927,7 @@ IPV6DefragDoSturgesNovakTest(int policy, u_char *expected, size_t expected_len)
     Packet *reassembled = Defrag(NULL, NULL, dc, packets[16]);
     if (reassembled == NULL)
         goto end;
-    if (memcmp(reassembled->pkt + 40, expected, expected_len) != 0)
+    if (memcmp(GET_PKT_DATA(reassembled) + 40, expected, expected_len) != 0)
         goto end;
 
     if (IPV6_GET_PLEN(reassembled) != 192)
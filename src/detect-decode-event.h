@@ -109,6 +109,16 @@ struct DetectDecodeEvents_ {
     { "ipraw.wrong_ip_version",IPRAW_INVALID_IPV, },
     { "vlan.hlen_too_small",VLAN_HEADER_TOO_SMALL, },
     { "vlan.unknown_type",VLAN_UNKNOWN_TYPE, },
+    { "lorawan.pkt_too_small", LORAWAN_PKT_TOO_SMALL, },
+    { "lorawan.fhdr_too_big", LORAWAN_FRAME_HEADER_TOO_BIG, },
+    { "lorawan.fhdr_too_small", LORAWAN_FRAME_PKT_INVALID, },
+    { "lorawan.fopts_with_fport0", LORAWAN_FRAME_CONTROL_INVALID, },
+    { "lorawan.join_invalid_len", LORAWAN_HEADER_INVALID_LEN, },
+    { "lorawan.unknown_major", LORAWAN_MAJOR_UNKNOWN, },
+    { "lorawan.mtype_rfu", LORAWAN_MTYPE_RFU, },
+    { "lorawan.fcnt_replay", LORAWAN_FCNT_REPLAY, },
+    { "lorawan.fcnt_rollback", LORAWAN_FCNT_ROLLBACK, },
+    { "lorawan.fcnt_jump", LORAWAN_FCNT_JUMP, },
     { NULL, 0 },
 };
 #endif /* DETECT_EVENTS */
@@ -1556,6 +1556,182 @@ DetectAddress *DetectAddressLookupInHead(DetectAddressHead *gh, Address *a)
     SCReturnPtr(NULL, "DetectAddress");
 }
 
+static int DetectAddressRange4Cmp(const void *a, const void *b) {
+    const DetectAddressRange4 *ra = (const DetectAddressRange4 *)a;
+    const DetectAddressRange4 *rb = (const DetectAddressRange4 *)b;
+
+    if (ra->ip < rb->ip)
+        return -1;
+    if (ra->ip > rb->ip)
+        return 1;
+    return 0;
+}
+
+/** \brief compare two ipv6 addresses with the words in host order */
+static int DetectAddressIPv6HostCmp(const uint32_t *a, const uint32_t *b) {
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        if (a[i] < b[i])
+            return -1;
+        if (a[i] > b[i])
+            return 1;
+    }
+    return 0;
+}
+
+static int DetectAddressRange6Cmp(const void *a, const void *b) {
+    return DetectAddressIPv6HostCmp(((const DetectAddressRange6 *)a)->ip,
+                                    ((const DetectAddressRange6 *)b)->ip);
+}
+
+/**
+ * \brief Free the ranges of an address array
+ *
+ * \param aa Pointer to the DetectAddressArray
+ */
+void DetectAddressArrayFree(DetectAddressArray *aa)
+{
+    if (aa->ipv4 != NULL)
+        SCFree(aa->ipv4);
+    if (aa->ipv6 != NULL)
+        SCFree(aa->ipv6);
+
+    memset(aa, 0, sizeof(DetectAddressArray));
+}
+
+/**
+ * \brief Build the sorted arrays of the ipv4 and ipv6 ranges of an address
+ *        group head, overlapping ranges merged. The 'any' list is left
+ *        out, as DetectAddressMatch() never matches its addresses.
+ *
+ * \param gh Pointer to the DetectAddressHead
+ * \param aa Pointer to the DetectAddressArray to fill, what it had is freed
+ *
+ * \retval 0 on success
+ * \retval -1 on error
+ */
+int DetectAddressArrayBuild(DetectAddressHead *gh, DetectAddressArray *aa)
+{
+    SCEnter();
+
+    DetectAddress *ag;
+    uint32_t cnt, i, j;
+    int k;
+
+    DetectAddressArrayFree(aa);
+
+    for (cnt = 0, ag = gh->ipv4_head; ag != NULL; ag = ag->next)
+        cnt++;
+    if (cnt > 0) {
+        aa->ipv4 = SCMalloc(cnt * sizeof(DetectAddressRange4));
+        if (aa->ipv4 == NULL)
+            goto error;
+
+        for (i = 0, ag = gh->ipv4_head; ag != NULL; ag = ag->next, i++) {
+            aa->ipv4[i].ip = ntohl(ag->ip[0]);
+            aa->ipv4[i].ip2 = ntohl(ag->ip2[0]);
+        }
+        qsort(aa->ipv4, cnt, sizeof(DetectAddressRange4), DetectAddressRange4Cmp);
+
+        for (i = 0, j = 1; j < cnt; j++) {
+            if ((uint64_t)aa->ipv4[i].ip2 + 1 >= aa->ipv4[j].ip) {
+                if (aa->ipv4[j].ip2 > aa->ipv4[i].ip2)
+                    aa->ipv4[i].ip2 = aa->ipv4[j].ip2;
+            } else {
+                aa->ipv4[++i] = aa->ipv4[j];
+            }
+        }
+        aa->ipv4_cnt = i + 1;
+    }
+
+    for (cnt = 0, ag = gh->ipv6_head; ag != NULL; ag = ag->next)
+        cnt++;
+    if (cnt > 0) {
+        aa->ipv6 = SCMalloc(cnt * sizeof(DetectAddressRange6));
+        if (aa->ipv6 == NULL)
+            goto error;
+
+        for (i = 0, ag = gh->ipv6_head; ag != NULL; ag = ag->next, i++) {
+            for (k = 0; k < 4; k++) {
+                aa->ipv6[i].ip[k] = ntohl(ag->ip[k]);
+                aa->ipv6[i].ip2[k] = ntohl(ag->ip2[k]);
+            }
+        }
+        qsort(aa->ipv6, cnt, sizeof(DetectAddressRange6), DetectAddressRange6Cmp);
+
+        for (i = 0, j = 1; j < cnt; j++) {
+            if (DetectAddressIPv6HostCmp(aa->ipv6[j].ip, aa->ipv6[i].ip2) <= 0) {
+                if (DetectAddressIPv6HostCmp(aa->ipv6[j].ip2, aa->ipv6[i].ip2) > 0)
+                    memcpy(aa->ipv6[i].ip2, aa->ipv6[j].ip2, sizeof(aa->ipv6[i].ip2));
+            } else {
+                aa->ipv6[++i] = aa->ipv6[j];
+            }
+        }
+        aa->ipv6_cnt = i + 1;
+    }
+
+    SCReturnInt(0);
+
+error:
+    DetectAddressArrayFree(aa);
+    SCReturnInt(-1);
+}
+
+/**
+ * \brief Look up an address in an address array
+ *
+ * \param aa Pointer to the DetectAddressArray
+ * \param a  Pointer to an Address instance
+ *
+ * \retval 1 if the address is in one of the ranges
+ * \retval 0 if not
+ */
+int DetectAddressArrayLookup(DetectAddressArray *aa, Address *a)
+{
+    uint32_t lo = 0, hi, mid;
+
+    if (a->family == AF_INET) {
+        uint32_t ip = ntohl(a->addr_data32[0]);
+
+        /* the first range starting above the address */
+        hi = aa->ipv4_cnt;
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (aa->ipv4[mid].ip <= ip)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if (lo == 0)
+            return 0;
+        return (ip <= aa->ipv4[lo - 1].ip2);
+
+    } else if (a->family == AF_INET6) {
+        uint32_t ip[4];
+        int k;
+
+        for (k = 0; k < 4; k++)
+            ip[k] = ntohl(a->addr_data32[k]);
+
+        hi = aa->ipv6_cnt;
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (DetectAddressIPv6HostCmp(aa->ipv6[mid].ip, ip) <= 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if (lo == 0)
+            return 0;
+        return (DetectAddressIPv6HostCmp(ip, aa->ipv6[lo - 1].ip2) <= 0);
+    }
+
+    return 0;
+}
+
 /********************************Unittests*************************************/
 
 #ifdef UNITTESTS
@@ -4014,6 +4190,58 @@ int AddressTestParseInvalidMask03(void)
     return result;
 }
 
+/**
+ * \test Test that the address array matches the addresses the group head
+ *       matches
+ */
+int AddressTestArray01(void)
+{
+    int result = 0;
+    DetectAddressArray aa;
+    DetectAddressHead *gh = DetectAddressHeadInit();
+    char *addrs[] = { "1.2.2.255", "1.2.3.0", "1.2.3.4", "1.2.3.5", "1.2.4.0",
+                      "10.1.2.3", "9.255.255.255", "11.0.0.0", "255.255.255.255",
+                      "0.0.0.0", "2001::", "2001::1", "2001::2",
+                      "2001:ffff:ffff:ffff:ffff:ffff:ffff:ffff", "2002::",
+                      "2000:ffff:ffff:ffff:ffff:ffff:ffff:ffff", "::1", NULL };
+    int i;
+
+    memset(&aa, 0, sizeof(aa));
+
+    if (gh == NULL)
+        goto end;
+    if (DetectAddressParse(gh, "[1.2.3.0/24,!1.2.3.4,10.0.0.0/8,2001::/16,!2001::1]") != 0)
+        goto end;
+    if (DetectAddressArrayBuild(gh, &aa) != 0)
+        goto end;
+
+    for (i = 0; addrs[i] != NULL; i++) {
+        Address a;
+
+        memset(&a, 0, sizeof(Address));
+        if (inet_pton(AF_INET, addrs[i], &a.addr_data32[0]) == 1) {
+            a.family = AF_INET;
+        } else if (inet_pton(AF_INET6, addrs[i], &a.addr_data32[0]) == 1) {
+            a.family = AF_INET6;
+        } else {
+            goto end;
+        }
+
+        if (DetectAddressArrayLookup(&aa, &a) !=
+            (DetectAddressLookupInHead(gh, &a) != NULL)) {
+            printf("%s mismatch: ", addrs[i]);
+            goto end;
+        }
+    }
+
+    result = 1;
+end:
+    DetectAddressArrayFree(&aa);
+    if (gh != NULL)
+        DetectAddressHeadFree(gh);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void DetectAddressTests(void)
@@ -4186,5 +4414,6 @@ void DetectAddressTests(void)
                    AddressTestParseInvalidMask02, 1);
     UtRegisterTest("AddressTestParseInvalidMask03",
                    AddressTestParseInvalidMask03, 1);
+    UtRegisterTest("AddressTestArray01", AddressTestArray01, 1);
 #endif /* UNITTESTS */
 }
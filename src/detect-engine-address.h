@@ -47,6 +47,10 @@ int DetectAddressJoin(DetectEngineCtx *, DetectAddress *, DetectAddress *);
 DetectAddress *DetectAddressLookupInHead(DetectAddressHead *, Address *);
 DetectAddress *DetectAddressLookupInList(DetectAddress *, DetectAddress *);
 
+int DetectAddressArrayBuild(DetectAddressHead *, DetectAddressArray *);
+int DetectAddressArrayLookup(DetectAddressArray *, Address *);
+void DetectAddressArrayFree(DetectAddressArray *);
+
 DetectAddress *DetectAddressCopy(DetectAddress *);
 void DetectAddressPrint(DetectAddress *);
 int DetectAddressCmp(DetectAddress *, DetectAddress *);
@@ -97,10 +97,11 @@ int PacketAlertRemove(Packet *p, uint16_t pos)
 {
     uint16_t i = 0;
     int match = 0;
-    if (pos > p->alerts.cnt)
+    if (pos >= p->alerts.cnt)
         return 0;
 
-    for (i = pos; i <= p->alerts.cnt - 1; i++) {
+    /* shift the alerts after pos, don't read past the last one */
+    for (i = pos; i + 1 < p->alerts.cnt; i++) {
         memcpy(&p->alerts.alerts[i], &p->alerts.alerts[i + 1], sizeof(PacketAlert));
     }
 
@@ -110,11 +111,58 @@ int PacketAlertRemove(Packet *p, uint16_t pos)
     return match;
 }
 
+/**
+ * \brief Make room for one more alert in p->alerts.alerts.
+ *
+ * Most packets don't alert at all or only on a few sigs, so the packet
+ * only carries PACKET_ALERT_INLINE alerts. When that isn't enough we move
+ * to a SCMalloc'd array, doubling it each time up to PACKET_ALERT_MAX.
+ * The array is released when the packet is recycled.
+ *
+ * \retval 0 ok, room for at least one more alert
+ * \retval -1 no room: PACKET_ALERT_MAX reached or out of memory
+ */
+static int PacketAlertGrow(Packet *p)
+{
+    PacketAlert *new_alerts = NULL;
+    uint16_t new_size = 0;
+
+    /* packet wasn't set up with PACKET_INITIALIZE, e.g. memset in tests */
+    if (p->alerts.alerts == NULL) {
+        p->alerts.alerts = p->alerts.inline_alerts;
+        p->alerts.size = PACKET_ALERT_INLINE;
+    }
+
+    if (p->alerts.cnt < p->alerts.size)
+        return 0;
+
+    if (p->alerts.size >= PACKET_ALERT_MAX)
+        return -1;
+
+    new_size = p->alerts.size * 2;
+    if (new_size > PACKET_ALERT_MAX)
+        new_size = PACKET_ALERT_MAX;
+
+    new_alerts = SCMalloc(new_size * sizeof(PacketAlert));
+    if (new_alerts == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "SCMalloc failed: %s", strerror(errno));
+        return -1;
+    }
+    memcpy(new_alerts, p->alerts.alerts, p->alerts.cnt * sizeof(PacketAlert));
+
+    if (p->alerts.alerts != p->alerts.inline_alerts)
+        SCFree(p->alerts.alerts);
+
+    p->alerts.alerts = new_alerts;
+    p->alerts.size = new_size;
+    return 0;
+}
+
 int PacketAlertAppend(DetectEngineThreadCtx *det_ctx, Signature *s, Packet *p)
 {
     int i = 0;
 
-    if (p->alerts.cnt == PACKET_ALERT_MAX)
+    if (PacketAlertGrow(p) == -1)
         return 0;
 
     SCLogDebug("sid %"PRIu32"", s->id);
@@ -0,0 +1,776 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Rule cache: the compiled tables of the mpm ctxs of the signature
+ * groups, written to disk after a build and mapped back in by the next
+ * build (detect-engine.rule-cache).
+ *
+ * File layout, all in host byte order, everything padded to 8:
+ *
+ *   DetectEngineCacheHeader
+ *   record_cnt times: DetectEngineCacheRecord, len bytes
+ *
+ * There is a record per pattern set. Its key is a hash of the patterns
+ * of the ctx (whatever order they were added in), the mpm and the mpm
+ * settings the tables depend on, see MpmTableElmt::CacheKey(). A ctx is
+ * loaded from the record of its key, so a rule change only recompiles the
+ * groups whose patterns changed. Behind the key every mpm stores its
+ * patterns in the order of its pattern array, and only takes the record
+ * if all of them are in the ctx. The tables themselves are flat arrays
+ * that are used in place, in the mapping; the lists that hang off them
+ * are rebuilt from the pattern array, which is cheap next to computing
+ * the tables. Anything that doesn't fit, a record of another version,
+ * byte order or pointer size, a missing or short record, and the ctx is
+ * compiled as usual.
+ *
+ * The rules are still parsed and grouped on every build, the signatures
+ * and groups are full of pointers. What the cache saves is compiling the
+ * pattern matchers and keeping their tables in memory of our own: they
+ * stay in the page cache, shared between reloads.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+#include "detect.h"
+#include "detect-engine-cache.h"
+
+#include "util-mpm.h"
+#include "util-debug.h"
+#include "util-unittest.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+/**
+ * \brief FNV-1a over a buffer
+ *
+ * \param h hash so far, DETECT_ENGINE_CACHE_HASH_INIT to start
+ */
+uint64_t DetectEngineCacheHash(uint64_t h, const uint8_t *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h ^= buf[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+void DetectEngineCacheKeyInit(DetectEngineCacheKeyCtx *kctx)
+{
+    memset(kctx, 0, sizeof(DetectEngineCacheKeyCtx));
+}
+
+/**
+ * \brief add a pattern of the set to the key
+ *
+ * \param cs case sensitive pattern, as the mpm stores it
+ */
+void DetectEngineCacheKeyAdd(DetectEngineCacheKeyCtx *kctx, const uint8_t *cs,
+        uint16_t len, uint8_t flags, uint32_t id)
+{
+    uint64_t h = DETECT_ENGINE_CACHE_HASH_INIT;
+
+    h = DetectEngineCacheHash(h, (uint8_t *)&id, sizeof(id));
+    h = DetectEngineCacheHash(h, (uint8_t *)&len, sizeof(len));
+    h = DetectEngineCacheHash(h, &flags, sizeof(flags));
+    h = DetectEngineCacheHash(h, cs, len);
+
+    /* sum and xor don't care about the order */
+    kctx->sum += h;
+    kctx->xsum ^= h;
+    kctx->cnt++;
+}
+
+/**
+ * \brief key of the pattern set
+ *
+ * \param settings the settings of the mpm the tables depend on, e.g.
+ *        hash and bloom sizes
+ */
+uint64_t DetectEngineCacheKeyFinal(DetectEngineCacheKeyCtx *kctx, uint16_t mpm_type,
+        const uint32_t *settings, uint32_t settings_cnt)
+{
+    uint64_t h = DETECT_ENGINE_CACHE_HASH_INIT;
+    uint32_t version = DETECT_ENGINE_CACHE_VERSION;
+
+    h = DetectEngineCacheHash(h, (uint8_t *)&version, sizeof(version));
+    h = DetectEngineCacheHash(h, (uint8_t *)&mpm_type, sizeof(mpm_type));
+    h = DetectEngineCacheHash(h, (uint8_t *)&kctx->cnt, sizeof(kctx->cnt));
+    h = DetectEngineCacheHash(h, (uint8_t *)&kctx->sum, sizeof(kctx->sum));
+    h = DetectEngineCacheHash(h, (uint8_t *)&kctx->xsum, sizeof(kctx->xsum));
+    h = DetectEngineCacheHash(h, (uint8_t *)settings,
+            settings_cnt * sizeof(uint32_t));
+    return h;
+}
+
+/**
+ * \brief write an array to a record, padded to 8
+ *
+ * \retval 0 ok, -1 write error
+ */
+int DetectEngineCacheWriteArray(FILE *fp, const void *data, size_t len)
+{
+    static const uint8_t pad[8] = { 0 };
+
+    if (len > 0 && fwrite(data, len, 1, fp) != 1)
+        return -1;
+    if (DETECT_ENGINE_CACHE_ALIGN(len) != len &&
+        fwrite(pad, DETECT_ENGINE_CACHE_ALIGN(len) - len, 1, fp) != 1)
+        return -1;
+    return 0;
+}
+
+/**
+ * \brief write a pattern to a record, see DetectEngineCacheReadPattern()
+ *
+ * \retval 0 ok, -1 write error
+ */
+int DetectEngineCacheWritePattern(FILE *fp, const uint8_t *cs, uint16_t len,
+        uint8_t flags, uint32_t id)
+{
+    DetectEngineCachePattern pat;
+
+    memset(&pat, 0, sizeof(pat));
+    pat.id = id;
+    pat.len = len;
+    pat.flags = flags;
+
+    if (fwrite(&pat, sizeof(pat), 1, fp) != 1)
+        return -1;
+    return DetectEngineCacheWriteArray(fp, cs, len);
+}
+
+/**
+ * \brief take the next array of a record
+ *
+ * \param ptr position in the record, moved past the array
+ * \param left bytes left in the record
+ * \param len length of the array as it was written
+ *
+ * \retval array or NULL if the record is too short
+ */
+void *DetectEngineCacheReadArray(uint8_t **ptr, uint32_t *left, size_t len)
+{
+    uint8_t *data = *ptr;
+
+    if (DETECT_ENGINE_CACHE_ALIGN(len) > (size_t)*left)
+        return NULL;
+
+    *ptr += DETECT_ENGINE_CACHE_ALIGN(len);
+    *left -= (uint32_t)DETECT_ENGINE_CACHE_ALIGN(len);
+    return data;
+}
+
+/**
+ * \brief take the next pattern of a record, the pattern itself is at
+ *        DETECT_ENGINE_CACHE_PATTERN()
+ *
+ * \retval pat the pattern or NULL if the record is too short
+ */
+DetectEngineCachePattern *DetectEngineCacheReadPattern(uint8_t **ptr, uint32_t *left)
+{
+    DetectEngineCachePattern *pat = DetectEngineCacheReadArray(ptr, left,
+            sizeof(DetectEngineCachePattern));
+    if (pat == NULL || pat->len == 0)
+        return NULL;
+    if (DetectEngineCacheReadArray(ptr, left, pat->len) == NULL)
+        return NULL;
+    return pat;
+}
+
+static int DetectEngineCacheRecordCmp(const void *a, const void *b)
+{
+    const DetectEngineCacheRecord *ra = *(DetectEngineCacheRecord * const *)a;
+    const DetectEngineCacheRecord *rb = *(DetectEngineCacheRecord * const *)b;
+
+    if (ra->key != rb->key)
+        return ra->key < rb->key ? -1 : 1;
+    if (ra->mpm_type != rb->mpm_type)
+        return ra->mpm_type < rb->mpm_type ? -1 : 1;
+    return 0;
+}
+
+/**
+ * \brief map a cache file and index its records
+ *
+ * \param path cache file
+ *
+ * \retval cache the mapped cache or NULL if there is none we can use
+ */
+DetectEngineCache *DetectEngineCacheOpen(const char *path)
+{
+    DetectEngineCache *cache = NULL;
+    struct stat st;
+    uint32_t i;
+    size_t off;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        SCLogInfo("no rule cache in %s yet, compiling the pattern matchers", path);
+        return NULL;
+    }
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(DetectEngineCacheHeader)) {
+        SCLogInfo("rule cache %s is truncated, compiling the pattern matchers", path);
+        close(fd);
+        return NULL;
+    }
+
+    uint8_t *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        SCLogError(SC_ERR_RULE_CACHE, "can't map rule cache %s: %s", path,
+                strerror(errno));
+        return NULL;
+    }
+
+    DetectEngineCacheHeader *hdr = (DetectEngineCacheHeader *)map;
+    if (memcmp(hdr->magic, DETECT_ENGINE_CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != DETECT_ENGINE_CACHE_VERSION ||
+        hdr->byte_order != DETECT_ENGINE_CACHE_BYTE_ORDER ||
+        hdr->ptr_size != sizeof(void *))
+    {
+        SCLogInfo("%s is not a rule cache of this version, compiling the "
+                "pattern matchers", path);
+        goto error;
+    }
+
+    cache = SCMalloc(sizeof(DetectEngineCache));
+    if (cache == NULL)
+        goto error;
+    memset(cache, 0, sizeof(DetectEngineCache));
+
+    if (hdr->record_cnt > 0) {
+        /* no more records than the file can hold */
+        if ((uint64_t)hdr->record_cnt * sizeof(DetectEngineCacheRecord) >
+                (uint64_t)st.st_size)
+            goto truncated;
+
+        cache->records = SCMalloc(hdr->record_cnt * sizeof(DetectEngineCacheRecord *));
+        if (cache->records == NULL)
+            goto error;
+    }
+
+    off = sizeof(DetectEngineCacheHeader);
+    for (i = 0; i < hdr->record_cnt; i++) {
+        DetectEngineCacheRecord *rec = (DetectEngineCacheRecord *)(map + off);
+
+        if ((size_t)st.st_size - off < sizeof(DetectEngineCacheRecord))
+            goto truncated;
+        off += sizeof(DetectEngineCacheRecord);
+        if (rec->len != DETECT_ENGINE_CACHE_ALIGN(rec->len) ||
+            (size_t)st.st_size - off < (size_t)rec->len)
+            goto truncated;
+        off += (size_t)rec->len;
+
+        cache->records[i] = rec;
+    }
+
+    qsort(cache->records, hdr->record_cnt, sizeof(DetectEngineCacheRecord *),
+            DetectEngineCacheRecordCmp);
+
+    cache->map = map;
+    cache->map_len = (size_t)st.st_size;
+    cache->record_cnt = hdr->record_cnt;
+    return cache;
+
+truncated:
+    SCLogInfo("rule cache %s is truncated, compiling the pattern matchers", path);
+error:
+    if (cache != NULL) {
+        if (cache->records != NULL)
+            SCFree(cache->records);
+        SCFree(cache);
+    }
+    munmap(map, (size_t)st.st_size);
+    return NULL;
+}
+
+/**
+ * \brief set up a ctx from the record of its pattern set instead of
+ *        compiling it. Safe to call for different ctxs at the same time.
+ *
+ * \retval 0 loaded, -1 ctx left as it is and needs to be compiled
+ */
+int DetectEngineCacheLoadCtx(DetectEngineCache *cache, MpmCtx *mpm_ctx)
+{
+    DetectEngineCacheRecord key_rec, *key_ptr = &key_rec;
+
+    if (cache == NULL || cache->record_cnt == 0 || mpm_ctx->pattern_cnt == 0 ||
+        mpm_table[mpm_ctx->mpm_type].CacheKey == NULL ||
+        mpm_table[mpm_ctx->mpm_type].CacheLoad == NULL)
+        return -1;
+
+    memset(&key_rec, 0, sizeof(key_rec));
+    key_rec.key = mpm_table[mpm_ctx->mpm_type].CacheKey(mpm_ctx);
+    key_rec.mpm_type = mpm_ctx->mpm_type;
+
+    DetectEngineCacheRecord **rec = bsearch(&key_ptr, cache->records,
+            cache->record_cnt, sizeof(DetectEngineCacheRecord *),
+            DetectEngineCacheRecordCmp);
+    if (rec == NULL)
+        return -1;
+
+    return mpm_table[mpm_ctx->mpm_type].CacheLoad(mpm_ctx,
+            (uint8_t *)(*rec) + sizeof(DetectEngineCacheRecord), (*rec)->len);
+}
+
+void DetectEngineCacheClose(DetectEngineCache *cache)
+{
+    if (cache == NULL)
+        return;
+
+    munmap(cache->map, cache->map_len);
+    if (cache->records != NULL)
+        SCFree(cache->records);
+    SCFree(cache);
+}
+
+typedef struct DetectEngineCacheWriteItem_ {
+    uint64_t key;
+    MpmCtx *mpm_ctx;
+} DetectEngineCacheWriteItem;
+
+static int DetectEngineCacheWriteItemCmp(const void *a, const void *b)
+{
+    const DetectEngineCacheWriteItem *ia = a;
+    const DetectEngineCacheWriteItem *ib = b;
+
+    if (ia->key != ib->key)
+        return ia->key < ib->key ? -1 : 1;
+    if (ia->mpm_ctx->mpm_type != ib->mpm_ctx->mpm_type)
+        return ia->mpm_ctx->mpm_type < ib->mpm_ctx->mpm_type ? -1 : 1;
+    return 0;
+}
+
+/**
+ * \brief write the tables of the compiled mpm ctxs to a cache file, one
+ *        record per pattern set
+ *
+ * The file is written next to path and renamed over it, so a running
+ * engine that has the old file mapped keeps its copy.
+ *
+ * \retval 0 ok, -1 error
+ */
+int DetectEngineCacheWrite(const char *path, MpmPrepareItem *items, uint32_t cnt)
+{
+    DetectEngineCacheWriteItem *witems = NULL;
+    DetectEngineCacheHeader hdr;
+    char tmp[PATH_MAX];
+    uint32_t i, witem_cnt = 0;
+    FILE *fp = NULL;
+    long size = (long)sizeof(hdr);
+
+    if (cnt > 0) {
+        witems = SCMalloc(cnt * sizeof(DetectEngineCacheWriteItem));
+        if (witems == NULL)
+            return -1;
+    }
+    for (i = 0; i < cnt; i++) {
+        MpmCtx *mpm_ctx = items[i].mpm_ctx;
+        if (mpm_ctx->pattern_cnt == 0 ||
+            mpm_table[mpm_ctx->mpm_type].CacheKey == NULL ||
+            mpm_table[mpm_ctx->mpm_type].CacheWrite == NULL)
+            continue;
+
+        witems[witem_cnt].key = mpm_table[mpm_ctx->mpm_type].CacheKey(mpm_ctx);
+        witems[witem_cnt].mpm_ctx = mpm_ctx;
+        witem_cnt++;
+    }
+    /* groups with the same patterns share a record */
+    if (witem_cnt > 0) {
+        qsort(witems, witem_cnt, sizeof(DetectEngineCacheWriteItem),
+                DetectEngineCacheWriteItemCmp);
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+    fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        SCLogError(SC_ERR_RULE_CACHE, "can't write rule cache %s: %s", tmp,
+                strerror(errno));
+        if (witems != NULL)
+            SCFree(witems);
+        return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, DETECT_ENGINE_CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version = DETECT_ENGINE_CACHE_VERSION;
+    hdr.byte_order = DETECT_ENGINE_CACHE_BYTE_ORDER;
+    hdr.ptr_size = sizeof(void *);
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+        goto error;
+
+    for (i = 0; i < witem_cnt; i++) {
+        MpmCtx *mpm_ctx = witems[i].mpm_ctx;
+        DetectEngineCacheRecord rec;
+
+        if (i > 0 && DetectEngineCacheWriteItemCmp(&witems[i - 1], &witems[i]) == 0)
+            continue;
+
+        memset(&rec, 0, sizeof(rec));
+        rec.key = witems[i].key;
+        rec.mpm_type = mpm_ctx->mpm_type;
+
+        long start = ftell(fp);
+        if (start < 0 || fwrite(&rec, sizeof(rec), 1, fp) != 1)
+            goto error;
+
+        /* a ctx the mpm can't write, e.g. one it failed to compile, is
+         * left out and compiled next time */
+        if (mpm_table[mpm_ctx->mpm_type].CacheWrite(mpm_ctx, fp) < 0) {
+            if (fseek(fp, start, SEEK_SET) != 0)
+                goto error;
+            continue;
+        }
+
+        long end = ftell(fp);
+        if (end < 0)
+            goto error;
+        /* the mpms write with DetectEngineCacheWriteArray() */
+        rec.len = (uint32_t)(end - start - (long)sizeof(rec));
+        if (DETECT_ENGINE_CACHE_ALIGN(rec.len) != rec.len)
+            goto error;
+
+        if (fseek(fp, start, SEEK_SET) != 0 ||
+            fwrite(&rec, sizeof(rec), 1, fp) != 1 ||
+            fseek(fp, end, SEEK_SET) != 0)
+            goto error;
+        hdr.record_cnt++;
+        size = end;
+    }
+
+    if (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+        goto error;
+
+    /* a skipped ctx may have left bytes behind the last record */
+    if (fflush(fp) != 0 || ftruncate(fileno(fp), size) != 0 ||
+        fsync(fileno(fp)) != 0)
+        goto error;
+    if (fclose(fp) != 0) {
+        fp = NULL;
+        goto error;
+    }
+    fp = NULL;
+
+    if (rename(tmp, path) != 0)
+        goto error;
+
+    SCLogInfo("wrote the tables of %" PRIu32 " pattern sets to rule cache %s",
+            hdr.record_cnt, path);
+    if (witems != NULL)
+        SCFree(witems);
+    return 0;
+
+error:
+    SCLogError(SC_ERR_RULE_CACHE, "can't write rule cache %s: %s", path,
+            strerror(errno));
+    if (fp != NULL)
+        fclose(fp);
+    unlink(tmp);
+    if (witems != NULL)
+        SCFree(witems);
+    return -1;
+}
+
+/*
+ * TESTS
+ */
+
+#ifdef UNITTESTS
+/** \brief set up a ctx of pats, nocase if they start with a '~' */
+static void DetectEngineCacheTestAdd(MpmCtx *mpm_ctx, uint16_t mpm_type,
+        char **pats, int patcnt, int reverse)
+{
+    int i, j;
+
+    memset(mpm_ctx, 0, sizeof(MpmCtx));
+    MpmInitCtx(mpm_ctx, mpm_type, -1);
+    for (j = 0; j < patcnt; j++) {
+        i = reverse ? patcnt - 1 - j : j;
+        if (pats[i][0] == '~')
+            mpm_table[mpm_type].AddPatternNocase(mpm_ctx, (uint8_t *)pats[i] + 1,
+                    strlen(pats[i]) - 1, 0, 0, i, 0, 0);
+        else
+            mpm_table[mpm_type].AddPattern(mpm_ctx, (uint8_t *)pats[i],
+                    strlen(pats[i]), 0, 0, i, 0, 0);
+    }
+}
+
+static uint32_t DetectEngineCacheTestSearch(MpmCtx *mpm_ctx, PatternMatcherQueue *pmq,
+        uint8_t *buf, uint16_t buflen)
+{
+    MpmThreadCtx mpm_thread_ctx;
+    uint32_t cnt;
+
+    memset(&mpm_thread_ctx, 0, sizeof(mpm_thread_ctx));
+    mpm_table[mpm_ctx->mpm_type].InitThreadCtx(mpm_ctx, &mpm_thread_ctx,
+            mpm_ctx->pattern_cnt);
+    PmqReset(pmq);
+    cnt = mpm_table[mpm_ctx->mpm_type].Search(mpm_ctx, &mpm_thread_ctx, pmq,
+            buf, buflen);
+    mpm_table[mpm_ctx->mpm_type].DestroyThreadCtx(mpm_ctx, &mpm_thread_ctx);
+    return cnt;
+}
+
+/**
+ * \brief compile a ctx of pats, write it to a rule cache and load a ctx
+ *        of the same patterns, added the other way around, from it.
+ *        The two must have the same tables according to Compare and find
+ *        the same in buf. A ctx with a pattern more must not load, and
+ *        compile as usual.
+ *
+ * \param pats patterns, nocase if they start with a '~'
+ *
+ * \retval 1 ok, 0 not
+ */
+int DetectEngineCacheTestCompare(uint16_t mpm_type, char **pats, int patcnt,
+        uint8_t *buf, uint16_t buflen, int (*Compare)(MpmCtx *, MpmCtx *))
+{
+    char path[] = "/tmp/rule-cache-XXXXXX";
+    char *more[16];
+    PatternMatcherQueue pmq, cache_pmq;
+    MpmCtx mpm_ctx, cache_ctx, more_ctx;
+    DetectEngineCache *cache = NULL;
+    MpmPrepareItem item;
+    int result = 0, i;
+
+    if (patcnt >= (int)(sizeof(more) / sizeof(more[0])))
+        return 0;
+
+    memset(&mpm_ctx, 0, sizeof(mpm_ctx));
+    memset(&cache_ctx, 0, sizeof(cache_ctx));
+    memset(&more_ctx, 0, sizeof(more_ctx));
+    PmqSetup(&pmq, 0, patcnt + 1);
+    PmqSetup(&cache_pmq, 0, patcnt + 1);
+
+    int fd = mkstemp(path);
+    if (fd < 0)
+        goto end;
+    close(fd);
+
+    DetectEngineCacheTestAdd(&mpm_ctx, mpm_type, pats, patcnt, 0);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
+
+    memset(&item, 0, sizeof(item));
+    item.mpm_ctx = &mpm_ctx;
+    if (DetectEngineCacheWrite(path, &item, 1) < 0)
+        goto end;
+    cache = DetectEngineCacheOpen(path);
+    if (cache == NULL || cache->record_cnt != 1) {
+        printf("no cache written: ");
+        goto end;
+    }
+
+    DetectEngineCacheTestAdd(&cache_ctx, mpm_type, pats, patcnt, 1);
+    if (DetectEngineCacheLoadCtx(cache, &cache_ctx) != 0) {
+        printf("ctx not loaded from the cache: ");
+        goto end;
+    }
+    if (Compare(&mpm_ctx, &cache_ctx) == 0) {
+        printf("tables differ: ");
+        goto end;
+    }
+
+    uint32_t cnt = DetectEngineCacheTestSearch(&mpm_ctx, &pmq, buf, buflen);
+    uint32_t cache_cnt = DetectEngineCacheTestSearch(&cache_ctx, &cache_pmq, buf, buflen);
+    if (cnt == 0 || cnt != cache_cnt ||
+        pmq.pattern_id_array_cnt != cache_pmq.pattern_id_array_cnt ||
+        memcmp(pmq.pattern_id_bitarray, cache_pmq.pattern_id_bitarray,
+               pmq.pattern_id_bitarray_size) != 0)
+    {
+        printf("%" PRIu32 " matches, %" PRIu32 " from the cache: ", cnt, cache_cnt);
+        goto end;
+    }
+
+    for (i = 0; i < patcnt; i++)
+        more[i] = pats[i];
+    more[patcnt] = "qqzzq";
+    DetectEngineCacheTestAdd(&more_ctx, mpm_type, more, patcnt + 1, 0);
+    if (DetectEngineCacheLoadCtx(cache, &more_ctx) == 0) {
+        printf("ctx of other patterns loaded: ");
+        goto end;
+    }
+    mpm_table[mpm_type].Prepare(&more_ctx);
+    if (DetectEngineCacheTestSearch(&more_ctx, &pmq, (uint8_t *)"aqqzzqa", 7) != 1) {
+        printf("ctx of other patterns doesn't compile: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (mpm_ctx.ctx != NULL)
+        mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    if (cache_ctx.ctx != NULL)
+        mpm_table[mpm_type].DestroyCtx(&cache_ctx);
+    if (more_ctx.ctx != NULL)
+        mpm_table[mpm_type].DestroyCtx(&more_ctx);
+    DetectEngineCacheClose(cache);
+    unlink(path);
+    PmqFree(&pmq);
+    PmqFree(&cache_pmq);
+    return result;
+}
+
+static int DetectEngineCacheTestWrite(char *path, char **pats, int patcnt)
+{
+    MpmCtx mpm_ctx;
+    MpmPrepareItem item;
+    int r;
+
+    DetectEngineCacheTestAdd(&mpm_ctx, MPM_B2G, pats, patcnt, 0);
+    mpm_table[MPM_B2G].Prepare(&mpm_ctx);
+
+    memset(&item, 0, sizeof(item));
+    item.mpm_ctx = &mpm_ctx;
+    r = DetectEngineCacheWrite(path, &item, 1);
+    mpm_table[MPM_B2G].DestroyCtx(&mpm_ctx);
+    return r;
+}
+
+/** \test a cache of another version or a truncated one is not used */
+static int DetectEngineCacheTest01(void)
+{
+    char path[] = "/tmp/rule-cache-XXXXXX";
+    char *pats[] = { "abcd", "~bcde", "xy" };
+    DetectEngineCache *cache = NULL;
+    DetectEngineCacheHeader hdr;
+    struct stat st;
+    int result = 0;
+    FILE *fp;
+
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return 0;
+    close(fd);
+
+    if (DetectEngineCacheTestWrite(path, pats, 3) < 0)
+        goto end;
+    cache = DetectEngineCacheOpen(path);
+    if (cache == NULL)
+        goto end;
+    DetectEngineCacheClose(cache);
+    cache = NULL;
+
+    fp = fopen(path, "r+");
+    if (fp == NULL)
+        goto end;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1) {
+        fclose(fp);
+        goto end;
+    }
+    hdr.version++;
+    if (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+        fclose(fp);
+        goto end;
+    }
+    fclose(fp);
+
+    cache = DetectEngineCacheOpen(path);
+    if (cache != NULL) {
+        printf("cache of another version opened: ");
+        goto end;
+    }
+
+    if (DetectEngineCacheTestWrite(path, pats, 3) < 0 || stat(path, &st) != 0 ||
+        truncate(path, st.st_size - 8) != 0)
+        goto end;
+    cache = DetectEngineCacheOpen(path);
+    if (cache != NULL) {
+        printf("truncated cache opened: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    DetectEngineCacheClose(cache);
+    unlink(path);
+    return result;
+}
+
+/** \test ctxs of the same patterns share a record, each is found */
+static int DetectEngineCacheTest02(void)
+{
+    char path[] = "/tmp/rule-cache-XXXXXX";
+    char *pats[] = { "abcd", "~bcde", "xy" };
+    char *pats2[] = { "efgh", "ijkl" };
+    MpmCtx mpm_ctx[3], load_ctx[2];
+    MpmPrepareItem items[3];
+    DetectEngineCache *cache = NULL;
+    int result = 0, i;
+
+    memset(load_ctx, 0, sizeof(load_ctx));
+
+    DetectEngineCacheTestAdd(&mpm_ctx[0], MPM_B2G, pats, 3, 0);
+    DetectEngineCacheTestAdd(&mpm_ctx[1], MPM_B2G, pats2, 2, 0);
+    DetectEngineCacheTestAdd(&mpm_ctx[2], MPM_B2G, pats, 3, 1);
+    memset(items, 0, sizeof(items));
+    for (i = 0; i < 3; i++) {
+        mpm_table[MPM_B2G].Prepare(&mpm_ctx[i]);
+        items[i].mpm_ctx = &mpm_ctx[i];
+    }
+
+    int fd = mkstemp(path);
+    if (fd < 0)
+        goto end;
+    close(fd);
+
+    if (DetectEngineCacheWrite(path, items, 3) < 0)
+        goto end;
+    cache = DetectEngineCacheOpen(path);
+    if (cache == NULL || cache->record_cnt != 2) {
+        printf("expected 2 records: ");
+        goto end;
+    }
+
+    DetectEngineCacheTestAdd(&load_ctx[0], MPM_B2G, pats2, 2, 1);
+    DetectEngineCacheTestAdd(&load_ctx[1], MPM_B2G, pats, 3, 0);
+    if (DetectEngineCacheLoadCtx(cache, &load_ctx[0]) != 0 ||
+        DetectEngineCacheLoadCtx(cache, &load_ctx[1]) != 0)
+    {
+        printf("ctx not loaded from the cache: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    for (i = 0; i < 3; i++)
+        mpm_table[MPM_B2G].DestroyCtx(&mpm_ctx[i]);
+    for (i = 0; i < 2; i++) {
+        if (load_ctx[i].ctx != NULL)
+            mpm_table[MPM_B2G].DestroyCtx(&load_ctx[i]);
+    }
+    DetectEngineCacheClose(cache);
+    unlink(path);
+    return result;
+}
+#endif /* UNITTESTS */
+
+void DetectEngineCacheRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("DetectEngineCacheTest01", DetectEngineCacheTest01, 1);
+    UtRegisterTest("DetectEngineCacheTest02", DetectEngineCacheTest02, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,113 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * See the .c file for the format of the cache file.
+ */
+
+#ifndef __DETECT_ENGINE_CACHE_H__
+#define __DETECT_ENGINE_CACHE_H__
+
+#include "util-mpm.h"
+
+#define DETECT_ENGINE_CACHE_MAGIC       "SCDECACH"
+/** bump on every change to the file format or to the layout of the
+ *  tables an mpm writes */
+#define DETECT_ENGINE_CACHE_VERSION     2
+/** written as is, a file of a host of the other byte order won't match */
+#define DETECT_ENGINE_CACHE_BYTE_ORDER  0x01020304
+
+/** start value of DetectEngineCacheHash() (FNV-1a 64 bit) */
+#define DETECT_ENGINE_CACHE_HASH_INIT   0xcbf29ce484222325ULL
+
+/** everything in the file starts at a multiple of 8 */
+#define DETECT_ENGINE_CACHE_ALIGN(len)  (((len) + 7) & ~7)
+
+typedef struct DetectEngineCacheHeader_ {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_cnt;
+    uint32_t byte_order;
+    uint8_t ptr_size;
+    uint8_t pad0[3];
+} DetectEngineCacheHeader;
+
+/** one per pattern set, followed by len bytes of the tables of the mpm */
+typedef struct DetectEngineCacheRecord_ {
+    uint64_t key;                   /**< MpmTableElmt::CacheKey() */
+    uint16_t mpm_type;
+    uint16_t pad0;
+    uint32_t len;                   /**< multiple of 8 */
+} DetectEngineCacheRecord;
+
+/** a pattern in a record, followed by len bytes of the case sensitive
+ *  pattern padded to 8 */
+typedef struct DetectEngineCachePattern_ {
+    uint32_t id;
+    uint16_t len;
+    uint8_t flags;
+    uint8_t pad0;
+} DetectEngineCachePattern;
+
+#define DETECT_ENGINE_CACHE_PATTERN(p) \
+    ((uint8_t *)(p) + sizeof(DetectEngineCachePattern))
+
+/** \brief state of the key of a pattern set, the same whatever order the
+ *         patterns are added in */
+typedef struct DetectEngineCacheKeyCtx_ {
+    uint64_t sum;
+    uint64_t xsum;
+    uint32_t cnt;
+} DetectEngineCacheKeyCtx;
+
+/** \brief a cache file mapped read only. The tables of the mpm ctxs
+ *         loaded from it point into the mapping, so it lives as long
+ *         as the detect engine ctx. */
+typedef struct DetectEngineCache_ {
+    uint8_t *map;
+    size_t map_len;
+    uint32_t record_cnt;
+    /** records sorted on key and mpm_type */
+    DetectEngineCacheRecord **records;
+} DetectEngineCache;
+
+struct MpmPrepareItem_;
+
+uint64_t DetectEngineCacheHash(uint64_t, const uint8_t *, size_t);
+void DetectEngineCacheKeyInit(DetectEngineCacheKeyCtx *);
+void DetectEngineCacheKeyAdd(DetectEngineCacheKeyCtx *, const uint8_t *, uint16_t, uint8_t, uint32_t);
+uint64_t DetectEngineCacheKeyFinal(DetectEngineCacheKeyCtx *, uint16_t, const uint32_t *, uint32_t);
+
+int DetectEngineCacheWriteArray(FILE *, const void *, size_t);
+int DetectEngineCacheWritePattern(FILE *, const uint8_t *, uint16_t, uint8_t, uint32_t);
+void *DetectEngineCacheReadArray(uint8_t **, uint32_t *, size_t);
+DetectEngineCachePattern *DetectEngineCacheReadPattern(uint8_t **, uint32_t *);
+
+DetectEngineCache *DetectEngineCacheOpen(const char *);
+int DetectEngineCacheLoadCtx(DetectEngineCache *, MpmCtx *);
+void DetectEngineCacheClose(DetectEngineCache *);
+int DetectEngineCacheWrite(const char *, struct MpmPrepareItem_ *, uint32_t);
+
+#ifdef UNITTESTS
+int DetectEngineCacheTestCompare(uint16_t, char **, int, uint8_t *, uint16_t,
+        int (*Compare)(MpmCtx *, MpmCtx *));
+#endif
+void DetectEngineCacheRegisterTests(void);
+
+#endif /* __DETECT_ENGINE_CACHE_H__ */
@@ -197,13 +197,11 @@ static int DoInspectDcePayload(DetectEngineCtx *de_ctx,
 
                 /* do the actual search */
                 if (cd->flags & DETECT_CONTENT_NOCASE) {
-                    found = BoyerMooreNocase(cd->content, cd->content_len, sstub,
-                                             sstub_len, cd->bm_ctx->bmGs,
-                                             cd->bm_ctx->bmBc);
+                    found = SpmBmCtxNocaseSearch(sstub, sstub_len, cd->content,
+                                                 cd->content_len, cd->bm_ctx);
                 } else {
-                    found = BoyerMoore(cd->content, cd->content_len, sstub,
-                                       sstub_len, cd->bm_ctx->bmGs,
-                                       cd->bm_ctx->bmBc);
+                    found = SpmBmCtxSearch(sstub, sstub_len, cd->content,
+                                           cd->content_len, cd->bm_ctx);
                 }
 
                 /* next we evaluate the result in combination with the
@@ -49,6 +49,8 @@
 #include "util-enum.h"
 #include "util-debug.h"
 #include "util-print.h"
+#include "util-cpu.h"
+#include "detect-engine-cache.h"
 
 /** \todo make it possible to use multiple pattern matcher algorithms next to
           eachother. */
@@ -63,6 +65,8 @@ SCEnumCharMap sc_mpm_algo_map[] = {
     { "b2g",      MPM_B2G },
     { "b3g",      MPM_B3G },
     { "wumanber", MPM_WUMANBER },
+    { "teddy",    MPM_TEDDY },
+    { "ac",       MPM_AC },
 };
 
 
@@ -647,6 +651,162 @@ error:
     return -1;
 }
 
+/**
+ * \brief compile the patterns of an mpm ctx, or queue it for
+ *        PatternMatchPrepareRun() while the group build defers that
+ *
+ * \param count the compiled memory counts in de_ctx->mpm_memory_size
+ *
+ * \retval 0 ok, -1 error
+ */
+static int PatternMatchPrepareCtx(DetectEngineCtx *de_ctx, MpmCtx *mpm_ctx, uint8_t count)
+{
+    if (mpm_table[mpm_ctx->mpm_type].Prepare == NULL)
+        return 0;
+
+    if (!de_ctx->mpm_prepare_defer) {
+        mpm_table[mpm_ctx->mpm_type].Prepare(mpm_ctx);
+        return 0;
+    }
+
+    if (de_ctx->mpm_prepare_cnt == de_ctx->mpm_prepare_size) {
+        uint32_t size = de_ctx->mpm_prepare_size ? de_ctx->mpm_prepare_size * 2 : 64;
+        MpmPrepareItem *array = SCRealloc(de_ctx->mpm_prepare_array,
+                size * sizeof(MpmPrepareItem));
+        if (array == NULL) {
+            SCLogError(SC_ERR_MEM_ALLOC, "can't grow the mpm prepare array");
+            return -1;
+        }
+        de_ctx->mpm_prepare_array = array;
+        de_ctx->mpm_prepare_size = size;
+    }
+
+    MpmPrepareItem *item = &de_ctx->mpm_prepare_array[de_ctx->mpm_prepare_cnt++];
+    item->mpm_ctx = mpm_ctx;
+    item->memory_size = mpm_ctx->memory_size;
+    item->count = count;
+    return 0;
+}
+
+/** state shared by the threads of PatternMatchPrepareRun() */
+typedef struct PatternMatchPrepareRunCtx_ {
+    MpmPrepareItem *items;
+    uint32_t cnt;
+    volatile uint32_t next;     /**< next item to compile */
+    DetectEngineCache *cache;   /**< rule cache to load the items from */
+    volatile uint32_t loaded;   /**< items loaded from the cache */
+    volatile uint32_t missed;   /**< items that could have been */
+} PatternMatchPrepareRunCtx;
+
+static void *PatternMatchPrepareWorker(void *arg)
+{
+    PatternMatchPrepareRunCtx *run = (PatternMatchPrepareRunCtx *)arg;
+    uint32_t i;
+
+    while ((i = __sync_fetch_and_add(&run->next, 1)) < run->cnt) {
+        MpmCtx *mpm_ctx = run->items[i].mpm_ctx;
+        if (DetectEngineCacheLoadCtx(run->cache, mpm_ctx) == 0) {
+            (void)__sync_fetch_and_add(&run->loaded, 1);
+            continue;
+        }
+        if (mpm_table[mpm_ctx->mpm_type].CacheLoad != NULL &&
+            mpm_ctx->pattern_cnt > 0)
+            (void)__sync_fetch_and_add(&run->missed, 1);
+        mpm_table[mpm_ctx->mpm_type].Prepare(mpm_ctx);
+    }
+    return NULL;
+}
+
+/**
+ * \brief compile the mpm ctxs the group build queued, on build_threads
+ *        threads. Every ctx is compiled on its own, so the result is the
+ *        same as compiling them one after the other in the build.
+ *        This needs every Prepare to be reentrant, see MpmTableElmt.
+ *
+ *  With a rule cache configured the ctxs are loaded from the records of
+ *  their pattern sets in it, and it's (re)written if any ctx had to be
+ *  compiled.
+ *
+ * \retval threads number of threads used
+ */
+uint16_t PatternMatchPrepareRun(DetectEngineCtx *de_ctx)
+{
+    PatternMatchPrepareRunCtx run;
+    pthread_t *threads = NULL;
+    uint16_t nthreads = de_ctx->build_threads;
+    uint16_t started = 0, t;
+    uint32_t i;
+
+    de_ctx->mpm_prepare_defer = 0;
+    if (de_ctx->mpm_prepare_cnt == 0)
+        goto end;
+
+    if (nthreads == 0)
+        nthreads = UtilCpuGetNumProcessorsOnline();
+    if (nthreads == 0)
+        nthreads = 1;
+    if (nthreads > de_ctx->mpm_prepare_cnt)
+        nthreads = (uint16_t)de_ctx->mpm_prepare_cnt;
+
+    run.items = de_ctx->mpm_prepare_array;
+    run.cnt = de_ctx->mpm_prepare_cnt;
+    run.next = 0;
+    run.cache = NULL;
+    run.loaded = 0;
+    run.missed = 0;
+
+    uint8_t use_cache = 0;
+    if (de_ctx->rule_cache_file != NULL && de_ctx->rule_cache == NULL) {
+        use_cache = 1;
+        run.cache = DetectEngineCacheOpen(de_ctx->rule_cache_file);
+    }
+
+    /* we're one of the threads ourselves */
+    if (nthreads > 1) {
+        threads = SCMalloc((nthreads - 1) * sizeof(pthread_t));
+        if (threads != NULL) {
+            for (t = 0; t < nthreads - 1; t++) {
+                if (pthread_create(&threads[t], NULL, PatternMatchPrepareWorker, &run) != 0)
+                    break;
+                started++;
+            }
+        }
+    }
+    PatternMatchPrepareWorker(&run);
+    for (t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    if (threads != NULL)
+        SCFree(threads);
+
+    if (run.cache != NULL) {
+        SCLogInfo("loaded %" PRIu32 " of %" PRIu32 " pattern matchers from "
+                "rule cache %s", run.loaded, run.cnt, de_ctx->rule_cache_file);
+        /* loaded tables point into the mapping */
+        if (run.loaded > 0)
+            de_ctx->rule_cache = run.cache;
+        else
+            DetectEngineCacheClose(run.cache);
+    }
+    if (use_cache && run.missed > 0) {
+        DetectEngineCacheWrite(de_ctx->rule_cache_file, run.items, run.cnt);
+    }
+
+    for (i = 0; i < de_ctx->mpm_prepare_cnt; i++) {
+        MpmPrepareItem *item = &de_ctx->mpm_prepare_array[i];
+        if (item->count)
+            de_ctx->mpm_memory_size += item->mpm_ctx->memory_size - item->memory_size;
+    }
+
+end:
+    if (de_ctx->mpm_prepare_array != NULL)
+        SCFree(de_ctx->mpm_prepare_array);
+    de_ctx->mpm_prepare_array = NULL;
+    de_ctx->mpm_prepare_cnt = 0;
+    de_ctx->mpm_prepare_size = 0;
+    return started + 1;
+}
+
 /** \brief Prepare the pattern matcher ctx in a sig group head.
  *
  *  \todo determine if a content match can set the 'single' flag
@@ -947,12 +1107,10 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
         /* load the patterns */
         PatternMatchPreprarePopulateMpm(de_ctx, sh);
 
-        if (mpm_table[sh->mpm_ctx->mpm_type].Prepare != NULL) {
-            mpm_table[sh->mpm_ctx->mpm_type].Prepare(sh->mpm_ctx);
-        }
-        if (mpm_table[sh->mpm_stream_ctx->mpm_type].Prepare != NULL) {
-            mpm_table[sh->mpm_stream_ctx->mpm_type].Prepare(sh->mpm_stream_ctx);
-        }
+        if (PatternMatchPrepareCtx(de_ctx, sh->mpm_ctx, 1) < 0)
+            goto error;
+        if (PatternMatchPrepareCtx(de_ctx, sh->mpm_stream_ctx, 0) < 0)
+            goto error;
 
         if (mpm_content_maxdepth) {
             // printf("mpm_content_maxdepth %" PRIu32 "\n", mpm_content_maxdepth);
@@ -971,9 +1129,8 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
 
     /* uricontent */
     if (sh->flags & SIG_GROUP_HAVEURICONTENT && !(sh->flags & SIG_GROUP_HEAD_MPM_URI_COPY)) {
-        if (mpm_table[sh->mpm_uri_ctx->mpm_type].Prepare != NULL) {
-            mpm_table[sh->mpm_uri_ctx->mpm_type].Prepare(sh->mpm_uri_ctx);
-        }
+        if (PatternMatchPrepareCtx(de_ctx, sh->mpm_uri_ctx, 1) < 0)
+            goto error;
         if (mpm_uricontent_cnt && sh->mpm_uricontent_maxlen > 1) {
             g_uricontent_search++;
         }
@@ -185,9 +185,9 @@ static int DoInspectPacketPayload(DetectEngineCtx *de_ctx,
 
                 /* do the actual search */
                 if (cd->flags & DETECT_CONTENT_NOCASE)
-                    found = BoyerMooreNocase(cd->content, cd->content_len, spayload, spayload_len, cd->bm_ctx->bmGs, cd->bm_ctx->bmBc);
+                    found = SpmBmCtxNocaseSearch(spayload, spayload_len, cd->content, cd->content_len, cd->bm_ctx);
                 else
-                    found = BoyerMoore(cd->content, cd->content_len, spayload, spayload_len, cd->bm_ctx->bmGs, cd->bm_ctx->bmBc);
+                    found = SpmBmCtxSearch(spayload, spayload_len, cd->content, cd->content_len, cd->bm_ctx);
 
                 /* next we evaluate the result in combination with the
                  * negation flag. */
@@ -862,6 +862,100 @@ DetectPortLookupGroup(DetectPort *dp, uint16_t port) {
     return NULL;
 }
 
+static int DetectPortRangeCmp(const void *a, const void *b) {
+    const DetectPortRange *ra = (const DetectPortRange *)a;
+    const DetectPortRange *rb = (const DetectPortRange *)b;
+
+    if (ra->port < rb->port)
+        return -1;
+    if (ra->port > rb->port)
+        return 1;
+    return 0;
+}
+
+/**
+ * \brief Free the ranges of a port array
+ *
+ * \param pa Pointer to the DetectPortArray
+ */
+void DetectPortArrayFree(DetectPortArray *pa) {
+    if (pa->range != NULL)
+        SCFree(pa->range);
+
+    pa->range = NULL;
+    pa->cnt = 0;
+}
+
+/**
+ * \brief Build the sorted array of the ranges of a port list, overlapping
+ *        and adjacent ranges merged
+ *
+ * \param dp Pointer to the DetectPort list
+ * \param pa Pointer to the DetectPortArray to fill, what it had is freed
+ *
+ * \retval 0 on success
+ * \retval -1 on error
+ */
+int DetectPortArrayBuild(DetectPort *dp, DetectPortArray *pa) {
+    DetectPort *p;
+    uint32_t cnt = 0, i, j;
+
+    DetectPortArrayFree(pa);
+
+    for (p = dp; p != NULL; p = p->next)
+        cnt++;
+    if (cnt == 0)
+        return 0;
+
+    pa->range = SCMalloc(cnt * sizeof(DetectPortRange));
+    if (pa->range == NULL)
+        return -1;
+
+    for (p = dp, i = 0; p != NULL; p = p->next, i++) {
+        pa->range[i].port = p->port;
+        pa->range[i].port2 = p->port2;
+    }
+    qsort(pa->range, cnt, sizeof(DetectPortRange), DetectPortRangeCmp);
+
+    for (i = 0, j = 1; j < cnt; j++) {
+        if ((uint32_t)pa->range[i].port2 + 1 >= pa->range[j].port) {
+            if (pa->range[j].port2 > pa->range[i].port2)
+                pa->range[i].port2 = pa->range[j].port2;
+        } else {
+            pa->range[++i] = pa->range[j];
+        }
+    }
+    pa->cnt = i + 1;
+
+    return 0;
+}
+
+/**
+ * \brief Look up a port in a port array
+ *
+ * \param pa Pointer to the DetectPortArray
+ * \param port port to look up
+ *
+ * \retval 1 if the port is in one of the ranges
+ * \retval 0 if not
+ */
+int DetectPortArrayLookup(DetectPortArray *pa, uint16_t port) {
+    uint32_t lo = 0, hi = pa->cnt;
+
+    /* the first range starting above the port */
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (pa->range[mid].port <= port)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == 0)
+        return 0;
+    return (port <= pa->range[lo - 1].port2);
+}
+
 /**
  * \brief Function to join the source group to the target and its members
  *
@@ -2458,6 +2552,45 @@ static int PortTestMatchDoubleNegation(void)
     return result;
 }
 
+/**
+ * \test Test that the port array matches the ports the list matches
+ */
+static int PortTestArray01(void)
+{
+    DetectPort *head = NULL;
+    DetectPortArray pa;
+    uint32_t port;
+    int result = 0;
+
+    memset(&pa, 0, sizeof(pa));
+
+    if (DetectPortParse(&head, "[80,1000:2000,!1500,2001:3000,65535]") != 0)
+        goto end;
+    if (DetectPortArrayBuild(head, &pa) != 0)
+        goto end;
+
+    /* 80, 1000:1499, 1501:3000 and 65535 */
+    if (pa.cnt != 4) {
+        printf("%"PRIu32" ranges, expected 4: ", pa.cnt);
+        goto end;
+    }
+
+    for (port = 0; port <= 65535; port++) {
+        if (DetectPortArrayLookup(&pa, (uint16_t)port) !=
+            (DetectPortLookupGroup(head, (uint16_t)port) != NULL)) {
+            printf("port %"PRIu32" mismatch: ", port);
+            goto end;
+        }
+    }
+
+    result = 1;
+end:
+    DetectPortArrayFree(&pa);
+    if (head != NULL)
+        DetectPortCleanupList(head);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void DetectPortTests(void) {
@@ -2503,6 +2636,7 @@ void DetectPortTests(void) {
     UtRegisterTest("PortTestMatchReal19",
                    PortTestMatchReal19, 1);
     UtRegisterTest("PortTestMatchDoubleNegation", PortTestMatchDoubleNegation, 1);
+    UtRegisterTest("PortTestArray01", PortTestArray01, 1);
 
 
 #endif /* UNITTESTS */
@@ -40,6 +40,10 @@ int DetectPortAdd(DetectPort **head, DetectPort *dp);
 
 DetectPort *DetectPortLookupGroup(DetectPort *dp, uint16_t port);
 
+int DetectPortArrayBuild(DetectPort *, DetectPortArray *);
+int DetectPortArrayLookup(DetectPortArray *, uint16_t);
+void DetectPortArrayFree(DetectPortArray *);
+
 void DetectPortPrintMemory(void);
 
 DetectPort *DetectPortDpHashLookup(DetectEngineCtx *, DetectPort *);
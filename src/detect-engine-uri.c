@@ -184,11 +184,11 @@ static int DoInspectPacketUri(DetectEngineCtx *de_ctx,
 
             //PrintawDataFp(stdout,ud->uricontent,ud->uricontent_len);
 
-            /* do the actual search with boyer moore precooked ctx */
+            /* do the actual search, simd or with boyer moore precooked ctx */
             if (ud->flags & DETECT_URICONTENT_NOCASE)
-                found = BoyerMooreNocase(ud->uricontent, ud->uricontent_len, spayload, spayload_len, ud->bm_ctx->bmGs, ud->bm_ctx->bmBc);
+                found = SpmBmCtxNocaseSearch(spayload, spayload_len, ud->uricontent, ud->uricontent_len, ud->bm_ctx);
             else
-                found = BoyerMoore(ud->uricontent, ud->uricontent_len, spayload, spayload_len, ud->bm_ctx->bmGs, ud->bm_ctx->bmBc);
+                found = SpmBmCtxSearch(spayload, spayload_len, ud->uricontent, ud->uricontent_len, ud->bm_ctx);
 
             /* next we evaluate the result in combination with the
              * negation flag. */
@@ -42,6 +42,7 @@
 #include "detect-content.h"
 #include "detect-uricontent.h"
 #include "detect-engine-threshold.h"
+#include "detect-engine-cache.h"
 
 //#include "util-mpm.h"
 #include "util-error.h"
@@ -50,9 +51,28 @@
 #include "util-debug.h"
 
 #include "util-var-name.h"
+#include "util-classification-config.h"
+#include "util-threshold-config.h"
 #include "tm-modules.h"
 
+#include <sys/resource.h>
+
+extern uint8_t suricata_ctl_flags;
+
+/** the ctx new packets are inspected with, see DetectEngineReloadStart() */
+static DetectEngineCtx *detect_engine_current = NULL;
+/** version of detect_engine_current, detect threads poll it per packet */
+volatile uint32_t detect_engine_version = 0;
+/** protects detect_engine_current while a reference to it is taken */
+static SCMutex detect_engine_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t detect_engine_reload_thread;
+static volatile uint8_t detect_engine_reload_running = 0;
+static uint8_t detect_engine_reload_joinable = 0;
+
 static uint8_t DetectEngineCtxLoadConf(DetectEngineCtx *);
+static TmEcode DetectEngineThreadCtxInitForCtx(DetectEngineThreadCtx *, DetectEngineCtx *);
+static void DetectEngineThreadCtxDeinitForCtx(DetectEngineThreadCtx *);
 DetectEngineCtx *DetectEngineCtxInit(void) {
     DetectEngineCtx *de_ctx;
 
@@ -61,6 +81,7 @@ DetectEngineCtx *DetectEngineCtxInit(void) {
         goto error;
 
     memset(de_ctx,0,sizeof(DetectEngineCtx));
+    de_ctx->version = detect_engine_version;
 
     if (ConfGetBool("engine.init_failure_fatal", (int *)&(de_ctx->failure_fatal)) != 1) {
         SCLogDebug("ConfGetBool could not load the value.");
@@ -116,6 +137,12 @@ void DetectEngineCtxFree(DetectEngineCtx *de_ctx) {
     VariableNameFreeHash();
     if (de_ctx->sig_array)
         SCFree(de_ctx->sig_array);
+    if (de_ctx->mpm_prepare_array != NULL)
+        SCFree(de_ctx->mpm_prepare_array);
+    /* after the groups, the mpm ctxs may point into it */
+    DetectEngineCacheClose(de_ctx->rule_cache);
+    if (de_ctx->rule_cache_file != NULL)
+        SCFree(de_ctx->rule_cache_file);
 
     if (de_ctx->class_conf_ht != NULL)
         HashTableFree(de_ctx->class_conf_ht);
@@ -151,6 +178,21 @@ static uint8_t DetectEngineCtxLoadConf(DetectEngineCtx *de_ctx) {
         TAILQ_FOREACH(opt, &de_ctx_custom->head, next) {
             if (strncmp(opt->val, "profile", 3) == 0) {
                 de_ctx_profile = opt->head.tqh_first->val;
+            } else if (strcmp(opt->val, "build-threads") == 0) {
+                char *build_threads = opt->head.tqh_first->val;
+                if (build_threads == NULL ||
+                    ByteExtractStringUint16(&de_ctx->build_threads, 10,
+                        strlen(build_threads), build_threads) <= 0)
+                {
+                    SCLogWarning(SC_ERR_INVALID_ARGUMENT, "invalid "
+                            "detect-engine.build-threads, using one per cpu");
+                    de_ctx->build_threads = 0;
+                }
+            } else if (strcmp(opt->val, "rule-cache") == 0) {
+                char *rule_cache = opt->head.tqh_first->val;
+                if (rule_cache != NULL && strlen(rule_cache) > 0) {
+                    de_ctx->rule_cache_file = SCStrdup(rule_cache);
+                }
             }
         }
     }
@@ -326,7 +368,42 @@ TmEcode DetectEngineThreadCtxInit(ThreadVars *tv, void *initdata, void **data) {
         return TM_ECODE_FAILED;
     memset(det_ctx, 0, sizeof(DetectEngineThreadCtx));
 
+    if (DetectEngineThreadCtxInitForCtx(det_ctx, de_ctx) != TM_ECODE_OK)
+        return TM_ECODE_FAILED;
+
+    /** alert counter setup */
+    det_ctx->counter_alerts = SCPerfTVRegisterCounter("detect.alert", tv,
+                                                      SC_PERF_TYPE_UINT64, "NULL");
+    tv->sc_perf_pca = SCPerfGetAllCountersArray(&tv->sc_perf_pctx);
+    SCPerfAddToClubbedTMTable((tv->thread_group_name != NULL) ? tv->thread_group_name : tv->name,
+                              &tv->sc_perf_pctx);
+
+    /* this detection engine context belongs to this thread instance */
+    det_ctx->tv = tv;
+
+    *data = (void *)det_ctx;
+
+    return TM_ECODE_OK;
+}
+
+/**
+ * \brief set up the parts of a thread ctx that depend on the detection
+ *        engine ctx: the mpm thread ctxs, the pattern queues, the IP-only
+ *        ctx and the match arrays. Takes a reference on de_ctx.
+ */
+static TmEcode DetectEngineThreadCtxInitForCtx(DetectEngineThreadCtx *det_ctx,
+        DetectEngineCtx *de_ctx)
+{
+    /* a switch starts from a copy of the old thread ctx */
+    det_ctx->match_array = NULL;
+    det_ctx->match_array_len = 0;
+    det_ctx->de_state_sig_array = NULL;
+    det_ctx->de_state_sig_array_len = 0;
+    det_ctx->sgh = NULL;
+
     det_ctx->de_ctx = de_ctx;
+    det_ctx->de_ctx_version = de_ctx->version;
+    __sync_fetch_and_add(&de_ctx->ref_cnt, 1);
 
     /** \todo we still depend on the global mpm_ctx here
      *
@@ -343,6 +420,10 @@ TmEcode DetectEngineThreadCtxInit(ThreadVars *tv, void *initdata, void **data) {
     for (i = 0; i < 256; i++) {
         PmqSetup(&det_ctx->smsg_pmq[i], 0, DetectContentMaxId(de_ctx));
     }
+    for (i = 0; i < MPM_BATCH_SIZE; i++) {
+        PmqSetup(&det_ctx->batch_pmq[i], 0, DetectContentMaxId(de_ctx));
+    }
+    det_ctx->batch_sgh = NULL;
 
     /* IP-ONLY */
     DetectEngineIPOnlyThreadInit(de_ctx,&det_ctx->io_ctx);
@@ -366,28 +447,16 @@ TmEcode DetectEngineThreadCtxInit(ThreadVars *tv, void *initdata, void **data) {
         }
     }
 
-    /** alert counter setup */
-    det_ctx->counter_alerts = SCPerfTVRegisterCounter("detect.alert", tv,
-                                                      SC_PERF_TYPE_UINT64, "NULL");
-    tv->sc_perf_pca = SCPerfGetAllCountersArray(&tv->sc_perf_pctx);
-    SCPerfAddToClubbedTMTable((tv->thread_group_name != NULL) ? tv->thread_group_name : tv->name,
-                              &tv->sc_perf_pctx);
-
-    /* this detection engine context belongs to this thread instance */
-    det_ctx->tv = tv;
-
-    *data = (void *)det_ctx;
-
     return TM_ECODE_OK;
 }
 
-TmEcode DetectEngineThreadCtxDeinit(ThreadVars *tv, void *data) {
-    DetectEngineThreadCtx *det_ctx = (DetectEngineThreadCtx *)data;
-
-    if (det_ctx == NULL) {
-        SCLogWarning(SC_ERR_INVALID_ARGUMENTS, "argument \"data\" NULL");
-        return TM_ECODE_OK;
-    }
+/**
+ * \brief free what DetectEngineThreadCtxInitForCtx() set up and drop the
+ *        reference on the detection engine ctx
+ */
+static void DetectEngineThreadCtxDeinitForCtx(DetectEngineThreadCtx *det_ctx)
+{
+    int i;
 
     DetectEngineIPOnlyThreadDeinit(&det_ctx->io_ctx);
 
@@ -396,9 +465,31 @@ TmEcode DetectEngineThreadCtxDeinit(ThreadVars *tv, void *data) {
     PatternMatchThreadDestroy(&det_ctx->mtcu, det_ctx->de_ctx->mpm_matcher);
 
     PmqFree(&det_ctx->pmq);
+    for (i = 0; i < 256; i++) {
+        PmqFree(&det_ctx->smsg_pmq[i]);
+    }
+    for (i = 0; i < MPM_BATCH_SIZE; i++) {
+        PmqFree(&det_ctx->batch_pmq[i]);
+    }
 
     if (det_ctx->de_state_sig_array != NULL)
         SCFree(det_ctx->de_state_sig_array);
+    if (det_ctx->match_array != NULL)
+        SCFree(det_ctx->match_array);
+
+    DetectEngineCtxRelease(det_ctx->de_ctx);
+    det_ctx->de_ctx = NULL;
+}
+
+TmEcode DetectEngineThreadCtxDeinit(ThreadVars *tv, void *data) {
+    DetectEngineThreadCtx *det_ctx = (DetectEngineThreadCtx *)data;
+
+    if (det_ctx == NULL) {
+        SCLogWarning(SC_ERR_INVALID_ARGUMENTS, "argument \"data\" NULL");
+        return TM_ECODE_OK;
+    }
+
+    DetectEngineThreadCtxDeinitForCtx(det_ctx);
 
     SCFree(det_ctx);
 
@@ -411,3 +502,257 @@ void DetectEngineThreadCtxInfo(ThreadVars *t, DetectEngineThreadCtx *det_ctx) {
     PatternMatchThreadPrint(&det_ctx->mtcu, det_ctx->de_ctx->mpm_matcher);
 }
 
+
+/**
+ * \brief take a reference on a detection engine ctx
+ */
+void DetectEngineCtxRef(DetectEngineCtx *de_ctx) {
+    __sync_fetch_and_add(&de_ctx->ref_cnt, 1);
+}
+
+/**
+ * \brief drop a reference. The ctx isn't freed here, the reload that
+ *        replaced it waits for the count to drop to 0 and frees it, so
+ *        the detect and output threads never do.
+ */
+void DetectEngineCtxRelease(DetectEngineCtx *de_ctx) {
+    __sync_fetch_and_sub(&de_ctx->ref_cnt, 1);
+}
+
+/**
+ * \brief make de_ctx the ctx the detect threads use, at startup. Later
+ *        ones are swapped in by DetectEngineReloadStart().
+ */
+void DetectEngineSetCurrent(DetectEngineCtx *de_ctx) {
+    SCMutexLock(&detect_engine_lock);
+    DetectEngineCtxRef(de_ctx);
+    detect_engine_current = de_ctx;
+    detect_engine_version = de_ctx->version;
+    SCMutexUnlock(&detect_engine_lock);
+}
+
+/**
+ * \brief get the current ctx, without a reference. Only for the main
+ *        thread once no reload can run anymore.
+ */
+DetectEngineCtx *DetectEngineGetCurrent(void) {
+    return detect_engine_current;
+}
+
+/**
+ * \brief move a detect thread over to the current ctx. Called between two
+ *        packets, when detect_engine_version changed.
+ *
+ *  The new thread ctx parts are set up on a copy first, so if that fails
+ *  the thread goes on with the rule set it has.
+ *
+ * \retval 0 ok, -1 error (still on the old ctx)
+ */
+int DetectEngineThreadCtxSwitch(DetectEngineThreadCtx *det_ctx)
+{
+    DetectEngineThreadCtx *tmp = NULL;
+    DetectEngineCtx *de_ctx;
+
+    SCMutexLock(&detect_engine_lock);
+    de_ctx = detect_engine_current;
+    if (de_ctx != NULL)
+        DetectEngineCtxRef(de_ctx);
+    SCMutexUnlock(&detect_engine_lock);
+
+    if (de_ctx == NULL) {
+        det_ctx->de_ctx_version = detect_engine_version;
+        return 0;
+    }
+    if (de_ctx == det_ctx->de_ctx) {
+        det_ctx->de_ctx_version = de_ctx->version;
+        DetectEngineCtxRelease(de_ctx);
+        return 0;
+    }
+
+    tmp = SCMalloc(sizeof(DetectEngineThreadCtx));
+    if (tmp == NULL)
+        goto error;
+    memcpy(tmp, det_ctx, sizeof(DetectEngineThreadCtx));
+
+    if (DetectEngineThreadCtxInitForCtx(tmp, de_ctx) != TM_ECODE_OK) {
+        /* what did get allocated is lost, we're out of memory anyway */
+        DetectEngineCtxRelease(de_ctx);
+        SCFree(tmp);
+        goto error;
+    }
+
+    DetectEngineThreadCtxDeinitForCtx(det_ctx);
+    memcpy(det_ctx, tmp, sizeof(DetectEngineThreadCtx));
+    SCFree(tmp);
+
+    SCLogDebug("switched to rule set version %"PRIu32, de_ctx->version);
+    DetectEngineCtxRelease(de_ctx);
+    return 0;
+
+error:
+    SCLogError(SC_ERR_MEM_ALLOC, "can't switch to rule set version %"PRIu32
+            ", staying with version %"PRIu32, de_ctx->version,
+            det_ctx->de_ctx->version);
+    det_ctx->de_ctx_version = de_ctx->version;
+    DetectEngineCtxRelease(de_ctx);
+    return -1;
+}
+
+static void DetectEngineCtxDestroy(DetectEngineCtx *de_ctx) {
+    SigGroupCleanup(de_ctx);
+    SigCleanSignatures(de_ctx);
+    DetectEngineCtxFree(de_ctx);
+}
+
+/**
+ * \brief build a complete ctx from the rule files, like at startup
+ *
+ * \retval de_ctx the new ctx or NULL if no rule could be loaded
+ */
+static DetectEngineCtx *DetectEngineCtxLoad(char *sig_file)
+{
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        return NULL;
+
+    /* a bad rule file must not take the running engine down */
+    de_ctx->failure_fatal = 0;
+
+    SCClassConfLoadClassficationConfigFile(de_ctx);
+
+    if (SigLoadSignatures(de_ctx, sig_file) < 0 || de_ctx->sig_list == NULL) {
+        DetectEngineCtxDestroy(de_ctx);
+        return NULL;
+    }
+
+    SCThresholdConfInitContext(de_ctx, NULL);
+    return de_ctx;
+}
+
+static inline double DetectEngineTimeDiff(struct timeval *a, struct timeval *b) {
+    return (double)(b->tv_sec - a->tv_sec) +
+        (double)(b->tv_usec - a->tv_usec) / 1000000.0;
+}
+
+/**
+ * \brief build the new rule set next to the running one, swap it in and
+ *        free the old one once nothing uses it anymore
+ */
+static void *DetectEngineReloadThread(void *arg)
+{
+    char *sig_file = (char *)arg;
+    DetectEngineCtx *de_ctx = NULL, *old = NULL;
+    struct timeval start, built, freed;
+    struct rusage ru;
+    long rss_start;
+    uint32_t version;
+
+    gettimeofday(&start, NULL);
+    getrusage(RUSAGE_SELF, &ru);
+    rss_start = ru.ru_maxrss;
+
+    SCLogInfo("rule reload: loading a new rule set");
+
+    de_ctx = DetectEngineCtxLoad(sig_file);
+    if (de_ctx == NULL) {
+        SCLogError(SC_ERR_NO_RULES_LOADED, "rule reload failed, keeping the "
+                "current rule set");
+        goto end;
+    }
+
+    gettimeofday(&built, NULL);
+    getrusage(RUSAGE_SELF, &ru);
+
+    if (suricata_ctl_flags != 0) {
+        DetectEngineCtxDestroy(de_ctx);
+        goto end;
+    }
+
+    SCMutexLock(&detect_engine_lock);
+    old = detect_engine_current;
+    de_ctx->version = old->version + 1;
+    DetectEngineCtxRef(de_ctx);
+    /* the ctx must be complete before the detect threads can see it */
+    __sync_synchronize();
+    detect_engine_current = de_ctx;
+    detect_engine_version = de_ctx->version;
+    SCMutexUnlock(&detect_engine_lock);
+    DetectEngineCtxRelease(old);
+
+    SCLogInfo("rule reload: rule set version %"PRIu32" with %"PRIu32" rules "
+            "built in %.3fs, memory high-water %ld KB (+%ld KB)",
+            de_ctx->version, de_ctx->sig_cnt, DetectEngineTimeDiff(&start, &built),
+            ru.ru_maxrss, ru.ru_maxrss - rss_start);
+
+    /* the detect threads move over with their next packet, alerts of
+     * packets still on their way to the outputs hold on to the old ctx */
+    while (old->ref_cnt > 0) {
+        if (detect_engine_reload_running == 2) {
+            SCLogDebug("engine shutting down, not waiting for version %"PRIu32,
+                    old->version);
+            goto end;
+        }
+        usleep(1000);
+    }
+
+    version = old->version;
+    DetectEngineCtxDestroy(old);
+
+    gettimeofday(&freed, NULL);
+    SCLogInfo("rule reload: rule set version %"PRIu32" freed %.3fs after the "
+            "switch", version, DetectEngineTimeDiff(&built, &freed));
+end:
+    detect_engine_reload_running = 0;
+    return NULL;
+}
+
+/**
+ * \brief reload the rules on a thread of its own, the detect threads go
+ *        on with the old rule set until the new one is ready
+ *
+ * \param sig_file rule file from the command line, or NULL
+ *
+ * \retval 0 reload started, -1 a reload is already running or error
+ */
+int DetectEngineReloadStart(char *sig_file)
+{
+    if (detect_engine_current == NULL)
+        return -1;
+
+    if (detect_engine_reload_running) {
+        SCLogWarning(SC_ERR_NO_RULES_LOADED, "rule reload already in "
+                "progress, ignoring");
+        return -1;
+    }
+
+    if (detect_engine_reload_joinable) {
+        pthread_join(detect_engine_reload_thread, NULL);
+        detect_engine_reload_joinable = 0;
+    }
+
+    detect_engine_reload_running = 1;
+    if (pthread_create(&detect_engine_reload_thread, NULL,
+                DetectEngineReloadThread, (void *)sig_file) != 0) {
+        SCLogError(SC_ERR_THREAD_CREATE, "can't start the rule reload thread: "
+                "%s", strerror(errno));
+        detect_engine_reload_running = 0;
+        return -1;
+    }
+    detect_engine_reload_joinable = 1;
+    return 0;
+}
+
+/**
+ * \brief wait for a running reload to finish, at shutdown. The old ctx of
+ *        a reload that is still waiting for its users is left alone.
+ */
+void DetectEngineReloadWait(void)
+{
+    if (!detect_engine_reload_joinable)
+        return;
+
+    if (detect_engine_reload_running)
+        detect_engine_reload_running = 2;
+    pthread_join(detect_engine_reload_thread, NULL);
+    detect_engine_reload_joinable = 0;
+}
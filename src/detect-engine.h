@@ -38,5 +38,15 @@ TmEcode DetectEngineThreadCtxDeinit(ThreadVars *, void *);
 #define DetectEngineGetMaxSigId(de_ctx) ((de_ctx)->signum)
 void DetectEngineResetMaxSigId(DetectEngineCtx *);
 
+extern volatile uint32_t detect_engine_version;
+
+void DetectEngineCtxRef(DetectEngineCtx *);
+void DetectEngineCtxRelease(DetectEngineCtx *);
+void DetectEngineSetCurrent(DetectEngineCtx *);
+DetectEngineCtx *DetectEngineGetCurrent(void);
+int DetectEngineThreadCtxSwitch(DetectEngineThreadCtx *);
+int DetectEngineReloadStart(char *);
+void DetectEngineReloadWait(void);
+
 #endif /* __DETECT_ENGINE_H__ */
 
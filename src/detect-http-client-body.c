@@ -135,14 +135,14 @@ int DetectHttpClientBodyMatch(ThreadVars *t, DetectEngineThreadCtx *det_ctx,
         }
         /* call the case insensitive version if nocase has been specified in the sig */
         if (hcbd->flags & DETECT_AL_HTTP_CLIENT_BODY_NOCASE) {
-            result = (BoyerMooreNocase(hcbd->content, hcbd->content_len, chunks_buffer,
-                                       total_chunks_len, hcbd->bm_ctx->bmGs,
-                                       hcbd->bm_ctx->bmBc) != NULL);
+            result = (SpmBmCtxNocaseSearch(chunks_buffer, total_chunks_len,
+                                       hcbd->content, hcbd->content_len,
+                                       hcbd->bm_ctx) != NULL);
         /* call the case sensitive version if nocase has been specified in the sig */
         } else {
-            result = (BoyerMoore(hcbd->content, hcbd->content_len, chunks_buffer,
-                                       total_chunks_len, hcbd->bm_ctx->bmGs,
-                                       hcbd->bm_ctx->bmBc) != NULL);
+            result = (SpmBmCtxSearch(chunks_buffer, total_chunks_len,
+                                       hcbd->content, hcbd->content_len,
+                                       hcbd->bm_ctx) != NULL);
         }
         SCFree(chunks_buffer);
     }
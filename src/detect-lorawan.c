@@ -0,0 +1,1128 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Implements the LoRaWAN header keywords. They match against the header
+ * view set up by DecodeLorawanMAC:
+ *
+ *   lorawan.mtype:[!]<mtype>[,<mtype>...];     name or 0-7
+ *   lorawan.devaddr:[!]<hex>[/<bits>|-<hex>];  address, prefix or range
+ *   lorawan.fport:[!]<port>[,<port>...];       n, <n, >n or a-b
+ *   lorawan.fctrl:[!]<bit>[,[!]<bit>...];      adr, adr_ack_req, ack, fpending
+ *   lorawan.fopts_cmd:<cid>;                   name or number
+ *   lorawan.fcnt_gap:<n>;                      n, <n, >n or a-b
+ *
+ * lorawan.mtype and lorawan.fport are also used when building the
+ * signature groups: a frame is only inspected by the signatures that
+ * apply to its MType and FPort.
+ */
+
+#include "suricata-common.h"
+#include "decode.h"
+
+#include "detect.h"
+#include "detect-parse.h"
+#include "detect-engine.h"
+
+#include "decode-lorawan-Mac.h"
+#include "decode-lorawan-frame.h"
+#include "detect-lorawan.h"
+
+#include "util-debug.h"
+#include "util-unittest.h"
+
+int DetectLorawanMtypeMatch(ThreadVars *, DetectEngineThreadCtx *, Packet *, Signature *, SigMatch *);
+static int DetectLorawanMtypeSetup(DetectEngineCtx *, Signature *, char *);
+int DetectLorawanDevAddrMatch(ThreadVars *, DetectEngineThreadCtx *, Packet *, Signature *, SigMatch *);
+static int DetectLorawanDevAddrSetup(DetectEngineCtx *, Signature *, char *);
+int DetectLorawanFportMatch(ThreadVars *, DetectEngineThreadCtx *, Packet *, Signature *, SigMatch *);
+static int DetectLorawanFportSetup(DetectEngineCtx *, Signature *, char *);
+int DetectLorawanFctrlMatch(ThreadVars *, DetectEngineThreadCtx *, Packet *, Signature *, SigMatch *);
+static int DetectLorawanFctrlSetup(DetectEngineCtx *, Signature *, char *);
+int DetectLorawanFoptsCmdMatch(ThreadVars *, DetectEngineThreadCtx *, Packet *, Signature *, SigMatch *);
+static int DetectLorawanFoptsCmdSetup(DetectEngineCtx *, Signature *, char *);
+int DetectLorawanFcntGapMatch(ThreadVars *, DetectEngineThreadCtx *, Packet *, Signature *, SigMatch *);
+static int DetectLorawanFcntGapSetup(DetectEngineCtx *, Signature *, char *);
+void DetectLorawanFree(void *);
+void DetectLorawanRegisterTests(void);
+
+typedef struct DetectLorawanName_ {
+    char *name;
+    uint8_t value;
+} DetectLorawanName;
+
+static DetectLorawanName lorawan_mtype_names[] = {
+    { "join_request",           JOIN_REQUEST, },
+    { "join_accept",            JOIN_ACCEPT, },
+    { "unconfirmed_data_up",    UNCONFIRMED_DATA_UP, },
+    { "unconfirmed_data_down",  UNCONFIRMED_DATA_DOWN, },
+    { "confirmed_data_up",      CONFIRMED_DATA_UP, },
+    { "confirmed_data_down",    CONFIRMED_DATA_DOWN, },
+    { "rfu",                    MTYPE_RFU, },
+    { "proprietary",            PROPRIETARY, },
+    { NULL, 0 },
+};
+
+static DetectLorawanName lorawan_fctrl_names[] = {
+    { "adr",                    LORAWAN_FCTRL_ADR, },
+    { "adr_ack_req",            LORAWAN_FCTRL_ADR_ACK_REQ, },
+    { "ack",                    LORAWAN_FCTRL_ACK, },
+    { "fpending",               LORAWAN_FCTRL_FPENDING, },
+    { "class_b",                LORAWAN_FCTRL_FPENDING, },
+    { NULL, 0 },
+};
+
+/** MAC commands by their name without the Req/Ans suffix, as the
+ *  request and the answer share the CID */
+static DetectLorawanName lorawan_cid_names[] = {
+    { "link_check",             LORAWAN_CID_LINK_CHECK, },
+    { "link_adr",               LORAWAN_CID_LINK_ADR, },
+    { "duty_cycle",             LORAWAN_CID_DUTY_CYCLE, },
+    { "rx_param_setup",         LORAWAN_CID_RX_PARAM_SETUP, },
+    { "dev_status",             LORAWAN_CID_DEV_STATUS, },
+    { "new_channel",            LORAWAN_CID_NEW_CHANNEL, },
+    { "rx_timing_setup",        LORAWAN_CID_RX_TIMING_SETUP, },
+    { "tx_param_setup",         LORAWAN_CID_TX_PARAM_SETUP, },
+    { "dl_channel",             LORAWAN_CID_DL_CHANNEL, },
+    { "device_time",            LORAWAN_CID_DEVICE_TIME, },
+    { NULL, 0 },
+};
+
+/** payload length of the MAC commands per CID, -1 if we don't know the
+ *  command. FOpts has no length fields so we need these to find the
+ *  next command. */
+static int8_t lorawan_cid_len_up[LORAWAN_CID_MAX + 1] = {
+    -1, -1, 0, 1, 0, 1, 2, 1, 0, 0, 1, -1, -1, 0 };
+static int8_t lorawan_cid_len_down[LORAWAN_CID_MAX + 1] = {
+    -1, -1, 2, 4, 1, 4, 0, 5, 1, 1, 4, -1, -1, 5 };
+
+/**
+ * \brief Registration function for the lorawan.* keywords
+ */
+void DetectLorawanRegister(void) {
+    sigmatch_table[DETECT_LORAWAN_MTYPE].name = "lorawan.mtype";
+    sigmatch_table[DETECT_LORAWAN_MTYPE].Match = DetectLorawanMtypeMatch;
+    sigmatch_table[DETECT_LORAWAN_MTYPE].Setup = DetectLorawanMtypeSetup;
+    sigmatch_table[DETECT_LORAWAN_MTYPE].Free = DetectLorawanFree;
+    sigmatch_table[DETECT_LORAWAN_MTYPE].RegisterTests = DetectLorawanRegisterTests;
+
+    sigmatch_table[DETECT_LORAWAN_DEVADDR].name = "lorawan.devaddr";
+    sigmatch_table[DETECT_LORAWAN_DEVADDR].Match = DetectLorawanDevAddrMatch;
+    sigmatch_table[DETECT_LORAWAN_DEVADDR].Setup = DetectLorawanDevAddrSetup;
+    sigmatch_table[DETECT_LORAWAN_DEVADDR].Free = DetectLorawanFree;
+    sigmatch_table[DETECT_LORAWAN_DEVADDR].RegisterTests = NULL;
+
+    sigmatch_table[DETECT_LORAWAN_FPORT].name = "lorawan.fport";
+    sigmatch_table[DETECT_LORAWAN_FPORT].Match = DetectLorawanFportMatch;
+    sigmatch_table[DETECT_LORAWAN_FPORT].Setup = DetectLorawanFportSetup;
+    sigmatch_table[DETECT_LORAWAN_FPORT].Free = DetectLorawanFree;
+    sigmatch_table[DETECT_LORAWAN_FPORT].RegisterTests = NULL;
+
+    sigmatch_table[DETECT_LORAWAN_FCTRL].name = "lorawan.fctrl";
+    sigmatch_table[DETECT_LORAWAN_FCTRL].Match = DetectLorawanFctrlMatch;
+    sigmatch_table[DETECT_LORAWAN_FCTRL].Setup = DetectLorawanFctrlSetup;
+    sigmatch_table[DETECT_LORAWAN_FCTRL].Free = DetectLorawanFree;
+    sigmatch_table[DETECT_LORAWAN_FCTRL].RegisterTests = NULL;
+
+    sigmatch_table[DETECT_LORAWAN_FOPTS_CMD].name = "lorawan.fopts_cmd";
+    sigmatch_table[DETECT_LORAWAN_FOPTS_CMD].Match = DetectLorawanFoptsCmdMatch;
+    sigmatch_table[DETECT_LORAWAN_FOPTS_CMD].Setup = DetectLorawanFoptsCmdSetup;
+    sigmatch_table[DETECT_LORAWAN_FOPTS_CMD].Free = DetectLorawanFree;
+    sigmatch_table[DETECT_LORAWAN_FOPTS_CMD].RegisterTests = NULL;
+
+    sigmatch_table[DETECT_LORAWAN_FCNT_GAP].name = "lorawan.fcnt_gap";
+    sigmatch_table[DETECT_LORAWAN_FCNT_GAP].Match = DetectLorawanFcntGapMatch;
+    sigmatch_table[DETECT_LORAWAN_FCNT_GAP].Setup = DetectLorawanFcntGapSetup;
+    sigmatch_table[DETECT_LORAWAN_FCNT_GAP].Free = DetectLorawanFree;
+    sigmatch_table[DETECT_LORAWAN_FCNT_GAP].RegisterTests = NULL;
+}
+
+/**
+ * \brief skip leading and cut trailing white space, in place
+ */
+static char *DetectLorawanTrim(char *str) {
+    char *end;
+
+    while (isspace((unsigned char)*str))
+        str++;
+
+    end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1]))
+        end--;
+    *end = '\0';
+
+    return str;
+}
+
+/**
+ * \brief parse an unsigned number
+ *
+ * \param str string to parse, leading white space is skipped
+ * \param base 10, 16 or 0 for either (0x prefix)
+ * \param max largest value allowed
+ * \param res the number
+ *
+ * \retval ptr first char after the number and the white space after it
+ * \retval NULL no number or out of range
+ */
+static char *DetectLorawanParseUint(char *str, int base, uint32_t max, uint32_t *res) {
+    char *end = NULL;
+    unsigned long val;
+
+    while (isspace((unsigned char)*str))
+        str++;
+    if (!isxdigit((unsigned char)*str))
+        return NULL;
+
+    errno = 0;
+    val = strtoul(str, &end, base);
+    if (errno == ERANGE || end == str || val > max)
+        return NULL;
+
+    while (isspace((unsigned char)*end))
+        end++;
+
+    *res = (uint32_t)val;
+    return end;
+}
+
+/**
+ * \brief parse "n", "<n", ">n" or "a-b" into an inclusive range
+ *
+ * \retval 0 ok
+ * \retval -1 parse error or empty range
+ */
+static int DetectLorawanParseRange(char *str, uint32_t max, uint32_t *lo, uint32_t *hi) {
+    uint32_t val;
+
+    str = DetectLorawanTrim(str);
+
+    if (*str == '<') {
+        str = DetectLorawanParseUint(str + 1, 10, max, &val);
+        if (str == NULL || *str != '\0' || val == 0)
+            return -1;
+        *lo = 0;
+        *hi = val - 1;
+        return 0;
+    } else if (*str == '>') {
+        str = DetectLorawanParseUint(str + 1, 10, max, &val);
+        if (str == NULL || *str != '\0' || val == max)
+            return -1;
+        *lo = val + 1;
+        *hi = max;
+        return 0;
+    }
+
+    str = DetectLorawanParseUint(str, 10, max, lo);
+    if (str == NULL)
+        return -1;
+
+    if (*str == '\0') {
+        *hi = *lo;
+        return 0;
+    } else if (*str != '-') {
+        return -1;
+    }
+
+    str = DetectLorawanParseUint(str + 1, 10, max, hi);
+    if (str == NULL || *str != '\0' || *hi < *lo)
+        return -1;
+
+    return 0;
+}
+
+/**
+ * \brief look up a name, or take a number if it's not one of the names
+ *
+ * \retval 0 ok
+ * \retval -1 unknown name or number out of range
+ */
+static int DetectLorawanParseName(DetectLorawanName *names, char *str,
+                                  uint32_t max, uint8_t *res) {
+    uint32_t val;
+    int i;
+
+    str = DetectLorawanTrim(str);
+
+    for (i = 0; names[i].name != NULL; i++) {
+        if (strcasecmp(names[i].name, str) == 0) {
+            *res = names[i].value;
+            return 0;
+        }
+    }
+
+    str = DetectLorawanParseUint(str, 0, max, &val);
+    if (str == NULL || *str != '\0')
+        return -1;
+
+    *res = (uint8_t)val;
+    return 0;
+}
+
+/**
+ * \brief add a sigmatch to the packet match list of the sig
+ */
+static int DetectLorawanAppend(Signature *s, uint8_t type, void *data) {
+    SigMatch *sm = SigMatchAlloc();
+    if (sm == NULL)
+        return -1;
+
+    sm->type = type;
+    sm->ctx = data;
+
+    SigMatchAppendPacket(s, sm);
+    return 0;
+}
+
+/**
+ * \brief This function is used to free the data of all lorawan.* keywords
+ */
+void DetectLorawanFree(void *ptr) {
+    SCFree(ptr);
+}
+
+/*
+ * lorawan.mtype
+ */
+
+/**
+ * \brief parse a lorawan.mtype setting
+ *
+ * \retval data DetectLorawanMtypeData on success
+ * \retval NULL on failure
+ */
+DetectLorawanMtypeData *DetectLorawanMtypeParse(char *str) {
+    DetectLorawanMtypeData *data = NULL;
+    char *copy = NULL, *tok, *saveptr = NULL;
+    char *ptr;
+    uint8_t mtype;
+    int negated = 0;
+
+    copy = SCStrdup(str);
+    if (copy == NULL)
+        goto error;
+
+    ptr = DetectLorawanTrim(copy);
+    if (*ptr == '!') {
+        negated = 1;
+        ptr++;
+    }
+
+    data = SCMalloc(sizeof(DetectLorawanMtypeData));
+    if (data == NULL)
+        goto error;
+    memset(data, 0x00, sizeof(DetectLorawanMtypeData));
+
+    for (tok = strtok_r(ptr, ",", &saveptr); tok != NULL;
+            tok = strtok_r(NULL, ",", &saveptr)) {
+        if (DetectLorawanParseName(lorawan_mtype_names, tok,
+                    LORAWAN_MTYPE_MAX - 1, &mtype) < 0) {
+            SCLogError(SC_ERR_INVALID_VALUE, "invalid lorawan.mtype \"%s\"", tok);
+            goto error;
+        }
+        data->mtypes |= (1 << mtype);
+    }
+
+    if (negated)
+        data->mtypes = ~data->mtypes;
+    if (data->mtypes == 0)
+        goto error;
+
+    SCFree(copy);
+    return data;
+
+error:
+    if (copy != NULL)
+        SCFree(copy);
+    if (data != NULL)
+        SCFree(data);
+    return NULL;
+}
+
+int DetectLorawanMtypeMatch(ThreadVars *t, DetectEngineThreadCtx *det_ctx,
+                            Packet *p, Signature *s, SigMatch *m) {
+    DetectLorawanMtypeData *data = (DetectLorawanMtypeData *)m->ctx;
+
+    if (!PKT_IS_LORAWAN(p))
+        return 0;
+
+    return (data->mtypes & (1 << LORAWAN_GET_MTYPE(p))) ? 1 : 0;
+}
+
+static int DetectLorawanMtypeSetup(DetectEngineCtx *de_ctx, Signature *s, char *str) {
+    DetectLorawanMtypeData *data = DetectLorawanMtypeParse(str);
+    if (data == NULL)
+        return -1;
+
+    /* narrow down the groups this sig goes in */
+    if (s->flags & SIG_FLAG_LORAWAN_MTYPE) {
+        s->lorawan_mtypes &= data->mtypes;
+    } else {
+        s->lorawan_mtypes = data->mtypes;
+        s->flags |= SIG_FLAG_LORAWAN_MTYPE;
+    }
+    if (s->lorawan_mtypes == 0) {
+        SCLogError(SC_ERR_INVALID_SIGNATURE, "lorawan.mtype settings exclude "
+                "each other, the signature can never match");
+        goto error;
+    }
+
+    if (DetectLorawanAppend(s, DETECT_LORAWAN_MTYPE, data) < 0)
+        goto error;
+
+    return 0;
+
+error:
+    SCFree(data);
+    return -1;
+}
+
+/*
+ * lorawan.devaddr
+ */
+
+/**
+ * \brief parse a lorawan.devaddr setting: a DevAddr, a DevAddr prefix
+ *        (e.g. the NwkID: 26000000/7) or a range of DevAddrs, all in hex
+ *
+ * \retval data DetectLorawanDevAddrData on success
+ * \retval NULL on failure
+ */
+DetectLorawanDevAddrData *DetectLorawanDevAddrParse(char *str) {
+    DetectLorawanDevAddrData *data = NULL;
+    char *copy = NULL;
+    char *ptr;
+    uint32_t bits;
+
+    copy = SCStrdup(str);
+    if (copy == NULL)
+        goto error;
+
+    data = SCMalloc(sizeof(DetectLorawanDevAddrData));
+    if (data == NULL)
+        goto error;
+    memset(data, 0x00, sizeof(DetectLorawanDevAddrData));
+
+    ptr = DetectLorawanTrim(copy);
+    if (*ptr == '!') {
+        data->negated = 1;
+        ptr++;
+    }
+
+    ptr = DetectLorawanParseUint(ptr, 16, 0xffffffff, &data->lo);
+    if (ptr == NULL)
+        goto error;
+
+    if (*ptr == '\0') {
+        data->hi = data->lo;
+    } else if (*ptr == '/') {
+        ptr = DetectLorawanParseUint(ptr + 1, 10, 32, &bits);
+        if (ptr == NULL || *ptr != '\0')
+            goto error;
+
+        if (bits == 0) {
+            data->lo = 0;
+            data->hi = 0xffffffff;
+        } else {
+            uint32_t mask = 0xffffffff << (32 - bits);
+            data->lo &= mask;
+            data->hi = data->lo | ~mask;
+        }
+    } else if (*ptr == '-') {
+        ptr = DetectLorawanParseUint(ptr + 1, 16, 0xffffffff, &data->hi);
+        if (ptr == NULL || *ptr != '\0' || data->hi < data->lo)
+            goto error;
+    } else {
+        goto error;
+    }
+
+    SCFree(copy);
+    return data;
+
+error:
+    SCLogError(SC_ERR_INVALID_VALUE, "invalid lorawan.devaddr \"%s\"", str);
+    if (copy != NULL)
+        SCFree(copy);
+    if (data != NULL)
+        SCFree(data);
+    return NULL;
+}
+
+int DetectLorawanDevAddrMatch(ThreadVars *t, DetectEngineThreadCtx *det_ctx,
+                              Packet *p, Signature *s, SigMatch *m) {
+    DetectLorawanDevAddrData *data = (DetectLorawanDevAddrData *)m->ctx;
+    uint32_t devaddr;
+    int ret;
+
+    if (!PKT_IS_LORAWAN(p) || !LORAWAN_HAS_FHDR(p))
+        return 0;
+
+    devaddr = LORAWAN_GET_DEVADDR(p);
+    ret = (devaddr >= data->lo && devaddr <= data->hi);
+
+    return ret ^ data->negated;
+}
+
+static int DetectLorawanDevAddrSetup(DetectEngineCtx *de_ctx, Signature *s, char *str) {
+    DetectLorawanDevAddrData *data = DetectLorawanDevAddrParse(str);
+    if (data == NULL)
+        return -1;
+
+    if (DetectLorawanAppend(s, DETECT_LORAWAN_DEVADDR, data) < 0) {
+        SCFree(data);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * lorawan.fport
+ */
+
+/**
+ * \brief parse a lorawan.fport setting into a FPort bitmap
+ *
+ * \retval data DetectLorawanFportData on success
+ * \retval NULL on failure
+ */
+DetectLorawanFportData *DetectLorawanFportParse(char *str) {
+    DetectLorawanFportData *data = NULL;
+    char *copy = NULL, *tok, *saveptr = NULL;
+    char *ptr;
+    uint32_t lo, hi, port;
+    int negated = 0;
+    int i, set = 0;
+
+    copy = SCStrdup(str);
+    if (copy == NULL)
+        goto error;
+
+    ptr = DetectLorawanTrim(copy);
+    if (*ptr == '!') {
+        negated = 1;
+        ptr++;
+    }
+
+    data = SCMalloc(sizeof(DetectLorawanFportData));
+    if (data == NULL)
+        goto error;
+    memset(data, 0x00, sizeof(DetectLorawanFportData));
+
+    for (tok = strtok_r(ptr, ",", &saveptr); tok != NULL;
+            tok = strtok_r(NULL, ",", &saveptr)) {
+        if (DetectLorawanParseRange(tok, 255, &lo, &hi) < 0) {
+            SCLogError(SC_ERR_INVALID_VALUE, "invalid lorawan.fport \"%s\"", tok);
+            goto error;
+        }
+        for (port = lo; port <= hi; port++)
+            data->fports[port / 8] |= (1 << (port % 8));
+    }
+
+    for (i = 0; i < DETECT_LORAWAN_FPORT_BYTES; i++) {
+        if (negated)
+            data->fports[i] = ~data->fports[i];
+        set |= data->fports[i];
+    }
+    if (set == 0)
+        goto error;
+
+    SCFree(copy);
+    return data;
+
+error:
+    if (copy != NULL)
+        SCFree(copy);
+    if (data != NULL)
+        SCFree(data);
+    return NULL;
+}
+
+/** \note frames without FPort never match */
+int DetectLorawanFportMatch(ThreadVars *t, DetectEngineThreadCtx *det_ctx,
+                            Packet *p, Signature *s, SigMatch *m) {
+    DetectLorawanFportData *data = (DetectLorawanFportData *)m->ctx;
+
+    if (!PKT_IS_LORAWAN(p) || !LORAWAN_HAS_FPORT(p))
+        return 0;
+
+    return DETECT_LORAWAN_FPORT_ISSET(data->fports, LORAWAN_GET_FPORT(p)) ? 1 : 0;
+}
+
+static int DetectLorawanFportSetup(DetectEngineCtx *de_ctx, Signature *s, char *str) {
+    DetectLorawanFportData *data = DetectLorawanFportParse(str);
+    int i, set = 0;
+
+    if (data == NULL)
+        return -1;
+
+    if (s->flags & SIG_FLAG_LORAWAN_FPORT) {
+        for (i = 0; i < DETECT_LORAWAN_FPORT_BYTES; i++) {
+            s->lorawan_fports[i] &= data->fports[i];
+            set |= s->lorawan_fports[i];
+        }
+        if (set == 0) {
+            SCLogError(SC_ERR_INVALID_SIGNATURE, "lorawan.fport settings "
+                    "exclude each other, the signature can never match");
+            goto error;
+        }
+    } else {
+        memcpy(s->lorawan_fports, data->fports, DETECT_LORAWAN_FPORT_BYTES);
+        s->flags |= SIG_FLAG_LORAWAN_FPORT;
+    }
+
+    if (DetectLorawanAppend(s, DETECT_LORAWAN_FPORT, data) < 0)
+        goto error;
+
+    return 0;
+
+error:
+    SCFree(data);
+    return -1;
+}
+
+/*
+ * lorawan.fctrl
+ */
+
+/**
+ * \brief parse a lorawan.fctrl setting: a list of FCtrl bits that need to
+ *        be set, or with a '!' need to be unset
+ *
+ * \retval data DetectLorawanFctrlData on success
+ * \retval NULL on failure
+ */
+DetectLorawanFctrlData *DetectLorawanFctrlParse(char *str) {
+    DetectLorawanFctrlData *data = NULL;
+    char *copy = NULL, *tok, *saveptr = NULL;
+    uint8_t bit;
+    int negated;
+
+    copy = SCStrdup(str);
+    if (copy == NULL)
+        goto error;
+
+    data = SCMalloc(sizeof(DetectLorawanFctrlData));
+    if (data == NULL)
+        goto error;
+    memset(data, 0x00, sizeof(DetectLorawanFctrlData));
+
+    for (tok = strtok_r(copy, ",", &saveptr); tok != NULL;
+            tok = strtok_r(NULL, ",", &saveptr)) {
+        tok = DetectLorawanTrim(tok);
+        negated = 0;
+        if (*tok == '!') {
+            negated = 1;
+            tok++;
+        }
+
+        if (DetectLorawanParseName(lorawan_fctrl_names, tok, 0, &bit) < 0 ||
+                bit == 0) {
+            SCLogError(SC_ERR_INVALID_VALUE, "invalid lorawan.fctrl \"%s\"", tok);
+            goto error;
+        }
+
+        data->mask |= bit;
+        if (!negated)
+            data->value |= bit;
+    }
+
+    if (data->mask == 0)
+        goto error;
+
+    SCFree(copy);
+    return data;
+
+error:
+    if (copy != NULL)
+        SCFree(copy);
+    if (data != NULL)
+        SCFree(data);
+    return NULL;
+}
+
+int DetectLorawanFctrlMatch(ThreadVars *t, DetectEngineThreadCtx *det_ctx,
+                            Packet *p, Signature *s, SigMatch *m) {
+    DetectLorawanFctrlData *data = (DetectLorawanFctrlData *)m->ctx;
+
+    if (!PKT_IS_LORAWAN(p) || !LORAWAN_HAS_FHDR(p))
+        return 0;
+
+    return ((LORAWAN_GET_FCTRL(p) & data->mask) == data->value) ? 1 : 0;
+}
+
+static int DetectLorawanFctrlSetup(DetectEngineCtx *de_ctx, Signature *s, char *str) {
+    DetectLorawanFctrlData *data = DetectLorawanFctrlParse(str);
+    if (data == NULL)
+        return -1;
+
+    if (DetectLorawanAppend(s, DETECT_LORAWAN_FCTRL, data) < 0) {
+        SCFree(data);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * lorawan.fopts_cmd
+ */
+
+/**
+ * \brief parse a lorawan.fopts_cmd setting
+ *
+ * \retval data DetectLorawanFoptsCmdData on success
+ * \retval NULL on failure
+ */
+DetectLorawanFoptsCmdData *DetectLorawanFoptsCmdParse(char *str) {
+    DetectLorawanFoptsCmdData *data = NULL;
+    char *copy = NULL;
+
+    copy = SCStrdup(str);
+    if (copy == NULL)
+        goto error;
+
+    data = SCMalloc(sizeof(DetectLorawanFoptsCmdData));
+    if (data == NULL)
+        goto error;
+    memset(data, 0x00, sizeof(DetectLorawanFoptsCmdData));
+
+    if (DetectLorawanParseName(lorawan_cid_names, copy, 255, &data->cid) < 0) {
+        SCLogError(SC_ERR_INVALID_VALUE, "invalid lorawan.fopts_cmd \"%s\"", str);
+        goto error;
+    }
+
+    SCFree(copy);
+    return data;
+
+error:
+    if (copy != NULL)
+        SCFree(copy);
+    if (data != NULL)
+        SCFree(data);
+    return NULL;
+}
+
+/**
+ * \brief look for a MAC command in FOpts
+ *
+ * Commands are walked using the known command lengths for the direction of
+ * the frame. At an unknown CID we have to stop as we can't tell where the
+ * next command starts.
+ */
+int DetectLorawanFoptsCmdMatch(ThreadVars *t, DetectEngineThreadCtx *det_ctx,
+                               Packet *p, Signature *s, SigMatch *m) {
+    DetectLorawanFoptsCmdData *data = (DetectLorawanFoptsCmdData *)m->ctx;
+    int8_t *cid_len;
+    uint8_t *fopts;
+    uint8_t cid;
+    uint16_t i;
+
+    if (!PKT_IS_LORAWAN(p) || !LORAWAN_HAS_FHDR(p) || p->lorawanh->fopts_len == 0)
+        return 0;
+
+    cid_len = LORAWAN_MTYPE_IS_UPLINK(LORAWAN_GET_MTYPE(p)) ?
+        lorawan_cid_len_up : lorawan_cid_len_down;
+    fopts = p->lorawanh->fopts;
+
+    for (i = 0; i < p->lorawanh->fopts_len; ) {
+        cid = fopts[i];
+        if (cid == data->cid)
+            return 1;
+
+        if (cid > LORAWAN_CID_MAX || cid_len[cid] < 0)
+            break;
+        i += 1 + cid_len[cid];
+    }
+
+    return 0;
+}
+
+static int DetectLorawanFoptsCmdSetup(DetectEngineCtx *de_ctx, Signature *s, char *str) {
+    DetectLorawanFoptsCmdData *data = DetectLorawanFoptsCmdParse(str);
+    if (data == NULL)
+        return -1;
+
+    if (DetectLorawanAppend(s, DETECT_LORAWAN_FOPTS_CMD, data) < 0) {
+        SCFree(data);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * lorawan.fcnt_gap
+ */
+
+/**
+ * \brief parse a lorawan.fcnt_gap setting
+ *
+ * \retval data DetectLorawanFcntGapData on success
+ * \retval NULL on failure
+ */
+DetectLorawanFcntGapData *DetectLorawanFcntGapParse(char *str) {
+    DetectLorawanFcntGapData *data = NULL;
+    char *copy = NULL;
+
+    copy = SCStrdup(str);
+    if (copy == NULL)
+        goto error;
+
+    data = SCMalloc(sizeof(DetectLorawanFcntGapData));
+    if (data == NULL)
+        goto error;
+    memset(data, 0x00, sizeof(DetectLorawanFcntGapData));
+
+    if (DetectLorawanParseRange(copy, 0xffffffff, &data->lo, &data->hi) < 0) {
+        SCLogError(SC_ERR_INVALID_VALUE, "invalid lorawan.fcnt_gap \"%s\"", str);
+        goto error;
+    }
+
+    SCFree(copy);
+    return data;
+
+error:
+    if (copy != NULL)
+        SCFree(copy);
+    if (data != NULL)
+        SCFree(data);
+    return NULL;
+}
+
+/** \note the gap is set by the session table, see LorawanSessionCheckFCnt */
+int DetectLorawanFcntGapMatch(ThreadVars *t, DetectEngineThreadCtx *det_ctx,
+                              Packet *p, Signature *s, SigMatch *m) {
+    DetectLorawanFcntGapData *data = (DetectLorawanFcntGapData *)m->ctx;
+    uint32_t gap;
+
+    if (!PKT_IS_LORAWAN(p) || !LORAWAN_HAS_FHDR(p))
+        return 0;
+
+    gap = LORAWAN_GET_FCNT_GAP(p);
+    return (gap >= data->lo && gap <= data->hi) ? 1 : 0;
+}
+
+static int DetectLorawanFcntGapSetup(DetectEngineCtx *de_ctx, Signature *s, char *str) {
+    DetectLorawanFcntGapData *data = DetectLorawanFcntGapParse(str);
+    if (data == NULL)
+        return -1;
+
+    if (DetectLorawanAppend(s, DETECT_LORAWAN_FCNT_GAP, data) < 0) {
+        SCFree(data);
+        return -1;
+    }
+    return 0;
+}
+
+#ifdef UNITTESTS
+
+#include "detect-engine-siggroup.h"
+
+static void DetectLorawanTestPacket(Packet *p, uint8_t mtype, uint32_t devaddr,
+                                    uint8_t fctrl, int fport) {
+    memset(p, 0x00, sizeof(Packet));
+    p->lorawan.mtype = mtype;
+    p->lorawan.devaddr = devaddr;
+    p->lorawan.fctrl = fctrl;
+    p->lorawan.flags = LORAWAN_HDR_HAS_FHDR;
+    if (fport >= 0) {
+        p->lorawan.fport = (uint8_t)fport;
+        p->lorawan.flags |= LORAWAN_HDR_HAS_FPORT;
+    }
+    p->lorawanh = &p->lorawan;
+}
+
+/** \test lorawan.mtype and lorawan.fport parsing */
+static int DetectLorawanTest01(void) {
+    DetectLorawanMtypeData *mt = NULL;
+    DetectLorawanFportData *fp = NULL;
+    int result = 0;
+
+    mt = DetectLorawanMtypeParse("join_request, 7");
+    if (mt == NULL || mt->mtypes != 0x81)
+        goto end;
+    SCFree(mt);
+
+    mt = DetectLorawanMtypeParse("!unconfirmed_data_up");
+    if (mt == NULL || mt->mtypes != 0xfb)
+        goto end;
+    SCFree(mt);
+
+    mt = DetectLorawanMtypeParse("8");
+    if (mt != NULL)
+        goto end;
+    mt = DetectLorawanMtypeParse("data_up");
+    if (mt != NULL)
+        goto end;
+
+    fp = DetectLorawanFportParse("1-3, 224, >250");
+    if (fp == NULL || fp->fports[0] != 0x0e || fp->fports[28] != 0x01 ||
+        fp->fports[31] != 0xf8 || fp->fports[1] != 0)
+        goto end;
+    SCFree(fp);
+
+    fp = DetectLorawanFportParse("!0");
+    if (fp == NULL || fp->fports[0] != 0xfe || fp->fports[31] != 0xff)
+        goto end;
+    SCFree(fp);
+    fp = NULL;
+
+    if (DetectLorawanFportParse("256") != NULL ||
+        DetectLorawanFportParse("3-1") != NULL ||
+        DetectLorawanFportParse("<0") != NULL)
+        goto end;
+
+    result = 1;
+end:
+    if (fp != NULL)
+        SCFree(fp);
+    return result;
+}
+
+/** \test lorawan.devaddr parsing and matching */
+static int DetectLorawanTest02(void) {
+    DetectLorawanDevAddrData *da = NULL;
+    SigMatch sm;
+    Packet p;
+    int result = 0;
+
+    da = DetectLorawanDevAddrParse("26011234");
+    if (da == NULL || da->lo != 0x26011234 || da->hi != 0x26011234)
+        goto end;
+    SCFree(da);
+
+    da = DetectLorawanDevAddrParse("0x26011234/7");
+    if (da == NULL || da->lo != 0x26000000 || da->hi != 0x27ffffff)
+        goto end;
+    SCFree(da);
+
+    da = DetectLorawanDevAddrParse("!26010000 - 2601ffff");
+    if (da == NULL || da->lo != 0x26010000 || da->hi != 0x2601ffff || !da->negated)
+        goto end;
+
+    memset(&sm, 0x00, sizeof(sm));
+    sm.ctx = da;
+
+    DetectLorawanTestPacket(&p, UNCONFIRMED_DATA_UP, 0x26011234, 0, 1);
+    if (DetectLorawanDevAddrMatch(NULL, NULL, &p, NULL, &sm) != 0)
+        goto end;
+    DetectLorawanTestPacket(&p, UNCONFIRMED_DATA_UP, 0x26021234, 0, 1);
+    if (DetectLorawanDevAddrMatch(NULL, NULL, &p, NULL, &sm) != 1)
+        goto end;
+    /* no DevAddr in a join request */
+    DetectLorawanTestPacket(&p, JOIN_REQUEST, 0, 0, -1);
+    p.lorawan.flags = LORAWAN_HDR_HAS_JOIN;
+    if (DetectLorawanDevAddrMatch(NULL, NULL, &p, NULL, &sm) != 0)
+        goto end;
+    SCFree(da);
+    da = NULL;
+
+    if (DetectLorawanDevAddrParse("26011234/33") != NULL ||
+        DetectLorawanDevAddrParse("2601ffff-26010000") != NULL ||
+        DetectLorawanDevAddrParse("node") != NULL)
+        goto end;
+
+    result = 1;
+end:
+    if (da != NULL)
+        SCFree(da);
+    return result;
+}
+
+/** \test lorawan.fctrl and lorawan.fopts_cmd */
+static int DetectLorawanTest03(void) {
+    DetectLorawanFctrlData *fc = NULL;
+    DetectLorawanFoptsCmdData *cmd = NULL;
+    SigMatch sm;
+    Packet p;
+    /* LinkADRReq (4 bytes) followed by DevStatusReq */
+    uint8_t fopts_down[] = { 0x03, 0x06, 0x02, 0x00, 0x01, 0x06 };
+    /* LinkADRAns, DevStatusAns (2 bytes) */
+    uint8_t fopts_up[] = { 0x03, 0x07, 0x06, 0xff, 0x20 };
+    int result = 0;
+
+    fc = DetectLorawanFctrlParse("adr, !ack");
+    if (fc == NULL || fc->mask != 0xa0 || fc->value != 0x80)
+        goto end;
+
+    memset(&sm, 0x00, sizeof(sm));
+    sm.ctx = fc;
+    DetectLorawanTestPacket(&p, UNCONFIRMED_DATA_UP, 1, 0x80 | 0x03, 1);
+    if (DetectLorawanFctrlMatch(NULL, NULL, &p, NULL, &sm) != 1)
+        goto end;
+    DetectLorawanTestPacket(&p, UNCONFIRMED_DATA_UP, 1, 0xa0, 1);
+    if (DetectLorawanFctrlMatch(NULL, NULL, &p, NULL, &sm) != 0)
+        goto end;
+    SCFree(fc);
+    fc = NULL;
+
+    if (DetectLorawanFctrlParse("adr,foo") != NULL)
+        goto end;
+
+    cmd = DetectLorawanFoptsCmdParse("dev_status");
+    if (cmd == NULL || cmd->cid != LORAWAN_CID_DEV_STATUS)
+        goto end;
+    sm.ctx = cmd;
+
+    /* the 0x06 inside the LinkADRReq payload is not a command */
+    DetectLorawanTestPacket(&p, UNCONFIRMED_DATA_DOWN, 1, sizeof(fopts_down), -1);
+    p.lorawan.fopts = fopts_down;
+    p.lorawan.fopts_len = sizeof(fopts_down);
+    if (DetectLorawanFoptsCmdMatch(NULL, NULL, &p, NULL, &sm) != 1)
+        goto end;
+    p.lorawan.fopts_len = 5;
+    if (DetectLorawanFoptsCmdMatch(NULL, NULL, &p, NULL, &sm) != 0)
+        goto end;
+
+    DetectLorawanTestPacket(&p, CONFIRMED_DATA_UP, 1, sizeof(fopts_up), -1);
+    p.lorawan.fopts = fopts_up;
+    p.lorawan.fopts_len = sizeof(fopts_up);
+    if (DetectLorawanFoptsCmdMatch(NULL, NULL, &p, NULL, &sm) != 1)
+        goto end;
+    SCFree(cmd);
+
+    cmd = DetectLorawanFoptsCmdParse("0x80");
+    if (cmd == NULL || cmd->cid != 0x80)
+        goto end;
+
+    result = 1;
+end:
+    if (fc != NULL)
+        SCFree(fc);
+    if (cmd != NULL)
+        SCFree(cmd);
+    return result;
+}
+
+/** \test lorawan.fcnt_gap */
+static int DetectLorawanTest04(void) {
+    DetectLorawanFcntGapData *gap = NULL;
+    SigMatch sm;
+    Packet p;
+    int result = 0;
+
+    gap = DetectLorawanFcntGapParse(">100");
+    if (gap == NULL || gap->lo != 101 || gap->hi != 0xffffffff)
+        goto end;
+
+    memset(&sm, 0x00, sizeof(sm));
+    sm.ctx = gap;
+    DetectLorawanTestPacket(&p, UNCONFIRMED_DATA_UP, 1, 0, 1);
+    p.lorawan.fcnt_gap = 100;
+    if (DetectLorawanFcntGapMatch(NULL, NULL, &p, NULL, &sm) != 0)
+        goto end;
+    p.lorawan.fcnt_gap = 101;
+    if (DetectLorawanFcntGapMatch(NULL, NULL, &p, NULL, &sm) != 1)
+        goto end;
+
+    result = 1;
+end:
+    if (gap != NULL)
+        SCFree(gap);
+    return result;
+}
+
+static int DetectLorawanTestSghHasSig(SigGroupHead *sgh, uint32_t sid) {
+    uint32_t i;
+
+    if (sgh == NULL)
+        return 0;
+
+    for (i = 0; i < sgh->sig_cnt; i++) {
+        if (sgh->match_array[i]->id == sid)
+            return 1;
+    }
+    return 0;
+}
+
+/** \test sigs end up in the LoRaWAN groups of their MType and FPort */
+static int DetectLorawanTest05(void) {
+    DetectEngineCtx *de_ctx = NULL;
+    DetectEngineLookupLorawan *gh;
+    int result = 0;
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+
+    de_ctx->sig_list = SigInit(de_ctx, "alert ip any any -> any any "
+            "(msg:\"any frame\"; sid:1;)");
+    if (de_ctx->sig_list == NULL)
+        goto end;
+    de_ctx->sig_list->next = SigInit(de_ctx, "alert ip any any -> any any "
+            "(msg:\"joins\"; lorawan.mtype:join_request; sid:2;)");
+    if (de_ctx->sig_list->next == NULL)
+        goto end;
+    de_ctx->sig_list->next->next = SigInit(de_ctx, "alert ip any any -> any any "
+            "(msg:\"port 10 up\"; lorawan.mtype:unconfirmed_data_up,confirmed_data_up; "
+            "lorawan.fport:10; sid:3;)");
+    if (de_ctx->sig_list->next->next == NULL)
+        goto end;
+
+    if (!(de_ctx->sig_list->next->next->flags & SIG_FLAG_LORAWAN_FPORT) ||
+        de_ctx->sig_list->next->next->lorawan_mtypes != 0x14)
+        goto end;
+
+    SigGroupBuild(de_ctx);
+
+    gh = &de_ctx->lorawan_gh[JOIN_REQUEST];
+    if (!DetectLorawanTestSghHasSig(gh->sgh[DETECT_LORAWAN_FPORT_NONE], 1) ||
+        !DetectLorawanTestSghHasSig(gh->sgh[DETECT_LORAWAN_FPORT_NONE], 2) ||
+        DetectLorawanTestSghHasSig(gh->sgh[DETECT_LORAWAN_FPORT_NONE], 3))
+        goto end;
+
+    gh = &de_ctx->lorawan_gh[UNCONFIRMED_DATA_UP];
+    if (!DetectLorawanTestSghHasSig(gh->sgh[10], 3) ||
+        !DetectLorawanTestSghHasSig(gh->sgh[10], 1) ||
+        DetectLorawanTestSghHasSig(gh->sgh[11], 3) ||
+        DetectLorawanTestSghHasSig(gh->sgh[DETECT_LORAWAN_FPORT_NONE], 3))
+        goto end;
+
+    /* ports without a sig of their own share the generic group */
+    if (gh->sgh[11] != gh->sgh[DETECT_LORAWAN_FPORT_NONE] ||
+        gh->sgh[11] != de_ctx->lorawan_gh[UNCONFIRMED_DATA_DOWN].sgh[10])
+        goto end;
+
+    gh = &de_ctx->lorawan_gh[UNCONFIRMED_DATA_DOWN];
+    if (DetectLorawanTestSghHasSig(gh->sgh[10], 3))
+        goto end;
+
+    result = 1;
+end:
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        SigCleanSignatures(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+/**
+ * \brief this function registers unit tests for the lorawan.* keywords
+ */
+void DetectLorawanRegisterTests(void) {
+#ifdef UNITTESTS
+    UtRegisterTest("DetectLorawanTest01", DetectLorawanTest01, 1);
+    UtRegisterTest("DetectLorawanTest02", DetectLorawanTest02, 1);
+    UtRegisterTest("DetectLorawanTest03", DetectLorawanTest03, 1);
+    UtRegisterTest("DetectLorawanTest04", DetectLorawanTest04, 1);
+    UtRegisterTest("DetectLorawanTest05", DetectLorawanTest05, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,61 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * LoRaWAN header keywords: lorawan.mtype, lorawan.devaddr, lorawan.fport,
+ * lorawan.fctrl, lorawan.fopts_cmd and lorawan.fcnt_gap
+ */
+
+#ifndef __DETECT_LORAWAN_H__
+#define __DETECT_LORAWAN_H__
+
+typedef struct DetectLorawanMtypeData_ {
+    uint8_t mtypes;                 /**< bit n set: MType n matches */
+} DetectLorawanMtypeData;
+
+typedef struct DetectLorawanDevAddrData_ {
+    uint32_t lo;                    /**< first DevAddr, inclusive */
+    uint32_t hi;                    /**< last DevAddr, inclusive */
+    uint8_t negated;
+} DetectLorawanDevAddrData;
+
+typedef struct DetectLorawanFportData_ {
+    uint8_t fports[DETECT_LORAWAN_FPORT_BYTES];
+} DetectLorawanFportData;
+
+typedef struct DetectLorawanFctrlData_ {
+    uint8_t mask;                   /**< FCtrl bits we look at */
+    uint8_t value;                  /**< and the value they need to have */
+} DetectLorawanFctrlData;
+
+typedef struct DetectLorawanFoptsCmdData_ {
+    uint8_t cid;                    /**< MAC command identifier */
+} DetectLorawanFoptsCmdData;
+
+typedef struct DetectLorawanFcntGapData_ {
+    uint32_t lo;                    /**< smallest gap, inclusive */
+    uint32_t hi;                    /**< largest gap, inclusive */
+} DetectLorawanFcntGapData;
+
+#define DETECT_LORAWAN_FPORT_ISSET(fp, port) \
+    ((fp)[(port) / 8] & (1 << ((port) % 8)))
+
+void DetectLorawanRegister(void);
+
+#endif /* __DETECT_LORAWAN_H__ */
@@ -1050,6 +1050,11 @@ void SigFree(Signature *s) {
         DetectPortCleanupList(s->dp);
     }
 
+    DetectAddressArrayFree(&s->src_array);
+    DetectAddressArrayFree(&s->dst_array);
+    DetectPortArrayFree(&s->sp_array);
+    DetectPortArrayFree(&s->dp_array);
+
     if (s->msg != NULL)
         SCFree(s->msg);
 
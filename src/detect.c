@@ -46,6 +46,7 @@
 #include "detect-engine-dcepayload.h"
 #include "detect-engine-uri.h"
 #include "detect-engine-state.h"
+#include "detect-engine-cache.h"
 
 #include "detect-http-cookie.h"
 #include "detect-http-method.h"
@@ -89,6 +90,7 @@
 #include "detect-id.h"
 #include "detect-rpc.h"
 #include "detect-asn1.h"
+#include "detect-lorawan.h"
 #include "detect-dsize.h"
 #include "detect-flowvar.h"
 #include "detect-flowint.h"
@@ -150,6 +152,7 @@ void DbgPrintSigs2(DetectEngineCtx *, SigGroupHead *);
 
 /* tm module api functions */
 TmEcode Detect(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
+TmEcode DetectBatch(ThreadVars *, Packet **, uint16_t, void *, PacketQueue *, PacketQueue *);
 TmEcode DetectThreadInit(ThreadVars *, void *, void **);
 TmEcode DetectThreadDeinit(ThreadVars *, void *);
 
@@ -157,17 +160,29 @@ void TmModuleDetectRegister (void) {
     tmm_modules[TMM_DETECT].name = "Detect";
     tmm_modules[TMM_DETECT].ThreadInit = DetectThreadInit;
     tmm_modules[TMM_DETECT].Func = Detect;
+    tmm_modules[TMM_DETECT].FuncBatch = DetectBatch;
     tmm_modules[TMM_DETECT].ThreadExitPrintStats = DetectExitPrintStats;
     tmm_modules[TMM_DETECT].ThreadDeinit = DetectThreadDeinit;
     tmm_modules[TMM_DETECT].RegisterTests = SigRegisterTests;
     tmm_modules[TMM_DETECT].cap_flags = 0;
 }
 
+/** alerts of the detect threads that have exited */
+static uint64_t detect_alerts = 0;
+
+/** \brief get the number of alerts raised by the detect threads, once they
+ *         have exited */
+uint64_t DetectGetAlertCnt(void) {
+    return detect_alerts;
+}
+
 void DetectExitPrintStats(ThreadVars *tv, void *data) {
     DetectEngineThreadCtx *det_ctx = (DetectEngineThreadCtx *)data;
     if (det_ctx == NULL)
         return;
 
+    __sync_fetch_and_add(&detect_alerts, det_ctx->alerts);
+
     SCLogInfo("(%s) (1byte) Pkts %" PRIu32 ", Searched %" PRIu32 " (%02.1f).",
         tv->name, det_ctx->pkts, det_ctx->pkts_searched1,
         (float)(det_ctx->pkts_searched1/(float)(det_ctx->pkts)*100));
@@ -524,6 +539,13 @@ SigGroupHead *SigMatchSignaturesGetSgh(DetectEngineCtx *de_ctx, DetectEngineThre
     int f;
     SigGroupHead *sgh = NULL;
 
+    /* LoRaWAN frames have no addresses or ports, they are grouped by
+     * MType and FPort instead */
+    if (PKT_IS_LORAWAN(p)) {
+        f = LORAWAN_HAS_FPORT(p) ? LORAWAN_GET_FPORT(p) : DETECT_LORAWAN_FPORT_NONE;
+        SCReturnPtr(de_ctx->lorawan_gh[LORAWAN_GET_MTYPE(p)].sgh[f], "SigGroupHead");
+    }
+
     /* if the packet proto is 0 (not set), we're inspecting it against
      * the decoder events sgh we have. */
     if (p->proto == 0 && p->events.cnt > 0) {
@@ -693,6 +715,20 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
 
         SCMutexLock(&p->flow->m);
 
+        /* the sgh's and the detection state are from an older rule set */
+        if (p->flow->de_ctx_version != de_ctx->version) {
+            p->flow->flags &= ~(FLOW_SGH_TOSERVER|FLOW_SGH_TOCLIENT);
+            p->flow->sgh_toserver = NULL;
+            p->flow->sgh_toclient = NULL;
+
+            SCMutexLock(&p->flow->de_state_m);
+            if (p->flow->de_state != NULL)
+                DetectEngineStateReset(p->flow->de_state);
+            SCMutexUnlock(&p->flow->de_state_m);
+
+            p->flow->de_ctx_version = de_ctx->version;
+        }
+
         /* Get the stored sgh from the flow (if any). Make sure we're not using
          * the sgh for icmp error packets part of the same stream. */
         if (p->proto == p->flow->proto) { /* filter out icmp */
@@ -765,6 +801,12 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
     } else {
         det_ctx->sgh = sgh;
     }
+    /* the payload was searched for another sgh than we got, so the pmq
+     * has matches we don't want */
+    if (det_ctx->batch_sgh != NULL && det_ctx->batch_sgh != det_ctx->sgh) {
+        PmqReset(&det_ctx->pmq);
+        det_ctx->batch_sgh = NULL;
+    }
     /* if we didn't get a sig group head, we
      * have nothing to do.... */
     if (det_ctx->sgh == NULL) {
@@ -797,7 +839,12 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
             else if (det_ctx->sgh->mpm_content_maxlen == 4) det_ctx->pkts_searched4++;
             else                                            det_ctx->pkts_searched++;
 
-            cnt = PacketPatternSearch(th_v, det_ctx, p);
+            if (det_ctx->batch_sgh != NULL) {
+                /* searched together with the other packets of the vector */
+                cnt = det_ctx->batch_cnt;
+            } else {
+                cnt = PacketPatternSearch(th_v, det_ctx, p);
+            }
             if (cnt > 0) {
                 det_ctx->mpm_match++;
             }
@@ -836,15 +883,13 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
         /* check the source & dst port in the sig */
         if (p->proto == IPPROTO_TCP || p->proto == IPPROTO_UDP) {
             if (!(s->flags & SIG_FLAG_DP_ANY)) {
-                DetectPort *dport = DetectPortLookupGroup(s->dp,p->dp);
-                if (dport == NULL) {
+                if (DetectPortArrayLookup(&s->dp_array, p->dp) == 0) {
                     SCLogDebug("dport didn't match.");
                     goto next;
                 }
             }
             if (!(s->flags & SIG_FLAG_SP_ANY)) {
-                DetectPort *sport = DetectPortLookupGroup(s->sp,p->sp);
-                if (sport == NULL) {
+                if (DetectPortArrayLookup(&s->sp_array, p->sp) == 0) {
                     SCLogDebug("sport didn't match.");
                     goto next;
                 }
@@ -853,16 +898,14 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
 
         /* check the destination address */
         if (!(s->flags & SIG_FLAG_DST_ANY)) {
-            DetectAddress *daddr = DetectAddressLookupInHead(&s->dst,&p->dst);
-            if (daddr == NULL) {
+            if (DetectAddressArrayLookup(&s->dst_array, &p->dst) == 0) {
                 SCLogDebug("dst addr didn't match.");
                 goto next;
             }
         }
         /* check the source address */
         if (!(s->flags & SIG_FLAG_SRC_ANY)) {
-            DetectAddress *saddr = DetectAddressLookupInHead(&s->src,&p->src);
-            if (saddr == NULL) {
+            if (DetectAddressArrayLookup(&s->src_array, &p->src) == 0) {
                 SCLogDebug("src addr didn't match.");
                 goto next;
             }
@@ -1043,6 +1086,13 @@ end:
     PacketAlertFinalize(de_ctx, det_ctx, p);
     if (p->alerts.cnt > 0) {
         SCPerfCounterAddUI64(det_ctx->counter_alerts, det_ctx->tv->sc_perf_pca, (uint64_t)p->alerts.cnt);
+        det_ctx->alerts += p->alerts.cnt;
+
+        /* the alerts point into de_ctx, keep it until the packet is done */
+        if (p->alerts.de_ctx == NULL) {
+            DetectEngineCtxRef(de_ctx);
+            p->alerts.de_ctx = de_ctx;
+        }
     }
 
     /* cleanup pkt specific part of the patternmatcher */
@@ -1108,6 +1158,10 @@ TmEcode Detect(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, PacketQue
         goto error;
     }
 
+    /* the rules were reloaded, move over between two packets */
+    if (det_ctx->de_ctx_version != detect_engine_version)
+        DetectEngineThreadCtxSwitch(det_ctx);
+
     DetectEngineCtx *de_ctx = det_ctx->de_ctx;
     if (de_ctx == NULL) {
         printf("ERROR: Detect has no detection engine ctx\n");
@@ -1124,6 +1178,166 @@ error:
     return TM_ECODE_FAILED;
 }
 
+/** \brief the sgh SigMatchSignatures() will get for a packet, if it will
+ *         search the payload of the packet with its mpm ctx
+ *
+ *  \retval sgh or NULL if the payload isn't searched
+ */
+static SigGroupHead *DetectBatchGetSgh(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Packet *p)
+{
+    SigGroupHead *sgh = NULL;
+    char use_flow_sgh = FALSE;
+
+    if (p->payload_len == 0 || (p->flags & (PKT_NOPACKET_INSPECTION|
+                    PKT_NOPAYLOAD_INSPECTION|PKT_STREAM_ADD)))
+        return NULL;
+
+    if (p->flow != NULL) {
+        SCMutexLock(&p->flow->m);
+        if (p->flow->de_ctx_version == de_ctx->version &&
+            p->proto == p->flow->proto) {
+            if (p->flowflags & FLOW_PKT_TOSERVER && p->flow->flags & FLOW_SGH_TOSERVER) {
+                sgh = p->flow->sgh_toserver;
+                use_flow_sgh = TRUE;
+            } else if (p->flowflags & FLOW_PKT_TOCLIENT && p->flow->flags & FLOW_SGH_TOCLIENT) {
+                sgh = p->flow->sgh_toclient;
+                use_flow_sgh = TRUE;
+            }
+        }
+        SCMutexUnlock(&p->flow->m);
+    }
+
+    if (sgh == NULL && !use_flow_sgh)
+        sgh = SigMatchSignaturesGetSgh(de_ctx, det_ctx, p);
+
+    if (sgh == NULL || sgh->mpm_ctx == NULL ||
+        sgh->mpm_content_maxlen > p->payload_len)
+        return NULL;
+    return sgh;
+}
+
+/** \brief search the payloads of up to MPM_BATCH_SIZE packets, those that
+ *         share an mpm ctx together, into det_ctx->batch_pmq
+ *
+ *  \param sghs out: the sgh per packet, NULL if it wasn't searched
+ *  \param cnts out: the matches per packet
+ */
+static void DetectBatchSearch(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Packet **pkts, uint16_t cnt,
+        SigGroupHead **sghs, uint32_t *cnts)
+{
+    PatternMatcherQueue *pmqs[MPM_BATCH_SIZE];
+    uint8_t *bufs[MPM_BATCH_SIZE];
+    uint16_t buflens[MPM_BATCH_SIZE];
+    uint32_t bcnts[MPM_BATCH_SIZE];
+    uint16_t idx[MPM_BATCH_SIZE];
+    uint8_t done[MPM_BATCH_SIZE];
+    uint16_t i, j, n;
+
+    for (i = 0; i < cnt; i++) {
+        sghs[i] = DetectBatchGetSgh(de_ctx, det_ctx, pkts[i]);
+        cnts[i] = 0;
+        done[i] = (sghs[i] == NULL);
+    }
+
+    for (i = 0; i < cnt; i++) {
+        if (done[i])
+            continue;
+
+        MpmCtx *mpm_ctx = sghs[i]->mpm_ctx;
+        for (j = i, n = 0; j < cnt; j++) {
+            if (done[j] || sghs[j]->mpm_ctx != mpm_ctx)
+                continue;
+
+            idx[n] = j;
+            pmqs[n] = &det_ctx->batch_pmq[j];
+            bufs[n] = pkts[j]->payload;
+            buflens[n] = pkts[j]->payload_len;
+            done[j] = 1;
+            n++;
+        }
+
+        MpmSearchBatch(mpm_ctx, &det_ctx->mtc, pmqs, bufs, buflens, bcnts, n);
+        for (j = 0; j < n; j++)
+            cnts[idx[j]] = bcnts[j];
+    }
+}
+
+/** \brief Detection engine thread wrapper for a vector of packets.
+ *
+ *  The payloads of the packets are searched first, those of packets that
+ *  get the same sgh with one MpmSearchBatch(). Then every packet is
+ *  inspected as Detect() does, with the pmq of its search.
+ *
+ *  \param tv thread vars
+ *  \param pkts packets to inspect
+ *  \param cnt number of packets
+ *  \param data thread specific data
+ *  \retval TM_ECODE_FAILED error
+ *  \retval TM_ECODE_OK ok
+ */
+TmEcode DetectBatch(ThreadVars *tv, Packet **pkts, uint16_t cnt, void *data,
+        PacketQueue *pq, PacketQueue *postpq)
+{
+    SigGroupHead *sghs[MPM_BATCH_SIZE];
+    uint32_t cnts[MPM_BATCH_SIZE];
+    uint16_t start, n, i;
+
+    DetectEngineThreadCtx *det_ctx = (DetectEngineThreadCtx *)data;
+    if (det_ctx == NULL) {
+        printf("ERROR: Detect has no thread ctx\n");
+        return TM_ECODE_FAILED;
+    }
+
+    /* the rules were reloaded, move over between two vectors */
+    if (det_ctx->de_ctx_version != detect_engine_version)
+        DetectEngineThreadCtxSwitch(det_ctx);
+
+    DetectEngineCtx *de_ctx = det_ctx->de_ctx;
+    if (de_ctx == NULL) {
+        printf("ERROR: Detect has no detection engine ctx\n");
+        return TM_ECODE_FAILED;
+    }
+
+    for (start = 0; start < cnt; start += n) {
+        n = (cnt - start) > MPM_BATCH_SIZE ? MPM_BATCH_SIZE : (cnt - start);
+
+        DetectBatchSearch(de_ctx, det_ctx, &pkts[start], n, sghs, cnts);
+
+        for (i = 0; i < n; i++) {
+            Packet *p = pkts[start + i];
+            PatternMatcherQueue tmp;
+            int r;
+
+            DEBUG_VALIDATE_PACKET(p);
+
+            /* No need to perform any detection on this packet, if the the given flag is set.*/
+            if (p->flags & PKT_NOPACKET_INSPECTION)
+                continue;
+
+            /* SigMatchSignatures works on det_ctx->pmq */
+            tmp = det_ctx->pmq;
+            det_ctx->pmq = det_ctx->batch_pmq[i];
+            det_ctx->batch_pmq[i] = tmp;
+            det_ctx->batch_sgh = sghs[i];
+            det_ctx->batch_cnt = cnts[i];
+
+            r = SigMatchSignatures(tv, de_ctx, det_ctx, p);
+
+            det_ctx->batch_sgh = NULL;
+            tmp = det_ctx->pmq;
+            det_ctx->pmq = det_ctx->batch_pmq[i];
+            det_ctx->batch_pmq[i] = tmp;
+
+            if (r < 0)
+                return TM_ECODE_FAILED;
+        }
+    }
+
+    return TM_ECODE_OK;
+}
+
 TmEcode DetectThreadInit(ThreadVars *t, void *initdata, void **data)
 {
     return DetectEngineThreadCtxInit(t,initdata,data);
@@ -1345,6 +1559,13 @@ int SigAddressPrepareStage1(DetectEngineCtx *de_ctx) {
     for (tmp_s = de_ctx->sig_list; tmp_s != NULL; tmp_s = tmp_s->next) {
         de_ctx->sig_array[tmp_s->num] = tmp_s;
 
+        /* the addresses and ports as arrays, for SigMatchSignatures */
+        if (DetectAddressArrayBuild(&tmp_s->src, &tmp_s->src_array) < 0 ||
+            DetectAddressArrayBuild(&tmp_s->dst, &tmp_s->dst_array) < 0 ||
+            DetectPortArrayBuild(tmp_s->sp, &tmp_s->sp_array) < 0 ||
+            DetectPortArrayBuild(tmp_s->dp, &tmp_s->dp_array) < 0)
+            goto error;
+
         SCLogDebug("Signature %" PRIu32 ", internal id %" PRIu32 ", ptrs %p %p ", tmp_s->id, tmp_s->num, tmp_s, de_ctx->sig_array[tmp_s->num]);
 
         /* see if the sig is ip only */
@@ -2601,6 +2822,164 @@ static void DetectEngineBuildDecoderEventSgh(DetectEngineCtx *de_ctx) {
     SigGroupHeadBuildMatchArray(de_ctx, de_ctx->decoder_event_sgh, max_idx);
 }
 
+/**
+ *  \internal
+ *  \brief Finish a LoRaWAN sgh. If we already have one with the same sigs,
+ *         the new one is freed and the existing one is used instead.
+ *
+ *  \retval sgh the sgh to put in the lookup table
+ */
+static SigGroupHead *DetectEngineLorawanSghFinish(DetectEngineCtx *de_ctx,
+        SigGroupHead *sgh, uint32_t max_idx)
+{
+    SigGroupHead *lookup = SigGroupHeadHashLookup(de_ctx, sgh);
+    if (lookup != NULL) {
+        SigGroupHeadFree(sgh);
+        lookup->flags |= SIG_GROUP_HEAD_REFERENCED;
+        de_ctx->gh_reuse++;
+        return lookup;
+    }
+
+    SigGroupHeadSetSigCnt(sgh, max_idx);
+    SigGroupHeadBuildMatchArray(de_ctx, sgh, max_idx);
+
+    SigGroupHeadLoadContent(de_ctx, sgh);
+    if (sgh->init->content_size == 0) {
+        de_ctx->mpm_none++;
+    } else {
+        SigGroupHead *mpmsh = SigGroupHeadMpmHashLookup(de_ctx, sgh);
+        if (mpmsh == NULL) {
+            SigGroupHeadMpmHashAdd(de_ctx, sgh);
+            de_ctx->mpm_unique++;
+        } else {
+            sgh->mpm_ctx = mpmsh->mpm_ctx;
+            sgh->flags |= SIG_GROUP_HEAD_MPM_COPY;
+            SigGroupHeadClearContent(sgh);
+            de_ctx->mpm_reuse++;
+        }
+    }
+
+    if (PatternMatchPrepareGroup(de_ctx, sgh) < 0) {
+        SCLogError(SC_ERR_INITIALIZATION, "PatternMatchPrepareGroup failed");
+        goto error;
+    }
+    if (!(sgh->flags & SIG_GROUP_HEAD_MPM_COPY) && sgh->mpm_ctx != NULL) {
+        de_ctx->mpm_memory_size += sgh->mpm_ctx->memory_size;
+    }
+
+    SigGroupHead **array = SCRealloc(de_ctx->lorawan_sgh_array,
+            (de_ctx->lorawan_sgh_array_cnt + 1) * sizeof(SigGroupHead *));
+    if (array == NULL)
+        goto error;
+    de_ctx->lorawan_sgh_array = array;
+    de_ctx->lorawan_sgh_array[de_ctx->lorawan_sgh_array_cnt++] = sgh;
+
+    SigGroupHeadHashAdd(de_ctx, sgh);
+    SigGroupHeadStore(de_ctx, sgh);
+    de_ctx->gh_unique++;
+    return sgh;
+
+error:
+    SigGroupHeadFree(sgh);
+    return NULL;
+}
+
+/**
+ *  \internal
+ *  \brief Build the LoRaWAN lookup: a sgh per MType and FPort.
+ *
+ *  Like with ports, the sigs without a lorawan.fport setting form a
+ *  generic group per MType. Only the FPorts named by a sig get a group of
+ *  their own, on top of the generic sigs. All other FPorts, and frames
+ *  without FPort, use the generic group.
+ *
+ *  \retval 0 ok
+ *  \retval -1 error
+ */
+static int DetectEngineBuildLorawanSghs(DetectEngineCtx *de_ctx) {
+    SigGroupHead *generic[LORAWAN_MTYPE_MAX];
+    DetectEngineLookupLorawan *gh;
+    uint32_t max_idx = DetectEngineGetMaxSigId(de_ctx);
+    Signature *s;
+    int m, f;
+
+    memset(generic, 0x00, sizeof(generic));
+    memset(de_ctx->lorawan_gh, 0x00, sizeof(de_ctx->lorawan_gh));
+
+    for (s = de_ctx->sig_list; s != NULL; s = s->next) {
+        if (s->flags & SIG_FLAG_LORAWAN_FPORT)
+            continue;
+
+        for (m = 0; m < LORAWAN_MTYPE_MAX; m++) {
+            if ((s->flags & SIG_FLAG_LORAWAN_MTYPE) && !(s->lorawan_mtypes & (1 << m)))
+                continue;
+            if (SigGroupHeadAppendSig(de_ctx, &generic[m], s) < 0)
+                goto error;
+        }
+    }
+
+    for (s = de_ctx->sig_list; s != NULL; s = s->next) {
+        if (!(s->flags & SIG_FLAG_LORAWAN_FPORT))
+            continue;
+
+        for (m = 0; m < LORAWAN_MTYPE_MAX; m++) {
+            /* only data frames have a FPort */
+            if (!LORAWAN_MTYPE_IS_DATA(m))
+                continue;
+            if ((s->flags & SIG_FLAG_LORAWAN_MTYPE) && !(s->lorawan_mtypes & (1 << m)))
+                continue;
+
+            gh = &de_ctx->lorawan_gh[m];
+            for (f = 0; f < DETECT_LORAWAN_FPORT_NONE; f++) {
+                if (!(s->lorawan_fports[f / 8] & (1 << (f % 8))))
+                    continue;
+
+                if (gh->sgh[f] == NULL && generic[m] != NULL) {
+                    if (SigGroupHeadCopySigs(de_ctx, generic[m], &gh->sgh[f]) < 0)
+                        goto error;
+                }
+                if (SigGroupHeadAppendSig(de_ctx, &gh->sgh[f], s) < 0)
+                    goto error;
+            }
+        }
+    }
+
+    for (m = 0; m < LORAWAN_MTYPE_MAX; m++) {
+        gh = &de_ctx->lorawan_gh[m];
+
+        if (generic[m] != NULL) {
+            generic[m] = DetectEngineLorawanSghFinish(de_ctx, generic[m], max_idx);
+            if (generic[m] == NULL)
+                goto error;
+        }
+
+        for (f = 0; f < DETECT_LORAWAN_FPORT_SLOTS; f++) {
+            if (gh->sgh[f] == NULL) {
+                gh->sgh[f] = generic[m];
+            } else {
+                gh->sgh[f] = DetectEngineLorawanSghFinish(de_ctx, gh->sgh[f], max_idx);
+                if (gh->sgh[f] == NULL)
+                    goto error;
+            }
+        }
+    }
+
+    if (!(de_ctx->flags & DE_QUIET)) {
+        SCLogInfo("LoRaWAN signature groups: %" PRIu32 " unique",
+                de_ctx->lorawan_sgh_array_cnt);
+    }
+    return 0;
+
+error:
+    return -1;
+}
+
+/** \brief seconds between two gettimeofday() results */
+static double SigGroupBuildTimeDiff(struct timeval *start, struct timeval *end) {
+    return (double)(end->tv_sec - start->tv_sec) +
+        (double)(end->tv_usec - start->tv_usec) / 1000000.0;
+}
+
 int SigAddressPrepareStage3(DetectEngineCtx *de_ctx) {
     int r;
 
@@ -2670,6 +3049,22 @@ int SigAddressPrepareStage3(DetectEngineCtx *de_ctx) {
     /* prepare the decoder event sgh */
     DetectEngineBuildDecoderEventSgh(de_ctx);
 
+    /* LoRaWAN MType/FPort groups */
+    if (DetectEngineBuildLorawanSghs(de_ctx) < 0) {
+        goto error;
+    }
+
+    /* compile the mpm ctxs of all groups at once, see SigGroupBuild */
+    struct timeval mpm_start, mpm_end;
+    uint32_t mpm_cnt = de_ctx->mpm_prepare_cnt;
+    gettimeofday(&mpm_start, NULL);
+    uint16_t mpm_threads = PatternMatchPrepareRun(de_ctx);
+    gettimeofday(&mpm_end, NULL);
+    if (!(de_ctx->flags & DE_QUIET)) {
+        SCLogInfo("compiled %" PRIu32 " MPM ctxs on %" PRIu16 " threads in %.3fs",
+                mpm_cnt, mpm_threads, SigGroupBuildTimeDiff(&mpm_start, &mpm_end));
+    }
+
     /* cleanup group head (uri)content_array's */
     SigGroupHeadFreeMpmArrays(de_ctx);
     /* cleanup group head sig arrays */
@@ -2727,6 +3122,17 @@ int SigAddressCleanupStage1(DetectEngineCtx *de_ctx) {
 
     IPOnlyDeinit(de_ctx, &de_ctx->io_ctx);
 
+    uint32_t i;
+    for (i = 0; i < de_ctx->lorawan_sgh_array_cnt; i++) {
+        SigGroupHeadFree(de_ctx->lorawan_sgh_array[i]);
+    }
+    if (de_ctx->lorawan_sgh_array != NULL) {
+        SCFree(de_ctx->lorawan_sgh_array);
+        de_ctx->lorawan_sgh_array = NULL;
+    }
+    de_ctx->lorawan_sgh_array_cnt = 0;
+    memset(de_ctx->lorawan_gh, 0x00, sizeof(de_ctx->lorawan_gh));
+
     if (!(de_ctx->flags & DE_QUIET)) {
         SCLogInfo("cleaning up signature grouping structure... done");
     }
@@ -3124,17 +3530,44 @@ int SigAddressPrepareStage5(DetectEngineCtx *de_ctx) {
 /**
  * \brief Convert the signature list into the runtime match structure.
  *
+ *  The groups are built one after the other, as which sgh and mpm ctx
+ *  is reused depends on the order they are built in. Compiling the
+ *  mpm ctxs, most of the time with large rule sets, is left until all
+ *  groups are there and then done on detect-engine.build-threads
+ *  threads (PatternMatchPrepareRun()).
+ *
  * \param de_ctx Pointer to the Detection Engine Context whose Signatures have
  *               to be processed
  *
  * \retval 0 Always
  */
 int SigGroupBuild (DetectEngineCtx *de_ctx) {
+    struct timeval t[5];
+
+    de_ctx->mpm_prepare_defer = 1;
+
+    gettimeofday(&t[0], NULL);
     SigAddressPrepareStage1(de_ctx);
+    gettimeofday(&t[1], NULL);
     SigAddressPrepareStage2(de_ctx);
+    gettimeofday(&t[2], NULL);
 
     SigAddressPrepareStage3(de_ctx);
+    gettimeofday(&t[3], NULL);
+    /* in case stage 3 failed before it compiled the mpm ctxs */
+    PatternMatchPrepareRun(de_ctx);
     SigAddressPrepareStage4(de_ctx);
+    gettimeofday(&t[4], NULL);
+
+    if (!(de_ctx->flags & DE_QUIET)) {
+        SCLogInfo("signature group build took %.3fs: stage 1 %.3fs, stage 2 "
+                "%.3fs, stage 3 %.3fs (MPM compile included), stage 4 %.3fs",
+                SigGroupBuildTimeDiff(&t[0], &t[4]),
+                SigGroupBuildTimeDiff(&t[0], &t[1]),
+                SigGroupBuildTimeDiff(&t[1], &t[2]),
+                SigGroupBuildTimeDiff(&t[2], &t[3]),
+                SigGroupBuildTimeDiff(&t[3], &t[4]));
+    }
 
 //    SigAddressPrepareStage5(de_ctx);
     DbgPrintSearchStats();
@@ -3221,6 +3654,7 @@ void SigTableSetup(void) {
     DetectHttpClientBodyRegister();
     DetectHttpUriRegister();
     DetectAsn1Register();
+    DetectLorawanRegister();
 
     uint8_t i = 0;
     for (i = 0; i < DETECT_TBLSIZE; i++) {
@@ -3249,6 +3683,7 @@ void SigTableRegisterTests(void) {
 #include "flow-util.h"
 #include "stream-tcp-reassemble.h"
 #include "util-var-name.h"
+#include "util-mpm-teddy.h"
 
 static const char *dummy_conf_string =
     "%YAML 1.1\n"
@@ -3362,6 +3797,12 @@ static int SigTest01B3g (void) {
 static int SigTest01Wm (void) {
     return SigTest01Real(MPM_WUMANBER);
 }
+static int SigTest01Teddy (void) {
+    return SigTest01Real(MPM_TEDDY);
+}
+static int SigTest01Ac (void) {
+    return SigTest01Real(MPM_AC);
+}
 
 static int SigTest02Real (int mpm_type) {
     uint8_t *buf = (uint8_t *)
@@ -3388,6 +3829,12 @@ static int SigTest02B3g (void) {
 static int SigTest02Wm (void) {
     return SigTest02Real(MPM_WUMANBER);
 }
+static int SigTest02Teddy (void) {
+    return SigTest02Real(MPM_TEDDY);
+}
+static int SigTest02Ac (void) {
+    return SigTest02Real(MPM_AC);
+}
 
 
 static int SigTest03Real (int mpm_type) {
@@ -3452,6 +3899,12 @@ static int SigTest03B3g (void) {
 static int SigTest03Wm (void) {
     return SigTest03Real(MPM_WUMANBER);
 }
+static int SigTest03Teddy (void) {
+    return SigTest03Real(MPM_TEDDY);
+}
+static int SigTest03Ac (void) {
+    return SigTest03Real(MPM_AC);
+}
 
 
 static int SigTest04Real (int mpm_type) {
@@ -3517,6 +3970,12 @@ static int SigTest04B3g (void) {
 static int SigTest04Wm (void) {
     return SigTest04Real(MPM_WUMANBER);
 }
+static int SigTest04Teddy (void) {
+    return SigTest04Real(MPM_TEDDY);
+}
+static int SigTest04Ac (void) {
+    return SigTest04Real(MPM_AC);
+}
 
 
 static int SigTest05Real (int mpm_type) {
@@ -3583,6 +4042,12 @@ static int SigTest05B3g (void) {
 static int SigTest05Wm (void) {
     return SigTest05Real(MPM_WUMANBER);
 }
+static int SigTest05Teddy (void) {
+    return SigTest05Real(MPM_TEDDY);
+}
+static int SigTest05Ac (void) {
+    return SigTest05Real(MPM_AC);
+}
 
 
 static int SigTest06Real (int mpm_type) {
@@ -3682,6 +4147,12 @@ static int SigTest06B3g (void) {
 static int SigTest06Wm (void) {
     return SigTest06Real(MPM_WUMANBER);
 }
+static int SigTest06Teddy (void) {
+    return SigTest06Real(MPM_TEDDY);
+}
+static int SigTest06Ac (void) {
+    return SigTest06Real(MPM_AC);
+}
 
 
 static int SigTest07Real (int mpm_type) {
@@ -3781,6 +4252,12 @@ static int SigTest07B3g (void) {
 static int SigTest07Wm (void) {
     return SigTest07Real(MPM_WUMANBER);
 }
+static int SigTest07Teddy (void) {
+    return SigTest07Real(MPM_TEDDY);
+}
+static int SigTest07Ac (void) {
+    return SigTest07Real(MPM_AC);
+}
 
 
 static int SigTest08Real (int mpm_type) {
@@ -3882,6 +4359,12 @@ static int SigTest08B3g (void) {
 static int SigTest08Wm (void) {
     return SigTest08Real(MPM_WUMANBER);
 }
+static int SigTest08Teddy (void) {
+    return SigTest08Real(MPM_TEDDY);
+}
+static int SigTest08Ac (void) {
+    return SigTest08Real(MPM_AC);
+}
 
 
 static int SigTest09Real (int mpm_type) {
@@ -3979,6 +4462,12 @@ static int SigTest09B3g (void) {
 static int SigTest09Wm (void) {
     return SigTest09Real(MPM_WUMANBER);
 }
+static int SigTest09Teddy (void) {
+    return SigTest09Real(MPM_TEDDY);
+}
+static int SigTest09Ac (void) {
+    return SigTest09Real(MPM_AC);
+}
 
 
 static int SigTest10Real (int mpm_type) {
@@ -4071,6 +4560,12 @@ static int SigTest10B3g (void) {
 static int SigTest10Wm (void) {
     return SigTest10Real(MPM_WUMANBER);
 }
+static int SigTest10Teddy (void) {
+    return SigTest10Real(MPM_TEDDY);
+}
+static int SigTest10Ac (void) {
+    return SigTest10Real(MPM_AC);
+}
 
 
 static int SigTest11Real (int mpm_type) {
@@ -4149,6 +4644,12 @@ static int SigTest11B3g (void) {
 static int SigTest11Wm (void) {
     return SigTest11Real(MPM_WUMANBER);
 }
+static int SigTest11Teddy (void) {
+    return SigTest11Real(MPM_TEDDY);
+}
+static int SigTest11Ac (void) {
+    return SigTest11Real(MPM_AC);
+}
 
 
 static int SigTest12Real (int mpm_type) {
@@ -4217,6 +4718,12 @@ static int SigTest12B3g (void) {
 static int SigTest12Wm (void) {
     return SigTest12Real(MPM_WUMANBER);
 }
+static int SigTest12Teddy (void) {
+    return SigTest12Real(MPM_TEDDY);
+}
+static int SigTest12Ac (void) {
+    return SigTest12Real(MPM_AC);
+}
 
 
 static int SigTest13Real (int mpm_type) {
@@ -4283,6 +4790,12 @@ static int SigTest13B3g (void) {
 static int SigTest13Wm (void) {
     return SigTest13Real(MPM_WUMANBER);
 }
+static int SigTest13Teddy (void) {
+    return SigTest13Real(MPM_TEDDY);
+}
+static int SigTest13Ac (void) {
+    return SigTest13Real(MPM_AC);
+}
 
 
 static int SigTest14Real (int mpm_type) {
@@ -4343,6 +4856,12 @@ static int SigTest14B3g (void) {
 static int SigTest14Wm (void) {
     return SigTest14Real(MPM_WUMANBER);
 }
+static int SigTest14Teddy (void) {
+    return SigTest14Real(MPM_TEDDY);
+}
+static int SigTest14Ac (void) {
+    return SigTest14Real(MPM_AC);
+}
 
 
 static int SigTest15Real (int mpm_type) {
@@ -4409,6 +4928,12 @@ static int SigTest15B3g (void) {
 static int SigTest15Wm (void) {
     return SigTest15Real(MPM_WUMANBER);
 }
+static int SigTest15Teddy (void) {
+    return SigTest15Real(MPM_TEDDY);
+}
+static int SigTest15Ac (void) {
+    return SigTest15Real(MPM_AC);
+}
 
 
 static int SigTest16Real (int mpm_type) {
@@ -4473,6 +4998,12 @@ static int SigTest16B3g (void) {
 static int SigTest16Wm (void) {
     return SigTest16Real(MPM_WUMANBER);
 }
+static int SigTest16Teddy (void) {
+    return SigTest16Real(MPM_TEDDY);
+}
+static int SigTest16Ac (void) {
+    return SigTest16Real(MPM_AC);
+}
 
 
 static int SigTest17Real (int mpm_type) {
@@ -4555,6 +5086,12 @@ static int SigTest17B3g (void) {
 static int SigTest17Wm (void) {
     return SigTest17Real(MPM_WUMANBER);
 }
+static int SigTest17Teddy (void) {
+    return SigTest17Real(MPM_TEDDY);
+}
+static int SigTest17Ac (void) {
+    return SigTest17Real(MPM_AC);
+}
 
 
 static int SigTest18Real (int mpm_type) {
@@ -4616,6 +5153,12 @@ static int SigTest18B3g (void) {
 static int SigTest18Wm (void) {
     return SigTest18Real(MPM_WUMANBER);
 }
+static int SigTest18Teddy (void) {
+    return SigTest18Real(MPM_TEDDY);
+}
+static int SigTest18Ac (void) {
+    return SigTest18Real(MPM_AC);
+}
 
 
 int SigTest19Real (int mpm_type) {
@@ -4684,6 +5227,12 @@ static int SigTest19B3g (void) {
 static int SigTest19Wm (void) {
     return SigTest19Real(MPM_WUMANBER);
 }
+static int SigTest19Teddy (void) {
+    return SigTest19Real(MPM_TEDDY);
+}
+static int SigTest19Ac (void) {
+    return SigTest19Real(MPM_AC);
+}
 
 static int SigTest20Real (int mpm_type) {
     uint8_t *buf = (uint8_t *)
@@ -4755,6 +5304,12 @@ static int SigTest20B3g (void) {
 static int SigTest20Wm (void) {
     return SigTest20Real(MPM_WUMANBER);
 }
+static int SigTest20Teddy (void) {
+    return SigTest20Real(MPM_TEDDY);
+}
+static int SigTest20Ac (void) {
+    return SigTest20Real(MPM_AC);
+}
 
 
 static int SigTest21Real (int mpm_type) {
@@ -4846,6 +5401,12 @@ static int SigTest21B3g (void) {
 static int SigTest21Wm (void) {
     return SigTest21Real(MPM_WUMANBER);
 }
+static int SigTest21Teddy (void) {
+    return SigTest21Real(MPM_TEDDY);
+}
+static int SigTest21Ac (void) {
+    return SigTest21Real(MPM_AC);
+}
 
 
 static int SigTest22Real (int mpm_type) {
@@ -4939,6 +5500,12 @@ static int SigTest22B3g (void) {
 static int SigTest22Wm (void) {
     return SigTest22Real(MPM_WUMANBER);
 }
+static int SigTest22Teddy (void) {
+    return SigTest22Real(MPM_TEDDY);
+}
+static int SigTest22Ac (void) {
+    return SigTest22Real(MPM_AC);
+}
 
 static int SigTest23Real (int mpm_type) {
     ThreadVars th_v;
@@ -5031,6 +5598,12 @@ static int SigTest23B3g (void) {
 static int SigTest23Wm (void) {
     return SigTest23Real(MPM_WUMANBER);
 }
+static int SigTest23Teddy (void) {
+    return SigTest23Real(MPM_TEDDY);
+}
+static int SigTest23Ac (void) {
+    return SigTest23Real(MPM_AC);
+}
 
 int SigTest24IPV4Keyword(void)
 {
@@ -6712,6 +7285,12 @@ static int SigTest38B3g (void) {
 static int SigTest38Wm (void) {
     return SigTest38Real(MPM_WUMANBER);
 }
+static int SigTest38Teddy (void) {
+    return SigTest38Real(MPM_TEDDY);
+}
+static int SigTest38Ac (void) {
+    return SigTest38Real(MPM_AC);
+}
 
 int SigTest39Real(int mpm_type)
 {
@@ -6844,6 +7423,12 @@ static int SigTest39B3g (void) {
 static int SigTest39Wm (void) {
     return SigTest39Real(MPM_WUMANBER);
 }
+static int SigTest39Teddy (void) {
+    return SigTest39Real(MPM_TEDDY);
+}
+static int SigTest39Ac (void) {
+    return SigTest39Real(MPM_AC);
+}
 
 
 
@@ -7095,6 +7680,12 @@ static int SigTest36ContentAndIsdataatKeywords01B3g (void) {
 static int SigTest36ContentAndIsdataatKeywords01Wm (void) {
     return SigTest36ContentAndIsdataatKeywords01Real(MPM_WUMANBER);
 }
+static int SigTest36ContentAndIsdataatKeywords01Teddy (void) {
+    return SigTest36ContentAndIsdataatKeywords01Real(MPM_TEDDY);
+}
+static int SigTest36ContentAndIsdataatKeywords01Ac (void) {
+    return SigTest36ContentAndIsdataatKeywords01Real(MPM_AC);
+}
 
 static int SigTest37ContentAndIsdataatKeywords02B2g (void) {
     return SigTest37ContentAndIsdataatKeywords02Real(MPM_B2G);
@@ -7105,6 +7696,12 @@ static int SigTest37ContentAndIsdataatKeywords02B3g (void) {
 static int SigTest37ContentAndIsdataatKeywords02Wm (void) {
     return SigTest37ContentAndIsdataatKeywords02Real(MPM_WUMANBER);
 }
+static int SigTest37ContentAndIsdataatKeywords02Teddy (void) {
+    return SigTest37ContentAndIsdataatKeywords02Real(MPM_TEDDY);
+}
+static int SigTest37ContentAndIsdataatKeywords02Ac (void) {
+    return SigTest37ContentAndIsdataatKeywords02Real(MPM_AC);
+}
 
 
 /**
@@ -8191,6 +8788,12 @@ static int SigTestContent01B3g (void) {
 static int SigTestContent01Wm (void) {
     return SigTestContent01Real(MPM_WUMANBER);
 }
+static int SigTestContent01Teddy (void) {
+    return SigTestContent01Real(MPM_TEDDY);
+}
+static int SigTestContent01Ac (void) {
+    return SigTestContent01Real(MPM_AC);
+}
 
 static int SigTestContent02Real (int mpm_type) {
     uint8_t *buf = (uint8_t *)"01234567890123456789012345678901";
@@ -8258,6 +8861,12 @@ static int SigTestContent02B3g (void) {
 static int SigTestContent02Wm (void) {
     return SigTestContent02Real(MPM_WUMANBER);
 }
+static int SigTestContent02Teddy (void) {
+    return SigTestContent02Real(MPM_TEDDY);
+}
+static int SigTestContent02Ac (void) {
+    return SigTestContent02Real(MPM_AC);
+}
 
 static int SigTestContent03Real (int mpm_type) {
     uint8_t *buf = (uint8_t *)"01234567890123456789012345678901abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
@@ -8315,6 +8924,12 @@ static int SigTestContent03B3g (void) {
 static int SigTestContent03Wm (void) {
     return SigTestContent03Real(MPM_WUMANBER);
 }
+static int SigTestContent03Teddy (void) {
+    return SigTestContent03Real(MPM_TEDDY);
+}
+static int SigTestContent03Ac (void) {
+    return SigTestContent03Real(MPM_AC);
+}
 
 static int SigTestContent04Real (int mpm_type) {
     uint8_t *buf = (uint8_t *)"01234567890123456789012345678901abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
@@ -8372,6 +8987,12 @@ static int SigTestContent04B3g (void) {
 static int SigTestContent04Wm (void) {
     return SigTestContent04Real(MPM_WUMANBER);
 }
+static int SigTestContent04Teddy (void) {
+    return SigTestContent04Real(MPM_TEDDY);
+}
+static int SigTestContent04Ac (void) {
+    return SigTestContent04Real(MPM_AC);
+}
 
 /** \test sigs with patterns at the limit of the pm's size limit */
 static int SigTestContent05Real (int mpm_type) {
@@ -8447,6 +9068,12 @@ static int SigTestContent05B3g (void) {
 static int SigTestContent05Wm (void) {
     return SigTestContent05Real(MPM_WUMANBER);
 }
+static int SigTestContent05Teddy (void) {
+    return SigTestContent05Real(MPM_TEDDY);
+}
+static int SigTestContent05Ac (void) {
+    return SigTestContent05Real(MPM_AC);
+}
 
 static int SigTestContent06Real (int mpm_type) {
     uint8_t *buf = (uint8_t *)"01234567890123456789012345678901abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
@@ -8518,6 +9145,12 @@ static int SigTestContent06B3g (void) {
 static int SigTestContent06Wm (void) {
     return SigTestContent06Real(MPM_WUMANBER);
 }
+static int SigTestContent06Teddy (void) {
+    return SigTestContent06Real(MPM_TEDDY);
+}
+static int SigTestContent06Ac (void) {
+    return SigTestContent06Real(MPM_AC);
+}
 
 static int SigTestWithinReal01 (int mpm_type) {
     DecodeThreadVars dtv;
@@ -8718,6 +9351,12 @@ static int SigTestWithinReal01B3g (void) {
 static int SigTestWithinReal01Wm (void) {
     return SigTestWithinReal01(MPM_WUMANBER);
 }
+static int SigTestWithinReal01Teddy (void) {
+    return SigTestWithinReal01(MPM_TEDDY);
+}
+static int SigTestWithinReal01Ac (void) {
+    return SigTestWithinReal01(MPM_AC);
+}
 
 static int SigTestDepthOffset01Real (int mpm_type) {
     uint8_t *buf = (uint8_t *)"01234567890123456789012345678901abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
@@ -8775,6 +9414,12 @@ static int SigTestDepthOffset01B3g (void) {
 static int SigTestDepthOffset01Wm (void) {
     return SigTestDepthOffset01Real(MPM_WUMANBER);
 }
+static int SigTestDepthOffset01Teddy (void) {
+    return SigTestDepthOffset01Real(MPM_TEDDY);
+}
+static int SigTestDepthOffset01Ac (void) {
+    return SigTestDepthOffset01Real(MPM_AC);
+}
 
 static int SigTestDetectAlertCounter(void)
 {
@@ -8833,104 +9478,334 @@ end:
     return result;
 }
 
+/** \test a vector of packets, their payloads searched together */
+static int SigTestDetectBatch01(void)
+{
+    Packet *p[4];
+    ThreadVars tv;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    int result = 0;
+
+    memset(&tv, 0, sizeof(tv));
+    p[0] = UTHBuildPacket((uint8_t *)"boo", 3, IPPROTO_TCP);
+    p[1] = UTHBuildPacket((uint8_t *)"roo", 3, IPPROTO_TCP);
+    p[2] = UTHBuildPacket((uint8_t *)"laboosa", 7, IPPROTO_TCP);
+    p[3] = UTHBuildPacket((uint8_t *)"xbooy", 5, IPPROTO_UDP);
+
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL) {
+        goto end;
+    }
+
+    de_ctx->mpm_matcher = MPM_AC;
+    de_ctx->flags |= DE_QUIET;
+
+    de_ctx->sig_list = SigInit(de_ctx, "alert tcp any any -> any any "
+            "(content:\"boo\"; sid:1;)");
+    if (de_ctx->sig_list == NULL) {
+        goto end;
+    }
+    de_ctx->sig_list->next = SigInit(de_ctx, "alert tcp any any -> any any "
+            "(content:\"laboo\"; sid:2;)");
+    if (de_ctx->sig_list->next == NULL) {
+        goto end;
+    }
+    de_ctx->sig_list->next->next = SigInit(de_ctx, "alert udp any any -> any any "
+            "(content:\"boo\"; sid:3;)");
+    if (de_ctx->sig_list->next->next == NULL) {
+        goto end;
+    }
+
+    SigGroupBuild(de_ctx);
+    tv.name = "detect_test";
+    DetectEngineThreadCtxInit(&tv, de_ctx, (void *)&det_ctx);
+
+    if (DetectBatch(&tv, p, 4, det_ctx, NULL, NULL) != TM_ECODE_OK) {
+        goto end;
+    }
+
+    result = PacketAlertCheck(p[0], 1) && !PacketAlertCheck(p[0], 2) &&
+        !PacketAlertCheck(p[1], 1) && !PacketAlertCheck(p[1], 2) &&
+        PacketAlertCheck(p[2], 1) && PacketAlertCheck(p[2], 2) &&
+        PacketAlertCheck(p[3], 3) && !PacketAlertCheck(p[3], 1);
+
+end:
+    SigGroupCleanup(de_ctx);
+    SigCleanSignatures(de_ctx);
+
+    DetectEngineThreadCtxDeinit(&tv, (void *)det_ctx);
+    DetectEngineCtxFree(de_ctx);
+    UTHFreePackets(p, 4);
+    return result;
+}
+
+#define SIG_TEST_BUILD_PRINT_SIZE 65536
+
+/**
+ * \brief build a fixed rule set with teddy on threads build threads and
+ *        write what the mpm ctxs were compiled to into print.
+ *
+ * \retval cnt values in print, -1 on error
+ */
+static int SigTestBuildThreadsPrint(uint16_t threads, uint32_t *print)
+{
+    DetectEngineCtx *de_ctx = NULL;
+    char sig[128];
+    int cnt = 0;
+    int result = -1;
+    uint32_t i, b, x;
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+
+    de_ctx->mpm_matcher = MPM_TEDDY;
+    de_ctx->flags |= DE_QUIET;
+    de_ctx->build_threads = threads;
+
+    /* patterns sharing their first bytes, of different lengths and case,
+     * over a few ports so there are several ctxs to compile */
+    for (i = 0; i < 96; i++) {
+        snprintf(sig, sizeof(sig), "alert tcp any any -> any %" PRIu32 " "
+                "(content:\"ab%" PRIu32 "%.*s\"; %ssid:%" PRIu32 ";)",
+                80 + (i % 8), i / 3, (int)(i % 5), "xyzzy",
+                (i % 4) ? "" : "nocase; ", i + 1);
+        if (DetectEngineAppendSig(de_ctx, sig) == NULL)
+            goto end;
+    }
+
+    SigGroupBuild(de_ctx);
+    if (de_ctx->mpm_prepare_cnt < 4)
+        goto end;
+
+    for (i = 0; i < de_ctx->mpm_prepare_cnt; i++) {
+        MpmCtx *mpm_ctx = de_ctx->mpm_prepare_array[i].mpm_ctx;
+
+        if (cnt + 4 > SIG_TEST_BUILD_PRINT_SIZE)
+            goto end;
+        print[cnt++] = mpm_ctx->mpm_type;
+        print[cnt++] = mpm_ctx->pattern_cnt;
+        print[cnt++] = mpm_ctx->memory_cnt;
+        print[cnt++] = mpm_ctx->memory_size;
+
+        if (mpm_ctx->mpm_type != MPM_TEDDY)
+            continue;
+
+        TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+        if (cnt + 2 + 2 * TEDDY_MAX_M * 16 + TEDDY_BUCKETS > SIG_TEST_BUILD_PRINT_SIZE)
+            goto end;
+        print[cnt++] = ctx->search;
+        print[cnt++] = ctx->m;
+        for (b = 0; b < TEDDY_MAX_M; b++) {
+            for (x = 0; x < 16; x++) {
+                print[cnt++] = ctx->lo[b][x];
+                print[cnt++] = ctx->hi[b][x];
+            }
+        }
+        for (b = 0; b < TEDDY_BUCKETS; b++) {
+            print[cnt++] = ctx->bucket_cnt[b];
+            if (cnt + ctx->bucket_cnt[b] > SIG_TEST_BUILD_PRINT_SIZE)
+                goto end;
+            for (x = 0; x < ctx->bucket_cnt[b]; x++) {
+                print[cnt++] = ctx->bucket[b][x]->id;
+            }
+        }
+    }
+    result = cnt;
+
+end:
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        SigCleanSignatures(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    return result;
+}
+
+/** \test the mpm ctxs compiled with build-threads 0 (one per cpu) and 4
+ *        are the same as the ones compiled on one thread */
+static int SigTestBuildThreads01(void)
+{
+    uint16_t threads[2] = { 0, 4 };
+    uint32_t *ref = NULL, *print = NULL;
+    int ref_cnt, cnt, t;
+    int result = 0;
+
+    ref = SCMalloc(SIG_TEST_BUILD_PRINT_SIZE * sizeof(uint32_t));
+    print = SCMalloc(SIG_TEST_BUILD_PRINT_SIZE * sizeof(uint32_t));
+    if (ref == NULL || print == NULL)
+        goto end;
+
+    ref_cnt = SigTestBuildThreadsPrint(1, ref);
+    if (ref_cnt <= 0)
+        goto end;
+
+    for (t = 0; t < 2; t++) {
+        cnt = SigTestBuildThreadsPrint(threads[t], print);
+        if (cnt != ref_cnt) {
+            printf("build-threads %" PRIu16 ": cnt %d != %d: ", threads[t],
+                    cnt, ref_cnt);
+            goto end;
+        }
+        if (memcmp(ref, print, cnt * sizeof(uint32_t)) != 0) {
+            printf("build-threads %" PRIu16 ": ctxs differ: ", threads[t]);
+            goto end;
+        }
+    }
+    result = 1;
+end:
+    if (ref != NULL)
+        SCFree(ref);
+    if (print != NULL)
+        SCFree(print);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void SigRegisterTests(void) {
 #ifdef UNITTESTS
     SigParseRegisterTests();
     IPOnlyRegisterTests();
+    DetectEngineCacheRegisterTests();
 
     UtRegisterTest("SigTest01B2g -- HTTP URI cap", SigTest01B2g, 1);
     UtRegisterTest("SigTest01B3g -- HTTP URI cap", SigTest01B3g, 1);
     UtRegisterTest("SigTest01Wm -- HTTP URI cap", SigTest01Wm, 1);
+    UtRegisterTest("SigTest01Teddy -- HTTP URI cap", SigTest01Teddy, 1);
+    UtRegisterTest("SigTest01Ac -- HTTP URI cap", SigTest01Ac, 1);
 
     UtRegisterTest("SigTest02B2g -- Offset/Depth match", SigTest02B2g, 1);
     UtRegisterTest("SigTest02B3g -- Offset/Depth match", SigTest02B3g, 1);
     UtRegisterTest("SigTest02Wm -- Offset/Depth match", SigTest02Wm, 1);
+    UtRegisterTest("SigTest02Teddy -- Offset/Depth match", SigTest02Teddy, 1);
+    UtRegisterTest("SigTest02Ac -- Offset/Depth match", SigTest02Ac, 1);
 
     UtRegisterTest("SigTest03B2g -- offset/depth mismatch", SigTest03B2g, 1);
     UtRegisterTest("SigTest03B3g -- offset/depth mismatch", SigTest03B3g, 1);
     UtRegisterTest("SigTest03Wm -- offset/depth mismatch", SigTest03Wm, 1);
+    UtRegisterTest("SigTest03Teddy -- offset/depth mismatch", SigTest03Teddy, 1);
+    UtRegisterTest("SigTest03Ac -- offset/depth mismatch", SigTest03Ac, 1);
 
     UtRegisterTest("SigTest04B2g -- distance/within match", SigTest04B2g, 1);
     UtRegisterTest("SigTest04B3g -- distance/within match", SigTest04B3g, 1);
     UtRegisterTest("SigTest04Wm -- distance/within match", SigTest04Wm, 1);
+    UtRegisterTest("SigTest04Teddy -- distance/within match", SigTest04Teddy, 1);
+    UtRegisterTest("SigTest04Ac -- distance/within match", SigTest04Ac, 1);
 
     UtRegisterTest("SigTest05B2g -- distance/within mismatch", SigTest05B2g, 1);
     UtRegisterTest("SigTest05B3g -- distance/within mismatch", SigTest05B3g, 1);
     UtRegisterTest("SigTest05Wm -- distance/within mismatch", SigTest05Wm, 1);
+    UtRegisterTest("SigTest05Teddy -- distance/within mismatch", SigTest05Teddy, 1);
+    UtRegisterTest("SigTest05Ac -- distance/within mismatch", SigTest05Ac, 1);
 
     UtRegisterTest("SigTest06B2g -- uricontent HTTP/1.1 match test", SigTest06B2g, 1);
     UtRegisterTest("SigTest06B3g -- uricontent HTTP/1.1 match test", SigTest06B3g, 1);
     UtRegisterTest("SigTest06wm -- uricontent HTTP/1.1 match test", SigTest06Wm, 1);
+    UtRegisterTest("SigTest06Teddy -- uricontent HTTP/1.1 match test", SigTest06Teddy, 1);
+    UtRegisterTest("SigTest06Ac -- uricontent HTTP/1.1 match test", SigTest06Ac, 1);
 
     UtRegisterTest("SigTest07B2g -- uricontent HTTP/1.1 mismatch test", SigTest07B2g, 1);
     UtRegisterTest("SigTest07B3g -- uricontent HTTP/1.1 mismatch test", SigTest07B3g, 1);
     UtRegisterTest("SigTest07Wm -- uricontent HTTP/1.1 mismatch test", SigTest07Wm, 1);
+    UtRegisterTest("SigTest07Teddy -- uricontent HTTP/1.1 mismatch test", SigTest07Teddy, 1);
+    UtRegisterTest("SigTest07Ac -- uricontent HTTP/1.1 mismatch test", SigTest07Ac, 1);
 
     UtRegisterTest("SigTest08B2g -- uricontent HTTP/1.0 match test", SigTest08B2g, 1);
     UtRegisterTest("SigTest08B3g -- uricontent HTTP/1.0 match test", SigTest08B3g, 1);
     UtRegisterTest("SigTest08Wm -- uricontent HTTP/1.0 match test", SigTest08Wm, 1);
+    UtRegisterTest("SigTest08Teddy -- uricontent HTTP/1.0 match test", SigTest08Teddy, 1);
+    UtRegisterTest("SigTest08Ac -- uricontent HTTP/1.0 match test", SigTest08Ac, 1);
 
     UtRegisterTest("SigTest09B2g -- uricontent HTTP/1.0 mismatch test", SigTest09B2g, 1);
     UtRegisterTest("SigTest09B3g -- uricontent HTTP/1.0 mismatch test", SigTest09B3g, 1);
     UtRegisterTest("SigTest09Wm -- uricontent HTTP/1.0 mismatch test", SigTest09Wm, 1);
+    UtRegisterTest("SigTest09Teddy -- uricontent HTTP/1.0 mismatch test", SigTest09Teddy, 1);
+    UtRegisterTest("SigTest09Ac -- uricontent HTTP/1.0 mismatch test", SigTest09Ac, 1);
 
     UtRegisterTest("SigTest10B2g -- long content match, longer than pkt", SigTest10B2g, 1);
     UtRegisterTest("SigTest10B3g -- long content match, longer than pkt", SigTest10B3g, 1);
     UtRegisterTest("SigTest10Wm -- long content match, longer than pkt", SigTest10Wm, 1);
+    UtRegisterTest("SigTest10Teddy -- long content match, longer than pkt", SigTest10Teddy, 1);
+    UtRegisterTest("SigTest10Ac -- long content match, longer than pkt", SigTest10Ac, 1);
 
     UtRegisterTest("SigTest11B2g -- mpm searching", SigTest11B2g, 1);
     UtRegisterTest("SigTest11B3g -- mpm searching", SigTest11B3g, 1);
     UtRegisterTest("SigTest11Wm -- mpm searching", SigTest11Wm, 1);
+    UtRegisterTest("SigTest11Teddy -- mpm searching", SigTest11Teddy, 1);
+    UtRegisterTest("SigTest11Ac -- mpm searching", SigTest11Ac, 1);
 
     UtRegisterTest("SigTest12B2g -- content order matching, normal", SigTest12B2g, 1);
     UtRegisterTest("SigTest12B3g -- content order matching, normal", SigTest12B3g, 1);
     UtRegisterTest("SigTest12Wm -- content order matching, normal", SigTest12Wm, 1);
+    UtRegisterTest("SigTest12Teddy -- content order matching, normal", SigTest12Teddy, 1);
+    UtRegisterTest("SigTest12Ac -- content order matching, normal", SigTest12Ac, 1);
 
     UtRegisterTest("SigTest13B2g -- content order matching, diff order", SigTest13B2g, 1);
     UtRegisterTest("SigTest13B3g -- content order matching, diff order", SigTest13B3g, 1);
     UtRegisterTest("SigTest13Wm -- content order matching, diff order", SigTest13Wm, 1);
+    UtRegisterTest("SigTest13Teddy -- content order matching, diff order", SigTest13Teddy, 1);
+    UtRegisterTest("SigTest13Ac -- content order matching, diff order", SigTest13Ac, 1);
 
     UtRegisterTest("SigTest14B2g -- content order matching, distance 0", SigTest14B2g, 1);
     UtRegisterTest("SigTest14B3g -- content order matching, distance 0", SigTest14B3g, 1);
     UtRegisterTest("SigTest14Wm -- content order matching, distance 0", SigTest14Wm, 1);
+    UtRegisterTest("SigTest14Teddy -- content order matching, distance 0", SigTest14Teddy, 1);
+    UtRegisterTest("SigTest14Ac -- content order matching, distance 0", SigTest14Ac, 1);
 
     UtRegisterTest("SigTest15B2g -- port negation sig (no match)", SigTest15B2g, 1);
     UtRegisterTest("SigTest15B3g -- port negation sig (no match)", SigTest15B3g, 1);
     UtRegisterTest("SigTest15Wm -- port negation sig (no match)", SigTest15Wm, 1);
+    UtRegisterTest("SigTest15Teddy -- port negation sig (no match)", SigTest15Teddy, 1);
+    UtRegisterTest("SigTest15Ac -- port negation sig (no match)", SigTest15Ac, 1);
 
     UtRegisterTest("SigTest16B2g -- port negation sig (match)", SigTest16B2g, 1);
     UtRegisterTest("SigTest16B3g -- port negation sig (match)", SigTest16B3g, 1);
     UtRegisterTest("SigTest16Wm -- port negation sig (match)", SigTest16Wm, 1);
+    UtRegisterTest("SigTest16Teddy -- port negation sig (match)", SigTest16Teddy, 1);
+    UtRegisterTest("SigTest16Ac -- port negation sig (match)", SigTest16Ac, 1);
 
     UtRegisterTest("SigTest17B2g -- HTTP Host Pkt var capture", SigTest17B2g, 1);
     UtRegisterTest("SigTest17B3g -- HTTP Host Pkt var capture", SigTest17B3g, 1);
     UtRegisterTest("SigTest17Wm -- HTTP Host Pkt var capture", SigTest17Wm, 1);
+    UtRegisterTest("SigTest17Teddy -- HTTP Host Pkt var capture", SigTest17Teddy, 1);
+    UtRegisterTest("SigTest17Ac -- HTTP Host Pkt var capture", SigTest17Ac, 1);
 
     UtRegisterTest("SigTest18B2g -- Ftp negation sig test", SigTest18B2g, 1);
     UtRegisterTest("SigTest18B3g -- Ftp negation sig test", SigTest18B3g, 1);
     UtRegisterTest("SigTest18Wm -- Ftp negation sig test", SigTest18Wm, 1);
+    UtRegisterTest("SigTest18Teddy -- Ftp negation sig test", SigTest18Teddy, 1);
+    UtRegisterTest("SigTest18Ac -- Ftp negation sig test", SigTest18Ac, 1);
 
     UtRegisterTest("SigTest19B2g -- IP-ONLY test (1)", SigTest19B2g, 1);
     UtRegisterTest("SigTest19B3g -- IP-ONLY test (1)", SigTest19B3g, 1);
     UtRegisterTest("SigTest19Wm -- IP-ONLY test (1)", SigTest19Wm, 1);
+    UtRegisterTest("SigTest19Teddy -- IP-ONLY test (1)", SigTest19Teddy, 1);
+    UtRegisterTest("SigTest19Ac -- IP-ONLY test (1)", SigTest19Ac, 1);
 
     UtRegisterTest("SigTest20B2g -- IP-ONLY test (2)", SigTest20B2g, 1);
     UtRegisterTest("SigTest20B3g -- IP-ONLY test (2)", SigTest20B3g, 1);
     UtRegisterTest("SigTest20Wm -- IP-ONLY test (2)", SigTest20Wm, 1);
+    UtRegisterTest("SigTest20Teddy -- IP-ONLY test (2)", SigTest20Teddy, 1);
+    UtRegisterTest("SigTest20Ac -- IP-ONLY test (2)", SigTest20Ac, 1);
 
     UtRegisterTest("SigTest21B2g -- FLOWBIT test (1)", SigTest21B2g, 1);
     UtRegisterTest("SigTest21B3g -- FLOWBIT test (1)", SigTest21B3g, 1);
     UtRegisterTest("SigTest21Wm -- FLOWBIT test (1)", SigTest21Wm, 1);
+    UtRegisterTest("SigTest21Teddy -- FLOWBIT test (1)", SigTest21Teddy, 1);
+    UtRegisterTest("SigTest21Ac -- FLOWBIT test (1)", SigTest21Ac, 1);
 
     UtRegisterTest("SigTest22B2g -- FLOWBIT test (2)", SigTest22B2g, 1);
     UtRegisterTest("SigTest22B3g -- FLOWBIT test (2)", SigTest22B3g, 1);
     UtRegisterTest("SigTest22Wm -- FLOWBIT test (2)", SigTest22Wm, 1);
+    UtRegisterTest("SigTest22Teddy -- FLOWBIT test (2)", SigTest22Teddy, 1);
+    UtRegisterTest("SigTest22Ac -- FLOWBIT test (2)", SigTest22Ac, 1);
 
     UtRegisterTest("SigTest23B2g -- FLOWBIT test (3)", SigTest23B2g, 1);
     UtRegisterTest("SigTest23B3g -- FLOWBIT test (3)", SigTest23B3g, 1);
     UtRegisterTest("SigTest23Wm -- FLOWBIT test (3)", SigTest23Wm, 1);
+    UtRegisterTest("SigTest23Teddy -- FLOWBIT test (3)", SigTest23Teddy, 1);
+    UtRegisterTest("SigTest23Ac -- FLOWBIT test (3)", SigTest23Ac, 1);
 
     UtRegisterTest("SigTest24IPV4Keyword", SigTest24IPV4Keyword, 1);
     UtRegisterTest("SigTest25NegativeIPV4Keyword",
@@ -8966,6 +9841,10 @@ void SigRegisterTests(void) {
                     SigTest36ContentAndIsdataatKeywords01B3g, 1);
     UtRegisterTest("SigTest36ContentAndIsdataatKeywords01Wm" ,
                     SigTest36ContentAndIsdataatKeywords01Wm,  1);
+    UtRegisterTest("SigTest36ContentAndIsdataatKeywords01Teddy",
+                    SigTest36ContentAndIsdataatKeywords01Teddy, 1);
+    UtRegisterTest("SigTest36ContentAndIsdataatKeywords01Ac",
+                    SigTest36ContentAndIsdataatKeywords01Ac, 1);
 
     UtRegisterTest("SigTest37ContentAndIsdataatKeywords02B2g",
                     SigTest37ContentAndIsdataatKeywords02B2g, 1);
@@ -8973,6 +9852,10 @@ void SigRegisterTests(void) {
                     SigTest37ContentAndIsdataatKeywords02B3g, 1);
     UtRegisterTest("SigTest37ContentAndIsdataatKeywords02Wm" ,
                     SigTest37ContentAndIsdataatKeywords02Wm,  1);
+    UtRegisterTest("SigTest37ContentAndIsdataatKeywords02Teddy",
+                    SigTest37ContentAndIsdataatKeywords02Teddy, 1);
+    UtRegisterTest("SigTest37ContentAndIsdataatKeywords02Ac",
+                    SigTest37ContentAndIsdataatKeywords02Ac, 1);
 
     /* We need to enable these tests, as soon as we add the ICMPv6 protocol
        support in our rules engine */
@@ -8983,10 +9866,14 @@ void SigRegisterTests(void) {
     UtRegisterTest("SigTest38B2g -- byte_test test (1)", SigTest38B2g, 1);
     UtRegisterTest("SigTest38B3g -- byte_test test (1)", SigTest38B3g, 1);
     UtRegisterTest("SigTest38Wm -- byte_test test (1)", SigTest38Wm, 1);
+    UtRegisterTest("SigTest38Teddy -- byte_test test (1)", SigTest38Teddy, 1);
+    UtRegisterTest("SigTest38Ac -- byte_test test (1)", SigTest38Ac, 1);
 
     UtRegisterTest("SigTest39B2g -- byte_jump test (2)", SigTest39B2g, 1);
     UtRegisterTest("SigTest39B3g -- byte_jump test (2)", SigTest39B3g, 1);
     UtRegisterTest("SigTest39Wm -- byte_jump test (2)", SigTest39Wm, 1);
+    UtRegisterTest("SigTest39Teddy -- byte_jump test (2)", SigTest39Teddy, 1);
+    UtRegisterTest("SigTest39Ac -- byte_jump test (2)", SigTest39Ac, 1);
 
     UtRegisterTest("SigTest40NoPacketInspection01", SigTest40NoPacketInspection01, 1);
     UtRegisterTest("SigTest40NoPayloadInspection02", SigTest40NoPayloadInspection02, 1);
@@ -9004,36 +9891,54 @@ void SigRegisterTests(void) {
     UtRegisterTest("SigTestContent01B2g -- 32 byte pattern", SigTestContent01B2g, 1);
     UtRegisterTest("SigTestContent01B3g -- 32 byte pattern", SigTestContent01B3g, 1);
     UtRegisterTest("SigTestContent01Wm -- 32 byte pattern", SigTestContent01Wm, 1);
+    UtRegisterTest("SigTestContent01Teddy -- 32 byte pattern", SigTestContent01Teddy, 1);
+    UtRegisterTest("SigTestContent01Ac -- 32 byte pattern", SigTestContent01Ac, 1);
 
     UtRegisterTest("SigTestContent02B2g -- 32+31 byte pattern", SigTestContent02B2g, 1);
     UtRegisterTest("SigTestContent02B3g -- 32+31 byte pattern", SigTestContent02B3g, 1);
     UtRegisterTest("SigTestContent02Wm -- 32+31 byte pattern", SigTestContent02Wm, 1);
+    UtRegisterTest("SigTestContent02Teddy -- 32+31 byte pattern", SigTestContent02Teddy, 1);
+    UtRegisterTest("SigTestContent02Ac -- 32+31 byte pattern", SigTestContent02Ac, 1);
 
     UtRegisterTest("SigTestContent03B2g -- 32 byte pattern, x2 + distance", SigTestContent03B2g, 1);
     UtRegisterTest("SigTestContent03B3g -- 32 byte pattern, x2 + distance", SigTestContent03B3g, 1);
     UtRegisterTest("SigTestContent03Wm -- 32 byte pattern, x2 + distance", SigTestContent03Wm, 1);
+    UtRegisterTest("SigTestContent03Teddy -- 32 byte pattern, x2 + distance", SigTestContent03Teddy, 1);
+    UtRegisterTest("SigTestContent03Ac -- 32 byte pattern, x2 + distance", SigTestContent03Ac, 1);
 
     UtRegisterTest("SigTestContent04B2g -- 32 byte pattern, x2 + distance/within", SigTestContent04B2g, 1);
     UtRegisterTest("SigTestContent04B3g -- 32 byte pattern, x2 + distance/within", SigTestContent04B3g, 1);
     UtRegisterTest("SigTestContent04Wm -- 32 byte pattern, x2 + distance/within", SigTestContent04Wm, 1);
+    UtRegisterTest("SigTestContent04Teddy -- 32 byte pattern, x2 + distance/within", SigTestContent04Teddy, 1);
+    UtRegisterTest("SigTestContent04Ac -- 32 byte pattern, x2 + distance/within", SigTestContent04Ac, 1);
 
     UtRegisterTest("SigTestContent05B2g -- distance/within", SigTestContent05B2g, 1);
     UtRegisterTest("SigTestContent05B3g -- distance/within", SigTestContent05B3g, 1);
     UtRegisterTest("SigTestContent05Wm -- distance/within", SigTestContent05Wm, 1);
+    UtRegisterTest("SigTestContent05Teddy -- distance/within", SigTestContent05Teddy, 1);
+    UtRegisterTest("SigTestContent05Ac -- distance/within", SigTestContent05Ac, 1);
 
     UtRegisterTest("SigTestContent06B2g -- distance/within ip only", SigTestContent06B2g, 1);
     UtRegisterTest("SigTestContent06B3g -- distance/within ip only", SigTestContent06B3g, 1);
     UtRegisterTest("SigTestContent06Wm -- distance/within ip only", SigTestContent06Wm, 1);
+    UtRegisterTest("SigTestContent06Teddy -- distance/within ip only", SigTestContent06Teddy, 1);
+    UtRegisterTest("SigTestContent06Ac -- distance/within ip only", SigTestContent06Ac, 1);
 
     UtRegisterTest("SigTestWithinReal01B2g", SigTestWithinReal01B2g, 1);
     UtRegisterTest("SigTestWithinReal01B3g", SigTestWithinReal01B3g, 1);
     UtRegisterTest("SigTestWithinReal01Wm", SigTestWithinReal01Wm, 1);
+    UtRegisterTest("SigTestWithinReal01Teddy", SigTestWithinReal01Teddy, 1);
+    UtRegisterTest("SigTestWithinReal01Ac", SigTestWithinReal01Ac, 1);
 
     UtRegisterTest("SigTestDepthOffset01B2g", SigTestDepthOffset01B2g, 1);
     UtRegisterTest("SigTestDepthOffset01B3g", SigTestDepthOffset01B3g, 1);
     UtRegisterTest("SigTestDepthOffset01Wm", SigTestDepthOffset01Wm, 1);
+    UtRegisterTest("SigTestDepthOffset01Teddy", SigTestDepthOffset01Teddy, 1);
+    UtRegisterTest("SigTestDepthOffset01Ac", SigTestDepthOffset01Ac, 1);
 
     UtRegisterTest("SigTestDetectAlertCounter", SigTestDetectAlertCounter, 1);
+    UtRegisterTest("SigTestDetectBatch01", SigTestDetectBatch01, 1);
+    UtRegisterTest("SigTestBuildThreads01", SigTestBuildThreads01, 1);
 
 #endif /* UNITTESTS */
 }
@@ -70,6 +70,11 @@ struct SCSigSignatureWrapper_;
    -=- Src address
    -==- Dst address
 
+   For LoRaWAN frames
+
+   - MType
+   -- FPort (or no FPort)
+
 */
 
 /*
@@ -133,6 +138,28 @@ typedef struct DetectAddressHead_ {
     DetectAddress *ipv6_head;
 } DetectAddressHead;
 
+/** ipv4 range, in host order */
+typedef struct DetectAddressRange4_ {
+    uint32_t ip;
+    uint32_t ip2;
+} DetectAddressRange4;
+
+/** ipv6 range, the words in host order */
+typedef struct DetectAddressRange6_ {
+    uint32_t ip[4];
+    uint32_t ip2[4];
+} DetectAddressRange6;
+
+/** The addresses of a DetectAddressHead as sorted arrays of non
+ *  overlapping ranges, to look up a packet's address with a binary
+ *  search instead of walking the lists. */
+typedef struct DetectAddressArray_ {
+    DetectAddressRange4 *ipv4;
+    DetectAddressRange6 *ipv6;
+    uint32_t ipv4_cnt;
+    uint32_t ipv6_cnt;
+} DetectAddressArray;
+
 /*
  * DETECT PORT
  */
@@ -175,6 +202,18 @@ typedef struct DetectPort_ {
     uint8_t flags;  /**< flags for this port */
 } DetectPort;
 
+typedef struct DetectPortRange_ {
+    uint16_t port;
+    uint16_t port2;
+} DetectPortRange;
+
+/** The ports of a DetectPort list as a sorted array of non overlapping
+ *  ranges, to look up a packet's port with a binary search. */
+typedef struct DetectPortArray_ {
+    DetectPortRange *range;
+    uint32_t cnt;
+} DetectPortArray;
+
 /* Signature flags */
 #define SIG_FLAG_RECURSIVE      0x00000001  /**< recursive capturing enabled */
 #define SIG_FLAG_SRC_ANY        0x00000002  /**< source is any */
@@ -203,6 +242,15 @@ typedef struct DetectPort_ {
 #define SIG_FLAG_AMATCH         0x00080000
 #define SIG_FLAG_DMATCH         0x00100000
 
+#define SIG_FLAG_LORAWAN_MTYPE  0x00200000  /**< sig only applies to the MTypes in lorawan_mtypes */
+#define SIG_FLAG_LORAWAN_FPORT  0x00400000  /**< sig only applies to the FPorts in lorawan_fports */
+
+/** one bit per FPort */
+#define DETECT_LORAWAN_FPORT_BYTES      32
+/** sgh slots per MType: one per FPort and one for frames without FPort */
+#define DETECT_LORAWAN_FPORT_NONE       256
+#define DETECT_LORAWAN_FPORT_SLOTS      257
+
 /* Detection Engine flags */
 #define DE_QUIET           0x01     /**< DE is quiet (esp for unittests) */
 
@@ -256,12 +304,22 @@ typedef struct Signature_ {
     /** port settings for this signature */
     DetectPort *sp, *dp;
 
+    /** the addresses and ports above as arrays, for the per packet
+     *  checks. Built by SigAddressPrepareStage1() */
+    DetectAddressArray src_array, dst_array;
+    DetectPortArray sp_array, dp_array;
+
     /** addresses, ports and proto this sig matches on */
     DetectProto proto;
 
     /** netblocks and hosts specified at the sid, in CIDR format */
     IPOnlyCIDRItem *CidrSrc, *CidrDst;
 
+    /** LoRaWAN MTypes and FPorts this sig applies to, used to put
+     *  the sig in the right LoRaWAN groups */
+    uint8_t lorawan_mtypes;
+    uint8_t lorawan_fports[DETECT_LORAWAN_FPORT_BYTES];
+
     /** ptr to the SigMatch lists */
     struct SigMatch_ *match; /* non-payload matches */
     struct SigMatch_ *match_tail; /* non-payload matches, tail of the list */
@@ -356,6 +414,18 @@ typedef struct DetectEngineIPOnlyCtx_ {
     uint32_t *match_array;
 } DetectEngineIPOnlyCtx;
 
+typedef struct DetectEngineLookupLorawan_ {
+    struct SigGroupHead_ *sgh[DETECT_LORAWAN_FPORT_SLOTS];
+} DetectEngineLookupLorawan;
+
+/** an mpm ctx whose patterns are compiled after the group build, see
+ *  PatternMatchPrepareRun() */
+typedef struct MpmPrepareItem_ {
+    MpmCtx *mpm_ctx;
+    uint32_t memory_size;       /**< memory_size before the compile */
+    uint8_t count;              /**< compiled memory counts in mpm_memory_size */
+} MpmPrepareItem;
+
 typedef struct DetectEngineLookupFlow_ {
     DetectAddressHead *src_gh[256]; /* a head for each protocol */
     DetectAddressHead *tmp_gh[256];
@@ -403,6 +473,13 @@ typedef struct DetectEngineCtx_ {
     uint8_t flags;
     uint8_t failure_fatal;
 
+    /** rule set version, bumped by every reload. Flows use it to tell
+     *  their cached sgh's and detection state belong to an older one. */
+    uint32_t version;
+    /** detect threads, packets with alerts and the engine (while this is
+     *  the current ctx) using the ctx. Freed after a reload once 0. */
+    uint32_t ref_cnt;
+
     Signature *sig_list;
     uint32_t sig_cnt;
 
@@ -448,6 +525,21 @@ typedef struct DetectEngineCtx_ {
     /* memory counters */
     uint32_t mpm_memory_size;
 
+    /** threads compiling the mpm ctxs at the end of the group build, 0
+     *  for one per cpu */
+    uint16_t build_threads;
+    /** set while SigGroupBuild runs: PatternMatchPrepareGroup() queues
+     *  the compile instead of doing it */
+    uint8_t mpm_prepare_defer;
+    MpmPrepareItem *mpm_prepare_array;
+    uint32_t mpm_prepare_cnt;
+    uint32_t mpm_prepare_size;
+
+    /** rule cache file, NULL if not used (detect-engine-cache.c) */
+    char *rule_cache_file;
+    /** the mapped cache the mpm ctxs were loaded from */
+    struct DetectEngineCache_ *rule_cache;
+
     DetectEngineIPOnlyCtx io_ctx;
     ThresholdCtx ths_ctx;
 
@@ -488,6 +580,12 @@ typedef struct DetectEngineCtx_ {
     /** sgh for signatures that match against invalid packets. In those cases
      *  we can't lookup by proto, address, port as we don't have these */
     struct SigGroupHead_ *decoder_event_sgh;
+
+    /** LoRaWAN frames are looked up by MType and FPort. Most slots point
+     *  to the same few sgh's, the unique ones are in lorawan_sgh_array */
+    DetectEngineLookupLorawan lorawan_gh[LORAWAN_MTYPE_MAX];
+    struct SigGroupHead_ **lorawan_sgh_array;
+    uint32_t lorawan_sgh_array_cnt;
 } DetectEngineCtx;
 
 /* Engine groups profiles (low, medium, high, custom) */
@@ -554,6 +652,14 @@ typedef struct DetectionEngineThreadCtx_ {
     PatternMatcherQueue pmq;
     PatternMatcherQueue smsg_pmq[256];
 
+    /** pmq's of the packets of a vector, their payloads are searched
+     *  together in DetectBatch() */
+    PatternMatcherQueue batch_pmq[MPM_BATCH_SIZE];
+    /** the sgh the payload of the packet was searched for already, and
+     *  the matches, NULL if it wasn't */
+    struct SigGroupHead_ *batch_sgh;
+    uint32_t batch_cnt;
+
     /* counters */
     uint32_t pkts;
     uint32_t pkts_searched;
@@ -569,6 +675,8 @@ typedef struct DetectionEngineThreadCtx_ {
     uint32_t pkts_uri_searched3;
     uint32_t pkts_uri_searched4;
 
+    uint64_t alerts;
+
     /** id for alert counter */
     uint16_t counter_alerts;
 
@@ -576,6 +684,8 @@ typedef struct DetectionEngineThreadCtx_ {
     DetectEngineIPOnlyThreadCtx io_ctx;
 
     DetectEngineCtx *de_ctx;
+    /** version of the current ctx when we last switched to it */
+    uint32_t de_ctx_version;
 
     uint64_t mpm_match;
 } DetectEngineThreadCtx;
@@ -761,6 +871,13 @@ enum {
 
     DETECT_ASN1,
 
+    DETECT_LORAWAN_MTYPE,
+    DETECT_LORAWAN_DEVADDR,
+    DETECT_LORAWAN_FPORT,
+    DETECT_LORAWAN_FCTRL,
+    DETECT_LORAWAN_FOPTS_CMD,
+    DETECT_LORAWAN_FCNT_GAP,
+
     /* make sure this stays last */
     DETECT_TBLSIZE,
 };
@@ -777,6 +894,7 @@ void SigCleanSignatures(DetectEngineCtx *);
 void SigTableRegisterTests(void);
 void SigRegisterTests(void);
 void TmModuleDetectRegister (void);
+uint64_t DetectGetAlertCnt(void);
 
 int SigGroupBuild(DetectEngineCtx *);
 int SigGroupCleanup (DetectEngineCtx *de_ctx);
@@ -47,6 +47,7 @@
         (f)->de_state = NULL; \
         (f)->sgh_toserver = NULL; \
         (f)->sgh_toclient = NULL; \
+        (f)->de_ctx_version = 0; \
         (f)->aldata = NULL; \
         (f)->alflags = 0; \
         (f)->alproto = 0; \
@@ -77,6 +78,7 @@
         } \
         (f)->sgh_toserver = NULL; \
         (f)->sgh_toclient = NULL; \
+        (f)->de_ctx_version = 0; \
         AppLayerParserCleanupState(f); \
         FlowL7DataPtrFree(f); \
         if ((f)->aldata != NULL) { \
@@ -50,6 +50,7 @@
 
 #include "util-debug.h"
 #include "util-privs.h"
+#include "util-affinity.h"
 
 #include "detect.h"
 #include "detect-engine-state.h"
@@ -821,6 +822,10 @@ void FlowInitConfig (char quiet)
     }
     uint32_t i = 0;
 
+    /* the hash is used by the threads that handle the flows: place it on
+     * their nodes before the memset below faults its pages in */
+    AffinityBindMemory(flow_hash, flow_config.hash_size * sizeof(FlowBucket),
+            AffinityGetNodeMask(DETECT_CPU_SET) | AffinityGetNodeMask(WORKER_CPU_SET));
     memset(flow_hash, 0, flow_config.hash_size * sizeof(FlowBucket));
     for (i = 0; i < flow_config.hash_size; i++)
         SCSpinInit(&flow_hash[i].s, 0);
@@ -173,6 +173,9 @@ typedef struct Flow_
     /** toserver sgh for this flow. Only use when FLOW_SGH_TOSERVER flow flag
      *  has been set. */
     struct SigGroupHead_ *sgh_toserver;
+    /** version of the detection engine ctx the sgh's and de_state are
+     *  from. They are dropped when a reloaded rule set sees the flow. */
+    uint32_t de_ctx_version;
 
     SCMutex m;
 
@@ -0,0 +1,1019 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * LoRaWAN device session table.
+ *
+ * The flow engine keys on IP tuples, so all LoRaWAN frames would share a
+ * single flow bucket. Instead end-devices get a session of their own, keyed
+ * on DevAddr for data frames and on JoinEUI/DevEUI for join requests. The
+ * two keys live in two tables with the same layout: a power of 2 hash of
+ * singly linked buckets, covered by a smaller power of 2 number of lock
+ * stripes. Every stripe owns a timer wheel with a slot per second, so the
+ * manager thread only looks at the sessions that are due instead of
+ * walking all of them.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+#include "decode.h"
+#include "conf.h"
+#include "threads.h"
+#include "threadvars.h"
+#include "tm-modules.h"
+#include "tm-threads.h"
+
+#include "lorawan-session.h"
+
+#include "util-atomic.h"
+#include "util-byte.h"
+#include "util-debug.h"
+#include "util-privs.h"
+#include "util-random.h"
+#include "util-time.h"
+#include "util-unittest.h"
+
+static LorawanSessionConfig lorawan_session_config;
+static LorawanSessionTable devaddr_table;
+static LorawanSessionTable eui_table;
+
+/** session memuse counter (atomic), for enforcing memcap limit */
+SC_ATOMIC_DECLARE(uint64_t, lorawan_session_memuse);
+
+/** \brief round up to the next power of 2 */
+static uint32_t LorawanSessionPow2(uint32_t v)
+{
+    uint32_t r = 1;
+    while (r < v && r < 0x80000000U)
+        r <<= 1;
+    return r;
+}
+
+static inline uint32_t LorawanSessionHashDevAddr(uint32_t devaddr)
+{
+    uint32_t h = (devaddr ^ lorawan_session_config.hash_rand) * 0x9e3779b1U;
+    return h ^ (h >> 16);
+}
+
+static inline uint32_t LorawanSessionHashEui(uint64_t join_eui, uint64_t dev_eui)
+{
+    uint64_t k = dev_eui ^ (join_eui * 0x9e3779b97f4a7c15ULL);
+    return LorawanSessionHashDevAddr((uint32_t)(k ^ (k >> 32)));
+}
+
+#define LORAWAN_SESSION_STRIPE(t, h) (&(t)->stripes[((h) & (t)->hash_mask) & (t)->stripe_mask])
+#define LORAWAN_SESSION_BUCKET(t, h) (&(t)->hash[(h) & (t)->hash_mask])
+
+/**
+ * \brief Reconstruct the 32 bit frame counter from the 16 lsb in the frame
+ *        and the last counter we saw: the candidate nearest to it. So a
+ *        smaller value is a wrap of the 16 bit counter if it's far enough
+ *        back, and a larger one a late frame from before the last wrap if
+ *        it's far enough ahead.
+ */
+static inline uint32_t LorawanSessionFCnt32(uint32_t last, uint16_t fcnt16)
+{
+    uint32_t fcnt = (last & 0xffff0000U) | fcnt16;
+
+    if (fcnt < last && (last - fcnt) > 0x8000)
+        fcnt += 0x10000;
+    else if (fcnt > last && (fcnt - last) > 0x8000 && last >= 0x10000)
+        fcnt -= 0x10000;
+    return fcnt;
+}
+
+/**
+ * \brief Check a frame counter against the window of the counters we saw
+ *        last and slide the window.
+ *
+ * The window is a bitmap of the LORAWAN_SESSION_FCNT_WINDOW counters up
+ * to the highest one, so the check is a shift and a bit test and the state
+ * is a fixed 12 bytes per direction, however many frames a device sends.
+ *
+ * \param p packet, decoder events and lorawan.fcnt_gap are set on it
+ * \param last highest counter so far, updated
+ * \param win window, updated
+ * \param seen 0 if this is the first frame in this direction
+ * \param fcnt16 the counter in the frame
+ * \param dup 1 if a repeat of the highest counter is a copy of the same
+ *            frame (heard by more than one gateway)
+ */
+static void LorawanSessionCheckFCnt(Packet *p, uint32_t *last, uint64_t *win,
+                                    int seen, uint16_t fcnt16, int dup)
+{
+    uint32_t fcnt;
+    uint32_t diff;
+
+    if (!seen) {
+        *last = fcnt16;
+        *win = 1;
+        return;
+    }
+
+    fcnt = LorawanSessionFCnt32(*last, fcnt16);
+
+    if (fcnt > *last) {
+        diff = fcnt - *last;
+        p->lorawan.fcnt_gap = diff - 1;
+        if (diff > lorawan_session_config.fcnt_gap) {
+            /* further than the device can get ahead of us (MAX_FCNT_GAP).
+             * We can't check the MIC, so this may well be a spoofed or
+             * corrupted frame: moving on to it would make every frame of
+             * the real device look like a rollback. */
+            DECODER_SET_EVENT(p, LORAWAN_FCNT_JUMP);
+            return;
+        }
+        *win = (diff >= LORAWAN_SESSION_FCNT_WINDOW) ? 1 : ((*win << diff) | 1);
+        *last = fcnt;
+        return;
+    }
+
+    diff = *last - fcnt;
+    if (diff >= LORAWAN_SESSION_FCNT_WINDOW) {
+        /* counter went back further than we can tell, the device reset
+         * its counters (ABP reboot) or someone replays old frames. We
+         * keep the highest counter: starting over from here would let
+         * the rest of a recorded history replay unnoticed. The counters
+         * only start over when the session does, see
+         * LorawanSessionResetFCnt(). */
+        DECODER_SET_EVENT(p, LORAWAN_FCNT_ROLLBACK);
+        return;
+    }
+
+    if (*win & (1ULL << diff)) {
+        if (!(diff == 0 && dup)) {
+            DECODER_SET_EVENT(p, LORAWAN_FCNT_REPLAY);
+        }
+        return;
+    }
+
+    /* late, but not seen before */
+    *win |= (1ULL << diff);
+}
+
+/** \brief forget the frame counters of a session, the device starts over:
+ *         it joined again or the DevAddr was handed to another device */
+static inline void LorawanSessionResetFCnt(LorawanSession *s)
+{
+    s->flags &= ~(LORAWAN_SESSION_FCNT_UP_SEEN|LORAWAN_SESSION_FCNT_DOWN_SEEN);
+    s->fcnt_up = s->fcnt_down = 0;
+    s->fcnt_up_win = s->fcnt_down_win = 0;
+    s->last_mic = 0;
+    s->last_up_ts = 0;
+}
+
+static void LorawanSessionWheelInsert(LorawanSessionStripe *st, LorawanSession *s)
+{
+    LorawanSession **slot = &st->wheel[s->expire & LORAWAN_SESSION_TW_MASK];
+
+    s->twprev = NULL;
+    s->twnext = *slot;
+    if (*slot != NULL)
+        (*slot)->twprev = s;
+    *slot = s;
+}
+
+static void LorawanSessionWheelRemove(LorawanSessionStripe *st, LorawanSession *s)
+{
+    if (s->twprev != NULL)
+        s->twprev->twnext = s->twnext;
+    else
+        st->wheel[s->expire & LORAWAN_SESSION_TW_MASK] = s->twnext;
+
+    if (s->twnext != NULL)
+        s->twnext->twprev = s->twprev;
+
+    s->twnext = s->twprev = NULL;
+}
+
+/** \brief update last seen and move the session to its new wheel slot.
+ *         The slot only changes once per second at most. */
+static inline void LorawanSessionTouch(LorawanSessionStripe *st, LorawanSession *s, uint32_t ts)
+{
+    uint32_t expire = ts + lorawan_session_config.timeout;
+
+    s->lastts = ts;
+    if (expire != s->expire) {
+        LorawanSessionWheelRemove(st, s);
+        s->expire = expire;
+        LorawanSessionWheelInsert(st, s);
+    }
+}
+
+/**
+ * \brief Find a session in a bucket, create it if it's not there.
+ *
+ * \warning the stripe lock of the bucket must be held
+ *
+ * \retval s session or NULL if the memcap was reached
+ */
+static LorawanSession *LorawanSessionGetOrAlloc(LorawanSessionTable *t, uint32_t h,
+        uint32_t devaddr, uint64_t join_eui, uint64_t dev_eui, int by_eui, uint32_t ts)
+{
+    LorawanSession **bucket = LORAWAN_SESSION_BUCKET(t, h);
+    LorawanSession *s;
+
+    for (s = *bucket; s != NULL; s = s->hnext) {
+        if (by_eui) {
+            if (s->dev_eui == dev_eui && s->join_eui == join_eui)
+                return s;
+        } else if (s->devaddr == devaddr) {
+            return s;
+        }
+    }
+
+    if (SC_ATOMIC_GET(lorawan_session_memuse) + sizeof(LorawanSession) >
+            lorawan_session_config.memcap) {
+        SCLogDebug("lorawan session memcap reached");
+        return NULL;
+    }
+
+    s = SCMalloc(sizeof(LorawanSession));
+    if (s == NULL)
+        return NULL;
+    SC_ATOMIC_ADD(lorawan_session_memuse, sizeof(LorawanSession));
+
+    memset(s, 0x00, sizeof(LorawanSession));
+    s->devaddr = devaddr;
+    if (by_eui) {
+        s->join_eui = join_eui;
+        s->dev_eui = dev_eui;
+        s->flags |= LORAWAN_SESSION_EUI_BOUND;
+    }
+
+    s->hnext = *bucket;
+    *bucket = s;
+
+    LorawanSessionStripe *st = LORAWAN_SESSION_STRIPE(t, h);
+    s->lastts = ts;
+    s->expire = ts + lorawan_session_config.timeout;
+    LorawanSessionWheelInsert(st, s);
+    st->cnt++;
+    return s;
+}
+
+static void LorawanSessionFree(LorawanSession *s)
+{
+    SCFree(s);
+    SC_ATOMIC_SUB(lorawan_session_memuse, sizeof(LorawanSession));
+}
+
+/**
+ * \brief Advance a stripe's timer wheel up to 'now', freeing the sessions
+ *        that expired.
+ *
+ * \warning the stripe lock must be held
+ *
+ * \retval cnt number of sessions that were freed
+ */
+static uint32_t LorawanSessionStripeTimeout(LorawanSessionTable *t, uint32_t stripe, uint32_t now)
+{
+    LorawanSessionStripe *st = &t->stripes[stripe];
+    uint32_t cnt = 0;
+    uint32_t steps;
+    uint32_t sec;
+
+    /* the first call sets the start of the wheel. We can't do that at
+     * init time: when reading from a file, time is the packet time */
+    if (st->tw_now == 0) {
+        st->tw_now = now;
+        return 0;
+    }
+
+    if ((int32_t)(now - st->tw_now) <= 0)
+        return 0;
+
+    /* after a long pause every slot is due, no need to go round twice */
+    steps = now - st->tw_now;
+    if (steps > LORAWAN_SESSION_TW_SLOTS)
+        steps = LORAWAN_SESSION_TW_SLOTS;
+
+    for (sec = now - steps + 1; steps > 0; sec++, steps--) {
+        LorawanSession *s = st->wheel[sec & LORAWAN_SESSION_TW_MASK];
+
+        while (s != NULL) {
+            LorawanSession *next = s->twnext;
+
+            /* a session a few rounds ahead stays where it is */
+            if ((int32_t)(s->expire - now) > 0) {
+                s = next;
+                continue;
+            }
+
+            LorawanSessionWheelRemove(st, s);
+
+            uint32_t h = (t == &eui_table) ?
+                LorawanSessionHashEui(s->join_eui, s->dev_eui) :
+                LorawanSessionHashDevAddr(s->devaddr);
+            LorawanSession **ps = LORAWAN_SESSION_BUCKET(t, h);
+            while (*ps != NULL && *ps != s)
+                ps = &(*ps)->hnext;
+            if (*ps != NULL)
+                *ps = s->hnext;
+
+            LorawanSessionFree(s);
+            st->cnt--;
+            cnt++;
+            s = next;
+        }
+    }
+
+    st->tw_now = now;
+    st->expired += cnt;
+    return cnt;
+}
+
+/**
+ * \brief Time out the sessions of both tables that are due at 'now'.
+ *
+ * \retval cnt number of sessions that were freed
+ */
+uint32_t LorawanSessionTimeout(uint32_t now)
+{
+    LorawanSessionTable *tables[2] = { &devaddr_table, &eui_table };
+    uint32_t cnt = 0;
+    uint32_t i, u;
+
+    for (u = 0; u < 2; u++) {
+        LorawanSessionTable *t = tables[u];
+        if (t->hash == NULL)
+            continue;
+
+        for (i = 0; i <= t->stripe_mask; i++) {
+            SCMutexLock(&t->stripes[i].m);
+            cnt += LorawanSessionStripeTimeout(t, i, now);
+            SCMutexUnlock(&t->stripes[i].m);
+        }
+    }
+    return cnt;
+}
+
+/**
+ * \brief Update the session of the device that sent or receives this
+ *        frame. Called by the decoder once the frame is decoded.
+ */
+void LorawanSessionHandlePacket(ThreadVars *tv, Packet *p)
+{
+    LorawanSessionStripe *st;
+    LorawanSession *s;
+    LorawanHdr *lh;
+    uint32_t ts;
+    uint32_t h;
+    int uplink;
+
+    if (devaddr_table.hash == NULL || !PKT_IS_LORAWAN(p))
+        return;
+
+    lh = p->lorawanh;
+    ts = (uint32_t)p->ts.tv_sec;
+    uplink = LORAWAN_MTYPE_IS_UPLINK(lh->mtype);
+
+    if (lh->flags & LORAWAN_HDR_HAS_JOIN) {
+        uint32_t devaddr = 0;
+        int bound = 0;
+
+        h = LorawanSessionHashEui(lh->join_eui, lh->dev_eui);
+        st = LORAWAN_SESSION_STRIPE(&eui_table, h);
+
+        SCMutexLock(&st->m);
+        s = LorawanSessionGetOrAlloc(&eui_table, h, 0, lh->join_eui, lh->dev_eui, 1, ts);
+        if (s != NULL) {
+            s->joins++;
+            s->dev_nonce = lh->dev_nonce;
+            s->last_gweui = p->pq_v.gweui;
+            s->pkts_up++;
+            s->bytes += GET_PKT_LEN(p);
+            LorawanSessionTouch(st, s, ts);
+            if (s->flags & LORAWAN_SESSION_DEVADDR_BOUND) {
+                devaddr = s->devaddr;
+                bound = 1;
+            }
+        }
+        SCMutexUnlock(&st->m);
+
+        /* a join restarts the frame counters of the session the device
+         * had. The two tables are never locked at the same time. */
+        if (bound) {
+            h = LorawanSessionHashDevAddr(devaddr);
+            st = LORAWAN_SESSION_STRIPE(&devaddr_table, h);
+
+            SCMutexLock(&st->m);
+            for (s = *LORAWAN_SESSION_BUCKET(&devaddr_table, h); s != NULL; s = s->hnext) {
+                if (s->devaddr == devaddr) {
+                    LorawanSessionResetFCnt(s);
+                    break;
+                }
+            }
+            SCMutexUnlock(&st->m);
+        }
+        return;
+    }
+
+    if (!(lh->flags & LORAWAN_HDR_HAS_FHDR))
+        return;
+
+    h = LorawanSessionHashDevAddr(lh->devaddr);
+    st = LORAWAN_SESSION_STRIPE(&devaddr_table, h);
+
+    SCMutexLock(&st->m);
+    s = LorawanSessionGetOrAlloc(&devaddr_table, h, lh->devaddr, 0, 0, 0, ts);
+    if (s != NULL) {
+        if (uplink) {
+            /* the same uplink heard by several gateways */
+            int seen = s->flags & LORAWAN_SESSION_FCNT_UP_SEEN;
+            uint32_t prev = s->fcnt_up;
+            int dup = (seen && lh->mic == s->last_mic &&
+                       ts - s->last_up_ts <= lorawan_session_config.dup_window);
+
+            LorawanSessionCheckFCnt(p, &s->fcnt_up, &s->fcnt_up_win,
+                    seen, lh->fcnt, dup);
+            /* the frame with the new highest counter, its copies are
+             * taken as dups for dup_window seconds */
+            if (!seen || s->fcnt_up != prev) {
+                s->last_mic = lh->mic;
+                s->last_up_ts = ts;
+            }
+            s->flags |= LORAWAN_SESSION_FCNT_UP_SEEN;
+            s->last_gweui = p->pq_v.gweui;
+            s->pkts_up++;
+        } else {
+            /* downlinks are sent once, by one gateway */
+            LorawanSessionCheckFCnt(p, &s->fcnt_down, &s->fcnt_down_win,
+                    s->flags & LORAWAN_SESSION_FCNT_DOWN_SEEN, lh->fcnt, 0);
+            s->flags |= LORAWAN_SESSION_FCNT_DOWN_SEEN;
+            s->pkts_down++;
+        }
+        s->bytes += GET_PKT_LEN(p);
+        LorawanSessionTouch(st, s, ts);
+    }
+    SCMutexUnlock(&st->m);
+}
+
+/** \brief copy a session out, the list ptrs are cleared as they're only
+ *         valid under the stripe lock */
+static inline void LorawanSessionCopy(LorawanSession *dst, LorawanSession *src)
+{
+    memcpy(dst, src, sizeof(LorawanSession));
+    dst->hnext = dst->twnext = dst->twprev = NULL;
+}
+
+/**
+ * \brief Get a copy of the session of a DevAddr.
+ *
+ * \retval 1 found, copied into 'out'
+ * \retval 0 no session
+ */
+int LorawanSessionGetByDevAddr(uint32_t devaddr, LorawanSession *out)
+{
+    LorawanSession *s;
+    int r = 0;
+
+    if (devaddr_table.hash == NULL)
+        return 0;
+
+    uint32_t h = LorawanSessionHashDevAddr(devaddr);
+    LorawanSessionStripe *st = LORAWAN_SESSION_STRIPE(&devaddr_table, h);
+
+    SCMutexLock(&st->m);
+    for (s = *LORAWAN_SESSION_BUCKET(&devaddr_table, h); s != NULL; s = s->hnext) {
+        if (s->devaddr == devaddr) {
+            LorawanSessionCopy(out, s);
+            r = 1;
+            break;
+        }
+    }
+    SCMutexUnlock(&st->m);
+    return r;
+}
+
+/**
+ * \brief Get a copy of the join state of a JoinEUI/DevEUI pair.
+ *
+ * \retval 1 found, copied into 'out'
+ * \retval 0 no session
+ */
+int LorawanSessionGetByEui(uint64_t join_eui, uint64_t dev_eui, LorawanSession *out)
+{
+    LorawanSession *s;
+    int r = 0;
+
+    if (eui_table.hash == NULL)
+        return 0;
+
+    uint32_t h = LorawanSessionHashEui(join_eui, dev_eui);
+    LorawanSessionStripe *st = LORAWAN_SESSION_STRIPE(&eui_table, h);
+
+    SCMutexLock(&st->m);
+    for (s = *LORAWAN_SESSION_BUCKET(&eui_table, h); s != NULL; s = s->hnext) {
+        if (s->dev_eui == dev_eui && s->join_eui == join_eui) {
+            LorawanSessionCopy(out, s);
+            r = 1;
+            break;
+        }
+    }
+    SCMutexUnlock(&st->m);
+    return r;
+}
+
+/**
+ * \brief Link a DevAddr to the JoinEUI/DevEUI of the device that got it.
+ *
+ * The DevAddr is handed out in the (encrypted) join accept, so we can't
+ * learn it from the air. A network server or a feed can tell us here.
+ *
+ * \retval 0 ok
+ * \retval -1 table not initialized or memcap reached
+ */
+int LorawanSessionBindEui(uint32_t devaddr, uint64_t join_eui, uint64_t dev_eui)
+{
+    LorawanSessionStripe *st;
+    LorawanSession *s;
+    struct timeval ts;
+    uint32_t h;
+    int r = 0;
+
+    if (devaddr_table.hash == NULL)
+        return -1;
+
+    memset(&ts, 0, sizeof(ts));
+    TimeGet(&ts);
+
+    /* the two tables are never locked at the same time */
+    h = LorawanSessionHashDevAddr(devaddr);
+    st = LORAWAN_SESSION_STRIPE(&devaddr_table, h);
+    SCMutexLock(&st->m);
+    s = LorawanSessionGetOrAlloc(&devaddr_table, h, devaddr, 0, 0, 0, (uint32_t)ts.tv_sec);
+    if (s != NULL) {
+        /* the DevAddr went to a (new) device: its counters start over */
+        if (!(s->flags & LORAWAN_SESSION_EUI_BOUND) ||
+            s->join_eui != join_eui || s->dev_eui != dev_eui)
+            LorawanSessionResetFCnt(s);
+        s->join_eui = join_eui;
+        s->dev_eui = dev_eui;
+        s->flags |= LORAWAN_SESSION_EUI_BOUND;
+    } else {
+        r = -1;
+    }
+    SCMutexUnlock(&st->m);
+
+    h = LorawanSessionHashEui(join_eui, dev_eui);
+    st = LORAWAN_SESSION_STRIPE(&eui_table, h);
+    SCMutexLock(&st->m);
+    s = LorawanSessionGetOrAlloc(&eui_table, h, devaddr, join_eui, dev_eui, 1, (uint32_t)ts.tv_sec);
+    if (s != NULL) {
+        s->devaddr = devaddr;
+        s->flags |= LORAWAN_SESSION_DEVADDR_BOUND;
+    } else {
+        r = -1;
+    }
+    SCMutexUnlock(&st->m);
+
+    return r;
+}
+
+static int LorawanSessionTableInit(LorawanSessionTable *t)
+{
+    uint32_t i;
+
+    t->hash_mask = lorawan_session_config.hash_size - 1;
+    t->stripe_mask = lorawan_session_config.stripes - 1;
+
+    t->hash = SCCalloc(lorawan_session_config.hash_size, sizeof(LorawanSession *));
+    if (t->hash == NULL)
+        return -1;
+    SC_ATOMIC_ADD(lorawan_session_memuse, lorawan_session_config.hash_size * sizeof(LorawanSession *));
+
+    t->stripes = SCCalloc(lorawan_session_config.stripes, sizeof(LorawanSessionStripe));
+    if (t->stripes == NULL)
+        return -1;
+    SC_ATOMIC_ADD(lorawan_session_memuse, lorawan_session_config.stripes * sizeof(LorawanSessionStripe));
+
+    for (i = 0; i < lorawan_session_config.stripes; i++)
+        SCMutexInit(&t->stripes[i].m, NULL);
+    return 0;
+}
+
+static void LorawanSessionTableFree(LorawanSessionTable *t)
+{
+    uint32_t i;
+
+    if (t->hash != NULL) {
+        for (i = 0; i <= t->hash_mask; i++) {
+            LorawanSession *s = t->hash[i];
+            while (s != NULL) {
+                LorawanSession *next = s->hnext;
+                LorawanSessionFree(s);
+                s = next;
+            }
+        }
+        SCFree(t->hash);
+    }
+
+    if (t->stripes != NULL) {
+        for (i = 0; i <= t->stripe_mask; i++)
+            SCMutexDestroy(&t->stripes[i].m);
+        SCFree(t->stripes);
+    }
+
+    memset(t, 0x00, sizeof(LorawanSessionTable));
+}
+
+/** \brief initialize the configuration and the tables
+ *  \warning Not thread safe */
+void LorawanSessionInitConfig(char quiet)
+{
+    char *conf_val;
+    uint32_t configval = 0;
+
+    memset(&lorawan_session_config, 0x00, sizeof(lorawan_session_config));
+    SC_ATOMIC_INIT(lorawan_session_memuse);
+
+    unsigned int seed = RandomTimePreseed();
+    lorawan_session_config.hash_rand = (uint32_t)rand_r(&seed);
+    lorawan_session_config.hash_size = LORAWAN_SESSION_DEFAULT_HASHSIZE;
+    lorawan_session_config.stripes = LORAWAN_SESSION_DEFAULT_STRIPES;
+    lorawan_session_config.timeout = LORAWAN_SESSION_DEFAULT_TIMEOUT;
+    lorawan_session_config.memcap = LORAWAN_SESSION_DEFAULT_MEMCAP;
+    lorawan_session_config.fcnt_gap = LORAWAN_SESSION_DEFAULT_FCNT_GAP;
+    lorawan_session_config.dup_window = LORAWAN_SESSION_DEFAULT_DUP_WINDOW;
+
+    if ((ConfGet("lorawan-session.memcap", &conf_val)) == 1) {
+        if (ByteExtractStringUint32(&configval, 10, strlen(conf_val),
+                                    conf_val) > 0)
+            lorawan_session_config.memcap = configval;
+    }
+    if ((ConfGet("lorawan-session.hash_size", &conf_val)) == 1) {
+        if (ByteExtractStringUint32(&configval, 10, strlen(conf_val),
+                                    conf_val) > 0)
+            lorawan_session_config.hash_size = configval;
+    }
+    if ((ConfGet("lorawan-session.stripes", &conf_val)) == 1) {
+        if (ByteExtractStringUint32(&configval, 10, strlen(conf_val),
+                                    conf_val) > 0)
+            lorawan_session_config.stripes = configval;
+    }
+    if ((ConfGet("lorawan-session.timeout", &conf_val)) == 1) {
+        if (ByteExtractStringUint32(&configval, 10, strlen(conf_val),
+                                    conf_val) > 0 && configval > 0)
+            lorawan_session_config.timeout = configval;
+    }
+
+    if ((ConfGet("lorawan-session.fcnt_max_gap", &conf_val)) == 1) {
+        if (ByteExtractStringUint32(&configval, 10, strlen(conf_val),
+                                    conf_val) > 0 && configval > 0)
+            lorawan_session_config.fcnt_gap = configval;
+    }
+    if ((ConfGet("lorawan-session.dup_window", &conf_val)) == 1) {
+        if (ByteExtractStringUint32(&configval, 10, strlen(conf_val),
+                                    conf_val) > 0)
+            lorawan_session_config.dup_window = configval;
+    }
+
+    /* both are used as masks */
+    lorawan_session_config.hash_size = LorawanSessionPow2(lorawan_session_config.hash_size);
+    lorawan_session_config.stripes = LorawanSessionPow2(lorawan_session_config.stripes);
+    if (lorawan_session_config.stripes > lorawan_session_config.hash_size)
+        lorawan_session_config.stripes = lorawan_session_config.hash_size;
+
+    if (LorawanSessionTableInit(&devaddr_table) < 0 ||
+        LorawanSessionTableInit(&eui_table) < 0) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Fatal error encountered in "
+                   "LorawanSessionInitConfig. Exiting...");
+        exit(EXIT_FAILURE);
+    }
+
+    if (quiet == FALSE) {
+        SCLogInfo("lorawan sessions: %" PRIu32 " buckets, %" PRIu32 " lock "
+                  "stripes, timeout %" PRIu32 "s, session size %" PRIuMAX
+                  ", memcap %" PRIu64 "", lorawan_session_config.hash_size,
+                  lorawan_session_config.stripes, lorawan_session_config.timeout,
+                  (uintmax_t)sizeof(LorawanSession), lorawan_session_config.memcap);
+    }
+}
+
+/** \brief free the tables and all sessions
+ *  \warning Not thread safe */
+void LorawanSessionShutdown(void)
+{
+    uint64_t expired = 0;
+    uint32_t active = 0;
+    uint32_t i;
+
+    if (devaddr_table.hash == NULL)
+        return;
+
+    for (i = 0; i <= devaddr_table.stripe_mask; i++) {
+        expired += devaddr_table.stripes[i].expired;
+        active += devaddr_table.stripes[i].cnt;
+    }
+    SCLogInfo("lorawan sessions: %" PRIu32 " active, %" PRIu64 " timed out",
+              active, expired);
+
+    LorawanSessionTableFree(&devaddr_table);
+    LorawanSessionTableFree(&eui_table);
+    SC_ATOMIC_DESTROY(lorawan_session_memuse);
+}
+
+/**
+ * \brief Timer wheel driver: once per second advance the wheels of all
+ *        stripes to the current time.
+ */
+static void *LorawanSessionManagerThread(void *td)
+{
+    ThreadVars *th_v = (ThreadVars *)td;
+    struct timeval ts;
+    uint64_t expired = 0;
+    uint32_t last_sec = 0;
+
+    /* set the thread name */
+    SCSetThreadName(th_v->name);
+    SCLogDebug("%s started...", th_v->name);
+
+    /* Set the threads capability */
+    th_v->cap_flags = 0;
+    SCDropCaps(th_v);
+
+    TmThreadsSetFlag(th_v, THV_INIT_DONE);
+    while (1)
+    {
+        TmThreadTestThreadUnPaused(th_v);
+
+        memset(&ts, 0, sizeof(ts));
+        TimeGet(&ts);
+
+        if ((uint32_t)ts.tv_sec != last_sec) {
+            expired += LorawanSessionTimeout((uint32_t)ts.tv_sec);
+            last_sec = (uint32_t)ts.tv_sec;
+        }
+
+        if (TmThreadsCheckFlag(th_v, THV_KILL)) {
+            SCPerfUpdateCounterArray(th_v->sc_perf_pca, &th_v->sc_perf_pctx, 0);
+            break;
+        }
+
+        usleep(100000);
+    }
+
+    SCLogInfo("%" PRIu64 " lorawan sessions were timed out", expired);
+    pthread_exit((void *) 0);
+}
+
+/** \brief spawn the lorawan session manager thread */
+void LorawanSessionManagerThreadSpawn(void)
+{
+    ThreadVars *tv_mgr = NULL;
+
+    tv_mgr = TmThreadCreateMgmtThread("LorawanSessionManager",
+                                      LorawanSessionManagerThread, 0);
+    if (tv_mgr == NULL) {
+        printf("ERROR: TmThreadsCreate failed\n");
+        exit(1);
+    }
+    if (TmThreadSpawn(tv_mgr) != TM_ECODE_OK) {
+        printf("ERROR: TmThreadSpawn failed\n");
+        exit(1);
+    }
+}
+
+#ifdef UNITTESTS
+
+static void LorawanSessionTestPacket(Packet *p, uint8_t mtype, uint32_t devaddr,
+                                     uint16_t fcnt, uint32_t ts)
+{
+    memset(p, 0x00, sizeof(Packet));
+    p->lorawan.mtype = mtype;
+    p->lorawan.devaddr = devaddr;
+    p->lorawan.fcnt = fcnt;
+    p->lorawan.flags = LORAWAN_HDR_HAS_FHDR;
+    p->lorawanh = &p->lorawan;
+    p->ts.tv_sec = ts;
+    p->pktlen = 20;
+}
+
+/** \test sessions are created per DevAddr, counters and FCnt tracked */
+static int LorawanSessionTest01(void)
+{
+    LorawanSession s;
+    Packet p;
+    int result = 0;
+
+    LorawanSessionInitConfig(TRUE);
+
+    LorawanSessionTestPacket(&p, UNCONFIRMED_DATA_UP, 0x26011234, 10, 1000);
+    LorawanSessionHandlePacket(NULL, &p);
+    LorawanSessionTestPacket(&p, UNCONFIRMED_DATA_UP, 0x26011234, 11, 1001);
+    LorawanSessionHandlePacket(NULL, &p);
+    LorawanSessionTestPacket(&p, UNCONFIRMED_DATA_DOWN, 0x26011234, 3, 1001);
+    LorawanSessionHandlePacket(NULL, &p);
+    LorawanSessionTestPacket(&p, UNCONFIRMED_DATA_UP, 0x26015678, 1, 1002);
+    LorawanSessionHandlePacket(NULL, &p);
+
+    if (LorawanSessionGetByDevAddr(0x26011234, &s) != 1)
+        goto end;
+    if (s.pkts_up != 2 || s.pkts_down != 1 || s.fcnt_up != 11 ||
+        s.fcnt_down != 3 || s.bytes != 60 || s.lastts != 1001)
+        goto end;
+    if (LorawanSessionGetByDevAddr(0x26015678, &s) != 1 || s.pkts_up != 1)
+        goto end;
+    if (LorawanSessionGetByDevAddr(0x26019999, &s) != 0)
+        goto end;
+
+    result = 1;
+end:
+    LorawanSessionShutdown();
+    return result;
+}
+
+/** \test 16 bit FCnt wrap is tracked as a 32 bit counter */
+static int LorawanSessionTest02(void)
+{
+    if (LorawanSessionFCnt32(0x0000fff0, 0x0005) != 0x00010005)
+        return 0;
+    if (LorawanSessionFCnt32(0x00010005, 0x0004) != 0x00010004)
+        return 0;
+    if (LorawanSessionFCnt32(0, 7) != 7)
+        return 0;
+    /* late frame from before the wrap */
+    if (LorawanSessionFCnt32(0x00010005, 0xffff) != 0x0000ffff)
+        return 0;
+    /* no wrap to go back over */
+    if (LorawanSessionFCnt32(0x00000005, 0xffff) != 0x0000ffff)
+        return 0;
+    return 1;
+}
+
+/** \test sessions time out through the wheel, busy ones stay */
+static int LorawanSessionTest03(void)
+{
+    LorawanSession s;
+    Packet p;
+    int result = 0;
+    uint32_t timeout;
+
+    LorawanSessionInitConfig(TRUE);
+    timeout = lorawan_session_config.timeout;
+    LorawanSessionTimeout(1000);
+
+    LorawanSessionTestPacket(&p, CONFIRMED_DATA_UP, 1, 1, 1000);
+    LorawanSessionHandlePacket(NULL, &p);
+    LorawanSessionTestPacket(&p, CONFIRMED_DATA_UP, 2, 1, 1000);
+    LorawanSessionHandlePacket(NULL, &p);
+    LorawanSessionTestPacket(&p, CONFIRMED_DATA_UP, 2, 2, 1000 + timeout - 1);
+    LorawanSessionHandlePacket(NULL, &p);
+
+    if (LorawanSessionTimeout(1000 + timeout - 1) != 0)
+        goto end;
+    if (LorawanSessionTimeout(1000 + timeout) != 1)
+        goto end;
+    if (LorawanSessionGetByDevAddr(1, &s) != 0 ||
+        LorawanSessionGetByDevAddr(2, &s) != 1)
+        goto end;
+    if (LorawanSessionTimeout(1000 + 2 * timeout) != 1)
+        goto end;
+
+    result = 1;
+end:
+    LorawanSessionShutdown();
+    return result;
+}
+
+/** \test JoinEUI/DevEUI index */
+static int LorawanSessionTest04(void)
+{
+    LorawanSession s;
+    Packet p;
+    int result = 0;
+
+    LorawanSessionInitConfig(TRUE);
+
+    memset(&p, 0x00, sizeof(Packet));
+    p.lorawan.mtype = JOIN_REQUEST;
+    p.lorawan.flags = LORAWAN_HDR_HAS_JOIN;
+    p.lorawan.join_eui = 0x70b3d57ed0000001ULL;
+    p.lorawan.dev_eui = 0x0004a30b001c0530ULL;
+    p.lorawan.dev_nonce = 0x1234;
+    p.lorawanh = &p.lorawan;
+    p.ts.tv_sec = 1000;
+    LorawanSessionHandlePacket(NULL, &p);
+
+    if (LorawanSessionGetByEui(p.lorawan.join_eui, p.lorawan.dev_eui, &s) != 1 ||
+        s.joins != 1 || s.dev_nonce != 0x1234)
+        goto end;
+
+    if (LorawanSessionBindEui(0x26011234, p.lorawan.join_eui, p.lorawan.dev_eui) != 0)
+        goto end;
+    if (LorawanSessionGetByDevAddr(0x26011234, &s) != 1 ||
+        !(s.flags & LORAWAN_SESSION_EUI_BOUND) || s.dev_eui != p.lorawan.dev_eui)
+        goto end;
+    if (LorawanSessionGetByEui(p.lorawan.join_eui, p.lorawan.dev_eui, &s) != 1 ||
+        s.devaddr != 0x26011234 || s.joins != 1)
+        goto end;
+
+    result = 1;
+end:
+    LorawanSessionShutdown();
+    return result;
+}
+
+/** \test FCnt window: replays, late frames, rollbacks and jumps */
+static int LorawanSessionTest05(void)
+{
+    Packet p;
+    int result = 0;
+
+    LorawanSessionInitConfig(TRUE);
+
+#define FCNT_TEST(fcnt, ts, m, ev) do {                                   \
+        LorawanSessionTestPacket(&p, UNCONFIRMED_DATA_UP, 0x26011234, (fcnt), (ts)); \
+        p.lorawan.mic = (m);                                                \
+        LorawanSessionHandlePacket(NULL, &p);                               \
+        if ((ev) == 0 && p.events.cnt != 0)                                 \
+            goto end;                                                       \
+        if ((ev) != 0 && !DECODER_ISSET_EVENT(&p, (ev)))                    \
+            goto end;                                                       \
+    } while (0)
+
+    FCNT_TEST(100, 1000, 0x1, 0);
+    FCNT_TEST(101, 1010, 0x2, 0);
+    /* same frame through a second gateway */
+    FCNT_TEST(101, 1010, 0x2, 0);
+    /* and again a minute later: replay */
+    FCNT_TEST(101, 1070, 0x2, LORAWAN_FCNT_REPLAY);
+    FCNT_TEST(105, 1080, 0x3, 0);
+    /* late but new, then replayed */
+    FCNT_TEST(103, 1081, 0x4, 0);
+    FCNT_TEST(103, 1090, 0x4, LORAWAN_FCNT_REPLAY);
+    FCNT_TEST(100, 1090, 0x1, LORAWAN_FCNT_REPLAY);
+    /* counter went back: the highest one is kept, so the old frames
+     * replayed after it are still replays */
+    FCNT_TEST(1, 1100, 0x5, LORAWAN_FCNT_ROLLBACK);
+    FCNT_TEST(2, 1101, 0x6, LORAWAN_FCNT_ROLLBACK);
+    FCNT_TEST(101, 1102, 0x2, LORAWAN_FCNT_REPLAY);
+    FCNT_TEST(105, 1103, 0x3, LORAWAN_FCNT_REPLAY);
+
+    /* a downlink doesn't make a later copy of the last uplink a dup */
+    FCNT_TEST(106, 1200, 0x9, 0);
+    LorawanSessionTestPacket(&p, UNCONFIRMED_DATA_DOWN, 0x26011234, 1, 1250);
+    LorawanSessionHandlePacket(NULL, &p);
+    FCNT_TEST(106, 1251, 0x9, LORAWAN_FCNT_REPLAY);
+
+    /* the DevAddr is given to a device: its counters start over */
+    if (LorawanSessionBindEui(0x26011234, 0x70b3d57ed0000001ULL,
+                              0x0004a30b001c0530ULL) != 0)
+        goto end;
+    FCNT_TEST(1, 1300, 0x5, 0);
+    FCNT_TEST(2, 1310, 0x6, 0);
+    /* skipped more than the max gap: flagged, and the counter stays where
+     * it was, so the device's next frame is fine */
+    FCNT_TEST(30000, 1320, 0x7, LORAWAN_FCNT_JUMP);
+    FCNT_TEST(30001, 1330, 0x8, LORAWAN_FCNT_JUMP);
+    FCNT_TEST(3, 1340, 0xb, 0);
+    FCNT_TEST(2, 1350, 0x6, LORAWAN_FCNT_REPLAY);
+
+    /* and after the device joins again */
+    memset(&p, 0x00, sizeof(Packet));
+    p.lorawan.mtype = JOIN_REQUEST;
+    p.lorawan.flags = LORAWAN_HDR_HAS_JOIN;
+    p.lorawan.join_eui = 0x70b3d57ed0000001ULL;
+    p.lorawan.dev_eui = 0x0004a30b001c0530ULL;
+    p.lorawanh = &p.lorawan;
+    p.ts.tv_sec = 1400;
+    LorawanSessionHandlePacket(NULL, &p);
+    FCNT_TEST(0, 1410, 0xa, 0);
+    FCNT_TEST(30000, 1420, 0x7, LORAWAN_FCNT_JUMP);
+
+#undef FCNT_TEST
+
+    result = 1;
+end:
+    LorawanSessionShutdown();
+    return result;
+}
+#endif /* UNITTESTS */
+
+void LorawanSessionRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("LorawanSessionTest01", LorawanSessionTest01, 1);
+    UtRegisterTest("LorawanSessionTest02", LorawanSessionTest02, 1);
+    UtRegisterTest("LorawanSessionTest03", LorawanSessionTest03, 1);
+    UtRegisterTest("LorawanSessionTest04", LorawanSessionTest04, 1);
+    UtRegisterTest("LorawanSessionTest05", LorawanSessionTest05, 1);
+#endif /* UNITTESTS */
+}
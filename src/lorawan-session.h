@@ -0,0 +1,122 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * LoRaWAN device session table.
+ */
+
+#ifndef __LORAWAN_SESSION_H__
+#define __LORAWAN_SESSION_H__
+
+#include "decode.h"
+
+#define LORAWAN_SESSION_DEFAULT_HASHSIZE    65536
+#define LORAWAN_SESSION_DEFAULT_STRIPES     64
+#define LORAWAN_SESSION_DEFAULT_TIMEOUT     3600            /**< seconds */
+#define LORAWAN_SESSION_DEFAULT_MEMCAP      (64 * 1024 * 1024)
+/** MAX_FCNT_GAP of the LoRaWAN 1.0 spec */
+#define LORAWAN_SESSION_DEFAULT_FCNT_GAP    16384
+/** seconds in which a copy of the last frame (same FCnt and MIC) is taken
+ *  to be the same frame heard by another gateway instead of a replay */
+#define LORAWAN_SESSION_DEFAULT_DUP_WINDOW  2
+
+/** FCnt values behind the last one we remember, one bit each */
+#define LORAWAN_SESSION_FCNT_WINDOW         64
+
+/** timer wheel slots, one per second. Sessions that expire more than
+ *  this many seconds from now simply stay in their slot for a few rounds */
+#define LORAWAN_SESSION_TW_SLOTS            1024
+#define LORAWAN_SESSION_TW_MASK             (LORAWAN_SESSION_TW_SLOTS - 1)
+
+/* LorawanSession flags */
+#define LORAWAN_SESSION_FCNT_UP_SEEN        0x01
+#define LORAWAN_SESSION_FCNT_DOWN_SEEN      0x02
+#define LORAWAN_SESSION_EUI_BOUND           0x04    /**< join_eui/dev_eui are set */
+#define LORAWAN_SESSION_DEVADDR_BOUND       0x08    /**< devaddr is set (eui table) */
+
+/** \brief state we keep per end-device */
+typedef struct LorawanSession_ {
+    uint32_t devaddr;               /**< key in the devaddr table */
+    uint32_t flags;
+    uint64_t join_eui;              /**< key in the eui table, with dev_eui */
+    uint64_t dev_eui;
+
+    uint32_t fcnt_up;               /**< highest uplink FCnt, 32 bit */
+    uint32_t fcnt_down;             /**< highest downlink FCnt, 32 bit */
+    uint64_t fcnt_up_win;           /**< bit n set: fcnt_up - n was seen */
+    uint64_t fcnt_down_win;
+    uint32_t last_mic;              /**< MIC of the frame with fcnt_up */
+    uint32_t last_up_ts;            /**< when that frame was first seen */
+    uint16_t dev_nonce;             /**< last DevNonce (eui table) */
+    uint16_t joins;                 /**< join requests seen (eui table) */
+    uint32_t lastts;                /**< last seen, seconds */
+    uint64_t last_gweui;            /**< last gateway that heard an uplink */
+
+    uint64_t pkts_up;
+    uint64_t pkts_down;
+    uint64_t bytes;
+
+    uint32_t expire;                /**< second this session times out */
+
+    struct LorawanSession_ *hnext;  /**< hash bucket list */
+    struct LorawanSession_ *twnext; /**< timer wheel slot list */
+    struct LorawanSession_ *twprev;
+} LorawanSession;
+
+/** \brief a stripe of the table: a lock, the timer wheel for the sessions
+ *         in the buckets it covers and a few counters.
+ *
+ *  Bucket b belongs to stripe (b & stripe_mask), so packets for different
+ *  devices hardly ever wait on the same lock. */
+typedef struct LorawanSessionStripe_ {
+    SCMutex m;
+    LorawanSession *wheel[LORAWAN_SESSION_TW_SLOTS];
+    uint32_t tw_now;                /**< second the wheel was advanced to */
+    uint32_t cnt;                   /**< sessions in this stripe */
+    uint64_t expired;
+} LorawanSessionStripe;
+
+typedef struct LorawanSessionTable_ {
+    LorawanSession **hash;
+    uint32_t hash_mask;             /**< hash_size - 1 */
+    LorawanSessionStripe *stripes;
+    uint32_t stripe_mask;           /**< nr of stripes - 1 */
+} LorawanSessionTable;
+
+typedef struct LorawanSessionConfig_ {
+    uint32_t hash_rand;
+    uint32_t hash_size;
+    uint32_t stripes;
+    uint32_t timeout;
+    uint64_t memcap;
+    uint32_t fcnt_gap;              /**< max forward FCnt jump */
+    uint32_t dup_window;
+} LorawanSessionConfig;
+
+void LorawanSessionInitConfig(char);
+void LorawanSessionShutdown(void);
+void LorawanSessionHandlePacket(ThreadVars *, Packet *);
+int LorawanSessionGetByDevAddr(uint32_t, LorawanSession *);
+int LorawanSessionGetByEui(uint64_t, uint64_t, LorawanSession *);
+int LorawanSessionBindEui(uint32_t, uint64_t, uint64_t);
+uint32_t LorawanSessionTimeout(uint32_t);
+void LorawanSessionManagerThreadSpawn(void);
+void LorawanSessionRegisterTests(void);
+
+#endif /* __LORAWAN_SESSION_H__ */
@@ -33,12 +33,28 @@
 #include "util-unittest.h"
 #include "suricata-common.h"
 #include "threads.h"
+#include "conf.h"
+#include "util-byte.h"
+#include "util-fmemopen.h"
+
+#include <sys/mman.h>
 
 /** Global trees that hold host reputation for IPV4 and IPV6 hosts */
 IPReputationCtx *rep_ctx;
 
+/** bumped for every context, so a thread can tell its cached reader slot
+ *  belongs to an older one */
+static uint32_t rep_ctx_gen = 0;
+
+/** reader slot of this thread, NULL if it has to use the shared counter */
+static __thread ReputationReader *rep_reader = NULL;
+static __thread uint32_t rep_reader_gen = 0;
+
+static void ReputationTableFree(ReputationTable *);
+
 /**
- * \brief Initialization fuction for the Reputation Context (IPV4 and IPV6)
+ * \brief Initialization fuction for the Reputation Context (IPV4, IPV6 and
+ *        DevAddr)
  *
  * \retval Pointer to the IPReputationCtx created
  *         NULL Error initializing moule;
@@ -64,6 +80,14 @@ IPReputationCtx *SCReputationInitCtx(void) {
     }
 
     SCLogDebug("Reputation IPV6 module initialized");
+
+    rep_ctx->reputationDevAddr_tree = SCRadixCreateRadixTree(SCReputationFreeData, NULL);
+    if (rep_ctx->reputationDevAddr_tree == NULL) {
+        SCLogDebug("Error initializing Reputation DevAddr module");
+        return NULL;
+    }
+
+    SCLogDebug("Reputation DevAddr module initialized");
     if (SCMutexInit(&rep_ctx->reputationIPV4_lock, NULL) != 0) {
         SCLogError(SC_ERR_MUTEX, "Mutex not correctly initialized");
         exit(EXIT_FAILURE);
@@ -72,6 +96,24 @@ IPReputationCtx *SCReputationInitCtx(void) {
         SCLogError(SC_ERR_MUTEX, "Mutex not correctly initialized");
         exit(EXIT_FAILURE);
     }
+    if (SCMutexInit(&rep_ctx->reputationDevAddr_lock, NULL) != 0) {
+        SCLogError(SC_ERR_MUTEX, "Mutex not correctly initialized");
+        exit(EXIT_FAILURE);
+    }
+
+    /* reader slots, each on a cache line of its own */
+    rep_ctx->readers_mem = SCMalloc(sizeof(ReputationReader) *
+            REPUTATION_READERS_MAX + 63);
+    if (rep_ctx->readers_mem == NULL) {
+        SCLogDebug("Error allocating the Reputation reader slots");
+        return NULL;
+    }
+    memset(rep_ctx->readers_mem, 0, sizeof(ReputationReader) *
+            REPUTATION_READERS_MAX + 63);
+    rep_ctx->readers = (ReputationReader *)(((uintptr_t)rep_ctx->readers_mem + 63) &
+            ~(uintptr_t)63);
+    rep_ctx->epoch = 1;
+    rep_ctx->gen = __sync_add_and_fetch(&rep_ctx_gen, 1);
 
     return rep_ctx;
 }
@@ -242,6 +284,625 @@ void SCReputationFreeCtx(IPReputationCtx *rep_ctx)
         rep_ctx->reputationIPV6_tree = NULL;
         SCMutexDestroy(&rep_ctx->reputationIPV6_lock);
     }
+    if (rep_ctx->reputationDevAddr_tree != NULL) {
+        SCRadixReleaseRadixTree(rep_ctx->reputationDevAddr_tree);
+        rep_ctx->reputationDevAddr_tree = NULL;
+        SCMutexDestroy(&rep_ctx->reputationDevAddr_lock);
+    }
+
+    ReputationTableFree(rep_ctx->reputationIPV4_table);
+    rep_ctx->reputationIPV4_table = NULL;
+    ReputationTableFree(rep_ctx->reputationIPV6_table);
+    rep_ctx->reputationIPV6_table = NULL;
+    ReputationTableFree(rep_ctx->reputationDevAddr_table);
+    rep_ctx->reputationDevAddr_table = NULL;
+
+    if (rep_ctx->snapshot_path != NULL) {
+        SCFree(rep_ctx->snapshot_path);
+        rep_ctx->snapshot_path = NULL;
+    }
+
+    if (rep_ctx->readers_mem != NULL) {
+        SCFree(rep_ctx->readers_mem);
+        rep_ctx->readers_mem = NULL;
+        rep_ctx->readers = NULL;
+    }
+}
+
+/* ----------------- lock free readers -------------------- */
+
+/**
+ * \brief Give this thread a reader slot of its own. Slots are not given
+ *        back, reader threads live as long as the engine does.
+ */
+static void ReputationReaderRegister(void)
+{
+    uint32_t slot = __sync_fetch_and_add(&rep_ctx->reader_cnt, 1);
+
+    if (slot < REPUTATION_READERS_MAX) {
+        rep_reader = &rep_ctx->readers[slot];
+    } else {
+        rep_reader = NULL;
+        SCLogDebug("out of reputation reader slots, sharing the counter");
+    }
+    rep_reader_gen = rep_ctx->gen;
+}
+
+/**
+ * \brief Enter a read side section. Until the matching ReputationReadEnd()
+ *        the tables this thread loads are not freed.
+ *
+ *  The reader only writes to its own slot, so readers on different cores
+ *  don't bounce a cache line between them.
+ *
+ * \retval r reader slot to pass to ReputationReadEnd()
+ */
+static inline ReputationReader *ReputationReadBegin(void)
+{
+    ReputationReader *r;
+
+    if (rep_reader_gen != rep_ctx->gen)
+        ReputationReaderRegister();
+
+    r = rep_reader;
+    if (r != NULL) {
+        r->epoch = rep_ctx->epoch;
+        /* our epoch must be visible before we load a table pointer */
+        __sync_synchronize();
+    } else {
+        __sync_fetch_and_add(&rep_ctx->overflow_readers, 1);
+    }
+    return r;
+}
+
+static inline void ReputationReadEnd(ReputationReader *r)
+{
+    if (r != NULL) {
+        /* done with the table before the writer may see us leave */
+        __sync_synchronize();
+        r->epoch = 0;
+    } else {
+        __sync_fetch_and_sub(&rep_ctx->overflow_readers, 1);
+    }
+}
+
+/**
+ * \brief Wait until no reader can still use a table that was unpublished
+ *        before this call. Writers only, never from a read side section.
+ *
+ *  A reader that entered before the new epoch may have loaded the old
+ *  pointer, so we wait for it to leave. One that enters later loads the
+ *  new one.
+ */
+static void ReputationSynchronize(void)
+{
+    uint64_t epoch = __sync_add_and_fetch(&rep_ctx->epoch, 1);
+    uint32_t cnt = rep_ctx->reader_cnt;
+    uint32_t i;
+
+    if (cnt > REPUTATION_READERS_MAX)
+        cnt = REPUTATION_READERS_MAX;
+
+    for (i = 0; i < cnt; i++) {
+        while (1) {
+            uint64_t e = rep_ctx->readers[i].epoch;
+            if (e == 0 || e >= epoch)
+                break;
+            sched_yield();
+        }
+    }
+    while (rep_ctx->overflow_readers != 0)
+        sched_yield();
+}
+
+/* ----------------- published tables -------------------- */
+
+/** a prefix collected from a radix tree */
+typedef struct ReputationPrefix_ {
+    ReputationKey key;
+    uint8_t netmask;
+    Reputation *rep;
+} ReputationPrefix;
+
+/** what is left of a prefix while we flatten the ones inside it */
+typedef struct ReputationOpenPrefix_ {
+    ReputationKey last;
+    uint32_t entry;
+} ReputationOpenPrefix;
+
+static inline int ReputationKeyCmp(const ReputationKey *a, const ReputationKey *b)
+{
+    if (a->hi != b->hi)
+        return (a->hi < b->hi) ? -1 : 1;
+    if (a->lo != b->lo)
+        return (a->lo < b->lo) ? -1 : 1;
+    return 0;
+}
+
+/**
+ * \brief Clear (fill 0) or set (fill 1) the bits of a key after the
+ *        first netmask ones: the first or the last key of the prefix
+ */
+static inline void ReputationKeyMask(ReputationKey *k, uint8_t netmask, int fill)
+{
+    uint64_t mhi = (netmask >= 64) ? ~0ULL :
+                   (netmask == 0) ? 0 : (~0ULL << (64 - netmask));
+    uint64_t mlo = (netmask <= 64) ? 0 :
+                   (netmask >= 128) ? ~0ULL : (~0ULL << (128 - netmask));
+
+    if (fill) {
+        k->hi |= ~mhi;
+        k->lo |= ~mlo;
+    } else {
+        k->hi &= mhi;
+        k->lo &= mlo;
+    }
+}
+
+/** \retval 1 if the key wrapped around */
+static inline int ReputationKeyInc(ReputationKey *k)
+{
+    if (++k->lo == 0 && ++k->hi == 0)
+        return 1;
+    return 0;
+}
+
+static inline void ReputationKeyDec(ReputationKey *k)
+{
+    if (k->lo-- == 0)
+        k->hi--;
+}
+
+/** \brief key from a big endian stream of len (4 or 16) bytes */
+static inline void ReputationKeyFromStream(ReputationKey *k, uint8_t *stream, int len)
+{
+    int i;
+
+    k->hi = 0;
+    k->lo = 0;
+    for (i = 0; i < 16; i++) {
+        uint64_t b = (i < len) ? stream[i] : 0;
+        if (i < 8)
+            k->hi = (k->hi << 8) | b;
+        else
+            k->lo = (k->lo << 8) | b;
+    }
+}
+
+static int ReputationPrefixCmp(const void *a, const void *b)
+{
+    const ReputationPrefix *pa = a, *pb = b;
+    int r = ReputationKeyCmp(&pa->key, &pb->key);
+
+    if (r != 0)
+        return r;
+    return (int)pa->netmask - (int)pb->netmask;
+}
+
+/**
+ * \brief Collect the prefixes of a (sub)tree
+ *
+ * \retval 0 ok, -1 out of memory
+ */
+static int ReputationCollectPrefixes(SCRadixNode *node, uint8_t bits,
+        ReputationPrefix **list, uint32_t *cnt, uint32_t *size)
+{
+    SCRadixUserData *ud;
+
+    if (node == NULL)
+        return 0;
+
+    if (node->prefix != NULL) {
+        for (ud = node->prefix->user_data; ud != NULL; ud = ud->next) {
+            ReputationPrefix *pfx;
+
+            if (ud->user == NULL)
+                continue;
+
+            if (*cnt == *size) {
+                uint32_t nsize = (*size == 0) ? 64 : *size * 2;
+                ReputationPrefix *nlist = SCRealloc(*list, sizeof(ReputationPrefix) * nsize);
+                if (nlist == NULL)
+                    return -1;
+                *list = nlist;
+                *size = nsize;
+            }
+
+            pfx = &(*list)[(*cnt)++];
+            ReputationKeyFromStream(&pfx->key, node->prefix->stream, bits / 8);
+            pfx->netmask = (ud->netmask > bits) ? bits : ud->netmask;
+            ReputationKeyMask(&pfx->key, pfx->netmask, 0);
+            pfx->rep = (Reputation *)ud->user;
+        }
+    }
+
+    if (ReputationCollectPrefixes(node->left, bits, list, cnt, size) < 0 ||
+        ReputationCollectPrefixes(node->right, bits, list, cnt, size) < 0)
+        return -1;
+    return 0;
+}
+
+static void ReputationTableFree(ReputationTable *t)
+{
+    if (t == NULL)
+        return;
+
+    if (t->snap != NULL) {
+        /* the arrays are in the snapshot, the last table unmaps it */
+        if (__sync_sub_and_fetch(&t->snap->refs, 1) == 0) {
+            munmap(t->snap->map, t->snap->len);
+            SCFree(t->snap);
+        }
+        SCFree(t);
+        return;
+    }
+
+    if (t->starts != NULL)
+        SCFree(t->starts);
+    if (t->runs != NULL)
+        SCFree(t->runs);
+    if (t->reps != NULL)
+        SCFree(t->reps);
+    if (t->keys != NULL)
+        SCFree(t->keys);
+    if (t->netmasks != NULL)
+        SCFree(t->netmasks);
+    SCFree(t);
+}
+
+/** \brief append a run, or grow the previous one if it has the same entry */
+static inline void ReputationTableAddRun(ReputationTable *t, ReputationKey *start,
+        uint32_t entry)
+{
+    if (t->cnt > 0 && t->runs[t->cnt - 1] == entry)
+        return;
+
+    t->starts[t->cnt] = *start;
+    t->runs[t->cnt] = entry;
+    t->cnt++;
+}
+
+/**
+ * \brief Build the table readers use from a radix tree. Call with the
+ *        tree's writer lock held.
+ *
+ *  Prefixes either nest or don't overlap at all, and sorted on key and
+ *  then netmask a prefix comes before the prefixes it contains. A stack of
+ *  the prefixes we are in tells which one is the longest match for the
+ *  keys up to the next prefix.
+ *
+ * \param tree the radix tree
+ * \param bits key length of the tree: 32 or 128
+ *
+ * \retval t the table, NULL if out of memory
+ */
+static ReputationTable *ReputationTableBuild(SCRadixTree *tree, uint8_t bits)
+{
+    ReputationPrefix *list = NULL;
+    uint32_t cnt = 0, size = 0, i, b, r;
+    ReputationOpenPrefix stack[129];
+    int top = -1;
+    int done = 0;
+    ReputationKey pos = { 0, 0 };
+    ReputationTable *t = NULL;
+
+    if (ReputationCollectPrefixes(tree->head, bits, &list, &cnt, &size) < 0)
+        goto error;
+    if (cnt > 1)
+        qsort(list, cnt, sizeof(ReputationPrefix), ReputationPrefixCmp);
+
+    t = SCMalloc(sizeof(ReputationTable));
+    if (t == NULL)
+        goto error;
+    memset(t, 0, sizeof(ReputationTable));
+    t->bits = bits;
+
+    /* every prefix opens a run and closes at most one more */
+    t->starts = SCMalloc(sizeof(ReputationKey) * (2 * cnt + 1));
+    t->runs = SCMalloc(sizeof(uint32_t) * (2 * cnt + 1));
+    t->reps = SCMalloc(sizeof(Reputation) * (cnt + 1));
+    t->keys = SCMalloc(sizeof(ReputationKey) * (cnt + 1));
+    t->netmasks = SCMalloc(sizeof(uint8_t) * (cnt + 1));
+    if (t->starts == NULL || t->runs == NULL || t->reps == NULL ||
+            t->keys == NULL || t->netmasks == NULL)
+        goto error;
+
+#define CLOSE_TOP() do { \
+        if (!done && ReputationKeyCmp(&pos, &stack[top].last) <= 0) { \
+            ReputationTableAddRun(t, &pos, stack[top].entry); \
+            pos = stack[top].last; \
+            done = ReputationKeyInc(&pos); \
+        } \
+        top--; \
+    } while (0)
+
+    for (i = 0; i < cnt; i++) {
+        ReputationPrefix *pfx = &list[i];
+        uint32_t entry;
+
+        /* the tree can have the same prefix twice, the first one wins */
+        if (i > 0 && ReputationPrefixCmp(pfx, &list[i - 1]) == 0)
+            continue;
+
+        entry = t->rep_cnt++;
+        t->reps[entry] = *pfx->rep;
+        t->keys[entry] = pfx->key;
+        t->netmasks[entry] = pfx->netmask;
+
+        while (top >= 0 && ReputationKeyCmp(&stack[top].last, &pfx->key) < 0)
+            CLOSE_TOP();
+
+        /* up to this prefix the keys belong to the one around it */
+        if (!done && ReputationKeyCmp(&pos, &pfx->key) < 0) {
+            ReputationTableAddRun(t, &pos, (top >= 0) ? stack[top].entry :
+                    REPUTATION_TABLE_NONE);
+        }
+        pos = pfx->key;
+
+        top++;
+        stack[top].last = pfx->key;
+        ReputationKeyMask(&stack[top].last, pfx->netmask, 1);
+        stack[top].entry = entry;
+    }
+    while (top >= 0)
+        CLOSE_TOP();
+    if (!done)
+        ReputationTableAddRun(t, &pos, REPUTATION_TABLE_NONE);
+#undef CLOSE_TOP
+
+    for (b = 0, r = 0; b < 256; b++) {
+        while (r < t->cnt && (t->starts[r].hi >> 56) < b)
+            r++;
+        t->index[b] = r;
+    }
+    t->index[256] = t->cnt;
+
+    if (list != NULL)
+        SCFree(list);
+    return t;
+
+error:
+    SCLogError(SC_ERR_MEM_ALLOC, "Error allocating the reputation table");
+    if (list != NULL)
+        SCFree(list);
+    ReputationTableFree(t);
+    return NULL;
+}
+
+/**
+ * \brief Find the run a key is in
+ *
+ *  The runs starting in the key's top byte are index[b] up to index[b + 1],
+ *  we want the last one that starts at or before the key. The first run
+ *  starts at key 0, so there always is one.
+ */
+static inline uint32_t ReputationTableFind(ReputationTable *t, ReputationKey *key)
+{
+    uint32_t b = (uint32_t)(key->hi >> 56);
+    uint32_t lo = t->index[b];
+    uint32_t hi = t->index[b + 1];
+
+    /* first run in [lo, hi) that starts after the key, or hi */
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (ReputationKeyCmp(&t->starts[mid], key) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - 1;
+}
+
+/**
+ * \brief Lookup in a published table. Doesn't lock.
+ *
+ * \param table the table pointer of the ctx
+ * \param key the key
+ * \param exact 1: only an entry for the host itself will do
+ *
+ * \retval Pointer to a copy of the Reputation on success;
+ *                 NULL on not finding the key
+ */
+static Reputation *ReputationTableLookup(ReputationTable * volatile *table,
+        ReputationKey *key, int exact)
+{
+    Reputation *rep_data = NULL;
+    ReputationReader *r = ReputationReadBegin();
+    ReputationTable *t = *table;
+
+    if (t != NULL) {
+        uint32_t entry = t->runs[ReputationTableFind(t, key)];
+
+        if (entry != REPUTATION_TABLE_NONE &&
+                (!exact || t->netmasks[entry] == t->bits))
+            rep_data = SCReputationClone(&t->reps[entry]);
+    }
+
+    ReputationReadEnd(r);
+    return rep_data;
+}
+
+/**
+ * \brief Fill a tree from the table that was loaded from a snapshot,
+ *        before a writer changes it. Call with the tree's writer lock held.
+ */
+static void ReputationTreeSync(SCRadixTree *tree, ReputationTable *t, uint8_t *stale)
+{
+    uint8_t stream[16];
+    uint32_t e;
+    int i;
+
+    if (!*stale)
+        return;
+    *stale = 0;
+
+    if (t == NULL || tree == NULL)
+        return;
+
+    for (e = 0; e < t->rep_cnt; e++) {
+        Reputation *rep = SCReputationClone(&t->reps[e]);
+        if (rep == NULL)
+            return;
+
+        for (i = 0; i < 8; i++) {
+            stream[i] = (uint8_t)(t->keys[e].hi >> (56 - 8 * i));
+            stream[i + 8] = (uint8_t)(t->keys[e].lo >> (56 - 8 * i));
+        }
+
+        if (t->bits == 32) {
+            if (t->netmasks[e] == 32)
+                SCRadixAddKeyIPV4(stream, tree, (void *)rep);
+            else
+                SCRadixAddKeyIPV4Netblock(stream, tree, (void *)rep, t->netmasks[e]);
+        } else {
+            if (t->netmasks[e] == 128)
+                SCRadixAddKeyIPV6(stream, tree, (void *)rep);
+            else
+                SCRadixAddKeyIPV6Netblock(stream, tree, (void *)rep, t->netmasks[e]);
+        }
+    }
+}
+
+#define ReputationSyncIPV4() \
+    ReputationTreeSync(rep_ctx->reputationIPV4_tree, \
+            rep_ctx->reputationIPV4_table, &rep_ctx->IPV4_stale)
+#define ReputationSyncIPV6() \
+    ReputationTreeSync(rep_ctx->reputationIPV6_tree, \
+            rep_ctx->reputationIPV6_table, &rep_ctx->IPV6_stale)
+#define ReputationSyncDevAddr() \
+    ReputationTreeSync(rep_ctx->reputationDevAddr_tree, \
+            rep_ctx->reputationDevAddr_table, &rep_ctx->DevAddr_stale)
+
+/**
+ * \brief Publish a radix tree: build a new table, swap it in and free the
+ *        old one once no reader can use it anymore. Call with the tree's
+ *        writer lock held.
+ *
+ * \retval 0 ok, -1 error (the old table stays, the tree is left dirty)
+ */
+static int ReputationPublishTable(ReputationTable * volatile *table,
+        SCRadixTree *tree, uint8_t bits, uint8_t *dirty)
+{
+    ReputationTable *t, *old;
+
+    t = ReputationTableBuild(tree, bits);
+    if (t == NULL)
+        return -1;
+
+    old = *table;
+    /* the table must be complete before readers can see it */
+    __sync_synchronize();
+    *table = t;
+    *dirty = 0;
+
+    ReputationSynchronize();
+    ReputationTableFree(old);
+    return 0;
+}
+
+/**
+ * \brief Publish what a writer changed in a radix tree. Call with the
+ *        tree's writer lock held.
+ *
+ *  While a batch is open, or with a publish interval, we only remember
+ *  the tree changed: rebuilding the table and waiting for the readers on
+ *  every single update would make a writer's updates O(n log n) each.
+ *
+ * \retval 0 ok, -1 error (the old table stays, the tree is left dirty)
+ */
+static int ReputationPublish(ReputationTable * volatile *table, SCRadixTree *tree,
+        uint8_t bits, uint8_t *dirty)
+{
+    *dirty = 1;
+    if (rep_ctx->batch > 0 || rep_ctx->publish_usec > 0)
+        return 0;
+
+    return ReputationPublishTable(table, tree, bits, dirty);
+}
+
+#define ReputationPublishIPV4() \
+    ReputationPublish(&rep_ctx->reputationIPV4_table, \
+            rep_ctx->reputationIPV4_tree, 32, &rep_ctx->IPV4_dirty)
+#define ReputationPublishIPV6() \
+    ReputationPublish(&rep_ctx->reputationIPV6_table, \
+            rep_ctx->reputationIPV6_tree, 128, &rep_ctx->IPV6_dirty)
+#define ReputationPublishDevAddr() \
+    ReputationPublish(&rep_ctx->reputationDevAddr_table, \
+            rep_ctx->reputationDevAddr_tree, 32, &rep_ctx->DevAddr_dirty)
+
+/**
+ * \brief Start a batch of updates. Until the last open batch is
+ *        committed, readers keep seeing the trees as they were, and a
+ *        feed of a million updates costs one table build instead of a
+ *        million.
+ */
+void SCReputationBatchBegin(void)
+{
+    __sync_fetch_and_add(&rep_ctx->batch, 1);
+}
+
+/**
+ * \brief Publish every tree that was changed since it was last published,
+ *        unless a batch is open.
+ */
+static void ReputationPublishDirty(void)
+{
+    SCMutexLock(&rep_ctx->reputationIPV4_lock);
+    if (rep_ctx->IPV4_dirty && rep_ctx->batch == 0) {
+        ReputationPublishTable(&rep_ctx->reputationIPV4_table,
+                rep_ctx->reputationIPV4_tree, 32, &rep_ctx->IPV4_dirty);
+    }
+    SCMutexUnlock(&rep_ctx->reputationIPV4_lock);
+
+    SCMutexLock(&rep_ctx->reputationIPV6_lock);
+    if (rep_ctx->IPV6_dirty && rep_ctx->batch == 0) {
+        ReputationPublishTable(&rep_ctx->reputationIPV6_table,
+                rep_ctx->reputationIPV6_tree, 128, &rep_ctx->IPV6_dirty);
+    }
+    SCMutexUnlock(&rep_ctx->reputationIPV6_lock);
+
+    SCMutexLock(&rep_ctx->reputationDevAddr_lock);
+    if (rep_ctx->DevAddr_dirty && rep_ctx->batch == 0) {
+        ReputationPublishTable(&rep_ctx->reputationDevAddr_table,
+                rep_ctx->reputationDevAddr_tree, 32, &rep_ctx->DevAddr_dirty);
+    }
+    SCMutexUnlock(&rep_ctx->reputationDevAddr_lock);
+}
+
+/**
+ * \brief Commit a batch: when it is the last open one, publish every tree
+ *        that was changed.
+ */
+void SCReputationBatchCommit(void)
+{
+    if (__sync_sub_and_fetch(&rep_ctx->batch, 1) != 0)
+        return;
+
+    ReputationPublishDirty();
+}
+
+/**
+ * \brief Publish the changes made outside a batch once every
+ *        reputation.publish-interval. Called from the main loop.
+ */
+void SCReputationPublishTick(void)
+{
+    struct timeval now;
+    uint64_t usec;
+
+    if (rep_ctx == NULL || rep_ctx->publish_usec == 0)
+        return;
+    if (!rep_ctx->IPV4_dirty && !rep_ctx->IPV6_dirty && !rep_ctx->DevAddr_dirty)
+        return;
+
+    gettimeofday(&now, NULL);
+    usec = (uint64_t)(now.tv_sec - rep_ctx->publish_last.tv_sec) * 1000000 +
+        (now.tv_usec - rep_ctx->publish_last.tv_usec);
+    if (usec < rep_ctx->publish_usec)
+        return;
+
+    rep_ctx->publish_last = now;
+    ReputationPublishDirty();
 }
 
 /**
@@ -271,8 +932,10 @@ Reputation *SCReputationAddIPV4Data(uint8_t *ipv4addr, int netmask_value, Reputa
     if (netmask_value == 32) {
         /* Be careful with the mutex */
         SCMutexLock(&rep_ctx->reputationIPV4_lock);
+        ReputationSyncIPV4();
         SCRadixAddKeyIPV4((uint8_t *)ipv4_addr, rep_ctx->reputationIPV4_tree,
                   (void *)rep_data);
+        ReputationPublishIPV4();
         SCMutexUnlock(&rep_ctx->reputationIPV4_lock);
 
     } else {
@@ -285,8 +948,10 @@ Reputation *SCReputationAddIPV4Data(uint8_t *ipv4addr, int netmask_value, Reputa
 
         /* Be careful with the mutex */
         SCMutexLock(&rep_ctx->reputationIPV4_lock);
+        ReputationSyncIPV4();
         SCRadixAddKeyIPV4Netblock((uint8_t *)ipv4_addr, rep_ctx->reputationIPV4_tree,
                       (void *)rep_data, netmask_value);
+        ReputationPublishIPV4();
         SCMutexUnlock(&rep_ctx->reputationIPV4_lock);
     }
 
@@ -295,7 +960,7 @@ Reputation *SCReputationAddIPV4Data(uint8_t *ipv4addr, int netmask_value, Reputa
 
 /**
  * \brief Retrieves the Reputation of a host (exact match), given an ipv4 address in the raw
- *        address format.
+ *        address format. Doesn't lock.
  *
  * \param ipv4_addr Pointer to a raw ipv4 address.
  *
@@ -304,27 +969,15 @@ Reputation *SCReputationAddIPV4Data(uint8_t *ipv4addr, int netmask_value, Reputa
  */
 Reputation *SCReputationLookupIPV4ExactMatch(uint8_t *ipv4_addr)
 {
-    Reputation *rep_data;
-
-    /* Be careful with this (locking)*/
-    SCMutexLock(&rep_ctx->reputationIPV4_lock);
-
-    SCRadixNode *node = SCRadixFindKeyIPV4ExactMatch(ipv4_addr, rep_ctx->reputationIPV4_tree);
-    if (node == NULL || node->prefix == NULL || node->prefix->user_data_result == NULL) {
-        rep_data = NULL;
-    } else {
-        /* Yes, we clone it because the pointer can be outdated
-         * while another thread remove this reputation */
-        rep_data = SCReputationClone((Reputation *)node->prefix->user_data_result);
-    }
+    ReputationKey key;
 
-    SCMutexUnlock(&rep_ctx->reputationIPV4_lock);
-    return rep_data;
+    ReputationKeyFromStream(&key, ipv4_addr, 4);
+    return ReputationTableLookup(&rep_ctx->reputationIPV4_table, &key, 1);
 }
 
 /**
  * \brief Retrieves the Reputation of a host (best match), given an ipv4 address in the raw
- *        address format.
+ *        address format. Doesn't lock.
  *
  * \param ipv4_addr Pointer to a raw ipv4 address.
  *
@@ -333,27 +986,15 @@ Reputation *SCReputationLookupIPV4ExactMatch(uint8_t *ipv4_addr)
  */
 Reputation *SCReputationLookupIPV4BestMatch(uint8_t *ipv4_addr)
 {
-    Reputation *rep_data;
-
-    /* Be careful with this (locking)*/
-    SCMutexLock(&rep_ctx->reputationIPV4_lock);
-
-    SCRadixNode *node = SCRadixFindKeyIPV4BestMatch(ipv4_addr, rep_ctx->reputationIPV4_tree);
-    if (node == NULL || node->prefix == NULL || node->prefix->user_data_result == NULL) {
-        rep_data = NULL;
-    } else {
-        /* Yes, we clone it because the pointer can be outdated
-         * while another thread remove this reputation */
-        rep_data = SCReputationClone((Reputation *)node->prefix->user_data_result);
-    }
+    ReputationKey key;
 
-    SCMutexUnlock(&rep_ctx->reputationIPV4_lock);
-    return rep_data;
+    ReputationKeyFromStream(&key, ipv4_addr, 4);
+    return ReputationTableLookup(&rep_ctx->reputationIPV4_table, &key, 0);
 }
 
 /**
  * \brief Retrieves the Reputation of a host (best match), given an ipv6 address in the raw
- *        address format.
+ *        address format. Doesn't lock.
  *
  * \param Pointer to a raw ipv6 address.
  *
@@ -362,27 +1003,15 @@ Reputation *SCReputationLookupIPV4BestMatch(uint8_t *ipv4_addr)
  */
 Reputation *SCReputationLookupIPV6BestMatch(uint8_t *ipv6_addr)
 {
-    Reputation *rep_data;
-
-    /* Be careful with this (locking)*/
-    SCMutexLock(&rep_ctx->reputationIPV6_lock);
+    ReputationKey key;
 
-    SCRadixNode *node = SCRadixFindKeyIPV6BestMatch(ipv6_addr, rep_ctx->reputationIPV6_tree);
-    if (node == NULL || node->prefix == NULL || node->prefix->user_data_result == NULL) {
-        rep_data = NULL;
-    } else {
-        /* Yes, we clone it because the pointer can be outdated
-         * while another thread remove this reputation */
-        rep_data = SCReputationClone((Reputation *)node->prefix->user_data_result);
-    }
-
-    SCMutexUnlock(&rep_ctx->reputationIPV6_lock);
-    return rep_data;
+    ReputationKeyFromStream(&key, ipv6_addr, 16);
+    return ReputationTableLookup(&rep_ctx->reputationIPV6_table, &key, 0);
 }
 
 /**
  * \brief Retrieves the Reputation of a host (exact match), given an ipv6 address in the raw
- *        address format.
+ *        address format. Doesn't lock.
  *
  * \param Pointer to a raw ipv6 address.
  *
@@ -391,25 +1020,12 @@ Reputation *SCReputationLookupIPV6BestMatch(uint8_t *ipv6_addr)
  */
 Reputation *SCReputationLookupIPV6ExactMatch(uint8_t *ipv6_addr)
 {
-    Reputation *rep_data;
-
-    /* Be careful with this (locking)*/
-    SCMutexLock(&rep_ctx->reputationIPV6_lock);
-
-    SCRadixNode *node = SCRadixFindKeyIPV6ExactMatch(ipv6_addr, rep_ctx->reputationIPV6_tree);
-    if (node == NULL || node->prefix == NULL || node->prefix->user_data_result == NULL) {
-        rep_data = NULL;
-    } else {
-        /* Yes, we clone it because the pointer can be outdated
-         * while another thread remove this reputation */
-        rep_data = SCReputationClone((Reputation *)node->prefix->user_data_result);
-    }
+    ReputationKey key;
 
-    SCMutexUnlock(&rep_ctx->reputationIPV6_lock);
-    return rep_data;
+    ReputationKeyFromStream(&key, ipv6_addr, 16);
+    return ReputationTableLookup(&rep_ctx->reputationIPV6_table, &key, 1);
 }
 
-
 /**
  * \brief Retrieves the Real Reputation of a host (exact match), given an ipv4 address in the raw
  *        address format. (Not thread safe!)
@@ -496,7 +1112,9 @@ Reputation *SCReputationLookupIPV6ExactMatchReal(uint8_t *ipv6_addr)
 void SCReputationRemoveIPV4Data(uint8_t * ipv4_addr, uint8_t netmask_value)
 {
     SCMutexLock(&rep_ctx->reputationIPV4_lock);
+    ReputationSyncIPV4();
     SCRadixRemoveKeyIPV4Netblock(ipv4_addr, rep_ctx->reputationIPV4_tree, netmask_value);
+    ReputationPublishIPV4();
     SCMutexUnlock(&rep_ctx->reputationIPV4_lock);
 }
 
@@ -510,7 +1128,9 @@ void SCReputationRemoveIPV4Data(uint8_t * ipv4_addr, uint8_t netmask_value)
 void SCReputationRemoveIPV6Data(uint8_t * ipv6_addr, uint8_t netmask_value)
 {
     SCMutexLock(&rep_ctx->reputationIPV6_lock);
+    ReputationSyncIPV6();
     SCRadixRemoveKeyIPV6Netblock(ipv6_addr, rep_ctx->reputationIPV6_tree, netmask_value);
+    ReputationPublishIPV6();
     SCMutexUnlock(&rep_ctx->reputationIPV6_lock);
 }
 
@@ -541,8 +1161,10 @@ Reputation *SCReputationAddIPV6Data(uint8_t *ipv6addr, int netmask_value, Reputa
     if (netmask_value == 128) {
         /* Be careful with the mutex */
         SCMutexLock(&rep_ctx->reputationIPV6_lock);
+        ReputationSyncIPV6();
         SCRadixAddKeyIPV6((uint8_t *)ipv6_addr, rep_ctx->reputationIPV6_tree,
                   (void *)rep_data);
+        ReputationPublishIPV6();
         SCMutexUnlock(&rep_ctx->reputationIPV6_lock);
 
     } else {
@@ -555,133 +1177,967 @@ Reputation *SCReputationAddIPV6Data(uint8_t *ipv6addr, int netmask_value, Reputa
 
         /* Be careful with the mutex */
         SCMutexLock(&rep_ctx->reputationIPV6_lock);
+        ReputationSyncIPV6();
         SCRadixAddKeyIPV6Netblock((uint8_t *)ipv6_addr, rep_ctx->reputationIPV6_tree,
                       (void *)rep_data, netmask_value);
+        ReputationPublishIPV6();
+        SCMutexUnlock(&rep_ctx->reputationIPV6_lock);
+    }
+
+    return rep_data;
+}
+
+/**
+ * \brief Update a reputation or insert a new one. If it doesn't exist
+ *        it will try to search for the reputation of parent subnets to
+ *        create the new reputation data based on this one
+ *
+ * \param ipv6addr pointer to the ipv6 address key
+ * \param rep_data Reputation pointer to the Reputation associated to the host/net
+ *
+ * \retval NULL On failure
+ */
+Reputation *SCReputationUpdateIPV4Data(uint8_t *ipv4addr, ReputationTransaction *rtx)
+{
+    struct in_addr *ipv4_addr = (struct in_addr *) ipv4addr;
+    Reputation *actual_rep;
+
+    if (ipv4_addr == NULL || rtx == NULL || rep_ctx == NULL) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "Invalid arguments");
+        return NULL;
+    }
+
+    /* If the reputation tree is not initialized yet */
+    if (rep_ctx->reputationIPV4_tree == NULL) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "Reputation trees not initialized");
+        return NULL;
+    }
+
+    /* Be careful with the mutex */
+    SCMutexLock(&rep_ctx->reputationIPV4_lock);
+    ReputationSyncIPV4();
+
+    /* Search exact match and update */
+    actual_rep = SCReputationLookupIPV4ExactMatchReal(ipv4addr);
+    if (actual_rep == NULL) {
+        /* else search best match (parent subnets) */
+        actual_rep =SCReputationLookupIPV4BestMatchReal(ipv4addr);
+
+        if (actual_rep != NULL) {
+            /* clone from parent and insert host */
+            actual_rep = SCReputationClone(actual_rep);
+        } else {
+            /* else insert a new reputation data for the host */
+            actual_rep = SCReputationAllocData();
+            /* If new, we only increment values */
+            rtx->flags = TRANSACTION_FLAG_INCS;
+            rtx->flags |= TRANSACTION_FLAG_NEEDSYNC;
+        }
+
+        /* insert the reputation data in the tree */
+        SCRadixAddKeyIPV4((uint8_t *)ipv4_addr, rep_ctx->reputationIPV4_tree,
+              (void *)actual_rep);
+    }
+    /* Apply updates */
+    SCReputationApplyTransaction(actual_rep, rtx);
+
+    /* readers see the change once it is published */
+    ReputationPublishIPV4();
+
+    /* Unlock! */
+    SCMutexUnlock(&rep_ctx->reputationIPV4_lock);
+
+    return actual_rep;
+}
+
+/**
+ * \brief Update a reputation or insert a new one. If it doesn't exist
+ *        it will try to search for the reputation of parent subnets to
+ *        create the new reputation data based on this one
+ *
+ * \param ipv6addr pointer to the ipv6 address key
+ * \param rep_data Reputation pointer to the Reputation associated to the host/net
+ *
+ * \retval NULL On failure
+ */
+Reputation *SCReputationUpdateIPV6Data(uint8_t *ipv6addr, ReputationTransaction *rtx)
+{
+    struct in_addr *ipv6_addr = (struct in_addr *) ipv6addr;
+    Reputation *actual_rep;
+
+    if (ipv6_addr == NULL || rtx == NULL || rep_ctx == NULL) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "Invalid arguments");
+        return NULL;
+    }
+
+    /* If the reputation tree is not initialized yet */
+    if (rep_ctx->reputationIPV6_tree == NULL) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "Reputation trees not initialized");
+        return NULL;
+    }
+
+    /* Be careful with the mutex */
+    SCMutexLock(&rep_ctx->reputationIPV6_lock);
+    ReputationSyncIPV6();
+
+    /* Search exact match and update */
+    actual_rep = SCReputationLookupIPV6ExactMatchReal(ipv6addr);
+    if (actual_rep == NULL) {
+        /* else search best match (parent subnets) */
+        actual_rep =SCReputationLookupIPV6BestMatchReal(ipv6addr);
+
+        if (actual_rep != NULL) {
+            /* clone from parent and insert host */
+            actual_rep = SCReputationClone(actual_rep);
+        } else {
+            /* else insert a new reputation data for the host */
+            actual_rep = SCReputationAllocData();
+            /* If new, we only increment values */
+            rtx->flags = TRANSACTION_FLAG_INCS;
+            rtx->flags |= TRANSACTION_FLAG_NEEDSYNC;
+        }
+
+        /* insert the reputation data in the tree */
+        SCRadixAddKeyIPV6((uint8_t *)ipv6_addr, rep_ctx->reputationIPV6_tree,
+              (void *)actual_rep);
+    }
+    /* Apply updates */
+    SCReputationApplyTransaction(actual_rep, rtx);
+
+    /* readers see the change once it is published */
+    ReputationPublishIPV6();
+
+    /* Unlock! */
+    SCMutexUnlock(&rep_ctx->reputationIPV6_lock);
+
+    return actual_rep;
+}
+
+
+/* ----------------- LoRaWAN DevAddrs -------------------- */
+
+/**
+ * \brief DevAddrs live in a 32 bit radix tree, keyed on their big endian
+ *        bytes so a prefix is the NwkID and the bits after it
+ */
+static inline void ReputationDevAddrStream(uint32_t devaddr, uint8_t *stream)
+{
+    stream[0] = (uint8_t)(devaddr >> 24);
+    stream[1] = (uint8_t)(devaddr >> 16);
+    stream[2] = (uint8_t)(devaddr >> 8);
+    stream[3] = (uint8_t)devaddr;
+}
+
+/**
+ * \brief Add the reputation of a DevAddr or of a DevAddr prefix, like a
+ *        NwkID (netmask 7). An existing entry for the same prefix is
+ *        replaced.
+ *
+ * \param devaddr the DevAddr, host order
+ * \param netmask_value number of significant bits (32 for a device)
+ * \param rep_data Reputation for the prefix, owned by the tree from now on
+ *
+ * \retval NULL On failure; rep_data on success
+ */
+Reputation *SCReputationAddDevAddrData(uint32_t devaddr, int netmask_value,
+        Reputation *rep_data)
+{
+    uint8_t key[4];
+
+    if (rep_data == NULL || rep_ctx == NULL) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "Invalid arguments");
+        return NULL;
+    }
+    if (netmask_value < 0 || netmask_value > 32) {
+        SCLogError(SC_ERR_INVALID_VALUE, "Invalid DevAddr prefix length %d",
+                netmask_value);
+        return NULL;
+    }
+
+    ReputationDevAddrStream(devaddr, key);
+
+    SCMutexLock(&rep_ctx->reputationDevAddr_lock);
+    ReputationSyncDevAddr();
+    if (netmask_value == 32) {
+        if (SC_RADIX_NODE_USERDATA(SCRadixFindKeyIPV4ExactMatch(key,
+                        rep_ctx->reputationDevAddr_tree), Reputation) != NULL)
+            SCRadixRemoveKeyIPV4(key, rep_ctx->reputationDevAddr_tree);
+        SCRadixAddKeyIPV4(key, rep_ctx->reputationDevAddr_tree, (void *)rep_data);
+    } else {
+        SCRadixChopIPAddressAgainstNetmask(key, netmask_value, 32);
+        if (SCRadixFindKeyIPV4Netblock(key, rep_ctx->reputationDevAddr_tree,
+                    netmask_value) != NULL)
+            SCRadixRemoveKeyIPV4Netblock(key, rep_ctx->reputationDevAddr_tree,
+                    netmask_value);
+        SCRadixAddKeyIPV4Netblock(key, rep_ctx->reputationDevAddr_tree,
+                (void *)rep_data, netmask_value);
+    }
+    ReputationPublishDevAddr();
+    SCMutexUnlock(&rep_ctx->reputationDevAddr_lock);
+
+    return rep_data;
+}
+
+/**
+ * \brief Remove the reputation of a DevAddr prefix
+ *
+ * \param devaddr the DevAddr, host order
+ * \param netmask_value number of significant bits (32 for a device)
+ */
+void SCReputationRemoveDevAddrData(uint32_t devaddr, uint8_t netmask_value)
+{
+    uint8_t key[4];
+
+    if (rep_ctx == NULL || netmask_value > 32)
+        return;
+
+    ReputationDevAddrStream(devaddr, key);
+    SCRadixChopIPAddressAgainstNetmask(key, netmask_value, 32);
+
+    SCMutexLock(&rep_ctx->reputationDevAddr_lock);
+    ReputationSyncDevAddr();
+    SCRadixRemoveKeyIPV4Netblock(key, rep_ctx->reputationDevAddr_tree, netmask_value);
+    ReputationPublishDevAddr();
+    SCMutexUnlock(&rep_ctx->reputationDevAddr_lock);
+}
+
+/**
+ * \brief Update the reputation of a device or insert a new one, based on
+ *        the one of its NwkID or other prefix if it has one
+ *
+ * \param devaddr the DevAddr, host order
+ * \param rtx the transaction
+ *
+ * \retval NULL On failure
+ */
+Reputation *SCReputationUpdateDevAddrData(uint32_t devaddr, ReputationTransaction *rtx)
+{
+    Reputation *actual_rep;
+    SCRadixNode *node;
+    uint8_t key[4];
+
+    if (rtx == NULL || rep_ctx == NULL) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "Invalid arguments");
+        return NULL;
+    }
+
+    ReputationDevAddrStream(devaddr, key);
+
+    SCMutexLock(&rep_ctx->reputationDevAddr_lock);
+    ReputationSyncDevAddr();
+
+    node = SCRadixFindKeyIPV4ExactMatch(key, rep_ctx->reputationDevAddr_tree);
+    actual_rep = SC_RADIX_NODE_USERDATA(node, Reputation);
+    if (actual_rep == NULL) {
+        node = SCRadixFindKeyIPV4BestMatch(key, rep_ctx->reputationDevAddr_tree);
+        actual_rep = SC_RADIX_NODE_USERDATA(node, Reputation);
+
+        if (actual_rep != NULL) {
+            actual_rep = SCReputationClone(actual_rep);
+        } else {
+            actual_rep = SCReputationAllocData();
+            rtx->flags = TRANSACTION_FLAG_INCS;
+            rtx->flags |= TRANSACTION_FLAG_NEEDSYNC;
+        }
+        if (actual_rep == NULL) {
+            SCMutexUnlock(&rep_ctx->reputationDevAddr_lock);
+            return NULL;
+        }
+
+        SCRadixAddKeyIPV4(key, rep_ctx->reputationDevAddr_tree, (void *)actual_rep);
+    }
+    SCReputationApplyTransaction(actual_rep, rtx);
+
+    ReputationPublishDevAddr();
+    SCMutexUnlock(&rep_ctx->reputationDevAddr_lock);
+
+    return actual_rep;
+}
+
+/**
+ * \brief Retrieves the Reputation of a DevAddr (best match): the one of
+ *        the longest prefix that has it. Doesn't lock.
+ *
+ * \param devaddr the DevAddr, host order
+ *
+ * \retval Pointer to a copy of the Reputation on success;
+ *                 NULL on failure, or on not finding the key;
+ */
+Reputation *SCReputationLookupDevAddrBestMatch(uint32_t devaddr)
+{
+    ReputationKey key;
+
+    if (rep_ctx == NULL)
+        return NULL;
+
+    key.hi = (uint64_t)devaddr << 32;
+    key.lo = 0;
+    return ReputationTableLookup(&rep_ctx->reputationDevAddr_table, &key, 0);
+}
+
+/**
+ * \brief Retrieves the Reputation of a device (exact match, /32). Doesn't
+ *        lock.
+ *
+ * \param devaddr the DevAddr, host order
+ *
+ * \retval Pointer to a copy of the Reputation on success;
+ *                 NULL on failure, or on not finding the key;
+ */
+Reputation *SCReputationLookupDevAddrExactMatch(uint32_t devaddr)
+{
+    ReputationKey key;
+
+    if (rep_ctx == NULL)
+        return NULL;
+
+    key.hi = (uint64_t)devaddr << 32;
+    key.lo = 0;
+    return ReputationTableLookup(&rep_ctx->reputationDevAddr_table, &key, 1);
+}
+
+/* ----------------- feeds and snapshots -------------------- */
+
+/** category names of the feed files, in REPUTATION_* order */
+static const char *rep_category_names[REPUTATION_NUMBER] = {
+    "spam", "cnc", "scan", "hostile", "dynamic", "publicaccess", "proxy",
+    "p2p", "utility", "ddos", "phish", "malware", "zombie",
+};
+
+/**
+ * \brief Set one category of a prefix in a tree, adding the prefix if
+ *        the tree doesn't have it yet. Call with the tree's writer lock held.
+ *
+ * \retval 0 ok, -1 out of memory
+ */
+static int ReputationTreeSet(SCRadixTree *tree, uint8_t *stream, uint8_t bits,
+        uint8_t netmask, int category, uint8_t value)
+{
+    SCRadixNode *node;
+    Reputation *rep;
+
+    if (netmask == bits) {
+        node = (bits == 32) ? SCRadixFindKeyIPV4ExactMatch(stream, tree) :
+                              SCRadixFindKeyIPV6ExactMatch(stream, tree);
+    } else {
+        SCRadixChopIPAddressAgainstNetmask(stream, netmask, bits);
+        node = (bits == 32) ? SCRadixFindKeyIPV4Netblock(stream, tree, netmask) :
+                              SCRadixFindKeyIPV6Netblock(stream, tree, netmask);
+    }
+
+    rep = SC_RADIX_NODE_USERDATA(node, Reputation);
+    if (rep == NULL) {
+        rep = SCReputationAllocData();
+        if (rep == NULL)
+            return -1;
+
+        if (bits == 32 && netmask == 32)
+            SCRadixAddKeyIPV4(stream, tree, (void *)rep);
+        else if (bits == 32)
+            SCRadixAddKeyIPV4Netblock(stream, tree, (void *)rep, netmask);
+        else if (netmask == 128)
+            SCRadixAddKeyIPV6(stream, tree, (void *)rep);
+        else
+            SCRadixAddKeyIPV6Netblock(stream, tree, (void *)rep, netmask);
+    }
+
+    rep->reps[category] = value;
+    return 0;
+}
+
+/**
+ * \brief Parse and apply one feed line:
+ *
+ *        <address>[/<bits>],<category>,<value>
+ *
+ *        The address is an IPv4 or IPv6 address or a DevAddr in hex, the
+ *        category a REPUTATION_* number or name, the value 0-255.
+ *
+ * \retval 1 entry set, 0 empty or comment line, -1 invalid line
+ */
+static int ReputationFeedLine(char *line)
+{
+    char *addr, *cat, *val, *mask, *saveptr = NULL;
+    uint8_t stream[16];
+    uint8_t netmask, value;
+    int category = -1;
+    int r = 0;
+    uint32_t devaddr;
+    char *end;
+
+    while (isspace((unsigned char)*line))
+        line++;
+    if (*line == '\0' || *line == '#')
+        return 0;
+    line[strcspn(line, "\r\n")] = '\0';
+
+    addr = strtok_r(line, ",", &saveptr);
+    cat = strtok_r(NULL, ",", &saveptr);
+    val = strtok_r(NULL, ",", &saveptr);
+    if (addr == NULL || cat == NULL || val == NULL ||
+            strtok_r(NULL, ",", &saveptr) != NULL)
+        return -1;
+
+    while (isspace((unsigned char)*cat))
+        cat++;
+    if (isdigit((unsigned char)*cat)) {
+        if (ByteExtractStringUint8(&value, 10, 0, cat) <= 0 ||
+                value >= REPUTATION_NUMBER)
+            return -1;
+        category = value;
+    } else {
+        for (category = REPUTATION_NUMBER - 1; category >= 0; category--) {
+            if (strncasecmp(cat, rep_category_names[category],
+                        strlen(rep_category_names[category])) == 0 &&
+                    (cat[strlen(rep_category_names[category])] == '\0' ||
+                     isspace((unsigned char)cat[strlen(rep_category_names[category])])))
+                break;
+        }
+        if (category < 0)
+            return -1;
+    }
+
+    while (isspace((unsigned char)*val))
+        val++;
+    if (ByteExtractStringUint8(&value, 10, 0, val) <= 0)
+        return -1;
+
+    mask = strchr(addr, '/');
+    if (mask != NULL)
+        *mask++ = '\0';
+
+    memset(stream, 0, sizeof(stream));
+    if (strchr(addr, ':') != NULL) {
+        if (inet_pton(AF_INET6, addr, stream) <= 0)
+            return -1;
+        netmask = 128;
+        if (mask != NULL && (ByteExtractStringUint8(&netmask, 10, 0, mask) <= 0 ||
+                    netmask > 128))
+            return -1;
+
+        SCMutexLock(&rep_ctx->reputationIPV6_lock);
+        ReputationSyncIPV6();
+        r = ReputationTreeSet(rep_ctx->reputationIPV6_tree, stream, 128, netmask,
+                category, value);
+        ReputationPublishIPV6();
         SCMutexUnlock(&rep_ctx->reputationIPV6_lock);
+
+    } else if (strchr(addr, '.') != NULL) {
+        if (inet_pton(AF_INET, addr, stream) <= 0)
+            return -1;
+        netmask = 32;
+        if (mask != NULL && (ByteExtractStringUint8(&netmask, 10, 0, mask) <= 0 ||
+                    netmask > 32))
+            return -1;
+
+        SCMutexLock(&rep_ctx->reputationIPV4_lock);
+        ReputationSyncIPV4();
+        r = ReputationTreeSet(rep_ctx->reputationIPV4_tree, stream, 32, netmask,
+                category, value);
+        ReputationPublishIPV4();
+        SCMutexUnlock(&rep_ctx->reputationIPV4_lock);
+
+    } else {
+        errno = 0;
+        devaddr = (uint32_t)strtoul(addr, &end, 16);
+        if (errno != 0 || end == addr || *end != '\0' || strlen(addr) > 10)
+            return -1;
+        netmask = 32;
+        if (mask != NULL && (ByteExtractStringUint8(&netmask, 10, 0, mask) <= 0 ||
+                    netmask > 32))
+            return -1;
+        ReputationDevAddrStream(devaddr, stream);
+
+        SCMutexLock(&rep_ctx->reputationDevAddr_lock);
+        ReputationSyncDevAddr();
+        r = ReputationTreeSet(rep_ctx->reputationDevAddr_tree, stream, 32, netmask,
+                category, value);
+        ReputationPublishDevAddr();
+        SCMutexUnlock(&rep_ctx->reputationDevAddr_lock);
+    }
+
+    return (r < 0) ? -1 : 1;
+}
+
+/**
+ * \brief Load a feed from an open file, all of it in one batch
+ *
+ * \retval cnt number of entries set
+ */
+static int ReputationLoadFeedFp(FILE *fp, const char *name)
+{
+    char line[1024];
+    int lineno = 0, cnt = 0, bad = 0;
+
+    SCReputationBatchBegin();
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        int r = ReputationFeedLine(line);
+
+        lineno++;
+        if (r > 0) {
+            cnt++;
+        } else if (r < 0) {
+            if (bad++ < 10)
+                SCLogWarning(SC_ERR_REPUTATION, "%s:%d: invalid reputation "
+                        "line", name, lineno);
+        }
+    }
+    SCReputationBatchCommit();
+
+    SCLogInfo("%d reputation entries loaded from %s, %d invalid lines",
+            cnt, name, bad);
+    return cnt;
+}
+
+/**
+ * \brief Load a reputation feed file, one "<address>[/<bits>],<category>,
+ *        <value>" per line. The whole file is published at once.
+ *
+ * \retval cnt number of entries set, -1 if the file can't be read
+ */
+int SCReputationLoadFeed(const char *path)
+{
+    FILE *fp;
+    int cnt;
+
+    if (rep_ctx == NULL || path == NULL)
+        return -1;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        SCLogError(SC_ERR_OPENING_FILE, "failed to open reputation feed %s: %s",
+                path, strerror(errno));
+        return -1;
+    }
+    cnt = ReputationLoadFeedFp(fp, path);
+    fclose(fp);
+    return cnt;
+}
+
+/** \brief bytes the arrays of a table take in a snapshot */
+static uint64_t ReputationSnapshotTableSize(uint32_t cnt, uint32_t rep_cnt)
+{
+    uint64_t size = (uint64_t)cnt * (sizeof(ReputationKey) + sizeof(uint32_t)) +
+                    (uint64_t)rep_cnt * (sizeof(ReputationKey) + sizeof(Reputation) +
+                                         sizeof(uint8_t));
+    return (size + 7) & ~(uint64_t)7;
+}
+
+/**
+ * \brief Write the tables readers see to a snapshot file. The file is
+ *        written next to path and renamed over it, so an engine that has
+ *        the old one mapped keeps using it until it reloads.
+ *
+ * \retval 0 ok, -1 error
+ */
+int SCReputationSaveSnapshot(const char *path)
+{
+    ReputationSnapshotHdr hdr;
+    ReputationTable *tables[REPUTATION_SNAPSHOT_TABLES];
+    ReputationTable *built[REPUTATION_SNAPSHOT_TABLES] = { NULL, NULL, NULL };
+    SCRadixTree *trees[REPUTATION_SNAPSHOT_TABLES];
+    uint8_t bits[REPUTATION_SNAPSHOT_TABLES] = { 32, 128, 32 };
+    static const uint8_t zero[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    char *tmp = NULL;
+    FILE *fp = NULL;
+    uint64_t off;
+    int i, r = -1;
+
+    if (rep_ctx == NULL || path == NULL)
+        return -1;
+
+    /* the writer locks keep the tables from being freed under us */
+    SCMutexLock(&rep_ctx->reputationIPV4_lock);
+    SCMutexLock(&rep_ctx->reputationIPV6_lock);
+    SCMutexLock(&rep_ctx->reputationDevAddr_lock);
+
+    tables[0] = rep_ctx->reputationIPV4_table;
+    tables[1] = rep_ctx->reputationIPV6_table;
+    tables[2] = rep_ctx->reputationDevAddr_table;
+    trees[0] = rep_ctx->reputationIPV4_tree;
+    trees[1] = rep_ctx->reputationIPV6_tree;
+    trees[2] = rep_ctx->reputationDevAddr_tree;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = REPUTATION_SNAPSHOT_MAGIC;
+    hdr.version = REPUTATION_SNAPSHOT_VERSION;
+    hdr.rep_size = sizeof(Reputation);
+    hdr.tables = REPUTATION_SNAPSHOT_TABLES;
+
+    off = (sizeof(hdr) + 7) & ~(uint64_t)7;
+    for (i = 0; i < REPUTATION_SNAPSHOT_TABLES; i++) {
+        if (tables[i] == NULL) {
+            /* nothing published yet: an empty table */
+            built[i] = ReputationTableBuild(trees[i], bits[i]);
+            if (built[i] == NULL)
+                goto end;
+            tables[i] = built[i];
+        }
+        hdr.table[i].offset = off;
+        hdr.table[i].cnt = tables[i]->cnt;
+        hdr.table[i].rep_cnt = tables[i]->rep_cnt;
+        hdr.table[i].bits = tables[i]->bits;
+        memcpy(hdr.table[i].index, tables[i]->index, sizeof(hdr.table[i].index));
+        off += ReputationSnapshotTableSize(tables[i]->cnt, tables[i]->rep_cnt);
+    }
+    hdr.size = off;
+
+    tmp = SCMalloc(strlen(path) + 5);
+    if (tmp == NULL)
+        goto end;
+    snprintf(tmp, strlen(path) + 5, "%s.tmp", path);
+
+    fp = fopen(tmp, "wb");
+    if (fp == NULL) {
+        SCLogError(SC_ERR_OPENING_FILE, "failed to open %s: %s", tmp,
+                strerror(errno));
+        goto end;
+    }
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+            fwrite(zero, ((sizeof(hdr) + 7) & ~7) - sizeof(hdr), 1, fp) > 1)
+        goto write_error;
+
+    for (i = 0; i < REPUTATION_SNAPSHOT_TABLES; i++) {
+        ReputationTable *t = tables[i];
+        uint64_t len = (uint64_t)t->cnt * (sizeof(ReputationKey) + sizeof(uint32_t)) +
+                       (uint64_t)t->rep_cnt * (sizeof(ReputationKey) +
+                                               sizeof(Reputation) + sizeof(uint8_t));
+
+        if (fwrite(t->starts, sizeof(ReputationKey), t->cnt, fp) != t->cnt ||
+            fwrite(t->keys, sizeof(ReputationKey), t->rep_cnt, fp) != t->rep_cnt ||
+            fwrite(t->reps, sizeof(Reputation), t->rep_cnt, fp) != t->rep_cnt ||
+            fwrite(t->runs, sizeof(uint32_t), t->cnt, fp) != t->cnt ||
+            fwrite(t->netmasks, sizeof(uint8_t), t->rep_cnt, fp) != t->rep_cnt)
+            goto write_error;
+        if (((len + 7) & ~7) != len &&
+                fwrite(zero, ((len + 7) & ~7) - len, 1, fp) != 1)
+            goto write_error;
+    }
+
+    if (fflush(fp) != 0 || fsync(fileno(fp)) != 0)
+        goto write_error;
+    fclose(fp);
+    fp = NULL;
+
+    if (rename(tmp, path) != 0) {
+        SCLogError(SC_ERR_REPUTATION, "failed to rename %s to %s: %s", tmp,
+                path, strerror(errno));
+        unlink(tmp);
+        goto end;
+    }
+
+    SCLogInfo("reputation snapshot %s written: %"PRIu64" bytes", path, hdr.size);
+    r = 0;
+    goto end;
+
+write_error:
+    SCLogError(SC_ERR_REPUTATION, "failed to write %s: %s", tmp, strerror(errno));
+    fclose(fp);
+    fp = NULL;
+    unlink(tmp);
+end:
+    SCMutexUnlock(&rep_ctx->reputationDevAddr_lock);
+    SCMutexUnlock(&rep_ctx->reputationIPV6_lock);
+    SCMutexUnlock(&rep_ctx->reputationIPV4_lock);
+
+    for (i = 0; i < REPUTATION_SNAPSHOT_TABLES; i++)
+        ReputationTableFree(built[i]);
+    if (tmp != NULL)
+        SCFree(tmp);
+    return r;
+}
+
+/**
+ * \brief Point a table at its arrays in a mapped snapshot and check them,
+ *        a lookup must never leave the table whatever the file holds
+ *
+ * \retval t the table, NULL if the snapshot is broken
+ */
+static ReputationTable *ReputationSnapshotTableMap(ReputationSnapshot *snap,
+        ReputationSnapshotTable *st, uint8_t bits)
+{
+    ReputationTable *t;
+    uint8_t *base;
+    uint32_t i, b, r;
+
+    if (st->bits != bits || st->cnt == 0 || (st->offset & 7) != 0 ||
+            st->offset > snap->len ||
+            ReputationSnapshotTableSize(st->cnt, st->rep_cnt) > snap->len - st->offset)
+        return NULL;
+
+    t = SCMalloc(sizeof(ReputationTable));
+    if (t == NULL)
+        return NULL;
+    memset(t, 0, sizeof(ReputationTable));
+
+    base = (uint8_t *)snap->map + st->offset;
+    t->cnt = st->cnt;
+    t->rep_cnt = st->rep_cnt;
+    t->bits = bits;
+    t->starts = (ReputationKey *)base;
+    base += sizeof(ReputationKey) * t->cnt;
+    t->keys = (ReputationKey *)base;
+    base += sizeof(ReputationKey) * t->rep_cnt;
+    t->reps = (Reputation *)base;
+    base += sizeof(Reputation) * t->rep_cnt;
+    t->runs = (uint32_t *)base;
+    base += sizeof(uint32_t) * t->cnt;
+    t->netmasks = base;
+    memcpy(t->index, st->index, sizeof(t->index));
+
+    if (t->starts[0].hi != 0 || t->starts[0].lo != 0)
+        goto error;
+    for (i = 0; i < t->cnt; i++) {
+        if (i > 0 && ReputationKeyCmp(&t->starts[i - 1], &t->starts[i]) >= 0)
+            goto error;
+        if (t->runs[i] != REPUTATION_TABLE_NONE && t->runs[i] >= t->rep_cnt)
+            goto error;
+    }
+    for (i = 0; i < t->rep_cnt; i++) {
+        if (t->netmasks[i] > bits)
+            goto error;
     }
+    for (b = 0, r = 0; b < 256; b++) {
+        while (r < t->cnt && (t->starts[r].hi >> 56) < b)
+            r++;
+        if (t->index[b] != r)
+            goto error;
+    }
+    if (t->index[256] != t->cnt)
+        goto error;
 
-    return rep_data;
+    return t;
+
+error:
+    SCFree(t);
+    return NULL;
 }
 
 /**
- * \brief Update a reputation or insert a new one. If it doesn't exist
- *        it will try to search for the reputation of parent subnets to
- *        create the new reputation data based on this one
+ * \brief Swap a table loaded from a snapshot in. The tree no longer has
+ *        what readers see, it is replaced by an empty one and the first
+ *        writer refills it from the table.
+ */
+static void ReputationSnapshotInstall(SCMutex *lock, ReputationTable * volatile *table,
+        SCRadixTree **tree, uint8_t *dirty, uint8_t *stale, ReputationTable *t,
+        SCRadixTree *new_tree)
+{
+    ReputationTable *old;
+
+    SCMutexLock(lock);
+    old = *table;
+    __sync_synchronize();
+    *table = t;
+    ReputationSynchronize();
+    ReputationTableFree(old);
+
+    SCRadixReleaseRadixTree(*tree);
+    *tree = new_tree;
+    *dirty = 0;
+    *stale = 1;
+    SCMutexUnlock(lock);
+}
+
+/**
+ * \brief Map a snapshot and make its tables the ones readers use. Safe
+ *        while detection runs: readers move over to the new tables with
+ *        their next lookup and nobody waits for the file to load.
  *
- * \param ipv6addr pointer to the ipv6 address key
- * \param rep_data Reputation pointer to the Reputation associated to the host/net
+ *  Replaces everything, including changes made since the snapshot was
+ *  written.
  *
- * \retval NULL On failure
+ * \retval 0 ok, -1 error (nothing changed)
  */
-Reputation *SCReputationUpdateIPV4Data(uint8_t *ipv4addr, ReputationTransaction *rtx)
+int SCReputationLoadSnapshot(const char *path)
 {
-    struct in_addr *ipv4_addr = (struct in_addr *) ipv4addr;
-    Reputation *actual_rep;
-
-    if (ipv4_addr == NULL || rtx == NULL || rep_ctx == NULL) {
-        SCLogError(SC_ERR_INVALID_ARGUMENT, "Invalid arguments");
-        return NULL;
+    ReputationSnapshotHdr *hdr;
+    ReputationSnapshot *snap = NULL;
+    ReputationTable *t[REPUTATION_SNAPSHOT_TABLES] = { NULL, NULL, NULL };
+    SCRadixTree *tree[REPUTATION_SNAPSHOT_TABLES] = { NULL, NULL, NULL };
+    uint8_t bits[REPUTATION_SNAPSHOT_TABLES] = { 32, 128, 32 };
+    struct stat st;
+    void *map;
+    int fd, i;
+
+    if (rep_ctx == NULL || path == NULL)
+        return -1;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        SCLogError(SC_ERR_OPENING_FILE, "failed to open reputation snapshot "
+                "%s: %s", path, strerror(errno));
+        return -1;
     }
-
-    /* If the reputation tree is not initialized yet */
-    if (rep_ctx->reputationIPV4_tree == NULL) {
-        SCLogError(SC_ERR_INVALID_ARGUMENT, "Reputation trees not initialized");
-        return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ReputationSnapshotHdr)) {
+        SCLogError(SC_ERR_REPUTATION, "%s is not a reputation snapshot", path);
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        SCLogError(SC_ERR_REPUTATION, "failed to map %s: %s", path,
+                strerror(errno));
+        return -1;
     }
 
-    /* Be careful with the mutex */
-    SCMutexLock(&rep_ctx->reputationIPV4_lock);
+    hdr = (ReputationSnapshotHdr *)map;
+    if (hdr->magic != REPUTATION_SNAPSHOT_MAGIC ||
+            hdr->version != REPUTATION_SNAPSHOT_VERSION ||
+            hdr->rep_size != sizeof(Reputation) ||
+            hdr->tables != REPUTATION_SNAPSHOT_TABLES ||
+            hdr->size != (uint64_t)st.st_size) {
+        SCLogError(SC_ERR_REPUTATION, "%s is not a reputation snapshot of "
+                "this version and architecture", path);
+        goto error;
+    }
 
-    /* Search exact match and update */
-    actual_rep = SCReputationLookupIPV4ExactMatchReal(ipv4addr);
-    if (actual_rep == NULL) {
-        /* else search best match (parent subnets) */
-        actual_rep =SCReputationLookupIPV4BestMatchReal(ipv4addr);
+    snap = SCMalloc(sizeof(ReputationSnapshot));
+    if (snap == NULL)
+        goto error;
+    snap->map = map;
+    snap->len = (size_t)st.st_size;
+    snap->refs = REPUTATION_SNAPSHOT_TABLES;
 
-        if (actual_rep != NULL) {
-            /* clone from parent and insert host */
-            actual_rep = SCReputationClone(actual_rep);
-        } else {
-            /* else insert a new reputation data for the host */
-            actual_rep = SCReputationAllocData();
-            /* If new, we only increment values */
-            rtx->flags = TRANSACTION_FLAG_INCS;
-            rtx->flags |= TRANSACTION_FLAG_NEEDSYNC;
+    for (i = 0; i < REPUTATION_SNAPSHOT_TABLES; i++) {
+        t[i] = ReputationSnapshotTableMap(snap, &hdr->table[i], bits[i]);
+        if (t[i] == NULL) {
+            SCLogError(SC_ERR_REPUTATION, "reputation snapshot %s is corrupt",
+                    path);
+            goto error;
         }
+        t[i]->snap = snap;
+
+        /* the empty trees the writers start over with, allocated up front
+         * so we don't install half a snapshot */
+        tree[i] = SCRadixCreateRadixTree(SCReputationFreeData, NULL);
+        if (tree[i] == NULL) {
+            SCLogError(SC_ERR_MEM_ALLOC, "Error allocating the reputation "
+                    "trees for snapshot %s", path);
+            goto error;
+        }
+    }
 
-        /* insert the reputation data in the tree */
-        SCRadixAddKeyIPV4((uint8_t *)ipv4_addr, rep_ctx->reputationIPV4_tree,
-              (void *)actual_rep);
+    ReputationSnapshotInstall(&rep_ctx->reputationIPV4_lock,
+            &rep_ctx->reputationIPV4_table, &rep_ctx->reputationIPV4_tree,
+            &rep_ctx->IPV4_dirty, &rep_ctx->IPV4_stale, t[0], tree[0]);
+    ReputationSnapshotInstall(&rep_ctx->reputationIPV6_lock,
+            &rep_ctx->reputationIPV6_table, &rep_ctx->reputationIPV6_tree,
+            &rep_ctx->IPV6_dirty, &rep_ctx->IPV6_stale, t[1], tree[1]);
+    ReputationSnapshotInstall(&rep_ctx->reputationDevAddr_lock,
+            &rep_ctx->reputationDevAddr_table, &rep_ctx->reputationDevAddr_tree,
+            &rep_ctx->DevAddr_dirty, &rep_ctx->DevAddr_stale, t[2], tree[2]);
+
+    SCLogInfo("reputation snapshot %s loaded: %"PRIu32" IPv4, %"PRIu32" IPv6 "
+            "and %"PRIu32" DevAddr prefixes", path, t[0]->rep_cnt,
+            t[1]->rep_cnt, t[2]->rep_cnt);
+    return 0;
+
+error:
+    for (i = 0; i < REPUTATION_SNAPSHOT_TABLES; i++) {
+        if (t[i] != NULL)
+            SCFree(t[i]);
+        if (tree[i] != NULL)
+            SCRadixReleaseRadixTree(tree[i]);
     }
-    /* Apply updates */
-    SCReputationApplyTransaction(actual_rep, rtx);
+    if (snap != NULL)
+        SCFree(snap);
+    munmap(map, (size_t)st.st_size);
+    return -1;
+}
 
-    /* Unlock! */
-    SCMutexUnlock(&rep_ctx->reputationIPV4_lock);
+/**
+ * \brief Load the configured snapshot again, after it was replaced
+ *
+ * \retval 0 ok, -1 error or no snapshot configured
+ */
+int SCReputationReloadSnapshot(void)
+{
+    if (rep_ctx == NULL || rep_ctx->snapshot_path == NULL)
+        return -1;
 
-    return actual_rep;
+    return SCReputationLoadSnapshot(rep_ctx->snapshot_path);
 }
 
 /**
- * \brief Update a reputation or insert a new one. If it doesn't exist
- *        it will try to search for the reputation of parent subnets to
- *        create the new reputation data based on this one
+ * \brief Check if the snapshot still has what the feeds have
  *
- * \param ipv6addr pointer to the ipv6 address key
- * \param rep_data Reputation pointer to the Reputation associated to the host/net
+ * \param snapshot path of the snapshot
+ * \param feeds the reputation.feeds list, may be NULL
  *
- * \retval NULL On failure
+ * \retval 1 a feed was changed after the snapshot was written, or there
+ *           is no snapshot; 0 the snapshot is up to date
  */
-Reputation *SCReputationUpdateIPV6Data(uint8_t *ipv6addr, ReputationTransaction *rtx)
+static int ReputationSnapshotIsStale(const char *snapshot, ConfNode *feeds)
 {
-    struct in_addr *ipv6_addr = (struct in_addr *) ipv6addr;
-    Reputation *actual_rep;
+    struct stat snap_st, feed_st;
+    ConfNode *file;
 
-    if (ipv6_addr == NULL || rtx == NULL || rep_ctx == NULL) {
-        SCLogError(SC_ERR_INVALID_ARGUMENT, "Invalid arguments");
-        return NULL;
-    }
+    if (stat(snapshot, &snap_st) != 0)
+        return 1;
+    if (feeds == NULL)
+        return 0;
 
-    /* If the reputation tree is not initialized yet */
-    if (rep_ctx->reputationIPV6_tree == NULL) {
-        SCLogError(SC_ERR_INVALID_ARGUMENT, "Reputation trees not initialized");
-        return NULL;
+    TAILQ_FOREACH(file, &feeds->head, next) {
+        if (file->val == NULL || stat(file->val, &feed_st) != 0)
+            continue;
+        if (feed_st.st_mtime > snap_st.st_mtime) {
+            SCLogInfo("reputation feed %s is newer than snapshot %s, "
+                    "rebuilding it", file->val, snapshot);
+            return 1;
+        }
     }
+    return 0;
+}
 
-    /* Be careful with the mutex */
-    SCMutexLock(&rep_ctx->reputationIPV6_lock);
+/**
+ * \brief Load the reputation data configured in the reputation section:
+ *        the snapshot if it can be loaded and no feed changed since it was
+ *        written, otherwise the feeds. Those are then written to the
+ *        snapshot, so the next start is quick.
+ */
+void SCReputationInitConfig(void)
+{
+    char *snapshot = NULL;
+    ConfNode *feeds, *file;
+    intmax_t interval = REPUTATION_PUBLISH_INTERVAL;
+    int loaded = 0;
 
-    /* Search exact match and update */
-    actual_rep = SCReputationLookupIPV6ExactMatchReal(ipv6addr);
-    if (actual_rep == NULL) {
-        /* else search best match (parent subnets) */
-        actual_rep =SCReputationLookupIPV6BestMatchReal(ipv6addr);
+    if (rep_ctx == NULL)
+        return;
 
-        if (actual_rep != NULL) {
-            /* clone from parent and insert host */
-            actual_rep = SCReputationClone(actual_rep);
-        } else {
-            /* else insert a new reputation data for the host */
-            actual_rep = SCReputationAllocData();
-            /* If new, we only increment values */
-            rtx->flags = TRANSACTION_FLAG_INCS;
-            rtx->flags |= TRANSACTION_FLAG_NEEDSYNC;
-        }
+    if (ConfGetInt("reputation.publish-interval", &interval) == 1 &&
+            (interval < 0 || interval > 60000)) {
+        SCLogWarning(SC_ERR_INVALID_ARGUMENT, "invalid reputation."
+                "publish-interval %" PRIdMAX ", using %d ms", interval,
+                REPUTATION_PUBLISH_INTERVAL);
+        interval = REPUTATION_PUBLISH_INTERVAL;
+    }
+    rep_ctx->publish_usec = (uint32_t)interval * 1000;
+    gettimeofday(&rep_ctx->publish_last, NULL);
 
-        /* insert the reputation data in the tree */
-        SCRadixAddKeyIPV6((uint8_t *)ipv6_addr, rep_ctx->reputationIPV6_tree,
-              (void *)actual_rep);
+    feeds = ConfGetNode("reputation.feeds");
+
+    if (ConfGet("reputation.snapshot", &snapshot) == 1 && snapshot != NULL) {
+        rep_ctx->snapshot_path = SCStrdup(snapshot);
+        if (access(snapshot, R_OK) == 0 &&
+                !ReputationSnapshotIsStale(snapshot, feeds) &&
+                SCReputationLoadSnapshot(snapshot) == 0)
+            return;
     }
-    /* Apply updates */
-    SCReputationApplyTransaction(actual_rep, rtx);
 
-    /* Unlock! */
-    SCMutexUnlock(&rep_ctx->reputationIPV6_lock);
+    if (feeds != NULL) {
+        TAILQ_FOREACH(file, &feeds->head, next) {
+            if (SCReputationLoadFeed(file->val) >= 0)
+                loaded++;
+        }
+    }
 
-    return actual_rep;
+    if (loaded > 0 && rep_ctx->snapshot_path != NULL)
+        SCReputationSaveSnapshot(rep_ctx->snapshot_path);
 }
 
-
 /* ----------------- UNITTESTS-------------------- */
 #ifdef UNITTESTS
 
@@ -1429,6 +2885,561 @@ error:
     return 0;
 }
 
+static Reputation *SCReputationTestDevAddrRep(uint8_t val)
+{
+    Reputation *rep = SCReputationAllocData();
+    int i;
+
+    if (rep != NULL) {
+        for (i = 0; i < REPUTATION_NUMBER; i++)
+            rep->reps[i] = val;
+    }
+    return rep;
+}
+
+/** \retval 1 if devaddr best matches a prefix with reputation val, or
+ *            nothing at all for val 0 */
+static int SCReputationTestDevAddrCheck(uint32_t devaddr, uint8_t val, int exact)
+{
+    Reputation *rep = exact ? SCReputationLookupDevAddrExactMatch(devaddr) :
+                              SCReputationLookupDevAddrBestMatch(devaddr);
+    int r;
+
+    if (rep == NULL)
+        return (val == 0);
+    r = (rep->reps[REPUTATION_CNC] == val);
+    SCReputationFreeData(rep);
+    return r;
+}
+
+/**
+ * \test DevAddr prefixes: NwkID, nested prefixes, devices, replacing and
+ *       removing entries
+ */
+int SCReputationTestDevAddrBestMatch01(void)
+{
+    int result = 0;
+
+    SCReputationInitCtx();
+    if (rep_ctx == NULL) {
+        SCLogInfo("Error initializing Reputation Module");
+        return 0;
+    }
+
+    /* nothing there yet */
+    if (!SCReputationTestDevAddrCheck(0x26011234, 0, 0))
+        goto end;
+
+    /* NwkID 0x13 and a /16 and a device inside it */
+    if (SCReputationAddDevAddrData(0x26000000, 7, SCReputationTestDevAddrRep(10)) == NULL ||
+        SCReputationAddDevAddrData(0x2601ffff, 16, SCReputationTestDevAddrRep(20)) == NULL ||
+        SCReputationAddDevAddrData(0x26011234, 32, SCReputationTestDevAddrRep(30)) == NULL ||
+        SCReputationAddDevAddrData(0xff000000, 8, SCReputationTestDevAddrRep(40)) == NULL)
+        goto end;
+    Reputation *bad = SCReputationTestDevAddrRep(1);
+    if (SCReputationAddDevAddrData(0x26011234, 33, bad) != NULL)
+        goto end;
+    SCReputationFreeData(bad);
+
+    if (REPUTATION_DEVADDR_NWKID(0x27ffffff) != 0x13)
+        goto end;
+
+    if (!SCReputationTestDevAddrCheck(0x26011234, 30, 0) ||
+        !SCReputationTestDevAddrCheck(0x26011234, 30, 1) ||
+        !SCReputationTestDevAddrCheck(0x26011233, 20, 0) ||
+        !SCReputationTestDevAddrCheck(0x26011233, 0, 1) ||
+        !SCReputationTestDevAddrCheck(0x26010000, 20, 0) ||
+        !SCReputationTestDevAddrCheck(0x2601ffff, 20, 0) ||
+        !SCReputationTestDevAddrCheck(0x26020000, 10, 0) ||
+        !SCReputationTestDevAddrCheck(0x26000000, 10, 0) ||
+        !SCReputationTestDevAddrCheck(0x27ffffff, 10, 0) ||
+        !SCReputationTestDevAddrCheck(0x28000000, 0, 0) ||
+        !SCReputationTestDevAddrCheck(0x25ffffff, 0, 0) ||
+        !SCReputationTestDevAddrCheck(0xffffffff, 40, 0) ||
+        !SCReputationTestDevAddrCheck(0x00000000, 0, 0))
+        goto end;
+
+    /* replace the /16, then drop it: its addresses fall back to the NwkID */
+    if (SCReputationAddDevAddrData(0x26010000, 16, SCReputationTestDevAddrRep(25)) == NULL)
+        goto end;
+    if (!SCReputationTestDevAddrCheck(0x26010000, 25, 0))
+        goto end;
+    SCReputationRemoveDevAddrData(0x26010000, 16);
+    if (!SCReputationTestDevAddrCheck(0x26010000, 10, 0) ||
+        !SCReputationTestDevAddrCheck(0x26011234, 30, 0))
+        goto end;
+
+    /* a default for every address */
+    if (SCReputationAddDevAddrData(0x12345678, 0, SCReputationTestDevAddrRep(5)) == NULL)
+        goto end;
+    if (!SCReputationTestDevAddrCheck(0x00000000, 5, 0) ||
+        !SCReputationTestDevAddrCheck(0x28000000, 5, 0) ||
+        !SCReputationTestDevAddrCheck(0x27ffffff, 10, 0) ||
+        !SCReputationTestDevAddrCheck(0xfeffffff, 5, 0) ||
+        !SCReputationTestDevAddrCheck(0xff000001, 40, 0))
+        goto end;
+
+    result = 1;
+end:
+    SCReputationFreeCtx(rep_ctx);
+    rep_ctx = NULL;
+    return result;
+}
+
+/** \retval the CNC reputation of a lookup result, 0 for none */
+static uint8_t SCReputationTestVal(Reputation *rep)
+{
+    uint8_t val = 0;
+
+    if (rep != NULL) {
+        val = rep->reps[REPUTATION_CNC];
+        SCReputationFreeData(rep);
+    }
+    return val;
+}
+
+/**
+ * \test Lookups see what writers publish, batches publish at their commit
+ */
+int SCReputationTestLockFree01(void)
+{
+    ReputationTransaction rtx;
+    struct in_addr in;
+    struct in6_addr in6;
+    int result = 0;
+
+    SCReputationInitCtx();
+    if (rep_ctx == NULL) {
+        SCLogInfo("Error initializing Reputation Module");
+        return 0;
+    }
+
+    if (inet_pton(AF_INET, "192.168.0.0", &in) <= 0)
+        goto end;
+    if (SCReputationAddIPV4Data((uint8_t *)&in, 16, SCReputationTestDevAddrRep(10)) == NULL)
+        goto end;
+
+    if (inet_pton(AF_INET, "192.168.1.1", &in) <= 0)
+        goto end;
+    if (SCReputationTestVal(SCReputationLookupIPV4BestMatch((uint8_t *)&in)) != 10 ||
+        SCReputationTestVal(SCReputationLookupIPV4ExactMatch((uint8_t *)&in)) != 0)
+        goto end;
+
+    /* nothing of the batch is visible before the commit */
+    SCReputationBatchBegin();
+    if (inet_pton(AF_INET, "192.168.1.0", &in) <= 0)
+        goto end;
+    if (SCReputationAddIPV4Data((uint8_t *)&in, 24, SCReputationTestDevAddrRep(20)) == NULL)
+        goto end;
+
+    memset(&rtx, 0, sizeof(ReputationTransaction));
+    rtx.inc[REPUTATION_CNC] = 5;
+    rtx.flags = TRANSACTION_FLAG_NEEDSYNC | TRANSACTION_FLAG_INCS;
+    if (inet_pton(AF_INET, "192.168.1.1", &in) <= 0)
+        goto end;
+    if (SCReputationUpdateIPV4Data((uint8_t *)&in, &rtx) == NULL)
+        goto end;
+
+    if (SCReputationTestVal(SCReputationLookupIPV4BestMatch((uint8_t *)&in)) != 10)
+        goto end;
+    SCReputationBatchCommit();
+
+    if (SCReputationTestVal(SCReputationLookupIPV4ExactMatch((uint8_t *)&in)) != 25)
+        goto end;
+    if (inet_pton(AF_INET, "192.168.1.2", &in) <= 0)
+        goto end;
+    if (SCReputationTestVal(SCReputationLookupIPV4BestMatch((uint8_t *)&in)) != 20)
+        goto end;
+    if (inet_pton(AF_INET, "192.168.2.2", &in) <= 0)
+        goto end;
+    if (SCReputationTestVal(SCReputationLookupIPV4BestMatch((uint8_t *)&in)) != 10)
+        goto end;
+    if (inet_pton(AF_INET, "192.169.0.1", &in) <= 0)
+        goto end;
+    if (SCReputationTestVal(SCReputationLookupIPV4BestMatch((uint8_t *)&in)) != 0)
+        goto end;
+
+    /* removing the host brings back the /24 */
+    if (inet_pton(AF_INET, "192.168.1.1", &in) <= 0)
+        goto end;
+    SCReputationRemoveIPV4Data((uint8_t *)&in, 32);
+    if (SCReputationTestVal(SCReputationLookupIPV4BestMatch((uint8_t *)&in)) != 20)
+        goto end;
+
+    /* ipv6 */
+    if (inet_pton(AF_INET6, "2001:db8::", &in6) <= 0)
+        goto end;
+    if (SCReputationAddIPV6Data((uint8_t *)&in6, 32, SCReputationTestDevAddrRep(30)) == NULL)
+        goto end;
+    if (inet_pton(AF_INET6, "2001:db8:0:0:ffff::1", &in6) <= 0)
+        goto end;
+    if (SCReputationAddIPV6Data((uint8_t *)&in6, 128, SCReputationTestDevAddrRep(40)) == NULL)
+        goto end;
+
+    if (SCReputationTestVal(SCReputationLookupIPV6BestMatch((uint8_t *)&in6)) != 40 ||
+        SCReputationTestVal(SCReputationLookupIPV6ExactMatch((uint8_t *)&in6)) != 40)
+        goto end;
+    if (inet_pton(AF_INET6, "2001:db8:ffff::1", &in6) <= 0)
+        goto end;
+    if (SCReputationTestVal(SCReputationLookupIPV6BestMatch((uint8_t *)&in6)) != 30 ||
+        SCReputationTestVal(SCReputationLookupIPV6ExactMatch((uint8_t *)&in6)) != 0)
+        goto end;
+    if (inet_pton(AF_INET6, "2001:db9::1", &in6) <= 0)
+        goto end;
+    if (SCReputationTestVal(SCReputationLookupIPV6BestMatch((uint8_t *)&in6)) != 0)
+        goto end;
+
+    result = 1;
+end:
+    SCReputationFreeCtx(rep_ctx);
+    rep_ctx = NULL;
+    return result;
+}
+
+static int rep_test_stop = 0;
+
+/** \brief reader for SCReputationTestLockFree02: the /24 is always there
+ *         with value 1 or 2, the host comes and goes */
+static void *SCReputationTestLockFreeReader(void *arg)
+{
+    long errors = 0;
+    uint32_t host = 0xc0a80101;
+    uint32_t other = 0xc0a80102;
+
+    while (!rep_test_stop) {
+        uint8_t v1 = SCReputationTestVal(SCReputationLookupDevAddrBestMatch(host));
+        uint8_t v2 = SCReputationTestVal(SCReputationLookupDevAddrBestMatch(other));
+
+        if (v1 != 1 && v1 != 2 && v1 != 3)
+            errors++;
+        if (v2 != 1 && v2 != 2)
+            errors++;
+    }
+    return (void *)errors;
+}
+
+/**
+ * \test Readers keep finding valid data while a writer keeps replacing
+ *       and removing entries and freeing the old tables
+ */
+int SCReputationTestLockFree02(void)
+{
+    pthread_t readers[4];
+    int started = 0, i;
+    int result = 0;
+
+    SCReputationInitCtx();
+    if (rep_ctx == NULL) {
+        SCLogInfo("Error initializing Reputation Module");
+        return 0;
+    }
+    rep_test_stop = 0;
+
+    if (SCReputationAddDevAddrData(0xc0a80100, 24, SCReputationTestDevAddrRep(1)) == NULL)
+        goto end;
+
+    for (started = 0; started < 4; started++) {
+        if (pthread_create(&readers[started], NULL, SCReputationTestLockFreeReader,
+                    NULL) != 0)
+            goto end;
+    }
+
+    for (i = 0; i < 500; i++) {
+        if (SCReputationAddDevAddrData(0xc0a80100, 24,
+                    SCReputationTestDevAddrRep(1 + (i & 1))) == NULL)
+            goto end;
+        if (i & 1)
+            SCReputationRemoveDevAddrData(0xc0a80101, 32);
+        else if (SCReputationAddDevAddrData(0xc0a80101, 32,
+                    SCReputationTestDevAddrRep(3)) == NULL)
+            goto end;
+    }
+
+    result = 1;
+end:
+    rep_test_stop = 1;
+    for (i = 0; i < started; i++) {
+        void *errors = NULL;
+        pthread_join(readers[i], &errors);
+        if (errors != NULL)
+            result = 0;
+    }
+    SCReputationFreeCtx(rep_ctx);
+    rep_ctx = NULL;
+    return result;
+}
+
+/**
+ * \test Load a feed with IPv4, IPv6 and DevAddr entries and check that
+ *       invalid lines are skipped
+ */
+int SCReputationTestFeed01(void)
+{
+    char buffer[] =
+        "# test feed\n"
+        "192.168.0.0/16,cnc,10\n"
+        "192.168.1.1, 1, 20\n"
+        "192.168.1.1,spam,5\n"
+        "2001:db8::/32,CNC,30\n"
+        "\n"
+        "0x26012345,cnc,40\n"
+        "26000000/7,cnc,50\n"
+        "192.168.2.0/33,cnc,1\n"
+        "192.168.2.0,bogus,1\n"
+        "192.168.2.0,cnc,256\n"
+        "nothex,cnc,1\n"
+        "192.168.2.0,cnc\n";
+    struct in_addr in;
+    struct in6_addr in6;
+    Reputation *rep;
+    FILE *fp;
+    int result = 0;
+
+    SCReputationInitCtx();
+    if (rep_ctx == NULL) {
+        SCLogInfo("Error initializing Reputation Module");
+        return 0;
+    }
+
+    fp = SCFmemopen((void *)buffer, strlen(buffer), "r");
+    if (fp == NULL)
+        goto end;
+    if (ReputationLoadFeedFp(fp, "test") != 6) {
+        fclose(fp);
+        goto end;
+    }
+    fclose(fp);
+
+    if (inet_pton(AF_INET, "192.168.1.1", &in) <= 0)
+        goto end;
+    rep = SCReputationLookupIPV4ExactMatch((uint8_t *)&in);
+    if (rep == NULL || rep->reps[REPUTATION_CNC] != 20 ||
+            rep->reps[REPUTATION_SPAM] != 5) {
+        if (rep != NULL)
+            SCReputationFreeData(rep);
+        goto end;
+    }
+    SCReputationFreeData(rep);
+
+    if (inet_pton(AF_INET, "192.168.2.0", &in) <= 0)
+        goto end;
+    if (SCReputationTestVal(SCReputationLookupIPV4BestMatch((uint8_t *)&in)) != 10)
+        goto end;
+
+    if (inet_pton(AF_INET6, "2001:db8::1", &in6) <= 0)
+        goto end;
+    if (SCReputationTestVal(SCReputationLookupIPV6BestMatch((uint8_t *)&in6)) != 30)
+        goto end;
+
+    if (SCReputationTestVal(SCReputationLookupDevAddrExactMatch(0x26012345)) != 40 ||
+        SCReputationTestVal(SCReputationLookupDevAddrBestMatch(0x27000001)) != 50 ||
+        SCReputationTestVal(SCReputationLookupDevAddrBestMatch(0x28000001)) != 0)
+        goto end;
+
+    result = 1;
+end:
+    SCReputationFreeCtx(rep_ctx);
+    rep_ctx = NULL;
+    return result;
+}
+
+/**
+ * \test Save a snapshot, load it in a new context and change it there
+ */
+int SCReputationTestSnapshot01(void)
+{
+    char path[] = "/tmp/suricata-reputation-XXXXXX";
+    struct in_addr in;
+    struct in6_addr in6;
+    int fd;
+    int result = 0;
+
+    fd = mkstemp(path);
+    if (fd < 0)
+        return 0;
+    close(fd);
+
+    SCReputationInitCtx();
+    if (rep_ctx == NULL) {
+        SCLogInfo("Error initializing Reputation Module");
+        goto end;
+    }
+
+    if (inet_pton(AF_INET, "10.0.0.0", &in) <= 0)
+        goto end;
+    if (SCReputationAddIPV4Data((uint8_t *)&in, 8, SCReputationTestDevAddrRep(10)) == NULL)
+        goto end;
+    if (inet_pton(AF_INET6, "2001:db8::1", &in6) <= 0)
+        goto end;
+    if (SCReputationAddIPV6Data((uint8_t *)&in6, 128, SCReputationTestDevAddrRep(20)) == NULL)
+        goto end;
+    if (SCReputationAddDevAddrData(0x26000000, 7, SCReputationTestDevAddrRep(30)) == NULL)
+        goto end;
+
+    if (SCReputationSaveSnapshot(path) != 0)
+        goto end;
+    SCReputationFreeCtx(rep_ctx);
+
+    SCReputationInitCtx();
+    if (rep_ctx == NULL)
+        goto end;
+    if (SCReputationLoadSnapshot(path) != 0)
+        goto end;
+
+    if (inet_pton(AF_INET, "10.1.2.3", &in) <= 0)
+        goto end;
+    if (SCReputationTestVal(SCReputationLookupIPV4BestMatch((uint8_t *)&in)) != 10)
+        goto end;
+    if (SCReputationTestVal(SCReputationLookupIPV6ExactMatch((uint8_t *)&in6)) != 20)
+        goto end;
+    if (SCReputationTestVal(SCReputationLookupDevAddrBestMatch(0x26abcdef)) != 30)
+        goto end;
+
+    /* a change after the load keeps what came from the snapshot */
+    if (SCReputationAddDevAddrData(0x26abcdef, 32, SCReputationTestDevAddrRep(40)) == NULL)
+        goto end;
+    if (SCReputationTestVal(SCReputationLookupDevAddrBestMatch(0x26abcdef)) != 40 ||
+        SCReputationTestVal(SCReputationLookupDevAddrBestMatch(0x26000001)) != 30)
+        goto end;
+
+    /* a corrupt snapshot is refused and the tables stay */
+    fd = open(path, O_WRONLY);
+    if (fd < 0 || pwrite(fd, "XXXX", 4, 0) != 4) {
+        if (fd >= 0)
+            close(fd);
+        goto end;
+    }
+    close(fd);
+    if (SCReputationLoadSnapshot(path) == 0)
+        goto end;
+    if (SCReputationTestVal(SCReputationLookupDevAddrBestMatch(0x26abcdef)) != 40)
+        goto end;
+
+    result = 1;
+end:
+    if (rep_ctx != NULL)
+        SCReputationFreeCtx(rep_ctx);
+    rep_ctx = NULL;
+    unlink(path);
+    return result;
+}
+
+/**
+ * \test A snapshot is stale once a feed was changed after it was written
+ */
+int SCReputationTestSnapshot02(void)
+{
+    char snap[] = "/tmp/suricata-reputation-XXXXXX";
+    char feed[] = "/tmp/suricata-reputation-feed-XXXXXX";
+    struct timeval tv[2];
+    ConfNode *feeds = NULL, *file = NULL;
+    int fd;
+    int result = 0;
+
+    fd = mkstemp(snap);
+    if (fd < 0)
+        return 0;
+    close(fd);
+    fd = mkstemp(feed);
+    if (fd < 0)
+        goto end;
+    close(fd);
+
+    feeds = ConfNodeNew();
+    file = ConfNodeNew();
+    if (feeds == NULL || file == NULL)
+        goto end;
+    file->val = SCStrdup(feed);
+    if (file->val == NULL)
+        goto end;
+    TAILQ_INSERT_TAIL(&feeds->head, file, next);
+    file = NULL;
+
+    /* feed written before the snapshot */
+    gettimeofday(&tv[0], NULL);
+    tv[1] = tv[0];
+    tv[0].tv_sec -= 60;
+    tv[1].tv_sec -= 60;
+    if (utimes(feed, tv) != 0)
+        goto end;
+    if (ReputationSnapshotIsStale(snap, feeds) != 0 ||
+        ReputationSnapshotIsStale(snap, NULL) != 0)
+        goto end;
+
+    /* and after it */
+    tv[0].tv_sec += 120;
+    tv[1].tv_sec += 120;
+    if (utimes(feed, tv) != 0)
+        goto end;
+    if (ReputationSnapshotIsStale(snap, feeds) != 1)
+        goto end;
+
+    /* no snapshot at all */
+    unlink(snap);
+    if (ReputationSnapshotIsStale(snap, NULL) != 1)
+        goto end;
+
+    result = 1;
+end:
+    if (file != NULL)
+        ConfNodeFree(file);
+    if (feeds != NULL)
+        ConfNodeFree(feeds);
+    unlink(snap);
+    unlink(feed);
+    return result;
+}
+
+/**
+ * \test With a publish interval, updates outside a batch are published by
+ *       the tick once the interval passed, batches still at their commit
+ */
+int SCReputationTestPublishTick01(void)
+{
+    int result = 0;
+
+    SCReputationInitCtx();
+    if (rep_ctx == NULL) {
+        SCLogInfo("Error initializing Reputation Module");
+        return 0;
+    }
+    rep_ctx->publish_usec = 1000000;
+    gettimeofday(&rep_ctx->publish_last, NULL);
+
+    if (SCReputationAddDevAddrData(0x26000000, 8, SCReputationTestDevAddrRep(10)) == NULL)
+        goto end;
+    if (SCReputationAddDevAddrData(0x26abcdef, 32, SCReputationTestDevAddrRep(20)) == NULL)
+        goto end;
+
+    /* not published yet, and the interval didn't pass */
+    if (SCReputationTestVal(SCReputationLookupDevAddrBestMatch(0x26abcdef)) != 0)
+        goto end;
+    SCReputationPublishTick();
+    if (SCReputationTestVal(SCReputationLookupDevAddrBestMatch(0x26abcdef)) != 0)
+        goto end;
+
+    /* both updates in one publish */
+    rep_ctx->publish_last.tv_sec -= 2;
+    SCReputationPublishTick();
+    if (rep_ctx->DevAddr_dirty ||
+        SCReputationTestVal(SCReputationLookupDevAddrBestMatch(0x26abcdef)) != 20 ||
+        SCReputationTestVal(SCReputationLookupDevAddrBestMatch(0x26000001)) != 10)
+        goto end;
+
+    /* a batch doesn't wait for the tick */
+    SCReputationBatchBegin();
+    SCReputationRemoveDevAddrData(0x26abcdef, 32);
+    SCReputationBatchCommit();
+    if (SCReputationTestVal(SCReputationLookupDevAddrBestMatch(0x26abcdef)) != 10)
+        goto end;
+
+    result = 1;
+end:
+    SCReputationFreeCtx(rep_ctx);
+    rep_ctx = NULL;
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 /** Register the following unittests for the Reputation module */
@@ -1452,6 +3463,23 @@ void SCReputationRegisterTests(void)
                    SCReputationTestIPV4Update01, 1);
     UtRegisterTest("SCReputationTestIPV6Update01",
                    SCReputationTestIPV6Update01, 1);
+
+    UtRegisterTest("SCReputationTestDevAddrBestMatch01",
+                   SCReputationTestDevAddrBestMatch01, 1);
+
+    UtRegisterTest("SCReputationTestLockFree01",
+                   SCReputationTestLockFree01, 1);
+    UtRegisterTest("SCReputationTestLockFree02",
+                   SCReputationTestLockFree02, 1);
+
+    UtRegisterTest("SCReputationTestFeed01",
+                   SCReputationTestFeed01, 1);
+    UtRegisterTest("SCReputationTestSnapshot01",
+                   SCReputationTestSnapshot01, 1);
+    UtRegisterTest("SCReputationTestSnapshot02",
+                   SCReputationTestSnapshot02, 1);
+    UtRegisterTest("SCReputationTestPublishTick01",
+                   SCReputationTestPublishTick01, 1);
 #endif /* UNITTESTS */
 }
 
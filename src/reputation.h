@@ -51,17 +51,6 @@
 /* Flags for reputation */
 #define REPUTATION_FLAG_NEEDSYNC    0x01 /**< rep was changed by engine, needs sync with external hub */
 
-/** Reputation Context for IPV4 IPV6 */
-typedef struct IPReputationCtx_ {
-    /** Radix trees that holds the host reputation information */
-    SCRadixTree *reputationIPV4_tree;
-    SCRadixTree *reputationIPV6_tree;
-
-    /** Mutex to support concurrent access */
-    SCMutex reputationIPV4_lock;
-    SCMutex reputationIPV6_lock;
-}IPReputationCtx;
-
 /** Reputation Data */
 //TODO: Add a timestamp here to know the last update of this reputation.
 typedef struct Reputation_ {
@@ -71,6 +60,137 @@ typedef struct Reputation_ {
     time_t mtime; /**< modification time (epoch) */
 } Reputation;
 
+/** NwkID of a LoRaWAN 1.0 DevAddr: its 7 most significant bits */
+#define REPUTATION_DEVADDR_NWKID_BITS   7
+#define REPUTATION_DEVADDR_NWKID(a)     ((uint32_t)(a) >> (32 - REPUTATION_DEVADDR_NWKID_BITS))
+
+/** Lookup key of the published tables: 128 bits, most significant half
+ *  first. IPv4 addresses and DevAddrs use the top 32 bits */
+typedef struct ReputationKey_ {
+    uint64_t hi;
+    uint64_t lo;
+} ReputationKey;
+
+/** run without a reputation */
+#define REPUTATION_TABLE_NONE       0xffffffff
+
+/** A snapshot file mapped in memory, shared by the tables loaded from it */
+typedef struct ReputationSnapshot_ {
+    void *map;
+    size_t len;
+    volatile uint32_t refs;         /**< tables still using the mapping */
+} ReputationSnapshot;
+
+/** \brief Published, read only view of one reputation tree.
+ *
+ *  The prefixes of the tree are flattened into runs of keys that all get
+ *  the reputation of the same, longest, prefix. The runs cover the whole
+ *  key space, so a lookup is a search for the last run that starts at or
+ *  before the key. index[b] is the first run that starts in or after top
+ *  byte b, which narrows that search down to one top byte.
+ *
+ *  A table is never changed after it is published. Writers change the
+ *  radix tree, build a new table from it and swap the pointer. */
+typedef struct ReputationTable_ {
+    ReputationKey *starts;          /**< first key of each run, sorted */
+    uint32_t *runs;                 /**< entry of each run, or REPUTATION_TABLE_NONE */
+    uint32_t cnt;                   /**< number of runs */
+
+    Reputation *reps;               /**< copy of the reputation of each prefix */
+    ReputationKey *keys;            /**< and its first key */
+    uint8_t *netmasks;              /**< and its netmask */
+    uint32_t rep_cnt;
+
+    uint8_t bits;                   /**< key length: 32 or 128 */
+    uint32_t index[257];
+
+    ReputationSnapshot *snap;       /**< arrays live in this mapping, if set */
+} ReputationTable;
+
+/** snapshot file: a header, then per table its arrays in the order of
+ *  ReputationTable: starts, keys, reps, runs, netmasks. Native byte
+ *  order, the magic tells if a file was made on another architecture */
+#define REPUTATION_SNAPSHOT_MAGIC   0x50455253      /**< "SREP" */
+#define REPUTATION_SNAPSHOT_VERSION 1
+#define REPUTATION_SNAPSHOT_TABLES  3               /**< IPv4, IPv6, DevAddr */
+
+typedef struct ReputationSnapshotTable_ {
+    uint64_t offset;                /**< of the first array, 8 byte aligned */
+    uint32_t cnt;
+    uint32_t rep_cnt;
+    uint32_t bits;
+    uint32_t index[257];
+} ReputationSnapshotTable;
+
+typedef struct ReputationSnapshotHdr_ {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t rep_size;              /**< sizeof(Reputation) of the writer */
+    uint32_t tables;
+    uint64_t size;                  /**< of the whole file */
+    ReputationSnapshotTable table[REPUTATION_SNAPSHOT_TABLES];
+} ReputationSnapshotHdr;
+
+/** reader threads with a slot of their own, more share a counter */
+#define REPUTATION_READERS_MAX      256
+
+/** default of reputation.publish-interval, in ms */
+#define REPUTATION_PUBLISH_INTERVAL 100
+
+/** \brief A reader thread's announcement: the epoch it entered its read
+ *         section in, 0 outside of it. One per cache line. */
+typedef struct ReputationReader_ {
+    volatile uint64_t epoch;
+    uint8_t pad[64 - sizeof(uint64_t)];
+} ReputationReader;
+
+/** Reputation Context for IPV4 IPV6 and LoRaWAN DevAddrs */
+typedef struct IPReputationCtx_ {
+    /** Radix trees that holds the host reputation information. Only
+     *  writers use them */
+    SCRadixTree *reputationIPV4_tree;
+    SCRadixTree *reputationIPV6_tree;
+    SCRadixTree *reputationDevAddr_tree;
+
+    /** Mutex to serialize the writers of each tree */
+    SCMutex reputationIPV4_lock;
+    SCMutex reputationIPV6_lock;
+    SCMutex reputationDevAddr_lock;
+
+    /** what the readers see, swapped as a whole by the writers */
+    ReputationTable * volatile reputationIPV4_table;
+    ReputationTable * volatile reputationIPV6_table;
+    ReputationTable * volatile reputationDevAddr_table;
+
+    /** trees changed during a batch, published at its commit */
+    uint8_t IPV4_dirty;
+    uint8_t IPV6_dirty;
+    uint8_t DevAddr_dirty;
+    volatile uint32_t batch;        /**< batches in progress */
+
+    /** usec between publishes of changes made outside a batch, 0 to
+     *  publish every change. With an interval writers only mark their
+     *  tree dirty and SCReputationPublishTick() publishes it */
+    uint32_t publish_usec;
+    struct timeval publish_last;
+
+    /** tables loaded from a snapshot that the trees don't have yet. The
+     *  first writer fills its tree from the table */
+    uint8_t IPV4_stale;
+    uint8_t IPV6_stale;
+    uint8_t DevAddr_stale;
+    char *snapshot_path;            /**< reputation.snapshot, for reloads */
+
+    /** lock free readers: a table a reader may have loaded is freed only
+     *  once every reader has left the epoch it was unpublished in */
+    volatile uint64_t epoch;
+    ReputationReader *readers;      /**< REPUTATION_READERS_MAX slots */
+    void *readers_mem;
+    volatile uint32_t reader_cnt;   /**< slots handed out */
+    volatile uint32_t overflow_readers; /**< readers in a section without a slot */
+    uint32_t gen;                   /**< tells contexts apart for the slot cache */
+}IPReputationCtx;
+
 /* flags for transactions */
 #define TRANSACTION_FLAG_NEEDSYNC 0x01 /**< We will apply the transaction only if necesary */
 #define TRANSACTION_FLAG_INCS     0x02 /**< We will increment only if necesary */
@@ -91,6 +211,33 @@ void SCReputationFreeData(void *);
 IPReputationCtx *SCReputationInitCtx(void);
 void SCReputationFreeCtx(IPReputationCtx *);
 
+Reputation *SCReputationAddIPV4Data(uint8_t *, int, Reputation *);
+Reputation *SCReputationAddIPV6Data(uint8_t *, int, Reputation *);
+Reputation *SCReputationAddDevAddrData(uint32_t, int, Reputation *);
+void SCReputationRemoveIPV4Data(uint8_t *, uint8_t);
+void SCReputationRemoveIPV6Data(uint8_t *, uint8_t);
+void SCReputationRemoveDevAddrData(uint32_t, uint8_t);
+Reputation *SCReputationUpdateIPV4Data(uint8_t *, ReputationTransaction *);
+Reputation *SCReputationUpdateIPV6Data(uint8_t *, ReputationTransaction *);
+Reputation *SCReputationUpdateDevAddrData(uint32_t, ReputationTransaction *);
+
+void SCReputationBatchBegin(void);
+void SCReputationBatchCommit(void);
+void SCReputationPublishTick(void);
+
+int SCReputationLoadFeed(const char *);
+int SCReputationSaveSnapshot(const char *);
+int SCReputationLoadSnapshot(const char *);
+int SCReputationReloadSnapshot(void);
+void SCReputationInitConfig(void);
+
+Reputation *SCReputationLookupIPV4ExactMatch(uint8_t *);
+Reputation *SCReputationLookupIPV4BestMatch(uint8_t *);
+Reputation *SCReputationLookupIPV6ExactMatch(uint8_t *);
+Reputation *SCReputationLookupIPV6BestMatch(uint8_t *);
+Reputation *SCReputationLookupDevAddrExactMatch(uint32_t);
+Reputation *SCReputationLookupDevAddrBestMatch(uint32_t);
+
 void SCReputationPrint(Reputation *);
 void SCReputationRegisterTests(void);
 
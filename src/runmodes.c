@@ -26,9 +26,11 @@
 #include "detect-engine.h"
 #include "detect-engine-mpm.h"
 #include "tm-threads.h"
+#include "tm-queuehandlers.h"
 #include "util-debug.h"
 #include "util-time.h"
 #include "util-cpu.h"
+#include "util-affinity.h"
 #include "util-byte.h"
 #include "conf.h"
 #include "queue.h"
@@ -44,6 +46,9 @@
 
 #include "output.h"
 
+#include "source-nfq-prototypes.h"
+#include "source-packetqueue.h"
+
 
 /**
  * A list of output modules that will be active for the run mode.
@@ -149,6 +154,9 @@ static void SetupOutputs(ThreadVars *tv)
 
 static int threading_set_cpu_affinity = FALSE;
 static float threading_detect_ratio = 1;
+static intmax_t threading_workers = 0;
+/** queue handler between the threads of the auto runmode */
+static char *threading_queue_handler = "batch";
 
 /**
  * Initialize the output modules.
@@ -161,67 +169,142 @@ static void RunModeInitialize(void)
     if ((ConfGetFloat("threading.detect_thread_ratio", &threading_detect_ratio)) != 1) {
         threading_detect_ratio = 1;
     }
+    if ((ConfGetInt("threading.workers", &threading_workers)) != 1) {
+        threading_workers = 0;
+    }
+    if ((ConfGet("threading.queue-handler", &threading_queue_handler)) != 1 ||
+        threading_queue_handler == NULL) {
+        threading_queue_handler = "batch";
+    } else if (TmqhGetQueueHandlerByName(threading_queue_handler) == NULL) {
+        SCLogWarning(SC_ERR_INVALID_ARGUMENT, "unknown threading.queue-handler "
+                "\"%s\", using batch", threading_queue_handler);
+        threading_queue_handler = "batch";
+    }
 
     SCLogDebug("threading_detect_ratio %f", threading_detect_ratio);
 }
 
+/**
+ * \brief Place a thread if threading.set_cpu_affinity is on: on the cpu
+ *        set of its group if threading.cpu-affinity has one, else on cpu
+ *        with priority prio like before.
+ */
+static void RunModeSetAffinity(ThreadVars *tv, uint8_t type, uint16_t cpu,
+        int prio, uint16_t ncpus)
+{
+    if (!threading_set_cpu_affinity)
+        return;
+
+    if (TmThreadSetCPU(tv, type) == TM_ECODE_OK) {
+        if (!AffinityGetSet(type)->prio_set && ncpus > 1)
+            TmThreadSetThreadPriority(tv, prio);
+        return;
+    }
+
+    TmThreadSetCPUAffinity(tv, cpu);
+    if (ncpus > 1)
+        TmThreadSetThreadPriority(tv, prio);
+}
+
+/**
+ * \brief Get the runmode selected with threading.runmode
+ *
+ * \retval 1 workers, 0 auto (the default)
+ */
+int RunModeIsWorkers(void)
+{
+    char *runmode = NULL;
+
+    if (ConfGet("threading.runmode", &runmode) != 1 || runmode == NULL)
+        return 0;
+
+    if (strcasecmp(runmode, "workers") == 0)
+        return 1;
+    if (strcasecmp(runmode, "auto") != 0) {
+        SCLogWarning(SC_ERR_INVALID_ARGUMENT, "unknown threading.runmode "
+                "\"%s\", using auto", runmode);
+    }
+    return 0;
+}
+
 /**
  * \brief RunModeIpsNFQAuto set up the following thread packet handlers:
- *        - Receive thread (from NFQ)
+ *        - Receive threads (from NFQ), one per queue
  *        - Decode thread
  *        - Stream thread
  *        - Detect: If we have only 1 cpu, it will setup one Detect thread
  *                  If we have more than one, it will setup num_cpus - 1
  *                  starting from the second cpu available.
- *        - Veredict thread (NFQ)
+ *        - Veredict threads (NFQ), one per queue
  *        - Respond/Reject thread
  *        - Outputs thread
  *        By default the threads will use the first cpu available
  *        except the Detection threads if we have more than one cpu
  *
  * \param de_ctx pointer to the Detection Engine
- * \param nfqid pointer to the netfilter queue id
+ * \param nfqid pointer to the netfilter queue id, or a range of them
+ *        like "0:3"
  * \retval 0 if all goes well. (If any problem is detected the engine will
  *           exit())
  */
 
 int RunModeIpsNFQAuto(DetectEngineCtx *de_ctx, char *nfq_id) {
     SCEnter();
-    char tname[12];
+    char tname[16];
+    char qname[8];
     uint16_t cpu = 0;
+    uint16_t queue_first = 0, queue_cnt = 0, q = 0;
 
     /* Available cpus */
     uint16_t ncpus = UtilCpuGetNumProcessorsOnline();
 
     RunModeInitialize();
 
-    TimeModeSetLive();
-    /* create the threads */
-    ThreadVars *tv_receivenfq = TmThreadCreatePacketHandler("ReceiveNFQ","packetpool","packetpool","pickup-queue","simple","1slot_noinout");
-    if (tv_receivenfq == NULL) {
-        printf("ERROR: TmThreadsCreate failed\n");
+    if (NFQParseQueues(nfq_id, &queue_first, &queue_cnt) != 0) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "specified queue %s is not "
+                "valid, use a number or a range like 0:3", nfq_id);
         exit(EXIT_FAILURE);
     }
 
+    TimeModeSetLive();
+    /* create the threads, a receive thread per queue */
     TmModule *tm_module = TmModuleGetByName("ReceiveNFQ");
     if (tm_module == NULL) {
         printf("ERROR: TmModuleGetByName failed for ReceiveNFQ\n");
         exit(EXIT_FAILURE);
     }
-    Tm1SlotSetFunc(tv_receivenfq,tm_module,nfq_id);
 
-    if (threading_set_cpu_affinity) {
-        TmThreadSetCPUAffinity(tv_receivenfq, 0);
-        if (ncpus > 1)
-            TmThreadSetThreadPriority(tv_receivenfq, PRIO_MEDIUM);
-    }
+    for (q = 0; q < queue_cnt; q++) {
+        if (queue_cnt == 1)
+            snprintf(tname, sizeof(tname), "ReceiveNFQ");
+        else
+            snprintf(tname, sizeof(tname), "ReceiveNFQ%"PRIu16, q+1);
+        snprintf(qname, sizeof(qname), "%"PRIu16, queue_first + q);
 
-    if (TmThreadSpawn(tv_receivenfq) != TM_ECODE_OK) {
-        printf("ERROR: TmThreadSpawn failed\n");
-        exit(EXIT_FAILURE);
+        char *thread_name = SCStrdup(tname);
+        char *queue_str = SCStrdup(qname);
+        if (thread_name == NULL || queue_str == NULL) {
+            printf("Error allocating memory\n");
+            exit(EXIT_FAILURE);
+        }
+
+        ThreadVars *tv_receivenfq = TmThreadCreatePacketHandler(thread_name,"packetpool","packetpool","pickup-queue",threading_queue_handler,"1slot_noinout");
+        if (tv_receivenfq == NULL) {
+            printf("ERROR: TmThreadsCreate failed\n");
+            exit(EXIT_FAILURE);
+        }
+        Tm1SlotSetFunc(tv_receivenfq,tm_module,queue_str);
+
+        RunModeSetAffinity(tv_receivenfq, RECEIVE_CPU_SET,
+                ncpus > 0 ? (int)(q % ncpus) : 0, PRIO_MEDIUM, ncpus);
+
+        if (TmThreadSpawn(tv_receivenfq) != TM_ECODE_OK) {
+            printf("ERROR: TmThreadSpawn failed\n");
+            exit(EXIT_FAILURE);
+        }
     }
     //TODO Refactoring CheckPoint - 2018/07/01
-    ThreadVars *tv_decode1 = TmThreadCreatePacketHandler("Decode1","pickup-queue","simple","decode-queue1","simple","1slot");
+    ThreadVars *tv_decode1 = TmThreadCreatePacketHandler("Decode1","pickup-queue",threading_queue_handler,"decode-queue1",threading_queue_handler,"1slot");
     if (tv_decode1 == NULL) {
         printf("ERROR: TmThreadsCreate failed for Decode1\n");
         exit(EXIT_FAILURE);
@@ -236,11 +319,7 @@ int RunModeIpsNFQAuto(DetectEngineCtx *de_ctx, char *nfq_id) {
 
     Tm1SlotSetFunc(tv_decode1,tm_module,NULL);
 
-    if (threading_set_cpu_affinity) {
-        TmThreadSetCPUAffinity(tv_decode1, 0);
-        if (ncpus > 1)
-            TmThreadSetThreadPriority(tv_decode1, PRIO_MEDIUM);
-    }
+    RunModeSetAffinity(tv_decode1, DECODE_CPU_SET, 0, PRIO_MEDIUM, ncpus);
 
     if (TmThreadSpawn(tv_decode1) != TM_ECODE_OK) {
         printf("ERROR: TmThreadSpawn failed\n");
@@ -252,7 +331,7 @@ int RunModeIpsNFQAuto(DetectEngineCtx *de_ctx, char *nfq_id) {
     if (ncpus > 0)
         cpu = 1;
     /* always create at least one thread */
-    int thread_max = ncpus * threading_detect_ratio;
+    int thread_max = AffinityGetCpuCount(DETECT_CPU_SET, ncpus) * threading_detect_ratio;
     if (thread_max < 1)
         thread_max = 1;
 
@@ -265,7 +344,7 @@ int RunModeIpsNFQAuto(DetectEngineCtx *de_ctx, char *nfq_id) {
         char *thread_name = SCStrdup(tname);
         SCLogDebug("Assigning %s affinity to cpu %u", thread_name, cpu);
 
-        ThreadVars *tv_detect_ncpu = TmThreadCreatePacketHandler(thread_name,"decode-queue1","simple","verdict-queue","simple","1slot");
+        ThreadVars *tv_detect_ncpu = TmThreadCreatePacketHandler(thread_name,"decode-queue1",threading_queue_handler,"verdict-queue",threading_queue_handler,"1slot");
         if (tv_detect_ncpu == NULL) {
             printf("ERROR: TmThreadsCreate failed\n");
             exit(EXIT_FAILURE);
@@ -277,19 +356,200 @@ int RunModeIpsNFQAuto(DetectEngineCtx *de_ctx, char *nfq_id) {
         }
         Tm1SlotSetFunc(tv_detect_ncpu,tm_module,(void *)de_ctx);
 
-        if (threading_set_cpu_affinity) {
-            TmThreadSetCPUAffinity(tv_detect_ncpu, (int)cpu);
-            /* If we have more than one core/cpu, the first Detect thread
-             * (at cpu 0) will have less priority (higher 'nice' value)
-             * In this case we will set the thread priority to +10 (default is 0)
-             */
-            if (cpu == 0 && ncpus > 1) {
-                TmThreadSetThreadPriority(tv_detect_ncpu, PRIO_LOW);
-            } else if (ncpus > 1) {
-                TmThreadSetThreadPriority(tv_detect_ncpu, PRIO_MEDIUM);
-            }
+        /* If we have more than one core/cpu, the first Detect thread
+         * (at cpu 0) will have less priority (higher 'nice' value)
+         * In this case we will set the thread priority to +10 (default is 0)
+         */
+        RunModeSetAffinity(tv_detect_ncpu, DETECT_CPU_SET, cpu,
+                cpu == 0 ? PRIO_LOW : PRIO_MEDIUM, ncpus);
+
+        char *thread_group_name = SCStrdup("Detect");
+        if (thread_group_name == NULL) {
+            printf("Error allocating memory\n");
+            exit(EXIT_FAILURE);
+        }
+        tv_detect_ncpu->thread_group_name = thread_group_name;
+
+        if (TmThreadSpawn(tv_detect_ncpu) != TM_ECODE_OK) {
+            printf("ERROR: TmThreadSpawn failed\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if ((cpu + 1) == ncpus)
+            cpu = 0;
+        else
+            cpu++;
+    }
+
+    /* a verdict thread per queue. They share the verdict queue, so each
+     * one can get the packets of any queue */
+    tm_module = TmModuleGetByName("VerdictNFQ");
+    if (tm_module == NULL) {
+        printf("ERROR: TmModuleGetByName VerdictNFQ failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (q = 0; q < queue_cnt; q++) {
+        if (queue_cnt == 1)
+            snprintf(tname, sizeof(tname), "Verdict");
+        else
+            snprintf(tname, sizeof(tname), "Verdict%"PRIu16, q+1);
+
+        char *thread_name = SCStrdup(tname);
+        if (thread_name == NULL) {
+            printf("Error allocating memory\n");
+            exit(EXIT_FAILURE);
         }
 
+        ThreadVars *tv_verdict = TmThreadCreatePacketHandler(thread_name,"verdict-queue",threading_queue_handler,"respond-queue",threading_queue_handler,"1slot");
+        if (tv_verdict == NULL) {
+            printf("ERROR: TmThreadsCreate failed\n");
+            exit(EXIT_FAILURE);
+        }
+        Tm1SlotSetFunc(tv_verdict,tm_module,NULL);
+
+        RunModeSetAffinity(tv_verdict, VERDICT_CPU_SET,
+                ncpus > 0 ? (int)(q % ncpus) : 0, PRIO_MEDIUM, ncpus);
+
+        if (TmThreadSpawn(tv_verdict) != TM_ECODE_OK) {
+            printf("ERROR: TmThreadSpawn failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    ThreadVars *tv_rreject = TmThreadCreatePacketHandler("RespondReject","respond-queue",threading_queue_handler,"alert-queue1",threading_queue_handler,"1slot");
+    if (tv_rreject == NULL) {
+        printf("ERROR: TmThreadsCreate failed\n");
+        exit(EXIT_FAILURE);
+    }
+    tm_module = TmModuleGetByName("RespondReject");
+    if (tm_module == NULL) {
+        printf("ERROR: TmModuleGetByName for RespondReject failed\n");
+        exit(EXIT_FAILURE);
+    }
+    Tm1SlotSetFunc(tv_rreject,tm_module,NULL);
+
+    RunModeSetAffinity(tv_rreject, OUTPUT_CPU_SET, 0, PRIO_MEDIUM, ncpus);
+
+    if (TmThreadSpawn(tv_rreject) != TM_ECODE_OK) {
+        printf("ERROR: TmThreadSpawn failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    ThreadVars *tv_outputs = TmThreadCreatePacketHandler("Outputs",
+        "alert-queue1", threading_queue_handler, "packetpool", "packetpool", "varslot");
+
+    RunModeSetAffinity(tv_outputs, OUTPUT_CPU_SET, 0, PRIO_MEDIUM, ncpus);
+    SetupOutputs(tv_outputs);
+    if (TmThreadSpawn(tv_outputs) != TM_ECODE_OK) {
+        printf("ERROR: TmThreadSpawn failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
+
+/**
+ * \brief RunModeIpsPacketQueueAuto set up the following thread packet handlers:
+ *        - Receive thread (from the forwarder's shared memory ring)
+ *        - Decode thread (LoRaWAN)
+ *        - Detect: If we have only 1 cpu, it will setup one Detect thread
+ *                  If we have more than one, it will setup num_cpus - 1
+ *                  starting from the second cpu available.
+ *        - Veredict thread (back to the forwarder)
+ *        - Respond/Reject thread
+ *        - Outputs thread
+ *        By default the threads will use the first cpu available
+ *        except the Detection threads if we have more than one cpu
+ *
+ * \param de_ctx pointer to the Detection Engine
+ * \param ring path of the shared memory ring the forwarder writes to
+ * \retval 0 if all goes well. (If any problem is detected the engine will
+ *           exit())
+ */
+int RunModeIpsPacketQueueAuto(DetectEngineCtx *de_ctx, char *ring) {
+    SCEnter();
+    char tname[12];
+    uint16_t cpu = 0;
+
+    /* Available cpus */
+    uint16_t ncpus = UtilCpuGetNumProcessorsOnline();
+
+    RunModeInitialize();
+
+    TimeModeSetLive();
+    /* create the threads */
+    ThreadVars *tv_receivepq = TmThreadCreatePacketHandler("ReceivePacketQueue","packetpool","packetpool","pickup-queue",threading_queue_handler,"1slot_noinout");
+    if (tv_receivepq == NULL) {
+        printf("ERROR: TmThreadsCreate failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    TmModule *tm_module = TmModuleGetByName("ReceivePacketQueue");
+    if (tm_module == NULL) {
+        printf("ERROR: TmModuleGetByName failed for ReceivePacketQueue\n");
+        exit(EXIT_FAILURE);
+    }
+    Tm1SlotSetFunc(tv_receivepq,tm_module,ring);
+
+    RunModeSetAffinity(tv_receivepq, RECEIVE_CPU_SET, 0, PRIO_MEDIUM, ncpus);
+
+    if (TmThreadSpawn(tv_receivepq) != TM_ECODE_OK) {
+        printf("ERROR: TmThreadSpawn failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    ThreadVars *tv_decode1 = TmThreadCreatePacketHandler("Decode1","pickup-queue",threading_queue_handler,"decode-queue1",threading_queue_handler,"1slot");
+    if (tv_decode1 == NULL) {
+        printf("ERROR: TmThreadsCreate failed for Decode1\n");
+        exit(EXIT_FAILURE);
+    }
+
+    tm_module = TmModuleGetByName("DecodePacketQueue");
+    if (tm_module == NULL) {
+        printf("ERROR: TmModuleGetByName DecodePacketQueue failed\n");
+        exit(EXIT_FAILURE);
+    }
+    Tm1SlotSetFunc(tv_decode1,tm_module,NULL);
+
+    RunModeSetAffinity(tv_decode1, DECODE_CPU_SET, 0, PRIO_MEDIUM, ncpus);
+
+    if (TmThreadSpawn(tv_decode1) != TM_ECODE_OK) {
+        printf("ERROR: TmThreadSpawn failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* start with cpu 1 so that if we're creating an odd number of detect
+     * threads we're not creating the most on CPU0. */
+    if (ncpus > 0)
+        cpu = 1;
+    /* always create at least one thread */
+    int thread_max = AffinityGetCpuCount(DETECT_CPU_SET, ncpus) * threading_detect_ratio;
+    if (thread_max < 1)
+        thread_max = 1;
+
+    int thread;
+    for (thread = 0; thread < thread_max; thread++) {
+        snprintf(tname, sizeof(tname),"Detect%"PRIu16, thread+1);
+
+        char *thread_name = SCStrdup(tname);
+        SCLogDebug("Assigning %s affinity to cpu %u", thread_name, cpu);
+
+        ThreadVars *tv_detect_ncpu = TmThreadCreatePacketHandler(thread_name,"decode-queue1",threading_queue_handler,"verdict-queue",threading_queue_handler,"1slot");
+        if (tv_detect_ncpu == NULL) {
+            printf("ERROR: TmThreadsCreate failed\n");
+            exit(EXIT_FAILURE);
+        }
+        tm_module = TmModuleGetByName("Detect");
+        if (tm_module == NULL) {
+            printf("ERROR: TmModuleGetByName Detect failed\n");
+            exit(EXIT_FAILURE);
+        }
+        Tm1SlotSetFunc(tv_detect_ncpu,tm_module,(void *)de_ctx);
+
+        RunModeSetAffinity(tv_detect_ncpu, DETECT_CPU_SET, cpu,
+                cpu == 0 ? PRIO_LOW : PRIO_MEDIUM, ncpus);
+
         char *thread_group_name = SCStrdup("Detect");
         if (thread_group_name == NULL) {
             printf("Error allocating memory\n");
@@ -308,30 +568,26 @@ int RunModeIpsNFQAuto(DetectEngineCtx *de_ctx, char *nfq_id) {
             cpu++;
     }
 
-    ThreadVars *tv_verdict = TmThreadCreatePacketHandler("Verdict","verdict-queue","simple","respond-queue","simple","1slot");
+    ThreadVars *tv_verdict = TmThreadCreatePacketHandler("Verdict","verdict-queue",threading_queue_handler,"respond-queue",threading_queue_handler,"1slot");
     if (tv_verdict == NULL) {
         printf("ERROR: TmThreadsCreate failed\n");
         exit(EXIT_FAILURE);
     }
-    tm_module = TmModuleGetByName("VerdictNFQ");
+    tm_module = TmModuleGetByName("VerdictPacketQueue");
     if (tm_module == NULL) {
-        printf("ERROR: TmModuleGetByName VerdictNFQ failed\n");
+        printf("ERROR: TmModuleGetByName VerdictPacketQueue failed\n");
         exit(EXIT_FAILURE);
     }
-    Tm1SlotSetFunc(tv_verdict,tm_module,nfq_id);
+    Tm1SlotSetFunc(tv_verdict,tm_module,ring);
 
-    if (threading_set_cpu_affinity) {
-        TmThreadSetCPUAffinity(tv_verdict, 0);
-        if (ncpus > 1)
-            TmThreadSetThreadPriority(tv_verdict, PRIO_MEDIUM);
-    }
+    RunModeSetAffinity(tv_verdict, VERDICT_CPU_SET, 0, PRIO_MEDIUM, ncpus);
 
     if (TmThreadSpawn(tv_verdict) != TM_ECODE_OK) {
         printf("ERROR: TmThreadSpawn failed\n");
         exit(EXIT_FAILURE);
     }
 
-    ThreadVars *tv_rreject = TmThreadCreatePacketHandler("RespondReject","respond-queue","simple","alert-queue1","simple","1slot");
+    ThreadVars *tv_rreject = TmThreadCreatePacketHandler("RespondReject","respond-queue",threading_queue_handler,"alert-queue1",threading_queue_handler,"1slot");
     if (tv_rreject == NULL) {
         printf("ERROR: TmThreadsCreate failed\n");
         exit(EXIT_FAILURE);
@@ -343,11 +599,7 @@ int RunModeIpsNFQAuto(DetectEngineCtx *de_ctx, char *nfq_id) {
     }
     Tm1SlotSetFunc(tv_rreject,tm_module,NULL);
 
-    if (threading_set_cpu_affinity) {
-        TmThreadSetCPUAffinity(tv_rreject, 0);
-        if (ncpus > 1)
-            TmThreadSetThreadPriority(tv_rreject, PRIO_MEDIUM);
-    }
+    RunModeSetAffinity(tv_rreject, OUTPUT_CPU_SET, 0, PRIO_MEDIUM, ncpus);
 
     if (TmThreadSpawn(tv_rreject) != TM_ECODE_OK) {
         printf("ERROR: TmThreadSpawn failed\n");
@@ -355,13 +607,291 @@ int RunModeIpsNFQAuto(DetectEngineCtx *de_ctx, char *nfq_id) {
     }
 
     ThreadVars *tv_outputs = TmThreadCreatePacketHandler("Outputs",
-        "alert-queue1", "simple", "packetpool", "packetpool", "varslot");
+        "alert-queue1", threading_queue_handler, "packetpool", "packetpool", "varslot");
 
-    if (threading_set_cpu_affinity) {
-        TmThreadSetCPUAffinity(tv_outputs, 0);
-        if (ncpus > 1)
-            TmThreadSetThreadPriority(tv_outputs, PRIO_MEDIUM);
+    RunModeSetAffinity(tv_outputs, OUTPUT_CPU_SET, 0, PRIO_MEDIUM, ncpus);
+    SetupOutputs(tv_outputs);
+    if (TmThreadSpawn(tv_outputs) != TM_ECODE_OK) {
+        printf("ERROR: TmThreadSpawn failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
+
+/**
+ * \brief RunModeIpsPacketQueueWorkers sets up worker threads that each
+ *        take their frames from receive to verdict and output themselves:
+ *        - Receive (from the forwarder's shared memory ring)
+ *        - Decode (LoRaWAN)
+ *        - Detect
+ *        - Verdict (back to the forwarder)
+ *        - Respond/Reject
+ *        - Outputs
+ *
+ *        Every worker reads a ring of its own, <ring>.<n> for worker n
+ *        (from 0). The forwarder divides the frames over the rings by
+ *        DevAddr, so the frames of a device are always handled by the same
+ *        worker, in order, and its session is only touched by that worker.
+ *        A busy worker only holds up its own ring.
+ *
+ *        One worker per cpu is created, unless threading.workers is set.
+ *        With set_cpu_affinity each worker gets a cpu of its own.
+ *
+ * \param de_ctx pointer to the Detection Engine
+ * \param ring path of the shared memory ring the forwarder writes to
+ * \retval 0 if all goes well. (If any problem is detected the engine will
+ *           exit())
+ */
+int RunModeIpsPacketQueueWorkers(DetectEngineCtx *de_ctx, char *ring) {
+    SCEnter();
+    char tname[16];
+    uint16_t cpu = 0;
+
+    /* Available cpus */
+    uint16_t ncpus = UtilCpuGetNumProcessorsOnline();
+
+    RunModeInitialize();
+
+    TimeModeSetLive();
+
+    int thread_max = threading_workers > 0 ? (int)threading_workers :
+        AffinityGetCpuCount(WORKER_CPU_SET, ncpus);
+    if (thread_max < 1)
+        thread_max = 1;
+    if (thread_max > PQ_RECEIVERS_MAX) {
+        SCLogWarning(SC_ERR_INVALID_ARGUMENT, "%d workers requested, using %d",
+                thread_max, PQ_RECEIVERS_MAX);
+        thread_max = PQ_RECEIVERS_MAX;
+    }
+    PacketQueueSetReceivers((uint16_t)thread_max);
+
+    SCLogInfo("using %d LoRaWAN workers", thread_max);
+
+    int thread;
+    for (thread = 0; thread < thread_max; thread++) {
+        snprintf(tname, sizeof(tname), "Worker%"PRIu16, thread+1);
+
+        char *thread_name = SCStrdup(tname);
+        if (thread_name == NULL) {
+            printf("Error allocating memory\n");
+            exit(EXIT_FAILURE);
+        }
+        SCLogDebug("Assigning %s affinity to cpu %u", thread_name, cpu);
+
+        ThreadVars *tv_worker = TmThreadCreatePacketHandler(thread_name,
+            "packetpool", "packetpool", "packetpool", "packetpool", "varslot_noin");
+        if (tv_worker == NULL) {
+            printf("ERROR: TmThreadsCreate failed\n");
+            exit(EXIT_FAILURE);
+        }
+
+        TmModule *tm_module = TmModuleGetByName("ReceivePacketQueue");
+        if (tm_module == NULL) {
+            printf("ERROR: TmModuleGetByName failed for ReceivePacketQueue\n");
+            exit(EXIT_FAILURE);
+        }
+        TmVarSlotSetFuncAppend(tv_worker, tm_module, ring);
+
+        tm_module = TmModuleGetByName("DecodePacketQueue");
+        if (tm_module == NULL) {
+            printf("ERROR: TmModuleGetByName DecodePacketQueue failed\n");
+            exit(EXIT_FAILURE);
+        }
+        TmVarSlotSetFuncAppend(tv_worker, tm_module, NULL);
+
+        tm_module = TmModuleGetByName("Detect");
+        if (tm_module == NULL) {
+            printf("ERROR: TmModuleGetByName Detect failed\n");
+            exit(EXIT_FAILURE);
+        }
+        TmVarSlotSetFuncAppend(tv_worker, tm_module, (void *)de_ctx);
+
+        tm_module = TmModuleGetByName("VerdictPacketQueue");
+        if (tm_module == NULL) {
+            printf("ERROR: TmModuleGetByName VerdictPacketQueue failed\n");
+            exit(EXIT_FAILURE);
+        }
+        TmVarSlotSetFuncAppend(tv_worker, tm_module, ring);
+
+        tm_module = TmModuleGetByName("RespondReject");
+        if (tm_module == NULL) {
+            printf("ERROR: TmModuleGetByName for RespondReject failed\n");
+            exit(EXIT_FAILURE);
+        }
+        TmVarSlotSetFuncAppend(tv_worker, tm_module, NULL);
+
+        SetupOutputs(tv_worker);
+
+        RunModeSetAffinity(tv_worker, WORKER_CPU_SET, (int)cpu, PRIO_MEDIUM, ncpus);
+
+        char *thread_group_name = SCStrdup("Workers");
+        if (thread_group_name == NULL) {
+            printf("Error allocating memory\n");
+            exit(EXIT_FAILURE);
+        }
+        tv_worker->thread_group_name = thread_group_name;
+
+        if (TmThreadSpawn(tv_worker) != TM_ECODE_OK) {
+            printf("ERROR: TmThreadSpawn failed\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if ((cpu + 1) == ncpus)
+            cpu = 0;
+        else
+            cpu++;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief RunModeFilePcapAuto set up the following thread packet handlers:
+ *        - Receive thread (reading the capture file)
+ *        - Decode thread (LoRaWAN)
+ *        - Detect: If we have only 1 cpu, it will setup one Detect thread
+ *                  If we have more than one, it will setup num_cpus - 1
+ *                  starting from the second cpu available.
+ *        - Respond/Reject thread
+ *        - Outputs thread
+ *        There is no verdict stage, the packets are only looked at. The
+ *        engine runs on the time of the capture and the time spent per
+ *        module is counted for the summary at the end.
+ *
+ * \param de_ctx pointer to the Detection Engine
+ * \param file pcap file or PHY log to replay
+ * \retval 0 if all goes well. (If any problem is detected the engine will
+ *           exit())
+ */
+int RunModeFilePcapAuto(DetectEngineCtx *de_ctx, char *file) {
+    SCEnter();
+    char tname[12];
+    uint16_t cpu = 0;
+
+    /* Available cpus */
+    uint16_t ncpus = UtilCpuGetNumProcessorsOnline();
+
+    RunModeInitialize();
+
+    TimeModeSetOffline();
+    tm_module_timing = 1;
+
+    /* create the threads */
+    ThreadVars *tv_receivepcap = TmThreadCreatePacketHandler("ReceivePcapFile","packetpool","packetpool","pickup-queue",threading_queue_handler,"1slot_noinout");
+    if (tv_receivepcap == NULL) {
+        printf("ERROR: TmThreadsCreate failed\n");
+        exit(EXIT_FAILURE);
+    }
+    TmModule *tm_module = TmModuleGetByName("ReceivePcapFile");
+    if (tm_module == NULL) {
+        printf("ERROR: TmModuleGetByName failed for ReceivePcapFile\n");
+        exit(EXIT_FAILURE);
+    }
+    Tm1SlotSetFunc(tv_receivepcap,tm_module,file);
+
+    RunModeSetAffinity(tv_receivepcap, RECEIVE_CPU_SET, 0, PRIO_MEDIUM, ncpus);
+
+    if (TmThreadSpawn(tv_receivepcap) != TM_ECODE_OK) {
+        printf("ERROR: TmThreadSpawn failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    ThreadVars *tv_decode1 = TmThreadCreatePacketHandler("Decode1","pickup-queue",threading_queue_handler,"decode-queue1",threading_queue_handler,"1slot");
+    if (tv_decode1 == NULL) {
+        printf("ERROR: TmThreadsCreate failed for Decode1\n");
+        exit(EXIT_FAILURE);
+    }
+    tm_module = TmModuleGetByName("DecodePcapFile");
+    if (tm_module == NULL) {
+        printf("ERROR: TmModuleGetByName DecodePcapFile failed\n");
+        exit(EXIT_FAILURE);
+    }
+    Tm1SlotSetFunc(tv_decode1,tm_module,NULL);
+
+    RunModeSetAffinity(tv_decode1, DECODE_CPU_SET, 0, PRIO_MEDIUM, ncpus);
+
+    if (TmThreadSpawn(tv_decode1) != TM_ECODE_OK) {
+        printf("ERROR: TmThreadSpawn failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* start with cpu 1 so that if we're creating an odd number of detect
+     * threads we're not creating the most on CPU0. */
+    if (ncpus > 0)
+        cpu = 1;
+    /* always create at least one thread */
+    int thread_max = AffinityGetCpuCount(DETECT_CPU_SET, ncpus) * threading_detect_ratio;
+    if (thread_max < 1)
+        thread_max = 1;
+
+    int thread;
+    for (thread = 0; thread < thread_max; thread++) {
+        snprintf(tname, sizeof(tname),"Detect%"PRIu16, thread+1);
+
+        char *thread_name = SCStrdup(tname);
+        if (thread_name == NULL) {
+            printf("Error allocating memory\n");
+            exit(EXIT_FAILURE);
+        }
+        SCLogDebug("Assigning %s affinity to cpu %u", thread_name, cpu);
+
+        ThreadVars *tv_detect_ncpu = TmThreadCreatePacketHandler(thread_name,"decode-queue1",threading_queue_handler,"respond-queue",threading_queue_handler,"1slot");
+        if (tv_detect_ncpu == NULL) {
+            printf("ERROR: TmThreadsCreate failed\n");
+            exit(EXIT_FAILURE);
+        }
+        tm_module = TmModuleGetByName("Detect");
+        if (tm_module == NULL) {
+            printf("ERROR: TmModuleGetByName Detect failed\n");
+            exit(EXIT_FAILURE);
+        }
+        Tm1SlotSetFunc(tv_detect_ncpu,tm_module,(void *)de_ctx);
+
+        RunModeSetAffinity(tv_detect_ncpu, DETECT_CPU_SET, cpu,
+                cpu == 0 ? PRIO_LOW : PRIO_MEDIUM, ncpus);
+
+        char *thread_group_name = SCStrdup("Detect");
+        if (thread_group_name == NULL) {
+            printf("Error allocating memory\n");
+            exit(EXIT_FAILURE);
+        }
+        tv_detect_ncpu->thread_group_name = thread_group_name;
+
+        if (TmThreadSpawn(tv_detect_ncpu) != TM_ECODE_OK) {
+            printf("ERROR: TmThreadSpawn failed\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if ((cpu + 1) == ncpus)
+            cpu = 0;
+        else
+            cpu++;
     }
+
+    ThreadVars *tv_rreject = TmThreadCreatePacketHandler("RespondReject","respond-queue",threading_queue_handler,"alert-queue1",threading_queue_handler,"1slot");
+    if (tv_rreject == NULL) {
+        printf("ERROR: TmThreadsCreate failed\n");
+        exit(EXIT_FAILURE);
+    }
+    tm_module = TmModuleGetByName("RespondReject");
+    if (tm_module == NULL) {
+        printf("ERROR: TmModuleGetByName for RespondReject failed\n");
+        exit(EXIT_FAILURE);
+    }
+    Tm1SlotSetFunc(tv_rreject,tm_module,NULL);
+
+    RunModeSetAffinity(tv_rreject, OUTPUT_CPU_SET, 0, PRIO_MEDIUM, ncpus);
+
+    if (TmThreadSpawn(tv_rreject) != TM_ECODE_OK) {
+        printf("ERROR: TmThreadSpawn failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    ThreadVars *tv_outputs = TmThreadCreatePacketHandler("Outputs",
+        "alert-queue1", threading_queue_handler, "packetpool", "packetpool", "varslot");
+
+    RunModeSetAffinity(tv_outputs, OUTPUT_CPU_SET, 0, PRIO_MEDIUM, ncpus);
     SetupOutputs(tv_outputs);
     if (TmThreadSpawn(tv_outputs) != TM_ECODE_OK) {
         printf("ERROR: TmThreadSpawn failed\n");
@@ -27,6 +27,11 @@ void RunModeInitializeOutputs(void);
 void RunModeShutDown(void);
 
 int RunModeIpsNFQAuto(DetectEngineCtx *, char *);
+int RunModeIpsPacketQueueAuto(DetectEngineCtx *, char *);
+int RunModeIpsPacketQueueWorkers(DetectEngineCtx *, char *);
+int RunModeFilePcapAuto(DetectEngineCtx *, char *);
+
+int RunModeIsWorkers(void);
 
 #endif /* __RUNMODES_H__ */
 
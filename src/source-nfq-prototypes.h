@@ -28,5 +28,7 @@ void TmModuleReceiveNFQRegister (void);
 void TmModuleVerdictNFQRegister (void);
 void TmModuleDecodeNFQRegister (void);
 
+int NFQParseQueues(char *, uint16_t *, uint16_t *);
+
 #endif /* __SOURCE_NFQ_PROTOTYPES_H__ */
 
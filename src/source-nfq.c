@@ -24,6 +24,13 @@
  *  kernel and setting verdicts back to it (inline mode).
  *  Supported on Linux and Windows.
  *
+ *  Every queue has its own receive thread, which reads up to
+ *  NFQ_RECV_BATCH datagrams per recvmmsg call. Verdicts don't go through
+ *  libnetfilter_queue: the verdict threads build the messages themselves
+ *  and send a vector's worth of them per queue in one datagram. So the
+ *  receive and the verdict side don't share any state but the socket,
+ *  and no lock.
+ *
  * \todo test if Receive and Verdict if both are present
  */
 
@@ -44,12 +51,13 @@
 #include "util-error.h"
 #include "util-byte.h"
 #include "util-privs.h"
+#include "util-unittest.h"
 #include "tmqh-packetpool.h"
 
 
 #include <pthread.h>
 
-extern int max_pending_packets;
+extern intmax_t max_pending_packets;
 
 #define NFQ_BURST_FACTOR 4
 //#define NFQ_DFT_QUEUE_LEN NFQ_BURST_FACTOR * MAX_PENDING
@@ -60,14 +68,16 @@ static NFQGlobalVars nfq_g;
 
 static NFQThreadVars nfq_t[NFQ_MAX_QUEUE];
 static uint16_t receive_queue_num = 0;
-static uint16_t verdict_queue_num = 0;
+static uint16_t verdict_thread_num = 0;
 static SCMutex nfq_init_lock;
 
 TmEcode ReceiveNFQ(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
 TmEcode ReceiveNFQThreadInit(ThreadVars *, void *, void **);
 void ReceiveNFQThreadExitStats(ThreadVars *, void *);
+void NFQRegisterTests(void);
 
 TmEcode VerdictNFQ(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
+TmEcode VerdictNFQBatch(ThreadVars *, Packet **, uint16_t, void *, PacketQueue *, PacketQueue *);
 TmEcode VerdictNFQThreadInit(ThreadVars *, void *, void **);
 void VerdictNFQThreadExitStats(ThreadVars *, void *);
 TmEcode VerdictNFQThreadDeinit(ThreadVars *, void *);
@@ -86,13 +96,14 @@ void TmModuleReceiveNFQRegister (void) {
     tmm_modules[TMM_RECEIVENFQ].Func = ReceiveNFQ;
     tmm_modules[TMM_RECEIVENFQ].ThreadExitPrintStats = ReceiveNFQThreadExitStats;
     tmm_modules[TMM_RECEIVENFQ].ThreadDeinit = NULL;
-    tmm_modules[TMM_RECEIVENFQ].RegisterTests = NULL;
+    tmm_modules[TMM_RECEIVENFQ].RegisterTests = NFQRegisterTests;
 }
 
 void TmModuleVerdictNFQRegister (void) {
     tmm_modules[TMM_VERDICTNFQ].name = "VerdictNFQ";
     tmm_modules[TMM_VERDICTNFQ].ThreadInit = VerdictNFQThreadInit;
     tmm_modules[TMM_VERDICTNFQ].Func = VerdictNFQ;
+    tmm_modules[TMM_VERDICTNFQ].FuncBatch = VerdictNFQBatch;
     tmm_modules[TMM_VERDICTNFQ].ThreadExitPrintStats = VerdictNFQThreadExitStats;
     tmm_modules[TMM_VERDICTNFQ].ThreadDeinit = VerdictNFQThreadDeinit;
     tmm_modules[TMM_VERDICTNFQ].RegisterTests = NULL;
@@ -107,6 +118,46 @@ void TmModuleDecodeNFQRegister (void) {
     tmm_modules[TMM_DECODENFQ].RegisterTests = NULL;
 }
 
+/**
+ * \brief Parse the queues to use: a single queue number or a range like
+ *        "0:3", --queue-balance style. Every queue gets its own receive
+ *        thread.
+ *
+ * \param str the -q argument
+ * \param first first queue number
+ * \param cnt number of queues
+ *
+ * \retval 0 ok, -1 invalid
+ */
+int NFQParseQueues(char *str, uint16_t *first, uint16_t *cnt)
+{
+    char *sep = NULL;
+    uint16_t last = 0;
+
+    if (str == NULL || strlen(str) == 0)
+        return -1;
+
+    sep = strchr(str, ':');
+    if (ByteExtractStringUint16(first, 10, sep ? (uint16_t)(sep - str) :
+                strlen(str), str) <= 0)
+        return -1;
+
+    last = *first;
+    if (sep != NULL) {
+        if (ByteExtractStringUint16(&last, 10, strlen(sep + 1), sep + 1) <= 0)
+            return -1;
+    }
+
+    if (last < *first || last - *first >= NFQ_MAX_QUEUE) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "queue range %s is not valid, "
+                "at most %d queues are supported", str, NFQ_MAX_QUEUE);
+        return -1;
+    }
+
+    *cnt = last - *first + 1;
+    return 0;
+}
+
 void NFQSetupPkt (Packet *p, void *data)
 {
     struct nfq_data *tb = (struct nfq_data *)data;
@@ -129,15 +180,12 @@ void NFQSetupPkt (Packet *p, void *data)
         /* nfq_get_payload returns a pointer to a part of memory
          * that is not preserved over the lifetime of our packet.
          * So we need to copy it. */
-        if (ret > 65536) {
+        if (PacketCopyData(p, (uint8_t *)pktdata, (uint32_t)ret) == -1) {
             /* Will not be able to copy data ! Set length to 0
              * to trigger an error in packet decoding.
              * This is unlikely to happen */
             SCLogWarning(SC_ERR_INVALID_ARGUMENTS, "NFQ sent too big packet");
-            p->pktlen = 0;
-        } else {
-            memcpy(p->pkt, pktdata, ret);
-            p->pktlen = (size_t)ret;
+            SET_PKT_LEN(p, 0);
         }
     } else if (ret ==  -1) {
         /* unable to get pointer to data, ensure packet length is zero.
@@ -168,10 +216,11 @@ static int NFQCallBack(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg,
     }
 
     NFQSetupPkt(p, (void *)nfa);
+    p->nfq_v.nfq_index = ntv->nfq_index;
 
 #ifdef COUNTERS
-    nfq_t->pkts++;
-    nfq_t->bytes += p->pktlen;
+    ntv->pkts++;
+    ntv->bytes += p->pktlen;
 #endif /* COUNTERS */
 
     /* pass on... */
@@ -269,6 +318,22 @@ TmEcode NFQInitThread(NFQThreadVars *nfq_t, uint16_t queue_num, uint32_t queue_m
         SCLogWarning(SC_ERR_NFQ_SETSOCKOPT, "can't set socket timeout: %s", strerror(errno));
     }
 
+    nfq_t->rbuf = SCMalloc(NFQ_RECV_BATCH * NFQ_RECV_BUFSIZE);
+    if (nfq_t->rbuf == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "can't allocate the receive buffers");
+        return TM_ECODE_FAILED;
+    }
+#ifdef MSG_WAITFORONE
+    int i;
+    memset(nfq_t->rmsgs, 0, sizeof(nfq_t->rmsgs));
+    for (i = 0; i < NFQ_RECV_BATCH; i++) {
+        nfq_t->riovs[i].iov_base = nfq_t->rbuf + i * NFQ_RECV_BUFSIZE;
+        nfq_t->riovs[i].iov_len = NFQ_RECV_BUFSIZE;
+        nfq_t->rmsgs[i].msg_hdr.msg_iov = &nfq_t->riovs[i];
+        nfq_t->rmsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+#endif /* MSG_WAITFORONE */
+
     SCLogDebug("nfq_t->h %p, nfq_t->nh %p, nfq_t->qh %p, nfq_t->fd %" PRId32 "",
             nfq_t->h, nfq_t->nh, nfq_t->qh, nfq_t->fd);
 
@@ -283,7 +348,15 @@ TmEcode ReceiveNFQThreadInit(ThreadVars *tv, void *initdata, void **data) {
     sigfillset(&sigs);
     pthread_sigmask(SIG_BLOCK, &sigs, NULL);
 
+    if (receive_queue_num >= NFQ_MAX_QUEUE) {
+        SCLogError(SC_ERR_NFQ_THREAD_INIT, "too many queues, the max is %d",
+                NFQ_MAX_QUEUE);
+        SCMutexUnlock(&nfq_init_lock);
+        exit(EXIT_FAILURE);
+    }
+
     NFQThreadVars *ntv = &nfq_t[receive_queue_num];
+    ntv->nfq_index = receive_queue_num;
 
     /* store the ThreadVars pointer in our NFQ thread context
      * as we will need it in our callback function */
@@ -314,39 +387,65 @@ TmEcode ReceiveNFQThreadInit(ThreadVars *tv, void *initdata, void **data) {
 }
 
 TmEcode VerdictNFQThreadInit(ThreadVars *tv, void *initdata, void **data) {
-    SCMutexLock(&nfq_init_lock);
-    SCLogDebug("starting... will bind to queuenum %" PRIu32 "", verdict_queue_num);
-
-    /* no initialization, ReceiveNFQ takes care of that */
-    NFQThreadVars *ntv = &nfq_t[verdict_queue_num];
-
-    *data = (void *)ntv;
-    verdict_queue_num++;
+    /* no queue initialization, ReceiveNFQ takes care of that */
+    NFQVerdictThreadVars *vtv = SCMalloc(sizeof(NFQVerdictThreadVars));
+    if (vtv == NULL)
+        return TM_ECODE_FAILED;
+    memset(vtv, 0, sizeof(NFQVerdictThreadVars));
 
+    SCMutexLock(&nfq_init_lock);
+    verdict_thread_num++;
     SCMutexUnlock(&nfq_init_lock);
+
+    *data = (void *)vtv;
     return TM_ECODE_OK;
 }
 
+/**
+ * \brief The last verdict thread to go closes the queues, any of them may
+ *        have had packets of every queue.
+ */
 TmEcode VerdictNFQThreadDeinit(ThreadVars *tv, void *data) {
-    NFQThreadVars *ntv = (NFQThreadVars *)data;
+    NFQVerdictThreadVars *vtv = (NFQVerdictThreadVars *)data;
+    uint16_t i;
 
-    SCLogDebug("starting... will close queuenum %" PRIu32 "", ntv->queue_num);
-    nfq_destroy_queue(ntv->qh);
+    SCMutexLock(&nfq_init_lock);
+    if (--verdict_thread_num == 0) {
+        for (i = 0; i < receive_queue_num; i++) {
+            SCLogDebug("closing queuenum %" PRIu32 "", nfq_t[i].queue_num);
+            if (nfq_t[i].qh != NULL) {
+                nfq_destroy_queue(nfq_t[i].qh);
+                nfq_t[i].qh = NULL;
+            }
+        }
+    }
+    SCMutexUnlock(&nfq_init_lock);
 
+    SCFree(vtv);
     return TM_ECODE_OK;
 }
 
 /**
- * \brief NFQ function to get a packet from the kernel
+ * \brief NFQ function to get packets from the kernel, as many as are
+ *        there up to NFQ_RECV_BATCH per syscall
  *
  * \note separate functions for Linux and Win32 for readability.
  */
 void NFQRecvPkt(NFQThreadVars *t) {
     int rv, ret;
-    char buf[70000];
-
-    /* XXX what happens on rv == 0? */
-    rv = recv(t->fd, buf, sizeof(buf), 0);
+#ifdef MSG_WAITFORONE
+    int i;
+#endif /* MSG_WAITFORONE */
+
+#ifdef MSG_WAITFORONE
+    /* waits for the first datagram only, within the socket timeout */
+    rv = recvmmsg(t->fd, t->rmsgs, NFQ_RECV_BATCH, MSG_WAITFORONE, NULL);
+#else
+    rv = recv(t->fd, t->rbuf, NFQ_RECV_BUFSIZE, 0);
+#endif /* MSG_WAITFORONE */
+#ifdef COUNTERS
+    t->recvs++;
+#endif /* COUNTERS */
 
     if (rv < 0) {
         if (errno == EINTR || errno == EWOULDBLOCK) {
@@ -359,20 +458,20 @@ void NFQRecvPkt(NFQThreadVars *t) {
     } else if(rv == 0) {
         SCLogWarning(SC_ERR_NFQ_RECV, "recv got returncode 0");
     } else {
-#ifdef DBG_PERF
-        if (rv > t->dbg_maxreadsize)
-            t->dbg_maxreadsize = rv;
-#endif /* DBG_PERF */
-
-        //printf("NFQRecvPkt: t %p, rv = %" PRId32 "\n", t, rv);
-
-        SCMutexLock(&t->mutex_qh);
-        ret = nfq_handle_packet(t->h, buf, rv);
-        SCMutexUnlock(&t->mutex_qh);
-
+#ifdef MSG_WAITFORONE
+        for (i = 0; i < rv; i++) {
+            ret = nfq_handle_packet(t->h, t->riovs[i].iov_base,
+                    (int)t->rmsgs[i].msg_len);
+            if (ret != 0) {
+                SCLogWarning(SC_ERR_NFQ_HANDLE_PKT, "nfq_handle_packet error %" PRId32 "", ret);
+            }
+        }
+#else
+        ret = nfq_handle_packet(t->h, t->rbuf, rv);
         if (ret != 0) {
             SCLogWarning(SC_ERR_NFQ_HANDLE_PKT, "nfq_handle_packet error %" PRId32 "", ret);
         }
+#endif /* MSG_WAITFORONE */
     }
 }
 
@@ -384,8 +483,7 @@ TmEcode ReceiveNFQ(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, Packe
     NFQThreadVars *ntv = (NFQThreadVars *)data;
 
     /* make sure we have at least one packet in the packet pool, to prevent
-     * us from 1) alloc'ing packets at line rate, 2) have a race condition
-     * for the nfq mutex lock with the verdict thread. */
+     * us from alloc'ing packets at line rate. */
     while (PacketPoolSize() == 0) {
         PacketPoolWait();
     }
@@ -402,8 +500,9 @@ TmEcode ReceiveNFQ(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, Packe
 void ReceiveNFQThreadExitStats(ThreadVars *tv, void *data) {
     NFQThreadVars *ntv = (NFQThreadVars *)data;
 #ifdef COUNTERS
-    SCLogInfo("(%s) Pkts %" PRIu32 ", Bytes %" PRIu64 ", Errors %" PRIu32 "",
-            tv->name, ntv->pkts, ntv->bytes, ntv->errs);
+    SCLogInfo("(%s) Pkts %" PRIu32 ", Bytes %" PRIu64 ", Errors %" PRIu32
+            ", Recv calls %" PRIu32 "", tv->name, ntv->pkts, ntv->bytes,
+            ntv->errs, ntv->recvs);
 #endif
 }
 
@@ -411,19 +510,85 @@ void ReceiveNFQThreadExitStats(ThreadVars *tv, void *data) {
  * \brief NFQ verdict module stats printing function
  */
 void VerdictNFQThreadExitStats(ThreadVars *tv, void *data) {
-    NFQThreadVars *ntv = (NFQThreadVars *)data;
+    NFQVerdictThreadVars *vtv = (NFQVerdictThreadVars *)data;
 #ifdef COUNTERS
-    SCLogInfo("(%s) Pkts accepted %" PRIu32 ", dropped %" PRIu32 "",
-            tv->name, ntv->accepted, ntv->dropped);
+    SCLogInfo("(%s) Pkts accepted %" PRIu32 ", dropped %" PRIu32 ", sends %"
+            PRIu32 ", errors %" PRIu32 "", tv->name, vtv->accepted,
+            vtv->dropped, vtv->sends, vtv->errs);
 #endif
 }
 
 /**
- * \brief NFQ verdict function
+ * \brief add a verdict message to a queue's batch, the same message
+ *        nfq_set_verdict() would send
  */
-void NFQSetVerdict(NFQThreadVars *t, Packet *p) {
-    int ret;
+static void NFQVerdictAdd(NFQVerdictBatch *b, uint16_t queue_num,
+        uint32_t id, uint32_t verdict)
+{
+    struct nlmsghdr *nlh = (struct nlmsghdr *)(b->buf + b->len);
+    struct nfgenmsg *nfg = NULL;
+    struct nfattr *nfa = NULL;
+    struct nfqnl_msg_verdict_hdr vh;
+
+    memset(nlh, 0, NFQ_VERDICT_MSG_LEN);
+    nlh->nlmsg_len = NFQ_VERDICT_MSG_LEN;
+    nlh->nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_VERDICT;
+    nlh->nlmsg_flags = NLM_F_REQUEST;
+
+    nfg = (struct nfgenmsg *)NLMSG_DATA(nlh);
+    nfg->nfgen_family = AF_UNSPEC;
+    nfg->version = NFNETLINK_V0;
+    nfg->res_id = htons(queue_num);
+
+    nfa = (struct nfattr *)((char *)nfg + NLMSG_ALIGN(sizeof(struct nfgenmsg)));
+    nfa->nfa_type = NFQA_VERDICT_HDR;
+    nfa->nfa_len = NFA_LENGTH(sizeof(vh));
+    vh.verdict = htonl(verdict);
+    vh.id = htonl(id);
+    memcpy(NFA_DATA(nfa), &vh, sizeof(vh));
+
+    b->len += NFQ_VERDICT_MSG_LEN;
+    b->cnt++;
+}
+
+/**
+ * \brief send the verdicts batched for a queue in one datagram
+ */
+static void NFQVerdictFlush(NFQVerdictThreadVars *vtv, uint16_t idx)
+{
+    NFQVerdictBatch *b = &vtv->batch[idx];
+    struct sockaddr_nl peer;
+
+    if (b->cnt == 0)
+        return;
+
+    memset(&peer, 0, sizeof(peer));
+    peer.nl_family = AF_NETLINK;
+
+    if (sendto(nfq_t[idx].fd, b->buf, b->len, 0, (struct sockaddr *)&peer,
+                sizeof(peer)) < 0) {
+        SCLogWarning(SC_ERR_NFQ_SET_VERDICT, "sending %" PRIu16 " verdicts "
+                "on queue %" PRIu16 " failed: %s", b->cnt,
+                nfq_t[idx].queue_num, strerror(errno));
+#ifdef COUNTERS
+        vtv->errs++;
+#endif /* COUNTERS */
+    }
+#ifdef COUNTERS
+    vtv->sends++;
+#endif /* COUNTERS */
+
+    b->cnt = 0;
+    b->len = 0;
+}
+
+/**
+ * \brief NFQ verdict function, adds the verdict to the batch of the queue
+ *        the packet came from. A full batch is sent right away.
+ */
+void NFQSetVerdict(NFQVerdictThreadVars *vtv, Packet *p) {
     uint32_t verdict;
+    uint16_t idx = p->nfq_v.nfq_index;
 
     //printf("%p verdicting on queue %" PRIu32 "\n", t, t->queue_num);
 
@@ -431,31 +596,26 @@ void NFQSetVerdict(NFQThreadVars *t, Packet *p) {
         p->action & ACTION_REJECT_DST || p->action & ACTION_DROP) {
         verdict = NF_DROP;
 #ifdef COUNTERS
-        t->dropped++;
+        vtv->dropped++;
 #endif /* COUNTERS */
     } else {
         verdict = NF_ACCEPT;
 #ifdef COUNTERS
-        t->accepted++;
+        vtv->accepted++;
 #endif /* COUNTERS */
     }
 
-    SCMutexLock(&t->mutex_qh);
-    ret = nfq_set_verdict(t->qh, p->nfq_v.id, verdict, 0, NULL);
-    SCMutexUnlock(&t->mutex_qh);
-
-    if (ret < 0) {
-        SCLogWarning(SC_ERR_NFQ_SET_VERDICT, "nfq_set_verdict of %p failed %" PRId32 "", p, ret);
-    }
+    NFQVerdictAdd(&vtv->batch[idx], nfq_t[idx].queue_num,
+            (uint32_t)p->nfq_v.id, verdict);
+    if (vtv->batch[idx].cnt == NFQ_VERDICT_BATCH)
+        NFQVerdictFlush(vtv, idx);
 }
 
 /**
- * \brief NFQ verdict module packet entry function
+ * \brief verdict a packet, unless it's a tunnel packet that has to wait
+ *        for the others
  */
-TmEcode VerdictNFQ(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, PacketQueue *postpq) {
-
-    NFQThreadVars *ntv = (NFQThreadVars *)data;
-
+static void NFQVerdictPacket(NFQVerdictThreadVars *vtv, Packet *p) {
     /* if this is a tunnel packet we check if we are ready to verdict
      * already. */
     if (IS_TUNNEL_PKT(p)) {
@@ -475,13 +635,45 @@ TmEcode VerdictNFQ(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, Packe
         /* don't verdict if we are not ready */
         if (verdict == 1) {
             //printf("VerdictNFQ: setting verdict\n");
-            NFQSetVerdict(ntv, p->root ? p->root : p);
+            NFQSetVerdict(vtv, p->root ? p->root : p);
         } else {
             TUNNEL_INCR_PKT_RTV(p);
         }
     } else {
         /* no tunnel, verdict normally */
-        NFQSetVerdict(ntv, p);
+        NFQSetVerdict(vtv, p);
+    }
+}
+
+/**
+ * \brief NFQ verdict module packet entry function. One packet at a time
+ *        there is nothing to batch, so the verdict goes out right away.
+ */
+TmEcode VerdictNFQ(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, PacketQueue *postpq) {
+    NFQVerdictThreadVars *vtv = (NFQVerdictThreadVars *)data;
+
+    NFQVerdictPacket(vtv, p);
+    NFQVerdictFlush(vtv, p->nfq_v.nfq_index);
+    return TM_ECODE_OK;
+}
+
+/**
+ * \brief NFQ verdict module vector entry function: the verdicts of a
+ *        vector go out in one datagram per queue.
+ *
+ *  We can't use nfq_set_verdict_batch(), it verdicts every packet up to
+ *  an id, and with more than one detect thread the packets of a queue
+ *  don't get here in order.
+ */
+TmEcode VerdictNFQBatch(ThreadVars *tv, Packet **pkts, uint16_t cnt, void *data, PacketQueue *pq, PacketQueue *postpq) {
+    NFQVerdictThreadVars *vtv = (NFQVerdictThreadVars *)data;
+    uint16_t i;
+
+    for (i = 0; i < cnt; i++) {
+        NFQVerdictPacket(vtv, pkts[i]);
+    }
+    for (i = 0; i < receive_queue_num; i++) {
+        NFQVerdictFlush(vtv, i);
     }
     return TM_ECODE_OK;
 }
@@ -492,7 +684,7 @@ TmEcode VerdictNFQ(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, Packe
 TmEcode DecodeNFQ(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, PacketQueue *postpq)
 {
 
-    EUI *eui = (EUI *)p->pkt;
+    EUI *eui = (EUI *)GET_PKT_DATA(p);
     DecodeThreadVars *dtv = (DecodeThreadVars *)data;
 
     SCPerfCounterIncr(dtv->counter_pkts, tv->sc_perf_pca);
@@ -503,13 +695,8 @@ TmEcode DecodeNFQ(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, Packet
     SCPerfCounterAddDouble(dtv->counter_mbit_per_sec, tv->sc_perf_pca,
                            (p->pktlen * 8)/1000000.0);
 
-    if (PKT_IS_LORAWAN(p)) {
-        SCLogDebug("Lorawan packet");
-
-        DecodeLorawanMAC(tv, dtv, p, p->pkt, p->pktlen, pq);
-    } else {
-        SCLogDebug("packet unsupported by NFQ, first byte: %02x", *p->pkt);
-    }
+    /* every frame we get is a LoRaWAN PHYPayload */
+    DecodeLorawanMAC(tv, dtv, p, GET_PKT_DATA(p), GET_PKT_LEN(p), pq);
 
     return TM_ECODE_OK;
 }
@@ -532,5 +719,31 @@ TmEcode DecodeNFQThreadInit(ThreadVars *tv, void *initdata, void **data)
     return TM_ECODE_OK;
 }
 
-#endif /* NFQ */
+#ifdef UNITTESTS
+/** \test parsing of the -q argument */
+static int NFQParseQueuesTest01(void) {
+    uint16_t first = 0, cnt = 0;
+
+    if (NFQParseQueues("5", &first, &cnt) != 0 || first != 5 || cnt != 1)
+        return 0;
+    if (NFQParseQueues("2:5", &first, &cnt) != 0 || first != 2 || cnt != 4)
+        return 0;
+    if (NFQParseQueues("5:2", &first, &cnt) == 0)
+        return 0;
+    if (NFQParseQueues("0:16", &first, &cnt) == 0)
+        return 0;
+    if (NFQParseQueues("a:b", &first, &cnt) == 0)
+        return 0;
+    if (NFQParseQueues("", &first, &cnt) == 0)
+        return 0;
+    return 1;
+}
+#endif /* UNITTESTS */
 
+void NFQRegisterTests(void) {
+#ifdef UNITTESTS
+    UtRegisterTest("NFQParseQueuesTest01", NFQParseQueuesTest01, 1);
+#endif /* UNITTESTS */
+}
+
+#endif /* NFQ */
@@ -36,12 +36,21 @@
 
 #define NFQ_MAX_QUEUE 16
 
-/* idea: set the recv-thread id in the packet to
- * select an verdict-queue */
+/** datagrams we get from the kernel per recvmmsg call */
+#define NFQ_RECV_BATCH      8
+#define NFQ_RECV_BUFSIZE    70000
+
+/** verdicts we send to the kernel in one datagram */
+#define NFQ_VERDICT_BATCH   32
+/** a verdict message: nlmsghdr, nfgenmsg and the verdict hdr attribute */
+#define NFQ_VERDICT_MSG_LEN NLMSG_SPACE(sizeof(struct nfgenmsg) + \
+        NFA_SPACE(sizeof(struct nfqnl_msg_verdict_hdr)))
 
 typedef struct NFQPacketVars_
 {
     int id; /* this nfq packets id */
+    uint16_t nfq_index; /* nfq_t entry of the queue we got it from, the
+                         * verdict goes back on that queue's socket */
 
     uint32_t mark;
     uint32_t ifi;
@@ -59,22 +68,50 @@ typedef struct NFQThreadVars_
     HANDLE fd;
     OVERLAPPED ovr;
 #endif
-    /* 2 threads deal with the queue handle, so add a mutex */
+    /* only the receive thread uses the queue handle. The verdict threads
+     * write their own messages to fd, so the two don't share a lock */
     struct nfq_q_handle *qh;
-    SCMutex mutex_qh;
-    /* this one should be not changing after init */
+    /* these should be not changing after init */
     uint16_t queue_num;
+    uint16_t nfq_index;
+
+    /* receive buffers, one per datagram of a recvmmsg */
+    char *rbuf;
+#ifdef MSG_WAITFORONE
+    struct mmsghdr rmsgs[NFQ_RECV_BATCH];
+    struct iovec riovs[NFQ_RECV_BATCH];
+#endif /* MSG_WAITFORONE */
 
     /* counters */
     uint32_t pkts;
     uint64_t bytes;
     uint32_t errs;
-    uint32_t accepted;
-    uint32_t dropped;
+    uint32_t recvs;
 
     ThreadVars *tv;
 } NFQThreadVars;
 
+/** \brief verdicts for one queue waiting to be sent as one datagram */
+typedef struct NFQVerdictBatch_
+{
+    uint16_t cnt;
+    uint32_t len;
+    char buf[NFQ_VERDICT_BATCH * NFQ_VERDICT_MSG_LEN];
+} NFQVerdictBatch;
+
+/** \brief ctx of a verdict thread. Any verdict thread can get packets of
+ *         any queue, so it batches per queue. */
+typedef struct NFQVerdictThreadVars_
+{
+    NFQVerdictBatch batch[NFQ_MAX_QUEUE];
+
+    /* counters */
+    uint32_t accepted;
+    uint32_t dropped;
+    uint32_t sends;
+    uint32_t errs;
+} NFQVerdictThreadVars;
+
 typedef struct NFQGlobalVars_
 {
     char unbind;
@@ -20,29 +20,54 @@
 #include "util-privs.h"
 #include "conf.h"
 #include "tmqh-packetpool.h"
-#include "signal.h"
+#include "tm-threads.h"
+#include "decode-lorawan-Mac.h"
+#include "decode-lorawan-frame.h"
 
-#define PQ_ACCEPT 0
-#define PQ_DROP 1
+#include <sys/mman.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+/* shared vars for the receive and verdict threads */
+static PacketQueueGlobalVars pq_g;
+
+/* verdict thread vars of this thread, if it also receives (workers) */
+static __thread PacketQueueThreadVars *pq_thread_verdict = NULL;
+/* ring this thread receives from, its verdict slot answers on it */
+static __thread int pq_thread_receiver = -1;
 
 TmEcode ReceivePacketQueue(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
 TmEcode ReceivePacketQueueThreadInit(ThreadVars *, void *, void **);
 void ReceivePacketQueueThreadExitStats(ThreadVars *, void *);
+TmEcode ReceivePacketQueueThreadDeinit(ThreadVars *, void *);
 
 TmEcode DecodePacketQueue(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
 TmEcode DecodePacketQueueThreadInit(ThreadVars *, void *, void **);
 
 TmEcode VerdictPacketQueue(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
+TmEcode VerdictPacketQueueBatch(ThreadVars *, Packet **, uint16_t, void *, PacketQueue *, PacketQueue *);
 TmEcode VerdictPacketQueueThreadInit(ThreadVars *, void *, void **);
 void VerdictPacketQueueThreadExitStats(ThreadVars *, void *);
 TmEcode VerdictPacketQueueThreadDeinit(ThreadVars *, void *);
 
+static void PacketQueueVerdictFlush(ThreadVars *, PacketQueueThreadVars *);
+
 void TmModuleReceivePacketQueueRegister (void) {
+    uint16_t i;
+
+    memset(&pq_g, 0, sizeof(pq_g));
+    for (i = 0; i < PQ_RECEIVERS_MAX; i++)
+        pq_g.maps[i].fd = -1;
+    pq_g.receivers = 1;
+    SCMutexInit(&pq_g.lock, NULL);
+
     tmm_modules[TMM_RECEIVEPACKETQUEUE].name = "ReceivePacketQueue";
     tmm_modules[TMM_RECEIVEPACKETQUEUE].ThreadInit = ReceivePacketQueueThreadInit;
     tmm_modules[TMM_RECEIVEPACKETQUEUE].Func = ReceivePacketQueue;
     tmm_modules[TMM_RECEIVEPACKETQUEUE].ThreadExitPrintStats = ReceivePacketQueueThreadExitStats;
-    tmm_modules[TMM_RECEIVEPACKETQUEUE].ThreadDeinit = NULL;
+    tmm_modules[TMM_RECEIVEPACKETQUEUE].ThreadDeinit = ReceivePacketQueueThreadDeinit;
     tmm_modules[TMM_RECEIVEPACKETQUEUE].RegisterTests = NULL;
 }
 
@@ -52,36 +77,227 @@ void TmModuleDecodePacketQueueRegister (void) {
     tmm_modules[TMM_DECODEPACKETQUEUE].Func = DecodePacketQueue;
     tmm_modules[TMM_DECODEPACKETQUEUE].ThreadExitPrintStats = NULL;
     tmm_modules[TMM_DECODEPACKETQUEUE].ThreadDeinit = NULL;
-    tmm_modules[TMM_DECODEPACKETQUEUE].RegisterTests = NULL;
+    tmm_modules[TMM_DECODEPACKETQUEUE].RegisterTests = DecodeLorawanMACRegisterTests;
 }
 
 void TmModuleVerdictPacketQueueRegister (void) {
     tmm_modules[TMM_VERDICTPACKETQUEUE].name = "VerdictPacketQueue";
     tmm_modules[TMM_VERDICTPACKETQUEUE].ThreadInit = VerdictPacketQueueThreadInit;
     tmm_modules[TMM_VERDICTPACKETQUEUE].Func = VerdictPacketQueue;
+    tmm_modules[TMM_VERDICTPACKETQUEUE].FuncBatch = VerdictPacketQueueBatch;
     tmm_modules[TMM_VERDICTPACKETQUEUE].ThreadExitPrintStats = VerdictPacketQueueThreadExitStats;
     tmm_modules[TMM_VERDICTPACKETQUEUE].ThreadDeinit = VerdictPacketQueueThreadDeinit;
     tmm_modules[TMM_VERDICTPACKETQUEUE].RegisterTests = NULL;
 }
 
+/**
+ * \brief Set the number of receive threads. Call before the threads are
+ *        spawned. With more than one, receiver n reads the ring <path>.<n>
+ *        and the forwarder has to fan the frames out over all of them.
+ */
+void PacketQueueSetReceivers(uint16_t cnt)
+{
+    if (cnt == 0)
+        cnt = 1;
+    if (cnt > PQ_RECEIVERS_MAX) {
+        SCLogWarning(SC_ERR_INVALID_ARGUMENT, "%"PRIu16" receivers requested, "
+                "the ring supports %d", cnt, PQ_RECEIVERS_MAX);
+        cnt = PQ_RECEIVERS_MAX;
+    }
+    pq_g.receivers = cnt;
+}
+
 /*
  * Receiving Part
  */
+
+/**
+ * \brief Map the shared memory ring of receiver 'idx'.
+ *
+ *        The receive and verdict threads of a ring share one mapping, the
+ *        first caller maps it. If the ring file doesn't exist yet we create and
+ *        initialize it, so it doesn't matter if the forwarder or the engine
+ *        starts first. If the forwarder just created it, we give it
+ *        PQ_RING_ATTACH_WAIT_USEC to ftruncate and initialize the ring.
+ *
+ * \param base path of the ring, e.g. /dev/shm/lora-ring, receiver n of
+ *        several maps <base>.<n>
+ * \param idx receiver the ring belongs to
+ *
+ * \retval ring the mapped ring or NULL on error
+ */
+static PacketQueueRing *PacketQueueRingAttach(char *base, uint16_t idx)
+{
+    PacketQueueRingMap *map = &pq_g.maps[idx];
+    char path[PATH_MAX];
+    struct stat st;
+    intmax_t size = PQ_RING_DEFAULT_SIZE;
+    int created = 0;
+    uint32_t waited = 0;
+
+    SCMutexLock(&pq_g.lock);
+    if (map->ring != NULL) {
+        map->refcnt++;
+        SCMutexUnlock(&pq_g.lock);
+        return map->ring;
+    }
+
+    if (pq_g.receivers == 1)
+        strlcpy(path, base, sizeof(path));
+    else
+        snprintf(path, sizeof(path), "%s.%"PRIu16, base, idx);
+
+    if (ConfGetInt("packetqueue.ring-size", &size) == 1) {
+        if (size <= 0 || (size & (size - 1)) != 0) {
+            SCLogError(SC_ERR_INVALID_ARGUMENT, "packetqueue.ring-size %"PRIdMAX
+                    " is not a power of 2", size);
+            SCMutexUnlock(&pq_g.lock);
+            return NULL;
+        }
+    }
+
+    map->fd = open(path, O_RDWR);
+    if (map->fd < 0 && errno == ENOENT) {
+        map->fd = open(path, O_RDWR|O_CREAT|O_EXCL, 0600);
+        if (map->fd >= 0) {
+            if (ftruncate(map->fd, PQ_RING_MAP_SIZE(size)) != 0) {
+                SCLogError(SC_ERR_PQ_RING, "ftruncate of ring %s failed: %s",
+                        path, strerror(errno));
+                goto error;
+            }
+            created = 1;
+        }
+    }
+    if (map->fd < 0) {
+        SCLogError(SC_ERR_PQ_RING, "opening ring %s failed: %s", path,
+                strerror(errno));
+        SCMutexUnlock(&pq_g.lock);
+        return NULL;
+    }
+
+    /* the forwarder may have created the file, but not sized it yet */
+    for (;;) {
+        if (fstat(map->fd, &st) != 0) {
+            SCLogError(SC_ERR_PQ_RING, "fstat of ring %s failed: %s", path,
+                    strerror(errno));
+            goto error;
+        }
+        if ((size_t)st.st_size >= sizeof(PacketQueueRing))
+            break;
+        if (waited >= PQ_RING_ATTACH_WAIT_USEC) {
+            SCLogError(SC_ERR_PQ_RING, "ring %s is too small", path);
+            goto error;
+        }
+        usleep(PQ_RING_ATTACH_POLL_USEC);
+        waited += PQ_RING_ATTACH_POLL_USEC;
+    }
+
+    map->map_size = (size_t)st.st_size;
+    map->ring = mmap(NULL, map->map_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                     map->fd, 0);
+    if (map->ring == MAP_FAILED) {
+        SCLogError(SC_ERR_PQ_RING, "mmap of ring %s failed: %s", path,
+                strerror(errno));
+        map->ring = NULL;
+        goto error;
+    }
+
+    if (created) {
+        map->ring->size = (uint32_t)size;
+        map->ring->frame_size = sizeof(PacketQueueFrame);
+        map->ring->verdict_size = sizeof(PacketQueueVerdict);
+        map->ring->ring_idx = idx;
+        map->ring->ring_cnt = pq_g.receivers;
+        map->ring->head = 0;
+        map->ring->tail = 0;
+        map->ring->vhead = 0;
+        map->ring->vtail = 0;
+        map->ring->vseq = 0;
+        map->ring->vwaiters = 0;
+        map->ring->version = PQ_RING_VERSION;
+        __sync_synchronize();
+        map->ring->magic = PQ_RING_MAGIC;
+    }
+
+    /* the forwarder sets the magic last, once the ring is initialized */
+    while (map->ring->magic == 0 && waited < PQ_RING_ATTACH_WAIT_USEC) {
+        usleep(PQ_RING_ATTACH_POLL_USEC);
+        waited += PQ_RING_ATTACH_POLL_USEC;
+    }
+    __sync_synchronize();
+
+    if (map->ring->magic != PQ_RING_MAGIC ||
+        map->ring->version != PQ_RING_VERSION ||
+        map->ring->frame_size != sizeof(PacketQueueFrame) ||
+        map->ring->verdict_size != sizeof(PacketQueueVerdict))
+    {
+        SCLogError(SC_ERR_PQ_RING, "ring %s has an incompatible layout "
+                "(magic %08x, version %u, frame size %u)", path,
+                map->ring->magic, map->ring->version, map->ring->frame_size);
+        goto error;
+    }
+    if (map->ring->size == 0 || (map->ring->size & (map->ring->size - 1)) != 0 ||
+        PQ_RING_MAP_SIZE(map->ring->size) > map->map_size)
+    {
+        SCLogError(SC_ERR_PQ_RING, "ring %s has an invalid size %u", path,
+                map->ring->size);
+        goto error;
+    }
+
+    /* the forwarder fans out over ring_cnt rings, if that isn't the
+     * number of receivers we run, frames would go to rings nobody reads */
+    if (map->ring->ring_idx != idx || map->ring->ring_cnt != pq_g.receivers) {
+        SCLogError(SC_ERR_PQ_RING, "ring %s is ring %u of %u, but we run "
+                "%"PRIu16" receivers", path, map->ring->ring_idx,
+                map->ring->ring_cnt, pq_g.receivers);
+        goto error;
+    }
+
+    map->refcnt = 1;
+    SCLogInfo("using LoRaWAN frame ring %s (%u slots%s, ring %"PRIu16" of "
+            "%"PRIu16")", path, map->ring->size, created ? ", created" : "",
+            idx, pq_g.receivers);
+    SCMutexUnlock(&pq_g.lock);
+    return map->ring;
+
+error:
+    if (map->ring != NULL) {
+        munmap(map->ring, map->map_size);
+        map->ring = NULL;
+    }
+    close(map->fd);
+    map->fd = -1;
+    SCMutexUnlock(&pq_g.lock);
+    return NULL;
+}
+
+/**
+ * \brief Drop a reference to the ring of receiver 'idx', the last one
+ *        unmaps it.
+ */
+static void PacketQueueRingDetach(uint16_t idx)
+{
+    PacketQueueRingMap *map = &pq_g.maps[idx];
+
+    SCMutexLock(&pq_g.lock);
+    if (map->refcnt > 0 && --map->refcnt == 0) {
+        munmap(map->ring, map->map_size);
+        map->ring = NULL;
+        close(map->fd);
+        map->fd = -1;
+    }
+    SCMutexUnlock(&pq_g.lock);
+}
+
 TmEcode ReceivePacketQueueThreadInit(ThreadVars *tv, void *initdata, void **data){
     
     sigset_t sigs;
     sigfillset(&sigs);
     pthread_sigmask(SIG_BLOCK, &sigs, NULL);
 
-
-    /* Extract the queue number-initdata from command line */
-    uint16_t queue_num = 0;
-    if ((ByteExtractStringUint16(&queue_num, 10, strlen((char *)initdata),
-                                      (char *)initdata)) < 0)
-    {
-        SCLogError(SC_ERR_INVALID_ARGUMENT, "specified queue number %s is not "
-                                        "valid", (char *)initdata);
-        exit(EXIT_FAILURE);
+    if (initdata == NULL) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "no packetqueue ring specified");
+        SCReturnInt(TM_ECODE_FAILED);
     }
 
     /*setup Threadvars*/
@@ -90,16 +306,178 @@ TmEcode ReceivePacketQueueThreadInit(ThreadVars *tv, void *initdata, void **data
         SCReturnInt(TM_ECODE_FAILED);
     memset(ptv, 0, sizeof(PacketQueueThreadVars));    
 
+    SCMutexLock(&pq_g.lock);
+    if (pq_g.receiver_cnt >= pq_g.receivers) {
+        SCMutexUnlock(&pq_g.lock);
+        SCLogError(SC_ERR_PQ_RING, "more receive threads than the %"PRIu16
+                " rings set up", pq_g.receivers);
+        SCFree(ptv);
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+    ptv->receiver = pq_g.receiver_cnt++;
+    SCMutexUnlock(&pq_g.lock);
+
+    ptv->ring = PacketQueueRingAttach((char *)initdata, ptv->receiver);
+    if (ptv->ring == NULL) {
+        SCFree(ptv);
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+    ptv->mask = ptv->ring->size - 1;
+    pq_thread_receiver = ptv->receiver;
+
     //pass threadvar pointer
     *data = (void *)ptv;
 
     SCReturnInt(TM_ECODE_OK);
 }
 
+TmEcode ReceivePacketQueueThreadDeinit(ThreadVars *tv, void *data) {
+    PacketQueueThreadVars *ptv = (PacketQueueThreadVars *)data;
+
+    if (ptv->ring != NULL) {
+        PacketQueueRingDetach(ptv->receiver);
+        ptv->ring = NULL;
+    }
+
+    return TM_ECODE_OK;
+}
+
+/**
+ * \brief Fill a packet from a ring frame. The frame is only valid until we
+ *        advance the tail, so everything we need is copied.
+ */
+static inline void PacketQueueSetupPkt(Packet *p, PacketQueueFrame *f)
+{
+    /* frames are at most PQ_FRAME_MAX_LEN, so this is the inline buffer */
+    memcpy(p->pkt, f->data, f->len);
+    SET_PKT_LEN(p, f->len);
+
+    p->ts.tv_sec = f->ts_sec;
+    p->ts.tv_usec = f->ts_usec;
+
+    p->pq_v.id = f->id;
+    p->pq_v.pid = (pid_t)f->pid;
+    p->pq_v.gweui = f->gweui;
+    p->pq_v.tmst = f->tmst;
+    p->pq_v.freq = f->freq;
+    p->pq_v.rssi = f->rssi;
+    p->pq_v.lsnr = f->lsnr;
+    p->pq_v.chan = f->chan;
+    p->pq_v.rfch = f->rfch;
+}
+
+/**
+ * \brief Get the ring the forwarder should have put a frame on: hash the
+ *        DevAddr of data frames and the DevEUI of join requests. Everything
+ *        else, including frames that are too short to have them, goes to
+ *        the first ring.
+ */
+static inline uint16_t PacketQueueFrameReceiver(PacketQueueFrame *f, uint16_t receivers)
+{
+    uint8_t mtype;
+    uint32_t key;
+
+    if (f->len < LORAWAN_MAC_HEADER_LEN + LORAWAN_FRAME_DEV_ADDR_LEN)
+        return 0;
+
+    mtype = LORAWAN_MHDR_GET_MTYPE(f->data[0]);
+    if (LORAWAN_MTYPE_IS_DATA(mtype)) {
+        key = LORAWAN_GET_LE32(&f->data[LORAWAN_MAC_HEADER_LEN]);
+    } else if (mtype == JOIN_REQUEST &&
+            f->len >= LORAWAN_MAC_HEADER_LEN + LORAWAN_JOIN_REQUEST_LEN) {
+        /* JoinEUI(8) | DevEUI(8) | DevNonce(2) */
+        uint64_t dev_eui = LORAWAN_GET_LE64(&f->data[LORAWAN_MAC_HEADER_LEN + 8]);
+        key = (uint32_t)(dev_eui ^ (dev_eui >> 32));
+    } else {
+        return 0;
+    }
+
+    return PQ_RING_FANOUT(key, receivers);
+}
+
+/**
+ * \brief Receive up to PQ_RING_BURST frames from the shared memory ring.
+ *
+ *        No syscalls are needed while the ring has frames. When it runs
+ *        dry we poll for a while and then back off with a short sleep so
+ *        an idle engine doesn't burn a core.
+ *
+ *        Packets go to the thread's output queue, or, if we are the first
+ *        slot of a worker, to pq so the worker runs them through its other
+ *        slots.
+ */
 TmEcode ReceivePacketQueue(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, PacketQueue *postpq){
 	PacketQueueThreadVars *ptv = (PacketQueueThreadVars *)data;
+    PacketQueueRing *ring = ptv->ring;
+    uint16_t receivers = pq_g.receivers;
+    uint32_t pos = ring->tail;
+    uint32_t head = ring->head;
+    int cnt = 0;
+
+    /* a worker is done with all packets of its previous burst, so the
+     * verdicts it holds back can go */
+    if (pq != NULL && pq_thread_verdict != NULL)
+        PacketQueueVerdictFlush(tv, pq_thread_verdict);
+
+    /* pairs with the producer's barrier before it updates head: the
+     * frame contents are visible once we see the new head */
+    __sync_synchronize();
+
+    if (head == pos) {
+        if (++ptv->idle > PQ_RING_SPIN_CNT) {
+            /* don't sit on packets the other workers may need */
+            PacketPoolFlushCache();
+            usleep(PQ_RING_IDLE_USEC);
+        }
+        return TM_ECODE_OK;
+    }
+    ptv->idle = 0;
+
+    /* make sure we have at least one packet in the packet pool, so we
+     * don't alloc packets at line rate */
+    while (PacketPoolSize() == 0) {
+        PacketPoolWait();
+    }
+
+    while (pos != head && cnt < PQ_RING_BURST) {
+        PacketQueueFrame *f = &ring->frames[pos & ptv->mask];
+
+        /* still ours to handle, but the devices it belongs to may now
+         * be seen by two workers */
+        if (receivers > 1 && PacketQueueFrameReceiver(f, receivers) != ptv->receiver)
+            ptv->misrouted++;
+
+        if (f->len == 0 || f->len > PQ_FRAME_MAX_LEN) {
+#ifdef COUNTERS
+            ptv->errs++;
+#endif /* COUNTERS */
+            pos++;
+            continue;
+        }
 
-	///TODO discuss funcs to be added
+        Packet *np = PacketGetFromQueueOrAlloc();
+        if (np == NULL)
+            break;
+
+        PacketQueueSetupPkt(np, f);
+        pos++;
+        cnt++;
+
+#ifdef COUNTERS
+        ptv->pkts++;
+        ptv->bytes += np->pktlen;
+#endif /* COUNTERS */
+
+        /* pass on... */
+        if (pq != NULL)
+            PacketEnqueue(pq, np);
+        else
+            tv->tmqh_out(tv, np);
+    }
+
+    /* release the slots only after we copied them */
+    __sync_synchronize();
+    ring->tail = pos;
 
 	return TM_ECODE_OK;
 }
@@ -111,6 +489,11 @@ void ReceivePacketQueueThreadExitStats(ThreadVars *tv, void *data){
     SCLogInfo("(%s) Pkts %" PRIu32 ", Bytes %" PRIu64 ", Errors %" PRIu32 "",
             tv->name, ptv->pkts, ptv->bytes, ptv->errs);
 #endif
+    if (ptv->misrouted > 0) {
+        SCLogWarning(SC_ERR_PQ_RING, "(%s) %" PRIu32 " frames on ring %"
+                PRIu16 " belong on another ring, the forwarder doesn't fan "
+                "out like we do", tv->name, ptv->misrouted, ptv->receiver);
+    }
 }
 
 /*
@@ -128,12 +511,7 @@ TmEcode DecodePacketQueue(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq
     SCPerfCounterAddDouble(dtv->counter_mbit_per_sec, tv->sc_perf_pca,
                            (p->pktlen * 8)/1000000.0);
     //process LoRaWAN packets
-    if (PKT_IS_LORAWAN(p)) {
-        SCLogDebug("Lorawan packet");
-        DecodeLorawanMAC(tv, dtv, p, p->pkt, p->pktlen, pq);
-    } else {
-        SCLogDebug("packet unsupported by lorawan, first byte: %02x", *p->pkt);
-    }
+    DecodeLorawanMAC(tv, dtv, p, GET_PKT_DATA(p), GET_PKT_LEN(p), pq);
 
     return TM_ECODE_OK;
 }
@@ -160,54 +538,217 @@ TmEcode DecodePacketQueueThreadInit(ThreadVars *tv, void *initdata, void **data)
 TmEcode VerdictPacketQueueThreadInit(ThreadVars *tv, void *initdata, void **data) {
 	PacketQueueThreadVars *ptv = NULL;
 
+    if (initdata == NULL) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "no packetqueue ring specified");
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+
     if ( (ptv = SCMalloc(sizeof(PacketQueueThreadVars))) == NULL)
         SCReturnInt(TM_ECODE_FAILED);
     memset(ptv, 0, sizeof(PacketQueueThreadVars));
 
+    /* a worker answers on the ring it receives from, which its receive
+     * slot attached before us. A verdict thread of its own only works
+     * with a single ring. */
+    if (pq_thread_receiver >= 0) {
+        ptv->receiver = (uint16_t)pq_thread_receiver;
+    } else if (pq_g.receivers > 1) {
+        SCLogError(SC_ERR_PQ_RING, "a verdict thread can't serve %"PRIu16
+                " rings, use the workers runmode", pq_g.receivers);
+        SCFree(ptv);
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+
+    ptv->ring = PacketQueueRingAttach((char *)initdata, ptv->receiver);
+    if (ptv->ring == NULL) {
+        SCFree(ptv);
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+    ptv->mask = ptv->ring->size - 1;
+    ptv->verdicts = PQ_RING_VERDICTS(ptv->ring);
+
+    pq_thread_verdict = ptv;
     *data = (void *)ptv;
 
     return TM_ECODE_OK;
 }
 
+/**
+ * \brief Publish the verdicts held back since the last flush and wake the
+ *        forwarder if it is sleeping. This is the only place the forwarder
+ *        is woken, so it is woken at most once per batch.
+ *
+ *        Every ring has a single verdict thread: the worker reading it, or
+ *        the verdict thread with a single ring. So vhead has one writer.
+ */
+static void PacketQueueVerdictFlush(ThreadVars *tv, PacketQueueThreadVars *ptv)
+{
+    PacketQueueRing *ring = ptv->ring;
+    uint32_t start, i, n = ptv->vpending;
+    uint32_t drain_usec = 0;
+
+    if (n == 0)
+        return;
+    ptv->vpending = 0;
+
+    if (ptv->vdead)
+        goto lost;
+
+    start = ring->vhead;
+
+    /* verdict ring full: wait for the forwarder to make room. Never drop
+     * a verdict, unless we are killed: then the forwarder gets
+     * PQ_VERDICT_DRAIN_USEC to drain the ring. If it didn't take anything
+     * by then it is gone, and we don't wait for it again. */
+    while ((uint32_t)(start + n - ring->vtail) > ring->size) {
+        if (TmThreadsCheckFlag(tv, THV_KILL)) {
+            if (drain_usec >= PQ_VERDICT_DRAIN_USEC) {
+                ptv->vdead = 1;
+                goto lost;
+            }
+            drain_usec += PQ_RING_IDLE_USEC;
+        }
+        usleep(PQ_RING_IDLE_USEC);
+    }
+
+    for (i = 0; i < n; i++)
+        ptv->verdicts[(start + i) & ptv->mask] = ptv->vbatch[i];
+
+    /* verdict slots must be visible before the new vhead */
+    __sync_synchronize();
+    ring->vhead = start + n;
+    __sync_fetch_and_add(&ring->vseq, 1);
+
+    ptv->batches++;
+
+    /* the forwarder sets vwaiters before it re-checks vhead and sleeps,
+     * and our vseq bump above makes its FUTEX_WAIT fail if it raced with
+     * us, so we can't lose a wakeup here */
+    if (ring->vwaiters != 0) {
+#ifdef __linux__
+        syscall(SYS_futex, &ring->vseq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif /* __linux__ */
+        ptv->wakeups++;
+    }
+    return;
+
+lost:
+    /* the forwarder will wait for these frames until it times them out */
+    ptv->vlost += n;
+    return;
+}
+
 TmEcode VerdictPacketQueueThreadDeinit(ThreadVars *tv, void *data) {
-	
-	/* will be called after VerdictPacketQueueThreadExitStats 
-	 * NFQ cases needed to call nfq_destory_queue (unbinding queue handle)
-	 * IPFW cases did nothing 
-	 * TODO discuss funcs needed to be added
-	 */
+    PacketQueueThreadVars *ptv = (PacketQueueThreadVars *)data;
+
+    /* will be called after VerdictPacketQueueThreadExitStats, hand out
+     * whatever we still hold back */
+    if (ptv->ring != NULL) {
+        PacketQueueVerdictFlush(tv, ptv);
+        PacketQueueRingDetach(ptv->receiver);
+        ptv->ring = NULL;
+    }
+    if (ptv->vlost > 0) {
+        SCLogWarning(SC_ERR_PQ_RING, "(%s) %" PRIu32 " verdicts lost: the "
+                "forwarder didn't take them before we exited", tv->name,
+                ptv->vlost);
+    }
 	return TM_ECODE_OK;
 }
 
-void PacketQueueSetVerdict(PacketQueueThreadVars *ptv, Packet *p) {
-    int ret;
+/**
+ * \brief Get the sid to report with the verdict: the first alert that
+ *        made us drop, or the first alert if we accept.
+ */
+static uint32_t PacketQueueVerdictSid(Packet *p, uint32_t verdict)
+{
+    uint16_t i;
+
+    if (p->alerts.cnt == 0)
+        return 0;
+
+    if (verdict == PQ_DROP) {
+        for (i = 0; i < p->alerts.cnt; i++) {
+            if (p->alerts.alerts[i].action & (ACTION_DROP|ACTION_REJECT|
+                        ACTION_REJECT_DST|ACTION_REJECT_BOTH))
+                return p->alerts.alerts[i].sid;
+        }
+    }
+    return p->alerts.alerts[0].sid;
+}
+
+void PacketQueueSetVerdict(ThreadVars *tv, PacketQueueThreadVars *ptv, Packet *p) {
+    PacketQueueVerdict *v;
     uint32_t verdict;
 
     if (p->action & ACTION_REJECT || p->action & ACTION_REJECT_BOTH ||
         p->action & ACTION_REJECT_DST || p->action & ACTION_DROP) {
         verdict = PQ_DROP;
-        ptv->dropped++;
-	kill(p->pid,SIGUSR1); /* send SIGUSR1 to HTTP Server */
     } else {
         verdict = PQ_ACCEPT;
-        ptv->accepted++;
-	kill(p->pid,SIGUSR2); /* send SIGUSR2 to HTTP Server */
-        //TODO packet accept case 
     }
 
+    if (ptv->vpending == PQ_VERDICT_BATCH)
+        PacketQueueVerdictFlush(tv, ptv);
+
+    v = &ptv->vbatch[ptv->vpending];
+    v->id = p->pq_v.id;
+    v->sid = PacketQueueVerdictSid(p, verdict);
+    v->verdict = (uint8_t)verdict;
+    v->pad[0] = v->pad[1] = v->pad[2] = 0;
+    ptv->vpending++;
+
+    if (verdict == PQ_DROP)
+        ptv->dropped++;
+    else
+        ptv->accepted++;
 }
 
 TmEcode VerdictPacketQueue(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, PacketQueue *postpq) {
 	PacketQueueThreadVars *ptv = (PacketQueueThreadVars *)data;
 
-	PacketQueueSetVerdict(ptv,p);
+	PacketQueueSetVerdict(tv, ptv, p);
+
+    /* close the batch if it is full or if no more packets are waiting
+     * for a verdict. The unlocked read of the queue len is fine: if we
+     * miss a packet being added we'll see it on the next call. A worker
+     * has no input queue, its receive slot flushes after each burst. */
+    if (ptv->vpending >= PQ_VERDICT_BATCH ||
+        (tv->inq != NULL && trans_q[tv->inq->id].len == 0))
+    {
+        PacketQueueVerdictFlush(tv, ptv);
+    }
 
 	return TM_ECODE_OK;
 }
 
+/**
+ * \brief Verdict a vector of packets from a batch queue handler. The
+ *        verdicts go out together, at most one batch per vector.
+ */
+TmEcode VerdictPacketQueueBatch(ThreadVars *tv, Packet **pkts, uint16_t cnt, void *data, PacketQueue *pq, PacketQueue *postpq) {
+    PacketQueueThreadVars *ptv = (PacketQueueThreadVars *)data;
+    uint16_t i;
+
+    /* a full batch is flushed by PacketQueueSetVerdict */
+    for (i = 0; i < cnt; i++) {
+        PacketQueueSetVerdict(tv, ptv, pkts[i]);
+    }
+
+    if (ptv->vpending >= PQ_VERDICT_BATCH ||
+        (tv->inq != NULL && trans_q[tv->inq->id].len == 0))
+    {
+        PacketQueueVerdictFlush(tv, ptv);
+    }
+
+    return TM_ECODE_OK;
+}
+
 // verdict module stats printing function
 void VerdictPacketQueueThreadExitStats(ThreadVars *tv, void *data) {
     PacketQueueThreadVars *ptv = (PacketQueueThreadVars *)data;
-    SCLogInfo("(%s) Pkts accepted %" PRIu32 ", dropped %" PRIu32 "",tv->name, ptv->accepted, ptv->dropped);
+    SCLogInfo("(%s) Pkts accepted %" PRIu32 ", dropped %" PRIu32 ", batches %"
+            PRIu32 ", wakeups %" PRIu32 ", verdicts lost %" PRIu32 "", tv->name,
+            ptv->accepted, ptv->dropped, ptv->batches, ptv->wakeups,
+            ptv->vlost);
 }
-
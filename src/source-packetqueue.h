@@ -5,27 +5,199 @@
 #ifndef __SOURCE_PKTQUEUE_H__
 #define __SOURCE_PKTQUEUE_H__
 
-// not used but neeeded in API
+/** \brief Shared memory ring between the LoRa forwarder and the engine.
+ *
+ *  The forwarder (producer) and ReceivePacketQueue (consumer) share a
+ *  single-producer/single-consumer ring of fixed size frame slots. The
+ *  forwarder copies a PHYPayload plus its radio metadata into the slot at
+ *  'head' and then advances 'head'. We copy the frame into a Packet and
+ *  advance 'tail'. Both indexes only ever increase and wrap at 2^32, the
+ *  slot is (idx & (size - 1)), so 'size' must be a power of 2.
+ *
+ *  Verdicts travel back the same way in a second ring of the same size
+ *  that follows the frames: VerdictPacketQueue owns 'vhead', the forwarder
+ *  owns 'vtail'. Verdicts are published in batches. Each published batch
+ *  bumps 'vseq', and only if the forwarder announced it is sleeping on
+ *  'vseq' (through 'vwaiters') it is woken with a single futex wake.
+ *
+ *  In the workers runmode every worker has a ring of its own, <path>.<n>
+ *  for worker n (counting from 0), and 'ring_idx'/'ring_cnt' in each ring
+ *  tell the forwarder which one it is. The forwarder fans the frames out
+ *  over the rings by DevAddr (DevEUI for join requests), see
+ *  PQ_RING_FANOUT(), so all frames of a device end up on the same worker.
+ *  A worker only ever reads its own ring and is the only one writing its
+ *  verdicts, so every ring stays single-producer/single-consumer in both
+ *  directions and a slow worker only holds up the devices it owns.
+ *
+ *  The layout is shared with another process, so it only uses fixed width
+ *  types and must not change without bumping PQ_RING_VERSION.
+ */
+#define PQ_RING_MAGIC                   0x4c524152  /**< "LRAR" */
+#define PQ_RING_VERSION                 3
+#define PQ_RING_DEFAULT_SIZE            4096        /**< default number of slots */
+#define PQ_RING_CACHELINE               64
+#define PQ_FRAME_MAX_LEN                256         /**< max LoRaWAN PHYPayload */
+
+/** frames handled per ReceivePacketQueue call before checking for a kill */
+#define PQ_RING_BURST                   64
+/** empty polls before we start sleeping between polls */
+#define PQ_RING_SPIN_CNT                1000
+#define PQ_RING_IDLE_USEC               50
+
+/** max verdicts we hold back before publishing them to the forwarder */
+#define PQ_VERDICT_BATCH                64
+/** once killed, how long we still wait for the forwarder to take verdicts
+ *  before we count them as lost */
+#define PQ_VERDICT_DRAIN_USEC           100000
+
+/** how long we wait for a forwarder that created the ring file to size and
+ *  initialize it, and how often we look */
+#define PQ_RING_ATTACH_WAIT_USEC        5000000
+#define PQ_RING_ATTACH_POLL_USEC        10000
+
+/** max receivers, each with a ring of its own (workers runmode) */
+#define PQ_RECEIVERS_MAX                64
+
+/* verdicts */
+#define PQ_ACCEPT                       0
+#define PQ_DROP                         1
+
+typedef struct PacketQueueFrame_ {
+    uint32_t id;            /**< forwarder side frame id, used for the verdict */
+    uint32_t pid;           /**< pid of the forwarder that owns the frame */
+    uint32_t ts_sec;        /**< host receive time */
+    uint32_t ts_usec;
+    uint64_t gweui;         /**< EUI of the gateway that heard the frame */
+    uint32_t tmst;          /**< concentrator timestamp (usec) */
+    uint32_t freq;          /**< center frequency in Hz */
+    int16_t rssi;           /**< RSSI in dBm */
+    int16_t lsnr;           /**< SNR in 0.1 dB units */
+    uint8_t chan;           /**< concentrator IF channel */
+    uint8_t rfch;           /**< concentrator RF chain */
+    uint16_t len;           /**< length of data[] in use */
+    uint8_t data[PQ_FRAME_MAX_LEN];
+} PacketQueueFrame;
+
+typedef struct PacketQueueVerdict_ {
+    uint32_t id;            /**< PacketQueueFrame::id of the frame */
+    uint32_t sid;           /**< sid of the signature that decided, 0 if none */
+    uint8_t verdict;        /**< PQ_ACCEPT or PQ_DROP */
+    uint8_t pad[3];
+} PacketQueueVerdict;
+
+typedef struct PacketQueueRing_ {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;          /**< number of slots, power of 2 */
+    uint32_t frame_size;    /**< sizeof(PacketQueueFrame) of the producer */
+    uint32_t verdict_size;  /**< sizeof(PacketQueueVerdict) of the producer */
+    uint16_t ring_idx;      /**< receiver reading this ring */
+    uint16_t ring_cnt;      /**< number of rings the frames are fanned out on */
+    uint8_t pad0[PQ_RING_CACHELINE - 24];
+
+    /** producer owned: idx of the next slot it will write */
+    volatile uint32_t head;
+    uint8_t pad1[PQ_RING_CACHELINE - sizeof(uint32_t)];
+
+    /** consumer owned: idx of the next slot we will read */
+    volatile uint32_t tail;
+    uint8_t pad2[PQ_RING_CACHELINE - sizeof(uint32_t)];
+
+    /** engine owned: idx of the next verdict slot we will write */
+    volatile uint32_t vhead;
+    /** futex word, incremented for every published verdict batch */
+    volatile uint32_t vseq;
+    uint8_t pad3[PQ_RING_CACHELINE - 2 * sizeof(uint32_t)];
+
+    /** forwarder owned: idx of the next verdict it will read */
+    volatile uint32_t vtail;
+    /** set by the forwarder while it sleeps on vseq */
+    volatile uint32_t vwaiters;
+    uint8_t pad4[PQ_RING_CACHELINE - 2 * sizeof(uint32_t)];
+
+    PacketQueueFrame frames[];
+    /* followed by PacketQueueVerdict verdicts[size] */
+} PacketQueueRing;
+
+#define PQ_RING_MAP_SIZE(size) \
+    (sizeof(PacketQueueRing) + (size_t)(size) * \
+     (sizeof(PacketQueueFrame) + sizeof(PacketQueueVerdict)))
+
+#define PQ_RING_VERDICTS(ring) \
+    ((PacketQueueVerdict *)&(ring)->frames[(ring)->size])
+
+/** ring of a frame with fan-out key 'key': the DevAddr of a data frame or
+ *  DevEUI ^ (DevEUI >> 32) of a join request, 0 for anything else */
+#define PQ_RING_FANOUT(key, cnt) \
+    ((uint16_t)(((uint64_t)(uint32_t)((key) * 0x9e3779b1U) * (cnt)) >> 32))
+
+/** per packet radio metadata, copied from the PacketQueueFrame */
 typedef struct PacketQueuePacketVars_
 {
+    uint32_t id;
+    pid_t pid;
+    uint64_t gweui;
+    uint32_t tmst;
+    uint32_t freq;
+    int16_t rssi;
+    int16_t lsnr;
+    uint8_t chan;
+    uint8_t rfch;
 } PacketQueuePacketVars;
 
 //Structure to hold thread specific variables
 typedef struct PacketQueueThreadVars_
 {
-	
+    /* shared memory ring */
+    PacketQueueRing *ring;
+    uint32_t mask;
+    uint32_t idle;          /**< consecutive empty polls */
+
+    /* receive side */
+    uint16_t receiver;      /**< index of our ring */
+
+    /* verdict side */
+    PacketQueueVerdict *verdicts;
+    PacketQueueVerdict vbatch[PQ_VERDICT_BATCH];
+    uint32_t vpending;      /**< verdicts in vbatch, not yet published */
+    uint8_t vdead;          /**< killed, and the forwarder didn't take any
+                                 verdicts for PQ_VERDICT_DRAIN_USEC */
 
 	/* counters */
     uint32_t pkts;
     uint64_t bytes;
     uint32_t errs;
+    uint32_t misrouted;     /**< frames the forwarder put on the wrong ring */
     uint32_t accepted;
     uint32_t dropped;
+    uint32_t batches;       /**< verdict batches published */
+    uint32_t wakeups;       /**< futex wakes of the forwarder */
+    uint32_t vlost;         /**< verdicts we gave up on at exit */
 
 } PacketQueueThreadVars;
 
+/** mapping of one ring, shared by its receive and verdict thread */
+typedef struct PacketQueueRingMap_
+{
+    int fd;
+    PacketQueueRing *ring;
+    size_t map_size;
+    uint32_t refcnt;
+} PacketQueueRingMap;
+
+typedef struct PacketQueueGlobalVars_
+{
+    SCMutex lock;
+    uint16_t receivers;     /**< receive threads, one ring each */
+    uint16_t receiver_cnt;  /**< receive threads that attached so far */
+
+    PacketQueueRingMap maps[PQ_RECEIVERS_MAX];
+} PacketQueueGlobalVars;
+
+void PacketQueueSetReceivers(uint16_t);
+
 void TmModuleReceivePacketQueueRegister (void);
 void TmModuleVerdictPacketQueueRegister (void);
 void TmModuleDecodePacketQueueRegister (void);
 
-#endif
\ No newline at end of file
+#endif
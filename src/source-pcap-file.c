@@ -0,0 +1,524 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Offline replay of LoRaWAN captures, to benchmark the engine and to
+ * reproduce production traffic without a forwarder or a kernel queue.
+ *
+ * Two kinds of files are read:
+ *  - pcap files with the LoRaTap linktype, or DLT_USER0 for frames that
+ *    are just the PHYPayload. We parse the file ourselves, so we don't
+ *    depend on libpcap.
+ *  - PHY logs: text files with a hex encoded PHYPayload per line, with an
+ *    optional "sec.usec " timestamp in front. Lines without a timestamp
+ *    get the one of the line before, or the file's mtime. Empty lines and
+ *    lines starting with '#' are skipped.
+ *
+ * Packets are replayed as fast as we can or, with pcap-file.speed set,
+ * at the recorded rate times the speed. The engine runs on packet time
+ * (TimeModeSetOffline), so flow and session timeouts don't depend on how
+ * fast the file is read. At the end of the file the engine is stopped.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+#include "decode.h"
+#include "packet-queue.h"
+#include "threads.h"
+#include "threadvars.h"
+#include "tm-queuehandlers.h"
+#include "tm-modules.h"
+#include "tm-threads.h"
+#include "source-pcap-file.h"
+#include "tmqh-packetpool.h"
+#include "detect.h"
+#include "conf.h"
+
+#include "util-debug.h"
+#include "util-error.h"
+#include "util-time.h"
+#include "util-unittest.h"
+
+/** replay totals for PcapFilePrintSummary */
+static struct timeval pcap_file_start;
+static uint64_t pcap_file_pkts = 0;
+static uint64_t pcap_file_bytes = 0;
+
+TmEcode ReceivePcapFile(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
+TmEcode ReceivePcapFileThreadInit(ThreadVars *, void *, void **);
+void ReceivePcapFileThreadExitStats(ThreadVars *, void *);
+TmEcode ReceivePcapFileThreadDeinit(ThreadVars *, void *);
+
+TmEcode DecodePcapFile(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
+TmEcode DecodePcapFileThreadInit(ThreadVars *, void *, void **);
+
+void PcapFileRegisterTests(void);
+
+void TmModuleReceivePcapFileRegister (void) {
+    memset(&pcap_file_start, 0, sizeof(pcap_file_start));
+
+    tmm_modules[TMM_RECEIVEPCAPFILE].name = "ReceivePcapFile";
+    tmm_modules[TMM_RECEIVEPCAPFILE].ThreadInit = ReceivePcapFileThreadInit;
+    tmm_modules[TMM_RECEIVEPCAPFILE].Func = ReceivePcapFile;
+    tmm_modules[TMM_RECEIVEPCAPFILE].ThreadExitPrintStats = ReceivePcapFileThreadExitStats;
+    tmm_modules[TMM_RECEIVEPCAPFILE].ThreadDeinit = ReceivePcapFileThreadDeinit;
+    tmm_modules[TMM_RECEIVEPCAPFILE].RegisterTests = PcapFileRegisterTests;
+}
+
+void TmModuleDecodePcapFileRegister (void) {
+    tmm_modules[TMM_DECODEPCAPFILE].name = "DecodePcapFile";
+    tmm_modules[TMM_DECODEPCAPFILE].ThreadInit = DecodePcapFileThreadInit;
+    tmm_modules[TMM_DECODEPCAPFILE].Func = DecodePcapFile;
+    tmm_modules[TMM_DECODEPCAPFILE].ThreadExitPrintStats = NULL;
+    tmm_modules[TMM_DECODEPCAPFILE].ThreadDeinit = NULL;
+    tmm_modules[TMM_DECODEPCAPFILE].RegisterTests = NULL;
+}
+
+static inline uint32_t PcapFileSwap32(PcapFileThreadVars *ptv, uint32_t v) {
+    return ptv->swapped ? __builtin_bswap32(v) : v;
+}
+
+/**
+ * \brief Check the file's header and find out its format.
+ *
+ * \retval 0 ok, -1 not a file we can replay
+ */
+static int PcapFileOpen(PcapFileThreadVars *ptv) {
+    PcapFileHeader hdr;
+    struct stat st;
+
+    if (fread(&hdr, 1, sizeof(hdr), ptv->fp) == sizeof(hdr)) {
+        if (hdr.magic == PCAP_FILE_MAGIC || hdr.magic == PCAP_FILE_MAGIC_NSEC) {
+            ptv->swapped = 0;
+        } else if (__builtin_bswap32(hdr.magic) == PCAP_FILE_MAGIC ||
+                   __builtin_bswap32(hdr.magic) == PCAP_FILE_MAGIC_NSEC) {
+            ptv->swapped = 1;
+        } else {
+            goto phylog;
+        }
+
+        ptv->format = PCAP_FILE_FORMAT_PCAP;
+        ptv->nsec = (PcapFileSwap32(ptv, hdr.magic) == PCAP_FILE_MAGIC_NSEC);
+        ptv->linktype = PcapFileSwap32(ptv, hdr.linktype);
+        if (ptv->linktype != LINKTYPE_LORATAP &&
+            ptv->linktype != LINKTYPE_USER0) {
+            SCLogError(SC_ERR_PCAP_OPEN_OFFLINE, "%s: linktype %" PRIu32 " "
+                    "is not supported, use LoRaTap (%d) or the bare "
+                    "PHYPayload as DLT_USER0 (%d)", ptv->filename,
+                    ptv->linktype, LINKTYPE_LORATAP, LINKTYPE_USER0);
+            return -1;
+        }
+        return 0;
+    }
+
+phylog:
+    ptv->format = PCAP_FILE_FORMAT_PHYLOG;
+    rewind(ptv->fp);
+
+    memset(&ptv->last_ts, 0, sizeof(ptv->last_ts));
+    if (fstat(fileno(ptv->fp), &st) == 0)
+        ptv->last_ts.tv_sec = st.st_mtime;
+    return 0;
+}
+
+/**
+ * \brief get the next record from a pcap file
+ *
+ * \retval len length of the PHYPayload in ptv->buf at *off, 0 to skip the
+ *         record, -1 at the end of the file
+ */
+static int PcapFileReadPcap(PcapFileThreadVars *ptv, struct timeval *ts,
+        uint32_t *off) {
+    PcapFileRecordHeader rec;
+    uint32_t len, hlen;
+
+    if (fread(&rec, 1, sizeof(rec), ptv->fp) != sizeof(rec))
+        return -1;
+
+    len = PcapFileSwap32(ptv, rec.incl_len);
+    if (len > sizeof(ptv->buf)) {
+        SCLogError(SC_ERR_PCAP_DISPATCH, "%s: record of %" PRIu32 " bytes, "
+                "the file is corrupt", ptv->filename, len);
+        return -1;
+    }
+    if (fread(ptv->buf, 1, len, ptv->fp) != len)
+        return -1;
+
+    ts->tv_sec = PcapFileSwap32(ptv, rec.ts_sec);
+    ts->tv_usec = PcapFileSwap32(ptv, rec.ts_usec);
+    if (ptv->nsec)
+        ts->tv_usec /= 1000;
+
+    *off = 0;
+    if (ptv->linktype == LINKTYPE_LORATAP) {
+        /* version, padding, header length in network order */
+        if (len < 4)
+            return 0;
+        hlen = (ptv->buf[2] << 8) | ptv->buf[3];
+        if (hlen > len)
+            return 0;
+        *off = hlen;
+    }
+    return (int)(len - *off);
+}
+
+static inline int PcapFileHexNibble(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * \brief parse a PHY log line into buf
+ *
+ * \retval len length of the PHYPayload, 0 for lines without one, -1 if
+ *         the line is invalid
+ */
+static int PcapFileParsePhyLine(char *line, uint8_t *buf, uint32_t size,
+        struct timeval *ts) {
+    char *hex = line, *end = NULL;
+    uint32_t len = 0;
+    int hi, lo;
+
+    while (*hex == ' ' || *hex == '\t')
+        hex++;
+    if (*hex == '\0' || *hex == '\n' || *hex == '\r' || *hex == '#')
+        return 0;
+
+    /* optional timestamp */
+    end = strpbrk(hex, " \t");
+    if (end != NULL) {
+        char *dot = NULL;
+        ts->tv_sec = strtoul(hex, &dot, 10);
+        ts->tv_usec = 0;
+        if (dot != NULL && *dot == '.') {
+            char *frac = dot + 1;
+            long mul = 100000;
+            for ( ; *frac >= '0' && *frac <= '9'; frac++) {
+                ts->tv_usec += (*frac - '0') * mul;
+                mul /= 10;
+            }
+            dot = frac;
+        }
+        if (dot != end)
+            return -1;
+
+        hex = end;
+        while (*hex == ' ' || *hex == '\t')
+            hex++;
+    }
+
+    while ((hi = PcapFileHexNibble(hex[0])) >= 0) {
+        lo = PcapFileHexNibble(hex[1]);
+        if (lo < 0 || len == size)
+            return -1;
+        buf[len++] = (uint8_t)((hi << 4) | lo);
+        hex += 2;
+    }
+    if (*hex != '\0' && *hex != '\n' && *hex != '\r')
+        return -1;
+
+    return (int)len;
+}
+
+/**
+ * \brief get the next PHYPayload from a PHY log
+ *
+ * \retval len its length, 0 to skip the line, -1 at the end of the file
+ */
+static int PcapFileReadPhyLog(PcapFileThreadVars *ptv, struct timeval *ts) {
+    char line[1024];
+    int len;
+
+    if (fgets(line, sizeof(line), ptv->fp) == NULL)
+        return -1;
+    ptv->line++;
+
+    *ts = ptv->last_ts;
+    len = PcapFileParsePhyLine(line, ptv->buf, sizeof(ptv->buf), ts);
+    if (len < 0) {
+        SCLogWarning(SC_ERR_PCAP_DISPATCH, "%s:%" PRIu32 ": not a PHYPayload, "
+                "skipping the line", ptv->filename, ptv->line);
+        ptv->errs++;
+        return 0;
+    }
+    ptv->last_ts = *ts;
+    return len;
+}
+
+/**
+ * \brief sleep until it's time for a packet, if we replay at the
+ *        recorded rate
+ */
+static void PcapFilePace(PcapFileThreadVars *ptv, struct timeval *ts) {
+    struct timeval now;
+    int64_t pkt_usec, wall_usec;
+
+    if (ptv->pkts == 0) {
+        ptv->first_ts = *ts;
+        gettimeofday(&ptv->first_wall, NULL);
+        return;
+    }
+    if (ptv->speed <= 0)
+        return;
+
+    pkt_usec = ((int64_t)ts->tv_sec - ptv->first_ts.tv_sec) * 1000000 +
+        ((int64_t)ts->tv_usec - ptv->first_ts.tv_usec);
+    pkt_usec = (int64_t)(pkt_usec / ptv->speed);
+
+    gettimeofday(&now, NULL);
+    wall_usec = ((int64_t)now.tv_sec - ptv->first_wall.tv_sec) * 1000000 +
+        ((int64_t)now.tv_usec - ptv->first_wall.tv_usec);
+
+    if (pkt_usec > wall_usec)
+        usleep((useconds_t)(pkt_usec - wall_usec));
+}
+
+/**
+ * \brief Replay the next burst of packets. At the end of the file the
+ *        engine is told to stop once all packets are processed.
+ */
+TmEcode ReceivePcapFile(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, PacketQueue *postpq) {
+    PcapFileThreadVars *ptv = (PcapFileThreadVars *)data;
+    struct timeval ts;
+    uint32_t off = 0;
+    int len, cnt = 0;
+    /* at the recorded rate packets are passed on one by one, so they
+     * don't wait in our output for the rest of the burst */
+    int burst = ptv->speed > 0 ? 1 : PCAP_FILE_BURST;
+
+    if (ptv->eof) {
+        usleep(10000);
+        return TM_ECODE_OK;
+    }
+
+    /* wait only while we hold no packets: the ones we output this call
+     * are passed on after we return */
+    while (PacketPoolSize() == 0) {
+        PacketPoolWait();
+        if (TmThreadsCheckFlag(tv, THV_KILL))
+            return TM_ECODE_OK;
+    }
+
+    while (cnt < burst && PacketPoolSize() > 0) {
+        if (ptv->format == PCAP_FILE_FORMAT_PCAP) {
+            len = PcapFileReadPcap(ptv, &ts, &off);
+        } else {
+            off = 0;
+            len = PcapFileReadPhyLog(ptv, &ts);
+        }
+
+        if (len < 0) {
+            SCLogInfo("%s: end of file reached", ptv->filename);
+            ptv->eof = 1;
+            EngineStop();
+            break;
+        }
+        if (len == 0)
+            continue;
+
+        PcapFilePace(ptv, &ts);
+
+        p = PacketGetFromQueueOrAlloc();
+        if (p == NULL) {
+            ptv->errs++;
+            break;
+        }
+        p->ts = ts;
+        if (PacketCopyData(p, ptv->buf + off, (uint32_t)len) == -1) {
+            TmqhOutputPacketpool(tv, p);
+            ptv->errs++;
+            continue;
+        }
+
+        /* the engine runs on packet time */
+        TimeSet(&p->ts);
+
+        ptv->pkts++;
+        ptv->bytes += len;
+        cnt++;
+
+        tv->tmqh_out(tv, p);
+    }
+
+    return TM_ECODE_OK;
+}
+
+TmEcode ReceivePcapFileThreadInit(ThreadVars *tv, void *initdata, void **data) {
+    PcapFileThreadVars *ptv = NULL;
+    char *speed = NULL;
+
+    if (initdata == NULL) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "no file to replay specified");
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+
+    ptv = SCMalloc(sizeof(PcapFileThreadVars));
+    if (ptv == NULL)
+        SCReturnInt(TM_ECODE_FAILED);
+    memset(ptv, 0, sizeof(PcapFileThreadVars));
+
+    ptv->filename = (char *)initdata;
+    ptv->fp = fopen(ptv->filename, "r");
+    if (ptv->fp == NULL) {
+        SCLogError(SC_ERR_FOPEN, "can't open %s: %s", ptv->filename,
+                strerror(errno));
+        SCFree(ptv);
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+
+    if (PcapFileOpen(ptv) != 0) {
+        fclose(ptv->fp);
+        SCFree(ptv);
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+
+    if (ConfGet("pcap-file.speed", &speed) == 1 && speed != NULL) {
+        ptv->speed = strtod(speed, NULL);
+        if (ptv->speed < 0)
+            ptv->speed = 0;
+    }
+
+    SCLogInfo("replaying %s (%s), %s", ptv->filename,
+            ptv->format == PCAP_FILE_FORMAT_PCAP ? "pcap" : "PHY log",
+            ptv->speed > 0 ? "at the recorded rate" : "as fast as possible");
+
+    gettimeofday(&pcap_file_start, NULL);
+
+    *data = (void *)ptv;
+    SCReturnInt(TM_ECODE_OK);
+}
+
+void ReceivePcapFileThreadExitStats(ThreadVars *tv, void *data) {
+    PcapFileThreadVars *ptv = (PcapFileThreadVars *)data;
+
+    SCLogInfo("(%s) Pkts %" PRIu32 ", Bytes %" PRIu64 ", Errors %" PRIu32 "",
+            tv->name, ptv->pkts, ptv->bytes, ptv->errs);
+
+    pcap_file_pkts += ptv->pkts;
+    pcap_file_bytes += ptv->bytes;
+}
+
+TmEcode ReceivePcapFileThreadDeinit(ThreadVars *tv, void *data) {
+    PcapFileThreadVars *ptv = (PcapFileThreadVars *)data;
+
+    if (ptv->fp != NULL)
+        fclose(ptv->fp);
+    SCFree(ptv);
+    SCReturnInt(TM_ECODE_OK);
+}
+
+/**
+ * \brief Log the throughput of the replay, the alerts and the time every
+ *        stage spent per packet. Call after the threads have exited.
+ *
+ * \param end time the last packet was processed
+ */
+void PcapFilePrintSummary(struct timeval *end) {
+    double secs = (end->tv_sec - pcap_file_start.tv_sec) +
+        (end->tv_usec - pcap_file_start.tv_usec) / 1000000.0;
+
+    if (secs <= 0)
+        secs = 0.000001;
+
+    SCLogInfo("replayed %" PRIu64 " packets, %" PRIu64 " bytes in %.3f s: "
+            "%.0f pkts/s, %.3f Mbit/s, %" PRIu64 " alerts", pcap_file_pkts,
+            pcap_file_bytes, secs, pcap_file_pkts / secs,
+            (pcap_file_bytes * 8) / secs / 1000000.0, DetectGetAlertCnt());
+
+    TmModulePrintTiming();
+}
+
+/**
+ * \brief Decode a packet read from the file, a LoRaWAN PHYPayload
+ */
+TmEcode DecodePcapFile(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, PacketQueue *postpq)
+{
+    DecodeThreadVars *dtv = (DecodeThreadVars *)data;
+
+    SCPerfCounterIncr(dtv->counter_pkts, tv->sc_perf_pca);
+    SCPerfCounterAddUI64(dtv->counter_bytes, tv->sc_perf_pca, p->pktlen);
+    SCPerfCounterAddUI64(dtv->counter_avg_pkt_size, tv->sc_perf_pca, p->pktlen);
+    SCPerfCounterSetUI64(dtv->counter_max_pkt_size, tv->sc_perf_pca, p->pktlen);
+
+    DecodeLorawanMAC(tv, dtv, p, GET_PKT_DATA(p), GET_PKT_LEN(p), pq);
+
+    return TM_ECODE_OK;
+}
+
+TmEcode DecodePcapFileThreadInit(ThreadVars *tv, void *initdata, void **data)
+{
+    DecodeThreadVars *dtv = NULL;
+    dtv = DecodeThreadVarsAlloc();
+
+    if (dtv == NULL)
+        SCReturnInt(TM_ECODE_FAILED);
+
+    DecodeRegisterPerfCounters(dtv, tv);
+
+    *data = (void *)dtv;
+
+    SCReturnInt(TM_ECODE_OK);
+}
+
+#ifdef UNITTESTS
+/** \test PHY log lines, with and without a timestamp */
+static int PcapFileTest01(void) {
+    uint8_t buf[8];
+    struct timeval ts;
+    char l1[] = "1500000000.25 40aabbccdd\n";
+    char l2[] = "  0102\n";
+    char l3[] = "# comment\n";
+    char l4[] = "01z2\n";
+    char l5[] = "010203040506070809\n";
+
+    memset(&ts, 0, sizeof(ts));
+    if (PcapFileParsePhyLine(l1, buf, sizeof(buf), &ts) != 5)
+        return 0;
+    if (ts.tv_sec != 1500000000 || ts.tv_usec != 250000 || buf[0] != 0x40 ||
+        buf[4] != 0xdd)
+        return 0;
+
+    /* keeps the time we pass in */
+    if (PcapFileParsePhyLine(l2, buf, sizeof(buf), &ts) != 2)
+        return 0;
+    if (ts.tv_sec != 1500000000 || buf[0] != 0x01 || buf[1] != 0x02)
+        return 0;
+
+    if (PcapFileParsePhyLine(l3, buf, sizeof(buf), &ts) != 0)
+        return 0;
+    if (PcapFileParsePhyLine(l4, buf, sizeof(buf), &ts) != -1)
+        return 0;
+    /* doesn't fit */
+    if (PcapFileParsePhyLine(l5, buf, sizeof(buf), &ts) != -1)
+        return 0;
+
+    return 1;
+}
+#endif /* UNITTESTS */
+
+void PcapFileRegisterTests(void) {
+#ifdef UNITTESTS
+    UtRegisterTest("PcapFileTest01", PcapFileTest01, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,90 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ */
+
+#ifndef __SOURCE_PCAP_FILE_H__
+#define __SOURCE_PCAP_FILE_H__
+
+/* pcap file format, so we don't depend on libpcap */
+#define PCAP_FILE_MAGIC                 0xa1b2c3d4
+#define PCAP_FILE_MAGIC_NSEC            0xa1b23c4d
+
+/** linktypes we replay: LoRaTap, and the PHYPayload without a header */
+#define LINKTYPE_LORATAP                270
+#define LINKTYPE_USER0                  147
+
+/** biggest record we read, a PHYPayload is much smaller */
+#define PCAP_FILE_MAX_PKT_LEN           65535
+/** packets read per ReceivePcapFile call before checking for a kill */
+#define PCAP_FILE_BURST                 32
+
+enum {
+    PCAP_FILE_FORMAT_PCAP = 0,
+    PCAP_FILE_FORMAT_PHYLOG,            /**< a hex PHYPayload per line */
+};
+
+typedef struct PcapFileHeader_ {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} PcapFileHeader;
+
+typedef struct PcapFileRecordHeader_ {
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} PcapFileRecordHeader;
+
+typedef struct PcapFileThreadVars_
+{
+    FILE *fp;
+    char *filename;
+    uint8_t format;
+    uint8_t swapped;                    /**< file is in the other byte order */
+    uint8_t nsec;                       /**< timestamps in nsec, not usec */
+    uint8_t eof;
+    uint32_t linktype;
+    uint32_t line;                      /**< current line of a PHY log */
+
+    /** replay speed against the recorded time, 0 for as fast as we can */
+    double speed;
+    struct timeval first_ts;            /**< time of the first packet */
+    struct timeval first_wall;          /**< and when we read it */
+    struct timeval last_ts;
+
+    /* counters */
+    uint32_t pkts;
+    uint64_t bytes;
+    uint32_t errs;
+
+    uint8_t buf[PCAP_FILE_MAX_PKT_LEN];
+} PcapFileThreadVars;
+
+void TmModuleReceivePcapFileRegister (void);
+void TmModuleDecodePcapFileRegister (void);
+
+void PcapFilePrintSummary(struct timeval *);
+
+#endif /* __SOURCE_PCAP_FILE_H__ */
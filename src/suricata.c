@@ -42,6 +42,7 @@
 #include "util-pool.h"
 #include "util-byte.h"
 #include "util-cpu.h"
+#include "util-affinity.h"
 #include "util-action.h"
 #include "util-pidfile.h"
 
@@ -78,6 +79,7 @@
 
 #include "source-nfq.h"
 #include "source-nfq-prototypes.h"
+#include "source-pcap-file.h"
 
 #include "respond-reject.h"
 
@@ -85,6 +87,7 @@
 #include "flow-var.h"
 #include "flow-bit.h"
 #include "flow-alert-sid.h"
+#include "lorawan-session.h"
 #include "pkt-var.h"
 
 #include "app-layer-detect-proto.h"
@@ -133,9 +136,10 @@
 volatile sig_atomic_t sigint_count = 0;
 volatile sig_atomic_t sighup_count = 0;
 volatile sig_atomic_t sigterm_count = 0;
+volatile sig_atomic_t sigusr2_count = 0;
 
 /* Max packets processed simultaniously. */
-#define DEFAULT_MAX_PENDING_PACKETS 50
+#define DEFAULT_MAX_PENDING_PACKETS 500
 
 /** suricata engine control flags */
 uint8_t suricata_ctl_flags = 0;
@@ -158,6 +162,12 @@ static void SignalHandlerSigterm(/*@unused@*/ int sig) {
     sigterm_count = 1;
     suricata_ctl_flags |= SURICATA_KILL;
 }
+static void SignalHandlerSigusr2(/*@unused@*/ int sig) {
+    sigusr2_count = 1;
+}
+static void SignalHandlerSighup(/*@unused@*/ int sig) {
+    sighup_count = 1;
+}
 
 static void SignalHandlerSetup(int sig, void (*handler)())
 {
@@ -245,7 +255,10 @@ void usage(const char *progname)
     printf("%s %s\n", PROG_NAME, PROG_VER);
     printf("USAGE: %s\n\n", progname);
     printf("\t-c <path>                    : path to configuration file\n");
-    printf("\t-q <qid>                     : run in inline nfqueue mode\n");
+    printf("\t-q <qid>[:<qid>]             : run in inline nfqueue mode, on a range of queues\n");
+    printf("\t-r <path>                    : replay a LoRaWAN capture (pcap or PHY log) offline\n");
+    printf("\t--lora-ring <path>           : run in inline mode on the LoRa forwarder's shared memory ring\n");
+    printf("\t--runmode <auto|workers>     : threading model, overrides threading.runmode\n");
      printf("\n");
     printf("\nTo run the engine with default configuration on "
             "interface eth0 with signature file \"signatures.rules\", run the "
@@ -261,6 +274,8 @@ int main(int argc, char **argv) {
     char *pfring_dev = NULL;
     char *sig_file = NULL;
     char *nfq_id = NULL;
+    char *pq_ring = NULL;
+    char *runmode_custom = NULL;
     char *conf_filename = NULL;
     char *pid_filename = NULL;
 
@@ -304,6 +319,8 @@ int main(int argc, char **argv) {
             {"group",               required_argument, 0,               0},
             {"erf-in",              required_argument, 0,               0},
             {"dag",                 required_argument, 0,               0},
+            {"lora-ring",           required_argument, 0,               0},
+            {"runmode",             required_argument, 0,               0},
             {NULL,                  0, NULL,                            0}
     };
 
@@ -314,6 +331,22 @@ int main(int argc, char **argv) {
 
     while ((opt = getopt_long(argc, argv, short_opts, long_opts, &option_index)) != -1) {
         switch (opt) {
+            case 0:
+                if (strcmp((long_opts[option_index]).name, "lora-ring") == 0) {
+                    if (run_mode == MODE_UNKNOWN) {
+                        run_mode = MODE_PACKETQUEUE;
+                    } else {
+                        SCLogError(SC_ERR_MULTIPLE_RUN_MODE, "more than one run mode "
+                                                             "has been specified");
+                        usage(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    pq_ring = optarg;
+                }
+                else if (strcmp((long_opts[option_index]).name, "runmode") == 0) {
+                    runmode_custom = optarg;
+                }
+                break;
             case 'c':
                 conf_filename = optarg;
                 break;
@@ -328,6 +361,17 @@ int main(int argc, char **argv) {
                 }
                 nfq_id = optarg;
                 break;
+            case 'r':
+                if (run_mode == MODE_UNKNOWN) {
+                    run_mode = MODE_PCAP_FILE;
+                } else {
+                    SCLogError(SC_ERR_MULTIPLE_RUN_MODE, "more than one run mode "
+                                                         "has been specified");
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                pcap_file = optarg;
+                break;
             default:
                 usage(argv[0]);
                 exit(EXIT_FAILURE);
@@ -336,6 +380,7 @@ int main(int argc, char **argv) {
     SetBpfString(optind, argv);
 
     UtilCpuPrintSummary();
+    UtilCpuPrintSimd();
 
 
     if (!CheckValidDaemonModes(daemon, run_mode)) {
@@ -357,6 +402,14 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
+    /* the command line wins over the config file */
+    if (runmode_custom != NULL) {
+        if (ConfSet("threading.runmode", runmode_custom, 1) != 1) {
+            fprintf(stderr, "ERROR: Failed to set runmode.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
     if (dump_config) {
         ConfDump();
         exit(EXIT_SUCCESS);
@@ -404,6 +457,7 @@ int main(int argc, char **argv) {
 
     /* hardcoded initialization code */
     MpmTableSetup(); /* load the pattern matchers */
+    SimdSearchInit(); /* pick the single pattern search for this cpu */
     SigTableSetup(); /* load the rule keywords */
     TmqhSetup();
 
@@ -422,6 +476,8 @@ int main(int argc, char **argv) {
     TmModuleReceivePacketQueueRegister();
     TmModuleVerdictPacketQueueRegister();
     TmModuleDecodePacketQueueRegister();
+    TmModuleReceivePcapFileRegister();
+    TmModuleDecodePcapFileRegister();
     TmModuleDetectRegister();
     TmModuleAlertFastLogRegister();
     TmModuleAlertDebugLogRegister();
@@ -470,9 +526,11 @@ int main(int argc, char **argv) {
     /* registering signals we use */
     SignalHandlerSetup(SIGINT, SignalHandlerSigint);
     SignalHandlerSetup(SIGTERM, SignalHandlerSigterm);
+    /* reload the reputation snapshot */
+    SignalHandlerSetup(SIGUSR2, SignalHandlerSigusr2);
 
-    /* SIGHUP is not implemnetd on WIN32 */
-    //SignalHandlerSetup(SIGHUP, SignalHandlerSighup);
+    /* reload the rules. SIGHUP is not implemnetd on WIN32 */
+    SignalHandlerSetup(SIGHUP, SignalHandlerSighup);
     /* Get the suricata user ID to given user ID */
     if (do_setuid == TRUE) {
         if (SCGetUserID(user_name, group_name, &userid, &groupid) != 0) {
@@ -490,21 +548,17 @@ int main(int argc, char **argv) {
 
         sc_set_caps = TRUE;
     }
+
+    /* the cpu sets decide where the packets and flows are placed */
+    AffinitySetupLoadFromConfig();
+
     /* pre allocate packets */
     SCLogDebug("preallocating packets... packet size %"
                        PRIuMAX
                        "", (uintmax_t) sizeof(Packet));
-    int i = 0;
-    for (i = 0; i < max_pending_packets; i++) {
-        /* XXX pkt alloc function */
-        Packet *p = SCMalloc(sizeof(Packet));
-        if (p == NULL) {
-            SCLogError(SC_ERR_FATAL, "Fatal error encountered while allocating a packet. Exiting...");
-            exit(EXIT_FAILURE);
-        }
-        PACKET_INITIALIZE(p);
-
-        PacketPoolStorePacket(p);
+    if (PacketPoolInit((uint32_t)max_pending_packets) != 0) {
+        SCLogError(SC_ERR_FATAL, "Fatal error encountered while allocating a packet. Exiting...");
+        exit(EXIT_FAILURE);
     }
     SCLogInfo("preallocated %"
                       PRIiMAX
@@ -514,6 +568,8 @@ int main(int argc, char **argv) {
               max_pending_packets, (uintmax_t) (max_pending_packets * sizeof(Packet)));
 
     FlowInitConfig(FLOW_VERBOSE);
+    LorawanSessionInitConfig(FALSE);
+    SCReputationInitConfig();
 
     DetectEngineCtx *de_ctx = DetectEngineCtxInit();
 
@@ -533,6 +589,7 @@ int main(int argc, char **argv) {
 
     AppLayerHtpRegisterExtraCallbacks();
     SCThresholdConfInitContext(de_ctx, NULL);
+    DetectEngineSetCurrent(de_ctx);
 
     struct timeval start_time;
     memset(&start_time, 0, sizeof(start_time));
@@ -542,7 +599,22 @@ int main(int argc, char **argv) {
 
     /* run the selected runmode */
     if (run_mode == MODE_NFQ) {
+        if (RunModeIsWorkers()) {
+            SCLogWarning(SC_ERR_INVALID_ARGUMENT, "the workers runmode "
+                    "needs --lora-ring, using auto");
+        }
         RunModeIpsNFQAuto(de_ctx, nfq_id);
+    } else if (run_mode == MODE_PACKETQUEUE) {
+        if (RunModeIsWorkers())
+            RunModeIpsPacketQueueWorkers(de_ctx, pq_ring);
+        else
+            RunModeIpsPacketQueueAuto(de_ctx, pq_ring);
+    } else if (run_mode == MODE_PCAP_FILE) {
+        if (RunModeIsWorkers()) {
+            SCLogWarning(SC_ERR_INVALID_ARGUMENT, "the workers runmode "
+                    "needs --lora-ring, using auto");
+        }
+        RunModeFilePcapAuto(de_ctx, pcap_file);
     } else {
         SCLogError(SC_ERR_UNKNOWN_RUN_MODE, "Unknown runtime mode. Aborting");
         exit(EXIT_FAILURE);
@@ -550,6 +622,7 @@ int main(int argc, char **argv) {
 
     /* Spawn the flow manager thread */
     FlowManagerThreadSpawn();
+    LorawanSessionManagerThreadSpawn();
 
     StreamTcpInitConfig(STREAM_VERBOSE);
     DefragInit();
@@ -589,7 +662,7 @@ int main(int argc, char **argv) {
 
                     /* if all packets are returned to the packetpool
                      * we are done */
-                    if (PacketPoolSize() == max_pending_packets)
+                    if (PacketPoolIdle() == max_pending_packets)
                         done = 1;
 
                     if (done == 0) {
@@ -607,18 +680,33 @@ int main(int argc, char **argv) {
             SCLogInfo("time elapsed %" PRIuMAX "s", (uintmax_t)(end_time.tv_sec - start_time.tv_sec));
 
             TmThreadKillThreads();
+            PacketPoolPrintStats();
+            if (run_mode == MODE_PCAP_FILE)
+                PcapFilePrintSummary(&end_time);
             SCPerfReleaseResources();
             break;
         }
 
         TmThreadCheckThreadState();
 
+        if (sigusr2_count) {
+            sigusr2_count = 0;
+            SCReputationReloadSnapshot();
+        }
+        SCReputationPublishTick();
+
+        if (sighup_count) {
+            sighup_count = 0;
+            DetectEngineReloadStart(sig_file);
+        }
+
         usleep(100);
     }
 
 
     FlowShutdown();
     FlowPrintQueueInfo();
+    LorawanSessionShutdown();
     StreamTcpFreeConfig(STREAM_VERBOSE);
     HTPFreeConfig();
     HTPAtExitPrintStats();
@@ -626,6 +714,10 @@ int main(int argc, char **argv) {
 
     SCPidfileRemove(pid_filename);
 
+    /* a reload may have replaced the ctx we started with */
+    DetectEngineReloadWait();
+    de_ctx = DetectEngineGetCurrent();
+
     /** \todo review whats needed here */
     SigGroupCleanup(de_ctx);
 
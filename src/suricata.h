@@ -49,6 +49,7 @@ enum {
     MODE_UNITTEST,
     MODE_ERF_FILE,
     MODE_DAG,
+    MODE_PACKETQUEUE,
 };
 
 /* queue's between various other threads
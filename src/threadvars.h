@@ -71,8 +71,10 @@ typedef struct ThreadVars_ {
 
     /** queue handlers */
     struct Packet_ * (*tmqh_in)(struct ThreadVars_ *);
+    uint16_t (*tmqh_in_batch)(struct ThreadVars_ *, struct Packet_ **, uint16_t);
     void (*InShutdownHandler)(struct ThreadVars_ *);
     void (*tmqh_out)(struct ThreadVars_ *, struct Packet_ *);
+    void (*tmqh_out_flush)(struct ThreadVars_ *);
 
     /** slot functions */
     void *(*tm_func)(void *);
@@ -80,6 +82,7 @@ typedef struct ThreadVars_ {
 
     uint8_t thread_setup_flags;
     uint16_t cpu_affinity; /** cpu or core number to set affinity to */
+    uint8_t cpu_set_type; /** cpu set of the thread, see util-affinity.h */
     int thread_priority; /** priority (real time) for this thread. Look at threads.h */
 
     /* the perf counter context and the perf counter array */
@@ -98,6 +101,7 @@ typedef struct ThreadVars_ {
 /** Thread setup flags: */
 #define THREAD_SET_AFFINITY     0x01 /** CPU/Core affinity */
 #define THREAD_SET_PRIORITY     0x02 /** Real time priority */
+#define THREAD_SET_AFFTYPE      0x04 /** Priority and affinity from a cpu set */
 
 #endif /* __THREADVARS_H__ */
 
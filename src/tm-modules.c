@@ -29,6 +29,10 @@
 #include "util-debug.h"
 #include "threads.h"
 
+/** when set the thread slots count the ticks spent in their module, see
+ *  TmModulePrintTiming() */
+int tm_module_timing = 0;
+
 void TmModuleDebugList(void) {
     TmModule *t;
     uint16_t i;
@@ -63,6 +67,33 @@ TmModule *TmModuleGetByName(char *name) {
     return NULL;
 }
 
+/** \brief add the time a thread spent in a module to the module's total
+ *  \param tm the module
+ *  \param ticks cpu ticks spent in Func or FuncBatch
+ *  \param pkts packets handled in that time */
+void TmModuleTimingAdd(TmModule *tm, uint64_t ticks, uint64_t pkts) {
+    __sync_fetch_and_add(&tm->ticks, ticks);
+    __sync_fetch_and_add(&tm->pkts, pkts);
+}
+
+/** \brief log the time per packet of every module that handled packets,
+ *         once the threads have exited */
+void TmModulePrintTiming(void) {
+    TmModule *t;
+    uint16_t i;
+
+    for (i = 0; i < TMM_SIZE; i++) {
+        t = &tmm_modules[i];
+
+        if (t->name == NULL || t->pkts == 0)
+            continue;
+
+        SCLogInfo("%-20s pkts %" PRIu64 ", ticks %" PRIu64 ", avg ticks "
+                "per packet %" PRIu64 "", t->name, t->pkts, t->ticks,
+                t->ticks / t->pkts);
+    }
+}
+
 /** \brief LogFileNewCtx() Get a new LogFileCtx
  *  \retval LogFileCtx * pointer if succesful, NULL if error
  *  */
@@ -42,11 +42,18 @@ typedef struct TmModule_ {
 
     /** the packet processing function */
     TmEcode (*Func)(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
+    /** optional: process a vector of packets from a batch queue handler */
+    TmEcode (*FuncBatch)(ThreadVars *, Packet **, uint16_t, void *, PacketQueue *, PacketQueue *);
 
     void (*RegisterTests)(void);
 
     uint8_t cap_flags;   /**< Flags to indicate the capability requierment of
                              the given TmModule */
+
+    /** time all threads spent in Func/FuncBatch, counted when
+     *  tm_module_timing is set, and the packets they handled */
+    uint64_t ticks;
+    uint64_t pkts;
 } TmModule;
 
 enum {
@@ -89,6 +96,8 @@ enum {
 
 TmModule tmm_modules[TMM_SIZE];
 
+extern int tm_module_timing;
+
 /** Global structure for Output Context */
 typedef struct LogFileCtx_ {
     FILE *fp;
@@ -137,6 +146,8 @@ TmModule *TmModuleGetByName(char *name);
 TmEcode TmModuleRegister(char *name, int (*module_func)(ThreadVars *, Packet *, void *));
 void TmModuleDebugList(void);
 void TmModuleRegisterTests(void);
+void TmModuleTimingAdd(TmModule *, uint64_t, uint64_t);
+void TmModulePrintTiming(void);
 
 #endif /* __TM_MODULES_H__ */
 
@@ -35,6 +35,8 @@
 #include "tmqh-packetpool.h"
 #include "tmqh-flow.h"
 #include "tmqh-ringbuffer.h"
+#include "tmqh-batch.h"
+#include "tmqh-mpmc.h"
 
 void TmqhSetup (void) {
     memset(&tmqh_table, 0, sizeof(tmqh_table));
@@ -44,6 +46,8 @@ void TmqhSetup (void) {
     TmqhPacketpoolRegister();
     TmqhFlowRegister();
     TmqhRingBufferRegister();
+    TmqhBatchRegister();
+    TmqhMpmcRegister();
 }
 
 Tmqh* TmqhGetQueueHandlerByName(char *name) {
@@ -32,6 +32,8 @@ enum {
     TMQH_RINGBUFFER_MRSW,
     TMQH_RINGBUFFER_SRSW,
     TMQH_RINGBUFFER_SRMW,
+    TMQH_BATCH,
+    TMQH_MPMC,
 
     TMQH_SIZE,
 };
@@ -39,8 +41,12 @@ enum {
 typedef struct Tmqh_ {
     char *name;
     Packet *(*InHandler)(ThreadVars *);
+    /** optional: get up to n packets at once */
+    uint16_t (*InBatchHandler)(ThreadVars *, Packet **, uint16_t);
     void (*InShutdownHandler)(ThreadVars *);
     void (*OutHandler)(ThreadVars *, Packet *);
+    /** optional: hand over the packets OutHandler held back */
+    void (*OutFlushHandler)(ThreadVars *);
     void *(*OutHandlerCtxSetup)(char *);
     void (*OutHandlerCtxFree)(void *);
     void (*RegisterTests)(void);
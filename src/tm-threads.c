@@ -33,11 +33,14 @@
 #include "tm-modules.h"
 #include "tm-threads.h"
 #include "tmqh-packetpool.h"
+#include "tmqh-batch.h"
 #include "threads.h"
+#include "util-affinity.h"
 #include "util-debug.h"
 #include <pthread.h>
 #include <unistd.h>
 #include "util-privs.h"
+#include "util-cpu.h"
 
 #ifdef OS_FREEBSD
 #include <sched.h>
@@ -58,6 +61,25 @@
 /* prototypes */
 static int SetCPUAffinity(uint16_t cpu);
 
+/** \brief start timing a call into a slot's module */
+static inline uint64_t TmSlotTimingStart(void) {
+    return tm_module_timing ? UtilCpuGetTicks() : 0;
+}
+
+/** \brief add the time since TmSlotTimingStart to the slot */
+static inline void TmSlotTimingEnd(TmSlot *s, uint64_t start, uint16_t pkts) {
+    if (tm_module_timing) {
+        s->ticks += UtilCpuGetTicks() - start;
+        s->pkts += pkts;
+    }
+}
+
+/** \brief at thread exit, add the slot's time to its module's total */
+static void TmSlotTimingDone(TmSlot *s) {
+    if (s->tm != NULL && s->pkts > 0)
+        TmModuleTimingAdd(s->tm, s->ticks, s->pkts);
+}
+
 /* root of the threadvars list */
 ThreadVars *tv_root[TVT_MAX] = { NULL };
 
@@ -174,6 +196,9 @@ void *TmThreadsSlot1NoIn(void *td) {
             }
         }
 
+        if (tv->tmqh_out_flush != NULL)
+            tv->tmqh_out_flush(tv);
+
         if (TmThreadsCheckFlag(tv, THV_KILL)) {
             SCPerfUpdateCounterArray(tv->sc_perf_pca, &tv->sc_perf_pctx, 0);
             run = 0;
@@ -304,6 +329,10 @@ void *TmThreadsSlot1NoInOut(void *td) {
             break;
         }
 
+        /* the module may have output packets itself */
+        if (tv->tmqh_out_flush != NULL)
+            tv->tmqh_out_flush(tv);
+
         if (TmThreadsCheckFlag(tv, THV_KILL)) {
             //printf("%s: TmThreadsSlot1NoInOut: KILL is set\n", tv->name);
             SCPerfUpdateCounterArray(tv->sc_perf_pca, &tv->sc_perf_pctx, 0);
@@ -328,10 +357,20 @@ void *TmThreadsSlot1NoInOut(void *td) {
     pthread_exit((void *) 0);
 }
 
+/**
+ *  \brief Slot function of a thread with one module between two queues.
+ *
+ *  If the input queue handler can, packets come in as a vector of up to
+ *  TMQH_BATCH_SIZE, which goes through the module in one call if it has
+ *  a FuncBatch, or one packet at a time if not. The output is flushed
+ *  once the whole vector is done.
+ */
 void *TmThreadsSlot1(void *td) {
     ThreadVars *tv = (ThreadVars *)td;
     Tm1Slot *s = (Tm1Slot *)tv->tm_slots;
     Packet *p = NULL;
+    Packet *pkts[TMQH_BATCH_SIZE];
+    uint16_t cnt = 0, i = 0;
     char run = 1;
     TmEcode r = TM_ECODE_OK;
 
@@ -362,19 +401,64 @@ void *TmThreadsSlot1(void *td) {
     while(run) {
         TmThreadTestThreadUnPaused(tv);
 
-        /* input a packet */
-        p = tv->tmqh_in(tv);
-
-        if (p == NULL) {
-            //printf("%s: TmThreadsSlot1: p == NULL\n", tv->name);
+        /* input a packet, or a vector of them */
+        if (tv->tmqh_in_batch != NULL) {
+            cnt = tv->tmqh_in_batch(tv, pkts, TMQH_BATCH_SIZE);
         } else {
+            pkts[0] = tv->tmqh_in(tv);
+            cnt = (pkts[0] != NULL);
+        }
+
+        if (cnt > 0 && s->s.SlotFuncBatch != NULL) {
+            uint64_t start = TmSlotTimingStart();
+            r = s->s.SlotFuncBatch(tv, pkts, cnt, s->s.slot_data, &s->s.slot_pre_pq, &s->s.slot_post_pq);
+            TmSlotTimingEnd(&s->s, start, cnt);
+            /* handle error */
+            if (r == TM_ECODE_FAILED) {
+                TmqhReleasePacketsToPacketPool(&s->s.slot_pre_pq);
+                TmqhReleasePacketsToPacketPool(&s->s.slot_post_pq);
+                for (i = 0; i < cnt; i++)
+                    TmqhOutputPacketpool(tv, pkts[i]);
+                TmThreadsSetFlag(tv, THV_FAILED);
+                break;
+            }
+
+            while (s->s.slot_pre_pq.top != NULL) {
+                /* handle new packets from this func */
+                Packet *extra_p = PacketDequeue(&s->s.slot_pre_pq);
+                if (extra_p != NULL) {
+                    tv->tmqh_out(tv, extra_p);
+                }
+            }
+
+            /* output the packets */
+            for (i = 0; i < cnt; i++)
+                tv->tmqh_out(tv, pkts[i]);
+
+            while (s->s.slot_post_pq.top != NULL) {
+                /* handle new packets from this func */
+                Packet *extra_p = PacketDequeue(&s->s.slot_post_pq);
+                if (extra_p != NULL) {
+                    tv->tmqh_out(tv, extra_p);
+                }
+            }
+            cnt = 0;
+        }
+
+        for (i = 0; i < cnt; i++) {
+            p = pkts[i];
+
+            uint64_t start = TmSlotTimingStart();
             r = s->s.SlotFunc(tv, p, s->s.slot_data, &s->s.slot_pre_pq, &s->s.slot_post_pq);
+            TmSlotTimingEnd(&s->s, start, 1);
             /* handle error */
             if (r == TM_ECODE_FAILED) {
                 TmqhReleasePacketsToPacketPool(&s->s.slot_pre_pq);
                 TmqhReleasePacketsToPacketPool(&s->s.slot_post_pq);
-                TmqhOutputPacketpool(tv, p);
+                for ( ; i < cnt; i++)
+                    TmqhOutputPacketpool(tv, pkts[i]);
                 TmThreadsSetFlag(tv, THV_FAILED);
+                run = 0;
                 break;
             }
 
@@ -398,6 +482,12 @@ void *TmThreadsSlot1(void *td) {
             }
         }
 
+        /* the vector is done, pass it on */
+        if (tv->tmqh_out_flush != NULL)
+            tv->tmqh_out_flush(tv);
+        if (run == 0)
+            break;
+
         if (TmThreadsCheckFlag(tv, THV_KILL)) {
             //printf("%s: TmThreadsSlot1: KILL is set\n", tv->name);
             SCPerfUpdateCounterArray(tv->sc_perf_pca, &tv->sc_perf_pctx, 0);
@@ -405,6 +495,7 @@ void *TmThreadsSlot1(void *td) {
         }
     }
 
+    TmSlotTimingDone(&s->s);
     if (s->s.SlotThreadExitPrintStats != NULL) {
         s->s.SlotThreadExitPrintStats(tv, s->s.slot_data);
     }
@@ -431,11 +522,13 @@ static inline TmEcode TmThreadsSlotVarRun (ThreadVars *tv, Packet *p, TmSlot *sl
     TmSlot *s = NULL;
 
     for (s = slot; s != NULL; s = s->slot_next) {
+        uint64_t start = TmSlotTimingStart();
         if (s->id == 0) {
             r = s->SlotFunc(tv, p, s->slot_data, &s->slot_pre_pq, &s->slot_post_pq);
         } else {
             r = s->SlotFunc(tv, p, s->slot_data, &s->slot_pre_pq, NULL);
         }
+        TmSlotTimingEnd(s, start, 1);
         /* handle error */
         if (r == TM_ECODE_FAILED) {
             /* Encountered error.  Return packets to packetpool and return */
@@ -481,6 +574,8 @@ void *TmThreadsSlotVar(void *td) {
     ThreadVars *tv = (ThreadVars *)td;
     TmVarSlot *s = (TmVarSlot *)tv->tm_slots;
     Packet *p = NULL;
+    Packet *pkts[TMQH_BATCH_SIZE];
+    uint16_t cnt = 0, i = 0;
     char run = 1;
     TmEcode r = TM_ECODE_OK;
     TmSlot *slot = NULL;
@@ -521,15 +616,24 @@ void *TmThreadsSlotVar(void *td) {
     while(run) {
         TmThreadTestThreadUnPaused(tv);
 
-        /* input a packet */
-        p = tv->tmqh_in(tv);
+        /* input a packet, or a vector of them */
+        if (tv->tmqh_in_batch != NULL) {
+            cnt = tv->tmqh_in_batch(tv, pkts, TMQH_BATCH_SIZE);
+        } else {
+            pkts[0] = tv->tmqh_in(tv);
+            cnt = (pkts[0] != NULL);
+        }
+
+        for (i = 0; i < cnt; i++) {
+            p = pkts[i];
 
-        if (p != NULL) {
             /* run the thread module(s) */
             r = TmThreadsSlotVarRun(tv, p, s->s);
             if (r == TM_ECODE_FAILED) {
-                TmqhOutputPacketpool(tv, p);
+                for ( ; i < cnt; i++)
+                    TmqhOutputPacketpool(tv, pkts[i]);
                 TmThreadsSetFlag(tv, THV_FAILED);
+                run = 0;
                 break;
             }
 
@@ -556,6 +660,12 @@ void *TmThreadsSlotVar(void *td) {
             }
         }
 
+        /* the vector is done, pass it on */
+        if (tv->tmqh_out_flush != NULL)
+            tv->tmqh_out_flush(tv);
+        if (run == 0)
+            break;
+
         if (TmThreadsCheckFlag(tv, THV_KILL)) {
             run = 0;
         }
@@ -563,6 +673,119 @@ void *TmThreadsSlotVar(void *td) {
     SCPerfUpdateCounterArray(tv->sc_perf_pca, &tv->sc_perf_pctx, 0);
 
     for (slot = s->s; slot != NULL; slot = slot->slot_next) {
+        TmSlotTimingDone(slot);
+        if (slot->SlotThreadExitPrintStats != NULL) {
+            slot->SlotThreadExitPrintStats(tv, slot->slot_data);
+        }
+
+        if (slot->SlotThreadDeinit != NULL) {
+            r = slot->SlotThreadDeinit(tv, slot->slot_data);
+            if (r != TM_ECODE_OK) {
+                TmThreadsSetFlag(tv, THV_CLOSED);
+                pthread_exit((void *) -1);
+            }
+        }
+    }
+
+    SCLogDebug("%s ending", tv->name);
+    TmThreadsSetFlag(tv, THV_CLOSED);
+    pthread_exit((void *) 0);
+}
+
+/**
+ *  \brief Slot function of a worker: a thread that takes packets all the
+ *         way from receive to output.
+ *
+ *  The first slot is a receive module. It is called without a packet and
+ *  puts the packets it receives in its pre_pq. Each of those is run
+ *  through the other slots before the next one, and then handed to the
+ *  output queue handler (normally the packetpool). So there is no queue
+ *  between the slots and no other thread touches the packet.
+ */
+void *TmThreadsSlotVarNoIn(void *td) {
+    ThreadVars *tv = (ThreadVars *)td;
+    TmVarSlot *s = (TmVarSlot *)tv->tm_slots;
+    Packet *p = NULL;
+    char run = 1;
+    TmEcode r = TM_ECODE_OK;
+    TmSlot *slot = NULL;
+
+    /* Set the thread name */
+    SCSetThreadName(tv->name);
+
+    /* Drop the capabilities for this thread */
+    SCDropCaps(tv);
+
+    if (tv->thread_setup_flags != 0)
+        TmThreadSetupOptions(tv);
+
+    /* check if we are setup properly */
+    if (s == NULL || s->s == NULL || tv->tmqh_out == NULL) {
+        EngineKill();
+
+        TmThreadsSetFlag(tv, THV_CLOSED);
+        pthread_exit((void *) -1);
+    }
+
+    for (slot = s->s; slot != NULL; slot = slot->slot_next) {
+        if (slot->SlotThreadInit != NULL) {
+            r = slot->SlotThreadInit(tv, slot->slot_initdata, &slot->slot_data);
+            if (r != TM_ECODE_OK) {
+                EngineKill();
+
+                TmThreadsSetFlag(tv, THV_CLOSED);
+                pthread_exit((void *) -1);
+            }
+        }
+        memset(&slot->slot_pre_pq, 0, sizeof(PacketQueue));
+        memset(&slot->slot_post_pq, 0, sizeof(PacketQueue));
+    }
+
+    TmThreadsSetFlag(tv, THV_INIT_DONE);
+
+    while(run) {
+        TmThreadTestThreadUnPaused(tv);
+
+        /* receive a burst of packets */
+        r = s->s->SlotFunc(tv, NULL, s->s->slot_data, &s->s->slot_pre_pq, NULL);
+        if (r == TM_ECODE_FAILED) {
+            TmqhReleasePacketsToPacketPool(&s->s->slot_pre_pq);
+            TmThreadsSetFlag(tv, THV_FAILED);
+            break;
+        }
+
+        /* and run them to completion, one by one */
+        while (s->s->slot_pre_pq.top != NULL) {
+            p = PacketDequeue(&s->s->slot_pre_pq);
+            if (p == NULL)
+                continue;
+
+            if (s->s->slot_next != NULL) {
+                r = TmThreadsSlotVarRun(tv, p, s->s->slot_next);
+                if (r == TM_ECODE_FAILED) {
+                    TmqhReleasePacketsToPacketPool(&s->s->slot_pre_pq);
+                    TmqhOutputPacketpool(tv, p);
+                    TmThreadsSetFlag(tv, THV_FAILED);
+                    run = 0;
+                    break;
+                }
+            }
+
+            /* output the packet */
+            tv->tmqh_out(tv, p);
+        }
+
+        if (tv->tmqh_out_flush != NULL)
+            tv->tmqh_out_flush(tv);
+
+        if (TmThreadsCheckFlag(tv, THV_KILL)) {
+            run = 0;
+        }
+    }
+    SCPerfUpdateCounterArray(tv->sc_perf_pca, &tv->sc_perf_pctx, 0);
+
+    for (slot = s->s; slot != NULL; slot = slot->slot_next) {
+        TmSlotTimingDone(slot);
         if (slot->SlotThreadExitPrintStats != NULL) {
             slot->SlotThreadExitPrintStats(tv, slot->slot_data);
         }
@@ -609,6 +832,9 @@ TmEcode TmThreadSetSlots(ThreadVars *tv, char *name, void *(*fn_p)(void *)) {
     } else if (strcmp(name, "varslot") == 0) {
         size = sizeof(TmVarSlot);
         tv->tm_func = TmThreadsSlotVar;
+    } else if (strcmp(name, "varslot_noin") == 0) {
+        size = sizeof(TmVarSlot);
+        tv->tm_func = TmThreadsSlotVarNoIn;
     } else if (strcmp(name, "custom") == 0) {
         /* \todo this needs to be changed to support slots of any size */
         size = sizeof(Tm1Slot);
@@ -641,8 +867,10 @@ void Tm1SlotSetFunc(ThreadVars *tv, TmModule *tm, void *data) {
     s1->s.SlotThreadInit = tm->ThreadInit;
     s1->s.slot_initdata = data;
     s1->s.SlotFunc = tm->Func;
+    s1->s.SlotFuncBatch = tm->FuncBatch;
     s1->s.SlotThreadExitPrintStats = tm->ThreadExitPrintStats;
     s1->s.SlotThreadDeinit = tm->ThreadDeinit;
+    s1->s.tm = tm;
     tv->cap_flags |= tm->cap_flags;
 }
 
@@ -657,8 +885,10 @@ void TmVarSlotSetFuncAppend(ThreadVars *tv, TmModule *tm, void *data) {
     slot->SlotThreadInit = tm->ThreadInit;
     slot->slot_initdata = data;
     slot->SlotFunc = tm->Func;
+    slot->SlotFuncBatch = tm->FuncBatch;
     slot->SlotThreadExitPrintStats = tm->ThreadExitPrintStats;
     slot->SlotThreadDeinit = tm->ThreadDeinit;
+    slot->tm = tm;
     tv->cap_flags |= tm->cap_flags;
 
     if (s->s == NULL) {
@@ -764,13 +994,38 @@ TmEcode TmThreadSetCPUAffinity(ThreadVars *tv, uint16_t cpu) {
     return TM_ECODE_OK;
 }
 
+/**
+ * \brief Set the thread options from the cpu set of a thread group. In
+ *        exclusive mode the thread gets the next cpu of the set here.
+ * \param tv pointer to the ThreadVars to setup the affinity
+ * \param type cpu set, *_CPU_SET
+ * \retval TM_ECODE_OK, TM_ECODE_FAILED if the group has no set
+ */
+TmEcode TmThreadSetCPU(ThreadVars *tv, uint8_t type) {
+    ThreadsAffinityType *taf = AffinityGetSet(type);
+    if (taf == NULL)
+        return TM_ECODE_FAILED;
+
+    tv->thread_setup_flags |= THREAD_SET_AFFTYPE;
+    tv->cpu_set_type = type;
+    if (taf->mode == EXCLUSIVE_AFFINITY)
+        tv->cpu_affinity = AffinityGetNextCpu(taf);
+    if (taf->prio_set)
+        TmThreadSetThreadPriority(tv, taf->prio);
+    return TM_ECODE_OK;
+}
+
 /**
  * \brief Set the thread options (cpu affinitythread)
  *        Priority should be already set by pthread_create
  * \param tv pointer to the ThreadVars of the calling thread
  */
 TmEcode TmThreadSetupOptions(ThreadVars *tv) {
-    if (tv->thread_setup_flags & THREAD_SET_AFFINITY) {
+    if (tv->thread_setup_flags & THREAD_SET_AFFTYPE) {
+        if (AffinityApply(tv) < 0 &&
+            AffinityGetSet(tv->cpu_set_type)->mode == EXCLUSIVE_AFFINITY)
+            SetCPUAffinity(tv->cpu_affinity);
+    } else if (tv->thread_setup_flags & THREAD_SET_AFFINITY) {
         SCLogInfo("Setting affinity for \"%s\" Module to cpu/core %"PRIu16", thread id %lu", tv->name, tv->cpu_affinity, SCGetThreadIdLong());
         SetCPUAffinity(tv->cpu_affinity);
     }
@@ -841,6 +1096,7 @@ ThreadVars *TmThreadCreate(char *name, char *inq_name, char *inqh_name,
         if (tmqh == NULL) goto error;
 
         tv->tmqh_in = tmqh->InHandler;
+        tv->tmqh_in_batch = tmqh->InBatchHandler;
         tv->InShutdownHandler = tmqh->InShutdownHandler;
         SCLogDebug("tv->tmqh_in %p", tv->tmqh_in);
     }
@@ -853,6 +1109,7 @@ ThreadVars *TmThreadCreate(char *name, char *inq_name, char *inqh_name,
         if (tmqh == NULL) goto error;
 
         tv->tmqh_out = tmqh->OutHandler;
+        tv->tmqh_out_flush = tmqh->OutFlushHandler;
 
         if (outq_name != NULL && strcmp(outq_name,"packetpool") != 0) {
             SCLogDebug("outq_name \"%s\"", outq_name);
@@ -37,6 +37,8 @@ enum {
 typedef struct TmSlot_ {
     /* function pointers */
     TmEcode (*SlotFunc)(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
+    /** optional, only used by 1slot: a vector of packets in one call */
+    TmEcode (*SlotFuncBatch)(ThreadVars *, Packet **, uint16_t, void *, PacketQueue *, PacketQueue *);
 
     TmEcode (*SlotThreadInit)(ThreadVars *, void *, void **);
     void (*SlotThreadExitPrintStats)(ThreadVars *, void *);
@@ -61,6 +63,12 @@ typedef struct TmSlot_ {
 
     int id; /**< slot id, only used my TmVarSlot to know what the first
              *   slot is. */
+
+    /** the module, and the time this thread spent in it if
+     *  tm_module_timing is set */
+    TmModule *tm;
+    uint64_t ticks;
+    uint64_t pkts;
 } TmSlot;
 
 /* 1 function slot */
@@ -92,6 +100,7 @@ void TmThreadAppend(ThreadVars *, int);
 void TmThreadRemove(ThreadVars *, int);
 
 TmEcode TmThreadSetCPUAffinity(ThreadVars *, uint16_t);
+TmEcode TmThreadSetCPU(ThreadVars *, uint8_t);
 TmEcode TmThreadSetThreadPriority(ThreadVars *, int);
 TmEcode TmThreadSetupOptions(ThreadVars *);
 void TmThreadSetPrio(ThreadVars *);
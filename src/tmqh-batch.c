@@ -0,0 +1,262 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Batch queue handler: 'simple', but packets move between the threads
+ * in vectors of up to TMQH_BATCH_SIZE. A reader takes a vector per lock,
+ * a writer collects its packets in a per thread vector and hands it over
+ * with one lock and one wake up.
+ *
+ * The writer holds back packets until its vector is full or the thread
+ * flushes it. The slot functions in tm-threads.c flush after each batch
+ * they processed and whenever they would block, so no packet stays
+ * behind.
+ */
+
+#include "suricata.h"
+#include "packet-queue.h"
+#include "decode.h"
+#include "threads.h"
+#include "threadvars.h"
+
+#include "tm-queuehandlers.h"
+#include "tmqh-batch.h"
+
+#include "util-unittest.h"
+
+/** \brief Per thread ctx of the batch output handler
+ *  \param id queue we output to
+ *  \param cnt packets in the vector
+ *  \param pkts the packets not yet handed over */
+typedef struct TmqhBatchCtx_ {
+    uint16_t id;
+    uint16_t cnt;
+    Packet *pkts[TMQH_BATCH_SIZE];
+} TmqhBatchCtx;
+
+Packet *TmqhInputBatch(ThreadVars *tv);
+uint16_t TmqhInputBatchVector(ThreadVars *tv, Packet **pkts, uint16_t max);
+void TmqhInputBatchShutdownHandler(ThreadVars *);
+void TmqhOutputBatch(ThreadVars *tv, Packet *p);
+void TmqhOutputBatchFlush(ThreadVars *tv);
+void *TmqhOutputBatchSetupCtx(char *queue_str);
+void TmqhOutputBatchFreeCtx(void *);
+void TmqhBatchRegisterTests(void);
+
+void TmqhBatchRegister (void) {
+    tmqh_table[TMQH_BATCH].name = "batch";
+    tmqh_table[TMQH_BATCH].InHandler = TmqhInputBatch;
+    tmqh_table[TMQH_BATCH].InBatchHandler = TmqhInputBatchVector;
+    tmqh_table[TMQH_BATCH].InShutdownHandler = TmqhInputBatchShutdownHandler;
+    tmqh_table[TMQH_BATCH].OutHandler = TmqhOutputBatch;
+    tmqh_table[TMQH_BATCH].OutFlushHandler = TmqhOutputBatchFlush;
+    tmqh_table[TMQH_BATCH].OutHandlerCtxSetup = TmqhOutputBatchSetupCtx;
+    tmqh_table[TMQH_BATCH].OutHandlerCtxFree = TmqhOutputBatchFreeCtx;
+    tmqh_table[TMQH_BATCH].RegisterTests = TmqhBatchRegisterTests;
+}
+
+/** \brief get a vector of packets from the input queue
+ *
+ *  Waits if the queue is empty. Takes at most max packets and, if other
+ *  threads read the same queue, not more than our share of what is in it
+ *  so one reader doesn't take all the work while the others wait.
+ *
+ *  \param tv thread vars
+ *  \param pkts array of at least max packets to fill
+ *  \param max size of pkts
+ *
+ *  \retval cnt number of packets in pkts, 0 on signals
+ */
+uint16_t TmqhInputBatchVector(ThreadVars *tv, Packet **pkts, uint16_t max)
+{
+    PacketQueue *q = &trans_q[tv->inq->id];
+    uint32_t want;
+    uint16_t cnt = 0;
+
+    SCMutexLock(&q->mutex_q);
+    if (q->len == 0) {
+        /* if we have no packets in queue, wait... */
+        SCCondWait(&q->cond_q, &q->mutex_q);
+    }
+
+    if (tv->sc_perf_pctx.perf_flag == 1)
+        SCPerfUpdateCounterArray(tv->sc_perf_pca, &tv->sc_perf_pctx, 0);
+
+    want = q->len;
+    if (tv->inq->reader_cnt > 1)
+        want = (want + tv->inq->reader_cnt - 1) / tv->inq->reader_cnt;
+    if (want > max)
+        want = max;
+
+    while (cnt < want) {
+        Packet *p = PacketDequeue(q);
+        if (p == NULL)
+            break;
+        pkts[cnt++] = p;
+    }
+    SCMutexUnlock(&q->mutex_q);
+
+    return cnt;
+}
+
+/** \brief get a single packet, for slot functions that don't do vectors */
+Packet *TmqhInputBatch(ThreadVars *tv)
+{
+    Packet *p = NULL;
+
+    if (TmqhInputBatchVector(tv, &p, 1) == 0)
+        return NULL;
+    return p;
+}
+
+void TmqhInputBatchShutdownHandler(ThreadVars *tv) {
+    if (tv == NULL || tv->inq == NULL) {
+        return;
+    }
+
+    SCMutexLock(&trans_q[tv->inq->id].mutex_q);
+    SCCondBroadcast(&trans_q[tv->inq->id].cond_q);
+    SCMutexUnlock(&trans_q[tv->inq->id].mutex_q);
+}
+
+/** \brief setup the output ctx of a thread
+ *
+ *  \param queue_str name of the queue to output to
+ *  \retval ctx queue handler ctx or NULL in error
+ */
+void *TmqhOutputBatchSetupCtx(char *queue_str) {
+    if (queue_str == NULL || strlen(queue_str) == 0)
+        return NULL;
+
+    Tmq *tmq = TmqGetQueueByName(queue_str);
+    if (tmq == NULL) {
+        tmq = TmqCreateQueue(SCStrdup(queue_str));
+        if (tmq == NULL)
+            return NULL;
+    }
+
+    TmqhBatchCtx *ctx = SCMalloc(sizeof(TmqhBatchCtx));
+    if (ctx == NULL)
+        return NULL;
+    memset(ctx, 0x00, sizeof(TmqhBatchCtx));
+
+    ctx->id = tmq->id;
+    tmq->writer_cnt++;
+    return (void *)ctx;
+}
+
+void TmqhOutputBatchFreeCtx(void *ctx) {
+    if (ctx != NULL)
+        SCFree(ctx);
+}
+
+/** \brief hand the packets we hold to the output queue, with one lock
+ *         and one wake up
+ *
+ *  A single packet only needs one reader, a vector can keep all of them
+ *  busy.
+ */
+void TmqhOutputBatchFlush(ThreadVars *tv)
+{
+    TmqhBatchCtx *ctx = (TmqhBatchCtx *)tv->outctx;
+    uint16_t i;
+
+    if (ctx == NULL || ctx->cnt == 0)
+        return;
+
+    PacketQueue *q = &trans_q[ctx->id];
+    SCMutexLock(&q->mutex_q);
+    for (i = 0; i < ctx->cnt; i++) {
+        PacketEnqueue(q, ctx->pkts[i]);
+    }
+    if (ctx->cnt > 1)
+        SCCondBroadcast(&q->cond_q);
+    else
+        SCCondSignal(&q->cond_q);
+    SCMutexUnlock(&q->mutex_q);
+
+    ctx->cnt = 0;
+}
+
+void TmqhOutputBatch(ThreadVars *tv, Packet *p)
+{
+    TmqhBatchCtx *ctx = (TmqhBatchCtx *)tv->outctx;
+    if (ctx == NULL) {
+        abort();
+    }
+
+    ctx->pkts[ctx->cnt++] = p;
+    if (ctx->cnt == TMQH_BATCH_SIZE)
+        TmqhOutputBatchFlush(tv);
+}
+
+#ifdef UNITTESTS
+/** \test packets are held back until the flush and then read as one
+ *        vector */
+static int TmqhBatchTest01(void) {
+    int retval = 0;
+    ThreadVars tv_out, tv_in;
+    Packet pkts[3];
+    Packet *vec[TMQH_BATCH_SIZE];
+    Tmq *tmq = NULL;
+
+    TmqResetQueues();
+    memset(&tv_out, 0, sizeof(tv_out));
+    memset(&tv_in, 0, sizeof(tv_in));
+    memset(&pkts, 0, sizeof(pkts));
+
+    tv_out.outctx = TmqhOutputBatchSetupCtx("batch-queue");
+    if (tv_out.outctx == NULL)
+        goto end;
+    tmq = TmqGetQueueByName("batch-queue");
+    if (tmq == NULL || tmq->writer_cnt != 1)
+        goto end;
+    tv_in.inq = tmq;
+    tmq->reader_cnt++;
+
+    TmqhOutputBatch(&tv_out, &pkts[0]);
+    TmqhOutputBatch(&tv_out, &pkts[1]);
+    TmqhOutputBatch(&tv_out, &pkts[2]);
+    if (trans_q[tmq->id].len != 0)
+        goto end;
+
+    TmqhOutputBatchFlush(&tv_out);
+    if (trans_q[tmq->id].len != 3)
+        goto end;
+
+    if (TmqhInputBatchVector(&tv_in, vec, 2) != 2)
+        goto end;
+    if (vec[0] != &pkts[0] || vec[1] != &pkts[1])
+        goto end;
+    if (TmqhInputBatch(&tv_in) != &pkts[2])
+        goto end;
+
+    retval = 1;
+end:
+    TmqhOutputBatchFreeCtx(tv_out.outctx);
+    TmqResetQueues();
+    return retval;
+}
+#endif /* UNITTESTS */
+
+void TmqhBatchRegisterTests(void) {
+#ifdef UNITTESTS
+    UtRegisterTest("TmqhBatchTest01", TmqhBatchTest01, 1);
+#endif
+}
@@ -0,0 +1,131 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Lock free queue handler: packets pass through a bounded MPMC queue
+ * (util-mpmcqueue.c) per Tmq, with any number of readers and writers.
+ * Idle readers sleep on a futex instead of polling.
+ *
+ * The queues hold max-pending-packets packets, the number of packets the
+ * engine has in flight, so a writer never finds its queue full.
+ */
+
+#include "suricata.h"
+#include "packet-queue.h"
+#include "decode.h"
+#include "threads.h"
+#include "threadvars.h"
+
+#include "tm-queuehandlers.h"
+#include "tmqh-mpmc.h"
+
+#include "util-mpmcqueue.h"
+
+extern intmax_t max_pending_packets;
+
+static MpmcQueue *mpmc_queues[256];
+static uint32_t mpmc_queue_size = 0;
+
+Packet *TmqhInputMpmc(ThreadVars *t);
+uint16_t TmqhInputMpmcBatch(ThreadVars *t, Packet **, uint16_t);
+void TmqhOutputMpmc(ThreadVars *t, Packet *p);
+void TmqhInputMpmcShutdownHandler(ThreadVars *);
+
+void TmqhMpmcRegister (void) {
+    tmqh_table[TMQH_MPMC].name = "mpmc";
+    tmqh_table[TMQH_MPMC].InHandler = TmqhInputMpmc;
+    tmqh_table[TMQH_MPMC].InBatchHandler = TmqhInputMpmcBatch;
+    tmqh_table[TMQH_MPMC].InShutdownHandler = TmqhInputMpmcShutdownHandler;
+    tmqh_table[TMQH_MPMC].OutHandler = TmqhOutputMpmc;
+
+    memset(mpmc_queues, 0, sizeof(mpmc_queues));
+
+    mpmc_queue_size = max_pending_packets > 0 ?
+        (uint32_t)max_pending_packets : 65536;
+}
+
+/** \brief get the queue of a Tmq, creating it on first use. Readers and
+ *         writers of a Tmq can start in any order, the first one wins. */
+static MpmcQueue *TmqhMpmcGetQueue(uint16_t id) {
+    MpmcQueue *q = mpmc_queues[id];
+    if (q != NULL)
+        return q;
+
+    q = MpmcQueueInit(mpmc_queue_size);
+    if (q == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "can't allocate queue %" PRIu16 "", id);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!__sync_bool_compare_and_swap(&mpmc_queues[id], NULL, q)) {
+        MpmcQueueDestroy(q);
+        q = mpmc_queues[id];
+    }
+    return q;
+}
+
+void TmqhInputMpmcShutdownHandler(ThreadVars *tv) {
+    if (tv == NULL || tv->inq == NULL) {
+        return;
+    }
+
+    MpmcQueueShutdown(TmqhMpmcGetQueue(tv->inq->id));
+}
+
+Packet *TmqhInputMpmc(ThreadVars *t)
+{
+    MpmcQueue *q = TmqhMpmcGetQueue(t->inq->id);
+
+    if (t->sc_perf_pctx.perf_flag == 1)
+        SCPerfUpdateCounterArray(t->sc_perf_pca, &t->sc_perf_pctx, 0);
+
+    /* returns NULL only on shutdown */
+    return (Packet *)MpmcQueueGet(q);
+}
+
+/** \brief wait for a packet, then take what else is there up to max */
+uint16_t TmqhInputMpmcBatch(ThreadVars *t, Packet **pkts, uint16_t max)
+{
+    MpmcQueue *q = TmqhMpmcGetQueue(t->inq->id);
+    uint16_t cnt = 0;
+
+    if (max == 0)
+        return 0;
+
+    if (t->sc_perf_pctx.perf_flag == 1)
+        SCPerfUpdateCounterArray(t->sc_perf_pca, &t->sc_perf_pctx, 0);
+
+    pkts[0] = (Packet *)MpmcQueueGet(q);
+    if (pkts[0] == NULL)
+        return 0;
+
+    for (cnt = 1; cnt < max; cnt++) {
+        pkts[cnt] = (Packet *)MpmcQueueTryGet(q);
+        if (pkts[cnt] == NULL)
+            break;
+    }
+    return cnt;
+}
+
+void TmqhOutputMpmc(ThreadVars *t, Packet *p)
+{
+    SCLogDebug("Packet %p, p->root %p, alloced %s", p, p->root, p->flags & PKT_ALLOC ? "true":"false");
+
+    MpmcQueuePut(TmqhMpmcGetQueue(t->outq->id), (void *)p);
+}
@@ -20,12 +20,12 @@
  *
  * \author Victor Julien <victor@inliniac.net>
  *
- * Packetpool queue handlers. Packet pool is implemented as a ringbuffer.
- * We're using a multi reader / multi writer version of the ringbuffer,
- * that is relatively expensive due to the CAS function. But it is necessary
- * because every thread can return packets to the pool and multiple parts
- * of the code retrieve packets (Decode, Defrag) and these can run in their
- * own threads as well.
+ * Packetpool queue handlers. Packet pool is implemented as a lock free
+ * multi reader / multi writer queue (util-mpmcqueue.c). It has to be
+ * multi reader / multi writer because every thread can return packets to
+ * the pool and multiple parts of the code retrieve packets (Decode,
+ * Defrag) and these can run in their own threads as well. A thread that
+ * waits for a packet sleeps until one is returned.
  */
 
 #include "suricata.h"
@@ -43,28 +43,349 @@
 
 #include "tmqh-packetpool.h"
 
-#include "util-ringbuffer.h"
-
-static RingBuffer16 *ringbuffer = NULL;
+#include "util-mpmcqueue.h"
+#include "util-cpu.h"
+#include "util-affinity.h"
+
+#include <sys/mman.h>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+extern intmax_t max_pending_packets;
+
+/** \brief the global pool of one NUMA node: the packets allocated on the
+ *         node while they are not in use or in a thread's cache */
+typedef struct PacketPoolNode_ {
+    MpmcQueue *q;
+    Packet *base;               /**< packets preallocated on this node */
+    uint32_t cnt;
+} PacketPoolNode;
+
+static PacketPoolNode pool_nodes[PACKET_POOL_NODES_MAX];
+static uint16_t pool_node_cnt = 0;
+
+/** caches of all threads, for PacketPoolIdle() and the stats */
+static PacketPoolCache *pool_caches = NULL;
+static SCMutex pool_caches_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t pool_packets = 0;        /**< set by PacketPoolInit */
+static uint16_t pool_getters = 0;        /**< caches with room */
+/** room in a cache, lowered as threads start to get packets. Caches with
+ *  more room shrink on their next get or return */
+static volatile uint16_t pool_cache_size = 0;
+
+/** the cache of the calling thread */
+static __thread PacketPoolCache *pool_cache = NULL;
 
 void TmqhPacketpoolRegister (void) {
     tmqh_table[TMQH_PACKETPOOL].name = "packetpool";
     tmqh_table[TMQH_PACKETPOOL].InHandler = TmqhInputPacketpool;
     tmqh_table[TMQH_PACKETPOOL].OutHandler = TmqhOutputPacketpool;
 
-    ringbuffer = RingBufferInit();
+    /* node 0 also takes packets that weren't preallocated by
+     * PacketPoolInit, so it has room for all packets */
+    memset(pool_nodes, 0, sizeof(pool_nodes));
+    pool_nodes[0].q = MpmcQueueInit(max_pending_packets > 0 ?
+            (uint32_t)max_pending_packets : 65536);
+    if (pool_nodes[0].q == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "can't allocate the packet pool");
+        exit(EXIT_FAILURE);
+    }
+    pool_node_cnt = 1;
+}
+
+/**
+ *  \brief Preallocate the packets of the pool.
+ *
+ *  The packets are split over the NUMA nodes. The memory of each share is
+ *  bound to its node before we touch it, so the pages end up there, and
+ *  threads take their packets from the node they run on. If the cpu sets
+ *  of threading.cpu-affinity are all on one node, all packets are put
+ *  there instead.
+ *
+ *  \param cnt number of packets
+ *
+ *  \retval 0 ok, -1 error
+ */
+int PacketPoolInit(uint32_t cnt) {
+    uint16_t nodes = UtilCpuGetNumaNodes();
+    int pkt_node = AffinityGetPacketNode();
+    uint16_t node;
+    uint32_t i, share;
+    size_t size;
+
+    if (nodes > PACKET_POOL_NODES_MAX)
+        nodes = PACKET_POOL_NODES_MAX;
+    if (cnt < nodes || pkt_node >= 0)
+        nodes = 1;
+
+    for (node = 0; node < nodes; node++) {
+        PacketPoolNode *pn = &pool_nodes[node];
+
+        share = cnt / nodes;
+        if (node == 0)
+            share += cnt % nodes;
+
+        if (pn->q == NULL) {
+            pn->q = MpmcQueueInit(share);
+            if (pn->q == NULL)
+                return -1;
+        }
+
+        size = (size_t)share * sizeof(Packet);
+        pn->base = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (pn->base == MAP_FAILED) {
+            SCLogError(SC_ERR_MEM_ALLOC, "mmap of %" PRIuMAX " bytes of "
+                    "packets failed: %s", (uintmax_t)size, strerror(errno));
+            pn->base = NULL;
+            return -1;
+        }
+#ifdef __linux__
+        if (nodes > 1) {
+            unsigned long mask = 1UL << node;
+            if (syscall(SYS_mbind, pn->base, size, MPOL_PREFERRED, &mask,
+                        sizeof(mask) * 8, 0) != 0) {
+                SCLogWarning(SC_ERR_SYSCALL, "binding the packets of node %"
+                        PRIu16 " failed: %s", node, strerror(errno));
+            }
+        }
+#endif /* __linux__ */
+        if (pkt_node >= 0)
+            AffinityBindMemory(pn->base, size, 1UL << pkt_node);
+        pn->cnt = share;
+
+        for (i = 0; i < share; i++) {
+            Packet *p = &pn->base[i];
+            PACKET_INITIALIZE(p);
+            if (MpmcQueueTryPut(pn->q, (void *)p) != 0)
+                return -1;
+        }
+    }
+    pool_node_cnt = nodes;
+
+    /* the caches are sized by the threads that get packets, as they
+     * start doing so, see PacketPoolCacheSizeUpdate() */
+    pool_packets = cnt;
+    pool_getters = 0;
+    pool_cache_size = 0;
+
+    SCLogDebug("%" PRIu32 " packets on %" PRIu16 " nodes", cnt, nodes);
+    return 0;
+}
+
+/** \brief the node a packet was preallocated on, 0 if it wasn't */
+static inline PacketPoolNode *PacketPoolNodeOf(Packet *p) {
+    uint16_t node;
+
+    for (node = 1; node < pool_node_cnt; node++) {
+        if (p >= pool_nodes[node].base &&
+            p < pool_nodes[node].base + pool_nodes[node].cnt)
+            return &pool_nodes[node];
+    }
+    return &pool_nodes[0];
+}
+
+/**
+ *  \brief size the caches for one more thread that gets packets
+ *
+ *  All caches together keep at most a quarter of the packets, whatever
+ *  the number of threads (threading.workers can be up to 64, more than
+ *  we have cpus). Too few packets for that, no caches.
+ *
+ *  \warning call with pool_caches_lock held
+ */
+static void PacketPoolCacheSizeUpdate(void) {
+    uint32_t csize;
+
+    pool_getters++;
+    csize = pool_packets / (4 * (uint32_t)pool_getters);
+    if (csize > PACKET_POOL_CACHE_SIZE)
+        csize = PACKET_POOL_CACHE_SIZE;
+    pool_cache_size = csize >= 4 ? (uint16_t)csize : 0;
+}
+
+/**
+ *  \brief Get the cache of this thread, setting it up on first use.
+ *
+ *  A thread that only returns packets gets a cache without room, so its
+ *  packets go straight back to the pool where the threads that need them
+ *  can get them. Once a thread takes packets from the pool its cache
+ *  keeps some, so it can recycle its own packets without touching the
+ *  pool.
+ *
+ *  \param get the thread wants to get packets
+ */
+static PacketPoolCache *PacketPoolGetCache(int get) {
+    PacketPoolCache *c = pool_cache;
+
+    if (c == NULL) {
+        c = SCMalloc(sizeof(PacketPoolCache));
+        if (c == NULL)
+            return NULL;
+        memset(c, 0x00, sizeof(PacketPoolCache));
+
+        c->node = pool_node_cnt > 1 ? UtilCpuGetCurrentNumaNode() : 0;
+        if (c->node >= pool_node_cnt)
+            c->node = 0;
+
+        SCMutexLock(&pool_caches_lock);
+        c->next = pool_caches;
+        pool_caches = c;
+        SCMutexUnlock(&pool_caches_lock);
+
+        pool_cache = c;
+    }
+
+    if (get && c->getter == 0) {
+        SCMutexLock(&pool_caches_lock);
+        PacketPoolCacheSizeUpdate();
+        SCMutexUnlock(&pool_caches_lock);
+        c->getter = 1;
+        c->size = pool_cache_size;
+    }
+    return c;
+}
+
+/** \brief get up to half a cache of packets from the pool, from our own
+ *         node if it has any */
+static void PacketPoolCacheRefill(PacketPoolCache *c) {
+    uint16_t i, node;
+    uint32_t want = c->size > 1 ? c->size / 2 : 1;
+
+    for (i = 0; i < pool_node_cnt && c->cnt == 0; i++) {
+        node = (c->node + i) % pool_node_cnt;
+        c->cnt = MpmcQueueTryGetBulk(pool_nodes[node].q, (void **)c->pkts,
+                want);
+    }
+    if (c->cnt > 0)
+        c->refills++;
+}
+
+/** \brief return the n oldest packets of the cache to the pool, the
+ *         packets we returned last are the ones still in our cpu cache */
+static void PacketPoolCacheSpill(PacketPoolCache *c, uint32_t n) {
+    uint32_t done = 0;
+    Packet **pkts = c->pkts;
+
+    if (pool_node_cnt == 1) {
+        while (done < n) {
+            done += MpmcQueueTryPutBulk(pool_nodes[0].q,
+                    (void **)&pkts[done], n - done);
+        }
+    } else {
+        for ( ; done < n; done++) {
+            MpmcQueuePut(PacketPoolNodeOf(pkts[done])->q, (void *)pkts[done]);
+        }
+    }
+    c->cnt -= n;
+    memmove(c->pkts, &c->pkts[n], c->cnt * sizeof(Packet *));
+    c->spills++;
+}
+
+/** \brief more threads get packets than when our cache was sized: give
+ *         back what no longer fits */
+static void PacketPoolCacheShrink(PacketPoolCache *c) {
+    c->size = pool_cache_size;
+    if (c->cnt > c->size)
+        PacketPoolCacheSpill(c, c->cnt - c->size);
+}
+
+/**
+ *  \brief return all packets in the cache of this thread to the pool
+ *
+ *  For threads that are about to idle: packets in their cache can't be
+ *  used by the other threads until they get or return a packet again.
+ */
+void PacketPoolFlushCache(void) {
+    PacketPoolCache *c = pool_cache;
+
+    if (c != NULL && c->cnt > 0)
+        PacketPoolCacheSpill(c, c->cnt);
+}
+
+/** \brief put a recycled packet in our cache, or in the pool */
+static inline void PacketPoolReturnPacket(Packet *p) {
+    PacketPoolCache *c = PacketPoolGetCache(0);
+
+    if (c != NULL && c->size > pool_cache_size)
+        PacketPoolCacheShrink(c);
+    if (c == NULL || c->size == 0) {
+        MpmcQueuePut(PacketPoolNodeOf(p)->q, (void *)p);
+        return;
+    }
+
+    if (c->cnt == c->size)
+        PacketPoolCacheSpill(c, c->size / 2);
+    c->pkts[c->cnt++] = p;
 }
 
 int PacketPoolIsEmpty(void) {
-    return RingBufferIsEmpty(ringbuffer);
+    return (PacketPoolSize() == 0);
 }
 
-uint16_t PacketPoolSize(void) {
-    return RingBufferSize(ringbuffer);
+/** \brief number of packets this thread can get without waiting */
+uint32_t PacketPoolSize(void) {
+    uint32_t size = 0;
+    uint16_t node;
+
+    if (pool_cache != NULL)
+        size = pool_cache->cnt;
+    for (node = 0; node < pool_node_cnt; node++)
+        size += MpmcQueueLen(pool_nodes[node].q);
+    return size;
+}
+
+/** \brief number of packets not in use, in the pool or in any cache */
+uint32_t PacketPoolIdle(void) {
+    PacketPoolCache *c;
+    uint32_t size = 0;
+    uint16_t node;
+
+    for (node = 0; node < pool_node_cnt; node++)
+        size += MpmcQueueLen(pool_nodes[node].q);
+
+    SCMutexLock(&pool_caches_lock);
+    for (c = pool_caches; c != NULL; c = c->next)
+        size += c->cnt;
+    SCMutexUnlock(&pool_caches_lock);
+    return size;
 }
 
+/**
+ *  \brief wait until a packet is returned to the pool
+ *
+ *  Time spent here means max-pending-packets is too low for the load, so
+ *  we count it.
+ */
 void PacketPoolWait(void) {
-    RingBufferWait(ringbuffer);
+    PacketPoolCache *c = PacketPoolGetCache(1);
+    struct timeval start, end;
+    uint16_t node;
+
+    if (PacketPoolSize() > 0)
+        return;
+
+    gettimeofday(&start, NULL);
+    /* packets go back to the node they came from, which doesn't have to
+     * be ours. So wake up now and then to look around, and to see if
+     * we're shut down */
+    while (PacketPoolSize() == 0) {
+        node = c != NULL ? c->node : 0;
+        if (MpmcQueueWaitNotEmpty(pool_nodes[node].q,
+                    PACKET_POOL_WAIT_USEC) == 0)
+            break;
+        if (pool_nodes[node].q->shutdown)
+            break;
+    }
+    gettimeofday(&end, NULL);
+
+    if (c != NULL) {
+        c->starved++;
+        c->starved_usec += (uint64_t)(end.tv_sec - start.tv_sec) * 1000000 +
+            (end.tv_usec - start.tv_usec);
+    }
 }
 
 /** \brief a initialized packet
@@ -72,31 +393,42 @@ void PacketPoolWait(void) {
  *  \warning Use *only* at init, not at packet runtime
  */
 void PacketPoolStorePacket(Packet *p) {
-    if (RingBufferIsFull(ringbuffer)) {
+    if (MpmcQueueTryPut(PacketPoolNodeOf(p)->q, (void *)p) != 0) {
         exit(1);
     }
 
-    RingBufferMrMwPut(ringbuffer, (void *)p);
-    SCLogDebug("buffersize %u", RingBufferSize(ringbuffer));
+    SCLogDebug("buffersize %u", PacketPoolSize());
 }
 
 /** \brief get a packet from the packet pool, but if the
  *         pool is empty, don't wait, just return NULL
  */
 Packet *PacketPoolGetPacket(void) {
-    if (RingBufferIsEmpty(ringbuffer))
+    PacketPoolCache *c = PacketPoolGetCache(1);
+
+    if (c == NULL)
+        return MpmcQueueTryGet(pool_nodes[0].q);
+
+    if (c->size > pool_cache_size)
+        PacketPoolCacheShrink(c);
+    if (c->cnt == 0)
+        PacketPoolCacheRefill(c);
+    if (c->cnt == 0) {
+        /* the caller will have to alloc one */
+        c->empty++;
         return NULL;
-
-    Packet *p = RingBufferMrMwGetNoWait(ringbuffer);
-    return p;
+    }
+    return c->pkts[--c->cnt];
 }
 
 Packet *TmqhInputPacketpool(ThreadVars *t)
 {
     Packet *p = NULL;
 
-    while (p == NULL && ringbuffer->shutdown == FALSE) {
-        p = RingBufferMrMwGet(ringbuffer);
+    while ((p = PacketPoolGetPacket()) == NULL) {
+        if (pool_nodes[0].q->shutdown)
+            return NULL;
+        PacketPoolWait();
     }
 
     /* packet is clean */
@@ -104,6 +436,29 @@ Packet *TmqhInputPacketpool(ThreadVars *t)
     return p;
 }
 
+/** \brief log how often the threads ran out of packets, to size
+ *         max-pending-packets */
+void PacketPoolPrintStats(void) {
+    PacketPoolCache *c;
+    uint64_t starved = 0, starved_usec = 0, empty = 0, refills = 0, spills = 0;
+
+    SCMutexLock(&pool_caches_lock);
+    for (c = pool_caches; c != NULL; c = c->next) {
+        starved += c->starved;
+        starved_usec += c->starved_usec;
+        empty += c->empty;
+        refills += c->refills;
+        spills += c->spills;
+    }
+    SCMutexUnlock(&pool_caches_lock);
+
+    SCLogInfo("packet pool: %" PRIuMAX " packets on %" PRIu16 " node(s), "
+            "starved %" PRIu64 " times for %" PRIu64 " ms, empty %" PRIu64
+            " times, cache refills %" PRIu64 ", spills %" PRIu64 "",
+            (uintmax_t)max_pending_packets, pool_node_cnt, starved,
+            starved_usec / 1000, empty, refills, spills);
+}
+
 void TmqhOutputPacketpool(ThreadVars *t, Packet *p)
 {
     SCEnter();
@@ -183,7 +538,7 @@ void TmqhOutputPacketpool(ThreadVars *t, Packet *p)
             p->root = NULL;
         } else {
             PACKET_RECYCLE(p->root);
-            RingBufferMrMwPut(ringbuffer, (void *)p->root);
+            PacketPoolReturnPacket(p->root);
         }
     }
 
@@ -193,7 +548,7 @@ void TmqhOutputPacketpool(ThreadVars *t, Packet *p)
         SCFree(p);
     } else {
         PACKET_RECYCLE(p);
-        RingBufferMrMwPut(ringbuffer, (void *)p);
+        PacketPoolReturnPacket(p);
     }
 
     SCReturn;
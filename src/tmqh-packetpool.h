@@ -24,13 +24,42 @@
 #ifndef __TMQH_PACKETPOOL_H__
 #define __TMQH_PACKETPOOL_H__
 
+/** NUMA nodes we split the packets over */
+#define PACKET_POOL_NODES_MAX   8
+/** max packets in the cache of a thread */
+#define PACKET_POOL_CACHE_SIZE  64
+/** look at the other nodes this often if we have to wait for a packet */
+#define PACKET_POOL_WAIT_USEC   1000
+
+/** \brief A thread's cache of free packets in front of the pool. It is
+ *         refilled from and spilled to the pool half a cache at a time. */
+typedef struct PacketPoolCache_ {
+    Packet *pkts[PACKET_POOL_CACHE_SIZE];
+    uint32_t cnt;
+    uint32_t size;              /**< max cnt, 0 if the thread only returns packets */
+    uint8_t getter;             /**< the thread gets packets */
+    uint16_t node;              /**< NUMA node we get packets from first */
+
+    uint64_t starved;           /**< times we waited for a packet */
+    uint64_t starved_usec;      /**< and for how long */
+    uint64_t empty;             /**< gets that found the pool empty */
+    uint64_t refills;
+    uint64_t spills;
+
+    struct PacketPoolCache_ *next;
+} PacketPoolCache;
+
 Packet *TmqhInputPacketpool(ThreadVars *);
 void TmqhOutputPacketpool(ThreadVars *, Packet *);
 void TmqhReleasePacketsToPacketPool(PacketQueue *);
 void TmqhPacketpoolRegister (void);
 Packet *PacketPoolGetPacket(void);
-uint16_t PacketPoolSize(void);
+uint32_t PacketPoolSize(void);
+uint32_t PacketPoolIdle(void);
 void PacketPoolStorePacket(Packet *);
 void PacketPoolWait(void);
+void PacketPoolFlushCache(void);
+int PacketPoolInit(uint32_t);
+void PacketPoolPrintStats(void);
 
 #endif /* __TMQH_PACKETPOOL_H__ */
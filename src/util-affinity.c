@@ -0,0 +1,411 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Thread placement: a cpu set per thread group from threading.cpu-affinity,
+ * and the NUMA nodes those sets are on for placing the memory the threads
+ * share.
+ *
+ *   cpu-affinity:
+ *     - detect-cpu-set:
+ *         cpu: [ "all" ]         # cpus and ranges like "2-7", or "all"
+ *         numa-node: 1           # only the cpus of node 1, memory there too
+ *         mode: exclusive        # a cpu per thread, or balanced
+ *         isolate: no            # keep these cpus out of the other sets
+ *         prio: medium           # low, medium or high
+ *
+ * A group without a set is placed by the runmode like before.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+#include "conf.h"
+#include "threads.h"
+#include "threadvars.h"
+
+#include "util-affinity.h"
+#include "util-cpu.h"
+#include "util-debug.h"
+#include "util-error.h"
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+static ThreadsAffinityType thread_affinity[MAX_CPU_SET] = {
+    { .name = "receive-cpu-set" },
+    { .name = "decode-cpu-set" },
+    { .name = "detect-cpu-set" },
+    { .name = "verdict-cpu-set" },
+    { .name = "output-cpu-set" },
+    { .name = "worker-cpu-set" },
+};
+
+/** \brief add a cpu to a set, once */
+static void AffinityAddCpu(ThreadsAffinityType *taf, uint16_t cpu) {
+    uint16_t i;
+
+    for (i = 0; i < taf->cpu_cnt; i++) {
+        if (taf->cpus[i] == cpu)
+            return;
+    }
+    if (taf->cpu_cnt < AFFINITY_MAX_CPUS)
+        taf->cpus[taf->cpu_cnt++] = cpu;
+}
+
+/**
+ * \brief parse "all", a cpu or a range "first-last" into a set
+ *
+ * \retval 0 ok, -1 not a cpu we have
+ */
+static int AffinityParseCpus(ThreadsAffinityType *taf, const char *str, uint16_t ncpus) {
+    unsigned long first, last;
+    char *end = NULL;
+
+    if (strcasecmp(str, "all") == 0) {
+        first = 0;
+        last = ncpus - 1;
+    } else {
+        first = strtoul(str, &end, 10);
+        if (end == str)
+            return -1;
+        last = first;
+        if (*end == '-') {
+            char *range = end + 1;
+            last = strtoul(range, &end, 10);
+            if (end == range)
+                return -1;
+        }
+        if (*end != '\0' || first > last || last >= ncpus)
+            return -1;
+    }
+
+    for ( ; first <= last; first++) {
+        AffinityAddCpu(taf, (uint16_t)first);
+    }
+    return 0;
+}
+
+/** \brief remove the cpus of an isolated set from another set */
+static void AffinityIsolate(ThreadsAffinityType *iso, ThreadsAffinityType *taf) {
+    uint16_t cpus[AFFINITY_MAX_CPUS];
+    uint16_t i, j, cnt = 0;
+
+    for (i = 0; i < taf->cpu_cnt; i++) {
+        for (j = 0; j < iso->cpu_cnt; j++) {
+            if (taf->cpus[i] == iso->cpus[j])
+                break;
+        }
+        if (j == iso->cpu_cnt)
+            cpus[cnt++] = taf->cpus[i];
+    }
+
+    if (cnt == 0) {
+        SCLogWarning(SC_ERR_INVALID_ARGUMENT, "isolating %s leaves no cpus "
+                "for %s, they share them", iso->name, taf->name);
+        return;
+    }
+    memcpy(taf->cpus, cpus, cnt * sizeof(uint16_t));
+    taf->cpu_cnt = cnt;
+}
+
+static void AffinitySetupSet(ThreadsAffinityType *taf, ConfNode *node, uint16_t ncpus) {
+    ConfNode *cpu_node = ConfNodeLookupChild(node, "cpu");
+    const char *val;
+    uint16_t i, cnt;
+
+    taf->mode = EXCLUSIVE_AFFINITY;
+    taf->numa_node = -1;
+
+    if (cpu_node != NULL && !TAILQ_EMPTY(&cpu_node->head)) {
+        ConfNode *item;
+        TAILQ_FOREACH(item, &cpu_node->head, next) {
+            if (item->val == NULL || AffinityParseCpus(taf, item->val, ncpus) < 0) {
+                SCLogError(SC_ERR_INVALID_ARGUMENT, "invalid cpu \"%s\" in %s, "
+                        "we have %" PRIu16 " cpus", item->val ? item->val : "",
+                        taf->name, ncpus);
+                exit(EXIT_FAILURE);
+            }
+        }
+    } else if (cpu_node != NULL && cpu_node->val != NULL) {
+        if (AffinityParseCpus(taf, cpu_node->val, ncpus) < 0) {
+            SCLogError(SC_ERR_INVALID_ARGUMENT, "invalid cpu \"%s\" in %s, "
+                    "we have %" PRIu16 " cpus", cpu_node->val, taf->name, ncpus);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    val = ConfNodeLookupChildValue(node, "numa-node");
+    if (val != NULL) {
+        char *end = NULL;
+        unsigned long n = strtoul(val, &end, 10);
+        if (end == val || *end != '\0' || n >= UtilCpuGetNumaNodes()) {
+            SCLogError(SC_ERR_INVALID_ARGUMENT, "invalid numa-node \"%s\" in "
+                    "%s, we have %" PRIu16 " nodes", val, taf->name,
+                    UtilCpuGetNumaNodes());
+            exit(EXIT_FAILURE);
+        }
+        taf->numa_node = (int)n;
+
+        /* no cpus given means all of the node */
+        if (taf->cpu_cnt == 0)
+            AffinityParseCpus(taf, "all", ncpus);
+        for (i = 0, cnt = 0; i < taf->cpu_cnt; i++) {
+            if (UtilCpuGetNumaNode(taf->cpus[i]) == (uint16_t)n)
+                taf->cpus[cnt++] = taf->cpus[i];
+        }
+        taf->cpu_cnt = cnt;
+    }
+
+    if (taf->cpu_cnt == 0) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "%s has no cpus", taf->name);
+        exit(EXIT_FAILURE);
+    }
+
+    val = ConfNodeLookupChildValue(node, "mode");
+    if (val != NULL) {
+        if (strcasecmp(val, "exclusive") == 0) {
+            taf->mode = EXCLUSIVE_AFFINITY;
+        } else if (strcasecmp(val, "balanced") == 0) {
+            taf->mode = BALANCED_AFFINITY;
+        } else {
+            SCLogError(SC_ERR_INVALID_ARGUMENT, "unknown mode \"%s\" in %s, "
+                    "use exclusive or balanced", val, taf->name);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    val = ConfNodeLookupChildValue(node, "prio");
+    if (val != NULL) {
+        taf->prio_set = 1;
+        if (strcasecmp(val, "low") == 0) {
+            taf->prio = PRIO_LOW;
+        } else if (strcasecmp(val, "medium") == 0) {
+            taf->prio = PRIO_MEDIUM;
+        } else if (strcasecmp(val, "high") == 0) {
+            taf->prio = PRIO_HIGH;
+        } else {
+            SCLogError(SC_ERR_INVALID_ARGUMENT, "unknown prio \"%s\" in %s, "
+                    "use low, medium or high", val, taf->name);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    taf->isolate = ConfNodeChildValueIsTrue(node, "isolate") ? 1 : 0;
+    taf->configured = 1;
+}
+
+/**
+ * \brief Load the cpu sets from threading.cpu-affinity. Only used with
+ *        threading.set_cpu_affinity.
+ */
+void AffinitySetupLoadFromConfig(void) {
+    ConfNode *root, *node;
+    int set_cpu_affinity = 0;
+    uint16_t ncpus = UtilCpuGetNumProcessorsOnline();
+    uint8_t t, o;
+
+    if (ConfGetBool("threading.set_cpu_affinity", &set_cpu_affinity) != 1 ||
+        !set_cpu_affinity)
+        return;
+
+    root = ConfGetNode("threading.cpu-affinity");
+    if (root == NULL || ncpus == 0)
+        return;
+
+    TAILQ_FOREACH(node, &root->head, next) {
+        for (t = 0; t < MAX_CPU_SET; t++) {
+            if (node->val != NULL && strcmp(node->val, thread_affinity[t].name) == 0)
+                break;
+        }
+        if (t == MAX_CPU_SET) {
+            SCLogWarning(SC_ERR_INVALID_YAML_CONF_ENTRY, "unknown cpu set "
+                    "\"%s\" in threading.cpu-affinity", node->val ? node->val : "");
+            continue;
+        }
+        if (node->head.tqh_first == NULL)
+            continue;
+
+        AffinitySetupSet(&thread_affinity[t], node->head.tqh_first, ncpus);
+    }
+
+    for (t = 0; t < MAX_CPU_SET; t++) {
+        if (!thread_affinity[t].configured || !thread_affinity[t].isolate)
+            continue;
+        for (o = 0; o < MAX_CPU_SET; o++) {
+            if (o != t && thread_affinity[o].configured)
+                AffinityIsolate(&thread_affinity[t], &thread_affinity[o]);
+        }
+    }
+
+    for (t = 0; t < MAX_CPU_SET; t++) {
+        ThreadsAffinityType *taf = &thread_affinity[t];
+        if (!taf->configured)
+            continue;
+
+        SCLogInfo("%s: %" PRIu16 " cpus from %" PRIu16 ", %s%s, numa node %d",
+                taf->name, taf->cpu_cnt, taf->cpus[0],
+                taf->mode == EXCLUSIVE_AFFINITY ? "exclusive" : "balanced",
+                taf->isolate ? ", isolated" : "", taf->numa_node);
+    }
+}
+
+/** \retval taf the set of a thread group, NULL if it has none */
+ThreadsAffinityType *AffinityGetSet(uint8_t type) {
+    if (type >= MAX_CPU_SET || !thread_affinity[type].configured)
+        return NULL;
+    return &thread_affinity[type];
+}
+
+/** \brief the cpus a thread group has: those of its set, else ncpus */
+uint16_t AffinityGetCpuCount(uint8_t type, uint16_t ncpus) {
+    ThreadsAffinityType *taf = AffinityGetSet(type);
+    return taf != NULL ? taf->cpu_cnt : ncpus;
+}
+
+/** \brief the next cpu of a set, round robin. Called while the runmode
+ *         creates the threads, so no locking. */
+uint16_t AffinityGetNextCpu(ThreadsAffinityType *taf) {
+    uint16_t cpu = taf->cpus[taf->next];
+
+    taf->next = (taf->next + 1) % taf->cpu_cnt;
+    return cpu;
+}
+
+/**
+ * \brief pin the calling thread to its cpu or set, and bind its memory
+ *        to the node of the set
+ *
+ * \retval 0 ok, -1 error or not supported here
+ */
+int AffinityApply(ThreadVars *tv) {
+    ThreadsAffinityType *taf = AffinityGetSet(tv->cpu_set_type);
+    int r = 0;
+
+    if (taf == NULL)
+        return -1;
+
+#if defined(__linux__)
+    cpu_set_t cs;
+    uint16_t i;
+
+    CPU_ZERO(&cs);
+    if (taf->mode == EXCLUSIVE_AFFINITY) {
+        CPU_SET(tv->cpu_affinity, &cs);
+    } else {
+        for (i = 0; i < taf->cpu_cnt; i++)
+            CPU_SET(taf->cpus[i], &cs);
+    }
+
+    pid_t tid = syscall(SYS_gettid);
+    if (sched_setaffinity(tid, sizeof(cpu_set_t), &cs) != 0) {
+        SCLogWarning(SC_ERR_SYSCALL, "setting the affinity of \"%s\" failed: %s",
+                tv->name, strerror(errno));
+        r = -1;
+    }
+
+    /* the thread ctxs are allocated by the thread right after this, so
+     * they end up on the node too */
+    if (taf->numa_node >= 0) {
+        unsigned long mask = 1UL << taf->numa_node;
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask,
+                    sizeof(mask) * 8) != 0) {
+            SCLogWarning(SC_ERR_SYSCALL, "binding the memory of \"%s\" to "
+                    "node %d failed: %s", tv->name, taf->numa_node,
+                    strerror(errno));
+        }
+    }
+#else
+    /* no cpu sets here, the caller pins the thread to the cpu it was
+     * handed out */
+    return -1;
+#endif /* __linux__ */
+
+    if (taf->mode == EXCLUSIVE_AFFINITY) {
+        SCLogInfo("Setting affinity for \"%s\" Module to cpu/core %" PRIu16
+                " of %s, thread id %lu", tv->name, tv->cpu_affinity, taf->name,
+                SCGetThreadIdLong());
+    } else {
+        SCLogInfo("Setting affinity for \"%s\" Module to %s, thread id %lu",
+                tv->name, taf->name, SCGetThreadIdLong());
+    }
+    return r;
+}
+
+/** \brief NUMA nodes the cpus of a set are on, 0 if it has no set */
+unsigned long AffinityGetNodeMask(uint8_t type) {
+    ThreadsAffinityType *taf = AffinityGetSet(type);
+    unsigned long mask = 0;
+    uint16_t i;
+
+    if (taf == NULL)
+        return 0;
+
+    for (i = 0; i < taf->cpu_cnt; i++) {
+        uint16_t node = UtilCpuGetNumaNode(taf->cpus[i]);
+        if (node < sizeof(mask) * 8)
+            mask |= 1UL << node;
+    }
+    return mask;
+}
+
+/**
+ * \brief the NUMA node the packets should live on: the node all
+ *        configured sets are on
+ *
+ * \retval node or -1 if the sets are on several nodes or there are none
+ */
+int AffinityGetPacketNode(void) {
+    unsigned long mask = 0;
+    uint8_t t;
+    int node;
+
+    for (t = 0; t < MAX_CPU_SET; t++)
+        mask |= AffinityGetNodeMask(t);
+
+    if (mask == 0 || (mask & (mask - 1)) != 0)
+        return -1;
+    for (node = 0; !(mask & (1UL << node)); node++)
+        ;
+    return node;
+}
+
+/**
+ * \brief place memory that isn't touched yet on the nodes of a mask:
+ *        on the node if it's one, interleaved over them if it's more.
+ *        Only the whole pages of the range are placed.
+ */
+void AffinityBindMemory(void *ptr, size_t size, unsigned long mask) {
+#ifdef __linux__
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)ptr + page - 1) & ~(page - 1);
+    uintptr_t end = ((uintptr_t)ptr + size) & ~(page - 1);
+    int mode = (mask & (mask - 1)) ? MPOL_INTERLEAVE : MPOL_PREFERRED;
+
+    if (mask == 0 || UtilCpuGetNumaNodes() < 2 || end <= start)
+        return;
+
+    if (syscall(SYS_mbind, (void *)start, end - start, mode, &mask,
+                sizeof(mask) * 8, 0) != 0) {
+        SCLogWarning(SC_ERR_SYSCALL, "placing %" PRIuMAX " bytes on the "
+                "nodes %#lx failed: %s", (uintmax_t)size, mask, strerror(errno));
+    }
+#endif /* __linux__ */
+}
@@ -0,0 +1,70 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ */
+
+#ifndef __UTIL_AFFINITY_H__
+#define __UTIL_AFFINITY_H__
+
+#include "suricata-common.h"
+#include "threadvars.h"
+
+#define AFFINITY_MAX_CPUS       256
+
+/** thread groups with a cpu set of their own in threading.cpu-affinity */
+enum {
+    RECEIVE_CPU_SET,
+    DECODE_CPU_SET,
+    DETECT_CPU_SET,
+    VERDICT_CPU_SET,
+    OUTPUT_CPU_SET,         /**< respond/reject and the outputs */
+    WORKER_CPU_SET,         /**< workers runmode */
+    MAX_CPU_SET
+};
+
+enum {
+    BALANCED_AFFINITY,      /**< every thread may run on all cpus of the set */
+    EXCLUSIVE_AFFINITY,     /**< every thread gets one cpu of the set */
+};
+
+typedef struct ThreadsAffinityType_ {
+    const char *name;
+    uint8_t configured;
+    uint8_t mode;
+    uint8_t isolate;        /**< keep our cpus out of the other sets */
+    uint8_t prio_set;       /**< prio configured, else the runmode's default */
+    int prio;               /**< PRIO_* */
+    int numa_node;          /**< node the threads' memory is bound to, -1 none */
+
+    uint16_t cpus[AFFINITY_MAX_CPUS];
+    uint16_t cpu_cnt;
+    uint16_t next;          /**< next cpu to hand out in exclusive mode */
+} ThreadsAffinityType;
+
+void AffinitySetupLoadFromConfig(void);
+ThreadsAffinityType *AffinityGetSet(uint8_t);
+uint16_t AffinityGetCpuCount(uint8_t, uint16_t);
+uint16_t AffinityGetNextCpu(ThreadsAffinityType *);
+int AffinityApply(ThreadVars *);
+
+unsigned long AffinityGetNodeMask(uint8_t);
+int AffinityGetPacketNode(void);
+void AffinityBindMemory(void *, size_t, unsigned long);
+
+#endif /* __UTIL_AFFINITY_H__ */
@@ -65,9 +65,32 @@ error:
     return NULL;
 }
 
+/**
+ * \brief set up a filter on a filled bitarray of (size/8)+1 bytes owned
+ *        by the caller, e.g. in a mapped rule cache. BloomFilterFree()
+ *        leaves the bitarray alone and it must not be added to.
+ */
+BloomFilter *BloomFilterInitMapped(uint8_t *bitarray, uint32_t size, uint8_t iter, uint32_t (*Hash)(void *, uint16_t, uint8_t, uint32_t)) {
+    BloomFilter *bf = NULL;
+
+    if (bitarray == NULL || size == 0 || iter == 0 || Hash == NULL)
+        return NULL;
+
+    bf = SCMalloc(sizeof(BloomFilter));
+    if (bf == NULL)
+        return NULL;
+    memset(bf,0,sizeof(BloomFilter));
+    bf->bitarray = bitarray;
+    bf->bitarray_size = size;
+    bf->hash_iterations = iter;
+    bf->mapped = 1;
+    bf->Hash = Hash;
+    return bf;
+}
+
 void BloomFilterFree(BloomFilter *bf) {
     if (bf != NULL) {
-        if (bf->bitarray != NULL)
+        if (bf->bitarray != NULL && !bf->mapped)
             SCFree(bf->bitarray);
 
         SCFree(bf);
@@ -29,11 +29,13 @@ typedef struct BloomFilter_ {
     uint8_t *bitarray;
     uint32_t bitarray_size;
     uint8_t hash_iterations;
+    uint8_t mapped;         /**< bitarray is not ours, see BloomFilterInitMapped() */
     uint32_t (*Hash)(void *, uint16_t, uint8_t, uint32_t);
 } BloomFilter;
 
 /* prototypes */
 BloomFilter *BloomFilterInit(uint32_t, uint8_t, uint32_t (*Hash)(void *, uint16_t, uint8_t, uint32_t));
+BloomFilter *BloomFilterInitMapped(uint8_t *, uint32_t, uint8_t, uint32_t (*Hash)(void *, uint16_t, uint8_t, uint32_t));
 void BloomFilterFree(BloomFilter *);
 void BloomFilterPrint(BloomFilter *);
 int BloomFilterAdd(BloomFilter *, void *, uint16_t);
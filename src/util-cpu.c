@@ -31,6 +31,11 @@
 #include "util-error.h"
 #include "util-debug.h"
 #include "suricata-common.h"
+#include "util-cpu.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif /* __linux__ */
 
 /**
  * Ok, if they should use sysconf, check that they have the macro's
@@ -174,6 +179,61 @@ void UtilCpuPrintSummary() {
                   "system info and check util-cpu.{c,h}");
 }
 
+/**
+ * \brief Get the number of NUMA nodes, from sysfs
+ * \retval 1 if the system has no NUMA or we can't tell; otherwise the
+ *           number of nodes
+ */
+uint16_t UtilCpuGetNumaNodes(void) {
+#ifdef __linux__
+    char path[64];
+    uint16_t nodes = 0;
+
+    for (;;) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%" PRIu16 "",
+                nodes);
+        if (access(path, F_OK) != 0)
+            break;
+        nodes++;
+    }
+    return nodes > 0 ? nodes : 1;
+#else
+    return 1;
+#endif /* __linux__ */
+}
+
+/**
+ * \brief Get the NUMA node a cpu belongs to
+ * \retval 0 if we can't tell; otherwise the node of cpu
+ */
+uint16_t UtilCpuGetNumaNode(uint16_t cpu) {
+#ifdef __linux__
+    char path[80];
+    uint16_t node, nodes = UtilCpuGetNumaNodes();
+
+    for (node = 0; node < nodes; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%" PRIu16
+                "/node%" PRIu16 "", cpu, node);
+        if (access(path, F_OK) == 0)
+            return node;
+    }
+#endif /* __linux__ */
+    return 0;
+}
+
+/**
+ * \brief Get the NUMA node of the cpu the calling thread runs on. Only
+ *        stable once the thread is pinned to a cpu.
+ */
+uint16_t UtilCpuGetCurrentNumaNode(void) {
+#ifdef __linux__
+    unsigned int cpu = 0;
+    if (syscall(SYS_getcpu, &cpu, NULL, NULL) == 0)
+        return UtilCpuGetNumaNode((uint16_t)cpu);
+#endif /* __linux__ */
+    return 0;
+}
+
 /**
  * Get the current number of ticks from the CPU.
  */
@@ -192,3 +252,80 @@ uint64_t UtilCpuGetTicks(void)
 #endif
     return val;
 }
+
+#if defined(__GNUC__) && (defined(__x86_64) || defined(__i386))
+static inline void UtilCpuCpuid(uint32_t leaf, uint32_t sub, uint32_t r[4])
+{
+#if defined(__i386) && defined(__PIC__)
+    /* ebx is the PIC register */
+    __asm__ __volatile__ ("xchgl %%ebx, %1\n\tcpuid\n\txchgl %%ebx, %1"
+            : "=a" (r[0]), "=&r" (r[1]), "=c" (r[2]), "=d" (r[3])
+            : "0" (leaf), "2" (sub));
+#else
+    __asm__ __volatile__ ("cpuid"
+            : "=a" (r[0]), "=b" (r[1]), "=c" (r[2]), "=d" (r[3])
+            : "0" (leaf), "2" (sub));
+#endif
+}
+#endif
+
+/**
+ * \brief Get the instruction set extensions of the cpu that we can use,
+ *        UTIL_CPU_* flags. AVX2 also needs the OS to save the ymm
+ *        registers. Detected once.
+ */
+uint32_t UtilCpuGetSimd(void)
+{
+    static int detected = 0;
+    static uint32_t simd = 0;
+
+    if (detected)
+        return simd;
+
+#if defined(__GNUC__) && (defined(__x86_64) || defined(__i386))
+    uint32_t r[4];
+    uint32_t flags = 0;
+
+    UtilCpuCpuid(0, 0, r);
+    uint32_t max_leaf = r[0];
+
+    if (max_leaf >= 1) {
+        UtilCpuCpuid(1, 0, r);
+        if (r[3] & (1 << 26))
+            flags |= UTIL_CPU_SSE2;
+        if (r[2] & (1 << 9))
+            flags |= UTIL_CPU_SSSE3;
+        if (r[2] & (1 << 20))
+            flags |= UTIL_CPU_SSE42;
+
+        /* osxsave and avx, then ask the OS about the xmm/ymm state */
+        if ((r[2] & (1 << 27)) && (r[2] & (1 << 28)) && max_leaf >= 7) {
+            uint32_t xcr0_lo, xcr0_hi;
+            __asm__ __volatile__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi)
+                    : "c" (0));
+            if ((xcr0_lo & 0x6) == 0x6) {
+                UtilCpuCpuid(7, 0, r);
+                if (r[1] & (1 << 5))
+                    flags |= UTIL_CPU_AVX2;
+            }
+        }
+    }
+    simd = flags;
+#endif
+    detected = 1;
+    return simd;
+}
+
+/**
+ * \brief Log the instruction set extensions UtilCpuGetSimd() found
+ */
+void UtilCpuPrintSimd(void)
+{
+    uint32_t simd = UtilCpuGetSimd();
+
+    SCLogInfo("cpu supports%s%s%s%s%s", simd ? "" : " no simd extensions we use",
+            (simd & UTIL_CPU_SSE2) ? " sse2" : "",
+            (simd & UTIL_CPU_SSSE3) ? " ssse3" : "",
+            (simd & UTIL_CPU_SSE42) ? " sse4.2" : "",
+            (simd & UTIL_CPU_AVX2) ? " avx2" : "");
+}
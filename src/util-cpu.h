@@ -34,6 +34,19 @@ uint16_t UtilCpuGetNumProcessorsMax();
 
 void UtilCpuPrintSummary();
 
+uint16_t UtilCpuGetNumaNodes(void);
+uint16_t UtilCpuGetNumaNode(uint16_t);
+uint16_t UtilCpuGetCurrentNumaNode(void);
+
 uint64_t UtilCpuGetTicks(void);
 
+/* instruction set extensions, see UtilCpuGetSimd() */
+#define UTIL_CPU_SSE2           0x01
+#define UTIL_CPU_SSSE3          0x02
+#define UTIL_CPU_SSE42          0x04
+#define UTIL_CPU_AVX2           0x08
+
+uint32_t UtilCpuGetSimd(void);
+void UtilCpuPrintSimd(void);
+
 #endif /* __UTIL_CPU_H__ */
@@ -189,6 +189,9 @@ const char * SCErrorToString(SCError err)
         CASE_CODE (SC_WARN_ERF_DAG_REC_LEN_CHANGED);
         CASE_CODE (SC_WARN_COMPATIBILITY);
         CASE_CODE (SC_ERR_DCERPC);
+        CASE_CODE (SC_ERR_PQ_RING);
+        CASE_CODE (SC_ERR_REPUTATION);
+        CASE_CODE (SC_ERR_RULE_CACHE);
 
         default:
             return "UNKNOWN_ERROR";
@@ -200,6 +200,9 @@ typedef enum {
     SC_ERR_DAG_NOSUPPORT,           /**< no ERF/DAG support compiled in */
     SC_ERR_FATAL,
     SC_ERR_DCERPC,
+    SC_ERR_PQ_RING,                 /**< packetqueue shared memory ring error */
+    SC_ERR_REPUTATION,              /**< reputation feed or snapshot error */
+    SC_ERR_RULE_CACHE,              /**< rule cache file error */
 } SCError;
 
 const char *SCErrorToString(SCError);
@@ -0,0 +1,1424 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Aho-Corasick pattern matcher. It is an mpm of its own, and is used by
+ * the teddy mpm for the pattern sets that are too large for its SIMD
+ * search.
+ *
+ * The automaton is built over the lower case patterns and turned into a
+ * DFA, so the search does one table lookup per byte of the buffer. The
+ * columns of the DFA are byte classes instead of bytes, which keeps the
+ * table of a few hundred patterns down to a few ten KB. Case sensitive
+ * patterns are compared against the buffer when their state is reached.
+ *
+ * The DFA of thousands of patterns no longer fits in the cpu caches, and
+ * a cache miss per byte is slower than the lookups of the compressed
+ * tables: per state a bitmap of the classes it has a goto transition for,
+ * the popcount of the bitmap below a class gives the transition in a
+ * packed array. Other classes are looked up in the failure state. Every
+ * failure transition is to a less deep state and every byte makes the
+ * state at most one deeper, so a buffer of n bytes takes at most 2n
+ * lookups either way, whatever the patterns or the buffer.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+#include "detect.h"
+#include "conf.h"
+#include "util-mpm-ac.h"
+#include "util-mpm-b2g.h"
+#include "detect-engine-cache.h"
+
+#include "util-debug.h"
+#include "util-unittest.h"
+
+#define INIT_HASH_SIZE 65536
+
+/** no transition in the goto function while building */
+#define AC_FAIL 0xffffffff
+
+#define AcPopcnt(x) (uint32_t)__builtin_popcountll(x)
+
+static int ac_config_done = 0;
+static uint8_t ac_compress = AC_COMPRESS_AUTO;
+
+static void AcThreadInitCtx(MpmCtx *, MpmThreadCtx *, uint32_t);
+static void AcThreadDestroyCtx(MpmCtx *, MpmThreadCtx *);
+static uint64_t AcCacheKey(MpmCtx *);
+static int AcCacheWrite(MpmCtx *, FILE *);
+static int AcCacheLoad(MpmCtx *, uint8_t *, uint32_t);
+void AcRegisterTests(void);
+
+void MpmAcRegister (void) {
+    mpm_table[MPM_AC].name = "ac";
+    mpm_table[MPM_AC].max_pattern_length = 0;
+
+    mpm_table[MPM_AC].InitCtx = AcInitCtx;
+    mpm_table[MPM_AC].InitThreadCtx = AcThreadInitCtx;
+    mpm_table[MPM_AC].DestroyCtx = AcDestroyCtx;
+    mpm_table[MPM_AC].DestroyThreadCtx = AcThreadDestroyCtx;
+    mpm_table[MPM_AC].AddPattern = AcAddPatternCS;
+    mpm_table[MPM_AC].AddPatternNocase = AcAddPatternCI;
+    mpm_table[MPM_AC].Prepare = AcPreparePatterns;
+    mpm_table[MPM_AC].Search = AcSearch;
+    mpm_table[MPM_AC].SearchBatch = AcSearchBatch;
+    mpm_table[MPM_AC].Cleanup = NULL;
+    mpm_table[MPM_AC].PrintCtx = AcPrintInfo;
+    mpm_table[MPM_AC].PrintThreadCtx = NULL;
+    mpm_table[MPM_AC].RegisterUnittests = AcRegisterTests;
+    mpm_table[MPM_AC].CacheKey = AcCacheKey;
+    mpm_table[MPM_AC].CacheWrite = AcCacheWrite;
+    mpm_table[MPM_AC].CacheLoad = AcCacheLoad;
+}
+
+/**
+ * \brief   Function to get the user defined values for the ac algorithm
+ *          from the config file 'suricata.yaml'
+ */
+static void AcGetConfig(void)
+{
+    ConfNode *ac_conf;
+
+    ac_config_done = 1;
+    ac_compress = AC_COMPRESS_AUTO;
+
+    ConfNode *pm = ConfGetNode("pattern-matcher");
+    if (pm == NULL)
+        return;
+
+    TAILQ_FOREACH(ac_conf, &pm->head, next) {
+        if (ac_conf->val == NULL || strcmp(ac_conf->val, "ac") != 0)
+            continue;
+
+        const char *compress_val = ConfNodeLookupChildValue
+                (ac_conf->head.tqh_first, "compress");
+        if (compress_val == NULL || strcasecmp(compress_val, "auto") == 0) {
+            ac_compress = AC_COMPRESS_AUTO;
+        } else if (strcasecmp(compress_val, "yes") == 0) {
+            ac_compress = AC_COMPRESS_YES;
+        } else if (strcasecmp(compress_val, "no") == 0) {
+            ac_compress = AC_COMPRESS_NO;
+        } else {
+            SCLogWarning(SC_ERR_INVALID_YAML_CONF_ENTRY, "invalid ac "
+                    "compress \"%s\", use auto, yes or no", compress_val);
+        }
+    }
+    SCLogDebug("ac: compress %" PRIu8, ac_compress);
+}
+
+static inline void memcpy_tolower(uint8_t *d, uint8_t *s, uint16_t len) {
+    uint16_t i;
+    for (i = 0; i < len; i++) {
+        d[i] = u8_tolower(s[i]);
+    }
+}
+
+/*
+ * INIT HASH START
+ */
+static inline uint32_t AcInitHashRaw(uint8_t *pat, uint16_t patlen) {
+    uint32_t hash = patlen * pat[0];
+    if (patlen > 1)
+        hash += pat[1];
+
+    return (hash % INIT_HASH_SIZE);
+}
+
+static inline void AcInitHashAdd(AcCtx *ctx, AcPattern *p) {
+    uint32_t hash = AcInitHashRaw(p->cs, p->len);
+
+    p->next = ctx->init_hash[hash];
+    ctx->init_hash[hash] = p;
+}
+
+static inline AcPattern *AcInitHashLookup(AcCtx *ctx, uint8_t *pat,
+        uint16_t patlen, uint8_t flags) {
+    AcPattern *t = ctx->init_hash[AcInitHashRaw(pat, patlen)];
+
+    for ( ; t != NULL; t = t->next) {
+        if (t->len == patlen && t->flags == flags &&
+            memcmp(t->cs, pat, patlen) == 0)
+            return t;
+    }
+    return NULL;
+}
+
+/*
+ * INIT HASH END
+ */
+
+static void AcFreePattern(MpmCtx *mpm_ctx, AcPattern *p) {
+    if (p == NULL)
+        return;
+
+    if (p->cs != NULL && p->cs != p->ci) {
+        SCFree(p->cs);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= p->len;
+    }
+    if (p->ci != NULL) {
+        SCFree(p->ci);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= p->len;
+    }
+    SCFree(p);
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= sizeof(AcPattern);
+}
+
+/** \internal
+ *  \brief add a pattern to the mpm/ac context
+ *
+ *  \param pat ptr to the pattern
+ *  \param patlen length of the pattern
+ *  \param pid pattern id
+ *  \param sid signature id (internal id)
+ *  \param flags pattern MPM_PATTERN_* flags
+ */
+static int AcAddPattern(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+        uint16_t offset, uint16_t depth, uint32_t pid, uint32_t sid, uint8_t flags) {
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+
+    if (patlen == 0)
+        return 0;
+
+    AcPattern *p = AcInitHashLookup(ctx, pat, patlen, flags);
+    if (p == NULL) {
+        p = SCMalloc(sizeof(AcPattern));
+        if (p == NULL)
+            goto error;
+        memset(p, 0, sizeof(AcPattern));
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += sizeof(AcPattern);
+
+        p->len = patlen;
+        p->flags = flags;
+        p->id = pid;
+
+        p->ci = SCMalloc(patlen);
+        if (p->ci == NULL)
+            goto error;
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += patlen;
+        memcpy_tolower(p->ci, pat, patlen);
+
+        /* nocase or lower case patterns need no case sensitive copy */
+        if ((p->flags & MPM_PATTERN_FLAG_NOCASE) || memcmp(p->ci, pat, patlen) == 0) {
+            p->cs = p->ci;
+        } else {
+            p->cs = SCMalloc(patlen);
+            if (p->cs == NULL)
+                goto error;
+            mpm_ctx->memory_cnt++;
+            mpm_ctx->memory_size += patlen;
+            memcpy(p->cs, pat, patlen);
+        }
+
+        AcInitHashAdd(ctx, p);
+
+        if (mpm_ctx->pattern_cnt == 65535) {
+            printf("Max search words reached\n");
+            exit(1);
+        }
+        mpm_ctx->pattern_cnt++;
+
+        if (mpm_ctx->maxlen < patlen) mpm_ctx->maxlen = patlen;
+        if (mpm_ctx->minlen == 0) mpm_ctx->minlen = patlen;
+        else if (mpm_ctx->minlen > patlen) mpm_ctx->minlen = patlen;
+    }
+
+    mpm_ctx->total_pattern_cnt++;
+    return 0;
+
+error:
+    AcFreePattern(mpm_ctx, p);
+    return -1;
+}
+
+int AcAddPatternCI(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+    uint16_t offset, uint16_t depth, uint32_t pid, uint32_t sid, uint8_t flags)
+{
+    flags |= MPM_PATTERN_FLAG_NOCASE;
+    return AcAddPattern(mpm_ctx, pat, patlen, offset, depth, pid, sid, flags);
+}
+
+int AcAddPatternCS(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+    uint16_t offset, uint16_t depth, uint32_t pid, uint32_t sid, uint8_t flags)
+{
+    return AcAddPattern(mpm_ctx, pat, patlen, offset, depth, pid, sid, flags);
+}
+
+/** \brief move the patterns from the init hash to the pattern array */
+int AcPreparePatternArray(MpmCtx *mpm_ctx) {
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+    uint32_t i, p = 0;
+
+    if (ctx->parray != NULL)
+        return 0;
+
+    if (mpm_ctx->pattern_cnt > 0) {
+        ctx->parray = SCMalloc(mpm_ctx->pattern_cnt * sizeof(AcPattern *));
+        if (ctx->parray == NULL)
+            return -1;
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += (mpm_ctx->pattern_cnt * sizeof(AcPattern *));
+    }
+
+    for (i = 0; i < INIT_HASH_SIZE; i++) {
+        AcPattern *node = ctx->init_hash[i], *nnode;
+        for ( ; node != NULL; node = nnode) {
+            nnode = node->next;
+            node->next = NULL;
+            ctx->parray[p++] = node;
+        }
+    }
+
+    SCFree(ctx->init_hash);
+    ctx->init_hash = NULL;
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= (INIT_HASH_SIZE * sizeof(AcPattern *));
+    return 0;
+}
+
+/** \brief byte classes of the patterns, see AcCtx::xlate */
+static void AcPrepareAlphabet(MpmCtx *mpm_ctx) {
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+    uint8_t used[256];
+    uint32_t i, c;
+
+    memset(used, 0, sizeof(used));
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        AcPattern *p = ctx->parray[i];
+        for (c = 0; c < p->len; c++)
+            used[p->ci[c]] = 1;
+    }
+
+    ctx->alpha_cnt = 1;
+    memset(ctx->xlate, 0, sizeof(ctx->xlate));
+    for (c = 0; c < 256; c++) {
+        if (used[c])
+            ctx->xlate[c] = (uint8_t)ctx->alpha_cnt++;
+    }
+    for (c = 0; c < 256; c++)
+        ctx->xlate[c] = ctx->xlate[u8_tolower(c)];
+}
+
+/** \brief do the tables of state_cnt states get compressed */
+static int AcCompress(uint32_t state_cnt, uint16_t alpha) {
+    if (ac_compress == AC_COMPRESS_YES)
+        return 1;
+    if (ac_compress == AC_COMPRESS_AUTO) {
+        size_t dfa_size = (size_t)state_cnt * alpha *
+            (state_cnt <= 65536 ? sizeof(uint16_t) : sizeof(uint32_t));
+        return dfa_size > AC_DFA_MAX_SIZE;
+    }
+    return 0;
+}
+
+/**
+ * \brief build the automaton of the patterns in parray
+ *
+ * The goto function is built as a table, then the failure function is
+ * folded into it breadth first: a missing transition of a state is the
+ * transition of its failure state, which is less deep and thus done.
+ * When the tables are compressed the goto function of a state is copied
+ * to its row before the folding.
+ *
+ * \retval 0 ok, -1 error
+ */
+int AcPrepareStates(MpmCtx *mpm_ctx) {
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+    uint32_t *delta = NULL, *fail = NULL, *queue = NULL;
+    uint32_t *own = NULL, *own_next = NULL, *out_cnt = NULL;
+    uint32_t state_max = 1, state_cnt = 1, edge_cnt = 0;
+    uint32_t i, a, s;
+    uint16_t alpha;
+    int compress = 0;
+    int r = -1;
+
+    AcPrepareAlphabet(mpm_ctx);
+    alpha = ctx->alpha_cnt;
+
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++)
+        state_max += ctx->parray[i]->len;
+
+    delta = SCMalloc((size_t)state_max * alpha * sizeof(uint32_t));
+    fail = SCMalloc(state_max * sizeof(uint32_t));
+    queue = SCMalloc(state_max * sizeof(uint32_t));
+    own = SCMalloc(state_max * sizeof(uint32_t));
+    out_cnt = SCMalloc(state_max * sizeof(uint32_t));
+    own_next = SCMalloc((mpm_ctx->pattern_cnt + 1) * sizeof(uint32_t));
+    if (delta == NULL || fail == NULL || queue == NULL || own == NULL ||
+        out_cnt == NULL || own_next == NULL)
+        goto end;
+    memset(delta, 0xff, (size_t)state_max * alpha * sizeof(uint32_t));
+    memset(own, 0xff, state_max * sizeof(uint32_t));
+    memset(out_cnt, 0, state_max * sizeof(uint32_t));
+
+    /* goto function, and the patterns that end in every state */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        AcPattern *p = ctx->parray[i];
+        uint16_t c;
+
+        s = 0;
+        for (c = 0; c < p->len; c++) {
+            uint32_t *next = &delta[(size_t)s * alpha + ctx->xlate[p->ci[c]]];
+            if (*next == AC_FAIL)
+                *next = state_cnt++;
+            s = *next;
+        }
+        own_next[i] = own[s];
+        own[s] = i;
+        out_cnt[s]++;
+    }
+
+    ctx->state_cnt = state_cnt;
+    compress = AcCompress(state_cnt, alpha);
+
+    if (compress) {
+        ctx->row_words = 1 + (alpha + 63) / 64;
+        ctx->rows = SCMalloc((size_t)state_cnt * ctx->row_words * sizeof(uint64_t));
+        if (ctx->rows == NULL)
+            goto end;
+        memset(ctx->rows, 0, (size_t)state_cnt * ctx->row_words * sizeof(uint64_t));
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += (size_t)state_cnt * ctx->row_words * sizeof(uint64_t);
+
+        /* every state but the root has one goto transition to it */
+        ctx->next = SCMalloc(state_cnt * sizeof(uint32_t));
+        if (ctx->next == NULL)
+            goto end;
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += state_cnt * sizeof(uint32_t);
+    }
+
+    /* failure function folded into the goto function */
+    uint32_t head = 0, tail = 0;
+    for (a = 0; a < alpha; a++) {
+        if (delta[a] == AC_FAIL) {
+            delta[a] = 0;
+        } else {
+            fail[delta[a]] = 0;
+            queue[tail++] = delta[a];
+        }
+        ctx->root_next[a] = delta[a];
+    }
+    while (head < tail) {
+        uint32_t r_state = queue[head++];
+
+        /* a state also ends the patterns of its failure state */
+        out_cnt[r_state] += out_cnt[fail[r_state]];
+
+        if (compress) {
+            uint64_t *row = &ctx->rows[(size_t)r_state * ctx->row_words];
+
+            row[0] = ((uint64_t)edge_cnt << 32) | fail[r_state];
+            for (a = 0; a < alpha; a++) {
+                uint32_t next = delta[(size_t)r_state * alpha + a];
+                if (next != AC_FAIL) {
+                    row[1 + a / 64] |= 1ULL << (a % 64);
+                    ctx->next[edge_cnt++] = next;
+                }
+            }
+        }
+
+        for (a = 0; a < alpha; a++) {
+            uint32_t *next = &delta[(size_t)r_state * alpha + a];
+            uint32_t f = delta[(size_t)fail[r_state] * alpha + a];
+            if (*next == AC_FAIL) {
+                *next = f;
+            } else {
+                fail[*next] = f;
+                queue[tail++] = *next;
+            }
+        }
+    }
+
+    /* the output lists, in breadth first order so those of the failure
+     * state are done when we copy them */
+    ctx->out_idx = SCMalloc((state_cnt + 1) * sizeof(uint32_t));
+    if (ctx->out_idx == NULL)
+        goto end;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (state_cnt + 1) * sizeof(uint32_t);
+
+    ctx->out_cnt = 0;
+    for (s = 0; s < state_cnt; s++) {
+        ctx->out_idx[s] = ctx->out_cnt;
+        ctx->out_cnt += out_cnt[s];
+    }
+    ctx->out_idx[state_cnt] = ctx->out_cnt;
+
+    if (ctx->out_cnt > 0) {
+        ctx->out = SCMalloc(ctx->out_cnt * sizeof(uint32_t));
+        if (ctx->out == NULL)
+            goto end;
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += ctx->out_cnt * sizeof(uint32_t);
+    }
+
+    for (i = 0; i <= tail; i++) {
+        uint32_t n = 0;
+
+        s = i == 0 ? 0 : queue[i - 1];
+        for (a = own[s]; a != AC_FAIL; a = own_next[a])
+            ctx->out[ctx->out_idx[s] + n++] = a;
+        if (s != 0) {
+            uint32_t f = fail[s];
+            memcpy(&ctx->out[ctx->out_idx[s] + n], &ctx->out[ctx->out_idx[f]],
+                    (ctx->out_idx[f + 1] - ctx->out_idx[f]) * sizeof(uint32_t));
+        }
+    }
+
+    /* the final table of the DFA, 16 bit if we can */
+    if (compress) {
+        /* done while folding */
+    } else if (state_cnt <= 65536) {
+        ctx->delta16 = SCMalloc((size_t)state_cnt * alpha * sizeof(uint16_t));
+        if (ctx->delta16 == NULL)
+            goto end;
+        for (i = 0; i < state_cnt * alpha; i++)
+            ctx->delta16[i] = (uint16_t)delta[i];
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += (size_t)state_cnt * alpha * sizeof(uint16_t);
+    } else {
+        ctx->delta32 = SCMalloc((size_t)state_cnt * alpha * sizeof(uint32_t));
+        if (ctx->delta32 == NULL)
+            goto end;
+        memcpy(ctx->delta32, delta, (size_t)state_cnt * alpha * sizeof(uint32_t));
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += (size_t)state_cnt * alpha * sizeof(uint32_t);
+    }
+
+    SCLogDebug("%" PRIu32 " patterns, %" PRIu32 " states, %" PRIu16 " byte "
+            "classes%s", mpm_ctx->pattern_cnt, state_cnt, alpha,
+            compress ? ", compressed" : "");
+    r = 0;
+end:
+    if (delta != NULL)
+        SCFree(delta);
+    if (fail != NULL)
+        SCFree(fail);
+    if (queue != NULL)
+        SCFree(queue);
+    if (own != NULL)
+        SCFree(own);
+    if (own_next != NULL)
+        SCFree(own_next);
+    if (out_cnt != NULL)
+        SCFree(out_cnt);
+    return r;
+}
+
+int AcPreparePatterns(MpmCtx *mpm_ctx) {
+    if (AcPreparePatternArray(mpm_ctx) < 0)
+        return -1;
+    return AcPrepareStates(mpm_ctx);
+}
+
+void AcInitCtx(MpmCtx *mpm_ctx, int module_handle) {
+    BUG_ON(mpm_ctx->ctx != NULL);
+
+    mpm_ctx->ctx = SCMalloc(sizeof(AcCtx));
+    if (mpm_ctx->ctx == NULL)
+        return;
+    memset(mpm_ctx->ctx, 0, sizeof(AcCtx));
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += sizeof(AcCtx);
+
+    /* Initialize the defaults value from the config file. The given check make
+       sure that we query config file only once for config values */
+    if (ac_config_done == 0)
+        AcGetConfig();
+
+    /* initialize the hash we use to speed up pattern insertions */
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+    ctx->init_hash = SCMalloc(sizeof(AcPattern *) * INIT_HASH_SIZE);
+    if (ctx->init_hash == NULL)
+        return;
+    memset(ctx->init_hash, 0, sizeof(AcPattern *) * INIT_HASH_SIZE);
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (INIT_HASH_SIZE * sizeof(AcPattern *));
+}
+
+void AcDestroyCtx(MpmCtx *mpm_ctx) {
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+    uint32_t i;
+
+    if (ctx == NULL)
+        return;
+
+    if (ctx->init_hash != NULL) {
+        for (i = 0; i < INIT_HASH_SIZE; i++) {
+            AcPattern *node = ctx->init_hash[i], *nnode;
+            for ( ; node != NULL; node = nnode) {
+                nnode = node->next;
+                AcFreePattern(mpm_ctx, node);
+            }
+        }
+        SCFree(ctx->init_hash);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (INIT_HASH_SIZE * sizeof(AcPattern *));
+    }
+
+    if (ctx->parray != NULL) {
+        for (i = 0; i < mpm_ctx->pattern_cnt; i++)
+            AcFreePattern(mpm_ctx, ctx->parray[i]);
+        SCFree(ctx->parray);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (mpm_ctx->pattern_cnt * sizeof(AcPattern *));
+    }
+
+    if (ctx->delta16 != NULL) {
+        if (!ctx->mapped)
+            SCFree(ctx->delta16);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (size_t)ctx->state_cnt * ctx->alpha_cnt * sizeof(uint16_t);
+    }
+    if (ctx->delta32 != NULL) {
+        if (!ctx->mapped)
+            SCFree(ctx->delta32);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (size_t)ctx->state_cnt * ctx->alpha_cnt * sizeof(uint32_t);
+    }
+    if (ctx->rows != NULL) {
+        if (!ctx->mapped)
+            SCFree(ctx->rows);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (size_t)ctx->state_cnt * ctx->row_words * sizeof(uint64_t);
+    }
+    if (ctx->next != NULL) {
+        if (!ctx->mapped)
+            SCFree(ctx->next);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= ctx->state_cnt * sizeof(uint32_t);
+    }
+    if (ctx->out_idx != NULL) {
+        if (!ctx->mapped)
+            SCFree(ctx->out_idx);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (ctx->state_cnt + 1) * sizeof(uint32_t);
+    }
+    if (ctx->out != NULL) {
+        if (!ctx->mapped)
+            SCFree(ctx->out);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= ctx->out_cnt * sizeof(uint32_t);
+    }
+
+    SCFree(mpm_ctx->ctx);
+    mpm_ctx->ctx = NULL;
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= sizeof(AcCtx);
+}
+
+/** \brief store the patterns that end at buf[end], checking the case of
+ *         the case sensitive ones */
+static inline uint32_t AcMatch(AcCtx *ctx, MpmThreadCtx *mpm_thread_ctx,
+        PatternMatcherQueue *pmq, uint8_t *buf, uint32_t end, uint32_t state) {
+    uint32_t k, cnt = 0;
+
+    for (k = ctx->out_idx[state]; k < ctx->out_idx[state + 1]; k++) {
+        AcPattern *p = ctx->parray[ctx->out[k]];
+
+        if (!(p->flags & MPM_PATTERN_FLAG_NOCASE) &&
+            memcmp(p->cs, buf + end + 1 - p->len, p->len) != 0)
+            continue;
+
+        cnt += MpmVerifyMatch(mpm_thread_ctx, pmq, p->id);
+    }
+    return cnt;
+}
+
+/** \brief next state in the compressed tables
+ *
+ *  The lookups in the failure states are bounded by the depth of the
+ *  state, see the file comment. */
+static inline uint32_t AcNextState(AcCtx *ctx, uint32_t state, uint8_t c) {
+    uint32_t w = 1 + c / 64, k;
+    uint64_t bit = 1ULL << (c % 64);
+
+    while (state != 0) {
+        uint64_t *row = &ctx->rows[(size_t)state * ctx->row_words];
+
+        if (row[w] & bit) {
+            uint32_t idx = (uint32_t)(row[0] >> 32) + AcPopcnt(row[w] & (bit - 1));
+            for (k = 1; k < w; k++)
+                idx += AcPopcnt(row[k]);
+            return ctx->next[idx];
+        }
+        state = (uint32_t)row[0];
+    }
+    return ctx->root_next[c];
+}
+
+uint32_t AcSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+        PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen) {
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+    uint32_t i, state = 0, cnt = 0;
+    uint16_t alpha;
+
+    if (ctx == NULL || ctx->out_idx == NULL)
+        return 0;
+    alpha = ctx->alpha_cnt;
+
+    if (ctx->rows != NULL) {
+        for (i = 0; i < buflen; i++) {
+            state = AcNextState(ctx, state, ctx->xlate[buf[i]]);
+            if (ctx->out_idx[state] != ctx->out_idx[state + 1])
+                cnt += AcMatch(ctx, mpm_thread_ctx, pmq, buf, i, state);
+        }
+    } else if (ctx->delta16 != NULL) {
+        uint16_t *delta = ctx->delta16;
+        for (i = 0; i < buflen; i++) {
+            state = delta[state * alpha + ctx->xlate[buf[i]]];
+            if (ctx->out_idx[state] != ctx->out_idx[state + 1])
+                cnt += AcMatch(ctx, mpm_thread_ctx, pmq, buf, i, state);
+        }
+    } else {
+        uint32_t *delta = ctx->delta32;
+        for (i = 0; i < buflen; i++) {
+            state = delta[(size_t)state * alpha + ctx->xlate[buf[i]]];
+            if (ctx->out_idx[state] != ctx->out_idx[state + 1])
+                cnt += AcMatch(ctx, mpm_thread_ctx, pmq, buf, i, state);
+        }
+    }
+    return cnt;
+}
+
+/** \brief next state, in the tables we have */
+static inline uint32_t AcStep(AcCtx *ctx, uint32_t state, uint8_t c) {
+    if (ctx->rows != NULL)
+        return AcNextState(ctx, state, c);
+    else if (ctx->delta16 != NULL)
+        return ctx->delta16[state * ctx->alpha_cnt + c];
+    return ctx->delta32[(size_t)state * ctx->alpha_cnt + c];
+}
+
+/**
+ * \brief search up to MPM_BATCH_SIZE buffers side by side
+ *
+ * Every round takes the next byte of each of the buffers, so the table
+ * lookups of different buffers are independent of each other and the
+ * cpu has them in flight together instead of waiting for each in turn.
+ */
+uint32_t AcSearchBatch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+        PatternMatcherQueue **pmqs, uint8_t **bufs, uint16_t *buflens,
+        uint32_t *cnts, uint16_t cnt) {
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+    uint32_t state[MPM_BATCH_SIZE];
+    uint32_t i, ret = 0;
+    uint16_t first, n, b, maxlen;
+
+    for (b = 0; b < cnt; b++)
+        cnts[b] = 0;
+    if (ctx == NULL || ctx->out_idx == NULL)
+        return 0;
+
+    for (first = 0; first < cnt; first += n) {
+        n = (cnt - first) > MPM_BATCH_SIZE ? MPM_BATCH_SIZE : (cnt - first);
+
+        maxlen = 0;
+        for (b = 0; b < n; b++) {
+            state[b] = 0;
+            if (buflens[first + b] > maxlen)
+                maxlen = buflens[first + b];
+        }
+
+        for (i = 0; i < maxlen; i++) {
+            for (b = 0; b < n; b++) {
+                uint16_t k = first + b;
+
+                if (i >= buflens[k])
+                    continue;
+
+                state[b] = AcStep(ctx, state[b], ctx->xlate[bufs[k][i]]);
+                if (ctx->out_idx[state[b]] != ctx->out_idx[state[b] + 1])
+                    cnts[k] += AcMatch(ctx, mpm_thread_ctx, pmqs[k], bufs[k], i, state[b]);
+            }
+        }
+    }
+
+    for (b = 0; b < cnt; b++)
+        ret += cnts[b];
+    return ret;
+}
+
+void AcPrintInfo(MpmCtx *mpm_ctx) {
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+
+    printf("MPM AC Information:\n");
+    printf("Memory allocs:   %" PRIu32 "\n", mpm_ctx->memory_cnt);
+    printf("Memory alloced:  %" PRIu32 "\n", mpm_ctx->memory_size);
+    printf("Unique Patterns: %" PRIu32 "\n", mpm_ctx->pattern_cnt);
+    printf("Total Patterns:  %" PRIu32 "\n", mpm_ctx->total_pattern_cnt);
+    printf("Smallest:        %" PRIu32 "\n", mpm_ctx->minlen);
+    printf("Largest:         %" PRIu32 "\n", mpm_ctx->maxlen);
+    printf("States:          %" PRIu32 "\n", ctx->state_cnt);
+    printf("Byte classes:    %" PRIu16 "\n", ctx->alpha_cnt);
+    printf("Tables:          %s\n", ctx->rows != NULL ? "compressed" : "dfa");
+    printf("\n");
+}
+
+/** \brief key of the patterns of a ctx for the rule cache, compiled or
+ *         not, for an mpm that uses ac with settings of its own
+ *
+ *  \param settings those settings, up to 6 */
+uint64_t AcCacheKeySettings(MpmCtx *mpm_ctx, uint16_t mpm_type,
+        const uint32_t *settings, uint32_t settings_cnt) {
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+    DetectEngineCacheKeyCtx kctx;
+    uint32_t all[8];
+    AcPattern *p;
+    uint32_t i;
+
+    BUG_ON(settings_cnt > 6);
+
+    DetectEngineCacheKeyInit(&kctx);
+    if (ctx->parray != NULL) {
+        for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+            p = ctx->parray[i];
+            DetectEngineCacheKeyAdd(&kctx, p->cs, p->len, p->flags, p->id);
+        }
+    } else if (ctx->init_hash != NULL) {
+        for (i = 0; i < INIT_HASH_SIZE; i++) {
+            for (p = ctx->init_hash[i]; p != NULL; p = p->next) {
+                DetectEngineCacheKeyAdd(&kctx, p->cs, p->len, p->flags, p->id);
+            }
+        }
+    }
+
+    for (i = 0; i < settings_cnt; i++)
+        all[i] = settings[i];
+    all[i++] = ac_compress;
+    all[i++] = AC_DFA_MAX_SIZE;
+    return DetectEngineCacheKeyFinal(&kctx, mpm_type, all, i);
+}
+
+static uint64_t AcCacheKey(MpmCtx *mpm_ctx) {
+    return AcCacheKeySettings(mpm_ctx, MPM_AC, NULL, 0);
+}
+
+/** \brief transitions in next of the compressed tables, the root has its
+ *         own in root_next */
+static uint32_t AcCountEdges(uint64_t *rows, uint32_t state_cnt, uint16_t row_words) {
+    uint32_t s, edge_cnt = 0;
+    uint16_t w;
+
+    for (s = 0; s < state_cnt; s++) {
+        for (w = 1; w < row_words; w++)
+            edge_cnt += AcPopcnt(rows[(size_t)s * row_words + w]);
+    }
+    return edge_cnt;
+}
+
+/**
+ * \brief write the patterns and, if it has them, the states of a prepared
+ *        ctx to a rule cache record, see AcCacheHeader
+ *
+ * \retval 0 ok, -1 the ctx isn't prepared or the write failed
+ */
+int AcCacheWriteTables(MpmCtx *mpm_ctx, FILE *fp) {
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+    AcCacheHeader hdr;
+    uint32_t i;
+
+    if (ctx == NULL || ctx->parray == NULL)
+        return -1;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.pattern_cnt = mpm_ctx->pattern_cnt;
+    if (ctx->out_idx != NULL) {
+        if (ctx->rows == NULL && ctx->delta16 == NULL && ctx->delta32 == NULL)
+            return -1;
+        hdr.state_cnt = ctx->state_cnt;
+        hdr.out_cnt = ctx->out_cnt;
+        hdr.alpha_cnt = ctx->alpha_cnt;
+        if (ctx->rows != NULL) {
+            hdr.row_words = ctx->row_words;
+            hdr.edge_cnt = AcCountEdges(ctx->rows, ctx->state_cnt, ctx->row_words);
+        }
+    }
+
+    if (DetectEngineCacheWriteArray(fp, &hdr, sizeof(hdr)) < 0)
+        return -1;
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        AcPattern *p = ctx->parray[i];
+        if (DetectEngineCacheWritePattern(fp, p->cs, p->len, p->flags, p->id) < 0)
+            return -1;
+    }
+    if (hdr.state_cnt == 0)
+        return 0;
+
+    if (DetectEngineCacheWriteArray(fp, ctx->xlate, sizeof(ctx->xlate)) < 0 ||
+        DetectEngineCacheWriteArray(fp, ctx->root_next, sizeof(ctx->root_next)) < 0)
+        return -1;
+
+    if (ctx->rows != NULL) {
+        if (DetectEngineCacheWriteArray(fp, ctx->rows,
+                    (size_t)ctx->state_cnt * ctx->row_words * sizeof(uint64_t)) < 0 ||
+            DetectEngineCacheWriteArray(fp, ctx->next,
+                    hdr.edge_cnt * sizeof(uint32_t)) < 0)
+            return -1;
+    } else if (ctx->delta16 != NULL) {
+        if (DetectEngineCacheWriteArray(fp, ctx->delta16,
+                    (size_t)ctx->state_cnt * ctx->alpha_cnt * sizeof(uint16_t)) < 0)
+            return -1;
+    } else {
+        if (DetectEngineCacheWriteArray(fp, ctx->delta32,
+                    (size_t)ctx->state_cnt * ctx->alpha_cnt * sizeof(uint32_t)) < 0)
+            return -1;
+    }
+
+    if (DetectEngineCacheWriteArray(fp, ctx->out_idx,
+                (ctx->state_cnt + 1) * sizeof(uint32_t)) < 0 ||
+        DetectEngineCacheWriteArray(fp, ctx->out, ctx->out_cnt * sizeof(uint32_t)) < 0)
+        return -1;
+    return 0;
+}
+
+static int AcCacheWrite(MpmCtx *mpm_ctx, FILE *fp) {
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+
+    if (ctx == NULL || ctx->out_idx == NULL)
+        return -1;
+    return AcCacheWriteTables(mpm_ctx, fp);
+}
+
+/** \brief check the indexes in the tables of a record, so that a damaged
+ *         file can't make the search read outside of them */
+static int AcCacheCheckTables(AcCacheTables *t, uint32_t pattern_cnt) {
+    AcCacheHeader *hdr = t->hdr;
+    uint32_t state_cnt = hdr->state_cnt;
+    size_t i, cells = (size_t)state_cnt * hdr->alpha_cnt;
+    uint16_t w;
+
+    for (i = 0; i < 256; i++) {
+        if (t->xlate[i] >= hdr->alpha_cnt || t->root_next[i] >= state_cnt)
+            return -1;
+    }
+
+    if (t->rows != NULL) {
+        for (i = 0; i < state_cnt; i++) {
+            uint64_t *row = &t->rows[i * hdr->row_words];
+            uint64_t edges = row[0] >> 32;
+
+            for (w = 1; w < hdr->row_words; w++)
+                edges += AcPopcnt(row[w]);
+            if ((uint32_t)row[0] >= state_cnt || edges > hdr->edge_cnt)
+                return -1;
+        }
+        for (i = 0; i < hdr->edge_cnt; i++) {
+            if (t->next[i] >= state_cnt)
+                return -1;
+        }
+    } else if (t->delta16 != NULL) {
+        for (i = 0; i < cells; i++) {
+            if (t->delta16[i] >= state_cnt)
+                return -1;
+        }
+    } else {
+        for (i = 0; i < cells; i++) {
+            if (t->delta32[i] >= state_cnt)
+                return -1;
+        }
+    }
+
+    if (t->out_idx[0] != 0 || t->out_idx[state_cnt] != hdr->out_cnt)
+        return -1;
+    for (i = 0; i < state_cnt; i++) {
+        if (t->out_idx[i] > t->out_idx[i + 1])
+            return -1;
+    }
+    for (i = 0; i < hdr->out_cnt; i++) {
+        if (t->out[i] >= pattern_cnt)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief take the patterns and the tables of a ctx from a rule cache
+ *        record, see AcCacheWriteTables(). Nothing is changed in the ctx
+ *        yet, the caller does that with AcCacheLoadTables() or frees the
+ *        tables with AcCacheFreeTables().
+ *
+ * \param ptr position in the record, moved past our part of it
+ * \param left bytes left in the record
+ * \param states the record must have the states, or must have none
+ *
+ * \retval 0 ok, -1 the record is of other patterns or settings
+ */
+int AcCacheReadTables(MpmCtx *mpm_ctx, uint8_t **ptr, uint32_t *left,
+        int states, AcCacheTables *t) {
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+    uint32_t i, state_cnt;
+    uint16_t alpha;
+    int compress;
+
+    memset(t, 0, sizeof(AcCacheTables));
+    if (ctx == NULL || ctx->init_hash == NULL || ctx->parray != NULL ||
+        mpm_ctx->pattern_cnt == 0)
+        return -1;
+
+    AcCacheHeader *hdr = DetectEngineCacheReadArray(ptr, left, sizeof(AcCacheHeader));
+    if (hdr == NULL || hdr->pattern_cnt != mpm_ctx->pattern_cnt ||
+        (hdr->state_cnt != 0) != (states != 0))
+        return -1;
+    t->hdr = hdr;
+
+    t->parray = SCMalloc(mpm_ctx->pattern_cnt * sizeof(AcPattern *));
+    if (t->parray == NULL)
+        return -1;
+
+    /* the patterns of the record in its order, all must be ours */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        DetectEngineCachePattern *pat = DetectEngineCacheReadPattern(ptr, left);
+        if (pat == NULL)
+            goto error;
+
+        AcPattern *p = AcInitHashLookup(ctx, DETECT_ENGINE_CACHE_PATTERN(pat),
+                pat->len, pat->flags);
+        if (p == NULL || p->id != pat->id)
+            goto error;
+        t->parray[i] = p;
+    }
+    if (hdr->state_cnt == 0)
+        return 0;
+
+    /* the tables must be those Prepare would build */
+    state_cnt = hdr->state_cnt;
+    alpha = hdr->alpha_cnt;
+    if (alpha == 0 || alpha > 256 || state_cnt < 2)
+        goto error;
+    compress = AcCompress(state_cnt, alpha);
+    if (compress != (hdr->row_words != 0) ||
+        (compress && hdr->row_words != 1 + (alpha + 63) / 64) ||
+        hdr->edge_cnt >= state_cnt)
+        goto error;
+
+    t->xlate = DetectEngineCacheReadArray(ptr, left, 256);
+    t->root_next = DetectEngineCacheReadArray(ptr, left, 256 * sizeof(uint32_t));
+    if (t->xlate == NULL || t->root_next == NULL)
+        goto error;
+
+    if (compress) {
+        t->rows = DetectEngineCacheReadArray(ptr, left,
+                (size_t)state_cnt * hdr->row_words * sizeof(uint64_t));
+        t->next = DetectEngineCacheReadArray(ptr, left,
+                (size_t)hdr->edge_cnt * sizeof(uint32_t));
+        if (t->rows == NULL || t->next == NULL)
+            goto error;
+    } else if (state_cnt <= 65536) {
+        t->delta16 = DetectEngineCacheReadArray(ptr, left,
+                (size_t)state_cnt * alpha * sizeof(uint16_t));
+        if (t->delta16 == NULL)
+            goto error;
+    } else {
+        t->delta32 = DetectEngineCacheReadArray(ptr, left,
+                (size_t)state_cnt * alpha * sizeof(uint32_t));
+        if (t->delta32 == NULL)
+            goto error;
+    }
+
+    t->out_idx = DetectEngineCacheReadArray(ptr, left,
+            ((size_t)state_cnt + 1) * sizeof(uint32_t));
+    t->out = DetectEngineCacheReadArray(ptr, left,
+            (size_t)hdr->out_cnt * sizeof(uint32_t));
+    if (t->out_idx == NULL || t->out == NULL)
+        goto error;
+
+    if (AcCacheCheckTables(t, mpm_ctx->pattern_cnt) < 0)
+        goto error;
+    return 0;
+
+error:
+    AcCacheFreeTables(t);
+    return -1;
+}
+
+void AcCacheFreeTables(AcCacheTables *t) {
+    if (t->parray != NULL) {
+        SCFree(t->parray);
+        t->parray = NULL;
+    }
+}
+
+/**
+ * \brief prepare a ctx with the tables of AcCacheReadTables(). xlate and
+ *        root_next are copied, the other tables are used in place, in
+ *        the mapping.
+ */
+void AcCacheLoadTables(MpmCtx *mpm_ctx, AcCacheTables *t) {
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+    AcCacheHeader *hdr = t->hdr;
+    uint32_t i;
+
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        t->parray[i]->next = NULL;
+    }
+    SCFree(ctx->init_hash);
+    ctx->init_hash = NULL;
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= (INIT_HASH_SIZE * sizeof(AcPattern *));
+
+    ctx->parray = t->parray;
+    t->parray = NULL;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (mpm_ctx->pattern_cnt * sizeof(AcPattern *));
+
+    if (hdr->state_cnt == 0)
+        return;
+
+    memcpy(ctx->xlate, t->xlate, sizeof(ctx->xlate));
+    memcpy(ctx->root_next, t->root_next, sizeof(ctx->root_next));
+    ctx->alpha_cnt = hdr->alpha_cnt;
+    ctx->state_cnt = hdr->state_cnt;
+    ctx->mapped = 1;
+
+    if (t->rows != NULL) {
+        ctx->row_words = hdr->row_words;
+        ctx->rows = t->rows;
+        ctx->next = t->next;
+        mpm_ctx->memory_cnt += 2;
+        mpm_ctx->memory_size += (size_t)ctx->state_cnt * ctx->row_words * sizeof(uint64_t) +
+            ctx->state_cnt * sizeof(uint32_t);
+    } else if (t->delta16 != NULL) {
+        ctx->delta16 = t->delta16;
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += (size_t)ctx->state_cnt * ctx->alpha_cnt * sizeof(uint16_t);
+    } else {
+        ctx->delta32 = t->delta32;
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += (size_t)ctx->state_cnt * ctx->alpha_cnt * sizeof(uint32_t);
+    }
+
+    ctx->out_idx = t->out_idx;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (ctx->state_cnt + 1) * sizeof(uint32_t);
+
+    ctx->out_cnt = hdr->out_cnt;
+    if (ctx->out_cnt > 0) {
+        ctx->out = t->out;
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += ctx->out_cnt * sizeof(uint32_t);
+    }
+}
+
+/**
+ * \brief prepare a ctx with the tables of a rule cache record
+ *
+ * \retval 0 ok, -1 the record is of other patterns or settings, the ctx
+ *         is left untouched
+ */
+static int AcCacheLoad(MpmCtx *mpm_ctx, uint8_t *data, uint32_t len) {
+    AcCacheTables t;
+
+    if (AcCacheReadTables(mpm_ctx, &data, &len, 1, &t) < 0)
+        return -1;
+    AcCacheLoadTables(mpm_ctx, &t);
+    return 0;
+}
+
+static void AcThreadInitCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx, uint32_t matchsize) {
+    memset(mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+}
+
+static void AcThreadDestroyCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx) {
+}
+
+/*
+ * TESTS
+ */
+
+#ifdef UNITTESTS
+/** \brief search buf with the DFA and the compressed tables, and compare
+ *         the patterns they find with those of b2g
+ *
+ *  \param pats patterns, nocase if they start with a '~'
+ */
+static int AcTestCompare(char **pats, int patcnt, uint8_t *buf, uint16_t buflen) {
+    PatternMatcherQueue b2g_pmq, pmq;
+    MpmThreadCtx mpm_thread_ctx;
+    MpmCtx b2g_ctx, mpm_ctx;
+    uint8_t save_compress, compress;
+    int result = 0, i;
+
+    memset(&b2g_ctx, 0, sizeof(b2g_ctx));
+    memset(&mpm_thread_ctx, 0, sizeof(mpm_thread_ctx));
+    PmqSetup(&b2g_pmq, 0, patcnt);
+    PmqSetup(&pmq, 0, patcnt);
+
+    MpmInitCtx(&b2g_ctx, MPM_B2G, -1);
+    for (i = 0; i < patcnt; i++) {
+        if (pats[i][0] == '~')
+            mpm_table[MPM_B2G].AddPatternNocase(&b2g_ctx, (uint8_t *)pats[i] + 1,
+                    strlen(pats[i]) - 1, 0, 0, i, 0, 0);
+        else
+            mpm_table[MPM_B2G].AddPattern(&b2g_ctx, (uint8_t *)pats[i],
+                    strlen(pats[i]), 0, 0, i, 0, 0);
+    }
+    mpm_table[MPM_B2G].Prepare(&b2g_ctx);
+    mpm_table[MPM_B2G].Search(&b2g_ctx, &mpm_thread_ctx, &b2g_pmq, buf, buflen);
+
+    if (ac_config_done == 0)
+        AcGetConfig();
+    save_compress = ac_compress;
+
+    for (compress = AC_COMPRESS_NO; compress <= AC_COMPRESS_YES; compress++) {
+        ac_compress = compress;
+
+        memset(&mpm_ctx, 0, sizeof(mpm_ctx));
+        PmqReset(&pmq);
+        MpmInitCtx(&mpm_ctx, MPM_AC, -1);
+        for (i = 0; i < patcnt; i++) {
+            if (pats[i][0] == '~')
+                AcAddPatternCI(&mpm_ctx, (uint8_t *)pats[i] + 1,
+                        strlen(pats[i]) - 1, 0, 0, i, 0, 0);
+            else
+                AcAddPatternCS(&mpm_ctx, (uint8_t *)pats[i],
+                        strlen(pats[i]), 0, 0, i, 0, 0);
+        }
+        AcPreparePatterns(&mpm_ctx);
+        AcSearch(&mpm_ctx, &mpm_thread_ctx, &pmq, buf, buflen);
+
+        if (pmq.pattern_id_array_cnt != b2g_pmq.pattern_id_array_cnt ||
+            memcmp(pmq.pattern_id_bitarray, b2g_pmq.pattern_id_bitarray,
+                   pmq.pattern_id_bitarray_size) != 0) {
+            printf("compress %" PRIu8 ": %" PRIu32 " patterns, b2g %" PRIu32 ": ",
+                    compress, pmq.pattern_id_array_cnt, b2g_pmq.pattern_id_array_cnt);
+            AcDestroyCtx(&mpm_ctx);
+            goto end;
+        }
+        AcDestroyCtx(&mpm_ctx);
+    }
+    result = 1;
+end:
+    ac_compress = save_compress;
+    mpm_table[MPM_B2G].DestroyCtx(&b2g_ctx);
+    PmqFree(&b2g_pmq);
+    PmqFree(&pmq);
+    return result;
+}
+
+static int AcTestSearch01 (void) {
+    char *pats[] = { "abcd", "bcde", "fghj" };
+    uint8_t *buf = (uint8_t *)"abcdefghjiklmnopqrstuvwxyz";
+    return AcTestCompare(pats, 3, buf, strlen((char *)buf));
+}
+
+/** \test case, and patterns in patterns */
+static int AcTestSearch02 (void) {
+    char *pats[] = { "~ABCD", "wxyz", "WXY", "z", "~Z", "yz", "bc", "~abcdefgh" };
+    uint8_t *buf = (uint8_t *)"abcdefghjiklmnopqrstuvwxyzABCDEFGHJIKLMNOPQRSTUVWXYZ";
+    return AcTestCompare(pats, 8, buf, strlen((char *)buf));
+}
+
+/** \test the worst case of the failure transitions: a buffer that walks
+ *        deep into the patterns and keeps failing back */
+static int AcTestSearch03 (void) {
+    char *pats[] = { "aaaaaaaab", "aaaab", "aab", "~ab", "aaaaaaaaaaaaaaac", "b" };
+    uint8_t buf[1024];
+
+    memset(buf, 'a', sizeof(buf));
+    buf[500] = 'b';
+    buf[1000] = 'B';
+    return AcTestCompare(pats, 6, buf, sizeof(buf));
+}
+
+/** \test more states and classes than fit in one bitmap word */
+static int AcTestSearch04 (void) {
+    char pat[256][8];
+    char *pats[256];
+    uint8_t buf[4096];
+    uint32_t seed = 1;
+    int i;
+
+    for (i = 0; i < 256; i++) {
+        snprintf(pat[i], sizeof(pat[i]), "%s%c%02x%c", (i & 1) ? "~" : "",
+                (char)(0x80 + i / 2), i, 'A' + i % 26);
+        pats[i] = pat[i];
+    }
+    for (i = 0; i < (int)sizeof(buf); i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (i % 4 == 0) ? (uint8_t)(0x80 + (seed >> 16) % 128) :
+                 (i % 4 == 3) ? (uint8_t)('A' + (seed >> 16) % 26) :
+            (uint8_t)"0123456789abcdefABCDEF"[(seed >> 16) % 22];
+    }
+    for (i = 0; i < 64; i++) {
+        char *pat_i = pats[i * 3] + (pats[i * 3][0] == '~');
+        memcpy(buf + i * 61 + 1, pat_i, strlen(pat_i));
+    }
+
+    return AcTestCompare(pats, 256, buf, sizeof(buf));
+}
+
+/** \test the buffers of a batch find what they find searched alone, with
+ *        buffers of other lengths and more than MPM_BATCH_SIZE of them */
+static int AcTestSearchBatch01 (void) {
+    char *pats[] = { "abcd", "~BCDE", "cd", "Z", "~xyz", "aaab" };
+    char *bufs[] = { "abcdefgh", "", "xyzXYZ", "aaaaaaaaaaab", "ZZ", "a", "bcde",
+        "no match here", "abcdeXYZabcde", "cd", "GET /abcd HTTP/1.1" };
+    PatternMatcherQueue pmq[11], *pmqs[11], single_pmq;
+    uint8_t *bbufs[11];
+    uint16_t buflens[11];
+    uint32_t cnts[11], cnt;
+    MpmThreadCtx mpm_thread_ctx;
+    MpmCtx mpm_ctx;
+    uint8_t save_compress, compress;
+    int result = 0, i;
+
+    memset(&mpm_thread_ctx, 0, sizeof(mpm_thread_ctx));
+    PmqSetup(&single_pmq, 0, 6);
+    for (i = 0; i < 11; i++) {
+        PmqSetup(&pmq[i], 0, 6);
+        pmqs[i] = &pmq[i];
+        bbufs[i] = (uint8_t *)bufs[i];
+        buflens[i] = strlen(bufs[i]);
+    }
+
+    if (ac_config_done == 0)
+        AcGetConfig();
+    save_compress = ac_compress;
+
+    for (compress = AC_COMPRESS_NO; compress <= AC_COMPRESS_YES; compress++) {
+        ac_compress = compress;
+
+        memset(&mpm_ctx, 0, sizeof(mpm_ctx));
+        MpmInitCtx(&mpm_ctx, MPM_AC, -1);
+        for (i = 0; i < 6; i++) {
+            if (pats[i][0] == '~')
+                AcAddPatternCI(&mpm_ctx, (uint8_t *)pats[i] + 1,
+                        strlen(pats[i]) - 1, 0, 0, i, 0, 0);
+            else
+                AcAddPatternCS(&mpm_ctx, (uint8_t *)pats[i],
+                        strlen(pats[i]), 0, 0, i, 0, 0);
+        }
+        AcPreparePatterns(&mpm_ctx);
+
+        for (i = 0; i < 11; i++)
+            PmqReset(&pmq[i]);
+        AcSearchBatch(&mpm_ctx, &mpm_thread_ctx, pmqs, bbufs, buflens, cnts, 11);
+
+        for (i = 0; i < 11; i++) {
+            PmqReset(&single_pmq);
+            cnt = AcSearch(&mpm_ctx, &mpm_thread_ctx, &single_pmq, bbufs[i], buflens[i]);
+            if (cnt != cnts[i] ||
+                pmq[i].pattern_id_array_cnt != single_pmq.pattern_id_array_cnt ||
+                memcmp(pmq[i].pattern_id_bitarray, single_pmq.pattern_id_bitarray,
+                       single_pmq.pattern_id_bitarray_size) != 0) {
+                printf("compress %" PRIu8 " buffer %d: %" PRIu32 " matches, "
+                        "alone %" PRIu32 ": ", compress, i, cnts[i], cnt);
+                AcDestroyCtx(&mpm_ctx);
+                goto end;
+            }
+        }
+        AcDestroyCtx(&mpm_ctx);
+    }
+    result = 1;
+end:
+    ac_compress = save_compress;
+    for (i = 0; i < 11; i++)
+        PmqFree(&pmq[i]);
+    PmqFree(&single_pmq);
+    return result;
+}
+
+/** \brief compare a compiled ctx and one loaded from a rule cache */
+static int AcTestCacheCompare(MpmCtx *mpm_ctx, MpmCtx *cache_mpm_ctx) {
+    AcCtx *ctx = (AcCtx *)mpm_ctx->ctx;
+    AcCtx *cache_ctx = (AcCtx *)cache_mpm_ctx->ctx;
+    size_t cells = (size_t)ctx->state_cnt * ctx->alpha_cnt;
+    uint32_t i;
+
+    if (!cache_ctx->mapped || ctx->state_cnt != cache_ctx->state_cnt ||
+        ctx->alpha_cnt != cache_ctx->alpha_cnt ||
+        ctx->out_cnt != cache_ctx->out_cnt ||
+        (ctx->rows == NULL) != (cache_ctx->rows == NULL) ||
+        (ctx->delta16 == NULL) != (cache_ctx->delta16 == NULL) ||
+        (ctx->delta32 == NULL) != (cache_ctx->delta32 == NULL))
+        return 0;
+
+    if (memcmp(ctx->xlate, cache_ctx->xlate, sizeof(ctx->xlate)) != 0 ||
+        memcmp(ctx->out_idx, cache_ctx->out_idx, (ctx->state_cnt + 1) * sizeof(uint32_t)) != 0 ||
+        memcmp(ctx->out, cache_ctx->out, ctx->out_cnt * sizeof(uint32_t)) != 0)
+        return 0;
+
+    if (ctx->rows != NULL) {
+        if (ctx->row_words != cache_ctx->row_words ||
+            memcmp(ctx->root_next, cache_ctx->root_next, sizeof(ctx->root_next)) != 0 ||
+            memcmp(ctx->rows, cache_ctx->rows,
+                   (size_t)ctx->state_cnt * ctx->row_words * sizeof(uint64_t)) != 0 ||
+            memcmp(ctx->next, cache_ctx->next, AcCountEdges(ctx->rows,
+                   ctx->state_cnt, ctx->row_words) * sizeof(uint32_t)) != 0)
+            return 0;
+    } else if (ctx->delta16 != NULL) {
+        if (memcmp(ctx->delta16, cache_ctx->delta16, cells * sizeof(uint16_t)) != 0)
+            return 0;
+    } else {
+        if (memcmp(ctx->delta32, cache_ctx->delta32, cells * sizeof(uint32_t)) != 0)
+            return 0;
+    }
+
+    /* out has indexes in parray, so its order must be the same */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        if (ctx->parray[i]->id != cache_ctx->parray[i]->id)
+            return 0;
+    }
+    return 1;
+}
+
+/** \test a ctx loaded from a rule cache has the tables of a compiled one
+ *        and finds the same, with the DFA and the compressed tables */
+static int AcTestCache01 (void) {
+    char *pats[] = { "abcd", "~BCDE", "xy", "e", "~Fghij", "abce" };
+    uint8_t *buf = (uint8_t *)"abcdefghijxyzABCEbcdE";
+    uint8_t save_compress, compress;
+    int result = 1;
+
+    if (ac_config_done == 0)
+        AcGetConfig();
+    save_compress = ac_compress;
+
+    for (compress = AC_COMPRESS_NO; compress <= AC_COMPRESS_YES; compress++) {
+        ac_compress = compress;
+        if (DetectEngineCacheTestCompare(MPM_AC, pats, 6, buf,
+                    strlen((char *)buf), AcTestCacheCompare) == 0) {
+            printf("compress %" PRIu8 ": ", compress);
+            result = 0;
+            break;
+        }
+    }
+
+    ac_compress = save_compress;
+    return result;
+}
+#endif /* UNITTESTS */
+
+void AcRegisterTests(void) {
+#ifdef UNITTESTS
+    UtRegisterTest("AcTestSearch01", AcTestSearch01, 1);
+    UtRegisterTest("AcTestSearch02", AcTestSearch02, 1);
+    UtRegisterTest("AcTestSearch03", AcTestSearch03, 1);
+    UtRegisterTest("AcTestSearch04", AcTestSearch04, 1);
+    UtRegisterTest("AcTestSearchBatch01", AcTestSearchBatch01, 1);
+    UtRegisterTest("AcTestCache01", AcTestCache01, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,136 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ */
+
+#ifndef __UTIL_MPM_AC_H__
+#define __UTIL_MPM_AC_H__
+
+#include "util-mpm.h"
+#include "detect-engine-cache.h"
+
+typedef struct AcPattern_ {
+    uint16_t len;
+    uint8_t flags;          /**< MPM_PATTERN_FLAG_* */
+    uint8_t pad0;
+    uint32_t id;
+    uint8_t *cs;            /* case sensitive */
+    uint8_t *ci;            /* case INsensitive */
+    struct AcPattern_ *next;
+} AcPattern;
+
+/** DFA tables up to this size are used as they are, larger ones are
+ *  compressed (pattern-matcher.ac.compress: auto) */
+#define AC_DFA_MAX_SIZE         (256 * 1024)
+
+enum {
+    AC_COMPRESS_AUTO = 0,
+    AC_COMPRESS_NO,
+    AC_COMPRESS_YES,
+};
+
+typedef struct AcCtx_ {
+    /* hash used during ctx initialization */
+    AcPattern **init_hash;
+
+    /* pattern array */
+    AcPattern **parray;
+
+    /** the automaton runs over byte classes: every byte the patterns
+     *  have is a class of its own, all others share class 0. Upper case
+     *  letters are in the class of their lower case. */
+    uint8_t xlate[256];
+    uint16_t alpha_cnt;
+
+    uint32_t state_cnt;
+    /** next state for state * alpha_cnt + class, 16 bit while the
+     *  states fit in it */
+    uint16_t *delta16;
+    uint32_t *delta32;
+
+    /** compressed instead of the DFA: the goto function as a row of
+     *  row_words per state, the failure state and the index of the
+     *  state's first transition in next in the first word and a bitmap
+     *  of the classes with a transition in the others. A class without
+     *  one is looked up in the failure state. The root has all its
+     *  transitions in root_next. */
+    uint64_t *rows;
+    uint32_t *next;
+    uint16_t row_words;
+    uint32_t root_next[256];
+
+    /** patterns that end in a state: out[out_idx[state]] up to
+     *  out[out_idx[state + 1]], indexes in parray */
+    uint32_t *out_idx;
+    uint32_t *out;
+    uint32_t out_cnt;
+
+    /** the tables point into a mapped rule cache file, see
+     *  AcCacheLoadTables() */
+    uint8_t mapped;
+} AcCtx;
+
+/** \brief the start of the Aho-Corasick part of a rule cache record. It's
+ *         followed by the patterns in pattern array order and, if there
+ *         are states, xlate, root_next and the rows and next of the
+ *         compressed tables or the DFA, out_idx and out. */
+typedef struct AcCacheHeader_ {
+    uint32_t pattern_cnt;
+    uint32_t state_cnt;         /**< 0: the patterns only */
+    uint32_t out_cnt;
+    uint16_t alpha_cnt;
+    uint16_t row_words;         /**< 0: the DFA */
+    uint32_t edge_cnt;          /**< used part of next */
+    uint32_t pad0;
+} AcCacheHeader;
+
+/** \brief the tables of a record, checked but not yet in the ctx */
+typedef struct AcCacheTables_ {
+    AcCacheHeader *hdr;
+    AcPattern **parray;
+    uint8_t *xlate;
+    uint32_t *root_next;
+    uint64_t *rows;
+    uint32_t *next;
+    uint16_t *delta16;
+    uint32_t *delta32;
+    uint32_t *out_idx;
+    uint32_t *out;
+} AcCacheTables;
+
+void AcInitCtx(MpmCtx *, int);
+void AcDestroyCtx(MpmCtx *);
+int AcAddPatternCI(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t, uint32_t, uint32_t, uint8_t);
+int AcAddPatternCS(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t, uint32_t, uint32_t, uint8_t);
+int AcPreparePatternArray(MpmCtx *);
+int AcPrepareStates(MpmCtx *);
+int AcPreparePatterns(MpmCtx *);
+uint32_t AcSearch(MpmCtx *, MpmThreadCtx *, PatternMatcherQueue *, uint8_t *, uint16_t);
+uint32_t AcSearchBatch(MpmCtx *, MpmThreadCtx *, PatternMatcherQueue **, uint8_t **, uint16_t *, uint32_t *, uint16_t);
+void AcPrintInfo(MpmCtx *);
+
+uint64_t AcCacheKeySettings(MpmCtx *, uint16_t, const uint32_t *, uint32_t);
+int AcCacheWriteTables(MpmCtx *, FILE *);
+int AcCacheReadTables(MpmCtx *, uint8_t **, uint32_t *, int, AcCacheTables *);
+void AcCacheLoadTables(MpmCtx *, AcCacheTables *);
+void AcCacheFreeTables(AcCacheTables *);
+
+void MpmAcRegister(void);
+
+#endif /* __UTIL_MPM_AC_H__ */
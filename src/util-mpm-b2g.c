@@ -42,6 +42,7 @@
 #include "util-debug.h"
 #include "util-unittest.h"
 #include "conf.h"
+#include "detect-engine-cache.h"
 
 #define INIT_HASH_SIZE 65536
 
@@ -63,6 +64,9 @@ void B2gThreadDestroyCtx(MpmCtx *, MpmThreadCtx *);
 int B2gAddPatternCI(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t, uint32_t, uint32_t, uint8_t);
 int B2gAddPatternCS(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t, uint32_t, uint32_t, uint8_t);
 int B2gPreparePatterns(MpmCtx *mpm_ctx);
+static uint64_t B2gCacheKey(MpmCtx *);
+static int B2gCacheWrite(MpmCtx *, FILE *);
+static int B2gCacheLoad(MpmCtx *, uint8_t *, uint32_t);
 uint32_t B2gSearchWrap(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx, PatternMatcherQueue *, uint8_t *buf, uint16_t buflen);
 uint32_t B2gSearch1(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx, PatternMatcherQueue *, uint8_t *buf, uint16_t buflen);
 #ifdef B2G_SEARCH2
@@ -85,6 +89,9 @@ void MpmB2gRegister (void) {
     mpm_table[MPM_B2G].AddPattern = B2gAddPatternCS;
     mpm_table[MPM_B2G].AddPatternNocase = B2gAddPatternCI;
     mpm_table[MPM_B2G].Prepare = B2gPreparePatterns;
+    mpm_table[MPM_B2G].CacheKey = B2gCacheKey;
+    mpm_table[MPM_B2G].CacheWrite = B2gCacheWrite;
+    mpm_table[MPM_B2G].CacheLoad = B2gCacheLoad;
     mpm_table[MPM_B2G].Search = B2gSearchWrap;
     mpm_table[MPM_B2G].Cleanup = NULL;
     mpm_table[MPM_B2G].PrintCtx = B2gPrintInfo;
@@ -510,10 +517,18 @@ static void B2gPrepareHash(MpmCtx *mpm_ctx) {
         }
     }
 
+    return;
+error:
+    return;
+}
+
+static void B2gPrepareBloom(MpmCtx *mpm_ctx) {
+    B2gCtx *ctx = (B2gCtx *)mpm_ctx->ctx;
+
     /* alloc the bloom array */
     ctx->bloom = (BloomFilter **)SCMalloc(sizeof(BloomFilter *) * ctx->hash_size);
     if (ctx->bloom == NULL)
-        goto error;
+        return;
     memset(ctx->bloom, 0, sizeof(BloomFilter *) * ctx->hash_size);
 
     mpm_ctx->memory_cnt++;
@@ -542,10 +557,6 @@ static void B2gPrepareHash(MpmCtx *mpm_ctx) {
             thi = thi->next;
         } while (thi != NULL);
     }
-
-    return;
-error:
-    return;
 }
 
 int B2gBuildMatchArray(MpmCtx *mpm_ctx) {
@@ -581,7 +592,20 @@ int B2gBuildMatchArray(MpmCtx *mpm_ctx) {
     SCReturnInt(0);
 }
 
-int B2gPreparePatterns(MpmCtx *mpm_ctx) {
+/** \brief 'm', the length the patterns are matched on: the smallest
+ *         pattern size, within bounds. m can be max WORD_SIZE - 1 */
+static B2G_TYPE B2gGetM(MpmCtx *mpm_ctx) {
+    B2G_TYPE m = mpm_ctx->minlen;
+
+    if (m >= B2G_WORD_SIZE) {
+        m = B2G_WORD_SIZE - 1;
+    }
+    if (m < 2) m = 2;
+    return m;
+}
+
+/** \brief move the patterns from the init hash to the pattern array */
+static int B2gPreparePatternArray(MpmCtx *mpm_ctx) {
     B2gCtx *ctx = (B2gCtx *)mpm_ctx->ctx;
 
     /* alloc the pattern array */
@@ -612,18 +636,15 @@ int B2gPreparePatterns(MpmCtx *mpm_ctx) {
     ctx->init_hash = NULL;
 
     /* set 'm' to the smallest pattern size */
-    ctx->m = mpm_ctx->minlen;
-
-    /* make sure 'm' stays in bounds
-       m can be max WORD_SIZE - 1 */
-    if (ctx->m >= B2G_WORD_SIZE) {
-        ctx->m = B2G_WORD_SIZE - 1;
-    }
-    if (ctx->m < 2) ctx->m = 2;
+    ctx->m = B2gGetM(mpm_ctx);
+    return 0;
+error:
+    return -1;
+}
 
-    ctx->hash_size = b2g_hash_size;
-    B2gPrepareHash(mpm_ctx);
-    B2gBuildMatchArray(mpm_ctx);
+/** \brief pick the search functions for the patterns we have */
+static void B2gPrepareSearch(MpmCtx *mpm_ctx) {
+    B2gCtx *ctx = (B2gCtx *)mpm_ctx->ctx;
 
     SCLogDebug("ctx->pat_1_cnt %"PRIu16"", ctx->pat_1_cnt);
     if (ctx->pat_1_cnt) {
@@ -641,9 +662,228 @@ int B2gPreparePatterns(MpmCtx *mpm_ctx) {
         ctx->MBSearch = b2g_func;
 #endif
     }
+}
+
+int B2gPreparePatterns(MpmCtx *mpm_ctx) {
+    B2gCtx *ctx = (B2gCtx *)mpm_ctx->ctx;
+
+    if (B2gPreparePatternArray(mpm_ctx) < 0)
+        return -1;
+
+    ctx->hash_size = b2g_hash_size;
+    B2gPrepareHash(mpm_ctx);
+    B2gPrepareBloom(mpm_ctx);
+    B2gBuildMatchArray(mpm_ctx);
+    B2gPrepareSearch(mpm_ctx);
+    return 0;
+}
+
+/** \brief the start of a rule cache record of a ctx. It's followed by
+ *         the patterns in pattern array order, B2G, pminlen and the bloom
+ *         filter bit array of every used bucket. */
+typedef struct B2gCacheHeader_ {
+    uint32_t pattern_cnt;
+    uint32_t hash_size;
+    uint32_t bloom_size;
+    uint32_t bloom_cnt;     /**< buckets with a bloom filter */
+    uint8_t type_size;      /**< sizeof(B2G_TYPE) */
+    uint8_t m;
+    uint16_t pad0;
+    uint32_t pad1;
+} B2gCacheHeader;
+
+/** \brief key of the patterns of a ctx for the rule cache, compiled or not */
+static uint64_t B2gCacheKey(MpmCtx *mpm_ctx) {
+    B2gCtx *ctx = (B2gCtx *)mpm_ctx->ctx;
+    DetectEngineCacheKeyCtx kctx;
+    B2gPattern *p;
+    uint32_t i;
+
+    DetectEngineCacheKeyInit(&kctx);
+    if (ctx->parray != NULL) {
+        for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+            p = ctx->parray[i];
+            DetectEngineCacheKeyAdd(&kctx, p->cs, p->len, p->flags, p->id);
+        }
+    } else if (ctx->init_hash != NULL) {
+        for (i = 0; i < INIT_HASH_SIZE; i++) {
+            for (p = ctx->init_hash[i]; p != NULL; p = p->next) {
+                DetectEngineCacheKeyAdd(&kctx, p->cs, p->len, p->flags, p->id);
+            }
+        }
+    }
+
+    uint32_t settings[] = { b2g_hash_size, b2g_bloom_size, sizeof(B2G_TYPE),
+                            B2G_HASHSHIFT };
+    return DetectEngineCacheKeyFinal(&kctx, MPM_B2G, settings,
+            sizeof(settings) / sizeof(settings[0]));
+}
+
+/**
+ * \brief write the tables of a prepared ctx to a rule cache record
+ *
+ * \retval 0 ok, -1 the ctx isn't (fully) prepared or the write failed
+ */
+static int B2gCacheWrite(MpmCtx *mpm_ctx, FILE *fp) {
+    B2gCtx *ctx = (B2gCtx *)mpm_ctx->ctx;
+    B2gCacheHeader hdr;
+    uint32_t i, h;
+
+    if (ctx == NULL || ctx->parray == NULL || ctx->hash == NULL ||
+        ctx->bloom == NULL || ctx->pminlen == NULL || ctx->B2G == NULL)
+        return -1;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.pattern_cnt = mpm_ctx->pattern_cnt;
+    hdr.hash_size = ctx->hash_size;
+    hdr.bloom_size = b2g_bloom_size;
+    hdr.type_size = sizeof(B2G_TYPE);
+    hdr.m = (uint8_t)ctx->m;
+
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (ctx->hash[h] == NULL)
+            continue;
+        if (ctx->bloom[h] == NULL)
+            return -1;
+        hdr.bloom_cnt++;
+    }
 
+    if (DetectEngineCacheWriteArray(fp, &hdr, sizeof(hdr)) < 0)
+        return -1;
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        B2gPattern *p = ctx->parray[i];
+        if (DetectEngineCacheWritePattern(fp, p->cs, p->len, p->flags, p->id) < 0)
+            return -1;
+    }
+    if (DetectEngineCacheWriteArray(fp, ctx->B2G, sizeof(B2G_TYPE) * ctx->hash_size) < 0 ||
+        DetectEngineCacheWriteArray(fp, ctx->pminlen, ctx->hash_size) < 0)
+        return -1;
+
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (ctx->hash[h] == NULL)
+            continue;
+        if (DetectEngineCacheWriteArray(fp, ctx->bloom[h]->bitarray,
+                    (b2g_bloom_size / 8) + 1) < 0)
+            return -1;
+    }
     return 0;
+}
+
+/**
+ * \brief prepare a ctx with the tables of a rule cache record. B2G and
+ *        the bloom filter bit arrays are used in place, in the mapping,
+ *        the hash lists are rebuilt from the pattern array.
+ *
+ * \retval 0 ok, -1 the record is of other patterns or settings, the ctx
+ *         is left untouched
+ */
+static int B2gCacheLoad(MpmCtx *mpm_ctx, uint8_t *data, uint32_t len) {
+    B2gCtx *ctx = (B2gCtx *)mpm_ctx->ctx;
+    B2gPattern **parray = NULL;
+    uint32_t bloom_len = (b2g_bloom_size / 8) + 1;
+    uint32_t i, h, bloom_cnt = 0;
+
+    if (ctx == NULL || ctx->init_hash == NULL || mpm_ctx->pattern_cnt == 0)
+        return -1;
+
+    B2gCacheHeader *hdr = DetectEngineCacheReadArray(&data, &len, sizeof(B2gCacheHeader));
+    if (hdr == NULL ||
+        hdr->pattern_cnt != mpm_ctx->pattern_cnt ||
+        hdr->hash_size != b2g_hash_size ||
+        hdr->bloom_size != b2g_bloom_size ||
+        hdr->type_size != sizeof(B2G_TYPE) ||
+        hdr->m != B2gGetM(mpm_ctx))
+        return -1;
+
+    parray = SCMalloc(mpm_ctx->pattern_cnt * sizeof(B2gPattern *));
+    if (parray == NULL)
+        return -1;
+
+    /* the patterns of the record in its order, all must be ours */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        DetectEngineCachePattern *pat = DetectEngineCacheReadPattern(&data, &len);
+        if (pat == NULL)
+            goto error;
+
+        B2gPattern *p = B2gInitHashLookup(ctx, DETECT_ENGINE_CACHE_PATTERN(pat),
+                pat->len, pat->flags);
+        if (p == NULL || p->id != pat->id)
+            goto error;
+        parray[i] = p;
+    }
+
+    B2G_TYPE *b2g = DetectEngineCacheReadArray(&data, &len,
+            sizeof(B2G_TYPE) * hdr->hash_size);
+    uint8_t *pminlen = DetectEngineCacheReadArray(&data, &len, hdr->hash_size);
+    if (b2g == NULL || pminlen == NULL ||
+        (uint64_t)hdr->bloom_cnt * DETECT_ENGINE_CACHE_ALIGN(bloom_len) > len)
+        goto error;
+
+    /* it's a match, from here on we set up the ctx */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        parray[i]->next = NULL;
+    }
+    SCFree(ctx->init_hash);
+    ctx->init_hash = NULL;
+
+    ctx->parray = parray;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (mpm_ctx->pattern_cnt * sizeof(B2gPattern *));
+
+    ctx->m = hdr->m;
+    ctx->hash_size = hdr->hash_size;
+    B2gPrepareHash(mpm_ctx);
+    if (ctx->hash == NULL || ctx->pminlen == NULL)
+        return 0;
+
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (ctx->hash[h] != NULL)
+            bloom_cnt++;
+    }
+    /* same patterns so this can't really happen, but if it does we
+     * are past the point of no return: build the tables after all */
+    if (bloom_cnt != hdr->bloom_cnt) {
+        B2gPrepareBloom(mpm_ctx);
+        B2gBuildMatchArray(mpm_ctx);
+        B2gPrepareSearch(mpm_ctx);
+        return 0;
+    }
+
+    ctx->B2G = b2g;
+    ctx->mapped = 1;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (sizeof(B2G_TYPE) * ctx->hash_size);
+
+    /* capped at 8 for the bloom filter */
+    memcpy(ctx->pminlen, pminlen, ctx->hash_size);
+
+    ctx->bloom = (BloomFilter **)SCMalloc(sizeof(BloomFilter *) * ctx->hash_size);
+    if (ctx->bloom == NULL)
+        return 0;
+    memset(ctx->bloom, 0, sizeof(BloomFilter *) * ctx->hash_size);
+
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (sizeof(BloomFilter *) * ctx->hash_size);
+
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (ctx->hash[h] == NULL)
+            continue;
+
+        uint8_t *bits = DetectEngineCacheReadArray(&data, &len, bloom_len);
+        ctx->bloom[h] = BloomFilterInitMapped(bits, b2g_bloom_size, 2, B2gBloomHash);
+        if (ctx->bloom[h] == NULL)
+            continue;
+
+        mpm_ctx->memory_cnt += BloomFilterMemoryCnt(ctx->bloom[h]);
+        mpm_ctx->memory_size += BloomFilterMemorySize(ctx->bloom[h]);
+    }
+
+    ctx->s0 = 1;
+    B2gPrepareSearch(mpm_ctx);
+    return 0;
+
 error:
+    SCFree(parray);
     return -1;
 }
 
@@ -793,7 +1033,8 @@ void B2gDestroyCtx(MpmCtx *mpm_ctx) {
     }
 
     if (ctx->B2G) {
-        SCFree(ctx->B2G);
+        if (!ctx->mapped)
+            SCFree(ctx->B2G);
         mpm_ctx->memory_cnt--;
         mpm_ctx->memory_size -= (sizeof(B2G_TYPE) * ctx->hash_size);
     }
@@ -1878,6 +2119,67 @@ static int B2gTestSearch21 (void) {
     B2gDestroyCtx(&mpm_ctx);
     return result;
 }
+
+static int B2gTestCacheCompareHash(B2gPattern *p, B2gPattern *cp) {
+    for ( ; p != NULL && cp != NULL; p = p->next, cp = cp->next) {
+        if (p->id != cp->id || p->flags != cp->flags || p->len != cp->len)
+            return 0;
+    }
+    return (p == cp);
+}
+
+/** \brief compare a compiled ctx and one loaded from a rule cache */
+static int B2gTestCacheCompare(MpmCtx *mpm_ctx, MpmCtx *cache_mpm_ctx) {
+    B2gCtx *ctx = (B2gCtx *)mpm_ctx->ctx;
+    B2gCtx *cache_ctx = (B2gCtx *)cache_mpm_ctx->ctx;
+    uint32_t i, h;
+
+    if (!cache_ctx->mapped || ctx->m != cache_ctx->m ||
+        ctx->hash_size != cache_ctx->hash_size ||
+        ctx->pat_1_cnt != cache_ctx->pat_1_cnt ||
+        ctx->pat_x_cnt != cache_ctx->pat_x_cnt ||
+        ctx->Search != cache_ctx->Search ||
+        ctx->MBSearch != cache_ctx->MBSearch)
+        return 0;
+
+    if (memcmp(ctx->B2G, cache_ctx->B2G, sizeof(B2G_TYPE) * ctx->hash_size) != 0 ||
+        memcmp(ctx->pminlen, cache_ctx->pminlen, ctx->hash_size) != 0)
+        return 0;
+
+    /* same pattern array order, whatever order the patterns came in */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        if (ctx->parray[i]->id != cache_ctx->parray[i]->id)
+            return 0;
+    }
+
+    for (i = 0; i < 256; i++) {
+        if (ctx->hash1[i].flags != cache_ctx->hash1[i].flags ||
+            B2gTestCacheCompareHash(&ctx->hash1[i], &cache_ctx->hash1[i]) == 0)
+            return 0;
+    }
+
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (B2gTestCacheCompareHash(ctx->hash[h], cache_ctx->hash[h]) == 0)
+            return 0;
+        if ((ctx->bloom[h] == NULL) != (cache_ctx->bloom[h] == NULL))
+            return 0;
+        if (ctx->bloom[h] != NULL &&
+            memcmp(ctx->bloom[h]->bitarray, cache_ctx->bloom[h]->bitarray,
+                   (b2g_bloom_size / 8) + 1) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+/** \test a ctx loaded from a rule cache has the tables of a compiled one
+ *        and finds the same */
+static int B2gTestCache01 (void) {
+    char *pats[] = { "abcd", "~BCDE", "xy", "e", "~Fghij", "abce" };
+    uint8_t *buf = (uint8_t *)"abcdefghijxyzABCEbcdE";
+
+    return DetectEngineCacheTestCompare(MPM_B2G, pats, 6, buf,
+            strlen((char *)buf), B2gTestCacheCompare);
+}
 #endif /* UNITTESTS */
 
 #if 0
@@ -2627,6 +2929,7 @@ void B2gRegisterTests(void) {
     UtRegisterTest("B2gTestSearch19", B2gTestSearch19, 1);
     UtRegisterTest("B2gTestSearch20", B2gTestSearch20, 1);
     UtRegisterTest("B2gTestSearch21", B2gTestSearch21, 1);
+    UtRegisterTest("B2gTestCache01", B2gTestCache01, 1);
 //    UtRegisterTest("B2gTestSearchXX", B2gTestSearchXX, 1);
 #endif /* UNITTESTS */
 }
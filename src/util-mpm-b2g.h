@@ -98,6 +98,8 @@ typedef struct B2gCtx_ {
     B2gPattern **init_hash;
 
     uint8_t s0;
+    /** B2G points into a mapped rule cache file, see B2gCacheLoad() */
+    uint8_t mapped;
 
     /* we store our own multi byte search func ptr here for B2gSearch1 */
     uint32_t (*Search)(struct MpmCtx_ *, struct MpmThreadCtx_ *, PatternMatcherQueue *, uint8_t *, uint16_t);
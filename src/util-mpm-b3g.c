@@ -37,6 +37,7 @@
 #include "util-unittest.h"
 #include "conf.h"
 #include "util-debug.h"
+#include "detect-engine-cache.h"
 
 #define INIT_HASH_SIZE 65536
 
@@ -58,6 +59,9 @@ void B3gThreadDestroyCtx(MpmCtx *, MpmThreadCtx *);
 int B3gAddPatternCI(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t, uint32_t, uint32_t, uint8_t);
 int B3gAddPatternCS(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t, uint32_t, uint32_t, uint8_t);
 int B3gPreparePatterns(MpmCtx *);
+static uint64_t B3gCacheKey(MpmCtx *);
+static int B3gCacheWrite(MpmCtx *, FILE *);
+static int B3gCacheLoad(MpmCtx *, uint8_t *, uint32_t);
 uint32_t B3gSearchWrap(MpmCtx *, MpmThreadCtx *, PatternMatcherQueue *, uint8_t *, uint16_t);
 uint32_t B3gSearch1(MpmCtx *, MpmThreadCtx *, PatternMatcherQueue *, uint8_t *, uint16_t);
 uint32_t B3gSearch2(MpmCtx *, MpmThreadCtx *, PatternMatcherQueue *, uint8_t *, uint16_t);
@@ -78,6 +82,9 @@ void MpmB3gRegister (void) {
     mpm_table[MPM_B3G].AddPattern = B3gAddPatternCS;
     mpm_table[MPM_B3G].AddPatternNocase = B3gAddPatternCI;
     mpm_table[MPM_B3G].Prepare = B3gPreparePatterns;
+    mpm_table[MPM_B3G].CacheKey = B3gCacheKey;
+    mpm_table[MPM_B3G].CacheWrite = B3gCacheWrite;
+    mpm_table[MPM_B3G].CacheLoad = B3gCacheLoad;
     mpm_table[MPM_B3G].Search = B3gSearchWrap;
     mpm_table[MPM_B3G].Cleanup = NULL;
     mpm_table[MPM_B3G].PrintCtx = B3gPrintInfo;
@@ -475,10 +482,18 @@ static void B3gPrepareHash(MpmCtx *mpm_ctx) {
         }
     }
 
+    return;
+error:
+    return;
+}
+
+static void B3gPrepareBloom(MpmCtx *mpm_ctx) {
+    B3gCtx *ctx = (B3gCtx *)mpm_ctx->ctx;
+
     /* alloc the bloom array */
     ctx->bloom = (BloomFilter **)SCMalloc(sizeof(BloomFilter *) * ctx->hash_size);
     if (ctx->bloom == NULL)
-        goto error;
+        return;
     memset(ctx->bloom, 0, sizeof(BloomFilter *) * ctx->hash_size);
 
     mpm_ctx->memory_cnt++;
@@ -506,10 +521,6 @@ static void B3gPrepareHash(MpmCtx *mpm_ctx) {
             thi = thi->nxt;
         } while (thi != NULL);
     }
-
-    return;
-error:
-    return;
 }
 
 int B3gBuildMatchArray(MpmCtx *mpm_ctx) {
@@ -543,7 +554,20 @@ int B3gBuildMatchArray(MpmCtx *mpm_ctx) {
     return 0;
 }
 
-int B3gPreparePatterns(MpmCtx *mpm_ctx) {
+/** \brief 'm', the length the patterns are matched on: the smallest
+ *         pattern size, within bounds. m can be max WORD_SIZE - 1 */
+static B3G_TYPE B3gGetM(MpmCtx *mpm_ctx) {
+    B3G_TYPE m = mpm_ctx->minlen;
+
+    if (m >= B3G_WORD_SIZE) {
+        m = B3G_WORD_SIZE - 1;
+    }
+    if (m < 3) m = 3;
+    return m;
+}
+
+/** \brief move the patterns from the init hash to the pattern array */
+static int B3gPreparePatternArray(MpmCtx *mpm_ctx) {
     B3gCtx *ctx = (B3gCtx *)mpm_ctx->ctx;
 
     /* alloc the pattern array */
@@ -574,19 +598,15 @@ int B3gPreparePatterns(MpmCtx *mpm_ctx) {
     ctx->init_hash = NULL;
 
     /* set 'm' to the smallest pattern size */
-    ctx->m = mpm_ctx->minlen;
-
-    /* make sure 'm' stays in bounds
-       m can be max WORD_SIZE - 1 */
-    if (ctx->m >= B3G_WORD_SIZE) {
-        ctx->m = B3G_WORD_SIZE - 1;
-    }
-    if (ctx->m < 3) ctx->m = 3;
-
+    ctx->m = B3gGetM(mpm_ctx);
+    return 0;
+error:
+    return -1;
+}
 
-    ctx->hash_size = b3g_hash_size;
-    B3gPrepareHash(mpm_ctx);
-    B3gBuildMatchArray(mpm_ctx);
+/** \brief pick the search functions for the patterns we have */
+static void B3gPrepareSearch(MpmCtx *mpm_ctx) {
+    B3gCtx *ctx = (B3gCtx *)mpm_ctx->ctx;
 
     if (ctx->pat_1_cnt) {
         ctx->Search = B3gSearch1;
@@ -599,10 +619,228 @@ int B3gPreparePatterns(MpmCtx *mpm_ctx) {
         ctx->Search = B3gSearch2;
         ctx->MBSearch = b3g_func;
     }
+}
+
+int B3gPreparePatterns(MpmCtx *mpm_ctx) {
+    B3gCtx *ctx = (B3gCtx *)mpm_ctx->ctx;
+
+    if (B3gPreparePatternArray(mpm_ctx) < 0)
+        return -1;
+
+    ctx->hash_size = b3g_hash_size;
+    B3gPrepareHash(mpm_ctx);
+    B3gPrepareBloom(mpm_ctx);
+    B3gBuildMatchArray(mpm_ctx);
+    B3gPrepareSearch(mpm_ctx);
+    return 0;
+}
+
+/** \brief the start of a rule cache record of a ctx. It's followed by
+ *         the patterns in pattern array order, B3G, pminlen and the bloom
+ *         filter bit array of every used bucket. */
+typedef struct B3gCacheHeader_ {
+    uint32_t pattern_cnt;
+    uint32_t hash_size;
+    uint32_t bloom_size;
+    uint32_t bloom_cnt;     /**< buckets with a bloom filter */
+    uint8_t type_size;      /**< sizeof(B3G_TYPE) */
+    uint8_t m;
+    uint16_t pad0;
+    uint32_t pad1;
+} B3gCacheHeader;
+
+/** \brief key of the patterns of a ctx for the rule cache, compiled or not */
+static uint64_t B3gCacheKey(MpmCtx *mpm_ctx) {
+    B3gCtx *ctx = (B3gCtx *)mpm_ctx->ctx;
+    DetectEngineCacheKeyCtx kctx;
+    B3gPattern *p;
+    uint32_t i;
+
+    DetectEngineCacheKeyInit(&kctx);
+    if (ctx->parray != NULL) {
+        for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+            p = ctx->parray[i];
+            DetectEngineCacheKeyAdd(&kctx, p->cs, p->len, p->flags, p->id);
+        }
+    } else if (ctx->init_hash != NULL) {
+        for (i = 0; i < INIT_HASH_SIZE; i++) {
+            for (p = ctx->init_hash[i]; p != NULL; p = p->next) {
+                DetectEngineCacheKeyAdd(&kctx, p->cs, p->len, p->flags, p->id);
+            }
+        }
+    }
+
+    uint32_t settings[] = { b3g_hash_size, b3g_bloom_size, sizeof(B3G_TYPE),
+                            B3G_HASHSHIFT };
+    return DetectEngineCacheKeyFinal(&kctx, MPM_B3G, settings,
+            sizeof(settings) / sizeof(settings[0]));
+}
+
+/**
+ * \brief write the tables of a prepared ctx to a rule cache record
+ *
+ * \retval 0 ok, -1 the ctx isn't (fully) prepared or the write failed
+ */
+static int B3gCacheWrite(MpmCtx *mpm_ctx, FILE *fp) {
+    B3gCtx *ctx = (B3gCtx *)mpm_ctx->ctx;
+    B3gCacheHeader hdr;
+    uint32_t i, h;
+
+    if (ctx == NULL || ctx->parray == NULL || ctx->hash == NULL ||
+        ctx->bloom == NULL || ctx->pminlen == NULL || ctx->B3G == NULL)
+        return -1;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.pattern_cnt = mpm_ctx->pattern_cnt;
+    hdr.hash_size = ctx->hash_size;
+    hdr.bloom_size = b3g_bloom_size;
+    hdr.type_size = sizeof(B3G_TYPE);
+    hdr.m = (uint8_t)ctx->m;
+
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (ctx->hash[h] == NULL)
+            continue;
+        if (ctx->bloom[h] == NULL)
+            return -1;
+        hdr.bloom_cnt++;
+    }
 
+    if (DetectEngineCacheWriteArray(fp, &hdr, sizeof(hdr)) < 0)
+        return -1;
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        B3gPattern *p = ctx->parray[i];
+        if (DetectEngineCacheWritePattern(fp, p->cs, p->len, p->flags, p->id) < 0)
+            return -1;
+    }
+    if (DetectEngineCacheWriteArray(fp, ctx->B3G, sizeof(B3G_TYPE) * ctx->hash_size) < 0 ||
+        DetectEngineCacheWriteArray(fp, ctx->pminlen, ctx->hash_size) < 0)
+        return -1;
 
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (ctx->hash[h] == NULL)
+            continue;
+        if (DetectEngineCacheWriteArray(fp, ctx->bloom[h]->bitarray,
+                    (b3g_bloom_size / 8) + 1) < 0)
+            return -1;
+    }
     return 0;
+}
+
+/**
+ * \brief prepare a ctx with the tables of a rule cache record. B3G and
+ *        the bloom filter bit arrays are used in place, in the mapping,
+ *        the hash lists are rebuilt from the pattern array.
+ *
+ * \retval 0 ok, -1 the record is of other patterns or settings, the ctx
+ *         is left untouched
+ */
+static int B3gCacheLoad(MpmCtx *mpm_ctx, uint8_t *data, uint32_t len) {
+    B3gCtx *ctx = (B3gCtx *)mpm_ctx->ctx;
+    B3gPattern **parray = NULL;
+    uint32_t bloom_len = (b3g_bloom_size / 8) + 1;
+    uint32_t i, h, bloom_cnt = 0;
+
+    if (ctx == NULL || ctx->init_hash == NULL || mpm_ctx->pattern_cnt == 0)
+        return -1;
+
+    B3gCacheHeader *hdr = DetectEngineCacheReadArray(&data, &len, sizeof(B3gCacheHeader));
+    if (hdr == NULL ||
+        hdr->pattern_cnt != mpm_ctx->pattern_cnt ||
+        hdr->hash_size != b3g_hash_size ||
+        hdr->bloom_size != b3g_bloom_size ||
+        hdr->type_size != sizeof(B3G_TYPE) ||
+        hdr->m != B3gGetM(mpm_ctx))
+        return -1;
+
+    parray = SCMalloc(mpm_ctx->pattern_cnt * sizeof(B3gPattern *));
+    if (parray == NULL)
+        return -1;
+
+    /* the patterns of the record in its order, all must be ours */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        DetectEngineCachePattern *pat = DetectEngineCacheReadPattern(&data, &len);
+        if (pat == NULL)
+            goto error;
+
+        B3gPattern *p = B3gInitHashLookup(ctx, DETECT_ENGINE_CACHE_PATTERN(pat),
+                pat->len, pat->flags);
+        if (p == NULL || p->id != pat->id)
+            goto error;
+        parray[i] = p;
+    }
+
+    B3G_TYPE *b3g = DetectEngineCacheReadArray(&data, &len,
+            sizeof(B3G_TYPE) * hdr->hash_size);
+    uint8_t *pminlen = DetectEngineCacheReadArray(&data, &len, hdr->hash_size);
+    if (b3g == NULL || pminlen == NULL ||
+        (uint64_t)hdr->bloom_cnt * DETECT_ENGINE_CACHE_ALIGN(bloom_len) > len)
+        goto error;
+
+    /* it's a match, from here on we set up the ctx */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        parray[i]->next = NULL;
+    }
+    SCFree(ctx->init_hash);
+    ctx->init_hash = NULL;
+
+    ctx->parray = parray;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (mpm_ctx->pattern_cnt * sizeof(B3gPattern *));
+
+    ctx->m = hdr->m;
+    ctx->hash_size = hdr->hash_size;
+    B3gPrepareHash(mpm_ctx);
+    if (ctx->hash == NULL || ctx->hash2 == NULL || ctx->pminlen == NULL)
+        return 0;
+
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (ctx->hash[h] != NULL)
+            bloom_cnt++;
+    }
+    /* same patterns so this can't really happen, but if it does we
+     * are past the point of no return: build the tables after all */
+    if (bloom_cnt != hdr->bloom_cnt) {
+        B3gPrepareBloom(mpm_ctx);
+        B3gBuildMatchArray(mpm_ctx);
+        B3gPrepareSearch(mpm_ctx);
+        return 0;
+    }
+
+    ctx->B3G = b3g;
+    ctx->mapped = 1;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (sizeof(B3G_TYPE) * ctx->hash_size);
+
+    /* capped at 8 for the bloom filter */
+    memcpy(ctx->pminlen, pminlen, ctx->hash_size);
+
+    ctx->bloom = (BloomFilter **)SCMalloc(sizeof(BloomFilter *) * ctx->hash_size);
+    if (ctx->bloom == NULL)
+        return 0;
+    memset(ctx->bloom, 0, sizeof(BloomFilter *) * ctx->hash_size);
+
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (sizeof(BloomFilter *) * ctx->hash_size);
+
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (ctx->hash[h] == NULL)
+            continue;
+
+        uint8_t *bits = DetectEngineCacheReadArray(&data, &len, bloom_len);
+        ctx->bloom[h] = BloomFilterInitMapped(bits, b3g_bloom_size, 2, B3gBloomHash);
+        if (ctx->bloom[h] == NULL)
+            continue;
+
+        mpm_ctx->memory_cnt += BloomFilterMemoryCnt(ctx->bloom[h]);
+        mpm_ctx->memory_size += BloomFilterMemorySize(ctx->bloom[h]);
+    }
+
+    ctx->s0 = 1;
+    B3gPrepareSearch(mpm_ctx);
+    return 0;
+
 error:
+    SCFree(parray);
     return -1;
 }
 
@@ -745,7 +983,8 @@ void B3gDestroyCtx(MpmCtx *mpm_ctx) {
     }
 
     if (ctx->B3G) {
-        SCFree(ctx->B3G);
+        if (!ctx->mapped)
+            SCFree(ctx->B3G);
         mpm_ctx->memory_cnt--;
         mpm_ctx->memory_size -= (sizeof(B3G_TYPE) * ctx->hash_size);
     }
@@ -1637,6 +1876,68 @@ static int B3gTestSearch12 (void) {
     return result;
 }
 
+static int B3gTestCacheCompareHash(B3gHashItem *hi, B3gHashItem *chi) {
+    for ( ; hi != NULL && chi != NULL; hi = hi->nxt, chi = chi->nxt) {
+        if (hi->idx != chi->idx || hi->flags != chi->flags)
+            return 0;
+    }
+    return (hi == chi);
+}
+
+/** \brief compare a compiled ctx and one loaded from a rule cache */
+static int B3gTestCacheCompare(MpmCtx *mpm_ctx, MpmCtx *cache_mpm_ctx) {
+    B3gCtx *ctx = (B3gCtx *)mpm_ctx->ctx;
+    B3gCtx *cache_ctx = (B3gCtx *)cache_mpm_ctx->ctx;
+    uint32_t i, h;
+
+    if (!cache_ctx->mapped || ctx->m != cache_ctx->m ||
+        ctx->hash_size != cache_ctx->hash_size ||
+        ctx->pat_1_cnt != cache_ctx->pat_1_cnt ||
+        ctx->pat_2_cnt != cache_ctx->pat_2_cnt ||
+        ctx->pat_x_cnt != cache_ctx->pat_x_cnt ||
+        ctx->Search != cache_ctx->Search ||
+        ctx->MBSearch != cache_ctx->MBSearch)
+        return 0;
+
+    if (memcmp(ctx->B3G, cache_ctx->B3G, sizeof(B3G_TYPE) * ctx->hash_size) != 0 ||
+        memcmp(ctx->pminlen, cache_ctx->pminlen, ctx->hash_size) != 0)
+        return 0;
+
+    /* same pattern array order, whatever order the patterns came in */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        if (ctx->parray[i]->id != cache_ctx->parray[i]->id)
+            return 0;
+    }
+
+    for (i = 0; i < 256; i++) {
+        if (B3gTestCacheCompareHash(&ctx->hash1[i], &cache_ctx->hash1[i]) == 0)
+            return 0;
+    }
+
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (B3gTestCacheCompareHash(ctx->hash[h], cache_ctx->hash[h]) == 0 ||
+            B3gTestCacheCompareHash(ctx->hash2[h], cache_ctx->hash2[h]) == 0)
+            return 0;
+        if ((ctx->bloom[h] == NULL) != (cache_ctx->bloom[h] == NULL))
+            return 0;
+        if (ctx->bloom[h] != NULL &&
+            memcmp(ctx->bloom[h]->bitarray, cache_ctx->bloom[h]->bitarray,
+                   (b3g_bloom_size / 8) + 1) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+/** \test a ctx loaded from a rule cache has the tables of a compiled one
+ *        and finds the same */
+static int B3gTestCache01 (void) {
+    char *pats[] = { "abcd", "~BCDE", "xy", "e", "~Fghij", "abce", "ghi" };
+    uint8_t *buf = (uint8_t *)"abcdefghijxyzABCEbcdE";
+
+    return DetectEngineCacheTestCompare(MPM_B3G, pats, 7, buf,
+            strlen((char *)buf), B3gTestCacheCompare);
+}
+
 #endif /* UNITTESTS */
 
 void B3gRegisterTests(void) {
@@ -1662,6 +1963,7 @@ void B3gRegisterTests(void) {
     UtRegisterTest("B3gTestSearch10", B3gTestSearch10, 1);
     UtRegisterTest("B3gTestSearch11", B3gTestSearch11, 1);
     UtRegisterTest("B3gTestSearch12", B3gTestSearch12, 1);
+    UtRegisterTest("B3gTestCache01", B3gTestCache01, 1);
 #endif /* UNITTESTS */
 }
 
@@ -71,6 +71,8 @@ typedef struct B3gCtx_ {
     B3G_TYPE *B3G;
 
     uint8_t s0;
+    /** B3G points into a mapped rule cache file, see B3gCacheLoad() */
+    uint8_t mapped;
 
     uint16_t pat_1_cnt;
     uint16_t pat_2_cnt;
@@ -0,0 +1,959 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Teddy: SIMD multi pattern matcher for small pattern sets.
+ *
+ * The patterns are spread over 8 buckets. For each of the first m (up to
+ * 3) bytes of the patterns there are two 16 byte masks, indexed by the low
+ * and the high nibble of a byte, that have the bit of a bucket set if a
+ * pattern of the bucket has a byte with that nibble there. pshufb looks up
+ * the nibbles of 16 (SSSE3) or 32 (AVX2) bytes of the buffer at once; and
+ * the lookups of the m bytes give the buckets that may have a pattern
+ * starting at each position. Only those are compared.
+ *
+ * Pattern sets larger than pattern-matcher.teddy.max-patterns fill the
+ * buckets with too many patterns to be fast, and are searched with
+ * Aho-Corasick (util-mpm-ac.c) instead, as are all sets on cpus without
+ * SSSE3.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+#include "detect.h"
+#include "conf.h"
+#include "util-mpm-teddy.h"
+#include "util-mpm-ac.h"
+#include "util-mpm-b2g.h"
+#include "util-cpu.h"
+#include "detect-engine-cache.h"
+
+#include "util-debug.h"
+#include "util-unittest.h"
+
+#ifdef TEDDY_SIMD
+#include <immintrin.h>
+#endif
+
+static uint32_t teddy_max_patterns = 0;
+static uint8_t teddy_search = TEDDY_SEARCH_AC;
+
+void TeddyInitCtx(MpmCtx *, int);
+void TeddyThreadInitCtx(MpmCtx *, MpmThreadCtx *, uint32_t);
+void TeddyDestroyCtx(MpmCtx *);
+void TeddyThreadDestroyCtx(MpmCtx *, MpmThreadCtx *);
+int TeddyAddPatternCI(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t, uint32_t, uint32_t, uint8_t);
+int TeddyAddPatternCS(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t, uint32_t, uint32_t, uint8_t);
+int TeddyPreparePatterns(MpmCtx *);
+uint32_t TeddySearch(MpmCtx *, MpmThreadCtx *, PatternMatcherQueue *, uint8_t *, uint16_t);
+uint32_t TeddySearchBatch(MpmCtx *, MpmThreadCtx *, PatternMatcherQueue **, uint8_t **, uint16_t *, uint32_t *, uint16_t);
+void TeddyPrintInfo(MpmCtx *);
+void TeddyRegisterTests(void);
+static uint64_t TeddyCacheKey(MpmCtx *);
+static int TeddyCacheWrite(MpmCtx *, FILE *);
+static int TeddyCacheLoad(MpmCtx *, uint8_t *, uint32_t);
+
+void MpmTeddyRegister (void) {
+    mpm_table[MPM_TEDDY].name = "teddy";
+    mpm_table[MPM_TEDDY].max_pattern_length = 0;
+
+    mpm_table[MPM_TEDDY].InitCtx = TeddyInitCtx;
+    mpm_table[MPM_TEDDY].InitThreadCtx = TeddyThreadInitCtx;
+    mpm_table[MPM_TEDDY].DestroyCtx = TeddyDestroyCtx;
+    mpm_table[MPM_TEDDY].DestroyThreadCtx = TeddyThreadDestroyCtx;
+    mpm_table[MPM_TEDDY].AddPattern = TeddyAddPatternCS;
+    mpm_table[MPM_TEDDY].AddPatternNocase = TeddyAddPatternCI;
+    mpm_table[MPM_TEDDY].Prepare = TeddyPreparePatterns;
+    mpm_table[MPM_TEDDY].Search = TeddySearch;
+    mpm_table[MPM_TEDDY].SearchBatch = TeddySearchBatch;
+    mpm_table[MPM_TEDDY].Cleanup = NULL;
+    mpm_table[MPM_TEDDY].PrintCtx = TeddyPrintInfo;
+    mpm_table[MPM_TEDDY].PrintThreadCtx = NULL;
+    mpm_table[MPM_TEDDY].RegisterUnittests = TeddyRegisterTests;
+    mpm_table[MPM_TEDDY].CacheKey = TeddyCacheKey;
+    mpm_table[MPM_TEDDY].CacheWrite = TeddyCacheWrite;
+    mpm_table[MPM_TEDDY].CacheLoad = TeddyCacheLoad;
+}
+
+/**
+ * \brief   Function to get the user defined values for the teddy algorithm
+ *          from the config file 'suricata.yaml'
+ */
+static void TeddyGetConfig(void)
+{
+    ConfNode *teddy_conf;
+    uint32_t simd = UtilCpuGetSimd();
+
+    /* init defaults */
+    teddy_max_patterns = TEDDY_MAX_PATTERNS;
+    teddy_search = TEDDY_SEARCH_AC;
+#ifdef TEDDY_SIMD
+    if (simd & UTIL_CPU_AVX2)
+        teddy_search = TEDDY_SEARCH_AVX2;
+    else if (simd & UTIL_CPU_SSSE3)
+        teddy_search = TEDDY_SEARCH_SSSE3;
+#endif
+
+    ConfNode *pm = ConfGetNode("pattern-matcher");
+    if (pm == NULL)
+        goto end;
+
+    TAILQ_FOREACH(teddy_conf, &pm->head, next) {
+        if (teddy_conf->val == NULL || strcmp(teddy_conf->val, "teddy") != 0)
+            continue;
+
+        const char *max_val = ConfNodeLookupChildValue
+                (teddy_conf->head.tqh_first, "max-patterns");
+        const char *simd_val = ConfNodeLookupChildValue
+                (teddy_conf->head.tqh_first, "simd");
+
+        if (max_val != NULL) {
+            char *endptr = NULL;
+            unsigned long v = strtoul(max_val, &endptr, 10);
+            if (endptr == max_val || *endptr != '\0' || v > 65535) {
+                SCLogWarning(SC_ERR_INVALID_YAML_CONF_ENTRY, "invalid "
+                        "teddy max-patterns \"%s\", using %d", max_val,
+                        TEDDY_MAX_PATTERNS);
+            } else {
+                teddy_max_patterns = (uint32_t)v;
+            }
+        }
+
+        /* the search can only be limited to less than the cpu has */
+        if (simd_val != NULL) {
+            if (strcasecmp(simd_val, "no") == 0) {
+                teddy_search = TEDDY_SEARCH_AC;
+            } else if (strcasecmp(simd_val, "ssse3") == 0) {
+                if (teddy_search > TEDDY_SEARCH_SSSE3)
+                    teddy_search = TEDDY_SEARCH_SSSE3;
+            } else if (strcasecmp(simd_val, "avx2") != 0 &&
+                       strcasecmp(simd_val, "auto") != 0) {
+                SCLogWarning(SC_ERR_INVALID_YAML_CONF_ENTRY, "invalid "
+                        "teddy simd \"%s\", use auto, avx2, ssse3 or no",
+                        simd_val);
+            }
+        }
+    }
+end:
+    SCLogDebug("teddy: max %" PRIu32 " patterns, search %" PRIu8,
+            teddy_max_patterns, teddy_search);
+}
+
+/** \brief the counters of the MpmCtx: the patterns of ac, and the memory
+ *         of both */
+static void TeddySyncCtx(MpmCtx *mpm_ctx) {
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+
+    mpm_ctx->pattern_cnt = ctx->ac.pattern_cnt;
+    mpm_ctx->total_pattern_cnt = ctx->ac.total_pattern_cnt;
+    mpm_ctx->minlen = ctx->ac.minlen;
+    mpm_ctx->maxlen = ctx->ac.maxlen;
+    mpm_ctx->memory_cnt = ctx->memory_cnt + ctx->ac.memory_cnt;
+    mpm_ctx->memory_size = ctx->memory_size + ctx->ac.memory_size;
+}
+
+void TeddyInitCtx(MpmCtx *mpm_ctx, int module_handle) {
+    BUG_ON(mpm_ctx->ctx != NULL);
+
+    mpm_ctx->ctx = SCMalloc(sizeof(TeddyCtx));
+    if (mpm_ctx->ctx == NULL)
+        return;
+    memset(mpm_ctx->ctx, 0, sizeof(TeddyCtx));
+
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+    ctx->memory_cnt++;
+    ctx->memory_size += sizeof(TeddyCtx);
+
+    /* Initialize the defaults value from the config file. The given check make
+       sure that we query config file only once for config values */
+    if (teddy_max_patterns == 0)
+        TeddyGetConfig();
+
+    ctx->ac.mpm_type = mpm_ctx->mpm_type;
+    AcInitCtx(&ctx->ac, module_handle);
+    TeddySyncCtx(mpm_ctx);
+}
+
+void TeddyDestroyCtx(MpmCtx *mpm_ctx) {
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+    int b;
+
+    if (ctx == NULL)
+        return;
+
+    for (b = 0; b < TEDDY_BUCKETS; b++) {
+        if (ctx->bucket[b] != NULL)
+            SCFree(ctx->bucket[b]);
+    }
+    AcDestroyCtx(&ctx->ac);
+
+    SCFree(mpm_ctx->ctx);
+    mpm_ctx->ctx = NULL;
+    mpm_ctx->memory_cnt = 0;
+    mpm_ctx->memory_size = 0;
+}
+
+void TeddyThreadInitCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx, uint32_t matchsize) {
+    memset(mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+}
+
+void TeddyThreadDestroyCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx) {
+}
+
+int TeddyAddPatternCI(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+    uint16_t offset, uint16_t depth, uint32_t pid, uint32_t sid, uint8_t flags)
+{
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+    int r = AcAddPatternCI(&ctx->ac, pat, patlen, offset, depth, pid, sid, flags);
+    TeddySyncCtx(mpm_ctx);
+    return r;
+}
+
+int TeddyAddPatternCS(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+    uint16_t offset, uint16_t depth, uint32_t pid, uint32_t sid, uint8_t flags)
+{
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+    int r = AcAddPatternCS(&ctx->ac, pat, patlen, offset, depth, pid, sid, flags);
+    TeddySyncCtx(mpm_ctx);
+    return r;
+}
+
+/** \brief order of the patterns over the buckets: patterns that start
+ *         alike share a bucket, so they share the bits in the masks.
+ *
+ *  The order is total, so the buckets are the same whatever order qsort
+ *  gets the patterns in. It only depends on the patterns: Prepare may run
+ *  for several contexts at once (detect-engine.build-threads). */
+static int TeddyPatternCmp(const void *a, const void *b) {
+    const AcPattern *pa = *(const AcPattern **)a;
+    const AcPattern *pb = *(const AcPattern **)b;
+    uint16_t len = pa->len < pb->len ? pa->len : pb->len;
+    int r;
+
+    r = memcmp(pa->ci, pb->ci, len < TEDDY_MAX_M ? len : TEDDY_MAX_M);
+    if (r != 0)
+        return r;
+    if (pa->len != pb->len)
+        return (int)pa->len - (int)pb->len;
+    r = memcmp(pa->ci, pb->ci, pa->len);
+    if (r != 0)
+        return r;
+    r = memcmp(pa->cs, pb->cs, pa->len);
+    if (r != 0)
+        return r;
+    if (pa->flags != pb->flags)
+        return (int)pa->flags - (int)pb->flags;
+    return pa->id < pb->id ? -1 : (pa->id > pb->id);
+}
+
+/** \brief set the bit of bucket b for byte c at pattern byte k */
+static inline void TeddyMaskSet(TeddyCtx *ctx, uint8_t k, uint8_t c, int b) {
+    ctx->lo[k][c & 0x0f] |= (uint8_t)(1 << b);
+    ctx->hi[k][c >> 4] |= (uint8_t)(1 << b);
+}
+
+/** \brief spread the patterns over the buckets and build the masks */
+static int TeddyPrepareMasks(MpmCtx *mpm_ctx) {
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+    AcCtx *ac = (AcCtx *)ctx->ac.ctx;
+    uint32_t cnt = ctx->ac.pattern_cnt, i;
+    int b;
+
+    ctx->m = ctx->ac.minlen < TEDDY_MAX_M ? (uint8_t)ctx->ac.minlen : TEDDY_MAX_M;
+
+    AcPattern **sorted = SCMalloc(cnt * sizeof(AcPattern *));
+    if (sorted == NULL)
+        return -1;
+    memcpy(sorted, ac->parray, cnt * sizeof(AcPattern *));
+    qsort(sorted, cnt, sizeof(AcPattern *), TeddyPatternCmp);
+
+    memset(ctx->lo, 0, sizeof(ctx->lo));
+    memset(ctx->hi, 0, sizeof(ctx->hi));
+
+    for (b = 0; b < TEDDY_BUCKETS; b++) {
+        uint32_t first = b * cnt / TEDDY_BUCKETS;
+        uint32_t last = (b + 1) * cnt / TEDDY_BUCKETS;
+
+        ctx->bucket_cnt[b] = (uint16_t)(last - first);
+        if (ctx->bucket_cnt[b] == 0)
+            continue;
+
+        ctx->bucket[b] = SCMalloc(ctx->bucket_cnt[b] * sizeof(AcPattern *));
+        if (ctx->bucket[b] == NULL) {
+            SCFree(sorted);
+            return -1;
+        }
+        ctx->memory_cnt++;
+        ctx->memory_size += ctx->bucket_cnt[b] * sizeof(AcPattern *);
+        memcpy(ctx->bucket[b], &sorted[first], ctx->bucket_cnt[b] * sizeof(AcPattern *));
+
+        for (i = first; i < last; i++) {
+            AcPattern *p = sorted[i];
+            uint8_t k;
+
+            for (k = 0; k < ctx->m; k++) {
+                if (p->flags & MPM_PATTERN_FLAG_NOCASE) {
+                    TeddyMaskSet(ctx, k, p->ci[k], b);
+                    TeddyMaskSet(ctx, k, (uint8_t)toupper(p->ci[k]), b);
+                } else {
+                    TeddyMaskSet(ctx, k, p->cs[k], b);
+                }
+            }
+        }
+    }
+
+    SCFree(sorted);
+    return 0;
+}
+
+/** \brief the search Prepare picks for the patterns of a ctx */
+static uint8_t TeddyGetSearch(TeddyCtx *ctx) {
+    if (ctx->ac.pattern_cnt == 0 || ctx->ac.pattern_cnt > teddy_max_patterns)
+        return TEDDY_SEARCH_AC;
+    return teddy_search;
+}
+
+int TeddyPreparePatterns(MpmCtx *mpm_ctx) {
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+    int r;
+
+    if (AcPreparePatternArray(&ctx->ac) < 0)
+        return -1;
+
+    ctx->search = TeddyGetSearch(ctx);
+
+    if (ctx->search == TEDDY_SEARCH_AC)
+        r = AcPrepareStates(&ctx->ac);
+    else
+        r = TeddyPrepareMasks(mpm_ctx);
+
+    TeddySyncCtx(mpm_ctx);
+    return r;
+}
+
+#ifdef TEDDY_SIMD
+static inline int TeddyCmpNocase(uint8_t *ci, uint8_t *buf, uint16_t len) {
+    uint16_t i;
+
+    for (i = 0; i < len; i++) {
+        if (u8_tolower(buf[i]) != ci[i])
+            return 1;
+    }
+    return 0;
+}
+
+/** \brief compare the patterns of the buckets a candidate position has */
+static inline uint32_t TeddyVerify(TeddyCtx *ctx, MpmThreadCtx *mpm_thread_ctx,
+        PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen, uint32_t pos,
+        uint32_t buckets) {
+    uint32_t cnt = 0;
+    uint16_t i;
+
+    while (buckets != 0) {
+        int b = __builtin_ctz(buckets);
+        buckets &= buckets - 1;
+
+        for (i = 0; i < ctx->bucket_cnt[b]; i++) {
+            AcPattern *p = ctx->bucket[b][i];
+
+            if (p->len > buflen - pos)
+                continue;
+            if (p->flags & MPM_PATTERN_FLAG_NOCASE) {
+                if (TeddyCmpNocase(p->ci, buf + pos, p->len) != 0)
+                    continue;
+            } else {
+                if (memcmp(p->cs, buf + pos, p->len) != 0)
+                    continue;
+            }
+            cnt += MpmVerifyMatch(mpm_thread_ctx, pmq, p->id);
+        }
+    }
+    return cnt;
+}
+
+/**
+ * The last block of the buffer is copied to a zeroed buffer, so the loads
+ * of the block and the m - 1 bytes after it stay in our memory. Positions
+ * past the end of the buffer are never reported.
+ */
+__attribute__((target("ssse3")))
+static uint32_t TeddySearchSSSE3(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+        PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen) {
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+    const __m128i nib = _mm_set1_epi8(0x0f);
+    __m128i lo[TEDDY_MAX_M], hi[TEDDY_MAX_M];
+    uint8_t tail[32], res_bytes[16];
+    uint32_t pos, cnt = 0, m = ctx->m, k;
+
+    for (k = 0; k < m; k++) {
+        lo[k] = _mm_loadu_si128((const __m128i *)ctx->lo[k]);
+        hi[k] = _mm_loadu_si128((const __m128i *)ctx->hi[k]);
+    }
+
+    for (pos = 0; pos < buflen; pos += 16) {
+        uint8_t *p = buf + pos;
+        if (pos + 16 + m - 1 > buflen) {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, p, buflen - pos);
+            p = tail;
+        }
+
+        __m128i res = _mm_set1_epi8(-1);
+        for (k = 0; k < m; k++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(p + k));
+            __m128i l = _mm_and_si128(v, nib);
+            __m128i h = _mm_and_si128(_mm_srli_epi16(v, 4), nib);
+            res = _mm_and_si128(res, _mm_and_si128(_mm_shuffle_epi8(lo[k], l),
+                        _mm_shuffle_epi8(hi[k], h)));
+        }
+
+        uint32_t bits = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(res,
+                    _mm_setzero_si128())) & 0xffff;
+        if (bits == 0)
+            continue;
+
+        _mm_storeu_si128((__m128i *)res_bytes, res);
+        while (bits != 0) {
+            uint32_t j = (uint32_t)__builtin_ctz(bits);
+            bits &= bits - 1;
+            if (pos + j >= buflen)
+                break;
+            cnt += TeddyVerify(ctx, mpm_thread_ctx, pmq, buf, buflen, pos + j,
+                    res_bytes[j]);
+        }
+    }
+    return cnt;
+}
+
+/** \brief TeddySearchSSSE3() on 32 bytes at a time, the masks are in
+ *         both 128 bit lanes */
+__attribute__((target("avx2")))
+static uint32_t TeddySearchAVX2(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+        PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen) {
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+    const __m256i nib = _mm256_set1_epi8(0x0f);
+    __m256i lo[TEDDY_MAX_M], hi[TEDDY_MAX_M];
+    uint8_t tail[64], res_bytes[32];
+    uint32_t pos, cnt = 0, m = ctx->m, k;
+
+    for (k = 0; k < m; k++) {
+        __m128i l = _mm_loadu_si128((const __m128i *)ctx->lo[k]);
+        __m128i h = _mm_loadu_si128((const __m128i *)ctx->hi[k]);
+        lo[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(l), l, 1);
+        hi[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(h), h, 1);
+    }
+
+    for (pos = 0; pos < buflen; pos += 32) {
+        uint8_t *p = buf + pos;
+        if (pos + 32 + m - 1 > buflen) {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, p, buflen - pos);
+            p = tail;
+        }
+
+        __m256i res = _mm256_set1_epi8(-1);
+        for (k = 0; k < m; k++) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(p + k));
+            __m256i l = _mm256_and_si256(v, nib);
+            __m256i h = _mm256_and_si256(_mm256_srli_epi16(v, 4), nib);
+            res = _mm256_and_si256(res, _mm256_and_si256(
+                        _mm256_shuffle_epi8(lo[k], l), _mm256_shuffle_epi8(hi[k], h)));
+        }
+
+        uint32_t bits = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(res,
+                    _mm256_setzero_si256()));
+        if (bits == 0)
+            continue;
+
+        _mm256_storeu_si256((__m256i *)res_bytes, res);
+        while (bits != 0) {
+            uint32_t j = (uint32_t)__builtin_ctz(bits);
+            bits &= bits - 1;
+            if (pos + j >= buflen)
+                break;
+            cnt += TeddyVerify(ctx, mpm_thread_ctx, pmq, buf, buflen, pos + j,
+                    res_bytes[j]);
+        }
+    }
+    return cnt;
+}
+#endif /* TEDDY_SIMD */
+
+uint32_t TeddySearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+        PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen) {
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+
+    if (ctx == NULL || buflen == 0)
+        return 0;
+
+    switch (ctx->search) {
+#ifdef TEDDY_SIMD
+        case TEDDY_SEARCH_AVX2:
+            return TeddySearchAVX2(mpm_ctx, mpm_thread_ctx, pmq, buf, buflen);
+        case TEDDY_SEARCH_SSSE3:
+            return TeddySearchSSSE3(mpm_ctx, mpm_thread_ctx, pmq, buf, buflen);
+#endif /* TEDDY_SIMD */
+        default:
+            return AcSearch(&ctx->ac, mpm_thread_ctx, pmq, buf, buflen);
+    }
+}
+
+/** \brief the SIMD search is not bound by memory latency, only the
+ *         aho-corasick fallback gains from searching the buffers together */
+uint32_t TeddySearchBatch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+        PatternMatcherQueue **pmqs, uint8_t **bufs, uint16_t *buflens,
+        uint32_t *cnts, uint16_t cnt) {
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+    uint32_t ret = 0;
+    uint16_t i;
+
+    if (ctx != NULL && ctx->search == TEDDY_SEARCH_AC)
+        return AcSearchBatch(&ctx->ac, mpm_thread_ctx, pmqs, bufs, buflens, cnts, cnt);
+
+    for (i = 0; i < cnt; i++) {
+        cnts[i] = TeddySearch(mpm_ctx, mpm_thread_ctx, pmqs[i], bufs[i], buflens[i]);
+        ret += cnts[i];
+    }
+    return ret;
+}
+
+void TeddyPrintInfo(MpmCtx *mpm_ctx) {
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+    static const char *search[] = { "aho-corasick", "ssse3", "avx2" };
+
+    printf("MPM Teddy Information:\n");
+    printf("Memory allocs:   %" PRIu32 "\n", mpm_ctx->memory_cnt);
+    printf("Memory alloced:  %" PRIu32 "\n", mpm_ctx->memory_size);
+    printf("Unique Patterns: %" PRIu32 "\n", mpm_ctx->pattern_cnt);
+    printf("Total Patterns:  %" PRIu32 "\n", mpm_ctx->total_pattern_cnt);
+    printf("Smallest:        %" PRIu32 "\n", mpm_ctx->minlen);
+    printf("Largest:         %" PRIu32 "\n", mpm_ctx->maxlen);
+    printf("Search:          %s\n", search[ctx->search]);
+    printf("Mask bytes:      %" PRIu8 "\n", ctx->m);
+    printf("\n");
+}
+
+/** \brief the teddy part of a rule cache record, after that of ac. Unless
+ *         ac searches, it's followed by the masks and per bucket the
+ *         indexes of its patterns in the pattern array of ac. */
+typedef struct TeddyCacheHeader_ {
+    uint8_t search;
+    uint8_t m;
+    uint16_t bucket_cnt[TEDDY_BUCKETS];
+    uint8_t pad0[6];
+} TeddyCacheHeader;
+
+/** \brief key of the patterns of a ctx for the rule cache, compiled or not */
+static uint64_t TeddyCacheKey(MpmCtx *mpm_ctx) {
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+    uint32_t settings[] = { teddy_search, teddy_max_patterns };
+
+    return AcCacheKeySettings(&ctx->ac, MPM_TEDDY, settings,
+            sizeof(settings) / sizeof(settings[0]));
+}
+
+typedef struct TeddyCacheIdx_ {
+    AcPattern *p;
+    uint32_t idx;
+} TeddyCacheIdx;
+
+static int TeddyCacheIdxCmp(const void *a, const void *b) {
+    const TeddyCacheIdx *ia = (const TeddyCacheIdx *)a;
+    const TeddyCacheIdx *ib = (const TeddyCacheIdx *)b;
+
+    if (ia->p == ib->p)
+        return 0;
+    return (uintptr_t)ia->p < (uintptr_t)ib->p ? -1 : 1;
+}
+
+/**
+ * \brief write the tables of a prepared ctx to a rule cache record
+ *
+ * \retval 0 ok, -1 the ctx isn't prepared or the write failed
+ */
+static int TeddyCacheWrite(MpmCtx *mpm_ctx, FILE *fp) {
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+    TeddyCacheIdx *map = NULL;
+    uint32_t *idx = NULL;
+    TeddyCacheHeader hdr;
+    uint32_t cnt, i;
+    int b, r = -1;
+
+    if (ctx == NULL || ctx->ac.ctx == NULL)
+        return -1;
+    AcCtx *ac = (AcCtx *)ctx->ac.ctx;
+    if (ac->parray == NULL ||
+        (ctx->search == TEDDY_SEARCH_AC ? ac->out_idx == NULL : ctx->m == 0))
+        return -1;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.search = ctx->search;
+    hdr.m = ctx->m;
+    for (b = 0; b < TEDDY_BUCKETS; b++)
+        hdr.bucket_cnt[b] = ctx->bucket_cnt[b];
+
+    if (AcCacheWriteTables(&ctx->ac, fp) < 0 ||
+        DetectEngineCacheWriteArray(fp, &hdr, sizeof(hdr)) < 0)
+        return -1;
+    if (ctx->search == TEDDY_SEARCH_AC)
+        return 0;
+
+    if (DetectEngineCacheWriteArray(fp, ctx->lo, sizeof(ctx->lo)) < 0 ||
+        DetectEngineCacheWriteArray(fp, ctx->hi, sizeof(ctx->hi)) < 0)
+        return -1;
+
+    /* the buckets point to the patterns, we write their indexes */
+    cnt = ctx->ac.pattern_cnt;
+    map = SCMalloc(cnt * sizeof(TeddyCacheIdx));
+    idx = SCMalloc(cnt * sizeof(uint32_t));
+    if (map == NULL || idx == NULL)
+        goto end;
+    for (i = 0; i < cnt; i++) {
+        map[i].p = ac->parray[i];
+        map[i].idx = i;
+    }
+    qsort(map, cnt, sizeof(TeddyCacheIdx), TeddyCacheIdxCmp);
+
+    for (b = 0; b < TEDDY_BUCKETS; b++) {
+        for (i = 0; i < ctx->bucket_cnt[b]; i++) {
+            TeddyCacheIdx key = { ctx->bucket[b][i], 0 };
+            TeddyCacheIdx *found = bsearch(&key, map, cnt,
+                    sizeof(TeddyCacheIdx), TeddyCacheIdxCmp);
+            if (found == NULL)
+                goto end;
+            idx[i] = found->idx;
+        }
+        if (DetectEngineCacheWriteArray(fp, idx,
+                    ctx->bucket_cnt[b] * sizeof(uint32_t)) < 0)
+            goto end;
+    }
+    r = 0;
+end:
+    if (map != NULL)
+        SCFree(map);
+    if (idx != NULL)
+        SCFree(idx);
+    return r;
+}
+
+/**
+ * \brief prepare a ctx with the tables of a rule cache record. The tables
+ *        of ac are used in place, in the mapping, the masks are copied
+ *        and the buckets rebuilt from the pattern indexes.
+ *
+ * \retval 0 ok, -1 the record is of other patterns or settings, the ctx
+ *         is left untouched
+ */
+static int TeddyCacheLoad(MpmCtx *mpm_ctx, uint8_t *data, uint32_t len) {
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+    AcPattern **bucket[TEDDY_BUCKETS];
+    AcCacheTables t;
+    uint32_t i, total = 0;
+    uint8_t search;
+    int b;
+
+    if (ctx == NULL)
+        return -1;
+    memset(bucket, 0, sizeof(bucket));
+
+    search = TeddyGetSearch(ctx);
+    if (AcCacheReadTables(&ctx->ac, &data, &len, search == TEDDY_SEARCH_AC, &t) < 0)
+        return -1;
+
+    TeddyCacheHeader *hdr = DetectEngineCacheReadArray(&data, &len, sizeof(TeddyCacheHeader));
+    if (hdr == NULL || hdr->search != search)
+        goto error;
+
+    if (search == TEDDY_SEARCH_AC) {
+        AcCacheLoadTables(&ctx->ac, &t);
+        ctx->search = search;
+        TeddySyncCtx(mpm_ctx);
+        return 0;
+    }
+
+    if (hdr->m == 0 || hdr->m != (ctx->ac.minlen < TEDDY_MAX_M ?
+                ctx->ac.minlen : TEDDY_MAX_M))
+        goto error;
+
+    uint8_t *lo = DetectEngineCacheReadArray(&data, &len, sizeof(ctx->lo));
+    uint8_t *hi = DetectEngineCacheReadArray(&data, &len, sizeof(ctx->hi));
+    if (lo == NULL || hi == NULL)
+        goto error;
+
+    for (b = 0; b < TEDDY_BUCKETS; b++) {
+        uint32_t *idx = DetectEngineCacheReadArray(&data, &len,
+                hdr->bucket_cnt[b] * sizeof(uint32_t));
+        if (idx == NULL)
+            goto error;
+
+        total += hdr->bucket_cnt[b];
+        if (hdr->bucket_cnt[b] == 0)
+            continue;
+
+        bucket[b] = SCMalloc(hdr->bucket_cnt[b] * sizeof(AcPattern *));
+        if (bucket[b] == NULL)
+            goto error;
+        for (i = 0; i < hdr->bucket_cnt[b]; i++) {
+            if (idx[i] >= ctx->ac.pattern_cnt)
+                goto error;
+            bucket[b][i] = t.parray[idx[i]];
+        }
+    }
+    if (total != ctx->ac.pattern_cnt)
+        goto error;
+
+    /* it's a match, from here on we set up the ctx */
+    AcCacheLoadTables(&ctx->ac, &t);
+
+    ctx->search = search;
+    ctx->m = hdr->m;
+    memcpy(ctx->lo, lo, sizeof(ctx->lo));
+    memcpy(ctx->hi, hi, sizeof(ctx->hi));
+
+    for (b = 0; b < TEDDY_BUCKETS; b++) {
+        ctx->bucket[b] = bucket[b];
+        ctx->bucket_cnt[b] = hdr->bucket_cnt[b];
+        if (bucket[b] == NULL)
+            continue;
+        ctx->memory_cnt++;
+        ctx->memory_size += ctx->bucket_cnt[b] * sizeof(AcPattern *);
+    }
+
+    TeddySyncCtx(mpm_ctx);
+    return 0;
+
+error:
+    for (b = 0; b < TEDDY_BUCKETS; b++) {
+        if (bucket[b] != NULL)
+            SCFree(bucket[b]);
+    }
+    AcCacheFreeTables(&t);
+    return -1;
+}
+
+/*
+ * TESTS
+ */
+
+#ifdef UNITTESTS
+/**
+ * \test the patterns found by every search teddy has on this cpu are
+ *       those b2g finds
+ *
+ * \param pats patterns, nocase if they start with '~'
+ */
+static int TeddyTestCompare(char **pats, int patcnt, uint8_t *buf, uint16_t buflen) {
+    uint8_t save_search;
+    uint32_t save_max;
+    PatternMatcherQueue b2g_pmq, pmq;
+    MpmThreadCtx mpm_thread_ctx;
+    MpmCtx b2g_ctx, mpm_ctx;
+    int result = 0, i;
+    uint8_t search;
+
+    memset(&b2g_ctx, 0, sizeof(b2g_ctx));
+    memset(&mpm_thread_ctx, 0, sizeof(mpm_thread_ctx));
+    PmqSetup(&b2g_pmq, 0, patcnt);
+    PmqSetup(&pmq, 0, patcnt);
+
+    MpmInitCtx(&b2g_ctx, MPM_B2G, -1);
+    for (i = 0; i < patcnt; i++) {
+        if (pats[i][0] == '~')
+            mpm_table[MPM_B2G].AddPatternNocase(&b2g_ctx, (uint8_t *)pats[i] + 1,
+                    strlen(pats[i]) - 1, 0, 0, i, 0, 0);
+        else
+            mpm_table[MPM_B2G].AddPattern(&b2g_ctx, (uint8_t *)pats[i],
+                    strlen(pats[i]), 0, 0, i, 0, 0);
+    }
+    mpm_table[MPM_B2G].Prepare(&b2g_ctx);
+    mpm_table[MPM_B2G].Search(&b2g_ctx, &mpm_thread_ctx, &b2g_pmq, buf, buflen);
+
+    if (teddy_max_patterns == 0)
+        TeddyGetConfig();
+    save_search = teddy_search;
+    save_max = teddy_max_patterns;
+    teddy_max_patterns = TEDDY_MAX_PATTERNS;
+
+    for (search = TEDDY_SEARCH_AC; search <= save_search; search++) {
+        teddy_search = search;
+
+        memset(&mpm_ctx, 0, sizeof(mpm_ctx));
+        PmqReset(&pmq);
+        MpmInitCtx(&mpm_ctx, MPM_TEDDY, -1);
+        for (i = 0; i < patcnt; i++) {
+            if (pats[i][0] == '~')
+                TeddyAddPatternCI(&mpm_ctx, (uint8_t *)pats[i] + 1,
+                        strlen(pats[i]) - 1, 0, 0, i, 0, 0);
+            else
+                TeddyAddPatternCS(&mpm_ctx, (uint8_t *)pats[i],
+                        strlen(pats[i]), 0, 0, i, 0, 0);
+        }
+        TeddyPreparePatterns(&mpm_ctx);
+        TeddySearch(&mpm_ctx, &mpm_thread_ctx, &pmq, buf, buflen);
+
+        if (pmq.pattern_id_array_cnt != b2g_pmq.pattern_id_array_cnt ||
+            memcmp(pmq.pattern_id_bitarray, b2g_pmq.pattern_id_bitarray,
+                   pmq.pattern_id_bitarray_size) != 0) {
+            printf("search %" PRIu8 ": %" PRIu32 " patterns, b2g %" PRIu32 ": ",
+                    search, pmq.pattern_id_array_cnt, b2g_pmq.pattern_id_array_cnt);
+            TeddyDestroyCtx(&mpm_ctx);
+            goto end;
+        }
+        TeddyDestroyCtx(&mpm_ctx);
+    }
+    result = 1;
+end:
+    teddy_search = save_search;
+    teddy_max_patterns = save_max;
+    mpm_table[MPM_B2G].DestroyCtx(&b2g_ctx);
+    PmqFree(&b2g_pmq);
+    PmqFree(&pmq);
+    return result;
+}
+
+static int TeddyTestSearch01 (void) {
+    char *pats[] = { "abcd" };
+    uint8_t *buf = (uint8_t *)"abcdefghjiklmnopqrstuvwxyz";
+    return TeddyTestCompare(pats, 1, buf, strlen((char *)buf));
+}
+
+/** \test case, and matches in the last bytes */
+static int TeddyTestSearch02 (void) {
+    char *pats[] = { "~ABCD", "wxyz", "WXY", "z", "~Z", "yz" };
+    uint8_t *buf = (uint8_t *)"abcdefghjiklmnopqrstuvwxyzabcdefghjiklmnopqrstuvwxyz";
+    return TeddyTestCompare(pats, 6, buf, strlen((char *)buf));
+}
+
+/** \test patterns that share their first bytes, and short buffers */
+static int TeddyTestSearch03 (void) {
+    char *pats[] = { "GET ", "GET /", "~get /index", "POST", "PUT", "HEAD",
+        "Host:", "~host: ", "Con", "~content-length" };
+    char *bufs[] = { "G", "GE", "GET", "GET /", "get /index.html HTTP/1.0",
+        "POST / HTTP/1.1\r\nHost: x\r\nContent-Length: 1\r\n\r\n" };
+    int i;
+
+    for (i = 0; i < 6; i++) {
+        if (TeddyTestCompare(pats, 10, (uint8_t *)bufs[i], strlen(bufs[i])) == 0)
+            return 0;
+    }
+    return 1;
+}
+
+/** \test more patterns than teddy takes: aho-corasick, on all bytes */
+static int TeddyTestSearch04 (void) {
+    char pat[TEDDY_MAX_PATTERNS * 2][8];
+    char *pats[TEDDY_MAX_PATTERNS * 2];
+    uint8_t buf[1024];
+    uint32_t seed = 1;
+    int i;
+
+    for (i = 0; i < TEDDY_MAX_PATTERNS * 2; i++) {
+        snprintf(pat[i], sizeof(pat[i]), "%s%02x%c", (i & 1) ? "~" : "",
+                i, 'A' + i % 26);
+        pats[i] = pat[i];
+    }
+    for (i = 0; i < (int)sizeof(buf); i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (i % 4 == 3) ? (uint8_t)('A' + (seed >> 16) % 26) :
+            (uint8_t)"0123456789abcdefABCDEF"[(seed >> 16) % 22];
+    }
+    for (i = 0; i < 64; i++)
+        buf[i] = (uint8_t)i;
+
+    return TeddyTestCompare(pats, TEDDY_MAX_PATTERNS * 2, buf, sizeof(buf)) &&
+           TeddyTestCompare(pats, 8, buf, sizeof(buf));
+}
+
+/** \brief compare a compiled ctx and one loaded from a rule cache */
+static int TeddyTestCacheCompare(MpmCtx *mpm_ctx, MpmCtx *cache_mpm_ctx) {
+    TeddyCtx *ctx = (TeddyCtx *)mpm_ctx->ctx;
+    TeddyCtx *cache_ctx = (TeddyCtx *)cache_mpm_ctx->ctx;
+    AcCtx *ac = (AcCtx *)ctx->ac.ctx;
+    AcCtx *cache_ac = (AcCtx *)cache_ctx->ac.ctx;
+    uint32_t i;
+    int b;
+
+    if (ctx->search != cache_ctx->search ||
+        mpm_ctx->memory_cnt != cache_mpm_ctx->memory_cnt)
+        return 0;
+
+    for (i = 0; i < ctx->ac.pattern_cnt; i++) {
+        if (ac->parray[i]->id != cache_ac->parray[i]->id)
+            return 0;
+    }
+
+    if (ctx->search == TEDDY_SEARCH_AC) {
+        return cache_ac->mapped && ac->state_cnt == cache_ac->state_cnt &&
+            ac->out_cnt == cache_ac->out_cnt &&
+            memcmp(ac->out_idx, cache_ac->out_idx,
+                   (ac->state_cnt + 1) * sizeof(uint32_t)) == 0;
+    }
+
+    if (ctx->m != cache_ctx->m ||
+        memcmp(ctx->lo, cache_ctx->lo, sizeof(ctx->lo)) != 0 ||
+        memcmp(ctx->hi, cache_ctx->hi, sizeof(ctx->hi)) != 0)
+        return 0;
+
+    for (b = 0; b < TEDDY_BUCKETS; b++) {
+        if (ctx->bucket_cnt[b] != cache_ctx->bucket_cnt[b])
+            return 0;
+        for (i = 0; i < ctx->bucket_cnt[b]; i++) {
+            if (ctx->bucket[b][i]->id != cache_ctx->bucket[b][i]->id)
+                return 0;
+        }
+    }
+    return 1;
+}
+
+/** \test a ctx loaded from a rule cache has the tables of a compiled one
+ *        and finds the same, for every search teddy has on this cpu */
+static int TeddyTestCache01 (void) {
+    char *pats[] = { "abcd", "~BCDE", "xyz", "efg", "~Fghij", "abce" };
+    uint8_t *buf = (uint8_t *)"abcdefghijxyzABCEbcdE";
+    uint8_t save_search, search;
+    int result = 1;
+
+    if (teddy_max_patterns == 0)
+        TeddyGetConfig();
+    save_search = teddy_search;
+
+    for (search = TEDDY_SEARCH_AC; search <= save_search; search++) {
+        teddy_search = search;
+        if (DetectEngineCacheTestCompare(MPM_TEDDY, pats, 6, buf,
+                    strlen((char *)buf), TeddyTestCacheCompare) == 0) {
+            printf("search %" PRIu8 ": ", search);
+            result = 0;
+            break;
+        }
+    }
+
+    teddy_search = save_search;
+    return result;
+}
+#endif /* UNITTESTS */
+
+void TeddyRegisterTests(void) {
+#ifdef UNITTESTS
+    UtRegisterTest("TeddyTestSearch01", TeddyTestSearch01, 1);
+    UtRegisterTest("TeddyTestSearch02", TeddyTestSearch02, 1);
+    UtRegisterTest("TeddyTestSearch03", TeddyTestSearch03, 1);
+    UtRegisterTest("TeddyTestSearch04", TeddyTestSearch04, 1);
+    UtRegisterTest("TeddyTestCache01", TeddyTestCache01, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,70 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ */
+
+#ifndef __UTIL_MPM_TEDDY_H__
+#define __UTIL_MPM_TEDDY_H__
+
+#include "util-mpm.h"
+#include "util-mpm-ac.h"
+
+/* the SIMD search needs pshufb and a compiler that can build it for
+ * other targets than the one we're built for */
+#if defined(__GNUC__) && (defined(__x86_64) || defined(__i386)) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define TEDDY_SIMD
+#endif
+
+#define TEDDY_BUCKETS           8
+/** bytes of the patterns in the masks */
+#define TEDDY_MAX_M             3
+/** default for pattern-matcher.teddy.max-patterns */
+#define TEDDY_MAX_PATTERNS      64
+
+enum {
+    TEDDY_SEARCH_AC = 0,
+    TEDDY_SEARCH_SSSE3,
+    TEDDY_SEARCH_AVX2,
+};
+
+typedef struct TeddyCtx_ {
+    /** holds the patterns, and searches when there are too many of them
+     *  or the cpu can't do our SIMD search */
+    MpmCtx ac;
+
+    uint8_t search;             /**< TEDDY_SEARCH_* */
+    uint8_t m;                  /**< pattern bytes in the masks */
+
+    /** per pattern byte the buckets with a pattern that has a byte with
+     *  that low resp. high nibble there */
+    uint8_t lo[TEDDY_MAX_M][16];
+    uint8_t hi[TEDDY_MAX_M][16];
+
+    AcPattern **bucket[TEDDY_BUCKETS];
+    uint16_t bucket_cnt[TEDDY_BUCKETS];
+
+    /* our memory, the MpmCtx has ours and that of ac */
+    uint32_t memory_cnt;
+    uint32_t memory_size;
+} TeddyCtx;
+
+void MpmTeddyRegister(void);
+
+#endif /* __UTIL_MPM_TEDDY_H__ */
@@ -42,6 +42,7 @@
 
 #include "util-unittest.h"
 #include "util-debug.h"
+#include "detect-engine-cache.h"
 
 #define INIT_HASH_SIZE 65535
 
@@ -66,6 +67,9 @@ void WmThreadDestroyCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx);
 int WmAddPatternCI(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t, uint32_t, uint32_t, uint8_t);
 int WmAddPatternCS(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t, uint32_t, uint32_t, uint8_t);
 int WmPreparePatterns(MpmCtx *mpm_ctx);
+static uint64_t WmCacheKey(MpmCtx *);
+static int WmCacheWrite(MpmCtx *, FILE *);
+static int WmCacheLoad(MpmCtx *, uint8_t *, uint32_t);
 uint32_t WmSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx, PatternMatcherQueue *, uint8_t *buf, uint16_t buflen);
 uint32_t WmSearch1(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx, PatternMatcherQueue *, uint8_t *buf, uint16_t buflen);
 uint32_t WmSearch2Hash9(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx, PatternMatcherQueue *, uint8_t *buf, uint16_t buflen);
@@ -99,6 +103,9 @@ void MpmWuManberRegister (void) {
     mpm_table[MPM_WUMANBER].AddPattern = WmAddPatternCS;
     mpm_table[MPM_WUMANBER].AddPatternNocase = WmAddPatternCI;
     mpm_table[MPM_WUMANBER].Prepare = WmPreparePatterns;
+    mpm_table[MPM_WUMANBER].CacheKey = WmCacheKey;
+    mpm_table[MPM_WUMANBER].CacheWrite = WmCacheWrite;
+    mpm_table[MPM_WUMANBER].CacheLoad = WmCacheLoad;
     mpm_table[MPM_WUMANBER].Search = WmSearch;
     mpm_table[MPM_WUMANBER].Cleanup = NULL;
     mpm_table[MPM_WUMANBER].PrintCtx = WmPrintInfo;
@@ -515,11 +522,18 @@ static void WmSearchPrepareHash(MpmCtx *mpm_ctx) {
             }
         }
     }
+    return;
+error:
+    return;
+}
+
+static void WmSearchPrepareBloom(MpmCtx *mpm_ctx) {
+    WmCtx *ctx = (WmCtx *)mpm_ctx->ctx;
 
     /* alloc the bloom array */
     ctx->bloom = (BloomFilter **)SCMalloc(sizeof(BloomFilter *) * ctx->hash_size);
     if (ctx->bloom == NULL)
-        goto error;
+        return;
     memset(ctx->bloom, 0, sizeof(BloomFilter *) * ctx->hash_size);
 
     mpm_ctx->memory_cnt++;
@@ -547,10 +561,16 @@ static void WmSearchPrepareHash(MpmCtx *mpm_ctx) {
             thi = thi->nxt;
         } while (thi != NULL);
     }
-    return;
-error:
-    return;
 }
+
+/** \brief the shift length: the smallest pattern size, within bounds */
+static uint16_t WmGetShiftLen(MpmCtx *mpm_ctx) {
+    uint16_t smallest = mpm_ctx->minlen;
+    if (smallest > 255) smallest = 255;
+    if (smallest < 2) smallest = 2;
+    return smallest;
+}
+
 static void WmSearchPrepareShiftTable(MpmCtx *mpm_ctx)
 {
     WmCtx *ctx = (WmCtx *)mpm_ctx->ctx;
@@ -558,11 +578,7 @@ static void WmSearchPrepareShiftTable(MpmCtx *mpm_ctx)
     uint16_t shift = 0, k = 0, idx = 0;
     uint32_t i = 0;
 
-    uint16_t smallest = mpm_ctx->minlen;
-    if (smallest > 255) smallest = 255;
-    if (smallest < 2) smallest = 2;
-
-    ctx->shiftlen = smallest;
+    ctx->shiftlen = WmGetShiftLen(mpm_ctx);
 
     ctx->shifttable = SCMalloc(sizeof(uint16_t) * ctx->hash_size);
     if (ctx->shifttable == NULL)
@@ -638,7 +654,8 @@ static void WmSearchPrepareShiftTable(MpmCtx *mpm_ctx)
     }
 }
 
-int WmPreparePatterns(MpmCtx *mpm_ctx) {
+/** \brief move the patterns from the init hash to the pattern array */
+static int WmPreparePatternArray(MpmCtx *mpm_ctx) {
     WmCtx *ctx = (WmCtx *)mpm_ctx->ctx;
 
     /* alloc the pattern array */
@@ -667,27 +684,33 @@ int WmPreparePatterns(MpmCtx *mpm_ctx) {
     /* we no longer need the hash, so free it's memory */
     SCFree(ctx->init_hash);
     ctx->init_hash = NULL;
+    return 0;
+error:
+    return -1;
+}
 
+/** \brief hash size for the number of patterns we have */
+static uint32_t WmGetHashSize(MpmCtx *mpm_ctx) {
     /* TODO VJ these values are chosen pretty much randomly, so
      * we should do some performance testing
      * */
 
-    if (ctx->hash_size == 0) {
-        if (mpm_ctx->pattern_cnt < 50) {
-            ctx->hash_size = HASH9_SIZE;
-        } else if(mpm_ctx->pattern_cnt < 300) {
-            ctx->hash_size = HASH12_SIZE;
-        } else if(mpm_ctx->pattern_cnt < 1200) {
-            ctx->hash_size = HASH14_SIZE;
-        } else if(mpm_ctx->pattern_cnt < 2400) {
-            ctx->hash_size = HASH15_SIZE;
-        } else {
-            ctx->hash_size = HASH16_SIZE;
-        }
+    if (mpm_ctx->pattern_cnt < 50) {
+        return HASH9_SIZE;
+    } else if(mpm_ctx->pattern_cnt < 300) {
+        return HASH12_SIZE;
+    } else if(mpm_ctx->pattern_cnt < 1200) {
+        return HASH14_SIZE;
+    } else if(mpm_ctx->pattern_cnt < 2400) {
+        return HASH15_SIZE;
+    } else {
+        return HASH16_SIZE;
     }
+}
 
-    WmSearchPrepareShiftTable(mpm_ctx);
-    WmSearchPrepareHash(mpm_ctx);
+/** \brief pick the search functions for the hash size and patterns */
+static void WmPrepareSearch(MpmCtx *mpm_ctx) {
+    WmCtx *ctx = (WmCtx *)mpm_ctx->ctx;
 
     if (ctx->hash_size == HASH9_SIZE) {
         ctx->MBSearch = WmSearch2Hash9;
@@ -709,9 +732,227 @@ int WmPreparePatterns(MpmCtx *mpm_ctx) {
     if (mpm_ctx->minlen == 1) {
         ctx->Search = WmSearch1;
     }
+}
+
+int WmPreparePatterns(MpmCtx *mpm_ctx) {
+    WmCtx *ctx = (WmCtx *)mpm_ctx->ctx;
+
+    if (WmPreparePatternArray(mpm_ctx) < 0)
+        return -1;
+
+    if (ctx->hash_size == 0)
+        ctx->hash_size = WmGetHashSize(mpm_ctx);
+
+    WmSearchPrepareShiftTable(mpm_ctx);
+    WmSearchPrepareHash(mpm_ctx);
+    WmSearchPrepareBloom(mpm_ctx);
+    WmPrepareSearch(mpm_ctx);
+    return 0;
+}
+
+/** \brief the start of a rule cache record of a ctx. It's followed by
+ *         the patterns in pattern array order, the shift table, pminlen
+ *         and the bloom filter bit array of every used bucket. */
+typedef struct WmCacheHeader_ {
+    uint32_t pattern_cnt;
+    uint32_t hash_size;
+    uint32_t bloom_size;
+    uint32_t bloom_cnt;     /**< buckets with a bloom filter */
+    uint16_t shiftlen;
+    uint16_t pad0;
+    uint32_t pad1;
+} WmCacheHeader;
+
+/** \brief key of the patterns of a ctx for the rule cache, compiled or not */
+static uint64_t WmCacheKey(MpmCtx *mpm_ctx) {
+    WmCtx *ctx = (WmCtx *)mpm_ctx->ctx;
+    DetectEngineCacheKeyCtx kctx;
+    WmPattern *p;
+    uint32_t i;
+
+    DetectEngineCacheKeyInit(&kctx);
+    if (ctx->parray != NULL) {
+        for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+            p = ctx->parray[i];
+            DetectEngineCacheKeyAdd(&kctx, p->cs, p->len, p->flags, p->id);
+        }
+    } else if (ctx->init_hash != NULL) {
+        for (i = 0; i < INIT_HASH_SIZE; i++) {
+            for (p = ctx->init_hash[i]; p != NULL; p = p->next) {
+                DetectEngineCacheKeyAdd(&kctx, p->cs, p->len, p->flags, p->id);
+            }
+        }
+    }
+
+    /* the hash size follows from the pattern count */
+    uint32_t settings[] = { wm_bloom_size };
+    return DetectEngineCacheKeyFinal(&kctx, MPM_WUMANBER, settings,
+            sizeof(settings) / sizeof(settings[0]));
+}
+
+/**
+ * \brief write the tables of a prepared ctx to a rule cache record
+ *
+ * \retval 0 ok, -1 the ctx isn't (fully) prepared or the write failed
+ */
+static int WmCacheWrite(MpmCtx *mpm_ctx, FILE *fp) {
+    WmCtx *ctx = (WmCtx *)mpm_ctx->ctx;
+    WmCacheHeader hdr;
+    uint32_t i, h;
+
+    if (ctx == NULL || ctx->parray == NULL || ctx->hash == NULL ||
+        ctx->bloom == NULL || ctx->pminlen == NULL || ctx->shifttable == NULL)
+        return -1;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.pattern_cnt = mpm_ctx->pattern_cnt;
+    hdr.hash_size = ctx->hash_size;
+    hdr.bloom_size = wm_bloom_size;
+    hdr.shiftlen = ctx->shiftlen;
+
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (ctx->hash[h] == NULL)
+            continue;
+        if (ctx->bloom[h] == NULL)
+            return -1;
+        hdr.bloom_cnt++;
+    }
+
+    if (DetectEngineCacheWriteArray(fp, &hdr, sizeof(hdr)) < 0)
+        return -1;
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        WmPattern *p = ctx->parray[i];
+        if (DetectEngineCacheWritePattern(fp, p->cs, p->len, p->flags, p->id) < 0)
+            return -1;
+    }
+    if (DetectEngineCacheWriteArray(fp, ctx->shifttable, sizeof(uint16_t) * ctx->hash_size) < 0 ||
+        DetectEngineCacheWriteArray(fp, ctx->pminlen, ctx->hash_size) < 0)
+        return -1;
+
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (ctx->hash[h] == NULL)
+            continue;
+        if (DetectEngineCacheWriteArray(fp, ctx->bloom[h]->bitarray,
+                    (wm_bloom_size / 8) + 1) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief prepare a ctx with the tables of a rule cache record. The shift
+ *        table and the bloom filter bit arrays are used in place, in the
+ *        mapping, the hash lists are rebuilt from the pattern array.
+ *
+ * \retval 0 ok, -1 the record is of other patterns or settings, the ctx
+ *         is left untouched
+ */
+static int WmCacheLoad(MpmCtx *mpm_ctx, uint8_t *data, uint32_t len) {
+    WmCtx *ctx = (WmCtx *)mpm_ctx->ctx;
+    WmPattern **parray = NULL;
+    uint32_t bloom_len = (wm_bloom_size / 8) + 1;
+    uint32_t i, h, bloom_cnt = 0;
+
+    if (ctx == NULL || ctx->init_hash == NULL || ctx->hash_size != 0 ||
+        mpm_ctx->pattern_cnt == 0)
+        return -1;
+
+    WmCacheHeader *hdr = DetectEngineCacheReadArray(&data, &len, sizeof(WmCacheHeader));
+    if (hdr == NULL ||
+        hdr->pattern_cnt != mpm_ctx->pattern_cnt ||
+        hdr->hash_size != WmGetHashSize(mpm_ctx) ||
+        hdr->bloom_size != wm_bloom_size ||
+        hdr->shiftlen != WmGetShiftLen(mpm_ctx))
+        return -1;
+
+    parray = SCMalloc(mpm_ctx->pattern_cnt * sizeof(WmPattern *));
+    if (parray == NULL)
+        return -1;
+
+    /* the patterns of the record in its order, all must be ours */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        DetectEngineCachePattern *pat = DetectEngineCacheReadPattern(&data, &len);
+        if (pat == NULL)
+            goto error;
+
+        WmPattern *p = WmInitHashLookup(ctx, DETECT_ENGINE_CACHE_PATTERN(pat),
+                pat->len, pat->flags);
+        if (p == NULL || p->id != pat->id)
+            goto error;
+        parray[i] = p;
+    }
+
+    uint16_t *shifttable = DetectEngineCacheReadArray(&data, &len,
+            sizeof(uint16_t) * hdr->hash_size);
+    uint8_t *pminlen = DetectEngineCacheReadArray(&data, &len, hdr->hash_size);
+    if (shifttable == NULL || pminlen == NULL ||
+        (uint64_t)hdr->bloom_cnt * DETECT_ENGINE_CACHE_ALIGN(bloom_len) > len)
+        goto error;
+
+    /* it's a match, from here on we set up the ctx */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        parray[i]->next = NULL;
+    }
+    SCFree(ctx->init_hash);
+    ctx->init_hash = NULL;
+
+    ctx->parray = parray;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (mpm_ctx->pattern_cnt * sizeof(WmPattern *));
+
+    ctx->hash_size = hdr->hash_size;
+    ctx->shiftlen = hdr->shiftlen;
+    WmSearchPrepareHash(mpm_ctx);
+    if (ctx->hash == NULL || ctx->pminlen == NULL)
+        return 0;
+
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (ctx->hash[h] != NULL)
+            bloom_cnt++;
+    }
+    /* same patterns so this can't really happen, but if it does we
+     * are past the point of no return: build the tables after all */
+    if (bloom_cnt != hdr->bloom_cnt) {
+        WmSearchPrepareShiftTable(mpm_ctx);
+        WmSearchPrepareBloom(mpm_ctx);
+        WmPrepareSearch(mpm_ctx);
+        return 0;
+    }
+
+    ctx->shifttable = shifttable;
+    ctx->mapped = 1;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (sizeof(uint16_t) * ctx->hash_size);
+
+    /* capped at 8 for the bloom filter */
+    memcpy(ctx->pminlen, pminlen, ctx->hash_size);
+
+    ctx->bloom = (BloomFilter **)SCMalloc(sizeof(BloomFilter *) * ctx->hash_size);
+    if (ctx->bloom == NULL)
+        return 0;
+    memset(ctx->bloom, 0, sizeof(BloomFilter *) * ctx->hash_size);
+
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (sizeof(BloomFilter *) * ctx->hash_size);
+
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (ctx->hash[h] == NULL)
+            continue;
+
+        uint8_t *bits = DetectEngineCacheReadArray(&data, &len, bloom_len);
+        ctx->bloom[h] = BloomFilterInitMapped(bits, wm_bloom_size, 2, WmBloomHash);
+        if (ctx->bloom[h] == NULL)
+            continue;
+
+        mpm_ctx->memory_cnt += BloomFilterMemoryCnt(ctx->bloom[h]);
+        mpm_ctx->memory_size += BloomFilterMemorySize(ctx->bloom[h]);
+    }
 
+    WmPrepareSearch(mpm_ctx);
     return 0;
+
 error:
+    SCFree(parray);
     return -1;
 }
 
@@ -1412,7 +1653,8 @@ void WmDestroyCtx(MpmCtx *mpm_ctx) {
     }
 
     if (ctx->shifttable) {
-        SCFree(ctx->shifttable);
+        if (!ctx->mapped)
+            SCFree(ctx->shifttable);
         mpm_ctx->memory_cnt--;
         mpm_ctx->memory_size -= (sizeof(uint16_t) * ctx->hash_size);
     }
@@ -2973,6 +3215,73 @@ static int WmTestSearch22Hash16 (void) {
     WmDestroyCtx(&mpm_ctx);
     return result;
 }
+
+static int WmTestCacheCompareHash(WmHashItem *hi, WmHashItem *chi) {
+    for ( ; hi != NULL && chi != NULL; hi = hi->nxt, chi = chi->nxt) {
+        if (hi->idx != chi->idx || hi->flags != chi->flags)
+            return 0;
+    }
+    return (hi == chi);
+}
+
+/** \brief compare a compiled ctx and one loaded from a rule cache */
+static int WmTestCacheCompare(MpmCtx *mpm_ctx, MpmCtx *cache_mpm_ctx) {
+    WmCtx *ctx = (WmCtx *)mpm_ctx->ctx;
+    WmCtx *cache_ctx = (WmCtx *)cache_mpm_ctx->ctx;
+    uint32_t i, h;
+
+    if (!cache_ctx->mapped || ctx->shiftlen != cache_ctx->shiftlen ||
+        ctx->hash_size != cache_ctx->hash_size ||
+        ctx->Search != cache_ctx->Search ||
+        ctx->MBSearch != cache_ctx->MBSearch)
+        return 0;
+
+    if (memcmp(ctx->shifttable, cache_ctx->shifttable, sizeof(uint16_t) * ctx->hash_size) != 0 ||
+        memcmp(ctx->pminlen, cache_ctx->pminlen, ctx->hash_size) != 0)
+        return 0;
+
+    /* same pattern array order, whatever order the patterns came in */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        if (ctx->parray[i]->id != cache_ctx->parray[i]->id)
+            return 0;
+    }
+
+    for (i = 0; i < 256; i++) {
+        if (WmTestCacheCompareHash(&ctx->hash1[i], &cache_ctx->hash1[i]) == 0)
+            return 0;
+    }
+
+    for (h = 0; h < ctx->hash_size; h++) {
+        if (WmTestCacheCompareHash(ctx->hash[h], cache_ctx->hash[h]) == 0)
+            return 0;
+        if ((ctx->bloom[h] == NULL) != (cache_ctx->bloom[h] == NULL))
+            return 0;
+        if (ctx->bloom[h] != NULL &&
+            memcmp(ctx->bloom[h]->bitarray, cache_ctx->bloom[h]->bitarray,
+                   (wm_bloom_size / 8) + 1) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+/** \test a ctx loaded from a rule cache has the tables of a compiled one
+ *        and finds the same */
+static int WmTestCache01 (void) {
+    char *pats[] = { "abcd", "~BCDE", "xy", "e", "~Fghij", "abce" };
+    uint8_t *buf = (uint8_t *)"abcdefghijxyzABCEbcdE";
+
+    return DetectEngineCacheTestCompare(MPM_WUMANBER, pats, 6, buf,
+            strlen((char *)buf), WmTestCacheCompare);
+}
+
+/** \test the same for a ctx without one byte patterns */
+static int WmTestCache02 (void) {
+    char *pats[] = { "abcd", "~BCDE", "xyz", "~Fghij", "abce" };
+    uint8_t *buf = (uint8_t *)"abcdefghijxyzABCEbcdE";
+
+    return DetectEngineCacheTestCompare(MPM_WUMANBER, pats, 5, buf,
+            strlen((char *)buf), WmTestCacheCompare);
+}
 #endif /* UNITTESTS */
 
 void WmRegisterTests(void) {
@@ -3052,6 +3361,8 @@ void WmRegisterTests(void) {
     UtRegisterTest("WmTestSearch22Hash14", WmTestSearch22Hash14, 1);
     UtRegisterTest("WmTestSearch22Hash15", WmTestSearch22Hash15, 1);
     UtRegisterTest("WmTestSearch22Hash16", WmTestSearch22Hash16, 1);
+    UtRegisterTest("WmTestCache01", WmTestCache01, 1);
+    UtRegisterTest("WmTestCache02", WmTestCache02, 1);
 #endif /* UNITTESTS */
 }
 
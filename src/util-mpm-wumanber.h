@@ -70,6 +70,8 @@ typedef struct WmCtx_ {
 
     /* only used for multibyte pattern search */
     uint16_t *shifttable;
+    /** shifttable points into a mapped rule cache file, see WmCacheLoad() */
+    uint8_t mapped;
 } WmCtx;
 
 typedef struct WmThreadCtx_ {
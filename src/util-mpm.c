@@ -31,6 +31,8 @@
 #include "util-mpm-wumanber.h"
 #include "util-mpm-b2g.h"
 #include "util-mpm-b3g.h"
+#include "util-mpm-teddy.h"
+#include "util-mpm-ac.h"
 #include "util-hashlist.h"
 
 /**
@@ -114,6 +116,42 @@ MpmVerifyMatch(MpmThreadCtx *thread_ctx, PatternMatcherQueue *pmq, uint32_t pati
     SCReturnInt(1);
 }
 
+/**
+ *  \brief search a number of buffers against the same mpm ctx
+ *
+ *  Short buffers spend most of a search in the call and in waiting for
+ *  the tables to come in from memory. Mpm's with a SearchBatch walk the
+ *  buffers side by side, so the table lookups of one overlap with those
+ *  of the others. The others search one buffer after the other.
+ *
+ *  \param pmqs pmq per buffer
+ *  \param bufs the buffers
+ *  \param buflens length per buffer
+ *  \param cnts out: the matches per buffer
+ *  \param cnt number of buffers
+ *
+ *  \retval cnt the matches of all buffers together
+ */
+uint32_t MpmSearchBatch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+        PatternMatcherQueue **pmqs, uint8_t **bufs, uint16_t *buflens,
+        uint32_t *cnts, uint16_t cnt)
+{
+    uint32_t ret = 0;
+    uint16_t i;
+
+    if (mpm_table[mpm_ctx->mpm_type].SearchBatch != NULL) {
+        return mpm_table[mpm_ctx->mpm_type].SearchBatch(mpm_ctx,
+                mpm_thread_ctx, pmqs, bufs, buflens, cnts, cnt);
+    }
+
+    for (i = 0; i < cnt; i++) {
+        cnts[i] = mpm_table[mpm_ctx->mpm_type].Search(mpm_ctx,
+                mpm_thread_ctx, pmqs[i], bufs[i], buflens[i]);
+        ret += cnts[i];
+    }
+    return ret;
+}
+
 /**
  *  \brief Merge two pmq's bitarrays
  *
@@ -212,6 +250,8 @@ void MpmTableSetup(void) {
     MpmWuManberRegister();
     MpmB2gRegister();
     MpmB3gRegister();
+    MpmTeddyRegister();
+    MpmAcRegister();
 }
 
 /** \brief  Function to return the default hash size for the mpm algorithm,
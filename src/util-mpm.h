@@ -56,6 +56,8 @@ enum {
     MPM_WUMANBER,
     MPM_B2G,
     MPM_B3G,
+    MPM_TEDDY,
+    MPM_AC,
 
     /* table size */
     MPM_TABLE_SIZE,
@@ -111,6 +113,9 @@ typedef struct MpmCtx_ {
 /** one byte pattern (used in b2g) */
 #define MPM_PATTERN_ONE_BYTE        0x10
 
+/** buffers MpmSearchBatch() searches together at most */
+#define MPM_BATCH_SIZE              8
+
 typedef struct MpmTableElmt_ {
     char *name;
     uint8_t max_pattern_length;
@@ -132,8 +137,29 @@ typedef struct MpmTableElmt_ {
      */
     int  (*AddPattern)(struct MpmCtx_ *, uint8_t *, uint16_t, uint16_t, uint16_t, uint32_t, uint32_t, uint8_t);
     int  (*AddPatternNocase)(struct MpmCtx_ *, uint8_t *, uint16_t, uint16_t, uint16_t, uint32_t, uint32_t, uint8_t);
+    /** compile the patterns added to the ctx.
+     *
+     *  PatternMatchPrepareRun() calls it for several ctxs at once from
+     *  the detect-engine.build-threads threads, so it may only change the
+     *  ctx it gets and globals set up before the group build (InitCtx,
+     *  the Register function). Nothing it computes may depend on other
+     *  ctxs or the order they are compiled in. */
     int  (*Prepare)(struct MpmCtx_ *);
+    /** optional, the rule cache (detect-engine-cache.c). CacheKey
+     *  returns the key of the pattern set and the settings of a ctx,
+     *  before or after Prepare, see DetectEngineCacheKeyFinal(). */
+    uint64_t (*CacheKey)(struct MpmCtx_ *);
+    /** write the tables Prepare built to a rule cache record */
+    int  (*CacheWrite)(struct MpmCtx_ *, FILE *);
+    /** instead of Prepare, set up the ctx from a rule cache record in
+     *  the mapped file. Returns -1 without touching the ctx if the record
+     *  is not of its patterns. Same rules as for Prepare. */
+    int  (*CacheLoad)(struct MpmCtx_ *, uint8_t *, uint32_t);
     uint32_t (*Search)(struct MpmCtx_ *, struct MpmThreadCtx_ *, PatternMatcherQueue *, uint8_t *, uint16_t);
+    /** optional: search a number of buffers in one pass, the matches of
+     *  buffer i go into pmq i and their count into cnts[i], see
+     *  MpmSearchBatch() */
+    uint32_t (*SearchBatch)(struct MpmCtx_ *, struct MpmThreadCtx_ *, PatternMatcherQueue **, uint8_t **, uint16_t *, uint32_t *, uint16_t);
     void (*Cleanup)(struct MpmThreadCtx_ *);
     void (*PrintCtx)(struct MpmCtx_ *);
     void (*PrintThreadCtx)(struct MpmThreadCtx_ *);
@@ -156,6 +182,7 @@ void MpmRegisterTests(void);
 int32_t MpmMatcherGetMaxPatternLength(uint16_t);
 
 int MpmVerifyMatch(MpmThreadCtx *, PatternMatcherQueue *, uint32_t);
+uint32_t MpmSearchBatch(MpmCtx *, MpmThreadCtx *, PatternMatcherQueue **, uint8_t **, uint16_t *, uint32_t *, uint16_t);
 void MpmInitCtx (MpmCtx *mpm_ctx, uint16_t matcher, int module_handle);
 void MpmInitThreadCtx(MpmThreadCtx *mpm_thread_ctx, uint16_t, uint32_t);
 uint32_t MpmGetHashSize(const char *);
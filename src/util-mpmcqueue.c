@@ -0,0 +1,616 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Bounded lock free queue for multiple producers and multiple consumers.
+ *
+ * The queue is an array of a power of 2 slots. Each slot has a sequence
+ * number that says whose turn it is: a slot at position pos can be put to
+ * when its seq is pos, and taken from when its seq is pos + 1. After a get
+ * the seq moves on to pos + size, the position the slot has the next time
+ * around. Producers claim a position by a CAS on head, consumers by a CAS
+ * on tail. Neither side ever waits for a thread of the other side that
+ * is half way, and there is no lock to get preempted with.
+ *
+ * A thread that finds the queue full or empty spins for a little while.
+ * If that doesn't help it sleeps on a futex (a mutex and condition where
+ * we have no futexes) until the other side makes progress. The wait
+ * protocol is described at MpmcQueueWait; unlike the condition in
+ * util-ringbuffer.c it doesn't lose wake ups, so no thread has to poll.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+#include "util-mpmcqueue.h"
+#include "util-unittest.h"
+#include "util-debug.h"
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+#if defined(__i386__) || defined(__x86_64__)
+#define MpmcQueueRelax() __asm__ __volatile__("pause" ::: "memory")
+#else
+#define MpmcQueueRelax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+/**
+ *  \brief Create a queue.
+ *
+ *  \param size number of slots, rounded up to a power of 2
+ *
+ *  \retval q the queue or NULL on error
+ */
+MpmcQueue *MpmcQueueInit(uint32_t size) {
+    uint32_t i;
+
+    if (size < 2)
+        size = 2;
+    if (size > 0x80000000) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "queue size %" PRIu32 " too big",
+                size);
+        return NULL;
+    }
+    for (i = 2; i < size; i <<= 1)
+        ;
+    size = i;
+
+    MpmcQueue *q = SCMalloc(sizeof(MpmcQueue));
+    if (q == NULL)
+        return NULL;
+    memset(q, 0x00, sizeof(MpmcQueue));
+
+    q->cells = SCMalloc(size * sizeof(MpmcQueueCell));
+    if (q->cells == NULL) {
+        SCFree(q);
+        return NULL;
+    }
+    for (i = 0; i < size; i++) {
+        q->cells[i].seq = i;
+        q->cells[i].data = NULL;
+    }
+    q->size = size;
+    q->mask = size - 1;
+
+#ifndef __linux__
+    SCMutexInit(&q->not_empty.m, NULL);
+    SCCondInit(&q->not_empty.cond, NULL);
+    SCMutexInit(&q->not_full.m, NULL);
+    SCCondInit(&q->not_full.cond, NULL);
+#endif /* __linux__ */
+    return q;
+}
+
+void MpmcQueueDestroy(MpmcQueue *q) {
+    if (q == NULL)
+        return;
+
+#ifndef __linux__
+    SCMutexDestroy(&q->not_empty.m);
+    SCCondDestroy(&q->not_empty.cond);
+    SCMutexDestroy(&q->not_full.m);
+    SCCondDestroy(&q->not_full.cond);
+#endif /* __linux__ */
+    SCFree(q->cells);
+    SCFree(q);
+}
+
+/**
+ *  \brief Wake the threads sleeping on w, if any.
+ *
+ *  The barrier orders our change of the queue before the read of
+ *  waiters. A thread going to sleep announces itself before it checks
+ *  the queue, so either it sees our change or we see it.
+ *
+ *  \param all wake all of them, not just one
+ */
+static inline void MpmcQueueWake(MpmcQueueWait *w, int all) {
+    __sync_synchronize();
+    if (w->waiters == 0)
+        return;
+
+    __sync_fetch_and_add(&w->seq, 1);
+#ifdef __linux__
+    syscall(SYS_futex, &w->seq, FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1,
+            NULL, NULL, 0);
+#else
+    SCMutexLock(&w->m);
+    if (all)
+        SCCondBroadcast(&w->cond);
+    else
+        SCCondSignal(&w->cond);
+    SCMutexUnlock(&w->m);
+#endif /* __linux__ */
+}
+
+/**
+ *  \brief Sleep on w for as long as its seq is still seq.
+ *
+ *  \param usec give up after this many microseconds, 0 for never
+ */
+static inline void MpmcQueueSleep(MpmcQueueWait *w, uint32_t seq, uint32_t usec) {
+#ifdef __linux__
+    struct timespec ts;
+
+    ts.tv_sec = usec / 1000000;
+    ts.tv_nsec = (usec % 1000000) * 1000;
+    syscall(SYS_futex, &w->seq, FUTEX_WAIT_PRIVATE, seq, usec ? &ts : NULL,
+            NULL, 0);
+#else
+    struct timeval tv;
+    struct timespec ts;
+
+    if (usec) {
+        gettimeofday(&tv, NULL);
+        tv.tv_usec += usec;
+        ts.tv_sec = tv.tv_sec + tv.tv_usec / 1000000;
+        ts.tv_nsec = (tv.tv_usec % 1000000) * 1000;
+    }
+
+    SCMutexLock(&w->m);
+    while (w->seq == seq) {
+        if (usec == 0) {
+            SCCondWait(&w->cond, &w->m);
+        } else if (SCCondTimedwait(&w->cond, &w->m, &ts) == ETIMEDOUT) {
+            break;
+        }
+    }
+    SCMutexUnlock(&w->m);
+#endif /* __linux__ */
+}
+
+/**
+ *  \brief Tell the queue to shut down: threads waiting in it return
+ *         and won't wait again.
+ */
+void MpmcQueueShutdown(MpmcQueue *q) {
+    q->shutdown = 1;
+    MpmcQueueWake(&q->not_empty, 1);
+    MpmcQueueWake(&q->not_full, 1);
+}
+
+/**
+ *  \brief Put a ptr in the queue, don't wait if it is full.
+ *
+ *  \retval 0 ok
+ *  \retval -1 queue is full
+ */
+int MpmcQueueTryPut(MpmcQueue *q, void *ptr) {
+    MpmcQueueCell *cell;
+    uint32_t pos = q->head;
+    int32_t diff;
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        diff = (int32_t)(cell->seq - pos);
+        if (diff == 0) {
+            if (__sync_bool_compare_and_swap(&q->head, pos, pos + 1))
+                break;
+        } else if (diff < 0) {
+            /* the slot still has the item of the previous round */
+            return -1;
+        }
+        pos = q->head;
+    }
+
+    cell->data = ptr;
+    /* the data before the seq that lets the consumers see it */
+    __sync_synchronize();
+    cell->seq = pos + 1;
+
+    MpmcQueueWake(&q->not_empty, 0);
+    return 0;
+}
+
+/**
+ *  \brief Get a ptr from the queue, don't wait if it is empty.
+ *
+ *  \retval ptr the oldest ptr or NULL if the queue is empty
+ */
+void *MpmcQueueTryGet(MpmcQueue *q) {
+    MpmcQueueCell *cell;
+    uint32_t pos = q->tail;
+    int32_t diff;
+    void *ptr;
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        diff = (int32_t)(cell->seq - (pos + 1));
+        if (diff == 0) {
+            if (__sync_bool_compare_and_swap(&q->tail, pos, pos + 1))
+                break;
+        } else if (diff < 0) {
+            /* nothing put here yet in this round */
+            return NULL;
+        }
+        pos = q->tail;
+    }
+
+    ptr = cell->data;
+    /* read the data before the producers may overwrite it */
+    __sync_synchronize();
+    cell->seq = pos + q->mask + 1;
+
+    MpmcQueueWake(&q->not_full, 0);
+    return ptr;
+}
+
+/**
+ *  \brief Put a ptr in the queue, wait while it is full.
+ *
+ *  \retval 0 ok
+ *  \retval -1 wait interrupted because the queue shuts down
+ */
+int MpmcQueuePut(MpmcQueue *q, void *ptr) {
+    uint32_t spin = 0, seq;
+
+    while (MpmcQueueTryPut(q, ptr) != 0) {
+        if (q->shutdown)
+            return -1;
+
+        if (spin < MPMC_QUEUE_SPIN_CNT) {
+            spin++;
+            MpmcQueueRelax();
+            continue;
+        }
+
+        seq = q->not_full.seq;
+        __sync_fetch_and_add(&q->not_full.waiters, 1);
+        if (MpmcQueueTryPut(q, ptr) == 0) {
+            __sync_fetch_and_sub(&q->not_full.waiters, 1);
+            return 0;
+        }
+        if (q->shutdown == 0)
+            MpmcQueueSleep(&q->not_full, seq, 0);
+        __sync_fetch_and_sub(&q->not_full.waiters, 1);
+    }
+
+    return 0;
+}
+
+/**
+ *  \brief Get a ptr from the queue, wait while it is empty.
+ *
+ *  \retval ptr the oldest ptr or NULL if the queue shuts down
+ */
+void *MpmcQueueGet(MpmcQueue *q) {
+    uint32_t spin = 0, seq;
+    void *ptr;
+
+    while ((ptr = MpmcQueueTryGet(q)) == NULL) {
+        if (q->shutdown)
+            return NULL;
+
+        if (spin < MPMC_QUEUE_SPIN_CNT) {
+            spin++;
+            MpmcQueueRelax();
+            continue;
+        }
+
+        seq = q->not_empty.seq;
+        __sync_fetch_and_add(&q->not_empty.waiters, 1);
+        ptr = MpmcQueueTryGet(q);
+        if (ptr != NULL) {
+            __sync_fetch_and_sub(&q->not_empty.waiters, 1);
+            return ptr;
+        }
+        if (q->shutdown == 0)
+            MpmcQueueSleep(&q->not_empty, seq, 0);
+        __sync_fetch_and_sub(&q->not_empty.waiters, 1);
+    }
+
+    return ptr;
+}
+
+/**
+ *  \brief Get up to max ptrs from the queue with a single CAS, don't wait
+ *         if it is empty.
+ *
+ *  \retval cnt number of ptrs stored in ptrs, oldest first
+ */
+uint32_t MpmcQueueTryGetBulk(MpmcQueue *q, void **ptrs, uint32_t max) {
+    uint32_t pos, n, i;
+    int32_t diff;
+
+    for (;;) {
+        pos = q->tail;
+
+        diff = (int32_t)(q->cells[pos & q->mask].seq - (pos + 1));
+        if (diff < 0)
+            return 0;
+        if (diff > 0)
+            continue;
+
+        /* the run of slots from pos on that are ready */
+        for (n = 1; n < max && n < q->size; n++) {
+            if (q->cells[(pos + n) & q->mask].seq != pos + n + 1)
+                break;
+        }
+        if (__sync_bool_compare_and_swap(&q->tail, pos, pos + n))
+            break;
+    }
+
+    for (i = 0; i < n; i++)
+        ptrs[i] = q->cells[(pos + i) & q->mask].data;
+    __sync_synchronize();
+    for (i = 0; i < n; i++)
+        q->cells[(pos + i) & q->mask].seq = pos + i + q->mask + 1;
+
+    MpmcQueueWake(&q->not_full, n > 1);
+    return n;
+}
+
+/**
+ *  \brief Put up to cnt ptrs in the queue with a single CAS, don't wait
+ *         if it is full.
+ *
+ *  \retval n number of ptrs from the start of ptrs that were put
+ */
+uint32_t MpmcQueueTryPutBulk(MpmcQueue *q, void **ptrs, uint32_t cnt) {
+    uint32_t pos, n, i;
+    int32_t diff;
+
+    if (cnt == 0)
+        return 0;
+
+    for (;;) {
+        pos = q->head;
+
+        diff = (int32_t)(q->cells[pos & q->mask].seq - pos);
+        if (diff < 0)
+            return 0;
+        if (diff > 0)
+            continue;
+
+        /* the run of slots from pos on that are free */
+        for (n = 1; n < cnt && n < q->size; n++) {
+            if (q->cells[(pos + n) & q->mask].seq != pos + n)
+                break;
+        }
+        if (__sync_bool_compare_and_swap(&q->head, pos, pos + n))
+            break;
+    }
+
+    for (i = 0; i < n; i++)
+        q->cells[(pos + i) & q->mask].data = ptrs[i];
+    __sync_synchronize();
+    for (i = 0; i < n; i++)
+        q->cells[(pos + i) & q->mask].seq = pos + i + 1;
+
+    MpmcQueueWake(&q->not_empty, n > 1);
+    return n;
+}
+
+/**
+ *  \brief Wait until the queue has at least one ptr or shuts down.
+ *         Someone else can still take it before we do.
+ *
+ *  \param usec sleep at most this long, 0 to wait as long as it takes
+ *
+ *  \retval 0 the queue has a ptr
+ *  \retval -1 timeout or shutdown
+ */
+int MpmcQueueWaitNotEmpty(MpmcQueue *q, uint32_t usec) {
+    uint32_t spin = 0, seq;
+
+    while (MpmcQueueIsEmpty(q)) {
+        if (q->shutdown)
+            return -1;
+
+        if (spin < MPMC_QUEUE_SPIN_CNT) {
+            spin++;
+            MpmcQueueRelax();
+            continue;
+        }
+
+        seq = q->not_empty.seq;
+        __sync_fetch_and_add(&q->not_empty.waiters, 1);
+        if (MpmcQueueIsEmpty(q) && q->shutdown == 0)
+            MpmcQueueSleep(&q->not_empty, seq, usec);
+        __sync_fetch_and_sub(&q->not_empty.waiters, 1);
+
+        if (usec != 0)
+            return MpmcQueueIsEmpty(q) ? -1 : 0;
+    }
+
+    return 0;
+}
+
+/**
+ *  \brief Number of ptrs in the queue. Only a snapshot: the other
+ *         threads keep going while we look.
+ */
+uint32_t MpmcQueueLen(MpmcQueue *q) {
+    uint32_t tail = q->tail;
+    uint32_t head = q->head;
+    int32_t len = (int32_t)(head - tail);
+
+    if (len < 0)
+        return 0;
+    if ((uint32_t)len > q->size)
+        return q->size;
+    return (uint32_t)len;
+}
+
+int MpmcQueueIsEmpty(MpmcQueue *q) {
+    MpmcQueueCell *cell;
+    uint32_t pos = q->tail;
+
+    /* an item is there once its slot is ready for the consumers, a
+     * producer that claimed a position but didn't fill it doesn't count */
+    cell = &q->cells[pos & q->mask];
+    return ((int32_t)(cell->seq - (pos + 1)) < 0);
+}
+
+#ifdef UNITTESTS
+/** \test fill up, overflow, drain and wrap around */
+static int MpmcQueueTest01(void) {
+    int result = 0;
+    int array[16];
+    uint32_t cnt, round;
+    MpmcQueue *q = MpmcQueueInit(5);
+
+    if (q == NULL)
+        goto end;
+    if (q->size != 8) {
+        printf("size %" PRIu32 ", expected 8: ", q->size);
+        goto end;
+    }
+
+    for (round = 0; round < 3; round++) {
+        for (cnt = 0; cnt < 8; cnt++) {
+            if (MpmcQueueTryPut(q, &array[cnt]) != 0) {
+                printf("put %" PRIu32 " failed: ", cnt);
+                goto end;
+            }
+        }
+        if (MpmcQueueTryPut(q, &array[8]) != -1) {
+            printf("put in a full queue succeeded: ");
+            goto end;
+        }
+        if (MpmcQueueLen(q) != 8)
+            goto end;
+
+        for (cnt = 0; cnt < 8; cnt++) {
+            void *ptr = MpmcQueueTryGet(q);
+            if (ptr != &array[cnt]) {
+                printf("ptr is %p, expected %p: ", ptr, (void *)&array[cnt]);
+                goto end;
+            }
+        }
+        if (MpmcQueueTryGet(q) != NULL || !MpmcQueueIsEmpty(q)) {
+            printf("queue should be empty, isn't: ");
+            goto end;
+        }
+    }
+
+    result = 1;
+end:
+    MpmcQueueDestroy(q);
+    return result;
+}
+
+/** \test bulk get and put stop at the end of what is there */
+static int MpmcQueueTest03(void) {
+    int result = 0;
+    int array[8];
+    void *ptrs[8], *out[8];
+    uint32_t cnt;
+    MpmcQueue *q = MpmcQueueInit(8);
+
+    if (q == NULL)
+        goto end;
+
+    for (cnt = 0; cnt < 8; cnt++)
+        ptrs[cnt] = &array[cnt];
+
+    if (MpmcQueueTryPut(q, ptrs[0]) != 0)
+        goto end;
+    /* only 7 slots left */
+    if (MpmcQueueTryPutBulk(q, &ptrs[1], 8) != 7)
+        goto end;
+    if (MpmcQueueTryGetBulk(q, out, 3) != 3)
+        goto end;
+    if (out[0] != ptrs[0] || out[2] != ptrs[2])
+        goto end;
+    /* wraps around */
+    if (MpmcQueueTryPutBulk(q, ptrs, 3) != 3)
+        goto end;
+    if (MpmcQueueTryGetBulk(q, out, 8) != 8)
+        goto end;
+    if (out[0] != ptrs[3] || out[4] != ptrs[7] || out[5] != ptrs[0] ||
+        out[7] != ptrs[2])
+        goto end;
+    if (MpmcQueueTryGetBulk(q, out, 8) != 0)
+        goto end;
+
+    result = 1;
+end:
+    MpmcQueueDestroy(q);
+    return result;
+}
+
+#define MPMC_TEST_ITEMS 200000
+
+static MpmcQueue *mpmc_test_q = NULL;
+static uint64_t mpmc_test_sum = 0;
+
+static void *MpmcQueueTestProducer(void *arg) {
+    uintptr_t i;
+
+    for (i = 1; i <= MPMC_TEST_ITEMS; i++) {
+        if (MpmcQueuePut(mpmc_test_q, (void *)i) != 0)
+            break;
+    }
+    return NULL;
+}
+
+static void *MpmcQueueTestConsumer(void *arg) {
+    uint64_t sum = 0;
+    uint32_t i;
+
+    for (i = 0; i < MPMC_TEST_ITEMS; i++) {
+        void *ptr = MpmcQueueGet(mpmc_test_q);
+        if (ptr == NULL)
+            break;
+        sum += (uintptr_t)ptr;
+    }
+    __sync_fetch_and_add(&mpmc_test_sum, sum);
+    return NULL;
+}
+
+/** \test 2 producers and 2 consumers through a small queue, so both sides
+ *        have to sleep. Nothing may get lost or hang. */
+static int MpmcQueueTest02(void) {
+    pthread_t t[4];
+    uint64_t expect = (uint64_t)MPMC_TEST_ITEMS * (MPMC_TEST_ITEMS + 1);
+    int i;
+
+    mpmc_test_sum = 0;
+    mpmc_test_q = MpmcQueueInit(4);
+    if (mpmc_test_q == NULL)
+        return 0;
+
+    pthread_create(&t[0], NULL, MpmcQueueTestConsumer, NULL);
+    pthread_create(&t[1], NULL, MpmcQueueTestConsumer, NULL);
+    pthread_create(&t[2], NULL, MpmcQueueTestProducer, NULL);
+    pthread_create(&t[3], NULL, MpmcQueueTestProducer, NULL);
+    for (i = 0; i < 4; i++)
+        pthread_join(t[i], NULL);
+
+    MpmcQueueDestroy(mpmc_test_q);
+    mpmc_test_q = NULL;
+
+    if (mpmc_test_sum != expect) {
+        printf("sum %" PRIu64 ", expected %" PRIu64 ": ", mpmc_test_sum, expect);
+        return 0;
+    }
+    return 1;
+}
+#endif /* UNITTESTS */
+
+void MpmcQueueRegisterTests(void) {
+#ifdef UNITTESTS
+    UtRegisterTest("MpmcQueueTest01", MpmcQueueTest01, 1);
+    UtRegisterTest("MpmcQueueTest02", MpmcQueueTest02, 1);
+    UtRegisterTest("MpmcQueueTest03", MpmcQueueTest03, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,97 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * See the .c file for a full explanation.
+ */
+
+#ifndef __UTIL_MPMCQUEUE_H__
+#define __UTIL_MPMCQUEUE_H__
+
+#include "threads.h"
+
+#define MPMC_QUEUE_CACHE_LINE   64
+
+/** times a full or empty queue is checked again before the thread
+ *  goes to sleep */
+#define MPMC_QUEUE_SPIN_CNT     256
+
+/** \brief Wait point of one side of the queue, "not empty" or "not full".
+ *
+ *  A thread that wants to sleep reads seq, announces itself in waiters,
+ *  checks the queue once more and then sleeps for as long as seq is
+ *  unchanged. The other side bumps seq before waking anyone, so a wake up
+ *  that comes in between the check and the sleep isn't lost: the sleep
+ *  returns right away.
+ */
+typedef struct MpmcQueueWait_ {
+    volatile uint32_t seq;          /**< futex word */
+    volatile uint32_t waiters;      /**< threads in or going into a sleep */
+#ifndef __linux__
+    SCMutex m;
+    SCCondT cond;
+#endif /* __linux__ */
+} MpmcQueueWait;
+
+/** a slot: seq tells whose turn it is to use it, see the .c file */
+typedef struct MpmcQueueCell_ {
+    volatile uint32_t seq;
+    void *data;
+} MpmcQueueCell;
+
+/** \brief Bounded lock free queue for multiple producers and consumers.
+ *
+ *  The producer and the consumer positions are on cache lines of their
+ *  own, so the two sides don't bounce a line between them.
+ */
+typedef struct MpmcQueue_ {
+    volatile uint32_t head;         /**< next position to put at */
+    uint8_t pad0[MPMC_QUEUE_CACHE_LINE - sizeof(uint32_t)];
+    volatile uint32_t tail;         /**< next position to get from */
+    uint8_t pad1[MPMC_QUEUE_CACHE_LINE - sizeof(uint32_t)];
+
+    MpmcQueueWait not_empty;
+    uint8_t pad2[MPMC_QUEUE_CACHE_LINE];
+    MpmcQueueWait not_full;
+    uint8_t pad3[MPMC_QUEUE_CACHE_LINE];
+
+    uint32_t size;                  /**< slots, a power of 2 */
+    uint32_t mask;
+    volatile uint8_t shutdown;
+    MpmcQueueCell *cells;
+} MpmcQueue;
+
+MpmcQueue *MpmcQueueInit(uint32_t);
+void MpmcQueueDestroy(MpmcQueue *);
+void MpmcQueueShutdown(MpmcQueue *);
+
+int MpmcQueueTryPut(MpmcQueue *, void *);
+void *MpmcQueueTryGet(MpmcQueue *);
+int MpmcQueuePut(MpmcQueue *, void *);
+void *MpmcQueueGet(MpmcQueue *);
+uint32_t MpmcQueueTryGetBulk(MpmcQueue *, void **, uint32_t);
+uint32_t MpmcQueueTryPutBulk(MpmcQueue *, void **, uint32_t);
+int MpmcQueueWaitNotEmpty(MpmcQueue *, uint32_t);
+
+uint32_t MpmcQueueLen(MpmcQueue *);
+int MpmcQueueIsEmpty(MpmcQueue *);
+
+void MpmcQueueRegisterTests(void);
+
+#endif /* __UTIL_MPMCQUEUE_H__ */
@@ -41,6 +41,8 @@
  *           are lost. T0 now is done as well and enters it's own wait
  *           condition. T1 completes it's "wait" initialization. It waits for
  *           signals, but T0 won't be able to send them as it's waiting itself.
+ *
+ *  util-mpmcqueue.c has a queue that sleeps without this race.
  */
 //#define RINGBUFFER_MUTEX_WAIT
 
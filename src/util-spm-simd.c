@@ -0,0 +1,275 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * SIMD single pattern search. 16 (SSE2) or 32 (AVX2) positions of the
+ * text are tested at once against the first and the last byte of the
+ * pattern, and only the positions where both are in place are compared
+ * further. Like BasicSearch it needs no context, and it finds the first
+ * match, as Boyer Moore does.
+ *
+ * The nocase search tests (byte | 0x20) against the lower case of the
+ * pattern byte if that is a letter, which only 'A' and 'a' pass for 'a'.
+ * The compare lower cases 16 bytes at once.
+ *
+ * Which search we use is decided at runtime from the cpu, see
+ * UtilCpuGetSimd(). Without SSE2 the searches are BasicSearch.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+#include "util-debug.h"
+#include "util-cpu.h"
+
+#include "util-spm-simd.h"
+#include "util-spm-bs.h"
+
+#ifdef SPM_SIMD
+#include <immintrin.h>
+#endif
+
+static int spm_simd_level = -1;
+
+/** \brief pick the search for this cpu */
+void SimdSearchInit(void) {
+    uint8_t level = SPM_SIMD_NONE;
+#ifdef SPM_SIMD
+    uint32_t simd = UtilCpuGetSimd();
+
+    if (simd & UTIL_CPU_AVX2)
+        level = SPM_SIMD_AVX2;
+    else if (simd & UTIL_CPU_SSE2)
+        level = SPM_SIMD_SSE2;
+#endif
+    spm_simd_level = level;
+}
+
+/** \retval level SPM_SIMD_* search we use */
+uint8_t SimdSearchLevel(void) {
+    if (spm_simd_level < 0)
+        SimdSearchInit();
+    return (uint8_t)spm_simd_level;
+}
+
+#ifdef UNITTESTS
+/** \brief use another search than the cpu has, for the tests and the
+ *         stats. Can only be lower. */
+void SimdSearchSetLevel(uint8_t level) {
+    SimdSearchInit();
+    if (level < spm_simd_level)
+        spm_simd_level = level;
+}
+#endif
+
+static int SimdMemcmpNocaseScalar(const uint8_t *a, const uint8_t *b, uint32_t len) {
+    uint32_t i;
+    for (i = 0; i < len; i++) {
+        if (u8_tolower(a[i]) != u8_tolower(b[i]))
+            return 1;
+    }
+    return 0;
+}
+
+#ifdef SPM_SIMD
+/* lower case the upper case letters of v: those with v - 'A' <= 25 */
+#define SIMD_TOLOWER128(v) \
+    _mm_or_si128((v), _mm_and_si128(_mm_cmpeq_epi8(_mm_min_epu8( \
+        _mm_sub_epi8((v), _mm_set1_epi8('A')), _mm_set1_epi8(25)), \
+        _mm_sub_epi8((v), _mm_set1_epi8('A'))), _mm_set1_epi8(0x20)))
+
+__attribute__((target("sse2")))
+static int SimdMemcmpNocaseSSE2(const uint8_t *a, const uint8_t *b, uint32_t len) {
+    for ( ; len >= 16; a += 16, b += 16, len -= 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)a);
+        __m128i vb = _mm_loadu_si128((const __m128i *)b);
+
+        va = SIMD_TOLOWER128(va);
+        vb = SIMD_TOLOWER128(vb);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff)
+            return 1;
+    }
+    return SimdMemcmpNocaseScalar(a, b, len);
+}
+#endif /* SPM_SIMD */
+
+/**
+ * \brief compare two buffers ignoring the case of the letters
+ *
+ * \retval 0 equal, 1 not
+ */
+int SimdMemcmpNocase(const uint8_t *a, const uint8_t *b, uint32_t len) {
+#ifdef SPM_SIMD
+    if (SimdSearchLevel() != SPM_SIMD_NONE)
+        return SimdMemcmpNocaseSSE2(a, b, len);
+#endif
+    return SimdMemcmpNocaseScalar(a, b, len);
+}
+
+#ifdef SPM_SIMD
+/** \brief what the bytes at a position of the text have to be, or'ed with
+ *         the mask, to be the first resp. last byte of the needle */
+static inline void SimdSearchEdges(const uint8_t *needle, uint32_t needlelen,
+        int nocase, uint8_t *first, uint8_t *first_mask, uint8_t *last,
+        uint8_t *last_mask) {
+    uint8_t f = needle[0], l = needle[needlelen - 1];
+
+    *first_mask = *last_mask = 0;
+    if (nocase) {
+        if (isalpha(f)) {
+            f = u8_tolower(f);
+            *first_mask = 0x20;
+        }
+        if (isalpha(l)) {
+            l = u8_tolower(l);
+            *last_mask = 0x20;
+        }
+    }
+    *first = f;
+    *last = l;
+}
+
+/** \brief compare the bytes between the first and the last */
+static inline int SimdSearchVerify(const uint8_t *t, const uint8_t *needle,
+        uint32_t needlelen, int nocase) {
+    if (needlelen <= 2)
+        return 1;
+    if (nocase)
+        return SimdMemcmpNocaseSSE2(t + 1, needle + 1, needlelen - 2) == 0;
+    return memcmp(t + 1, needle + 1, needlelen - 2) == 0;
+}
+
+/** \brief the positions from i on that are too close to the end of the
+ *         text for a vector */
+static uint8_t *SimdSearchTail(const uint8_t *text, uint32_t textlen,
+        const uint8_t *needle, uint32_t needlelen, int nocase, uint32_t i) {
+    uint8_t f, fm, l, lm;
+    uint32_t last = needlelen - 1;
+
+    SimdSearchEdges(needle, needlelen, nocase, &f, &fm, &l, &lm);
+    for ( ; i + last < textlen; i++) {
+        if ((text[i] | fm) == f && (text[i + last] | lm) == l &&
+            SimdSearchVerify(text + i, needle, needlelen, nocase))
+            return (uint8_t *)text + i;
+    }
+    return NULL;
+}
+
+__attribute__((target("sse2")))
+static uint8_t *SimdSearchSSE2(const uint8_t *text, uint32_t textlen,
+        const uint8_t *needle, uint32_t needlelen, int nocase) {
+    uint8_t f, fm, l, lm;
+    uint32_t i, last = needlelen - 1;
+
+    SimdSearchEdges(needle, needlelen, nocase, &f, &fm, &l, &lm);
+    const __m128i vf = _mm_set1_epi8(f), vfm = _mm_set1_epi8(fm);
+    const __m128i vl = _mm_set1_epi8(l), vlm = _mm_set1_epi8(lm);
+
+    for (i = 0; i + last + 16 <= textlen; i += 16) {
+        __m128i bf = _mm_or_si128(_mm_loadu_si128((const __m128i *)(text + i)), vfm);
+        __m128i bl = _mm_or_si128(_mm_loadu_si128((const __m128i *)(text + i + last)), vlm);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(
+                    _mm_cmpeq_epi8(bf, vf), _mm_cmpeq_epi8(bl, vl)));
+
+        while (mask != 0) {
+            uint32_t bit = __builtin_ctz(mask);
+            if (SimdSearchVerify(text + i + bit, needle, needlelen, nocase))
+                return (uint8_t *)text + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return SimdSearchTail(text, textlen, needle, needlelen, nocase, i);
+}
+
+__attribute__((target("avx2")))
+static uint8_t *SimdSearchAVX2(const uint8_t *text, uint32_t textlen,
+        const uint8_t *needle, uint32_t needlelen, int nocase) {
+    uint8_t f, fm, l, lm;
+    uint32_t i, last = needlelen - 1;
+
+    SimdSearchEdges(needle, needlelen, nocase, &f, &fm, &l, &lm);
+    const __m256i vf = _mm256_set1_epi8(f), vfm = _mm256_set1_epi8(fm);
+    const __m256i vl = _mm256_set1_epi8(l), vlm = _mm256_set1_epi8(lm);
+
+    for (i = 0; i + last + 32 <= textlen; i += 32) {
+        __m256i bf = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(text + i)), vfm);
+        __m256i bl = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(text + i + last)), vlm);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(
+                    _mm256_cmpeq_epi8(bf, vf), _mm256_cmpeq_epi8(bl, vl)));
+
+        while (mask != 0) {
+            uint32_t bit = __builtin_ctz(mask);
+            if (SimdSearchVerify(text + i + bit, needle, needlelen, nocase))
+                return (uint8_t *)text + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    /* less than a 32 byte vector left, maybe a 16 byte one */
+    if (i + last >= textlen)
+        return NULL;
+    return SimdSearchSSE2(text + i, textlen - i, needle, needlelen, nocase);
+}
+#endif /* SPM_SIMD */
+
+/**
+ * \brief search the first match of a pattern in a text
+ *
+ * \param text the text
+ * \param textlen length of the text
+ * \param needle the pattern
+ * \param needlelen length of the pattern
+ *
+ * \retval ptr to start of the match; NULL if no match
+ */
+uint8_t *SimdSearch(const uint8_t *text, uint32_t textlen,
+        const uint8_t *needle, uint32_t needlelen) {
+    if (needlelen == 0 || needlelen > textlen)
+        return NULL;
+
+#ifdef SPM_SIMD
+    switch (SimdSearchLevel()) {
+        case SPM_SIMD_AVX2:
+            return SimdSearchAVX2(text, textlen, needle, needlelen, 0);
+        case SPM_SIMD_SSE2:
+            return SimdSearchSSE2(text, textlen, needle, needlelen, 0);
+    }
+#endif
+    return BasicSearch(text, textlen, needle, needlelen);
+}
+
+/**
+ * \brief search the first match of a pattern in a text, ignoring the case
+ *        of the letters in both
+ *
+ * \retval ptr to start of the match; NULL if no match
+ */
+uint8_t *SimdSearchNocase(const uint8_t *text, uint32_t textlen,
+        const uint8_t *needle, uint32_t needlelen) {
+    if (needlelen == 0 || needlelen > textlen)
+        return NULL;
+
+#ifdef SPM_SIMD
+    switch (SimdSearchLevel()) {
+        case SPM_SIMD_AVX2:
+            return SimdSearchAVX2(text, textlen, needle, needlelen, 1);
+        case SPM_SIMD_SSE2:
+            return SimdSearchSSE2(text, textlen, needle, needlelen, 1);
+    }
+#endif
+    return BasicSearchNocase(text, textlen, needle, needlelen);
+}
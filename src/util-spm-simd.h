@@ -0,0 +1,51 @@
+/* Copyright (C) 2007-2010 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ */
+
+#ifndef __UTIL_SPM_SIMD__
+#define __UTIL_SPM_SIMD__
+
+#include "suricata-common.h"
+#include "suricata.h"
+
+/* the vector searches are built for other targets than the one we're
+ * built for, and picked at runtime */
+#if defined(__GNUC__) && (defined(__x86_64) || defined(__i386)) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SPM_SIMD
+#endif
+
+enum {
+    SPM_SIMD_NONE = 0,
+    SPM_SIMD_SSE2,
+    SPM_SIMD_AVX2,
+};
+
+void SimdSearchInit(void);
+uint8_t SimdSearchLevel(void);
+uint8_t *SimdSearch(const uint8_t *, uint32_t, const uint8_t *, uint32_t);
+uint8_t *SimdSearchNocase(const uint8_t *, uint32_t, const uint8_t *, uint32_t);
+int SimdMemcmpNocase(const uint8_t *, const uint8_t *, uint32_t);
+
+#ifdef UNITTESTS
+void SimdSearchSetLevel(uint8_t);
+#endif
+
+#endif /* __UTIL_SPM_SIMD__ */
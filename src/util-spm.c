@@ -41,6 +41,10 @@
  * This is an aproximation, but use the stats and util-clock to determine which one
  * fit better for your case.
  *
+ * If the cpu has SSE2 the SIMD search (util-spm-simd.c) beats them all,
+ * for short and long patterns, and needs no context either. SpmSearch and
+ * SpmBmCtxSearch use it then.
+ *
  */
 
 #include <time.h>
@@ -55,6 +59,7 @@
 #include "util-spm-bs.h"
 #include "util-spm-bs2bm.h"
 #include "util-spm-bm.h"
+#include "util-spm-simd.h"
 #include "util-clock.h"
 
 
@@ -142,6 +147,41 @@ uint8_t *BoyerMooreNocaseSearch(uint8_t *text, uint32_t textlen, uint8_t *needle
     return ret;
 }
 
+/**
+ * \brief Search a pattern in the text with the SIMD search if the cpu can
+ *        do it, with Boyer Moore and the prepared context otherwise
+ *
+ * \param text Text to search in
+ * \param textlen length of the text
+ * \param needle pattern to search for
+ * \param needlelen length of the pattern
+ * \param bm_ctx Boyer Moore context of the pattern
+ */
+uint8_t *SpmBmCtxSearch(uint8_t *text, uint32_t textlen, uint8_t *needle, uint32_t needlelen, BmCtx *bm_ctx) {
+    if (SimdSearchLevel() != SPM_SIMD_NONE)
+        return SimdSearch(text, textlen, needle, needlelen);
+
+    return BoyerMoore(needle, needlelen, text, textlen, bm_ctx->bmGs, bm_ctx->bmBc);
+}
+
+/**
+ * \brief Search a pattern in the text with the SIMD nocase search if the
+ *        cpu can do it, with Boyer Moore nocase and the prepared context
+ *        otherwise
+ *
+ * \param text Text to search in
+ * \param textlen length of the text
+ * \param needle pattern to search for
+ * \param needlelen length of the pattern
+ * \param bm_ctx Boyer Moore nocase context of the pattern
+ */
+uint8_t *SpmBmCtxNocaseSearch(uint8_t *text, uint32_t textlen, uint8_t *needle, uint32_t needlelen, BmCtx *bm_ctx) {
+    if (SimdSearchLevel() != SPM_SIMD_NONE)
+        return SimdSearchNocase(text, textlen, needle, needlelen);
+
+    return BoyerMooreNocase(needle, needlelen, text, textlen, bm_ctx->bmGs, bm_ctx->bmBc);
+}
+
 
 #ifdef UNITTESTS
 
@@ -194,6 +234,38 @@ uint8_t *BasicSearchNocaseWrapper(uint8_t *text, uint8_t *needle, int times) {
     return ret;
 }
 
+uint8_t *SimdSearchWrapper(uint8_t *text, uint8_t *needle, int times) {
+    uint32_t textlen = strlen((char *)text);
+    uint32_t needlelen = strlen((char *)needle);
+
+    uint8_t *ret = NULL;
+    int i = 0;
+
+    CLOCK_INIT;
+    if (times > 1) CLOCK_START;
+    for (i = 0; i < times; i++) {
+        ret = SimdSearch(text, textlen, needle, needlelen);
+    }
+    if (times > 1) { CLOCK_END; CLOCK_PRINT_SEC; };
+    return ret;
+}
+
+uint8_t *SimdSearchNocaseWrapper(uint8_t *text, uint8_t *needle, int times) {
+    uint32_t textlen = strlen((char *)text);
+    uint32_t needlelen = strlen((char *)needle);
+
+    uint8_t *ret = NULL;
+    int i = 0;
+
+    CLOCK_INIT;
+    if (times > 1) CLOCK_START;
+    for (i = 0; i < times; i++) {
+        ret = SimdSearchNocase(text, textlen, needle, needlelen);
+    }
+    if (times > 1) { CLOCK_END; CLOCK_PRINT_SEC; };
+    return ret;
+}
+
 uint8_t *Bs2bmWrapper(uint8_t *text, uint8_t *needle, int times) {
     uint32_t textlen = strlen((char *)text);
     uint32_t needlelen = strlen((char *)needle);
@@ -539,6 +611,81 @@ int UtilSpmBoyerMooreSearchNocaseTestIssue130() {
         return 0;
 }
 
+int UtilSpmSimdSearchTest01() {
+    uint8_t *needle = (uint8_t *)"oPqRsT";
+    uint8_t *text = (uint8_t *)"aBcDeFgHiJkLmNoPqRsTuVwXyZ";
+    uint8_t *found = SimdSearchWrapper(text, needle, 1);
+    //printf("found: %s\n", found);
+    if (found != NULL)
+        return 1;
+    else
+        return 0;
+}
+
+int UtilSpmSimdSearchNocaseTest01() {
+    uint8_t *needle = (uint8_t *)"OpQrSt";
+    uint8_t *text = (uint8_t *)"aBcDeFgHiJkLmNoPqRsTuVwXyZ";
+    uint8_t *found = SimdSearchNocaseWrapper(text, needle, 1);
+    //printf("found: %s\n", found);
+    if (found != NULL)
+        return 1;
+    else
+        return 0;
+}
+
+/**
+ * \test Check that the SIMD search finds the same first match as the basic
+ *       search with each of the vector searches, for matches anywhere in
+ *       texts longer and shorter than a vector, and mixed case letters and
+ *       other bytes that are equal or'ed with 0x20
+ */
+int UtilSpmSimdSearchLevelsTest01() {
+    uint8_t text[80];
+    uint8_t needle[40];
+    uint8_t swapped[80];
+    uint8_t level;
+    int result = 0;
+    int textlen, needlelen, off;
+
+    for (level = SPM_SIMD_NONE; level <= SPM_SIMD_AVX2; level++) {
+        SimdSearchInit();
+        SimdSearchSetLevel(level);
+
+        for (textlen = 1; textlen <= (int)sizeof(text); textlen++) {
+            for (needlelen = 1; needlelen <= (int)sizeof(needle) && needlelen <= textlen; needlelen++) {
+                for (off = 0; off + needlelen <= textlen; off += 3) {
+                    int k;
+                    for (k = 0; k < textlen; k++)
+                        text[k] = "aA@`zZ"[(k * 7 + textlen) % 6];
+                    for (k = 0; k < needlelen; k++)
+                        needle[k] = "aA@`zZ"[(k * 5 + needlelen) % 6];
+                    memcpy(text + off, needle, needlelen);
+                    for (k = 0; k < textlen; k++)
+                        swapped[k] = isalpha(text[k]) ? text[k] ^ 0x20 : text[k];
+
+                    if (SimdSearch(text, textlen, needle, needlelen) !=
+                        BasicSearch(text, textlen, needle, needlelen)) {
+                        printf("level %u textlen %d needlelen %d off %d: ",
+                                level, textlen, needlelen, off);
+                        goto end;
+                    }
+                    if (SimdSearchNocase(swapped, textlen, needle, needlelen) !=
+                        BasicSearchNocase(swapped, textlen, needle, needlelen)) {
+                        printf("nocase level %u textlen %d needlelen %d off %d: ",
+                                level, textlen, needlelen, off);
+                        goto end;
+                    }
+                }
+            }
+        }
+    }
+
+    result = 1;
+end:
+    SimdSearchInit();
+    return result;
+}
+
 /* Generic tests that should not match */
 int UtilSpmBasicSearchTest02() {
     uint8_t *needle = (uint8_t *)"oPQRsT";
@@ -595,6 +742,28 @@ int UtilSpmBoyerMooreSearchTest02() {
         return 1;
 }
 
+int UtilSpmSimdSearchTest02() {
+    uint8_t *needle = (uint8_t *)"oPQRsT";
+    uint8_t *text = (uint8_t *)"aBcDeFgHiJkLmNoPqRsTuVwXyZ";
+    uint8_t *found = SimdSearchWrapper(text, needle, 1);
+    //printf("found: %s\n", found);
+    if (found != NULL)
+        return 0;
+    else
+        return 1;
+}
+
+int UtilSpmSimdSearchNocaseTest02() {
+    uint8_t *needle = (uint8_t *)"OpZrSt";
+    uint8_t *text = (uint8_t *)"aBcDeFgHiJkLmNoPqRsTuVwXyZ";
+    uint8_t *found = SimdSearchNocaseWrapper(text, needle, 1);
+    //printf("found: %s\n", found);
+    if (found != NULL)
+        return 0;
+    else
+        return 1;
+}
+
 int UtilSpmBoyerMooreSearchNocaseTest02() {
     uint8_t *needle = (uint8_t *)"OpZrSt";
     uint8_t *text = (uint8_t *)"aBcDeFgHiJkLmNoPqRsTuVwXyZ";
@@ -1036,6 +1205,11 @@ int UtilSpmSearchOffsetsTest01() {
                 printf("Error3 searching for %s in text %s\n", needle[i], text[i][j]);
                 return 0;
             }
+            found = SimdSearchWrapper((uint8_t *)text[i][j], (uint8_t *)needle[i], 1);
+            if (found == 0) {
+                printf("Error4 searching for %s in text %s\n", needle[i], text[i][j]);
+                return 0;
+            }
         }
     }
     return 1;
@@ -1471,6 +1645,11 @@ int UtilSpmSearchOffsetsNocaseTest01() {
                 printf("Error3 searching for %s in text %s\n", needle[i], text[i][j]);
                 return 0;
             }
+            found = SimdSearchNocaseWrapper((uint8_t *)text[i][j], (uint8_t *)needle[i], 1);
+            if (found == 0) {
+                printf("Error4 searching for %s in text %s\n", needle[i], text[i][j]);
+                return 0;
+            }
         }
     }
     return 1;
@@ -1538,6 +1717,12 @@ int UtilSpmSearchStatsTest01() {
             printf("Error3 searching for %s in text %s\n", needle[i], text[i]);
             return 0;
         }
+        printf("Pattern length %d with SimdSearch:", i+1);
+        found = SimdSearchWrapper((uint8_t *)text[i], (uint8_t *)needle[i], STATS_TIMES);
+        if (found == 0) {
+            printf("Error4 searching for %s in text %s\n", needle[i], text[i]);
+            return 0;
+        }
         printf("\n");
     }
     return 1;
@@ -1605,6 +1790,12 @@ int UtilSpmSearchStatsTest02() {
             printf("Error3 searching for %s in text %s\n", needle[i], text[i]);
             return 0;
         }
+        printf("Pattern length %d with SimdSearch:", i+1);
+        found = SimdSearchWrapper((uint8_t *)text[i], (uint8_t *)needle[i], STATS_TIMES);
+        if (found == 0) {
+            printf("Error4 searching for %s in text %s\n", needle[i], text[i]);
+            return 0;
+        }
         printf("\n");
     }
     return 1;
@@ -1670,6 +1861,12 @@ int UtilSpmSearchStatsTest03() {
             printf("Error3 searching for %s in text %s\n", needle[i], text[i]);
             return 0;
         }
+        printf("Pattern length %d with SimdSearch:", i+1);
+        found = SimdSearchWrapper((uint8_t *)text[i], (uint8_t *)needle[i], STATS_TIMES);
+        if (found == 0) {
+            printf("Error4 searching for %s in text %s\n", needle[i], text[i]);
+            return 0;
+        }
         printf("\n");
     }
     return 1;
@@ -1963,6 +2160,12 @@ int UtilSpmNocaseSearchStatsTest01() {
             printf("Error3 searching for %s in text %s\n", needle[i], text[i]);
             return 0;
         }
+        printf("Pattern length %d with SimdSearch:", i+1);
+        found = SimdSearchNocaseWrapper((uint8_t *)text[i], (uint8_t *)needle[i], STATS_TIMES);
+        if (found == 0) {
+            printf("Error4 searching for %s in text %s\n", needle[i], text[i]);
+            return 0;
+        }
         printf("\n");
     }
     return 1;
@@ -2027,6 +2230,12 @@ int UtilSpmNocaseSearchStatsTest02() {
             printf("Error3 searching for %s in text %s\n", needle[i], text[i]);
             return 0;
         }
+        printf("Pattern length %d with SimdSearch:", i+1);
+        found = SimdSearchNocaseWrapper((uint8_t *)text[i], (uint8_t *)needle[i], STATS_TIMES);
+        if (found == 0) {
+            printf("Error4 searching for %s in text %s\n", needle[i], text[i]);
+            return 0;
+        }
         printf("\n");
     }
     return 1;
@@ -2070,6 +2279,12 @@ int UtilSpmNocaseSearchStatsTest03() {
             printf("Error3 searching for %s in text %s\n", needle[i], text[i]);
             return 0;
         }
+        printf("Pattern length %d with SimdSearch:", i+1);
+        found = SimdSearchNocaseWrapper((uint8_t *)text[i], (uint8_t *)needle[i], STATS_TIMES);
+        if (found == 0) {
+            printf("Error4 searching for %s in text %s\n", needle[i], text[i]);
+            return 0;
+        }
         printf("\n");
     }
     return 1;
@@ -2316,6 +2531,12 @@ void UtilSpmSearchRegistertests(void) {
     UtRegisterTest("UtilSpmBoyerMooreSearchTest02", UtilSpmBoyerMooreSearchTest02, 1);
     UtRegisterTest("UtilSpmBoyerMooreSearchNocaseTest02", UtilSpmBoyerMooreSearchNocaseTest02, 1);
 
+    UtRegisterTest("UtilSpmSimdSearchTest01", UtilSpmSimdSearchTest01, 1);
+    UtRegisterTest("UtilSpmSimdSearchNocaseTest01", UtilSpmSimdSearchNocaseTest01, 1);
+    UtRegisterTest("UtilSpmSimdSearchTest02", UtilSpmSimdSearchTest02, 1);
+    UtRegisterTest("UtilSpmSimdSearchNocaseTest02", UtilSpmSimdSearchNocaseTest02, 1);
+    UtRegisterTest("UtilSpmSimdSearchLevelsTest01", UtilSpmSimdSearchLevelsTest01, 1);
+
     /* test matches at any offset */
     UtRegisterTest("UtilSpmSearchOffsetsTest01", UtilSpmSearchOffsetsTest01, 1);
     UtRegisterTest("UtilSpmSearchOffsetsNocaseTest01", UtilSpmSearchOffsetsNocaseTest01, 1);
@@ -27,6 +27,7 @@
 #include "util-spm-bs.h"
 #include "util-spm-bs2bm.h"
 #include "util-spm-bm.h"
+#include "util-spm-simd.h"
 
 /** Default algorithm to use: Boyer Moore */
 uint8_t *Bs2bmSearch(uint8_t *text, uint32_t textlen, uint8_t *needle, uint32_t needlelen);
@@ -34,10 +35,15 @@ uint8_t *Bs2bmNocaseSearch(uint8_t *text, uint32_t textlen, uint8_t *needle, uin
 uint8_t *BoyerMooreSearch(uint8_t *text, uint32_t textlen, uint8_t *needle, uint32_t needlelen);
 uint8_t *BoyerMooreNocaseSearch(uint8_t *text, uint32_t textlen, uint8_t *needle, uint32_t needlelen);
 
+uint8_t *SpmBmCtxSearch(uint8_t *, uint32_t, uint8_t *, uint32_t, BmCtx *);
+uint8_t *SpmBmCtxNocaseSearch(uint8_t *, uint32_t, uint8_t *, uint32_t, BmCtx *);
+
 /* Macros for automatic algorithm selection (use them only when you can't store the context) */
 #define SpmSearch(text, textlen, needle, needlelen) ({\
     uint8_t *mfound; \
-    if (needlelen < 4 && textlen < 512) \
+    if (SimdSearchLevel() != SPM_SIMD_NONE) \
+          mfound = SimdSearch(text, textlen, needle, needlelen); \
+    else if (needlelen < 4 && textlen < 512) \
           mfound = BasicSearch(text, textlen, needle, needlelen); \
     else if (needlelen < 4) \
           mfound = BasicSearch(text, textlen, needle, needlelen); \
@@ -48,7 +54,9 @@ uint8_t *BoyerMooreNocaseSearch(uint8_t *text, uint32_t textlen, uint8_t *needle
 
 #define SpmNocaseSearch(text, textlen, needle, needlelen) ({\
     uint8_t *mfound; \
-    if (needlelen < 4 && textlen < 512) \
+    if (SimdSearchLevel() != SPM_SIMD_NONE) \
+          mfound = SimdSearchNocase(text, textlen, needle, needlelen); \
+    else if (needlelen < 4 && textlen < 512) \
           mfound = BasicSearchNocase(text, textlen, needle, needlelen); \
     else if (needlelen < 4) \
           mfound = BasicSearchNocase(text, textlen, needle, needlelen); \
@@ -31,6 +31,12 @@ HashListTable *variable_names;
 HashListTable *variable_idxs;
 uint16_t variable_names_idx;
 
+/** detection engine ctxs using the hash. A reload builds a new ctx while
+ *  the old one is still in use, both share the names so flows keep their
+ *  flowbits and flowvars across the reload. */
+static uint32_t variable_names_users = 0;
+static SCMutex variable_names_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /** \brief Name2idx mapping structure for flowbits, flowvars and pktvars. */
 typedef struct VariableName_ {
     char *name;
@@ -99,29 +105,49 @@ static void VariableNameFree(void *data) {
     SCFree(fn);
 }
 
-/** \brief Initialize the Name idx hash.
- *  \param de_ctx Ptr to the detection engine ctx.
+/** \brief Initialize the Name idx hash, or start using the existing one.
  *  \retval -1 in case of error
  *  \retval 0 in case of success
  */
 int VariableNameInitHash() {
+    int r = 0;
+
+    SCMutexLock(&variable_names_lock);
+    if (variable_names_users++ > 0)
+        goto end;
+
     variable_names = HashListTableInit(4096, VariableNameHash, VariableNameCompare, VariableNameFree);
-    if (variable_names == NULL)
-        return -1;
+    if (variable_names == NULL) {
+        r = -1;
+        goto end;
+    }
 
     variable_idxs = HashListTableInit(4096, VariableIdxHash, VariableIdxCompare, NULL);
-    if (variable_idxs == NULL)
-        return -1;
+    if (variable_idxs == NULL) {
+        r = -1;
+        goto end;
+    }
 
     variable_names_idx = 0;
-    return 0;
+end:
+    SCMutexUnlock(&variable_names_lock);
+    return r;
 }
 
+/** \brief Stop using the Name idx hash, the last user frees it */
 void VariableNameFreeHash() {
+    SCMutexLock(&variable_names_lock);
+    if (variable_names_users > 0 && --variable_names_users > 0)
+        goto end;
+
     if (variable_names != NULL) {
         HashListTableFree(variable_names);
         HashListTableFree(variable_idxs);
+        variable_names = NULL;
+        variable_idxs = NULL;
     }
+end:
+    SCMutexUnlock(&variable_names_lock);
 }
 
 /** \brief Get a name idx for a name. If the name is already used reuse the idx.
@@ -144,6 +170,7 @@ uint16_t VariableNameGetIdx(char *name, uint8_t type) {
     if (fn->name == NULL)
         goto error;
 
+    SCMutexLock(&variable_names_lock);
     VariableName *lookup_fn = (VariableName *)HashListTableLookup(variable_names, (void *)fn, 0);
     if (lookup_fn == NULL) {
         variable_names_idx++;
@@ -155,6 +182,7 @@ uint16_t VariableNameGetIdx(char *name, uint8_t type) {
         idx = lookup_fn->idx;
         VariableNameFree(fn);
     }
+    SCMutexUnlock(&variable_names_lock);
 
     return idx;
 error:
@@ -180,9 +208,13 @@ char *VariableIdxGetName(uint16_t idx, uint8_t type)
     fn->type = type;
     fn->idx = idx;
 
+    SCMutexLock(&variable_names_lock);
     VariableName *lookup_fn = (VariableName *)HashListTableLookup(variable_idxs, (void *)fn, 0);
-    if (lookup_fn != NULL) {
+    if (lookup_fn != NULL)
         name = SCStrdup(lookup_fn->name);
+    SCMutexUnlock(&variable_names_lock);
+
+    if (lookup_fn != NULL) {
         if (name == NULL)
             goto error;
 